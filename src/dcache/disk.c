@@ -0,0 +1,1469 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       dcache/disk.c
+**
+** DESCRIPTION:     Disk dentry cache plugin.
+**
+**                  Bounds the memory taken by the dentry tree of a cartridge by
+**                  evicting the children of unused directories to a record store
+**                  under <work directory>/dcache/<name>, see disk_store.c. Each
+**                  evicted directory is one record keyed by its UID, holding its
+**                  <contents> element as written to the index, so the index writer
+**                  copies records without parsing them, and loading a directory
+**                  back parses a single record.
+**
+**                  Directories whose children are in memory are kept on an LRU
+**                  list. Once more than maxresident dentries are loaded, the least
+**                  recently used directory with nothing open below it is written
+**                  out together with its subdirectories and dropped from memory.
+**                  Directories in the index spill of the lazy index option are
+**                  managed by the spill instead.
+**
+**                  A meta file records the volume UUID and index generation the
+**                  store matches, and whether the cache was closed cleanly, so a
+**                  later mount of the same generation reuses the records of the
+**                  directories evicted at unmount instead of writing them again.
+**
+*************************************************************************************
+*/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "libltfs/ltfs.h"
+#include "libltfs/fs.h"
+#include "libltfs/xattr.h"
+#include "libltfs/index_spill.h"
+#include "libltfs/index_snapshot.h"
+#include "libltfs/xml_libltfs.h"
+#include "libltfs/dcache_ops.h"
+#include "ltfs_copyright.h"
+#include "disk_store.h"
+
+volatile char *copyright = LTFS_COPYRIGHT_0"\n"LTFS_COPYRIGHT_1"\n"LTFS_COPYRIGHT_2"\n" \
+	LTFS_COPYRIGHT_3"\n"LTFS_COPYRIGHT_4"\n"LTFS_COPYRIGHT_5"\n";
+
+#define DISK_DCACHE_DIR  "dcache"
+#define DISK_DCACHE_META "meta"
+
+/** Directories tried per eviction before giving up */
+#define DISK_EVICT_TRIES (8)
+
+/**
+ * State of the cache, kept in the meta file.
+ */
+struct disk_meta {
+	char uuid[37];                /**< Volume UUID */
+	unsigned int generation;      /**< Index generation the store matches */
+	bool dirty;                   /**< True if the store holds changes not on the medium */
+	bool closed;                  /**< True if the cache was closed cleanly */
+};
+
+/**
+ * Directory whose children are in memory, pointed to by its dcache_priv field.
+ */
+struct disk_node {
+	struct dentry *d;             /**< Directory */
+	uint64_t dentries;            /**< Number of children of the directory */
+	TAILQ_ENTRY(disk_node) lru;   /**< Position in the LRU list */
+};
+
+struct disk_dcache {
+	struct ltfs_volume *vol;      /**< Volume this cache belongs to */
+	char *workdir;                /**< LTFS work directory */
+	char *basedir;                /**< Directory holding the caches of all cartridges */
+	/* Protects the fields below and the dcache fields of dentries. Taken before the
+	 * dirty_lock of the index and before lock. */
+	ltfs_mutex_t tree_lock;
+	TAILQ_HEAD(disk_lru, disk_node) lru; /**< Loaded directories, least recently used first */
+	uint64_t resident;            /**< Children of the directories in lru */
+	uint64_t max_resident;        /**< Evict directories once resident goes above this */
+	bool trust;                   /**< True if records in the store match the tree */
+	/* Protects the fields below. No other lock is taken while it is held. */
+	ltfs_mutex_t lock;
+	char *name;                   /**< Assigned cartridge name, or NULL */
+	char *dir;                    /**< Directory of the assigned cache */
+	struct disk_store *store;     /**< Store of the assigned cache */
+	struct disk_meta meta;        /**< Meta data of the assigned cache */
+	bool failed;                  /**< True if a record could not be stored */
+	int lock_fd;                  /**< Advisory lock file, or -1 */
+	int maxsize;                  /**< Size limit of the store in GB, 0 for no limit */
+};
+
+/* The cache of the mounted cartridge; is_full has no handle argument */
+static struct disk_dcache *disk_active;
+
+static int _disk_cache_dir(const char *work_dir, const char *name, char **dir)
+{
+	if (asprintf(dir, "%s/"DISK_DCACHE_DIR"/%s", work_dir, name) < 0) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	return 0;
+}
+
+/**
+ * Read the meta file of a cache.
+ * @return 0 on success, -LTFS_NO_DENTRY if the cache does not exist or a negative
+ *         value on error.
+ */
+static int _disk_meta_read(const char *dir, struct disk_meta *meta)
+{
+	int dirty = 1, closed = 0;
+	char *path;
+	FILE *fp;
+
+	if (asprintf(&path, "%s/"DISK_DCACHE_META, dir) < 0) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	fp = fopen(path, "r");
+	free(path);
+	if (! fp)
+		return -LTFS_NO_DENTRY;
+
+	memset(meta, 0, sizeof(*meta));
+	if (fscanf(fp, "uuid=%36s\ngeneration=%u\ndirty=%d\nclosed=%d\n",
+			   meta->uuid, &meta->generation, &dirty, &closed) != 4) {
+		fclose(fp);
+		ltfsmsg(LTFS_WARN, 13505W, dir);
+		return -LTFS_NO_DENTRY;
+	}
+	fclose(fp);
+
+	meta->dirty = dirty;
+	meta->closed = closed;
+	return 0;
+}
+
+/**
+ * Replace the meta file of a cache. The new file is synced before it replaces the old one,
+ * so the meta file never claims more than the store holds.
+ */
+static int _disk_meta_write(const char *dir, const struct disk_meta *meta)
+{
+	int ret = 0;
+	char *path = NULL, *tmp = NULL;
+	FILE *fp;
+
+	if (asprintf(&path, "%s/"DISK_DCACHE_META, dir) < 0
+		|| asprintf(&tmp, "%s/"DISK_DCACHE_META".tmp", dir) < 0) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		free(path);
+		return -LTFS_NO_MEMORY;
+	}
+
+	fp = fopen(tmp, "w");
+	if (! fp) {
+		ret = -LTFS_FILE_ERR;
+		goto out;
+	}
+	if (fprintf(fp, "uuid=%s\ngeneration=%u\ndirty=%d\nclosed=%d\n", meta->uuid,
+			meta->generation, meta->dirty ? 1 : 0, meta->closed ? 1 : 0) < 0
+		|| fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+		ret = -LTFS_FILE_ERR;
+	if (fclose(fp) != 0)
+		ret = -LTFS_FILE_ERR;
+	if (ret == 0 && rename(tmp, path) < 0)
+		ret = -LTFS_FILE_ERR;
+
+out:
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 13506E, dir, errno);
+		unlink(tmp);
+	}
+	free(tmp);
+	free(path);
+	return ret;
+}
+
+/**
+ * Start tracking a directory whose children are in memory. Call with tree_lock held.
+ */
+static int _disk_node_add(struct disk_dcache *priv, struct dentry *d)
+{
+	struct disk_node *node;
+
+	node = calloc(1, sizeof(*node));
+	if (! node) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	node->d = d;
+	node->dentries = HASH_COUNT(d->child_list);
+	priv->resident += node->dentries;
+	TAILQ_INSERT_TAIL(&priv->lru, node, lru);
+	d->dcache_priv = node;
+	return 0;
+}
+
+/**
+ * Stop tracking a directory. Call with tree_lock held.
+ * @return Number of children the directory had.
+ */
+static uint64_t _disk_node_remove(struct disk_dcache *priv, struct dentry *d)
+{
+	uint64_t count;
+	struct disk_node *node = d->dcache_priv;
+
+	count = node->dentries;
+	TAILQ_REMOVE(&priv->lru, node, lru);
+	priv->resident -= count;
+	d->dcache_priv = NULL;
+	free(node);
+	return count;
+}
+
+/**
+ * Track the directories of a tree which have their children in memory. Subdirectories
+ * are added first, so the deepest directories are the first to be evicted. Call with
+ * tree_lock held and the volume lock held exclusively.
+ */
+static int _disk_node_add_tree(struct disk_dcache *priv, struct dentry *d)
+{
+	int ret = 0;
+	struct name_list *entry, *tmp;
+
+	/* Directories still deferred to the index spill have no children in memory */
+	if (d->spill && ! d->spill_loaded)
+		return 0;
+
+	HASH_ITER(hh, d->child_list, entry, tmp) {
+		if (entry->d->isdir) {
+			ret = _disk_node_add_tree(priv, entry->d);
+			if (ret < 0)
+				return ret;
+		}
+	}
+
+	if (! d->spill && ! d->dcache_evicted && ! d->dcache_priv)
+		ret = _disk_node_add(priv, d);
+	return ret;
+}
+
+/**
+ * Adjust the number of children of a tracked directory. Call with tree_lock held.
+ */
+static void _disk_node_count(struct disk_dcache *priv, struct dentry *d, bool add)
+{
+	struct disk_node *node = d ? d->dcache_priv : NULL;
+
+	if (! node)
+		return;
+	if (add) {
+		++node->dentries;
+		++priv->resident;
+	} else if (node->dentries) {
+		--node->dentries;
+		--priv->resident;
+	}
+}
+
+/**
+ * Check whether the children of a directory can be dropped from memory: nothing below it
+ * may be open or waiting to be written, and the directories below it must be outside the
+ * index spill. Call with the contents_lock of d held for write.
+ */
+static bool _disk_unused(struct dentry *d)
+{
+	struct dentry *child;
+	struct name_list *entry, *tmp;
+
+	/* The sync list of .LTFSEE_DATA relies on dirty flags, which records do not keep */
+	if (d->name.name && ! strcmp(d->name.name, ".LTFSEE_DATA"))
+		return false;
+
+	HASH_ITER(hh, d->child_list, entry, tmp) {
+		child = entry->d;
+		if (child->numhandles != 1 || child->out_of_sync || child->iosched_priv
+			|| child->dentry_proxy)
+			return false;
+		if (child->isdir && (child->spill
+			|| (! child->dcache_evicted && ! _disk_unused(child))))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Store a record for a directory and for every subdirectory whose children are in
+ * memory. Records are written deepest first. Call with tree_lock held.
+ */
+static int _disk_store_tree(struct disk_dcache *priv, struct dentry *d)
+{
+	int ret;
+	char *record;
+	size_t size;
+	struct name_list *entry, *tmp;
+
+	HASH_ITER(hh, d->child_list, entry, tmp) {
+		if (entry->d->isdir && ! entry->d->dcache_evicted) {
+			ret = _disk_store_tree(priv, entry->d);
+			if (ret < 0)
+				return ret;
+		}
+	}
+
+	/* While assigning the cache, records left by the last unmount match the tree */
+	if (priv->trust) {
+		ltfs_mutex_lock(&priv->lock);
+		ret = disk_store_get(priv->store, d->uid, NULL, NULL);
+		ltfs_mutex_unlock(&priv->lock);
+		if (ret == 0)
+			return 0;
+	}
+
+	ret = xml_dir_contents_to_record(d, priv->vol->index, &record, &size);
+	if (ret == 0 && size > UINT32_MAX) {
+		/* Store records are limited to 4 GB */
+		free(record);
+		ret = -LTFS_BAD_ARG;
+	}
+	if (ret == 0) {
+		ltfs_mutex_lock(&priv->lock);
+		ret = disk_store_put(priv->store, d->uid, record, size);
+		if (ret < 0)
+			priv->failed = true;
+		ltfs_mutex_unlock(&priv->lock);
+		free(record);
+	}
+	if (ret < 0)
+		ltfsmsg(LTFS_ERR, 13507E, (unsigned long long)d->uid, ret);
+	return ret;
+}
+
+/**
+ * Stop tracking the loaded directories below d. Call with tree_lock held.
+ * @return Number of children the directories had.
+ */
+static uint64_t _disk_node_remove_below(struct disk_dcache *priv, struct dentry *d)
+{
+	uint64_t count = 0;
+	struct name_list *entry, *tmp;
+
+	HASH_ITER(hh, d->child_list, entry, tmp) {
+		if (! entry->d->isdir || entry->d->dcache_evicted)
+			continue;
+		count += _disk_node_remove_below(priv, entry->d);
+		if (entry->d->dcache_priv)
+			count += _disk_node_remove(priv, entry->d);
+	}
+
+	return count;
+}
+
+/**
+ * Write the children of a directory to the store and drop them from memory.
+ * Call with tree_lock held.
+ * @return true if the directory was evicted, false if it is in use or cannot be stored.
+ */
+static bool _disk_evict_dir(struct disk_dcache *priv, struct dentry *d)
+{
+	uint64_t blocks, count;
+	struct ltfs_index *idx = priv->vol->index;
+
+	if (fs_prepare_dentry_locks(d) < 0 || ! try_acquirewrite_mrsw(&fs_dentry_locks(d)->contents_lock))
+		return false;
+	if (! _disk_unused(d) || _disk_store_tree(priv, d) < 0) {
+		releasewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
+		return false;
+	}
+
+	count = _disk_node_remove_below(priv, d);
+	count += _disk_node_remove(priv, d);
+	blocks = fs_release_children(d);
+	/* Readers which take the contents_lock after this see the flag set */
+	__atomic_store_n(&d->dcache_evicted, true, __ATOMIC_RELEASE);
+	releasewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
+
+	/* The files stay counted, as the index still describes them */
+	ltfs_mutex_lock(&idx->dirty_lock);
+	idx->valid_blocks -= blocks;
+	ltfs_mutex_unlock(&idx->dirty_lock);
+
+	ltfsmsg(LTFS_DEBUG, 13512D, (unsigned long long)d->uid, (unsigned long long)count);
+	return true;
+}
+
+/**
+ * Evict least recently used directories until the number of loaded dentries is below
+ * the limit. Call with tree_lock held.
+ * @param current Directory the caller is using, which is never evicted.
+ */
+static void _disk_evict(struct disk_dcache *priv, struct dentry *current)
+{
+	int tries = 0;
+	struct disk_node *node, *next;
+
+	/* The index writer walks the live tree while a snapshot is active */
+	if (index_snapshot_active(priv->vol->index->snapshot))
+		return;
+
+	/* Records are parsed like the index, which must give files their UIDs */
+	if (priv->vol->index->version < IDX_VERSION_UID)
+		return;
+
+	node = TAILQ_FIRST(&priv->lru);
+	while (node && priv->resident > priv->max_resident && tries < DISK_EVICT_TRIES) {
+		next = TAILQ_NEXT(node, lru);
+		if (node->d != current && _disk_evict_dir(priv, node->d))
+			next = TAILQ_FIRST(&priv->lru);
+		else
+			++tries;
+		node = next;
+	}
+}
+
+struct disk_record {
+	char *buf;                    /**< Record of a directory */
+	uint32_t size;                /**< Size of the record */
+};
+
+static int _disk_parse_record(struct dentry *dir, struct ltfs_index *idx, void *arg)
+{
+	struct disk_record *rec = arg;
+	return xml_dir_contents_from_record(rec->buf, rec->size, dir, idx);
+}
+
+/**
+ * Load the children of an evicted directory from its record. Call with tree_lock held.
+ */
+static int _disk_load_dir(struct disk_dcache *priv, struct dentry *d)
+{
+	int ret;
+	uint64_t files = 0;
+	struct disk_record rec = {NULL, 0};
+	struct name_list *entry, *tmp;
+	struct ltfs_index *idx = priv->vol->index;
+
+	ltfs_mutex_lock(&priv->lock);
+	ret = disk_store_get(priv->store, d->uid, &rec.buf, &rec.size);
+	ltfs_mutex_unlock(&priv->lock);
+	if (ret == 0)
+		ret = index_spill_attach(d, idx, _disk_parse_record, &rec);
+	free(rec.buf);
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 13511E, (unsigned long long)d->uid, ret);
+		return ret;
+	}
+
+	/* The files were still counted while the directory was evicted */
+	HASH_ITER(hh, d->child_list, entry, tmp) {
+		if (! entry->d->isdir)
+			++files;
+	}
+	ltfs_mutex_lock(&idx->dirty_lock);
+	idx->file_count -= files;
+	ltfs_mutex_unlock(&idx->dirty_lock);
+
+	__atomic_store_n(&d->dcache_evicted, false, __ATOMIC_RELEASE);
+
+	/* An untracked directory is never evicted, which is safe */
+	_disk_node_add(priv, d);
+	return 0;
+}
+
+/**
+ * Write out buffered records and record that the store matches the medium.
+ * Call with priv->lock held.
+ */
+static int _disk_sync(struct disk_dcache *priv)
+{
+	int ret = disk_store_flush(priv->store);
+	if (ret == 0)
+		ret = _disk_meta_write(priv->dir, &priv->meta);
+	return ret;
+}
+
+void *disk_init(const struct dcache_options *options, struct ltfs_volume *vol)
+{
+	int ret;
+	struct disk_dcache *priv;
+
+	priv = calloc(1, sizeof(*priv));
+	if (! priv) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return NULL;
+	}
+
+	ret = ltfs_mutex_init(&priv->tree_lock);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10002E, ret);
+		free(priv);
+		return NULL;
+	}
+	ret = ltfs_mutex_init(&priv->lock);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10002E, ret);
+		ltfs_mutex_destroy(&priv->tree_lock);
+		free(priv);
+		return NULL;
+	}
+	TAILQ_INIT(&priv->lru);
+	priv->vol = vol;
+	priv->lock_fd = -1;
+	priv->maxsize = options ? options->maxsize : 0;
+	priv->max_resident = (options && options->maxresident) ?
+		options->maxresident : INDEX_SPILL_DEFAULT_LIMIT;
+
+	ltfsmsg(LTFS_INFO, 13500I);
+	return priv;
+}
+
+int disk_unassign_name(void *dcache_handle);
+
+int disk_destroy(void *dcache_handle)
+{
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	if (priv->name)
+		disk_unassign_name(priv);
+	if (priv->lock_fd >= 0)
+		close(priv->lock_fd);
+	if (disk_active == priv)
+		disk_active = NULL;
+
+	ltfs_mutex_destroy(&priv->lock);
+	ltfs_mutex_destroy(&priv->tree_lock);
+	free(priv->basedir);
+	free(priv->workdir);
+	free(priv);
+
+	ltfsmsg(LTFS_INFO, 13508I);
+	return 0;
+}
+
+int disk_mkcache(const char *name, void *dcache_handle)
+{
+	int ret;
+	char *dir;
+	struct disk_store *store;
+	struct disk_dcache *priv = dcache_handle;
+	struct ltfs_volume *vol;
+
+	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv->basedir, -LTFS_NULL_ARG);
+
+	vol = priv->vol;
+	if (! vol->index || ! vol->index->root)
+		return -LTFS_BAD_ARG;
+
+	ret = _disk_cache_dir(priv->workdir, name, &dir);
+	if (ret < 0)
+		return ret;
+
+	ltfsmsg(LTFS_INFO, 13509I, name);
+
+	/* Start from an empty store; a stale meta file must not outlive the old runs.
+	 * Records are only written once directories are evicted. */
+	ret = disk_store_clear(dir);
+	if (ret == 0)
+		ret = disk_store_open(dir, &store);
+	if (ret < 0) {
+		free(dir);
+		return ret;
+	}
+	if (disk_store_close(store) < 0)
+		ret = -LTFS_FILE_ERR;
+
+	if (ret == 0) {
+		struct disk_meta meta;
+
+		memset(&meta, 0, sizeof(meta));
+		strncpy(meta.uuid, vol->label->vol_uuid, sizeof(meta.uuid) - 1);
+		meta.generation = vol->index->generation;
+		meta.dirty = vol->index->dirty;
+		meta.closed = true;
+		ret = _disk_meta_write(dir, &meta);
+	}
+
+	free(dir);
+	return ret;
+}
+
+int disk_rmcache(const char *name, void *dcache_handle)
+{
+	int ret;
+	char *dir, *path;
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv->basedir, -LTFS_NULL_ARG);
+
+	ret = _disk_cache_dir(priv->workdir, name, &dir);
+	if (ret < 0)
+		return ret;
+
+	if (asprintf(&path, "%s/"DISK_DCACHE_META, dir) < 0) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		free(dir);
+		return -LTFS_NO_MEMORY;
+	}
+	unlink(path);
+	free(path);
+
+	ret = disk_store_clear(dir);
+	rmdir(dir);
+	free(dir);
+	return ret;
+}
+
+int disk_cache_exists(const char *name, bool *exists, void *dcache_handle)
+{
+	int ret;
+	char *dir;
+	struct disk_meta meta;
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(exists, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv->basedir, -LTFS_NULL_ARG);
+
+	ret = _disk_cache_dir(priv->workdir, name, &dir);
+	if (ret < 0)
+		return ret;
+	ret = _disk_meta_read(dir, &meta);
+	free(dir);
+
+	*exists = (ret == 0);
+	return (ret == -LTFS_NO_DENTRY) ? 0 : ret;
+}
+
+int disk_set_workdir(const char *workdir, bool clean, void *dcache_handle)
+{
+	DIR *dir;
+	struct dirent *ent;
+	char *basedir, *copy;
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(workdir, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	if (asprintf(&basedir, "%s/"DISK_DCACHE_DIR, workdir) < 0) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	copy = strdup(workdir);
+	if (! copy) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		free(basedir);
+		return -LTFS_NO_MEMORY;
+	}
+	if (mkdir(basedir, 0700) < 0 && errno != EEXIST) {
+		ltfsmsg(LTFS_ERR, 13501E, basedir, errno);
+		free(basedir);
+		free(copy);
+		return -LTFS_FILE_ERR;
+	}
+
+	free(priv->basedir);
+	free(priv->workdir);
+	priv->basedir = basedir;
+	priv->workdir = copy;
+
+	if (clean) {
+		dir = opendir(basedir);
+		while (dir && (ent = readdir(dir))) {
+			if (ent->d_name[0] != '.' && ! strstr(ent->d_name, ".lock"))
+				disk_rmcache(ent->d_name, priv);
+		}
+		if (dir)
+			closedir(dir);
+	}
+
+	return 0;
+}
+
+int disk_get_workdir(char **workdir, void *dcache_handle)
+{
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(workdir, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv->workdir, -LTFS_NULL_ARG);
+
+	*workdir = strdup(priv->workdir);
+	if (! *workdir) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	return 0;
+}
+
+int disk_assign_name(const char *name, void *dcache_handle)
+{
+	int ret;
+	char *dir, *copy;
+	struct disk_store *store;
+	struct disk_meta meta;
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv->basedir, -LTFS_NULL_ARG);
+
+	if (priv->name)
+		return -LTFS_BAD_ARG;
+
+	ret = _disk_cache_dir(priv->workdir, name, &dir);
+	if (ret < 0)
+		return ret;
+	ret = _disk_meta_read(dir, &meta);
+	if (ret < 0) {
+		/* mkcache must come first */
+		free(dir);
+		return ret;
+	}
+	copy = strdup(name);
+	if (! copy) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		free(dir);
+		return -LTFS_NO_MEMORY;
+	}
+	ret = disk_store_open(dir, &store);
+	if (ret < 0) {
+		free(copy);
+		free(dir);
+		return ret;
+	}
+
+	/* Until unassign_name, a crash leaves the store behind the live tree */
+	meta.closed = false;
+	ret = _disk_meta_write(dir, &meta);
+	if (ret < 0) {
+		disk_store_close(store);
+		free(copy);
+		free(dir);
+		return ret;
+	}
+
+	ltfs_mutex_lock(&priv->lock);
+	priv->failed = false;
+	priv->dir = dir;
+	priv->store = store;
+	priv->meta = meta;
+	disk_active = priv;
+	ltfs_mutex_unlock(&priv->lock);
+
+	/* Track the directories loaded from the index and evict down to the limit. Records a
+	 * reused cache holds were written for the index the tree was read from, so they are
+	 * kept; a new cache has none. */
+	acquirewrite_mrsw(&priv->vol->lock);
+	ltfs_mutex_lock(&priv->tree_lock);
+	ret = _disk_node_add_tree(priv, priv->vol->index->root);
+	if (ret == 0) {
+		priv->name = copy;
+		priv->trust = true;
+		_disk_evict(priv, NULL);
+		priv->trust = false;
+	}
+	ltfs_mutex_unlock(&priv->tree_lock);
+	releasewrite_mrsw(&priv->vol->lock);
+
+	if (ret < 0) {
+		free(copy);
+		disk_unassign_name(priv);
+		return ret;
+	}
+
+	return 0;
+}
+
+int disk_unassign_name(void *dcache_handle)
+{
+	int ret;
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	ltfs_mutex_lock(&priv->tree_lock);
+	ltfs_mutex_lock(&priv->lock);
+	if (! priv->store) {
+		ltfs_mutex_unlock(&priv->lock);
+		ltfs_mutex_unlock(&priv->tree_lock);
+		return 0;
+	}
+
+	/* Records of directories which were loaded again no longer match the tree. What
+	 * remains are the records of directories evicted in the final index. */
+	ret = 0;
+	while (! TAILQ_EMPTY(&priv->lru)) {
+		struct dentry *d = TAILQ_FIRST(&priv->lru)->d;
+		if (ret == 0)
+			ret = disk_store_remove(priv->store, d->uid);
+		_disk_node_remove(priv, d);
+	}
+
+	if (ret == 0)
+		ret = disk_store_flush(priv->store);
+	if (ret == 0)
+		ret = disk_store_compact(priv->store);
+	if (disk_store_close(priv->store) < 0 && ret == 0)
+		ret = -LTFS_FILE_ERR;
+	priv->store = NULL;
+	if (ret == 0) {
+		/* A store which missed a change must be rebuilt by the next mount */
+		priv->meta.closed = ! priv->failed;
+		ret = _disk_meta_write(priv->dir, &priv->meta);
+	}
+
+	free(priv->name);
+	free(priv->dir);
+	priv->name = NULL;
+	priv->dir = NULL;
+	if (disk_active == priv)
+		disk_active = NULL;
+	ltfs_mutex_unlock(&priv->lock);
+	ltfs_mutex_unlock(&priv->tree_lock);
+
+	return ret;
+}
+
+int disk_is_name_assigned(bool *assigned, void *dcache_handle)
+{
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(assigned, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	*assigned = (priv->name != NULL);
+	return 0;
+}
+
+int disk_wipe_dentry_tree(void *dcache_handle)
+{
+	/* Directories are evicted one at a time by load, never the whole tree at once */
+	return 0;
+}
+
+int disk_set_vol_uuid(const char *uuid, void *dcache_handle)
+{
+	int ret = 0;
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(uuid, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	ltfs_mutex_lock(&priv->lock);
+	if (priv->name && strcmp(priv->meta.uuid, uuid)) {
+		strncpy(priv->meta.uuid, uuid, sizeof(priv->meta.uuid) - 1);
+		ret = _disk_meta_write(priv->dir, &priv->meta);
+	}
+	ltfs_mutex_unlock(&priv->lock);
+
+	return ret;
+}
+
+int disk_get_vol_uuid(const char *work_dir, const char *name, char **uuid)
+{
+	int ret;
+	char *dir;
+	struct disk_meta meta;
+
+	CHECK_ARG_NULL(work_dir, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(uuid, -LTFS_NULL_ARG);
+
+	ret = _disk_cache_dir(work_dir, name, &dir);
+	if (ret < 0)
+		return ret;
+	ret = _disk_meta_read(dir, &meta);
+	free(dir);
+	if (ret < 0)
+		return ret;
+
+	*uuid = strdup(meta.uuid);
+	if (! *uuid) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	return 0;
+}
+
+int disk_set_generation(unsigned int gen, void *dcache_handle)
+{
+	int ret = 0;
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	/* A new index is on the medium; the store must hold everything it describes */
+	ltfs_mutex_lock(&priv->lock);
+	if (priv->name) {
+		priv->meta.generation = gen;
+		ret = _disk_sync(priv);
+	}
+	ltfs_mutex_unlock(&priv->lock);
+
+	return ret;
+}
+
+int disk_get_generation(const char *work_dir, const char *name, unsigned int *gen)
+{
+	int ret;
+	char *dir;
+	struct disk_meta meta;
+
+	CHECK_ARG_NULL(work_dir, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(gen, -LTFS_NULL_ARG);
+
+	ret = _disk_cache_dir(work_dir, name, &dir);
+	if (ret < 0)
+		return ret;
+	ret = _disk_meta_read(dir, &meta);
+	free(dir);
+	if (ret == 0)
+		*gen = meta.generation;
+	return ret;
+}
+
+int disk_set_dirty(bool dirty, void *dcache_handle)
+{
+	int ret = 0;
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	ltfs_mutex_lock(&priv->lock);
+	if (priv->name && priv->meta.dirty != dirty) {
+		priv->meta.dirty = dirty;
+		/* Going clean means an index reached the medium; write the records out first */
+		ret = dirty ? _disk_meta_write(priv->dir, &priv->meta) : _disk_sync(priv);
+	}
+	ltfs_mutex_unlock(&priv->lock);
+
+	return ret;
+}
+
+int disk_get_dirty(const char *work_dir, const char *name, bool *dirty)
+{
+	int ret;
+	char *dir;
+	struct disk_meta meta;
+
+	CHECK_ARG_NULL(work_dir, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(dirty, -LTFS_NULL_ARG);
+
+	ret = _disk_cache_dir(work_dir, name, &dir);
+	if (ret < 0)
+		return ret;
+	ret = _disk_meta_read(dir, &meta);
+	free(dir);
+
+	/* A cache which was not closed cleanly may have missed changes */
+	if (ret == 0)
+		*dirty = meta.dirty || ! meta.closed;
+	return ret;
+}
+
+/* The store lives in plain files of the work directory, there is no separate disk image.
+ * The maxsize option caps the bytes the store may take there. */
+int disk_diskimage_create(void *dcache_handle)
+{
+	return 0;
+}
+
+int disk_diskimage_remove(void *dcache_handle)
+{
+	return 0;
+}
+
+int disk_diskimage_mount(void *dcache_handle)
+{
+	return 0;
+}
+
+int disk_diskimage_unmount(void *dcache_handle)
+{
+	return 0;
+}
+
+bool disk_diskimage_is_full(void)
+{
+	bool full = false;
+	struct disk_dcache *priv = disk_active;
+
+	if (! priv || priv->maxsize <= 0)
+		return false;
+
+	ltfs_mutex_lock(&priv->lock);
+	if (priv->store)
+		full = disk_store_disk_size(priv->store) >= ((uint64_t)priv->maxsize << 30);
+	ltfs_mutex_unlock(&priv->lock);
+
+	return full;
+}
+
+int disk_get_advisory_lock(const char *name, void *dcache_handle)
+{
+	char *path;
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv->basedir, -LTFS_NULL_ARG);
+
+	if (priv->lock_fd >= 0)
+		return -LTFS_BAD_ARG;
+
+	if (asprintf(&path, "%s/%s.lock", priv->basedir, name) < 0) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	priv->lock_fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (priv->lock_fd < 0) {
+		ltfsmsg(LTFS_ERR, 13501E, path, errno);
+		free(path);
+		return -LTFS_FILE_ERR;
+	}
+	if (flock(priv->lock_fd, LOCK_EX | LOCK_NB) < 0) {
+		/* Another process uses the cache of this cartridge */
+		ltfsmsg(LTFS_ERR, 13510E, path);
+		close(priv->lock_fd);
+		priv->lock_fd = -1;
+		free(path);
+		return -LTFS_DEVICE_UNREADY;
+	}
+	free(path);
+
+	return 0;
+}
+
+int disk_put_advisory_lock(const char *name, void *dcache_handle)
+{
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	if (priv->lock_fd >= 0) {
+		flock(priv->lock_fd, LOCK_UN);
+		close(priv->lock_fd);
+		priv->lock_fd = -1;
+	}
+	return 0;
+}
+
+int disk_open(const char *path, struct dentry **d, void *dcache_handle)
+{
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(path, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	return fs_path_lookup(path, 0, d, priv->vol->index);
+}
+
+int disk_openat(const char *parent_path, struct dentry *parent, const char *name,
+	struct dentry **result, void *dcache_handle)
+{
+	int ret;
+
+	CHECK_ARG_NULL(parent, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(result, -LTFS_NULL_ARG);
+
+	acquireread_mrsw(&fs_dentry_locks(parent)->contents_lock);
+	ret = fs_directory_lookup(parent, name, result);
+	releaseread_mrsw(&fs_dentry_locks(parent)->contents_lock);
+
+	return ret;
+}
+
+int disk_close(struct dentry *d, bool lock_meta, bool descend, void *dcache_handle)
+{
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+
+	/* Handles only pin the dentry itself, so there is nothing to descend into */
+	if (lock_meta)
+		fs_release_dentry(d);
+	else
+		fs_release_dentry_unlocked(d);
+	return 0;
+}
+
+int disk_create(const char *path, struct dentry *d, void *dcache_handle)
+{
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	/* The new dentry is in memory; it reaches the store when its parent is evicted */
+	ltfs_mutex_lock(&priv->tree_lock);
+	_disk_node_count(priv, d->parent, true);
+	ltfs_mutex_unlock(&priv->tree_lock);
+
+	return 0;
+}
+
+int disk_unlink(const char *path, struct dentry *d, void *dcache_handle)
+{
+	int ret = 0;
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	/* The caller holds the meta_lock of d and its parent */
+	ltfs_mutex_lock(&priv->tree_lock);
+	_disk_node_count(priv, d->parent, false);
+	ltfs_mutex_unlock(&priv->tree_lock);
+
+	/* A removed directory may have a record left from an earlier eviction */
+	if (d->isdir) {
+		ltfs_mutex_lock(&priv->lock);
+		if (priv->store)
+			ret = disk_store_remove(priv->store, d->uid);
+		if (ret < 0)
+			priv->failed = true;
+		ltfs_mutex_unlock(&priv->lock);
+	}
+
+	return ret;
+}
+
+int disk_rename(const char *oldpath, const char *newpath, struct dentry **old_dentry,
+	void *dcache_handle)
+{
+	CHECK_ARG_NULL(old_dentry, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(*old_dentry, -LTFS_NULL_ARG);
+
+	/* Both parents are loaded, so the move happens in memory only. The records of an
+	 * evicted directory being moved are keyed by UID and stay valid. */
+	return 0;
+}
+
+int disk_flush(struct dentry *d, enum dcache_flush_flags flags, void *dcache_handle)
+{
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+
+	/* Changes are picked up when the parent directory is evicted */
+	return 0;
+}
+
+int disk_readdir(struct dentry *d, bool dentries, void ***result, void *dcache_handle)
+{
+	int ret;
+	size_t i = 0, count;
+	void **list;
+	struct name_list *entry, *tmp;
+
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(result, -LTFS_NULL_ARG);
+
+	/* The caller holds the contents_lock of d */
+	ret = index_spill_load(d, true);
+	if (ret < 0)
+		return ret;
+
+	count = HASH_COUNT(d->child_list);
+	list = calloc(count + 1, sizeof(void *));
+	if (! list) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+
+	HASH_ITER(hh, d->child_list, entry, tmp) {
+		if (dentries) {
+			ret = fs_prepare_dentry_locks(entry->d);
+			if (ret < 0) {
+				while (i)
+					fs_release_dentry(list[--i]);
+				free(list);
+				return ret;
+			}
+			acquirewrite_mrsw(&fs_dentry_locks(entry->d)->meta_lock);
+			++entry->d->numhandles;
+			releasewrite_mrsw(&fs_dentry_locks(entry->d)->meta_lock);
+			list[i++] = entry->d;
+		} else if (entry->d->platform_safe_name) {
+			list[i] = strdup(entry->d->platform_safe_name);
+			if (! list[i]) {
+				ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+				while (i)
+					free(list[--i]);
+				free(list);
+				return -LTFS_NO_MEMORY;
+			}
+			++i;
+		}
+	}
+
+	*result = list;
+	return 0;
+}
+
+int disk_read_direntry(struct dentry *d, struct ltfs_direntry *dirent, unsigned long index,
+	void *dcache_handle)
+{
+	int ret;
+	unsigned long i = 0;
+	struct dentry *target = NULL;
+	struct name_list *entry, *tmp;
+
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(dirent, -LTFS_NULL_ARG);
+
+	acquireread_mrsw(&fs_dentry_locks(d)->contents_lock);
+	ret = index_spill_load(d, true);
+	if (ret == 0) {
+		HASH_ITER(hh, d->child_list, entry, tmp) {
+			if (entry->d->deleted || ! entry->d->platform_safe_name)
+				continue;
+			if (i++ == index) {
+				target = entry->d;
+				break;
+			}
+		}
+	}
+	releaseread_mrsw(&fs_dentry_locks(d)->contents_lock);
+
+	if (ret < 0)
+		return ret;
+	if (! target)
+		return -LTFS_NO_DENTRY;
+
+	acquireread_mrsw(&fs_dentry_locks(target)->meta_lock);
+	dirent->creation_time = target->creation_time;
+	dirent->access_time   = target->access_time;
+	dirent->modify_time   = target->modify_time;
+	dirent->change_time   = target->change_time;
+	dirent->isdir         = target->isdir;
+	dirent->readonly      = target->readonly;
+	dirent->isslink       = target->isslink;
+	dirent->realsize      = target->realsize;
+	dirent->size          = target->size;
+	dirent->name          = target->name.name;
+	dirent->platform_safe_name = target->platform_safe_name;
+	releaseread_mrsw(&fs_dentry_locks(target)->meta_lock);
+
+	return 0;
+}
+
+int disk_setxattr(const char *path, struct dentry *d, const char *xattr, const char *value,
+	size_t size, int flags, void *dcache_handle)
+{
+	return disk_flush(d, FLUSH_XATTRS, dcache_handle);
+}
+
+int disk_removexattr(const char *path, struct dentry *d, const char *xattr, void *dcache_handle)
+{
+	return disk_flush(d, FLUSH_XATTRS, dcache_handle);
+}
+
+int disk_listxattr(const char *path, struct dentry *d, char *list, size_t size,
+	void *dcache_handle)
+{
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+	return xattr_list(d, list, size, priv->vol);
+}
+
+int disk_getxattr(const char *path, struct dentry *d, const char *name, void *value, size_t size,
+	void *dcache_handle)
+{
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+	return xattr_get(d, name, value, size, priv->vol);
+}
+
+int disk_get_dentry(struct dentry *d, void *dcache_handle)
+{
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	++d->numhandles;
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	return 0;
+}
+
+int disk_put_dentry(struct dentry *d, void *dcache_handle)
+{
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+
+	fs_release_dentry(d);
+	return 0;
+}
+
+int disk_load(struct dentry *d, bool evict, void *dcache_handle)
+{
+	int ret = 0;
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	if (! priv->name)
+		return 0;
+
+	ltfs_mutex_lock(&priv->tree_lock);
+	if (__atomic_load_n(&d->dcache_evicted, __ATOMIC_ACQUIRE))
+		ret = _disk_load_dir(priv, d);
+	else if (d->dcache_priv) {
+		struct disk_node *node = d->dcache_priv;
+		TAILQ_REMOVE(&priv->lru, node, lru);
+		TAILQ_INSERT_TAIL(&priv->lru, node, lru);
+	} else
+		ret = _disk_node_add(priv, d);
+	if (ret == 0 && evict)
+		_disk_evict(priv, d);
+	ltfs_mutex_unlock(&priv->tree_lock);
+
+	return ret;
+}
+
+void disk_forget(struct dentry *d, void *dcache_handle)
+{
+	struct disk_dcache *priv = dcache_handle;
+
+	if (! d || ! priv)
+		return;
+
+	ltfs_mutex_lock(&priv->tree_lock);
+	if (d->dcache_priv)
+		_disk_node_remove(priv, d);
+	ltfs_mutex_unlock(&priv->tree_lock);
+
+	/* The record, if any, predates the last load of the directory */
+	ltfs_mutex_lock(&priv->lock);
+	if (priv->store && disk_store_remove(priv->store, d->uid) < 0)
+		priv->failed = true;
+	ltfs_mutex_unlock(&priv->lock);
+}
+
+int disk_get_contents(uint64_t uid, char **buf, size_t *size, void *dcache_handle)
+{
+	int ret = -LTFS_NO_DENTRY;
+	uint32_t len = 0;
+	struct disk_dcache *priv = dcache_handle;
+
+	CHECK_ARG_NULL(buf, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(size, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	ltfs_mutex_lock(&priv->lock);
+	if (priv->store)
+		ret = disk_store_get(priv->store, uid, buf, &len);
+	ltfs_mutex_unlock(&priv->lock);
+
+	if (ret == 0)
+		*size = len;
+	else
+		ltfsmsg(LTFS_ERR, 13511E, (unsigned long long)uid, ret);
+	return ret;
+}
+
+struct dcache_ops disk_ops = {
+	.init              = disk_init,
+	.destroy           = disk_destroy,
+	.mkcache           = disk_mkcache,
+	.rmcache           = disk_rmcache,
+	.cache_exists      = disk_cache_exists,
+	.set_workdir       = disk_set_workdir,
+	.get_workdir       = disk_get_workdir,
+	.assign_name       = disk_assign_name,
+	.unassign_name     = disk_unassign_name,
+	.is_name_assigned  = disk_is_name_assigned,
+	.wipe_dentry_tree  = disk_wipe_dentry_tree,
+	.set_vol_uuid      = disk_set_vol_uuid,
+	.get_vol_uuid      = disk_get_vol_uuid,
+	.set_generation    = disk_set_generation,
+	.get_generation    = disk_get_generation,
+	.set_dirty         = disk_set_dirty,
+	.get_dirty         = disk_get_dirty,
+	.diskimage_create  = disk_diskimage_create,
+	.diskimage_remove  = disk_diskimage_remove,
+	.diskimage_mount   = disk_diskimage_mount,
+	.diskimage_unmount = disk_diskimage_unmount,
+	.diskimage_is_full = disk_diskimage_is_full,
+	.get_advisory_lock = disk_get_advisory_lock,
+	.put_advisory_lock = disk_put_advisory_lock,
+	.open              = disk_open,
+	.openat            = disk_openat,
+	.close             = disk_close,
+	.create            = disk_create,
+	.unlink            = disk_unlink,
+	.rename            = disk_rename,
+	.flush             = disk_flush,
+	.readdir           = disk_readdir,
+	.read_direntry     = disk_read_direntry,
+	.setxattr          = disk_setxattr,
+	.removexattr       = disk_removexattr,
+	.listxattr         = disk_listxattr,
+	.getxattr          = disk_getxattr,
+	.get_dentry        = disk_get_dentry,
+	.put_dentry        = disk_put_dentry,
+	.load              = disk_load,
+	.forget            = disk_forget,
+	.get_contents      = disk_get_contents,
+};
+
+struct dcache_ops *dcache_get_ops(void)
+{
+	return &disk_ops;
+}
+
+#ifndef mingw_PLATFORM
+extern char dcache_disk_dat[];
+#endif
+
+const char *dcache_get_message_bundle_name(void **message_data)
+{
+#ifndef mingw_PLATFORM
+	*message_data = dcache_disk_dat;
+#else
+	*message_data = NULL;
+#endif
+	return "dcache_disk";
+}
@@ -0,0 +1,928 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       dcache/disk_store.c
+**
+** DESCRIPTION:     Record store of the disk dentry cache.
+**
+**                  The store keeps one record per dentry UID in a small
+**                  log-structured merge tree. New records go to an in-memory
+**                  table. When the table fills up, or when the store is flushed,
+**                  the table is sorted by UID and written out as a run file.
+**                  Removals are written as tombstones which hide older records.
+**                  Once there are more than DISK_STORE_MAX_RUNS runs, all of them
+**                  are merged into a single run, dropping shadowed records and
+**                  tombstones. Lookups search the table, then the runs from the
+**                  newest, each through a sparse index holding one entry per
+**                  DISK_STORE_INDEX_STRIDE records. Memory use is therefore bounded
+**                  by the size of the table, the sparse indexes and one record per
+**                  run during a merge.
+**
+**                  Run files are named run.<sequence>, a higher sequence number
+**                  holding newer records. A run is written to a temporary file and
+**                  renamed into place, so a crash leaves either the old or the new
+**                  run behind.
+**
+*************************************************************************************
+*/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "libltfs/ltfs.h"
+#include "disk_store.h"
+
+#define DISK_STORE_RUN_MAGIC "LTFSDCR1"
+#define DISK_STORE_DELETED   (0x1)
+/** Records between two entries of the sparse index of a run */
+#define DISK_STORE_INDEX_STRIDE (64)
+
+/**
+ * On-disk header of a run file.
+ */
+struct disk_run_header {
+	char magic[8];          /**< DISK_STORE_RUN_MAGIC */
+	uint64_t count;         /**< Number of records in the run */
+};
+
+/**
+ * On-disk header of a record, followed by 'size' bytes of payload.
+ */
+struct disk_record_header {
+	uint64_t uid;           /**< Dentry UID, runs are sorted by it */
+	uint32_t size;          /**< Payload size */
+	uint32_t flags;         /**< DISK_STORE_DELETED for a tombstone */
+};
+
+/**
+ * Record buffered in the in-memory table.
+ */
+struct disk_mem_record {
+	uint64_t uid;           /**< Dentry UID */
+	uint64_t seq;           /**< Insertion order, the latest record for a UID wins */
+	size_t offset;          /**< Payload offset in the table buffer */
+	uint32_t size;          /**< Payload size */
+	uint32_t flags;         /**< DISK_STORE_DELETED for a tombstone */
+};
+
+/**
+ * Sequential reader of a run, used while merging runs.
+ */
+struct disk_run_reader {
+	FILE *fp;
+	uint64_t left;                 /**< Records not read yet */
+	struct disk_record_header hdr; /**< Current record */
+	char *buf;                     /**< Payload of the current record */
+	uint32_t buf_size;             /**< Allocated size of buf */
+	bool valid;                    /**< True if hdr and buf hold a record */
+};
+
+/**
+ * Entry of the sparse index of a run.
+ */
+struct disk_run_index {
+	uint64_t uid;           /**< UID of the record */
+	uint64_t offset;        /**< Offset of the record header in the run file */
+};
+
+/**
+ * Run file open for lookups.
+ */
+struct disk_run {
+	uint64_t seq;                  /**< Sequence number */
+	int fd;                        /**< Open run file */
+	uint64_t end;                  /**< Size of the run file */
+	struct disk_run_index *index;  /**< Every DISK_STORE_INDEX_STRIDE-th record */
+	size_t index_count;            /**< Entries in index */
+};
+
+struct disk_store {
+	char *dir;                      /**< Directory holding the run files */
+	struct disk_run *runs;          /**< Runs, oldest first */
+	size_t run_count;               /**< Number of runs */
+	uint64_t next_run;              /**< Sequence number of the next run */
+	uint64_t disk_size;             /**< Bytes used by the runs */
+
+	struct disk_mem_record *records; /**< In-memory table */
+	size_t record_count;            /**< Records in the table */
+	size_t record_alloc;            /**< Allocated table entries */
+	char *data;                     /**< Payloads of the table */
+	size_t data_used;               /**< Bytes of data in use */
+	size_t data_alloc;              /**< Allocated bytes of data */
+	uint64_t seq;                   /**< Insertion counter */
+};
+
+static int _disk_store_run_path(struct disk_store *store, uint64_t seq, bool tmp, char **path)
+{
+	int ret = asprintf(path, "%s/run.%020llu%s", store->dir, (unsigned long long)seq,
+		tmp ? ".tmp" : "");
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	return 0;
+}
+
+static int _disk_store_cmp_seq(const void *a, const void *b)
+{
+	uint64_t x = ((const struct disk_run *)a)->seq, y = ((const struct disk_run *)b)->seq;
+	return (x > y) - (x < y);
+}
+
+static int _disk_store_cmp_record(const void *a, const void *b)
+{
+	const struct disk_mem_record *x = a, *y = b;
+
+	if (x->uid != y->uid)
+		return (x->uid > y->uid) - (x->uid < y->uid);
+	return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+static void _disk_run_close(struct disk_run *run)
+{
+	if (run->fd >= 0)
+		close(run->fd);
+	run->fd = -1;
+	free(run->index);
+	run->index = NULL;
+	run->index_count = 0;
+}
+
+/**
+ * Open a run file for lookups and build its sparse index from the record headers.
+ */
+static int _disk_run_open(struct disk_store *store, uint64_t seq, struct disk_run *run)
+{
+	int ret;
+	char *path;
+	FILE *fp;
+	uint64_t i, offset;
+	size_t alloc;
+	struct disk_run_header run_hdr;
+	struct disk_record_header hdr;
+
+	run->seq = seq;
+	run->fd = -1;
+	run->end = 0;
+	run->index = NULL;
+	run->index_count = 0;
+
+	ret = _disk_store_run_path(store, seq, false, &path);
+	if (ret < 0)
+		return ret;
+	run->fd = open(path, O_RDONLY);
+	fp = (run->fd >= 0) ? fopen(path, "rb") : NULL;
+	if (! fp) {
+		ltfsmsg(LTFS_ERR, 13503E, path, errno);
+		free(path);
+		_disk_run_close(run);
+		return -LTFS_FILE_ERR;
+	}
+	if (fread(&run_hdr, sizeof(run_hdr), 1, fp) != 1
+		|| memcmp(run_hdr.magic, DISK_STORE_RUN_MAGIC, sizeof(run_hdr.magic))) {
+		ltfsmsg(LTFS_ERR, 13504E, path);
+		ret = -LTFS_FILE_ERR;
+		goto out;
+	}
+
+	alloc = run_hdr.count / DISK_STORE_INDEX_STRIDE + 1;
+	run->index = malloc(alloc * sizeof(*run->index));
+	if (! run->index) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		ret = -LTFS_NO_MEMORY;
+		goto out;
+	}
+
+	offset = sizeof(run_hdr);
+	for (i = 0; i < run_hdr.count; ++i) {
+		if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || fseeko(fp, hdr.size, SEEK_CUR) != 0) {
+			ltfsmsg(LTFS_ERR, 13504E, path);
+			ret = -LTFS_FILE_ERR;
+			goto out;
+		}
+		if (i % DISK_STORE_INDEX_STRIDE == 0) {
+			run->index[run->index_count].uid = hdr.uid;
+			run->index[run->index_count++].offset = offset;
+		}
+		offset += sizeof(hdr) + hdr.size;
+	}
+	run->end = offset;
+
+out:
+	fclose(fp);
+	free(path);
+	if (ret < 0)
+		_disk_run_close(run);
+	return ret;
+}
+
+static int _disk_run_pread(struct disk_run *run, void *buf, size_t len, uint64_t offset)
+{
+	ssize_t nread;
+	size_t done = 0;
+
+	while (done < len) {
+		nread = pread(run->fd, (char *)buf + done, len - done, offset + done);
+		if (nread < 0 && errno == EINTR)
+			continue;
+		if (nread <= 0)
+			return -LTFS_FILE_ERR;
+		done += nread;
+	}
+	return 0;
+}
+
+/**
+ * Look up a record in a run.
+ * @return 0 if found, 1 if the run has no record of the UID or a negative value on error.
+ */
+static int _disk_run_get(struct disk_run *run, uint64_t uid, struct disk_record_header *hdr,
+	uint64_t *payload)
+{
+	int ret;
+	size_t lo = 0, hi = run->index_count, mid;
+	uint64_t offset;
+
+	/* Find the last indexed record at or before the UID, then scan forward */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (run->index[mid].uid <= uid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0)
+		return 1;
+
+	for (offset = run->index[lo - 1].offset; offset < run->end;
+		 offset += sizeof(*hdr) + hdr->size) {
+		ret = _disk_run_pread(run, hdr, sizeof(*hdr), offset);
+		if (ret < 0)
+			return ret;
+		if (hdr->uid == uid) {
+			*payload = offset + sizeof(*hdr);
+			return 0;
+		}
+		if (hdr->uid > uid)
+			break;
+	}
+	return 1;
+}
+
+/**
+ * Find the run files in the store directory.
+ */
+static int _disk_store_scan(struct disk_store *store)
+{
+	DIR *dir;
+	struct dirent *ent;
+	struct stat st;
+	unsigned long long seq;
+	char *path, *end;
+	struct disk_run *runs;
+	int ret = 0;
+
+	dir = opendir(store->dir);
+	if (! dir) {
+		ltfsmsg(LTFS_ERR, 13501E, store->dir, errno);
+		return -LTFS_FILE_ERR;
+	}
+
+	while ((ent = readdir(dir))) {
+		if (strncmp(ent->d_name, "run.", 4))
+			continue;
+		seq = strtoull(ent->d_name + 4, &end, 10);
+		if (*end != '\0') {
+			/* A leftover temporary run of an interrupted flush or merge */
+			if (! strcmp(end, ".tmp") && asprintf(&path, "%s/%s", store->dir, ent->d_name) >= 0) {
+				unlink(path);
+				free(path);
+			}
+			continue;
+		}
+
+		runs = realloc(store->runs, (store->run_count + 1) * sizeof(*runs));
+		if (! runs) {
+			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+			ret = -LTFS_NO_MEMORY;
+			break;
+		}
+		store->runs = runs;
+		ret = _disk_run_open(store, seq, &store->runs[store->run_count]);
+		if (ret < 0)
+			break;
+		++store->run_count;
+		if (seq >= store->next_run)
+			store->next_run = seq + 1;
+
+		ret = _disk_store_run_path(store, seq, false, &path);
+		if (ret < 0)
+			break;
+		if (stat(path, &st) == 0)
+			store->disk_size += st.st_size;
+		free(path);
+	}
+	closedir(dir);
+
+	if (ret == 0)
+		qsort(store->runs, store->run_count, sizeof(*store->runs), _disk_store_cmp_seq);
+	return ret;
+}
+
+/**
+ * Open a store, creating its directory if needed.
+ * @param dir Directory holding the store.
+ * @param[out] store On success, the store handle.
+ * @return 0 on success or a negative value on error.
+ */
+int disk_store_open(const char *dir, struct disk_store **store)
+{
+	int ret;
+	struct disk_store *s;
+
+	CHECK_ARG_NULL(dir, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(store, -LTFS_NULL_ARG);
+
+	if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+		ltfsmsg(LTFS_ERR, 13501E, dir, errno);
+		return -LTFS_FILE_ERR;
+	}
+
+	s = calloc(1, sizeof(*s));
+	if (! s) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	s->dir = strdup(dir);
+	if (! s->dir) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		free(s);
+		return -LTFS_NO_MEMORY;
+	}
+	s->next_run = 1;
+
+	ret = _disk_store_scan(s);
+	if (ret < 0) {
+		while (s->run_count)
+			_disk_run_close(&s->runs[--s->run_count]);
+		free(s->runs);
+		free(s->dir);
+		free(s);
+		return ret;
+	}
+
+	*store = s;
+	return 0;
+}
+
+/**
+ * Flush and close a store.
+ * @param store Store to close.
+ * @return 0 on success or a negative value if buffered records could not be written.
+ */
+int disk_store_close(struct disk_store *store)
+{
+	int ret;
+
+	CHECK_ARG_NULL(store, -LTFS_NULL_ARG);
+
+	ret = disk_store_flush(store);
+
+	while (store->run_count)
+		_disk_run_close(&store->runs[--store->run_count]);
+	free(store->records);
+	free(store->data);
+	free(store->runs);
+	free(store->dir);
+	free(store);
+	return ret;
+}
+
+static int _disk_store_add(struct disk_store *store, uint64_t uid, const char *buf, uint32_t size,
+	uint32_t flags)
+{
+	int ret;
+	struct disk_mem_record *rec;
+
+	if (store->data_used + size > DISK_STORE_MEMTABLE_MAX && store->record_count) {
+		ret = disk_store_flush(store);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (store->record_count == store->record_alloc) {
+		size_t alloc = store->record_alloc ? store->record_alloc * 2 : 1024;
+		rec = realloc(store->records, alloc * sizeof(*rec));
+		if (! rec) {
+			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+			return -LTFS_NO_MEMORY;
+		}
+		store->records = rec;
+		store->record_alloc = alloc;
+	}
+	if (store->data_used + size > store->data_alloc) {
+		size_t alloc = store->data_alloc ? store->data_alloc : 65536;
+		char *data;
+		while (alloc < store->data_used + size)
+			alloc *= 2;
+		data = realloc(store->data, alloc);
+		if (! data) {
+			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+			return -LTFS_NO_MEMORY;
+		}
+		store->data = data;
+		store->data_alloc = alloc;
+	}
+
+	rec = &store->records[store->record_count++];
+	rec->uid = uid;
+	rec->seq = store->seq++;
+	rec->offset = store->data_used;
+	rec->size = size;
+	rec->flags = flags;
+	if (size)
+		memcpy(store->data + store->data_used, buf, size);
+	store->data_used += size;
+
+	return 0;
+}
+
+/**
+ * Store the record of a dentry, replacing any previous record with the same UID.
+ * @param store Store.
+ * @param uid Dentry UID.
+ * @param buf Record payload.
+ * @param size Payload size.
+ * @return 0 on success or a negative value on error.
+ */
+int disk_store_put(struct disk_store *store, uint64_t uid, const char *buf, uint32_t size)
+{
+	CHECK_ARG_NULL(store, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(buf, -LTFS_NULL_ARG);
+
+	return _disk_store_add(store, uid, buf, size, 0);
+}
+
+/**
+ * Remove the record of a dentry.
+ * @param store Store.
+ * @param uid Dentry UID.
+ * @return 0 on success or a negative value on error.
+ */
+int disk_store_remove(struct disk_store *store, uint64_t uid)
+{
+	CHECK_ARG_NULL(store, -LTFS_NULL_ARG);
+
+	return _disk_store_add(store, uid, NULL, 0, DISK_STORE_DELETED);
+}
+
+/**
+ * Get the record of a dentry.
+ * @param store Store.
+ * @param uid Dentry UID.
+ * @param[out] buf On success, an allocated buffer holding the payload, to be freed by the
+ *                 caller. May be NULL to only check that the record exists.
+ * @param[out] size On success, the payload size. May be NULL if buf is NULL.
+ * @return 0 on success, -LTFS_NO_DENTRY if there is no record of the UID or a negative
+ *         value on error.
+ */
+int disk_store_get(struct disk_store *store, uint64_t uid, char **buf, uint32_t *size)
+{
+	int ret = 1;
+	size_t i;
+	uint64_t payload = 0;
+	struct disk_run *run = NULL;
+	struct disk_record_header hdr;
+	struct disk_mem_record *rec = NULL;
+
+	CHECK_ARG_NULL(store, -LTFS_NULL_ARG);
+
+	/* The newest record wins: the table first, latest insertion first, then newer runs */
+	for (i = store->record_count; i > 0; --i) {
+		if (store->records[i - 1].uid == uid) {
+			rec = &store->records[i - 1];
+			break;
+		}
+	}
+	if (rec) {
+		if (rec->flags & DISK_STORE_DELETED)
+			return -LTFS_NO_DENTRY;
+		hdr.size = rec->size;
+	} else {
+		for (i = store->run_count; i > 0 && ret == 1; --i) {
+			run = &store->runs[i - 1];
+			ret = _disk_run_get(run, uid, &hdr, &payload);
+		}
+		if (ret < 0) {
+			ltfsmsg(LTFS_ERR, 13503E, store->dir, ret);
+			return ret;
+		}
+		if (ret == 1 || (hdr.flags & DISK_STORE_DELETED))
+			return -LTFS_NO_DENTRY;
+	}
+
+	if (! buf)
+		return 0;
+
+	*buf = malloc(hdr.size ? hdr.size : 1);
+	if (! *buf) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	if (rec)
+		memcpy(*buf, store->data + rec->offset, hdr.size);
+	else {
+		ret = _disk_run_pread(run, *buf, hdr.size, payload);
+		if (ret < 0) {
+			ltfsmsg(LTFS_ERR, 13503E, store->dir, ret);
+			free(*buf);
+			*buf = NULL;
+			return ret;
+		}
+	}
+	*size = hdr.size;
+
+	return 0;
+}
+
+/**
+ * Make a run file durable and publish it under its final name.
+ */
+static int _disk_store_publish(struct disk_store *store, FILE *fp, uint64_t seq, const char *tmp)
+{
+	int ret = 0;
+	long size;
+	char *path;
+
+	if (fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+		ret = -LTFS_FILE_ERR;
+	size = ftell(fp);
+	if (fclose(fp) != 0)
+		ret = -LTFS_FILE_ERR;
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 13502E, tmp, errno);
+		unlink(tmp);
+		return ret;
+	}
+
+	ret = _disk_store_run_path(store, seq, false, &path);
+	if (ret < 0) {
+		unlink(tmp);
+		return ret;
+	}
+	if (rename(tmp, path) < 0) {
+		ltfsmsg(LTFS_ERR, 13502E, path, errno);
+		unlink(tmp);
+		free(path);
+		return -LTFS_FILE_ERR;
+	}
+	free(path);
+
+	if (size > 0)
+		store->disk_size += size;
+	return 0;
+}
+
+static int _disk_store_write_record(FILE *fp, const struct disk_record_header *hdr,
+	const char *buf)
+{
+	if (fwrite(hdr, sizeof(*hdr), 1, fp) != 1)
+		return -LTFS_FILE_ERR;
+	if (hdr->size && fwrite(buf, hdr->size, 1, fp) != 1)
+		return -LTFS_FILE_ERR;
+	return 0;
+}
+
+/**
+ * Write the in-memory table out as a new run, merging all runs if there are too many.
+ * @param store Store.
+ * @return 0 on success or a negative value on error.
+ */
+int disk_store_flush(struct disk_store *store)
+{
+	int ret = 0;
+	size_t i, j;
+	uint64_t seq;
+	struct disk_run *runs;
+	char *tmp = NULL;
+	FILE *fp;
+	struct disk_run_header run_hdr;
+	struct disk_record_header hdr;
+
+	CHECK_ARG_NULL(store, -LTFS_NULL_ARG);
+
+	if (! store->record_count)
+		return 0;
+
+	runs = realloc(store->runs, (store->run_count + 1) * sizeof(*runs));
+	if (! runs) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	store->runs = runs;
+
+	/* Sort by UID, and by insertion order within a UID, so the last record of each UID wins */
+	qsort(store->records, store->record_count, sizeof(*store->records), _disk_store_cmp_record);
+	for (i = 0, j = 0; i < store->record_count; ++i) {
+		if (i + 1 < store->record_count && store->records[i + 1].uid == store->records[i].uid)
+			continue;
+		store->records[j++] = store->records[i];
+	}
+
+	seq = store->next_run++;
+	ret = _disk_store_run_path(store, seq, true, &tmp);
+	if (ret < 0)
+		return ret;
+	fp = fopen(tmp, "wb");
+	if (! fp) {
+		ltfsmsg(LTFS_ERR, 13502E, tmp, errno);
+		free(tmp);
+		return -LTFS_FILE_ERR;
+	}
+
+	memcpy(run_hdr.magic, DISK_STORE_RUN_MAGIC, sizeof(run_hdr.magic));
+	run_hdr.count = j;
+	if (fwrite(&run_hdr, sizeof(run_hdr), 1, fp) != 1)
+		ret = -LTFS_FILE_ERR;
+	for (i = 0; ret == 0 && i < j; ++i) {
+		hdr.uid = store->records[i].uid;
+		hdr.size = store->records[i].size;
+		hdr.flags = store->records[i].flags;
+		ret = _disk_store_write_record(fp, &hdr, store->data + store->records[i].offset);
+	}
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 13502E, tmp, errno);
+		fclose(fp);
+		unlink(tmp);
+		free(tmp);
+		return ret;
+	}
+
+	ret = _disk_store_publish(store, fp, seq, tmp);
+	free(tmp);
+	if (ret == 0)
+		ret = _disk_run_open(store, seq, &store->runs[store->run_count]);
+	if (ret < 0)
+		return ret;
+
+	++store->run_count;
+	store->record_count = 0;
+	store->data_used = 0;
+
+	if (store->run_count > DISK_STORE_MAX_RUNS)
+		ret = disk_store_compact(store);
+	return ret;
+}
+
+static int _disk_run_reader_next(struct disk_run_reader *r)
+{
+	r->valid = false;
+	if (! r->left)
+		return 0;
+
+	if (fread(&r->hdr, sizeof(r->hdr), 1, r->fp) != 1)
+		return -LTFS_FILE_ERR;
+	if (r->hdr.size > r->buf_size) {
+		char *buf = realloc(r->buf, r->hdr.size);
+		if (! buf) {
+			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+			return -LTFS_NO_MEMORY;
+		}
+		r->buf = buf;
+		r->buf_size = r->hdr.size;
+	}
+	if (r->hdr.size && fread(r->buf, r->hdr.size, 1, r->fp) != 1)
+		return -LTFS_FILE_ERR;
+
+	--r->left;
+	r->valid = true;
+	return 0;
+}
+
+static int _disk_run_reader_open(struct disk_store *store, uint64_t seq, struct disk_run_reader *r)
+{
+	int ret;
+	char *path;
+	struct disk_run_header run_hdr;
+
+	ret = _disk_store_run_path(store, seq, false, &path);
+	if (ret < 0)
+		return ret;
+
+	r->fp = fopen(path, "rb");
+	if (! r->fp) {
+		ltfsmsg(LTFS_ERR, 13503E, path, errno);
+		free(path);
+		return -LTFS_FILE_ERR;
+	}
+	if (fread(&run_hdr, sizeof(run_hdr), 1, r->fp) != 1
+		|| memcmp(run_hdr.magic, DISK_STORE_RUN_MAGIC, sizeof(run_hdr.magic))) {
+		ltfsmsg(LTFS_ERR, 13504E, path);
+		free(path);
+		return -LTFS_FILE_ERR;
+	}
+	free(path);
+
+	r->left = run_hdr.count;
+	ret = _disk_run_reader_next(r);
+	if (ret < 0)
+		ltfsmsg(LTFS_ERR, 13503E, store->dir, ret);
+	return ret;
+}
+
+/**
+ * Merge all runs into a single run. Records shadowed by newer records of the same UID and
+ * tombstones are dropped, so the result holds exactly one record per stored dentry.
+ * @param store Store.
+ * @return 0 on success or a negative value on error.
+ */
+int disk_store_compact(struct disk_store *store)
+{
+	int ret = 0;
+	size_t i, newest, n;
+	uint64_t seq, count = 0, uid = 0;
+	char *tmp = NULL, *path = NULL;
+	FILE *fp = NULL;
+	struct disk_run_reader *readers;
+	struct disk_run_header run_hdr;
+	struct disk_run merged;
+
+	CHECK_ARG_NULL(store, -LTFS_NULL_ARG);
+
+	if (store->run_count < 2)
+		return 0;
+
+	n = store->run_count;
+	readers = calloc(n, sizeof(*readers));
+	if (! readers) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	for (i = 0; ret == 0 && i < n; ++i)
+		ret = _disk_run_reader_open(store, store->runs[i].seq, &readers[i]);
+	if (ret < 0)
+		goto out;
+
+	seq = store->next_run++;
+	ret = _disk_store_run_path(store, seq, true, &tmp);
+	if (ret < 0)
+		goto out;
+	fp = fopen(tmp, "wb");
+	if (! fp) {
+		ltfsmsg(LTFS_ERR, 13502E, tmp, errno);
+		ret = -LTFS_FILE_ERR;
+		goto out;
+	}
+
+	/* The record count is only known at the end, the header is rewritten then */
+	memcpy(run_hdr.magic, DISK_STORE_RUN_MAGIC, sizeof(run_hdr.magic));
+	run_hdr.count = 0;
+	if (fwrite(&run_hdr, sizeof(run_hdr), 1, fp) != 1)
+		ret = -LTFS_FILE_ERR;
+
+	while (ret == 0) {
+		/* Pick the smallest UID; runs are ordered oldest first, so the last match is the newest */
+		newest = n;
+		for (i = 0; i < n; ++i) {
+			if (readers[i].valid && (newest == n || readers[i].hdr.uid <= uid)) {
+				newest = i;
+				uid = readers[i].hdr.uid;
+			}
+		}
+		if (newest == n)
+			break;
+
+		if (! (readers[newest].hdr.flags & DISK_STORE_DELETED)) {
+			ret = _disk_store_write_record(fp, &readers[newest].hdr, readers[newest].buf);
+			if (ret < 0)
+				break;
+			++count;
+		}
+
+		for (i = 0; ret == 0 && i < n; ++i) {
+			if (readers[i].valid && readers[i].hdr.uid == uid)
+				ret = _disk_run_reader_next(&readers[i]);
+		}
+	}
+
+	if (ret == 0) {
+		run_hdr.count = count;
+		if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&run_hdr, sizeof(run_hdr), 1, fp) != 1
+			|| fseek(fp, 0, SEEK_END) != 0)
+			ret = -LTFS_FILE_ERR;
+	}
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 13502E, tmp, errno);
+		fclose(fp);
+		unlink(tmp);
+		goto out;
+	}
+
+	ret = _disk_store_publish(store, fp, seq, tmp);
+	if (ret == 0)
+		ret = _disk_run_open(store, seq, &merged);
+	if (ret < 0)
+		goto out;
+
+	/* The merged run holds everything, drop the inputs */
+	for (i = 0; i < n; ++i) {
+		_disk_run_close(&store->runs[i]);
+		if (_disk_store_run_path(store, store->runs[i].seq, false, &path) == 0) {
+			unlink(path);
+			free(path);
+		}
+	}
+	store->disk_size = merged.end;
+	store->runs[0] = merged;
+	store->run_count = 1;
+
+out:
+	for (i = 0; i < n; ++i) {
+		if (readers[i].fp)
+			fclose(readers[i].fp);
+		free(readers[i].buf);
+	}
+	free(readers);
+	free(tmp);
+	return ret;
+}
+
+/**
+ * Remove all run files of a store.
+ * @param dir Directory holding the store.
+ * @return 0 on success or a negative value on error.
+ */
+int disk_store_clear(const char *dir)
+{
+	DIR *d;
+	struct dirent *ent;
+	char *path;
+
+	CHECK_ARG_NULL(dir, -LTFS_NULL_ARG);
+
+	d = opendir(dir);
+	if (! d)
+		return (errno == ENOENT) ? 0 : -LTFS_FILE_ERR;
+
+	while ((ent = readdir(d))) {
+		if (strncmp(ent->d_name, "run.", 4))
+			continue;
+		if (asprintf(&path, "%s/%s", dir, ent->d_name) < 0) {
+			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+			closedir(d);
+			return -LTFS_NO_MEMORY;
+		}
+		unlink(path);
+		free(path);
+	}
+	closedir(d);
+	return 0;
+}
+
+/**
+ * Get the number of bytes the runs of a store occupy on disk.
+ * @param store Store.
+ * @return Size of the runs in bytes.
+ */
+uint64_t disk_store_disk_size(struct disk_store *store)
+{
+	return store ? store->disk_size : 0;
+}
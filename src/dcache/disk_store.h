@@ -0,0 +1,68 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       dcache/disk_store.h
+**
+** DESCRIPTION:     Prototypes for the record store of the disk dentry cache.
+**
+*************************************************************************************
+*/
+#ifndef __disk_store_h
+#define __disk_store_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Bytes of records buffered in memory before they are written out as a sorted run */
+#define DISK_STORE_MEMTABLE_MAX (4 * 1024 * 1024)
+/** Number of runs on disk which triggers merging them into a single run */
+#define DISK_STORE_MAX_RUNS     (8)
+
+struct disk_store;
+
+int disk_store_open(const char *dir, struct disk_store **store);
+int disk_store_close(struct disk_store *store);
+int disk_store_put(struct disk_store *store, uint64_t uid, const char *buf, uint32_t size);
+int disk_store_remove(struct disk_store *store, uint64_t uid);
+int disk_store_get(struct disk_store *store, uint64_t uid, char **buf, uint32_t *size);
+int disk_store_flush(struct disk_store *store);
+int disk_store_compact(struct disk_store *store);
+int disk_store_clear(const char *dir);
+uint64_t disk_store_disk_size(struct disk_store *store);
+
+#endif /* __disk_store_h */
@@ -59,6 +59,7 @@
 #include "libltfs/tape.h"
 #include "libltfs/ltfs_fsops_raw.h"
 #include "libltfs/index_criteria.h"
+#include "libltfs/index_snapshot.h"
 #include "libltfs/iosched_ops.h"
 #include "libltfs/arch/time_internal.h"
 #include "cache_manager.h"
@@ -100,6 +101,17 @@ struct write_request {
 	enum request_state state;        /**< Current state of the request */
 };
 
+/**
+ * Source of the bytes consumed by unified_write: either a flat buffer or a caller-defined
+ * source which is copied straight into cache blocks.
+ */
+struct write_source {
+	const char *buf;                 /**< Flat source buffer, or NULL to use copy() */
+	ltfs_write_source copy;          /**< Callback gathering bytes from a caller-defined source */
+	void *copy_priv;                 /**< Source handle passed to copy() */
+	size_t pos;                      /**< Number of source bytes consumed so far */
+};
+
 /**
  * Per-dentry private data structure. It records a list of outstanding write requests
  * and associated data.
@@ -236,9 +248,13 @@ int  _unified_update_queue_membership(bool add, bool all, enum request_state que
 	 struct dentry_priv *dentry_priv, struct unified_data *priv);
 int _unified_cache_alloc(void **cache, struct dentry *d, struct unified_data *priv);
 void _unified_cache_free(void *cache, size_t count, struct unified_data *priv);
-ssize_t _unified_insert_new_request(const char *buf, off_t offset, size_t count, void **cache,
-	bool ip_state, struct write_request *req, struct dentry *d, struct unified_data *priv);
-size_t _unified_update_request(const char *buf, off_t offset, size_t size,
+ssize_t _unified_write(struct dentry *d, struct write_source *src, size_t size, off_t offset,
+	bool isupdatetime, struct unified_data *priv);
+int _unified_copy_source(char *dst, size_t count, const struct write_source *src);
+ssize_t _unified_insert_new_request(const struct write_source *src, off_t offset, size_t count,
+	void **cache, bool ip_state, struct write_request *req, struct dentry *d,
+	struct unified_data *priv);
+ssize_t _unified_update_request(const struct write_source *src, off_t offset, size_t size,
 	struct dentry_priv *dpr, struct write_request *req, struct unified_data *priv);
 int _unified_merge_requests(struct write_request *dest, struct write_request *src,
 	void **spare_cache, struct dentry_priv *dpr, struct unified_data *priv);
@@ -254,6 +270,21 @@ void _unified_handle_write_error(ssize_t write_ret, struct write_request *req,
 int _unified_get_write_error(struct dentry_priv *dpr);
 int _unified_write_index_after_perm(int write_ret, struct unified_data *priv);
 
+/* Take and release the iosched_lock of a dentry, counted by the lock profiler */
+static inline void _unified_lock_dentry(struct dentry *d)
+{
+	struct dentry_locks *locks = fs_dentry_locks(d);
+
+	ltfs_mutex_lock_profiled(&locks->iosched_lock, LOCK_CLASS_IOSCHED_DENTRY, &locks->iosched_hold_start);
+}
+
+static inline void _unified_unlock_dentry(struct dentry *d)
+{
+	struct dentry_locks *locks = fs_dentry_locks(d);
+
+	ltfs_mutex_unlock_profiled(&locks->iosched_lock, LOCK_CLASS_IOSCHED_DENTRY, &locks->iosched_hold_start);
+}
+
 /**
  * Initialize an instance of the unified scheduler.
  * @param vol LTFS volume to schedule writes for.
@@ -340,6 +371,7 @@ void *unified_init(struct ltfs_volume *vol)
 		free(priv);
 		return NULL;
 	}
+	set_lock_class_mrsw(&priv->lock, LOCK_CLASS_IOSCHED);
 
 	TAILQ_INIT(&priv->working_set);
 	TAILQ_INIT(&priv->dp_queue);
@@ -456,12 +488,12 @@ int unified_close(struct dentry *d, bool flush, void *iosched_handle)
 	ltfs_profiler_add_entry(priv->profiler, &priv->proflock, IOSCHED_REQ_ENTER(REQ_IOS_CLOSE));
 
 	acquireread_mrsw(&priv->lock);
-	ltfs_mutex_lock(&d->iosched_lock);
+	_unified_lock_dentry(d);
 	if (flush)
 		ret = _unified_flush_unlocked(d, priv);
 	write_error = _unified_get_write_error(d->iosched_priv);
 	_unified_free_dentry_priv_conditional(d, 3, priv);
-	ltfs_mutex_unlock(&d->iosched_lock);
+	_unified_unlock_dentry(d);
 	releaseread_mrsw(&priv->lock);
 
 	/* No need to hold any scheduler locks when closing the file. All writes which were
@@ -514,10 +546,10 @@ ssize_t unified_read(struct dentry *d, char *buf, size_t size, off_t offset, voi
 		goto out;
 	releaseread_mrsw(&priv->vol->lock);
 
-	ltfs_mutex_lock(&d->iosched_lock);
+	_unified_lock_dentry(d);
 	dpr = d->iosched_priv;
 	if (! dpr) {
-		ltfs_mutex_unlock(&d->iosched_lock);
+		_unified_unlock_dentry(d);
 		ret = ltfs_fsraw_read(d, buf, size, offset, priv->vol);
 		goto out;
 	}
@@ -525,7 +557,7 @@ ssize_t unified_read(struct dentry *d, char *buf, size_t size, off_t offset, voi
 	/* If there are no outstanding requests, get data from libltfs */
 	if (TAILQ_EMPTY(&dpr->requests)) {
 		ltfs_mutex_lock(&dpr->io_lock);
-		ltfs_mutex_unlock(&d->iosched_lock);
+		_unified_unlock_dentry(d);
 		ret = ltfs_fsraw_read(d, buf, size, offset, priv->vol);
 		ltfs_mutex_unlock(&dpr->io_lock);
 		goto out;
@@ -544,7 +576,7 @@ ssize_t unified_read(struct dentry *d, char *buf, size_t size, off_t offset, voi
 			rreq = malloc(sizeof(struct read_request));
 			if (! rreq) {
 				ltfsmsg(LTFS_ERR, 10001E, "unified_read: read request");
-				ltfs_mutex_unlock(&d->iosched_lock);
+				_unified_unlock_dentry(d);
 				ret = -LTFS_NO_MEMORY;
 				goto out;
 			}
@@ -583,7 +615,7 @@ ssize_t unified_read(struct dentry *d, char *buf, size_t size, off_t offset, voi
 	/* Issue any queued reads down to libltfs */
 	if (! TAILQ_EMPTY(&requests)) {
 		ltfs_mutex_lock(&dpr->io_lock);
-		ltfs_mutex_unlock(&d->iosched_lock);
+		_unified_unlock_dentry(d);
 		have_io_lock = true;
 
 		TAILQ_FOREACH_SAFE(rreq, &requests, list, rreq_aux) {
@@ -622,7 +654,7 @@ ssize_t unified_read(struct dentry *d, char *buf, size_t size, off_t offset, voi
 	if (size > 0) {
 		if (! have_io_lock) {
 			ltfs_mutex_lock(&dpr->io_lock);
-			ltfs_mutex_unlock(&d->iosched_lock);
+			_unified_unlock_dentry(d);
 		}
 		nread = ltfs_fsraw_read(d, buf, size, offset, priv->vol);
 		if (nread > 0)
@@ -633,7 +665,7 @@ ssize_t unified_read(struct dentry *d, char *buf, size_t size, off_t offset, voi
 	} else if (have_io_lock)
 		ltfs_mutex_unlock(&dpr->io_lock);
 	else
-		ltfs_mutex_unlock(&d->iosched_lock);
+		_unified_unlock_dentry(d);
 
 out:
 	releaseread_mrsw(&priv->lock);
@@ -660,22 +692,55 @@ out:
  */
 ssize_t unified_write(struct dentry *d, const char *buf, size_t size, off_t offset,
 	bool isupdatetime, void *iosched_handle)
+{
+	struct write_source src = { buf, NULL, NULL, 0 };
+
+	CHECK_ARG_NULL(buf, -LTFS_NULL_ARG);
+	return _unified_write(d, &src, size, offset, isupdatetime, iosched_handle);
+}
+
+/**
+ * Write to a file, copying the data from a caller-defined source straight into cache blocks.
+ * The source is consumed exactly once, in order, so it may be a pipe (FUSE splice).
+ * @param d File to write.
+ * @param source Callback that copies bytes out of the source.
+ * @param source_priv Source handle passed to the callback.
+ * @param size Number of bytes to write.
+ * @param offset Logical file offset where bytes should be written.
+ * @param isupdatetime False if caller is Windows system.
+ * @param iosched_handle Handle to the I/O scheduler data.
+ * @return Number of bytes written on success, or a negative value on error.
+ */
+ssize_t unified_write_source(struct dentry *d, ltfs_write_source source, void *source_priv,
+	size_t size, off_t offset, bool isupdatetime, void *iosched_handle)
+{
+	struct write_source src = { NULL, source, source_priv, 0 };
+
+	CHECK_ARG_NULL(source, -LTFS_NULL_ARG);
+	return _unified_write(d, &src, size, offset, isupdatetime, iosched_handle);
+}
+
+/**
+ * Common implementation of unified_write and unified_write_source.
+ * @param src Data source; src->pos is advanced as bytes are consumed.
+ * Other parameters and the return value are as for unified_write.
+ */
+ssize_t _unified_write(struct dentry *d, struct write_source *src, size_t size, off_t offset,
+	bool isupdatetime, struct unified_data *priv)
 {
 	ssize_t ret = 0;
-	struct unified_data *priv = iosched_handle;
 	struct dentry_priv *dpr;
 	struct write_request *req, *aux, *prev_req;
 	char *req_cache;
 	size_t original_size = size;
-	size_t copy_offset, copy_count;
+	size_t copy_offset;
 	void *spare_cache = NULL;
 	off_t last_offset;
 	int did_merge = 0;
 	bool checked_readonly = false;
 
 	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
-	CHECK_ARG_NULL(buf, -LTFS_NULL_ARG);
-	CHECK_ARG_NULL(iosched_handle, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
 
 	ltfs_profiler_add_entry(priv->profiler, &priv->proflock, IOSCHED_REQ_ENTER(REQ_IOS_WRITE));
 	if (size == 0)
@@ -691,7 +756,7 @@ ssize_t unified_write(struct dentry *d, const char *buf, size_t size, off_t offs
 	releaseread_mrsw(&priv->vol->lock);
 
 write_start:
-	ltfs_mutex_lock(&d->iosched_lock);
+	_unified_lock_dentry(d);
 
 	/* Allocate a new iosched_priv structure if it doesn't exist */
 	ret = _unified_get_dentry_priv(d, &dpr, priv);
@@ -705,7 +770,7 @@ write_start:
 	ret = _unified_get_write_error(dpr);
 	if (ret < 0) {
 		/* Propagate the write error to the caller */
-		ltfs_mutex_unlock(&d->iosched_lock);
+		_unified_unlock_dentry(d);
 		releaseread_mrsw(&priv->lock);
 		ltfs_profiler_add_entry(priv->profiler, &priv->proflock, IOSCHED_REQ_EXIT(REQ_IOS_WRITE));
 		return ret;
@@ -715,7 +780,7 @@ write_start:
 	if (! checked_readonly) {
 		ret = ltfs_get_tape_readonly(priv->vol);
 		if (ret < 0) {
-			ltfs_mutex_unlock(&d->iosched_lock);
+			_unified_unlock_dentry(d);
 			releaseread_mrsw(&priv->lock);
 			ltfs_profiler_add_entry(priv->profiler, &priv->proflock, IOSCHED_REQ_EXIT(REQ_IOS_WRITE));
 			return ret;
@@ -747,22 +812,24 @@ do_append:
 		/* Try to append data to an existing request buffer */
 		if (req && req->count < priv->cache_size && offset == last_offset &&
 			req->state != REQUEST_IP) {
-			copy_count = _unified_update_request(buf, offset, size, dpr, req, priv);
-			buf += copy_count;
-			offset += copy_count;
-			size -= copy_count;
+			ret = _unified_update_request(src, offset, size, dpr, req, priv);
+			if (ret < 0)
+				goto out;
+			src->pos += ret;
+			offset += ret;
+			size -= ret;
 		}
 
 		/* Append new request(s) to the end of the queue */
 		while (size > 0) {
-			ret = _unified_insert_new_request(buf, offset, size, &spare_cache, false,
+			ret = _unified_insert_new_request(src, offset, size, &spare_cache, false,
 				NULL, d, priv);
 			if (ret < 0)
 				goto out;
 			else if (ret == 0)
 				goto write_start;
 
-			buf += ret;
+			src->pos += ret;
 			offset += ret;
 			size -= ret;
 		}
@@ -779,14 +846,14 @@ do_append:
 		/* Insert request(s) before the current one */
 do_insert_before:
 		while (size > 0 && (uint64_t)offset < req->offset) {
-			ret = _unified_insert_new_request(buf, offset, size, &spare_cache, false, req, d, priv);
+			ret = _unified_insert_new_request(src, offset, size, &spare_cache, false, req, d, priv);
 			if (ret < 0)
 				goto out;
 			else if (ret == 0)
 				goto write_start;
 
 			prev_req = TAILQ_PREV(req, req_struct, list);
-			buf += ret;
+			src->pos += ret;
 			offset += ret;
 			size -= ret;
 		}
@@ -812,10 +879,12 @@ do_insert_before:
 				((uint64_t)offset == req->offset + req->count && req->count < priv->cache_size))) {
 				/* Update this request with bytes from the new write */
 				did_merge = true; /* Force another iteration, merge check might be needed */
-				copy_count = _unified_update_request(buf, offset, size, dpr, req, priv);
-				buf += copy_count;
-				offset += copy_count;
-				size -= copy_count;
+				ret = _unified_update_request(src, offset, size, dpr, req, priv);
+				if (ret < 0)
+					goto out;
+				src->pos += ret;
+				offset += ret;
+				size -= ret;
 			} else if (req->state == REQUEST_IP && (uint64_t)offset < req->offset + req->count) {
 				/* Truncate, split or remove this request to avoid overlapping with the new write */
 				if ((uint64_t)offset == req->offset && size >= req->count) { /* Remove */
@@ -839,8 +908,11 @@ do_insert_before:
 					req->count = offset - req->offset;
 				} else {
 					/* Split */
+					struct write_source tail = { NULL, NULL, NULL, 0 };
+
 					copy_offset = (offset - req->offset) + size;
-					ret = _unified_insert_new_request(req_cache + copy_offset,
+					tail.buf = req_cache + copy_offset;
+					ret = _unified_insert_new_request(&tail,
 						req->offset + copy_offset, req->count - copy_offset,
 						&spare_cache, true, aux, d, priv);
 					if (ret < 0)
@@ -870,16 +942,17 @@ out:
 		 * to its previous state. There's no harm in ignoring revalidation errors at this point. */
 		if (err == 0) {
             if (isupdatetime) {
-                acquirewrite_mrsw(&d->meta_lock);
+                acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+                index_snapshot_preserve(d);
                 get_current_timespec(&d->modify_time);
                 d->change_time = d->modify_time;
-                releasewrite_mrsw(&d->meta_lock);
+                releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
             }
 			/* Don't set index dirty flag here. Will be set later by ltfs_fsraw_add_extent. */
 			releaseread_mrsw(&priv->vol->lock);
 		}
 	}
-	ltfs_mutex_unlock(&d->iosched_lock);
+	_unified_unlock_dentry(d);
 	if (spare_cache)
 		_unified_cache_free(spare_cache, 0, priv);
 	releaseread_mrsw(&priv->lock);
@@ -905,9 +978,9 @@ int unified_flush(struct dentry *d, bool closeflag, void *iosched_handle)
 
 	if (d) {
 		acquirewrite_mrsw(&priv->lock);
-		ltfs_mutex_lock(&d->iosched_lock);
+		_unified_lock_dentry(d);
 		ret = _unified_flush_unlocked(d, priv);
-		ltfs_mutex_unlock(&d->iosched_lock);
+		_unified_unlock_dentry(d);
 		releasewrite_mrsw(&priv->lock);
 	} else
 		ret = _unified_flush_all(priv);
@@ -945,7 +1018,7 @@ int unified_truncate(struct dentry *d, off_t length, void *iosched_handle)
 	}
 
 	acquireread_mrsw(&priv->lock);
-	ltfs_mutex_lock(&d->iosched_lock);
+	_unified_lock_dentry(d);
 
 	dpr = d->iosched_priv;
 	if (dpr) {
@@ -978,10 +1051,10 @@ int unified_truncate(struct dentry *d, off_t length, void *iosched_handle)
 
 		/* Recompute dpr->write_ip */
 		max_filesize = index_criteria_get_max_filesize(priv->vol);
-		acquireread_mrsw(&d->meta_lock);
+		acquireread_mrsw(&fs_dentry_locks(d)->meta_lock);
 		matches_name_criteria = d->matches_name_criteria;
 		deleted = d->deleted;
-		releaseread_mrsw(&d->meta_lock);
+		releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 		/* Only reset write_ip if the new size is 0 (complete rewrite) to avoid interleaving
 		 * DP and IP extents in a single file. */
@@ -998,7 +1071,7 @@ int unified_truncate(struct dentry *d, off_t length, void *iosched_handle)
 		ltfs_mutex_unlock(&dpr->io_lock);
 	}
 
-	ltfs_mutex_unlock(&d->iosched_lock);
+	_unified_unlock_dentry(d);
 	releaseread_mrsw(&priv->lock);
 
 	if (! dpr)
@@ -1027,18 +1100,18 @@ uint64_t unified_get_filesize(struct dentry *d, void *iosched_handle)
 
 	/* Try to get the file size from the dentry_priv */
 	acquireread_mrsw(&priv->lock);
-	ltfs_mutex_lock(&d->iosched_lock);
+	_unified_lock_dentry(d);
 	dentry_priv = (struct dentry_priv *) d->iosched_priv;
 	if (dentry_priv)
 		size = dentry_priv->file_size;
-	ltfs_mutex_unlock(&d->iosched_lock);
+	_unified_unlock_dentry(d);
 	releaseread_mrsw(&priv->lock);
 
 	/* If there was no dentry_priv, return file size as stored in the dentry structure */
 	if (! dentry_priv) {
-		acquireread_mrsw(&d->meta_lock);
+		acquireread_mrsw(&fs_dentry_locks(d)->meta_lock);
 		size = d->size;
-		releaseread_mrsw(&d->meta_lock);
+		releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
 	}
 
 	ltfs_profiler_add_entry(priv->profiler, &priv->proflock, IOSCHED_REQ_EXIT(REQ_IOS_GETFSIZE));
@@ -1068,7 +1141,7 @@ int unified_update_data_placement(struct dentry *d, void *iosched_handle)
 	ltfs_profiler_add_entry(priv->profiler, &priv->proflock, IOSCHED_REQ_ENTER(REQ_IOS_UPDPLACE));
 
 	acquireread_mrsw(&priv->lock);
-	ltfs_mutex_lock(&d->iosched_lock);
+	_unified_lock_dentry(d);
 
 	dpr = d->iosched_priv;
 	if (! dpr)
@@ -1077,10 +1150,10 @@ int unified_update_data_placement(struct dentry *d, void *iosched_handle)
 	filesize = dpr->file_size;
 	max_filesize = index_criteria_get_max_filesize(priv->vol);
 
-	acquireread_mrsw(&d->meta_lock);
+	acquireread_mrsw(&fs_dentry_locks(d)->meta_lock);
 	matches_name_criteria = d->matches_name_criteria;
 	deleted = d->deleted;
-	releaseread_mrsw(&d->meta_lock);
+	releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 	if (! dpr->write_ip && max_filesize > 0 && filesize <= max_filesize && matches_name_criteria
 		&& ! deleted)
@@ -1089,7 +1162,7 @@ int unified_update_data_placement(struct dentry *d, void *iosched_handle)
 		_unified_unset_write_ip(dpr, priv);
 
 out:
-	ltfs_mutex_unlock(&d->iosched_lock);
+	_unified_unlock_dentry(d);
 	releaseread_mrsw(&priv->lock);
 
 	ltfs_profiler_add_entry(priv->profiler, &priv->proflock, IOSCHED_REQ_EXIT(REQ_IOS_UPDPLACE));
@@ -1254,11 +1327,11 @@ void _unified_process_data_queue(enum request_state queue, struct unified_data *
 			continue;
 		}
 
-		ltfs_mutex_lock(&dentry->iosched_lock);
+		_unified_lock_dentry(dentry);
 		dentry_priv = dentry->iosched_priv;
 		if (! dentry_priv) {
 			/* Someone else took care of this dentry */
-			ltfs_mutex_unlock(&dentry->iosched_lock);
+			_unified_unlock_dentry(dentry);
 			continue;
 		}
 
@@ -1303,7 +1376,7 @@ void _unified_process_data_queue(enum request_state queue, struct unified_data *
 			}
 		}
 
-		ltfs_mutex_unlock(&dentry->iosched_lock);
+		_unified_unlock_dentry(dentry);
 
 		/* Send requests to tape */
 		if (! TAILQ_EMPTY(&local_req_list)) {
@@ -1325,14 +1398,14 @@ void _unified_process_data_queue(enum request_state queue, struct unified_data *
 			/* If there are requests left, then a write error (ret) occurred */
 			if (! TAILQ_EMPTY(&local_req_list)) {
 				ltfs_mutex_unlock(&dentry_priv->io_lock);
-				ltfs_mutex_lock(&dentry->iosched_lock);
+				_unified_lock_dentry(dentry);
 				if (dentry->iosched_priv) {
 					dentry_priv = dentry->iosched_priv;
 					ltfs_mutex_lock(&dentry_priv->io_lock);
 					_unified_handle_write_error(ret, req, dentry_priv, priv);
 				} else
 					dentry_priv = NULL;
-				ltfs_mutex_unlock(&dentry->iosched_lock);
+				_unified_unlock_dentry(dentry);
 
 				TAILQ_FOREACH_SAFE(req, &local_req_list, list, req_aux) {
 					TAILQ_REMOVE(&local_req_list, req, list);
@@ -1398,10 +1471,10 @@ int _unified_get_dentry_priv(struct dentry *d, struct dentry_priv **dentry_priv,
 		return -LTFS_MUTEX_INIT;
 	}
 
-	acquireread_mrsw(&d->meta_lock);
+	acquireread_mrsw(&fs_dentry_locks(d)->meta_lock);
 	dpr->file_size = d->size;
 	dpr->write_ip = d->matches_name_criteria;
-	releaseread_mrsw(&d->meta_lock);
+	releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
 	max_filesize = index_criteria_get_max_filesize(priv->vol);
 	if (max_filesize == 0 || dpr->file_size > max_filesize)
 		dpr->write_ip = false;
@@ -1697,7 +1770,7 @@ int _unified_cache_alloc(void **cache, struct dentry *d, struct unified_data *pr
 	}
 
 	/* Cache pressure occurred. Release locks and wait for space to become free */
-	ltfs_mutex_unlock(&d->iosched_lock);
+	_unified_unlock_dentry(d);
 	ltfs_thread_mutex_lock(&priv->queue_lock);
 	ltfs_thread_cond_signal(&priv->queue_cond);
 	++priv->cache_requests;
@@ -1716,6 +1789,34 @@ int _unified_cache_alloc(void **cache, struct dentry *d, struct unified_data *pr
 	return 1;
 }
 
+/**
+ * Copy bytes from a write source into a cache block.
+ * @param dst Destination inside a cache block.
+ * @param count Number of bytes to copy.
+ * @param src Source of the data, positioned at the first byte to copy. The position is not
+ *            advanced; the caller does so once the bytes are accounted for.
+ * @return 0 on success or a negative value if the source could not provide 'count' bytes.
+ */
+int _unified_copy_source(char *dst, size_t count, const struct write_source *src)
+{
+	ssize_t ret;
+
+	if (src->buf) {
+		memcpy(dst, src->buf + src->pos, count);
+		return 0;
+	}
+
+	ret = src->copy(dst, count, src->pos, src->copy_priv);
+	if (ret < 0)
+		return ret;
+	else if ((size_t)ret != count) {
+		ltfsmsg(LTFS_ERR, 13028E, (unsigned long)ret, (unsigned long)count);
+		return -LTFS_BAD_ARG;
+	}
+
+	return 0;
+}
+
 /**
  * Insert a new write request before 'req', or at the end of the request list if
  * 'req' is NULL.
@@ -1723,22 +1824,23 @@ int _unified_cache_alloc(void **cache, struct dentry *d, struct unified_data *pr
  * d->iosched_lock may be released during allocation of a new cache block, in which case
  * the function returns without actually inserting a new request into the queue.
  * This is a helper function for unified_write; it may not be useful elsewhere.
- * @param buf Data buffer to copy.
- * @param offset File offset of the buffer.
- * @param count Number of bytes in the buffer.
+ * @param src Source of the data to copy, positioned at the first byte to copy.
+ * @param offset File offset of the data.
+ * @param count Number of bytes available from the source.
  * @param cache Address of a cache block. May point to NULL if no cache block is available when
- *              the function is called. On exit, it contains NULL (for a return value <= 0)
- *              or a pointer to a newly allocated cache block (for a return value of 1).
+ *              the function is called. On exit, it contains NULL if the block was consumed
+ *              by the new request; on error it still holds the block, which the caller frees.
  * @param ip_state True to put the new request into state REQUEST_IP, false to put it in
  *                 REQUEST_DP or REQUEST_PARTIAL (depending on its size).
  * @param req An existing write request, or NULL to insert the new request at the end of the list.
  * @param d Dentry for which this write request is being issued.
  * @return Number of bytes copied on success, 0 if d->iosched_lock must be retaken,
  *         or a negative value on error. d->iosched_lock is released if the function returns 0;
- *         all locks are released on error.
+ *         it remains held on error.
  */
-ssize_t _unified_insert_new_request(const char *buf, off_t offset, size_t count, void **cache,
-	bool ip_state, struct write_request *req, struct dentry *d, struct unified_data *priv)
+ssize_t _unified_insert_new_request(const struct write_source *src, off_t offset, size_t count,
+	void **cache, bool ip_state, struct write_request *req, struct dentry *d,
+	struct unified_data *priv)
 {
 	int ret;
 	struct dentry_priv *dpr = d->iosched_priv;
@@ -1761,15 +1863,14 @@ ssize_t _unified_insert_new_request(const char *buf, off_t offset, size_t count,
 	copy_count = count;
 	if (copy_count > priv->cache_size)
 		copy_count = priv->cache_size;
-	memcpy(cache_manager_get_object_data(*cache), buf, copy_count);
+	ret = _unified_copy_source(cache_manager_get_object_data(*cache), copy_count, src);
+	if (ret < 0)
+		return ret;
 
 	/* Store new write request */
 	new_req = (struct write_request*)calloc(1, sizeof(struct write_request));
 	if (! new_req) {
 		ltfsmsg(LTFS_ERR, 13018E);
-		_unified_cache_free(*cache, 0, priv);
-		ltfs_mutex_unlock(&d->iosched_lock);
-		releaseread_mrsw(&priv->lock);
 		return -LTFS_NO_MEMORY;
 	}
 	new_req->offset = offset;
@@ -1790,7 +1891,7 @@ ssize_t _unified_insert_new_request(const char *buf, off_t offset, size_t count,
 	if (new_req->offset + new_req->count > dpr->file_size)
 		dpr->file_size = new_req->offset + new_req->count;
 
-	return (ssize_t)count;
+	return (ssize_t)copy_count;
 }
 
 /**
@@ -1798,19 +1899,21 @@ ssize_t _unified_insert_new_request(const char *buf, off_t offset, size_t count,
  * Must call with a read lock on priv->lock and a lock on dpr->dentry->iosched_lock.
  * This function must not be called to merge dirty (DP targeted) bytes into a REQUEST_IP
  * request.
- * @param buf New bytes to write.
- * @param offset File offset of buf. Must be between req->offset and
+ * @param src Source of the new bytes, positioned at the first byte to write.
+ * @param offset File offset of the new bytes. Must be between req->offset and
  *               req->offset + req->count, inclusive.
- * @param size Length of buf in bytes.
+ * @param size Number of bytes available from the source.
  * @param dpr dentry_priv structure being processed.
  * @param req Write request to modify.
  * @param priv Handle to I/O scheduler data.
- * @return Number of bytes written to req->write_cache from the beginning of buf.
- *         This function does not fail.
+ * @return Number of bytes written to req->write_cache from the beginning of the source,
+ *         or a negative value if copying from the source failed. This function cannot fail
+ *         for a flat buffer source.
  */
-size_t _unified_update_request(const char *buf, off_t offset, size_t size,
+ssize_t _unified_update_request(const struct write_source *src, off_t offset, size_t size,
 	struct dentry_priv *dpr, struct write_request *req, struct unified_data *priv)
 {
+	int ret;
 	size_t copy_offset; /* Offset into req->write_cache */
 	size_t copy_count;
 	char *req_cache;
@@ -1826,7 +1929,9 @@ size_t _unified_update_request(const char *buf, off_t offset, size_t size,
 	if (copy_count > size)
 		copy_count = size;
 
-	memcpy(req_cache + copy_offset, buf, copy_count);
+	ret = _unified_copy_source(req_cache + copy_offset, copy_count, src);
+	if (ret < 0)
+		return ret;
 	if (copy_offset + copy_count > req->count)
 		req->count = copy_offset + copy_count;
 
@@ -1844,7 +1949,7 @@ size_t _unified_update_request(const char *buf, off_t offset, size_t size,
 	if (req->offset + req->count > dpr->file_size)
 		dpr->file_size = req->offset + req->count;
 
-	return copy_count;
+	return (ssize_t)copy_count;
 }
 
 /**
@@ -1879,10 +1984,11 @@ int _unified_merge_requests(struct write_request *dest, struct write_request *sr
 	 * target partition: otherwise some bytes would get written to the DP more than once. */
 	if (dest->state != src->state && (dest->state == REQUEST_IP || src->state == REQUEST_IP))
 		copy_count = 0;
-	else if (dest->count < priv->cache_size && src->count > copy_offset)
-		copy_count = _unified_update_request(src_cache + copy_offset,
+	else if (dest->count < priv->cache_size && src->count > copy_offset) {
+		struct write_source tail = { src_cache + copy_offset, NULL, NULL, 0 };
+		copy_count = _unified_update_request(&tail,
 			src->offset + copy_offset, src->count - copy_offset, dpr, dest, priv);
-	else
+	} else
 		copy_count = 0;
 
 	/* Truncate or remove the current request */
@@ -2039,9 +2145,9 @@ void _unified_free_dentry_priv_conditional(struct dentry *d, uint32_t target_han
 	uint32_t numhandles;
 	struct dentry_priv *dpr;
 
-	acquireread_mrsw(&d->meta_lock);
+	acquireread_mrsw(&fs_dentry_locks(d)->meta_lock);
 	numhandles = d->numhandles;
-	releaseread_mrsw(&d->meta_lock);
+	releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 	dpr = d->iosched_priv;
 	if (dpr && numhandles <= target_handles && TAILQ_EMPTY(&dpr->requests) &&
@@ -2202,9 +2308,9 @@ void _unified_handle_write_error(ssize_t write_ret, struct write_request *failed
 	}
 
 	/* Recompute file size, starting with what libltfs thinks the file size is */
-	acquireread_mrsw(&dpr->dentry->meta_lock);
+	acquireread_mrsw(&fs_dentry_locks(dpr->dentry)->meta_lock);
 	dpr->file_size = dpr->dentry->size;
-	releaseread_mrsw(&dpr->dentry->meta_lock);
+	releaseread_mrsw(&fs_dentry_locks(dpr->dentry)->meta_lock);
 
 	/* Remove requests from the selected partitions */
 	if (! TAILQ_EMPTY(&dpr->requests)) {
@@ -2359,6 +2465,7 @@ struct iosched_ops unified_ops = {
 	.get_filesize = unified_get_filesize,
 	.update_data_placement = unified_update_data_placement,
 	.set_profiler = unified_set_profiler,
+	.write_source = unified_write_source,
 };
 
 struct iosched_ops *iosched_get_ops(void)
@@ -72,6 +72,18 @@ destroy_mrsw(MultiReaderSingleWriter *mrsw)
 	pthread_rwlock_destroy(mrsw);
 }
 
+static inline void
+enable_reader_bias_mrsw(MultiReaderSingleWriter *mrsw)
+{
+	/* Readers take the rwlock directly, there is no gate to bypass */
+}
+
+static inline void
+set_lock_class_mrsw(MultiReaderSingleWriter *mrsw, uint32_t lock_class)
+{
+	/* The bare rwlock has no room for profiling state */
+}
+
 static inline bool
 try_acquirewrite_mrsw(MultiReaderSingleWriter *mrsw)
 {
@@ -0,0 +1,192 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       capacity_refresh.c
+**
+** DESCRIPTION:     Background refresh of the cached cartridge capacity.
+**
+**                  Reading the capacity from the drive takes the device lock and
+**                  issues a TEST UNIT READY and a log sense, so a statfs that asks
+**                  the drive waits behind every long write. Instead statfs reads
+**                  the capacity cached in the volume (ltfs_capacity_data_cached),
+**                  the write path subtracts the blocks it writes from the cache,
+**                  and this thread re-reads the capacity from the drive once per
+**                  period. Cached values are therefore at most one period old,
+**                  plus whatever the write path could not account for (index
+**                  writes and compression).
+**
+*************************************************************************************
+*/
+
+#include "ltfs.h"
+#include "capacity_refresh.h"
+
+/**
+ * Capacity refresh private data structure.
+ */
+struct capacity_refresh_data {
+	ltfs_thread_cond_t   cond;      /**< Used to wake up the refresh thread */
+	ltfs_thread_mutex_t  mutex;     /**< Protects keepalive */
+	ltfs_thread_t        thread_id; /**< Thread id of the refresh thread */
+	bool                 keepalive; /**< Used to terminate the background thread */
+	int                  period_sec; /**< Period between refreshes (sec) */
+	struct ltfs_volume  *vol;       /**< A reference to the LTFS volume structure */
+};
+
+/**
+ * Main routine for the capacity refresh. Reads the capacity once right away, so the
+ * first statfs after mount does not have to, and then once per period.
+ * @param data Capacity refresh private data
+ * @return NULL.
+ */
+ltfs_thread_return capacity_refresh_thread(void *data)
+{
+	struct capacity_refresh_data *priv = (struct capacity_refresh_data *) data;
+	struct device_capacity cap;
+	int ret;
+
+	ltfs_thread_mutex_lock(&priv->mutex);
+	while (priv->keepalive) {
+		ltfs_thread_mutex_unlock(&priv->mutex);
+
+		/* Updates the volume's capacity cache as a side effect */
+		ret = ltfs_capacity_data(&cap, priv->vol);
+		if (ret < 0)
+			ltfsmsg(LTFS_DEBUG, 17312D, ret);
+
+		ltfs_thread_mutex_lock(&priv->mutex);
+		if (! priv->keepalive)
+			break;
+		ltfs_thread_cond_timedwait(&priv->cond, &priv->mutex, priv->period_sec);
+	}
+	ltfs_thread_mutex_unlock(&priv->mutex);
+
+	ltfs_thread_exit();
+
+	return LTFS_THREAD_RC_NULL;
+}
+
+/**
+ * Verifies if the capacity refresh thread is currently running.
+ * @param vol LTFS volume
+ * @return true if the thread is running, false if not.
+ */
+bool capacity_refresh_thread_initialized(struct ltfs_volume *vol)
+{
+	return vol && vol->capacity_refresh_handle;
+}
+
+/**
+ * Initialize the capacity refresh thread.
+ * @param sec period in which the capacity is read from the drive
+ * @param vol LTFS volume
+ * @return 0 on success or a negative value on error.
+ */
+int capacity_refresh_thread_init(int sec, struct ltfs_volume *vol)
+{
+	int ret;
+	struct capacity_refresh_data *priv;
+
+	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
+
+	priv = calloc(1, sizeof(struct capacity_refresh_data));
+	if (! priv) {
+		ltfsmsg(LTFS_ERR, 10001E, "capacity_refresh_thread_init: capacity refresh data");
+		return -LTFS_NO_MEMORY;
+	}
+
+	priv->vol = vol;
+	priv->keepalive = true;
+	priv->period_sec = sec;
+
+	ret = ltfs_thread_cond_init(&priv->cond);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10003E, ret);
+		free(priv);
+		return -ret;
+	}
+	ret = ltfs_thread_mutex_init(&priv->mutex);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10002E, ret);
+		ltfs_thread_cond_destroy(&priv->cond);
+		free(priv);
+		return -ret;
+	}
+	ret = ltfs_thread_create(&priv->thread_id, capacity_refresh_thread, priv);
+	if (ret < 0) {
+		/* Failed to spawn the capacity refresh thread (%d) */
+		ltfsmsg(LTFS_ERR, 17311E, ret);
+		ltfs_thread_mutex_destroy(&priv->mutex);
+		ltfs_thread_cond_destroy(&priv->cond);
+		free(priv);
+		return -ret;
+	}
+
+	ltfsmsg(LTFS_DEBUG, 17309D, sec);
+	vol->capacity_refresh_handle = priv;
+
+	return 0;
+}
+
+/**
+ * Destroy the capacity refresh thread.
+ * @param vol LTFS volume
+ * @return 0 on success or a negative value on error.
+ */
+int capacity_refresh_thread_destroy(struct ltfs_volume *vol)
+{
+	struct capacity_refresh_data *priv = vol ? vol->capacity_refresh_handle : NULL;
+
+	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+
+	ltfs_thread_mutex_lock(&priv->mutex);
+	priv->keepalive = false;
+	ltfs_thread_cond_signal(&priv->cond);
+	ltfs_thread_mutex_unlock(&priv->mutex);
+
+	ltfs_thread_join(priv->thread_id);
+	ltfs_thread_cond_destroy(&priv->cond);
+	ltfs_thread_mutex_destroy(&priv->mutex);
+	free(priv);
+
+	vol->capacity_refresh_handle = NULL;
+
+	ltfsmsg(LTFS_DEBUG, 17310D);
+	return 0;
+}
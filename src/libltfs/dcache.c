@@ -206,6 +206,14 @@ int dcache_parse_options(const char **options, struct dcache_options **out)
 				ret = -EINVAL;
 				goto out_free;
 			}
+		} else if (! strcmp(option, "maxresident")) {
+			opt->maxresident = strtoull(value, NULL, 10);
+			if (opt->maxresident == 0) {
+				/* Failed to parse LTFS dcache configuration rules: invalid value '%d' for option '%s' */
+				ltfsmsg(LTFS_ERR, 17171E, atoi(value), option);
+				ret = -EINVAL;
+				goto out_free;
+			}
 		} else {
 			/* Failed to parse LTFS dcache configuration rules: invalid option '%s' */
 			ltfsmsg(LTFS_ERR, 17170E, options[i]);
@@ -860,3 +868,38 @@ int dcache_getxattr(const char *path, struct dentry *d, const char *name,
 
 	return priv->ops->getxattr(path, d, name, value, size, priv->backend_handle);
 }
+
+int dcache_load(struct dentry *d, bool evict, struct ltfs_volume *vol)
+{
+	struct dcache_priv *priv = (struct dcache_priv *) vol ? vol->dcache_handle : NULL;
+
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv->ops, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv->ops->load, -LTFS_NULL_ARG);
+
+	return priv->ops->load(d, evict, priv->backend_handle);
+}
+
+void dcache_forget(struct dentry *d, struct ltfs_volume *vol)
+{
+	struct dcache_priv *priv = (struct dcache_priv *) vol ? vol->dcache_handle : NULL;
+
+	if (d && priv && priv->ops && priv->ops->forget)
+		priv->ops->forget(d, priv->backend_handle);
+}
+
+int dcache_get_contents(uint64_t uid, char **buf, size_t *size, struct ltfs_volume *vol)
+{
+	struct dcache_priv *priv = (struct dcache_priv *) vol ? vol->dcache_handle : NULL;
+
+	CHECK_ARG_NULL(buf, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(size, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv->ops, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv->ops->get_contents, -LTFS_NULL_ARG);
+
+	return priv->ops->get_contents(uid, buf, size, priv->backend_handle);
+}
@@ -134,6 +134,11 @@ int  dcache_getxattr(const char *path, struct dentry *d, const char *name,
 int  dcache_get_dentry(struct dentry *d, struct ltfs_volume *vol);
 int  dcache_put_dentry(struct dentry *d, struct ltfs_volume *vol);
 
+/* Directory residency */
+int  dcache_load(struct dentry *d, bool evict, struct ltfs_volume *vol);
+void dcache_forget(struct dentry *d, struct ltfs_volume *vol);
+int  dcache_get_contents(uint64_t uid, char **buf, size_t *size, struct ltfs_volume *vol);
+
 #ifdef __cplusplus
 }
 #endif
@@ -72,6 +72,7 @@ struct dcache_options {
 	bool enabled;  /**< Disk cache is enabled */
 	int minsize;   /**< Minimum size (initial size of dcache image) in GB */
 	int maxsize;   /**< Maximum size (final size of dcache image) in GB */
+	uint64_t maxresident; /**< Dentries kept in memory before directories are evicted, 0 for default */
 };
 
 /**
@@ -233,7 +234,13 @@ struct dcache_ops {
 	int      (*get_advisory_lock)(const char *name, void *dcache_handle);
 	int      (*put_advisory_lock)(const char *name, void *dcache_handle);
 
-	/* File system operations */
+	/* File system operations. libltfs changes the in-memory dentry tree itself and keeps
+	 * the cache in step through these: create and flush are called after the change with
+	 * the dentry in its new state and no dentry locks held. rename is called before the
+	 * change, with the contents_lock of both parent directories held; an error aborts the
+	 * rename. unlink is called with the meta_lock of the dentry and of its parent held.
+	 * readdir is called with the contents_lock of the directory held. read_direntry gets
+	 * the position among the children, not counting "." and "..". */
 	int      (*open)(const char *path, struct dentry **d, void *dcache_handle);
 	int      (*openat)(const char *parent_path, struct dentry *parent, const char *name,
 						struct dentry **result, void *dcache_handle);
@@ -257,6 +264,39 @@ struct dcache_ops {
 	/* Helper operations */
 	int      (*get_dentry)(struct dentry *d, void *dcache_handle);
 	int      (*put_dentry)(struct dentry *d, void *dcache_handle);
+
+	/* Directory residency. The children of a directory may be dropped from memory and kept
+	 * by the cache only, in which case the dcache_evicted flag of the directory is set. */
+
+	/**
+	 * Make sure the children of a directory are in memory, loading them from the cache if
+	 * they were evicted. Called by index_spill_load() for directories outside the index
+	 * spill, possibly with the contents_lock of the directory held.
+	 * @param d Directory.
+	 * @param evict True to evict unused directories if too many dentries are loaded.
+	 * @param dcache_handle dcache handle returned by init() call of dcache
+	 * @return 0 on success or a negative value on error.
+	 */
+	int      (*load)(struct dentry *d, bool evict, void *dcache_handle);
+
+	/**
+	 * Stop tracking a directory which is being disposed. Called for dentries whose
+	 * dcache_priv field is set.
+	 * @param d Directory being disposed.
+	 * @param dcache_handle dcache handle returned by init() call of dcache
+	 */
+	void     (*forget)(struct dentry *d, void *dcache_handle);
+
+	/**
+	 * Get the children of an evicted directory in the format of
+	 * xml_dir_contents_to_record(), for the index writer.
+	 * @param uid UID of the directory.
+	 * @param[out] buf On success, an allocated buffer holding the record.
+	 * @param[out] size On success, the size of the record.
+	 * @param dcache_handle dcache handle returned by init() call of dcache
+	 * @return 0 on success or a negative value on error.
+	 */
+	int      (*get_contents)(uint64_t uid, char **buf, size_t *size, void *dcache_handle);
 };
 
 struct dcache_ops *dcache_get_ops(void);
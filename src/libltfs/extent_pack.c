@@ -0,0 +1,402 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       extent_pack.c
+**
+** DESCRIPTION:     Packed extent list.
+**
+**                  Files written over many sessions, or interleaved with other
+**                  files, can have hundreds of thousands of extents. Kept as a
+**                  list, every extent is a separate allocation. A packed list
+**                  stores them in one byte array instead, each extent encoded as
+**                  variable length deltas from the extent before it: start block,
+**                  byte offset, byte count and the gap between the end of the
+**                  previous extent and its file offset.
+**
+**                  Extents are encoded in groups of EXTENT_PACK_GROUP. The first
+**                  extent of each group is kept unencoded in a group header, so
+**                  a seek binary searches the headers by file offset and decodes
+**                  at most one group. The last extent is also kept unencoded, so
+**                  it can be extended in place, and it is encoded only when the
+**                  next extent is appended.
+**
+*************************************************************************************
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ltfs.h"
+#include "extent_pack.h"
+
+/** Number of extents in a group */
+#define EXTENT_PACK_GROUP (64)
+
+/** Longest encoding of an extent: four 64-bit variable length integers and a partition */
+#define EXTENT_PACK_MAX_ENCODED (4 * 10 + 1)
+
+/**
+ * First extent of a group, and where the rest of the group is encoded.
+ */
+struct extent_pack_group {
+	uint64_t block;       /**< Start block */
+	uint64_t bytecount;   /**< Number of bytes */
+	uint64_t fileoffset;  /**< File offset */
+	uint32_t byteoffset;  /**< Offset in the start block */
+	uint32_t pos;         /**< Offset of the second extent of the group in data */
+	char partition;       /**< Partition */
+};
+
+/**
+ * extent_pack structure.
+ * Must be created by extent_pack_alloc() and freed by extent_pack_free().
+ */
+struct extent_pack {
+	uint32_t count;                    /**< Number of extents, including the tail */
+	uint32_t ngroups;                  /**< Number of groups in use */
+	uint32_t max_groups;               /**< Number of groups allocated */
+	uint32_t len;                      /**< Number of bytes of data in use */
+	uint32_t size;                     /**< Number of bytes of data allocated */
+	struct extent_pack_group *groups;  /**< Group headers */
+	unsigned char *data;               /**< Encoded extents */
+	struct extent_info last;           /**< Last encoded extent */
+	struct extent_info tail;           /**< Last extent, not encoded yet */
+};
+
+static void _extent_pack_set(struct extent_info *dst, const struct extent_info *src)
+{
+	dst->start = src->start;
+	dst->byteoffset = src->byteoffset;
+	dst->bytecount = src->bytecount;
+	dst->fileoffset = src->fileoffset;
+}
+
+static inline uint32_t _extent_pack_put(unsigned char *p, uint64_t value)
+{
+	uint32_t n = 0;
+
+	while (value >= 0x80) {
+		p[n++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	p[n++] = (unsigned char)value;
+	return n;
+}
+
+static inline uint64_t _extent_pack_get(const unsigned char *data, uint32_t *pos)
+{
+	uint64_t value = 0;
+	unsigned int shift = 0;
+	unsigned char c;
+
+	do {
+		c = data[(*pos)++];
+		value |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return value;
+}
+
+/**
+ * Encode an extent after 'prev'. The start block delta is zigzag encoded since it can be
+ * negative; the lowest bit of the byte offset field tells whether a partition follows.
+ */
+static uint32_t _extent_pack_encode(unsigned char *p, const struct extent_info *prev,
+	const struct extent_info *ext)
+{
+	uint64_t delta = ext->start.block - prev->start.block;
+	bool new_partition = (ext->start.partition != prev->start.partition);
+	uint32_t n;
+
+	n = _extent_pack_put(p, (delta << 1) ^ (uint64_t)((int64_t)delta >> 63));
+	n += _extent_pack_put(p + n, ((uint64_t)ext->byteoffset << 1) | (new_partition ? 1 : 0));
+	if (new_partition)
+		p[n++] = (unsigned char)ext->start.partition;
+	n += _extent_pack_put(p + n, ext->bytecount);
+	n += _extent_pack_put(p + n, ext->fileoffset - (prev->fileoffset + prev->bytecount));
+	return n;
+}
+
+static void _extent_pack_decode(const unsigned char *data, uint32_t *pos, struct extent_info *ext)
+{
+	uint64_t value;
+
+	value = _extent_pack_get(data, pos);
+	ext->start.block += (value >> 1) ^ (0 - (value & 1));
+	value = _extent_pack_get(data, pos);
+	ext->byteoffset = (uint32_t)(value >> 1);
+	if (value & 1)
+		ext->start.partition = (char)data[(*pos)++];
+	ext->fileoffset += ext->bytecount;
+	ext->bytecount = _extent_pack_get(data, pos);
+	ext->fileoffset += _extent_pack_get(data, pos);
+}
+
+static void _extent_pack_load_group(struct extent_pack_iter *iter, uint32_t group)
+{
+	const struct extent_pack_group *g = &iter->pack->groups[group];
+
+	iter->index = group * EXTENT_PACK_GROUP;
+	iter->pos = g->pos;
+	iter->cur.start.partition = g->partition;
+	iter->cur.start.block = g->block;
+	iter->cur.byteoffset = g->byteoffset;
+	iter->cur.bytecount = g->bytecount;
+	iter->cur.fileoffset = g->fileoffset;
+}
+
+/**
+ * Allocate an empty packed extent list.
+ * @return the new list, or NULL if memory is exhausted.
+ */
+struct extent_pack *extent_pack_alloc(void)
+{
+	struct extent_pack *pack = calloc(1, sizeof(struct extent_pack));
+	if (! pack)
+		ltfsmsg(LTFS_ERR, 10001E, "extent_pack_alloc");
+	return pack;
+}
+
+void extent_pack_free(struct extent_pack *pack)
+{
+	if (! pack)
+		return;
+	free(pack->groups);
+	free(pack->data);
+	free(pack);
+}
+
+/**
+ * Copy a packed extent list, allocating only the memory in use by the source.
+ * @return the copy, or NULL if memory is exhausted.
+ */
+struct extent_pack *extent_pack_copy(const struct extent_pack *pack)
+{
+	struct extent_pack *copy;
+
+	copy = extent_pack_alloc();
+	if (! copy)
+		return NULL;
+
+	*copy = *pack;
+	copy->groups = NULL;
+	copy->data = NULL;
+	copy->max_groups = pack->ngroups;
+	copy->size = pack->len;
+
+	if (pack->ngroups) {
+		copy->groups = malloc(pack->ngroups * sizeof(struct extent_pack_group));
+		if (! copy->groups)
+			goto out_nomem;
+		memcpy(copy->groups, pack->groups, pack->ngroups * sizeof(struct extent_pack_group));
+	}
+	if (pack->len) {
+		copy->data = malloc(pack->len);
+		if (! copy->data)
+			goto out_nomem;
+		memcpy(copy->data, pack->data, pack->len);
+	}
+
+	return copy;
+
+out_nomem:
+	ltfsmsg(LTFS_ERR, 10001E, "extent_pack_copy");
+	extent_pack_free(copy);
+	return NULL;
+}
+
+uint32_t extent_pack_count(const struct extent_pack *pack)
+{
+	return pack->count;
+}
+
+/**
+ * Append an extent to a packed list. The list is unchanged if this function fails.
+ * @param pack Extent list.
+ * @param ext Extent to append. It must not start before the end of the last extent.
+ * @return 0 on success, -LTFS_BAD_ARG if ext overlaps the last extent or the list is full,
+ *         or -LTFS_NO_MEMORY if memory is exhausted.
+ */
+int extent_pack_append(struct extent_pack *pack, const struct extent_info *ext)
+{
+	uint32_t index, new_size;
+	void *tmp;
+
+	if (pack->count == 0) {
+		_extent_pack_set(&pack->tail, ext);
+		pack->count = 1;
+		return 0;
+	}
+
+	if (ext->fileoffset < pack->tail.fileoffset + pack->tail.bytecount ||
+		pack->count == UINT32_MAX)
+		return -LTFS_BAD_ARG;
+
+	/* Encode the tail, which becomes the extent at 'index' */
+	index = pack->count - 1;
+	if (index % EXTENT_PACK_GROUP == 0) {
+		if (pack->ngroups == pack->max_groups) {
+			new_size = pack->max_groups ? pack->max_groups * 2 : 1;
+			tmp = realloc(pack->groups, new_size * sizeof(struct extent_pack_group));
+			if (! tmp) {
+				ltfsmsg(LTFS_ERR, 10001E, "extent_pack_append: groups");
+				return -LTFS_NO_MEMORY;
+			}
+			pack->groups = tmp;
+			pack->max_groups = new_size;
+		}
+		pack->groups[pack->ngroups].partition = pack->tail.start.partition;
+		pack->groups[pack->ngroups].block = pack->tail.start.block;
+		pack->groups[pack->ngroups].byteoffset = pack->tail.byteoffset;
+		pack->groups[pack->ngroups].bytecount = pack->tail.bytecount;
+		pack->groups[pack->ngroups].fileoffset = pack->tail.fileoffset;
+		pack->groups[pack->ngroups].pos = pack->len;
+		++pack->ngroups;
+	} else {
+		if (pack->size - pack->len < EXTENT_PACK_MAX_ENCODED) {
+			if (pack->size > UINT32_MAX / 2)
+				return -LTFS_BAD_ARG;
+			new_size = pack->size ? pack->size * 2 : EXTENT_PACK_GROUP * 8;
+			tmp = realloc(pack->data, new_size);
+			if (! tmp) {
+				ltfsmsg(LTFS_ERR, 10001E, "extent_pack_append: data");
+				return -LTFS_NO_MEMORY;
+			}
+			pack->data = tmp;
+			pack->size = new_size;
+		}
+		pack->len += _extent_pack_encode(pack->data + pack->len, &pack->last, &pack->tail);
+	}
+
+	pack->last = pack->tail;
+	_extent_pack_set(&pack->tail, ext);
+	++pack->count;
+	return 0;
+}
+
+/**
+ * Get the last extent of a packed list. The caller may extend it in place, as long as it
+ * does not overlap the extent which is appended next.
+ * @return the last extent, or NULL if the list is empty.
+ */
+struct extent_info *extent_pack_tail(struct extent_pack *pack)
+{
+	return pack->count ? &pack->tail : NULL;
+}
+
+/**
+ * Start walking a packed extent list.
+ * @param pack Extent list. It must not change while it is walked.
+ * @param iter Walk position.
+ * @return the first extent, or NULL if the list is empty.
+ */
+const struct extent_info *extent_pack_first(const struct extent_pack *pack,
+	struct extent_pack_iter *iter)
+{
+	iter->pack = pack;
+	if (pack->count == 0)
+		return NULL;
+
+	if (pack->count == 1) {
+		iter->index = 0;
+		_extent_pack_set(&iter->cur, &pack->tail);
+	} else
+		_extent_pack_load_group(iter, 0);
+	return &iter->cur;
+}
+
+/**
+ * Move to the next extent of a packed list.
+ * @return the next extent, or NULL at the end of the list.
+ */
+const struct extent_info *extent_pack_next(struct extent_pack_iter *iter)
+{
+	uint32_t index = iter->index + 1;
+
+	if (index >= iter->pack->count)
+		return NULL;
+
+	if (index == iter->pack->count - 1) {
+		iter->index = index;
+		_extent_pack_set(&iter->cur, &iter->pack->tail);
+	} else if (index % EXTENT_PACK_GROUP == 0)
+		_extent_pack_load_group(iter, index / EXTENT_PACK_GROUP);
+	else {
+		iter->index = index;
+		_extent_pack_decode(iter->pack->data, &iter->pos, &iter->cur);
+	}
+	return &iter->cur;
+}
+
+/**
+ * Start walking a packed extent list from the first extent which ends after a file offset.
+ * @param pack Extent list. It must not change while it is walked.
+ * @param fileoffset File offset.
+ * @param iter Walk position.
+ * @return the first extent which ends after fileoffset, or NULL if there is none.
+ */
+const struct extent_info *extent_pack_seek(const struct extent_pack *pack, uint64_t fileoffset,
+	struct extent_pack_iter *iter)
+{
+	const struct extent_info *ext;
+	uint32_t lo = 0, hi = pack->ngroups, mid;
+
+	iter->pack = pack;
+	if (pack->count == 0)
+		return NULL;
+
+	/* Find the last group starting at or before fileoffset */
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (pack->groups[mid].fileoffset <= fileoffset)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	if (pack->ngroups == 0) {
+		iter->index = 0;
+		_extent_pack_set(&iter->cur, &pack->tail);
+	} else
+		_extent_pack_load_group(iter, lo);
+
+	ext = &iter->cur;
+	while (ext && ext->fileoffset + ext->bytecount <= fileoffset)
+		ext = extent_pack_next(iter);
+	return ext;
+}
@@ -0,0 +1,88 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       extent_pack.h
+**
+** DESCRIPTION:     Prototypes for the packed extent list.
+**
+*************************************************************************************
+*/
+#ifndef __extent_pack_h
+#define __extent_pack_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ltfs.h"
+
+/** Files with at least this many extents keep them packed after an index is parsed */
+#define EXTENT_PACK_MIN_EXTENTS (64)
+
+struct extent_pack;
+
+/**
+ * Position in a packed extent list. The extent at the position is decoded into 'cur'.
+ */
+struct extent_pack_iter {
+	const struct extent_pack *pack;  /**< Extent list being walked */
+	uint32_t index;                  /**< Index of the current extent */
+	uint32_t pos;                    /**< Offset of the next encoded extent */
+	struct extent_info cur;          /**< Current extent */
+};
+
+struct extent_pack *extent_pack_alloc(void);
+void extent_pack_free(struct extent_pack *pack);
+struct extent_pack *extent_pack_copy(const struct extent_pack *pack);
+uint32_t extent_pack_count(const struct extent_pack *pack);
+int extent_pack_append(struct extent_pack *pack, const struct extent_info *ext);
+struct extent_info *extent_pack_tail(struct extent_pack *pack);
+const struct extent_info *extent_pack_first(const struct extent_pack *pack,
+	struct extent_pack_iter *iter);
+const struct extent_info *extent_pack_next(struct extent_pack_iter *iter);
+const struct extent_info *extent_pack_seek(const struct extent_pack *pack, uint64_t fileoffset,
+	struct extent_pack_iter *iter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __extent_pack_h */
@@ -65,13 +65,16 @@
 #include "arch/filename_handling.h"
 #include "dcache.h"
 #include "fs.h"
+#include "path_cache.h"
+#include "index_snapshot.h"
 
 #define TRUNCATE_STRING(end) do { if ((end)) *(end) = '\0'; } while(0)
 #define RESTORE_STRING(end)  do { if ((end)) *(end) =  '/'; } while(0)
 
 int fs_hash_sort_by_uid(struct name_list *a, struct name_list *b)
 {
-	return (a->uid - b->uid);
+	/* UIDs are 64 bits wide, so their difference does not fit in the return value */
+	return (a->uid > b->uid) - (a->uid < b->uid);
 }
 
 static char* generate_hash_key_name(const char *src_str, int *rc)
@@ -104,9 +107,9 @@ static char* generate_hash_key_name(const char *src_str, int *rc)
 
 struct name_list* fs_add_key_to_hash_table(struct name_list *list, struct dentry *add_entry, int *rc)
 {
-	struct name_list *new_list = NULL;
+	struct name_list *new_list = NULL, *tail;
 
-	new_list = (struct name_list *) malloc(sizeof(struct name_list));
+	new_list = calloc(1, sizeof(struct name_list));
 	if (!new_list) {
 		ltfsmsg(LTFS_ERR, 10001E, "fs_add_key_to_hash_table: new list");
 		*rc = -LTFS_NO_MEMORY;
@@ -114,12 +117,23 @@ struct name_list* fs_add_key_to_hash_table(struct name_list *list, struct dentry
 	}
 
 	new_list->name = generate_hash_key_name(add_entry->platform_safe_name, rc);
+	if (! new_list->name) {
+		free(new_list);
+		return list;
+	}
 
-	if (*rc == 0 && new_list->name != NULL)	{
+	if (*rc == 0)	{
 		errno = 0;
 		new_list->d = add_entry;
 		new_list->uid = add_entry->uid;
-		HASH_ADD_KEYPTR(hh, list, new_list->name, strlen(new_list->name), new_list);
+		/* Keep children in UID order so listings can resume from a UID. New dentries have the
+		 * highest UID; only renamed ones land before the end. */
+		tail = HASH_TAIL(hh, list);
+		if (! tail || tail->uid < new_list->uid)
+			HASH_ADD_KEYPTR(hh, list, new_list->name, strlen(new_list->name), new_list);
+		else
+			HASH_ADD_KEYPTR_INORDER(hh, list, new_list->name, strlen(new_list->name), new_list,
+				fs_hash_sort_by_uid);
 		if (errno == ENOMEM) {
 			ltfsmsg(LTFS_ERR, 10001E, "fs_add_key_to_hash_table: add key");
 			*rc = -LTFS_NO_MEMORY;
@@ -178,15 +192,719 @@ void fs_decrement_file_count(struct ltfs_index *idx)
 static ltfs_mutex_t inode_mutex;
 static ino_t inode_number = 0;
 
+/**
+ * Lock blocks of dentries. A block is allocated the first time a dentry is locked and is
+ * released again by fs_release_idle_dentry_locks() once the dentry is idle, so only the
+ * dentries in use hold one. A few spare blocks are kept for fs_dentry_locks(), which cannot
+ * fail: when memory is exhausted and no spare block is left, it waits until a block is returned
+ * to the reserve or memory can be allocated again. See fs_prepare_dentry_locks().
+ */
+#define FS_DENTRY_LOCKS_RESERVE (64)
+
+static ltfs_mutex_t dentry_locks_mutex;
+static TAILQ_HEAD(dentry_locks_struct, dentry_locks) dentry_locks_list =
+	TAILQ_HEAD_INITIALIZER(dentry_locks_list);
+static size_t dentry_locks_count = 0;
+static struct dentry_locks *dentry_locks_reserve[FS_DENTRY_LOCKS_RESERVE];
+static size_t dentry_locks_reserved = 0;
+static ltfs_thread_mutex_t dentry_locks_wait_lock;
+static ltfs_thread_cond_t dentry_locks_wait_cond;
+
+static struct dentry_locks *_fs_new_dentry_locks(void)
+{
+	int ret;
+	struct dentry_locks *locks;
+
+	locks = calloc(1, sizeof(struct dentry_locks));
+	if (! locks)
+		return NULL;
+
+	ret = init_mrsw(&locks->contents_lock);
+	if (ret == 0) {
+		ret = init_mrsw(&locks->meta_lock);
+		if (ret < 0)
+			destroy_mrsw(&locks->contents_lock);
+	}
+	if (ret == 0) {
+		ret = ltfs_mutex_init(&locks->iosched_lock);
+		if (ret) {
+			destroy_mrsw(&locks->meta_lock);
+			destroy_mrsw(&locks->contents_lock);
+		}
+	}
+	if (ret) {
+		free(locks);
+		return NULL;
+	}
+
+	set_lock_class_mrsw(&locks->contents_lock, LOCK_CLASS_CONTENTS);
+	set_lock_class_mrsw(&locks->meta_lock, LOCK_CLASS_META);
+	return locks;
+}
+
+static void _fs_destroy_dentry_locks(struct dentry_locks *locks)
+{
+	destroy_mrsw(&locks->contents_lock);
+	destroy_mrsw(&locks->meta_lock);
+	ltfs_mutex_destroy(&locks->iosched_lock);
+	free(locks);
+}
+
 int fs_init_inode(void)
 {
 	int ret;
 
 	ret = ltfs_mutex_init(&inode_mutex);
-	if (ret)
+	if (ret) {
 		ltfsmsg(LTFS_ERR, 10002E, ret);
+		return ret;
+	}
 
-	return ret;
+	ret = ltfs_mutex_init(&dentry_locks_mutex);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10002E, ret);
+		return ret;
+	}
+
+	ret = ltfs_thread_mutex_init(&dentry_locks_wait_lock);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10002E, ret);
+		return ret;
+	}
+
+	ret = ltfs_thread_cond_init(&dentry_locks_wait_cond);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10003E, ret);
+		return ret;
+	}
+
+	while (dentry_locks_reserved < FS_DENTRY_LOCKS_RESERVE) {
+		dentry_locks_reserve[dentry_locks_reserved] = _fs_new_dentry_locks();
+		if (! dentry_locks_reserve[dentry_locks_reserved]) {
+			ltfsmsg(LTFS_ERR, 10001E, "fs_init_inode: dentry locks");
+			return -LTFS_NO_MEMORY;
+		}
+		++dentry_locks_reserved;
+	}
+
+	return 0;
+}
+
+/**
+ * Return an unused lock block to the reserve, or free it if the reserve is full.
+ * The caller must hold dentry_locks_mutex.
+ * @return true if the block went to the reserve.
+ */
+static bool _fs_reserve_dentry_locks(struct dentry_locks *locks)
+{
+	if (dentry_locks_reserved >= FS_DENTRY_LOCKS_RESERVE) {
+		_fs_destroy_dentry_locks(locks);
+		return false;
+	}
+
+	locks->owner = NULL;
+	dentry_locks_reserve[dentry_locks_reserved++] = locks;
+	return true;
+}
+
+/**
+ * Wake up the threads waiting in fs_allocate_dentry_locks() for a spare block.
+ */
+static void _fs_wake_dentry_locks_waiters(void)
+{
+	ltfs_thread_mutex_lock(&dentry_locks_wait_lock);
+	ltfs_thread_cond_broadcast(&dentry_locks_wait_cond);
+	ltfs_thread_mutex_unlock(&dentry_locks_wait_lock);
+}
+
+/**
+ * Release the locks of a dentry which is being freed, if it was ever locked.
+ */
+static void _fs_free_dentry_locks(struct dentry *d)
+{
+	struct dentry_locks *locks;
+	bool reserved = false;
+
+	ltfs_mutex_lock(&dentry_locks_mutex);
+	locks = d->locks;
+	if (locks) {
+		TAILQ_REMOVE(&dentry_locks_list, locks, list);
+		--dentry_locks_count;
+		d->locks = NULL;
+		reserved = _fs_reserve_dentry_locks(locks);
+	}
+	ltfs_mutex_unlock(&dentry_locks_mutex);
+
+	if (reserved)
+		_fs_wake_dentry_locks_waiters();
+}
+
+/**
+ * Free a dentry allocated by fs_allocate_dentry() without disposing of its
+ * contents. Only for parser error paths, where the dentry was never linked into the tree.
+ */
+void fs_free_dentry(struct dentry *d)
+{
+	_fs_free_dentry_locks(d);
+	free(d);
+}
+
+/**
+ * Publish a lock block for a dentry. The first thread to publish wins and the others
+ * release their blocks.
+ */
+static struct dentry_locks *_fs_publish_dentry_locks(struct dentry *d, struct dentry_locks *locks)
+{
+	struct dentry_locks *expected = NULL;
+
+	locks->owner = d;
+	ltfs_mutex_lock(&dentry_locks_mutex);
+	if (__atomic_compare_exchange_n(&d->locks, &expected, locks, false,
+									__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		TAILQ_INSERT_TAIL(&dentry_locks_list, locks, list);
+		++dentry_locks_count;
+		ltfs_mutex_unlock(&dentry_locks_mutex);
+		return locks;
+	}
+	ltfs_mutex_unlock(&dentry_locks_mutex);
+
+	_fs_destroy_dentry_locks(locks);
+	return expected;
+}
+
+/**
+ * Make sure a dentry has its locks allocated before it is locked.
+ *
+ * Call this where a reference to a dentry is first obtained, or before locking a dentry
+ * which is reached through its parent without taking a reference, so that running out of
+ * memory is reported to the caller instead of in fs_dentry_locks(). The locks stay allocated
+ * while the caller holds vol->lock, and as long as the dentry is referenced.
+ * @param d Dentry to allocate locks for.
+ * @return 0 on success or -LTFS_NO_MEMORY.
+ */
+int fs_prepare_dentry_locks(struct dentry *d)
+{
+	struct dentry_locks *locks;
+
+	if (__atomic_load_n(&d->locks, __ATOMIC_ACQUIRE))
+		return 0;
+
+	locks = _fs_new_dentry_locks();
+	if (! locks) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+
+	_fs_publish_dentry_locks(d, locks);
+	return 0;
+}
+
+/**
+ * Take a block from the reserve.
+ * @return the block, or NULL if the reserve is empty.
+ */
+static struct dentry_locks *_fs_take_reserved_dentry_locks(void)
+{
+	struct dentry_locks *locks = NULL;
+
+	ltfs_mutex_lock(&dentry_locks_mutex);
+	if (dentry_locks_reserved)
+		locks = dentry_locks_reserve[--dentry_locks_reserved];
+	ltfs_mutex_unlock(&dentry_locks_mutex);
+
+	return locks;
+}
+
+/**
+ * Allocate and publish the locks of a dentry which was not prepared with
+ * fs_prepare_dentry_locks(). Called by fs_dentry_locks(), which cannot fail: if memory is
+ * exhausted a spare block is used, and if none is left this function waits until a block is
+ * returned to the reserve by a freed dentry or by fs_release_idle_dentry_locks(), retrying the
+ * allocation every second.
+ * @param d Dentry to allocate locks for.
+ * @return the locks of d, never NULL.
+ */
+struct dentry_locks *fs_allocate_dentry_locks(struct dentry *d)
+{
+	struct dentry_locks *locks;
+	bool waiting = false;
+
+	locks = _fs_new_dentry_locks();
+	if (! locks) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		/* The reserve is checked with the wait lock held, so a returned block cannot be missed */
+		ltfs_thread_mutex_lock(&dentry_locks_wait_lock);
+		while (! (locks = _fs_take_reserved_dentry_locks())) {
+			if (! waiting) {
+				ltfsmsg(LTFS_WARN, 17319W);
+				waiting = true;
+			}
+			ltfs_thread_cond_timedwait(&dentry_locks_wait_cond, &dentry_locks_wait_lock, 1);
+			locks = _fs_new_dentry_locks();
+			if (locks)
+				break;
+		}
+		ltfs_thread_mutex_unlock(&dentry_locks_wait_lock);
+	}
+
+	return _fs_publish_dentry_locks(d, locks);
+}
+
+/**
+ * Take the meta_lock of a dentry for read without allocating a lock block for it.
+ *
+ * If the dentry has no lock block, the mutex under which blocks are published is taken
+ * instead: no other thread can lock the dentry until it is released, so the fields protected
+ * by the meta_lock can be read. Only hold this for a short read, as it delays the first lock
+ * of every other dentry. Release with fs_release_dentry_meta_read().
+ * @param d Dentry to read. The caller must hold vol->lock, so that a lock block of d is
+ *          not released meanwhile.
+ */
+void fs_acquire_dentry_meta_read(struct dentry *d)
+{
+	struct dentry_locks *locks = __atomic_load_n(&d->locks, __ATOMIC_ACQUIRE);
+
+	if (! locks) {
+		ltfs_mutex_lock(&dentry_locks_mutex);
+		locks = d->locks;
+		if (! locks)
+			return;
+		ltfs_mutex_unlock(&dentry_locks_mutex);
+	}
+	acquireread_mrsw(&locks->meta_lock);
+}
+
+/**
+ * Release the lock taken by fs_acquire_dentry_meta_read().
+ * @param d Dentry passed to fs_acquire_dentry_meta_read().
+ */
+void fs_release_dentry_meta_read(struct dentry *d)
+{
+	/* No block can be published for d while the mutex is held, so d->locks tells which
+	 * lock was taken */
+	struct dentry_locks *locks = __atomic_load_n(&d->locks, __ATOMIC_ACQUIRE);
+
+	if (locks)
+		releaseread_mrsw(&locks->meta_lock);
+	else
+		ltfs_mutex_unlock(&dentry_locks_mutex);
+}
+
+/**
+ * Mark the lock block of a dentry and of all its ancestors as needed.
+ */
+static void _fs_keep_dentry_locks(struct dentry *d)
+{
+	for (; d; d = d->parent) {
+		if (d->locks) {
+			if (d->locks->keep)
+				break;
+			d->locks->keep = true;
+		}
+	}
+}
+
+/**
+ * Check whether the locks of a dentry can be released: nothing refers to the dentry besides
+ * its parent, the I/O scheduler has no state for it and none of its locks is held.
+ */
+static bool _fs_dentry_locks_idle(struct dentry *d)
+{
+	struct dentry_locks *locks = d->locks;
+	bool idle = true;
+
+	if (! d->parent || d->numhandles > 1 || d->iosched_priv)
+		return false;
+
+	if (! try_acquirewrite_mrsw(&locks->contents_lock))
+		return false;
+	if (! try_acquirewrite_mrsw(&locks->meta_lock))
+		idle = false;
+	else {
+		if (ltfs_mutex_trylock(&locks->iosched_lock))
+			idle = false;
+		else
+			ltfs_mutex_unlock(&locks->iosched_lock);
+		releasewrite_mrsw(&locks->meta_lock);
+	}
+	releasewrite_mrsw(&locks->contents_lock);
+
+	return idle;
+}
+
+/**
+ * Release the lock blocks of idle dentries of a volume. A block is kept when the dentry is
+ * in use or when any dentry below it keeps its block, so the ancestors of a dentry in use
+ * can always be locked without allocating.
+ *
+ * The caller must hold vol->lock for write. No other thread then holds a dentry lock of the
+ * volume, except for the I/O scheduler on dentries with scheduler state, which are kept.
+ * @param vol LTFS volume.
+ * @return the number of blocks released.
+ */
+size_t fs_release_idle_dentry_locks(struct ltfs_volume *vol)
+{
+	size_t count = 0;
+	bool reserved = false;
+	struct dentry *d;
+	struct dentry_locks *locks, *next;
+
+	ltfs_mutex_lock(&dentry_locks_mutex);
+
+	TAILQ_FOREACH(locks, &dentry_locks_list, list)
+		locks->keep = (locks->owner->vol != vol);
+	TAILQ_FOREACH(locks, &dentry_locks_list, list) {
+		if (! locks->keep && ! _fs_dentry_locks_idle(locks->owner))
+			_fs_keep_dentry_locks(locks->owner);
+	}
+
+	for (locks = TAILQ_FIRST(&dentry_locks_list); locks; locks = next) {
+		next = TAILQ_NEXT(locks, list);
+		if (locks->keep)
+			continue;
+
+		d = locks->owner;
+		TAILQ_REMOVE(&dentry_locks_list, locks, list);
+		--dentry_locks_count;
+		__atomic_store_n(&d->locks, NULL, __ATOMIC_RELEASE);
+		++count;
+
+		if (_fs_reserve_dentry_locks(locks))
+			reserved = true;
+	}
+
+	ltfsmsg(LTFS_DEBUG, 17320D, (unsigned long long)count, (unsigned long long)dentry_locks_count);
+	ltfs_mutex_unlock(&dentry_locks_mutex);
+
+	if (reserved)
+		_fs_wake_dentry_locks_waiters();
+
+	return count;
+}
+
+/**
+ * Get the number of dentries which currently have their locks allocated.
+ */
+size_t fs_dentry_locks_count(void)
+{
+	size_t count;
+
+	ltfs_mutex_lock(&dentry_locks_mutex);
+	count = dentry_locks_count;
+	ltfs_mutex_unlock(&dentry_locks_mutex);
+
+	return count;
+}
+
+/**
+ * Pack the extent list of a file if it is long enough to benefit from it
+ * (see extent_pack.h). The list is left as it is if packing fails.
+ * The extents must be sorted by file offset and must not overlap.
+ * The caller must hold a write lock on d->contents_lock, or have exclusive access to d.
+ * @param d File whose extents to pack.
+ */
+void fs_pack_extents(struct dentry *d)
+{
+	int ret = 0;
+	uint32_t count = 0;
+	struct extent_pack *pack;
+	struct extent_info *ext, *aux;
+
+	if (d->extent_pack)
+		return;
+	TAILQ_FOREACH(ext, &d->extentlist, list) {
+		if (++count >= EXTENT_PACK_MIN_EXTENTS)
+			break;
+	}
+	if (count < EXTENT_PACK_MIN_EXTENTS)
+		return;
+
+	pack = extent_pack_alloc();
+	if (! pack)
+		return;
+	TAILQ_FOREACH(ext, &d->extentlist, list) {
+		ret = extent_pack_append(pack, ext);
+		if (ret < 0) {
+			extent_pack_free(pack);
+			return;
+		}
+	}
+
+	TAILQ_FOREACH_SAFE(ext, &d->extentlist, list, aux)
+		free(ext);
+	TAILQ_INIT(&d->extentlist);
+	d->extent_pack = pack;
+}
+
+/**
+ * Move the extents of a packed file back to its extent list, so they can be changed
+ * anywhere in the list. Nothing is changed if this function fails.
+ * The caller must hold a write lock on d->contents_lock.
+ * @param d File whose extents to unpack.
+ * @return 0 on success or -LTFS_NO_MEMORY.
+ */
+int fs_unpack_extents(struct dentry *d)
+{
+	struct extent_pack_iter iter;
+	const struct extent_info *ext;
+	struct extent_info *new_ext, *aux;
+	struct extent_struct list;
+
+	if (! d->extent_pack)
+		return 0;
+
+	TAILQ_INIT(&list);
+	for (ext = extent_pack_first(d->extent_pack, &iter); ext; ext = extent_pack_next(&iter)) {
+		new_ext = calloc(1, sizeof(struct extent_info));
+		if (! new_ext) {
+			ltfsmsg(LTFS_ERR, 10001E, "fs_unpack_extents");
+			TAILQ_FOREACH_SAFE(new_ext, &list, list, aux)
+				free(new_ext);
+			return -LTFS_NO_MEMORY;
+		}
+		new_ext->start = ext->start;
+		new_ext->byteoffset = ext->byteoffset;
+		new_ext->bytecount = ext->bytecount;
+		new_ext->fileoffset = ext->fileoffset;
+		TAILQ_INSERT_TAIL(&list, new_ext, list);
+	}
+
+	TAILQ_CONCAT(&d->extentlist, &list, list);
+	extent_pack_free(d->extent_pack);
+	d->extent_pack = NULL;
+	return 0;
+}
+
+/**
+ * Start walking the extents of a file. The extents returned must not be modified.
+ * The caller must hold a lock on d->contents_lock until the walk is over.
+ * @param d File.
+ * @param iter Walk position.
+ * @return the first extent, or NULL if the file has no extents.
+ */
+const struct extent_info *fs_extent_first(struct dentry *d, struct fs_extent_iter *iter)
+{
+	if (d->extent_pack)
+		return extent_pack_first(d->extent_pack, &iter->pack);
+	iter->ext = TAILQ_FIRST(&d->extentlist);
+	return iter->ext;
+}
+
+/**
+ * Move to the next extent of a file.
+ * @return the next extent, or NULL at the end of the list.
+ */
+const struct extent_info *fs_extent_next(struct dentry *d, struct fs_extent_iter *iter)
+{
+	if (d->extent_pack)
+		return extent_pack_next(&iter->pack);
+	iter->ext = TAILQ_NEXT(iter->ext, list);
+	return iter->ext;
+}
+
+/**
+ * Start walking the extents of a file from the first one which ends after a file offset.
+ * @return that extent, or NULL if there is none.
+ */
+const struct extent_info *fs_extent_seek(struct dentry *d, uint64_t fileoffset,
+	struct fs_extent_iter *iter)
+{
+	const struct extent_info *ext;
+
+	if (d->extent_pack)
+		return extent_pack_seek(d->extent_pack, fileoffset, &iter->pack);
+
+	for (ext = fs_extent_first(d, iter); ext; ext = fs_extent_next(d, iter)) {
+		if (ext->fileoffset + ext->bytecount > fileoffset)
+			break;
+	}
+	return ext;
+}
+
+/**
+ * Get the last extent of a file.
+ * @return the last extent, or NULL if the file has no extents.
+ */
+const struct extent_info *fs_extent_last(struct dentry *d)
+{
+	if (d->extent_pack)
+		return extent_pack_tail(d->extent_pack);
+	return TAILQ_LAST(&d->extentlist, extent_struct);
+}
+
+/**
+ * Extended attribute lookups compare the cached name hash of each entry in xattrlist before
+ * comparing names. Once a dentry holds FS_XATTR_INDEX_MIN attributes, an open-addressed index
+ * with linear probing is kept next to the list, which still defines the order written to
+ * the index. The index is sized to stay at most half full.
+ */
+#define FS_XATTR_INDEX_MIN (16)
+
+struct xattr_index {
+	uint32_t mask;              /**< Number of slots minus one */
+	struct xattr_info *slot[];  /**< Entries placed by name hash, NULL for free slots */
+};
+
+static uint32_t _fs_xattr_hash(const char *name)
+{
+	unsigned hashv;
+
+	HASH_VALUE(name, strlen(name), hashv);
+	return hashv;
+}
+
+static inline bool _fs_xattr_match(struct xattr_info *xattr, uint32_t hash, const char *name)
+{
+	return xattr->hash == hash && ! strcmp(xattr->key.name, name);
+}
+
+/**
+ * Place an entry in the index. If another entry has the same name, the index keeps the
+ * new one when 'replace' is set and the old one otherwise.
+ */
+static void _fs_xattr_index_put(struct xattr_index *idx, struct xattr_info *xattr, bool replace)
+{
+	uint32_t i;
+
+	for (i = xattr->hash & idx->mask; idx->slot[i]; i = (i + 1) & idx->mask) {
+		if (_fs_xattr_match(idx->slot[i], xattr->hash, xattr->key.name)) {
+			if (replace)
+				idx->slot[i] = xattr;
+			return;
+		}
+	}
+	idx->slot[i] = xattr;
+}
+
+/**
+ * Remove an entry from the index, moving back the entries that probed past its slot.
+ * @return true if the entry was in the index.
+ */
+static bool _fs_xattr_index_del(struct xattr_index *idx, struct xattr_info *xattr)
+{
+	uint32_t i, j, home;
+
+	for (i = xattr->hash & idx->mask; idx->slot[i] != xattr; i = (i + 1) & idx->mask)
+		if (! idx->slot[i])
+			return false;
+
+	idx->slot[i] = NULL;
+	for (j = (i + 1) & idx->mask; idx->slot[j]; j = (j + 1) & idx->mask) {
+		home = idx->slot[j]->hash & idx->mask;
+		/* Entries whose home slot lies cyclically in (i, j] are reachable where they are */
+		if (i <= j ? (home > i && home <= j) : (home > i || home <= j))
+			continue;
+		idx->slot[i] = idx->slot[j];
+		idx->slot[j] = NULL;
+		i = j;
+	}
+	return true;
+}
+
+/**
+ * Rebuild the index of a dentry with the given number of slots. On allocation failure the
+ * dentry is left without an index, which only makes lookups slower.
+ */
+static void _fs_xattr_index_build(struct dentry *d, uint32_t slots)
+{
+	struct xattr_index *idx;
+	struct xattr_info *xattr;
+
+	free(d->xattr_index);
+	d->xattr_index = NULL;
+
+	idx = calloc(1, sizeof(struct xattr_index) + slots * sizeof(struct xattr_info *));
+	if (! idx)
+		return;
+	idx->mask = slots - 1;
+	TAILQ_FOREACH(xattr, &d->xattrlist, list)
+		_fs_xattr_index_put(idx, xattr, false);
+	d->xattr_index = idx;
+}
+
+/**
+ * Link an extended attribute into a dentry. The key name must be set.
+ * @param d Dentry to modify. The caller must hold its meta_lock for writing or own the dentry.
+ * @param xattr Attribute to add.
+ * @param tail True to append the attribute to xattrlist, false to insert it at the head.
+ */
+void fs_add_xattr(struct dentry *d, struct xattr_info *xattr, bool tail)
+{
+	uint32_t slots;
+
+	xattr->hash = _fs_xattr_hash(xattr->key.name);
+	if (tail)
+		TAILQ_INSERT_TAIL(&d->xattrlist, xattr, list);
+	else
+		TAILQ_INSERT_HEAD(&d->xattrlist, xattr, list);
+	++d->xattr_count;
+
+	if (d->xattr_count < FS_XATTR_INDEX_MIN)
+		return;
+
+	slots = d->xattr_index ? d->xattr_index->mask + 1 : FS_XATTR_INDEX_MIN;
+	if (! d->xattr_index || d->xattr_count * 2 > slots) {
+		while (d->xattr_count * 2 > slots)
+			slots *= 2;
+		_fs_xattr_index_build(d, slots);
+	} else {
+		/* Lookups return the first match in xattrlist, so only a new head replaces a
+		 * duplicate name. */
+		_fs_xattr_index_put(d->xattr_index, xattr, ! tail);
+	}
+}
+
+/**
+ * Unlink an extended attribute from a dentry. The attribute itself is not released.
+ * @param d Dentry to modify. The caller must hold its meta_lock for writing.
+ * @param xattr Attribute to remove.
+ */
+void fs_remove_xattr(struct dentry *d, struct xattr_info *xattr)
+{
+	struct xattr_info *other;
+
+	TAILQ_REMOVE(&d->xattrlist, xattr, list);
+	--d->xattr_count;
+
+	if (! d->xattr_index)
+		return;
+
+	if (d->xattr_count < FS_XATTR_INDEX_MIN / 2) {
+		free(d->xattr_index);
+		d->xattr_index = NULL;
+	} else if (_fs_xattr_index_del(d->xattr_index, xattr)) {
+		/* An index read from tape may repeat a name; expose the next entry with it */
+		TAILQ_FOREACH(other, &d->xattrlist, list) {
+			if (_fs_xattr_match(other, xattr->hash, xattr->key.name)) {
+				_fs_xattr_index_put(d->xattr_index, other, false);
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * Look up an extended attribute of a dentry by name.
+ * @param d Dentry to search. The caller must hold its meta_lock.
+ * @param name Attribute name.
+ * @return The first attribute in xattrlist with the given name, or NULL if there is none.
+ */
+struct xattr_info *fs_find_xattr(struct dentry *d, const char *name)
+{
+	uint32_t i, hash = _fs_xattr_hash(name);
+	struct xattr_info *xattr;
+
+	if (d->xattr_index) {
+		for (i = hash & d->xattr_index->mask; d->xattr_index->slot[i]; i = (i + 1) & d->xattr_index->mask)
+			if (_fs_xattr_match(d->xattr_index->slot[i], hash, name))
+				return d->xattr_index->slot[i];
+		return NULL;
+	}
+
+	TAILQ_FOREACH(xattr, &d->xattrlist, list)
+		if (_fs_xattr_match(xattr, hash, name))
+			return xattr;
+	return NULL;
 }
 
 /**
@@ -256,13 +974,12 @@ struct dentry * fs_allocate_dentry(struct dentry *parent, const char *name, cons
 	int ret;
 	struct dentry *d = NULL;
 
-	d = (struct dentry *) malloc(sizeof(struct dentry));
+	d = calloc(1, sizeof(struct dentry));
 	if (! d) {
 		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
 		return NULL;
 	}
 
-	memset(d, 0, sizeof(struct dentry));
 	d->parent = parent;
 	if (!name && !platform_safe_name) {
 		d->name.name = NULL;
@@ -330,56 +1047,33 @@ struct dentry * fs_allocate_dentry(struct dentry *parent, const char *name, cons
 		free(d);
 		return NULL;
 	}
-	ret = init_mrsw(&d->contents_lock);
-	if (ret < 0) {
-		ltfsmsg(LTFS_ERR, 10002E, ret);
-		if (d->name.name)
-			free(d->name.name);
-		if (d->platform_safe_name)
-			free(d->platform_safe_name);
-		free(d);
-		return NULL;
-	}
-	ret = init_mrsw(&d->meta_lock);
-	if (ret < 0) {
-		ltfsmsg(LTFS_ERR, 10002E, ret);
-		destroy_mrsw(&d->contents_lock);
-		if (d->name.name)
-			free(d->name.name);
-		if (d->platform_safe_name)
-			free(d->platform_safe_name);
-		free(d);
-		return NULL;
-	}
 	d->child_list=NULL;
 	TAILQ_INIT(&d->extentlist);
 	TAILQ_INIT(&d->xattrlist);
 
-	ret = ltfs_mutex_init(&d->iosched_lock);
-	if (ret) {
-		ltfsmsg(LTFS_ERR, 10002E, ret);
-		destroy_mrsw(&d->contents_lock);
-		destroy_mrsw(&d->meta_lock);
-		if (d->name.name)
-			free(d->name.name);
-		if (d->platform_safe_name)
-			free(d->platform_safe_name);
-		free(d);
-		return NULL;
-	}
-
 	d->tag_count = 0;
 	d->preserved_tags = NULL;
+	if (idx)
+		index_snapshot_set_new(idx->snapshot, d);
 
 	if (parent) {
-		acquirewrite_mrsw(&parent->contents_lock);
-		acquirewrite_mrsw(&parent->meta_lock);
+		if (fs_prepare_dentry_locks(parent) < 0) {
+			if (d->name.name)
+				free(d->name.name);
+			if (d->platform_safe_name)
+				free(d->platform_safe_name);
+			free(d);
+			return NULL;
+		}
+		acquirewrite_mrsw(&fs_dentry_locks(parent)->contents_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(parent)->meta_lock);
+		index_snapshot_preserve(parent);
 		if (d->platform_safe_name != NULL) {
 			parent->child_list = fs_add_key_to_hash_table(parent->child_list, d, &ret);
 			if (ret != 0) {
 				ltfsmsg(LTFS_ERR, 11319E, "fs_allocate_dentry", ret);
-				releasewrite_mrsw(&parent->meta_lock);
-				releasewrite_mrsw(&parent->contents_lock);
+				releasewrite_mrsw(&fs_dentry_locks(parent)->meta_lock);
+				releasewrite_mrsw(&fs_dentry_locks(parent)->contents_lock);
 				if (d->name.name)
 					free(d->name.name);
 				if (d->platform_safe_name)
@@ -393,8 +1087,8 @@ struct dentry * fs_allocate_dentry(struct dentry *parent, const char *name, cons
 		d->link_count++;
 		if (isdir)
 			parent->link_count++;
-		releasewrite_mrsw(&parent->meta_lock);
-		releasewrite_mrsw(&parent->contents_lock);
+		releasewrite_mrsw(&fs_dentry_locks(parent)->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(parent)->contents_lock);
 		if (! isdir)
 			fs_increment_file_count(idx);
 	}
@@ -449,7 +1143,7 @@ int fs_dentry_lookup(struct dentry *dentry, char **name)
 	parent = d->parent;
 	for (i=names-1; i>=0; --i) {
 		if (parent)
-			acquireread_mrsw(&parent->contents_lock);
+			acquireread_mrsw(&fs_dentry_locks(parent)->contents_lock);
 
 		lookup_name = (const char *) d->platform_safe_name;
 		if (! lookup_name) {
@@ -467,7 +1161,7 @@ int fs_dentry_lookup(struct dentry *dentry, char **name)
 		namelen += strlen(lookup_name);
 
 		if (parent)
-			releaseread_mrsw(&parent->contents_lock);
+			releaseread_mrsw(&fs_dentry_locks(parent)->contents_lock);
 
 		d = parent;
 		if (! d)
@@ -518,6 +1212,10 @@ int fs_directory_lookup(struct dentry *basedir, const char *name, struct dentry
 	if (pathname_strlen(name) > LTFS_FILENAME_MAX)
 		return -LTFS_NAMETOOLONG;
 
+	rc = index_spill_load(basedir, true);
+	if (rc < 0)
+		return rc;
+
 	if (HASH_COUNT(basedir->child_list) == 0)
 		return 0;
 
@@ -529,9 +1227,12 @@ int fs_directory_lookup(struct dentry *basedir, const char *name, struct dentry
 	}
 
 	if (namelist) {
-		acquirewrite_mrsw(&namelist->d->meta_lock);
+		rc = fs_prepare_dentry_locks(namelist->d);
+		if (rc < 0)
+			return rc;
+		acquirewrite_mrsw(&fs_dentry_locks(namelist->d)->meta_lock);
 		++namelist->d->numhandles;
-		releasewrite_mrsw(&namelist->d->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(namelist->d)->meta_lock);
 		*dentry = namelist->d;
 		return 0;
 	}
@@ -540,16 +1241,30 @@ int fs_directory_lookup(struct dentry *basedir, const char *name, struct dentry
 	return 0;
 }
 
-int fs_path_lookup(const char *path, int flags, struct dentry **dentry, struct ltfs_index *idx)
+/**
+ * Take the LOCK_DENTRY_* locks requested by a fs_path_lookup caller.
+ */
+static void _fs_lock_dentry(struct dentry *d, int flags)
+{
+	if (flags & LOCK_DENTRY_CONTENTS_W)
+		acquirewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
+	else if (flags & LOCK_DENTRY_CONTENTS_R)
+		acquireread_mrsw(&fs_dentry_locks(d)->contents_lock);
+	if (flags & LOCK_DENTRY_META_W)
+		acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	else if (flags & LOCK_DENTRY_META_R)
+		acquireread_mrsw(&fs_dentry_locks(d)->meta_lock);
+}
+
+/**
+ * Walk the name tree to find the dentry corresponding to a path. See fs_path_lookup.
+ */
+static int _fs_path_walk(const char *path, int flags, struct dentry **dentry, struct ltfs_index *idx)
 {
 	int ret = 0;
 	struct dentry *d = NULL, *parent = NULL;
 	char *tmp_path, *start, *end;
 
-	CHECK_ARG_NULL(path, -LTFS_NULL_ARG);
-	CHECK_ARG_NULL(dentry, -LTFS_NULL_ARG);
-	CHECK_ARG_NULL(idx, -LTFS_NULL_ARG);
-
 	tmp_path = arch_strdup(path);
 	if (! tmp_path) {
 		ltfsmsg(LTFS_ERR, 10001E, "fs_path_lookup: tmp_path");
@@ -558,9 +1273,14 @@ int fs_path_lookup(const char *path, int flags, struct dentry **dentry, struct l
 
 	/* Get a reference count on the root dentry. Either it will be returned immediately, or it
 	 * will be disposed later after the first path lookup. */
-	acquirewrite_mrsw(&idx->root->meta_lock);
+	ret = fs_prepare_dentry_locks(idx->root);
+	if (ret < 0) {
+		free(tmp_path);
+		return ret;
+	}
+	acquirewrite_mrsw(&fs_dentry_locks(idx->root)->meta_lock);
 	++idx->root->numhandles;
-	releasewrite_mrsw(&idx->root->meta_lock);
+	releasewrite_mrsw(&fs_dentry_locks(idx->root)->meta_lock);
 
 	/* Did the caller ask for the root dentry? */
 	if (*path == '\0' || ! strcmp(path, "/")) {
@@ -578,21 +1298,21 @@ int fs_path_lookup(const char *path, int flags, struct dentry **dentry, struct l
 			*end = '\0';
 
 		if (! end && (flags & LOCK_PARENT_CONTENTS_W))
-			acquirewrite_mrsw(&d->contents_lock);
+			acquirewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
 		else
-			acquireread_mrsw(&d->contents_lock);
+			acquireread_mrsw(&fs_dentry_locks(d)->contents_lock);
 
 		if (parent)
-			releaseread_mrsw(&parent->contents_lock);
+			releaseread_mrsw(&fs_dentry_locks(parent)->contents_lock);
 		parent = d;
 		d = NULL;
 
 		ret = fs_directory_lookup(parent, start, &d);
 		if (ret < 0 || ! d) {
 			if (! end && (flags & LOCK_PARENT_CONTENTS_W))
-				releasewrite_mrsw(&parent->contents_lock);
+				releasewrite_mrsw(&fs_dentry_locks(parent)->contents_lock);
 			else
-				releaseread_mrsw(&parent->contents_lock);
+				releaseread_mrsw(&fs_dentry_locks(parent)->contents_lock);
 			fs_release_dentry(parent);
 
 			if (ret == 0)
@@ -606,9 +1326,9 @@ int fs_path_lookup(const char *path, int flags, struct dentry **dentry, struct l
 		 * decrementing the handle count... so do that. */
 		if (end || ! (flags & (LOCK_PARENT_CONTENTS_W | LOCK_PARENT_CONTENTS_R
 			| LOCK_PARENT_META_W | LOCK_PARENT_META_R))) {
-			acquirewrite_mrsw(&parent->meta_lock);
+			acquirewrite_mrsw(&fs_dentry_locks(parent)->meta_lock);
 			--parent->numhandles;
-			releasewrite_mrsw(&parent->meta_lock);
+			releasewrite_mrsw(&fs_dentry_locks(parent)->meta_lock);
 		}
 
 		if (end)
@@ -616,7 +1336,7 @@ int fs_path_lookup(const char *path, int flags, struct dentry **dentry, struct l
 	}
 
 	if (! (flags & (LOCK_PARENT_CONTENTS_W | LOCK_PARENT_CONTENTS_R)))
-		releaseread_mrsw(&parent->contents_lock);
+		releaseread_mrsw(&fs_dentry_locks(parent)->contents_lock);
 
 out:
 	free(tmp_path);
@@ -625,20 +1345,45 @@ out:
 		if (parent) {
 			/* Parent contents_lock was already taken appropriately above */
 			if (flags & LOCK_PARENT_META_W)
-				acquirewrite_mrsw(&parent->meta_lock);
+				acquirewrite_mrsw(&fs_dentry_locks(parent)->meta_lock);
 			else if (flags & LOCK_PARENT_META_R)
-				acquireread_mrsw(&parent->meta_lock);
+				acquireread_mrsw(&fs_dentry_locks(parent)->meta_lock);
 		}
 
-		if (flags & LOCK_DENTRY_CONTENTS_W)
-			acquirewrite_mrsw(&d->contents_lock);
-		else if (flags & LOCK_DENTRY_CONTENTS_R)
-			acquireread_mrsw(&d->contents_lock);
-		if (flags & LOCK_DENTRY_META_W)
-			acquirewrite_mrsw(&d->meta_lock);
-		else if (flags & LOCK_DENTRY_META_R)
-			acquireread_mrsw(&d->meta_lock);
+		_fs_lock_dentry(d, flags);
+		*dentry = d;
+	}
 
+	return ret;
+}
+
+int fs_path_lookup(const char *path, int flags, struct dentry **dentry, struct ltfs_index *idx)
+{
+	int ret;
+	uint64_t generation;
+	struct dentry *d = NULL;
+
+	CHECK_ARG_NULL(path, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(dentry, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(idx, -LTFS_NULL_ARG);
+
+	/* Lookups which lock the parent need the walk. So does the root, which is never cached. */
+	if (! idx->path_cache || *path == '\0' || ! strcmp(path, "/")
+		|| (flags & (LOCK_PARENT_CONTENTS_W | LOCK_PARENT_CONTENTS_R
+			| LOCK_PARENT_META_W | LOCK_PARENT_META_R)))
+		return _fs_path_walk(path, flags, dentry, idx);
+
+	ret = path_cache_lookup(idx->path_cache, path, &d, &generation);
+	if (ret == 1) {
+		ret = _fs_path_walk(path, 0, &d, idx);
+		if (ret == 0)
+			path_cache_insert(idx->path_cache, path, d, generation);
+		else if (ret == -LTFS_NO_DENTRY)
+			path_cache_insert(idx->path_cache, path, NULL, generation);
+	}
+
+	if (ret == 0) {
+		_fs_lock_dentry(d, flags);
 		*dentry = d;
 	}
 
@@ -679,6 +1424,7 @@ void _fs_dispose_dentry_contents(struct dentry *dentry, bool unlock, bool gc)
 
 			/* Remove child from the tree first */
 			HASH_DEL(dentry->child_list, child);
+			++dentry->child_removals;
 			if (child->d->parent)
 				child->d->parent = NULL;
 
@@ -709,6 +1455,10 @@ void _fs_dispose_dentry_contents(struct dentry *dentry, bool unlock, bool gc)
 		}
 	}
 
+	if (dentry->spill_loaded)
+		index_spill_forget(dentry);
+	if (dentry->dcache_priv)
+		dcache_forget(dentry, dentry->vol);
 	if (dentry->tag_count > 0) {
 		for (i=0; i<dentry->tag_count; ++i)
 			free(dentry->preserved_tags[i]);
@@ -722,6 +1472,7 @@ void _fs_dispose_dentry_contents(struct dentry *dentry, bool unlock, bool gc)
 		TAILQ_FOREACH_SAFE(ext_entry, &dentry->extentlist, list, ext_aux)
 			free(ext_entry);
 	}
+	extent_pack_free(dentry->extent_pack);
 	if (! TAILQ_EMPTY(&dentry->xattrlist)) {
 		TAILQ_FOREACH_SAFE(xattr_entry, &dentry->xattrlist, list, xattr_aux) {
 			free(xattr_entry->key.name);
@@ -730,6 +1481,7 @@ void _fs_dispose_dentry_contents(struct dentry *dentry, bool unlock, bool gc)
 			free(xattr_entry);
 		}
 	}
+	free(dentry->xattr_index);
 	if (dentry->parent) {
 		namelist = fs_find_key_from_hash_table(dentry->parent->child_list, dentry->platform_safe_name, &rc);
 		if (rc != 0) {
@@ -737,6 +1489,7 @@ void _fs_dispose_dentry_contents(struct dentry *dentry, bool unlock, bool gc)
 		}
 		if (namelist) {
 			HASH_DEL(dentry->parent->child_list, namelist);
+			++dentry->parent->child_removals;
 			free(namelist->name);
 			free(namelist);
 		}
@@ -751,10 +1504,10 @@ void _fs_dispose_dentry_contents(struct dentry *dentry, bool unlock, bool gc)
 		dentry->platform_safe_name = NULL;
 	}
 	if (unlock)
-		releasewrite_mrsw(&dentry->meta_lock);
-	destroy_mrsw(&dentry->contents_lock);
-	destroy_mrsw(&dentry->meta_lock);
-	ltfs_mutex_destroy(&dentry->iosched_lock);
+		releasewrite_mrsw(&fs_dentry_locks(dentry)->meta_lock);
+	if (__atomic_load_n(&dentry->path_cached, __ATOMIC_ACQUIRE))
+		path_cache_forget(dentry->vol->index->path_cache, dentry);
+	_fs_free_dentry_locks(dentry);
 	HASH_CLEAR(hh, dentry->child_list);
 	if (dentry->target.name) {
 		free(dentry->target.name);
@@ -770,7 +1523,7 @@ void fs_release_dentry(struct dentry *d)
 		return;
 	}
 
-	acquirewrite_mrsw(&d->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 	fs_release_dentry_unlocked(d);
 }
 
@@ -778,20 +1531,48 @@ void fs_release_dentry_unlocked(struct dentry *d)
 {
 	--d->numhandles;
 	if (d->numhandles != 0 || d->out_of_sync) {
-		releasewrite_mrsw(&d->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 		return;
 	}
 
 	_fs_dispose_dentry_contents(d, true, false);
 }
 
+/**
+ * Dispose all children of a directory, leaving the directory itself in the tree.
+ * The caller must hold the contents_lock of d for write and make sure that no dentry
+ * below d is referenced from anywhere but its parent.
+ * @param d Directory to empty.
+ * @return Number of tape blocks used by the files released.
+ */
+uint64_t fs_release_children(struct dentry *d)
+{
+	uint64_t used = 0;
+	struct name_list *child, *aux;
+
+	HASH_ITER(hh, d->child_list, child, aux) {
+		HASH_DEL(d->child_list, child);
+		++d->child_removals;
+		if (child->d->isdir)
+			used += fs_release_children(child->d);
+		else
+			used += child->d->used_blocks;
+		child->d->parent = NULL;
+		fs_release_dentry(child->d);
+		free(child->name);
+		free(child);
+	}
+
+	return used;
+}
+
 void fs_gc_dentry(struct dentry *d)
 {
-	acquirewrite_mrsw(&d->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 	if (d->numhandles == 0 && ! d->out_of_sync)
 		_fs_dispose_dentry_contents(d, true, true);
 	else {
-		releasewrite_mrsw(&d->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 		if (HASH_COUNT(d->child_list) != 0) {
 			struct name_list *child, *aux;
 			HASH_ITER(hh, d->child_list, child, aux) {
@@ -801,6 +1582,181 @@ void fs_gc_dentry(struct dentry *d)
 	}
 }
 
+/**
+ * Free a dentry copy created by fs_snapshot_dentry.
+ * @param d Copy to free.
+ */
+void fs_release_snapshot_dentry(struct dentry *d)
+{
+	size_t i;
+	struct name_list *child, *aux;
+	struct extent_info *ext_entry, *ext_aux;
+	struct xattr_info *xattr_entry, *xattr_aux;
+
+	if (! d)
+		return;
+
+	HASH_ITER(hh, d->child_list, child, aux) {
+		HASH_DEL(d->child_list, child);
+		free(child);
+	}
+
+	if (d->tag_count > 0) {
+		for (i=0; i<d->tag_count; ++i)
+			free(d->preserved_tags[i]);
+		free(d->preserved_tags);
+	}
+	TAILQ_FOREACH_SAFE(ext_entry, &d->extentlist, list, ext_aux)
+		free(ext_entry);
+	extent_pack_free(d->extent_pack);
+	TAILQ_FOREACH_SAFE(xattr_entry, &d->xattrlist, list, xattr_aux) {
+		free(xattr_entry->key.name);
+		if (xattr_entry->value)
+			free(xattr_entry->value);
+		free(xattr_entry);
+	}
+	if (d->name.name)
+		free(d->name.name);
+	if (d->target.name)
+		free(d->target.name);
+	free(d);
+}
+
+/**
+ * Copy the parts of a dentry which are needed to serialize it into an index.
+ *
+ * The copy has no locks, no platform safe names and no I/O scheduler state, so it must only
+ * be handed to the XML writer and freed with fs_release_snapshot_dentry. The child list of
+ * a directory copy refers to the live children, which are kept alive by the index snapshot
+ * (see index_snapshot_hold).
+ *
+ * The caller must hold the locks needed to change src, so that it does not change during
+ * the copy.
+ * @param src Dentry to copy.
+ * @return the copy, or NULL if memory allocation failed.
+ */
+struct dentry *fs_snapshot_dentry(struct dentry *src)
+{
+	size_t i;
+	struct dentry *d;
+	struct name_list *child, *aux, *entry;
+	struct extent_info *ext, *new_ext;
+	struct xattr_info *xattr, *new_xattr;
+
+	d = calloc(1, sizeof(struct dentry));
+	if (! d) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return NULL;
+	}
+	TAILQ_INIT(&d->extentlist);
+	TAILQ_INIT(&d->xattrlist);
+
+	d->ino                = src->ino;
+	d->uid                = src->uid;
+	d->isdir              = src->isdir;
+	d->isslink            = src->isslink;
+	d->vol                = src->vol;
+	d->realsize           = src->realsize;
+	d->size               = src->size;
+	d->used_blocks        = src->used_blocks;
+	d->dirty              = src->dirty;
+	d->readonly           = src->readonly;
+	d->creation_time      = src->creation_time;
+	d->modify_time        = src->modify_time;
+	d->access_time        = src->access_time;
+	d->change_time        = src->change_time;
+	d->backup_time        = src->backup_time;
+	d->numhandles         = 1;
+	d->link_count         = src->link_count;
+	d->is_immutable       = src->is_immutable;
+	d->is_appendonly      = src->is_appendonly;
+	if (src->spill && ! __atomic_load_n(&src->spill_loaded, __ATOMIC_ACQUIRE))
+		d->spill          = src->spill;
+	d->dcache_evicted     = __atomic_load_n(&src->dcache_evicted, __ATOMIC_ACQUIRE);
+
+	d->name.percent_encode = src->name.percent_encode;
+	if (src->name.name) {
+		d->name.name = arch_strdup(src->name.name);
+		if (! d->name.name)
+			goto out_nomem;
+	}
+	d->target.percent_encode = src->target.percent_encode;
+	if (src->target.name) {
+		d->target.name = arch_strdup(src->target.name);
+		if (! d->target.name)
+			goto out_nomem;
+	}
+
+	if (src->tag_count > 0) {
+		d->preserved_tags = calloc(src->tag_count, sizeof(unsigned char *));
+		if (! d->preserved_tags)
+			goto out_nomem;
+		for (i=0; i<src->tag_count; ++i) {
+			d->preserved_tags[i] = (unsigned char *) arch_strdup((char *) src->preserved_tags[i]);
+			if (! d->preserved_tags[i])
+				goto out_nomem;
+			++d->tag_count;
+		}
+	}
+
+	TAILQ_FOREACH(ext, &src->extentlist, list) {
+		new_ext = calloc(1, sizeof(struct extent_info));
+		if (! new_ext)
+			goto out_nomem;
+		memcpy(new_ext, ext, sizeof(struct extent_info));
+		TAILQ_INSERT_TAIL(&d->extentlist, new_ext, list);
+	}
+	if (src->extent_pack) {
+		d->extent_pack = extent_pack_copy(src->extent_pack);
+		if (! d->extent_pack)
+			goto out_nomem;
+	}
+
+	TAILQ_FOREACH(xattr, &src->xattrlist, list) {
+		new_xattr = calloc(1, sizeof(struct xattr_info));
+		if (! new_xattr)
+			goto out_nomem;
+		TAILQ_INSERT_TAIL(&d->xattrlist, new_xattr, list);
+		new_xattr->hash = xattr->hash;
+		new_xattr->key.percent_encode = xattr->key.percent_encode;
+		new_xattr->key.name = arch_strdup(xattr->key.name);
+		if (! new_xattr->key.name)
+			goto out_nomem;
+		new_xattr->size = xattr->size;
+		if (xattr->value) {
+			new_xattr->value = malloc(xattr->size);
+			if (! new_xattr->value)
+				goto out_nomem;
+			memcpy(new_xattr->value, xattr->value, xattr->size);
+		}
+	}
+
+	if (! d->spill) {
+		HASH_ITER(hh, src->child_list, child, aux) {
+			entry = calloc(1, sizeof(struct name_list));
+			if (! entry)
+				goto out_nomem;
+			entry->d = child->d;
+			entry->uid = child->uid;
+
+			/* The XML writer never searches the copy by name, so it is keyed by UID */
+			errno = 0;
+			HASH_ADD_KEYPTR(hh, d->child_list, &entry->uid, sizeof(entry->uid), entry);
+			if (errno == ENOMEM) {
+				free(entry);
+				goto out_nomem;
+			}
+		}
+	}
+
+	return d;
+
+out_nomem:
+	ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+	fs_release_snapshot_dentry(d);
+	return NULL;
+}
+
 /**
  * Update platform safe name for dentries in the specified
  * directory.
@@ -853,6 +1809,19 @@ int fs_update_platform_safe_names(struct dentry* basedir, struct ltfs_index *idx
 {
 	struct name_list *list_ptr, *list_tmp;
 	int ret = 0;
+	uint64_t last_uid = 0;
+	bool sorted = true;
+
+	/* Indexes are normally written in UID order. Sort the others so that adding each child
+	 * to basedir stays an append. */
+	HASH_ITER(hh, list, list_ptr, list_tmp) {
+		list_ptr->uid = list_ptr->d->uid;
+		if (list_ptr->uid < last_uid)
+			sorted = false;
+		last_uid = list_ptr->uid;
+	}
+	if (! sorted)
+		HASH_SORT(list, fs_hash_sort_by_uid);
 
 	list = fs_update_platform_safe_names_and_hash_table(basedir, idx, list, false, false);	// normal loop
 	list = fs_update_platform_safe_names_and_hash_table(basedir, idx, list, true, false);	// add dup name
@@ -899,9 +1868,10 @@ bool fs_is_predecessor(struct dentry *d1, struct dentry *d2)
 uint64_t fs_get_used_blocks(struct dentry *d)
 {
 	uint64_t used = 0;
-	struct extent_info *extent;
+	struct fs_extent_iter iter;
+	const struct extent_info *extent;
 
-	TAILQ_FOREACH(extent, &d->extentlist, list) {
+	for (extent = fs_extent_first(d, &iter); extent; extent = fs_extent_next(d, &iter)) {
 		used += ((extent->byteoffset + extent->bytecount) / d->vol->label->blocksize);
 		if ((extent->byteoffset + extent->bytecount) % d->vol->label->blocksize)
 			used++;
@@ -919,7 +1889,8 @@ void _fs_dump_dentry(struct dentry *ptr, int spaces)
 {
 	int i, n = 0;
 	struct xattr_info *xattr;
-	struct extent_info *extent;
+	struct fs_extent_iter iter;
+	const struct extent_info *extent;
 
 	for (i=0; i<spaces; ++i)
 		printf(" ");
@@ -932,7 +1903,7 @@ void _fs_dump_dentry(struct dentry *ptr, int spaces)
 			(long long int) ptr->modify_time.tv_sec, (long long int) ptr->access_time.tv_sec,
 			ptr->deleted ? " (deleted)" : "");
 	/* Extent data */
-	TAILQ_FOREACH(extent, &ptr->extentlist, list) {
+	for (extent = fs_extent_first(ptr, &iter); extent; extent = fs_extent_next(ptr, &iter)) {
 		int tab = spaces + strlen(ptr->name.name) + (ptr->isdir ? 1 : 0);
 		for (i=0; i<tab+5; ++i)
 			printf(" ");
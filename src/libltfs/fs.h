@@ -50,6 +50,7 @@
 #define __fs_helper_h
 
 #include "ltfs.h"
+#include "extent_pack.h"
 #include "arch/filename_handling.h"
 
 /* Lock requests that can be passed to fs_path_lookup */
@@ -62,6 +63,24 @@
 #define LOCK_DENTRY_META_R     (1 << 6)
 #define LOCK_DENTRY_META_W     (1 << 7)
 
+/**
+ * Position in the extent list of a file, whether it is packed or not.
+ * See fs_extent_first().
+ */
+struct fs_extent_iter {
+	struct extent_info *ext;        /**< Current extent of an unpacked list */
+	struct extent_pack_iter pack;   /**< Position in a packed list */
+};
+
+/**
+ * Tell whether a file has any extents.
+ * The caller must hold a lock on d->contents_lock.
+ */
+static inline bool fs_has_extents(struct dentry *d)
+{
+	return d->extent_pack || ! TAILQ_EMPTY(&d->extentlist);
+}
+
 struct dentry *fs_allocate_dentry(struct dentry *parent, const char *name, const char * platform_safe_name,
 	bool dir, bool readonly, bool allocate_uid, struct ltfs_index *idx);
 uint64_t fs_allocate_uid(struct ltfs_index *idx);
@@ -72,6 +91,22 @@ void fs_dump_tree(struct dentry *root);
 void fs_increment_file_count(struct ltfs_index *idx);
 void fs_decrement_file_count(struct ltfs_index *idx);
 int fs_init_inode(void);
+void fs_free_dentry(struct dentry *d);
+int fs_prepare_dentry_locks(struct dentry *d);
+void fs_acquire_dentry_meta_read(struct dentry *d);
+void fs_release_dentry_meta_read(struct dentry *d);
+size_t fs_release_idle_dentry_locks(struct ltfs_volume *vol);
+size_t fs_dentry_locks_count(void);
+void fs_pack_extents(struct dentry *d);
+int fs_unpack_extents(struct dentry *d);
+const struct extent_info *fs_extent_first(struct dentry *d, struct fs_extent_iter *iter);
+const struct extent_info *fs_extent_next(struct dentry *d, struct fs_extent_iter *iter);
+const struct extent_info *fs_extent_seek(struct dentry *d, uint64_t fileoffset,
+	struct fs_extent_iter *iter);
+const struct extent_info *fs_extent_last(struct dentry *d);
+void fs_add_xattr(struct dentry *d, struct xattr_info *xattr, bool tail);
+void fs_remove_xattr(struct dentry *d, struct xattr_info *xattr);
+struct xattr_info *fs_find_xattr(struct dentry *d, const char *name);
 int fs_hash_sort_by_uid(struct name_list *a, struct name_list *b);
 struct name_list* fs_add_key_to_hash_table(struct name_list *list, struct dentry *add_entry, int *rc);
 struct name_list* fs_find_key_from_hash_table(struct name_list *list, const char *name, int *rc);
@@ -79,6 +114,9 @@ void fs_gc_dentry(struct dentry *d);
 bool fs_is_percent_encode_required(const char *name);
 void fs_set_nametype(struct ltfs_name *name, char *str);
 void fs_clear_nametype(struct ltfs_name *name);
+struct dentry *fs_snapshot_dentry(struct dentry *src);
+void fs_release_snapshot_dentry(struct dentry *d);
+uint64_t fs_release_children(struct dentry *d);
 
 /**
  * Decrement a dentry's reference count, freeing it if the reference count becomes 0.
@@ -122,6 +160,8 @@ int fs_dentry_lookup(struct dentry *dentry, char **name);
 /**
  * Look up the dentry corresponding to a path.
  * If a dentry is found, its reference count is incremented.
+ * Unless the parent is locked, the result is served from and remembered in the path
+ * cache of the index (see path_cache.h).
  * The caller must hold a read or write lock on the LTFS volume to which 'idx' belongs.
  * @param path Path to search for, in UTF-8 NFC. The path should be checked
  *             for invalid characters by the caller. This function validates the length of each
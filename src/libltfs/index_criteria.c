@@ -72,8 +72,44 @@ typedef struct ustack {
 	struct ustack *next;
 } filename_ustack_t;
 
+/* Rule sets which need more automaton states are left to the glob matcher */
+#define INDEX_CRITERIA_DFA_MAX_STATES (4096)
+/* The state reached once no rule can match any more */
+#define INDEX_CRITERIA_DFA_DEAD       (0)
+/* Returned while building when the automaton would exceed INDEX_CRITERIA_DFA_MAX_STATES */
+#define INDEX_CRITERIA_DFA_FULL       (-1)
+
+/**
+ * Deterministic automaton which matches a case-folded ASCII name against all name rules
+ * in one pass. Built from the rules whose case-folded form is plain ASCII; a non-ASCII rule
+ * can never match an ASCII name, so the automaton decides ASCII names on its own. Names
+ * with other characters go through the glob matcher.
+ */
+struct index_criteria_dfa {
+	uint8_t char_class[128];   /**< Input class of each ASCII character, upper case folded */
+	uint32_t num_classes;      /**< Number of input classes */
+	uint32_t num_states;       /**< Number of states */
+	uint32_t start;            /**< Initial state */
+	bool complete;             /**< True if every rule is part of the automaton */
+	uint16_t *next;            /**< Transitions, num_states rows of num_classes entries */
+	bool *accept;              /**< True for states in which some rule has matched */
+};
+
+/**
+ * Set of glob positions, one automaton state while the automaton is being built.
+ */
+struct index_criteria_dfa_set {
+	uint64_t *bits;            /**< Bit per glob position */
+	uint32_t state;            /**< Automaton state of this set */
+	UT_hash_handle hh;
+};
+
 /* Forward declaration of private functions */
 int _prepare_glob_cache(struct index_criteria *ic);
+void _index_criteria_compile(struct index_criteria *ic);
+int _index_criteria_dfa_build(const UChar **patterns, struct index_criteria_dfa **out);
+void _index_criteria_dfa_free(struct index_criteria_dfa **dfa);
+int _index_criteria_dfa_match(const struct index_criteria_dfa *dfa, const char *name);
 int _matches_name_criteria_caseless(const UChar *criteria, int32_t cr_len,
 	const UChar *filename, int32_t fi_len);
 void _next_char(const UChar *str, UBreakIterator *it, int32_t *pos);
@@ -425,6 +461,7 @@ int index_criteria_parse(const char *filterrules, struct ltfs_volume *vol)
 		return -LTFS_POLICY_INVALID;
 	}
 
+	_index_criteria_compile(ic);
 	return ret;
 }
 
@@ -460,7 +497,8 @@ int index_criteria_dup_rules(struct index_criteria *dest_ic, struct index_criter
 	index_criteria_free(dest_ic);
 
 	memcpy(dest_ic, src_ic, sizeof(*src_ic));
-	dest_ic->glob_cache = NULL; /* regenerate glob cache lazily */
+	dest_ic->glob_cache = NULL; /* regenerated below */
+	dest_ic->glob_dfa = NULL;
 	if (src_ic->have_criteria && src_ic->glob_patterns) {
 		while (src_ic->glob_patterns[counter].name)
 			counter++;
@@ -491,6 +529,7 @@ int index_criteria_dup_rules(struct index_criteria *dest_ic, struct index_criter
 		}
 	}
 
+	_index_criteria_compile(dest_ic);
 	return 0;
 }
 
@@ -524,6 +563,7 @@ void index_criteria_free(struct index_criteria *ic)
 		free(ic->glob_cache);
 		ic->glob_cache = NULL;
 	}
+	_index_criteria_dfa_free(&ic->glob_dfa);
 	ic->max_filesize_criteria = 0;
 	ic->have_criteria = false;
 }
@@ -596,6 +636,13 @@ bool index_criteria_match(struct dentry *d, struct ltfs_volume *vol)
 		return true;
 	}
 
+	/* Most names are ASCII and are decided by the automaton in a single pass */
+	if (ic->glob_dfa) {
+		match = _index_criteria_dfa_match(ic->glob_dfa, d->name.name);
+		if (match >= 0)
+			return match > 0;
+	}
+
 	if (! ic->glob_cache) {
 		ret = _prepare_glob_cache(ic);
 		if (ret < 0) {
@@ -665,6 +712,331 @@ int _prepare_glob_cache(struct index_criteria *ic)
 	return 0;
 }
 
+/**
+ * Compile the name rules of the given index criteria, so that index_criteria_match() does
+ * not have to do it while files are written. Failures are not fatal: the glob cache is
+ * then built on first use and names are matched by the glob matcher alone.
+ */
+void _index_criteria_compile(struct index_criteria *ic)
+{
+	int ret;
+	struct index_criteria_dfa *dfa = NULL;
+
+	if (! ic->have_criteria || ! ic->glob_patterns || ! ic->glob_patterns[0].name)
+		return;
+
+	ret = _prepare_glob_cache(ic);
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 11158E, ret);
+		return;
+	}
+
+	_index_criteria_dfa_free(&ic->glob_dfa);
+	ret = _index_criteria_dfa_build((const UChar **) ic->glob_cache, &dfa);
+	if (ret == 0)
+		ic->glob_dfa = dfa;
+}
+
+/**
+ * Tell whether a case-folded glob pattern can be run by the automaton.
+ * CR is left out because CR LF is a single character to the glob matcher.
+ */
+static bool _index_criteria_dfa_accepts(const UChar *pattern)
+{
+	for (; *pattern; ++pattern) {
+		if (*pattern >= 0x80 || *pattern == '\r')
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Add a glob position to a set, along with the positions it reaches without consuming
+ * input: an asterisk may match nothing, so it also stands for the position after it.
+ */
+static void _index_criteria_dfa_add(uint64_t *bits, const char *pos_char, uint32_t pos)
+{
+	bits[pos / 64] |= UINT64_C(1) << (pos % 64);
+	while (pos_char[pos] == '*') {
+		++pos;
+		bits[pos / 64] |= UINT64_C(1) << (pos % 64);
+	}
+}
+
+/**
+ * Once a rule which ends with an asterisk has matched, the rest of the name no longer
+ * matters. Such sets are all replaced with the set holding only the extra position after
+ * the last rule, which keeps rules like "*.bak*" from multiplying the number of states.
+ */
+static void _index_criteria_dfa_settle(uint64_t *bits, size_t set_bytes, const char *pos_char,
+	uint32_t num_pos)
+{
+	uint32_t p;
+
+	for (p=1; p<num_pos; ++p) {
+		if ((bits[p / 64] & (UINT64_C(1) << (p % 64))) && pos_char[p] == '\0'
+			&& pos_char[p - 1] == '*') {
+			memset(bits, 0, set_bytes);
+			bits[num_pos / 64] |= UINT64_C(1) << (num_pos % 64);
+			return;
+		}
+	}
+}
+
+/**
+ * Find the automaton state of a set of glob positions, adding a new state if the set
+ * has not been seen before.
+ * @return the state, INDEX_CRITERIA_DFA_FULL if there is no room for a new state,
+ *         or a negative value on error.
+ */
+static int _index_criteria_dfa_state(struct index_criteria_dfa_set **sets, uint64_t *bits,
+	size_t set_bytes, uint32_t *num_states, struct index_criteria_dfa_set ***order,
+	size_t *order_size)
+{
+	struct index_criteria_dfa_set *set, **tmp;
+
+	HASH_FIND(hh, *sets, bits, set_bytes, set);
+	if (set)
+		return set->state;
+
+	if (*num_states >= INDEX_CRITERIA_DFA_MAX_STATES)
+		return INDEX_CRITERIA_DFA_FULL;
+
+	set = calloc(1, sizeof(*set));
+	if (set)
+		set->bits = malloc(set_bytes);
+	if (! set || ! set->bits) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		free(set);
+		return -LTFS_NO_MEMORY;
+	}
+	if (*num_states == *order_size) {
+		tmp = realloc(*order, (*order_size ? *order_size * 2 : 64) * sizeof(*tmp));
+		if (! tmp) {
+			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+			free(set->bits);
+			free(set);
+			return -LTFS_NO_MEMORY;
+		}
+		*order = tmp;
+		*order_size = *order_size ? *order_size * 2 : 64;
+	}
+
+	memcpy(set->bits, bits, set_bytes);
+	set->state = (*num_states)++;
+	(*order)[set->state] = set;
+	HASH_ADD_KEYPTR(hh, *sets, set->bits, set_bytes, set);
+	return set->state;
+}
+
+/**
+ * Build the automaton for a list of case-folded glob patterns by subset construction.
+ * Each rule is laid out as a run of glob positions, one per pattern character plus one
+ * for the end of the pattern, and each automaton state is the set of positions the rules
+ * can be at after reading the name so far.
+ * @param patterns NULL-terminated list of patterns, as prepared by _prepare_glob_cache().
+ * @param out On success, the automaton.
+ * @return 0 on success, INDEX_CRITERIA_DFA_FULL if the automaton would have more than
+ *         INDEX_CRITERIA_DFA_MAX_STATES states, or another negative value on error.
+ */
+int _index_criteria_dfa_build(const UChar **patterns, struct index_criteria_dfa **out)
+{
+	int i, ret = 0, state;
+	uint32_t num_pos = 0, p, c, cur;
+	int num_rules = 0, num_ascii = 0;
+	size_t words, set_bytes, order_size = 0;
+	char *pos_char = NULL, class_char[128];
+	uint64_t *start = NULL, *next = NULL;
+	struct index_criteria_dfa *dfa;
+	struct index_criteria_dfa_set *sets = NULL, *set, *tmp, **order = NULL;
+	uint16_t *table;
+
+	dfa = calloc(1, sizeof(*dfa));
+	if (! dfa) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+
+	/* Lay out the glob positions of the rules the automaton can run */
+	for (i=0; patterns[i]; ++i) {
+		++num_rules;
+		if (_index_criteria_dfa_accepts(patterns[i])) {
+			num_pos += u_strlen(patterns[i]) + 1;
+			++num_ascii;
+		}
+	}
+	dfa->complete = (num_ascii == num_rules);
+
+	/* Every character which appears in a rule gets its own input class. Class 0 stands
+	 * for all the others, which only wildcards accept. */
+	dfa->num_classes = 1;
+	class_char[0] = '\0';
+	pos_char = calloc(num_pos + 1, 1);
+	words = (num_pos + 1 + 63) / 64;
+	set_bytes = words * sizeof(uint64_t);
+	start = calloc(words, sizeof(uint64_t));
+	next = calloc(words, sizeof(uint64_t));
+	if (! pos_char || ! start || ! next) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		ret = -LTFS_NO_MEMORY;
+		goto out;
+	}
+
+	p = 0;
+	for (i=0; patterns[i]; ++i) {
+		const UChar *ch;
+
+		if (! _index_criteria_dfa_accepts(patterns[i]))
+			continue;
+		for (ch=patterns[i]; *ch; ++ch) {
+			pos_char[p++] = (char) *ch;
+			if (*ch != '*' && *ch != '?' && ! dfa->char_class[*ch]) {
+				class_char[dfa->num_classes] = (char) *ch;
+				dfa->char_class[*ch] = dfa->num_classes++;
+			}
+		}
+		pos_char[p++] = '\0';
+	}
+	/* Every rule starts at its first position */
+	p = 0;
+	for (i=0; patterns[i]; ++i) {
+		if (! _index_criteria_dfa_accepts(patterns[i]))
+			continue;
+		_index_criteria_dfa_add(start, pos_char, p);
+		p += u_strlen(patterns[i]) + 1;
+	}
+	_index_criteria_dfa_settle(start, set_bytes, pos_char, num_pos);
+	for (c='A'; c<='Z'; ++c)
+		dfa->char_class[c] = dfa->char_class[c - 'A' + 'a'];
+
+	/* The dead state is the empty set */
+	memset(next, 0, set_bytes);
+	state = _index_criteria_dfa_state(&sets, next, set_bytes, &dfa->num_states, &order, &order_size);
+	if (state >= 0)
+		state = _index_criteria_dfa_state(&sets, start, set_bytes, &dfa->num_states, &order,
+			&order_size);
+	if (state < 0) {
+		ret = state;
+		goto out;
+	}
+	dfa->start = state;
+
+	/* Compute the transitions of each state, adding states as they are reached */
+	for (cur=0; cur<dfa->num_states; ++cur) {
+		uint16_t *row;
+
+		if (cur % 64 == 0) {
+			table = realloc(dfa->next, (cur + 64) * dfa->num_classes * sizeof(uint16_t));
+			if (! table) {
+				ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+				ret = -LTFS_NO_MEMORY;
+				goto out;
+			}
+			dfa->next = table;
+		}
+		row = dfa->next + (size_t) cur * dfa->num_classes;
+
+		for (c=0; c<dfa->num_classes; ++c) {
+			memset(next, 0, set_bytes);
+			for (p=0; p<num_pos; ++p) {
+				if (! (order[cur]->bits[p / 64] & (UINT64_C(1) << (p % 64))))
+					continue;
+				if (pos_char[p] == '*')
+					_index_criteria_dfa_add(next, pos_char, p);
+				else if (pos_char[p] == '?' || (c && pos_char[p] == class_char[c]))
+					_index_criteria_dfa_add(next, pos_char, p + 1);
+			}
+			if (order[cur]->bits[num_pos / 64] & (UINT64_C(1) << (num_pos % 64)))
+				next[num_pos / 64] |= UINT64_C(1) << (num_pos % 64);
+			_index_criteria_dfa_settle(next, set_bytes, pos_char, num_pos);
+			state = _index_criteria_dfa_state(&sets, next, set_bytes, &dfa->num_states,
+				&order, &order_size);
+			if (state < 0) {
+				ret = state;
+				goto out;
+			}
+			row[c] = state;
+		}
+	}
+
+	/* A state accepts if some rule is at its end position, or has already matched */
+	dfa->accept = calloc(dfa->num_states, sizeof(bool));
+	if (! dfa->accept) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		ret = -LTFS_NO_MEMORY;
+		goto out;
+	}
+	for (cur=0; cur<dfa->num_states; ++cur) {
+		if (order[cur]->bits[num_pos / 64] & (UINT64_C(1) << (num_pos % 64)))
+			dfa->accept[cur] = true;
+		p = 0;
+		for (i=0; patterns[i]; ++i) {
+			if (! _index_criteria_dfa_accepts(patterns[i]))
+				continue;
+			p += u_strlen(patterns[i]);
+			if (order[cur]->bits[p / 64] & (UINT64_C(1) << (p % 64)))
+				dfa->accept[cur] = true;
+			++p;
+		}
+	}
+
+	ltfsmsg(LTFS_DEBUG, 17313D, num_ascii, num_rules, dfa->num_states);
+
+out:
+	HASH_ITER(hh, sets, set, tmp) {
+		HASH_DEL(sets, set);
+		free(set->bits);
+		free(set);
+	}
+	free(order);
+	free(next);
+	free(start);
+	free(pos_char);
+
+	if (ret == INDEX_CRITERIA_DFA_FULL)
+		ltfsmsg(LTFS_DEBUG, 17314D, INDEX_CRITERIA_DFA_MAX_STATES);
+	if (ret < 0)
+		_index_criteria_dfa_free(&dfa);
+	else
+		*out = dfa;
+	return ret;
+}
+
+void _index_criteria_dfa_free(struct index_criteria_dfa **dfa)
+{
+	if (! dfa || ! *dfa)
+		return;
+	free((*dfa)->next);
+	free((*dfa)->accept);
+	free(*dfa);
+	*dfa = NULL;
+}
+
+/**
+ * Match a name against all rules in the automaton.
+ * @param dfa Automaton.
+ * @param name Name in UTF-8.
+ * @return 1 if the name matches a rule, 0 if it matches none, or -1 if the name must go
+ *         through the glob matcher instead.
+ */
+int _index_criteria_dfa_match(const struct index_criteria_dfa *dfa, const char *name)
+{
+	const unsigned char *ch = (const unsigned char *) name;
+	uint32_t state = dfa->start;
+
+	for (; *ch; ++ch) {
+		if (*ch >= 0x80 || *ch == '\r')
+			return -1;
+		state = dfa->next[(size_t) state * dfa->num_classes + dfa->char_class[*ch]];
+		if (state == INDEX_CRITERIA_DFA_DEAD && dfa->complete) {
+			/* No rule can match whatever follows */
+			return 0;
+		}
+	}
+
+	return dfa->accept[state] ? 1 : 0;
+}
+
 /**
  * Check whether a string matches the given criteria. Matching is performed using
  * filename globbing ("*" and "?" are supported), and it is performed by grapheme cluster
@@ -0,0 +1,483 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       index_snapshot.c
+**
+** DESCRIPTION:     Copy-on-write index snapshots.
+**
+**                  An index is serialized while other operations keep changing the
+**                  dentry tree. The snapshot is taken under the exclusive volume lock
+**                  and costs nothing but a new snapshot number; the index writer copies
+**                  each dentry when it visits it afterwards, and serializes the copy.
+**
+**                  Every change to a field written to the index calls
+**                  index_snapshot_preserve() before touching the dentry. If the index
+**                  writer has not read the dentry yet, a copy of it is taken and the
+**                  writer uses the copy instead. The writer and the changes are kept
+**                  apart by a small table of stripe locks, selected by UID, which are
+**                  never held while taking any other lock of the file system, nor while
+**                  the writer serializes a dentry.
+**
+**                  A dentry removed from the name tree while a snapshot is active may
+**                  still be visited by the writer, so the reference of its parent is
+**                  handed to the snapshot and dropped when the snapshot ends.
+**
+**                  The per-dentry dirty flags reported in the sync list are cleared
+**                  only after the index was written, and only on dentries which did
+**                  not change since the writer read them.
+**
+*************************************************************************************
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ltfs.h"
+#include "fs.h"
+#include "index_snapshot.h"
+
+/**
+ * index_snapshot structure.
+ * Must be created by index_snapshot_create() and freed by index_snapshot_free().
+ */
+struct index_snapshot {
+	ltfs_mutex_t stripe[INDEX_SNAPSHOT_STRIPES]; /**< Serialize the writer and changes, by UID */
+	ltfs_mutex_t lock;         /**< Protects the lists below */
+	uint32_t gen;              /**< Number of the active or of the last snapshot */
+	bool active;               /**< True while a snapshot is being written (atomic) */
+	bool failed;               /**< Set when a dentry could not be copied (atomic) */
+	struct dentry *copies;     /**< Copies taken during the snapshot, linked by snapshot_next */
+	struct dentry *held;       /**< Dentries whose parent reference is held, by snapshot_next */
+	struct dentry **reported;  /**< Files reported in the sync list */
+	size_t reported_count;     /**< Number of entries in reported */
+	size_t reported_alloc;     /**< Allocated size of reported */
+};
+
+static inline ltfs_mutex_t *_index_snapshot_stripe(struct index_snapshot *snap, struct dentry *d)
+{
+	return &snap->stripe[d->uid % INDEX_SNAPSHOT_STRIPES];
+}
+
+static inline struct index_snapshot *_index_snapshot_of(struct dentry *d)
+{
+	if (! d->vol || ! d->vol->index)
+		return NULL;
+	return d->vol->index->snapshot;
+}
+
+/**
+ * Create the snapshot state of an index.
+ * @param snap On success, points to the new state.
+ * @return 0 on success or a negative value on error.
+ */
+int index_snapshot_create(struct index_snapshot **snap)
+{
+	int ret, i;
+	struct index_snapshot *s;
+
+	CHECK_ARG_NULL(snap, -LTFS_NULL_ARG);
+
+	s = calloc(1, sizeof(struct index_snapshot));
+	if (! s) {
+		ltfsmsg(LTFS_ERR, 10001E, "index_snapshot_create: state");
+		return -LTFS_NO_MEMORY;
+	}
+
+	ret = ltfs_mutex_init(&s->lock);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10002E, ret);
+		free(s);
+		return -LTFS_MUTEX_INIT;
+	}
+	for (i = 0; i < INDEX_SNAPSHOT_STRIPES; ++i) {
+		ret = ltfs_mutex_init(&s->stripe[i]);
+		if (ret) {
+			ltfsmsg(LTFS_ERR, 10002E, ret);
+			while (--i >= 0)
+				ltfs_mutex_destroy(&s->stripe[i]);
+			ltfs_mutex_destroy(&s->lock);
+			free(s);
+			return -LTFS_MUTEX_INIT;
+		}
+	}
+
+	*snap = s;
+	return 0;
+}
+
+/**
+ * Free the snapshot state of an index. No snapshot may be active.
+ * @param snap State to free. Set to NULL on return.
+ */
+void index_snapshot_free(struct index_snapshot **snap)
+{
+	int i;
+
+	if (! snap || ! *snap)
+		return;
+
+	index_snapshot_release_held(*snap);
+	for (i = 0; i < INDEX_SNAPSHOT_STRIPES; ++i)
+		ltfs_mutex_destroy(&(*snap)->stripe[i]);
+	ltfs_mutex_destroy(&(*snap)->lock);
+	free((*snap)->reported);
+	free(*snap);
+	*snap = NULL;
+}
+
+/**
+ * Check whether a snapshot is being written.
+ * @param snap Snapshot state, may be NULL.
+ * @return true if a snapshot is active.
+ */
+bool index_snapshot_active(struct index_snapshot *snap)
+{
+	return snap && __atomic_load_n(&snap->active, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Start a snapshot of the dentry tree.
+ * The caller must hold the volume lock for write, so that no change is in progress.
+ * @param snap Snapshot state of the index.
+ */
+void index_snapshot_begin(struct index_snapshot *snap)
+{
+	/* Dentries start out with number 0, which is never used for a snapshot */
+	if (++snap->gen == 0)
+		++snap->gen;
+	snap->failed = false;
+	__atomic_store_n(&snap->active, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * Finish a snapshot. Copies are freed; dentries held by the snapshot stay held until
+ * index_snapshot_release_held() is called.
+ * @param snap Snapshot state of the index.
+ * @param written True if the index was written, in which case the dirty flags reported in
+ *                the sync list are cleared on files which did not change since.
+ * @return 0 on success, or -LTFS_NO_MEMORY if a dentry could not be copied during the
+ *         snapshot, in which case the index written from it is not consistent.
+ */
+int index_snapshot_end(struct index_snapshot *snap, bool written)
+{
+	int i, ret = 0;
+	size_t n;
+	ltfs_mutex_t *lock;
+	struct dentry *d, *next;
+
+	if (! index_snapshot_active(snap))
+		return 0;
+
+	if (written) {
+		for (n = 0; n < snap->reported_count; ++n) {
+			d = snap->reported[n];
+			lock = _index_snapshot_stripe(snap, d);
+			ltfs_mutex_lock(lock);
+			if (d->snapshot_changed != snap->gen)
+				d->dirty = false;
+			ltfs_mutex_unlock(lock);
+		}
+	}
+	snap->reported_count = 0;
+
+	/* Wait for changes which saw the snapshot active to finish preserving their dentries */
+	__atomic_store_n(&snap->active, false, __ATOMIC_RELEASE);
+	for (i = 0; i < INDEX_SNAPSHOT_STRIPES; ++i) {
+		ltfs_mutex_lock(&snap->stripe[i]);
+		ltfs_mutex_unlock(&snap->stripe[i]);
+	}
+
+	if (__atomic_load_n(&snap->failed, __ATOMIC_ACQUIRE))
+		ret = -LTFS_NO_MEMORY;
+
+	for (d = snap->copies; d; d = next) {
+		next = d->snapshot_next;
+		fs_release_snapshot_dentry(d);
+	}
+	snap->copies = NULL;
+
+	return ret;
+}
+
+/**
+ * Drop the parent references handed to a finished snapshot by index_snapshot_hold().
+ * The caller must not hold the tape device lock or any dentry lock, as the dentries
+ * may be disposed of here.
+ * @param snap Snapshot state of the index.
+ */
+void index_snapshot_release_held(struct index_snapshot *snap)
+{
+	struct dentry *d, *next;
+
+	if (! snap)
+		return;
+
+	ltfs_mutex_lock(&snap->lock);
+	d = snap->held;
+	snap->held = NULL;
+	ltfs_mutex_unlock(&snap->lock);
+
+	for (; d; d = next) {
+		next = d->snapshot_next;
+		d->snapshot_next = NULL;
+		fs_release_dentry(d);
+	}
+}
+
+/**
+ * Copy a dentry for the active snapshot if the index writer has not read it yet.
+ */
+static void _index_snapshot_preserve(struct dentry *d)
+{
+	ltfs_mutex_t *lock;
+	struct dentry *copy;
+	struct index_snapshot *snap = _index_snapshot_of(d);
+
+	if (! index_snapshot_active(snap))
+		return;
+
+	lock = _index_snapshot_stripe(snap, d);
+	ltfs_mutex_lock(lock);
+	if (! __atomic_load_n(&snap->active, __ATOMIC_RELAXED))
+		goto out;
+
+	/* Dentries unlinked before the snapshot was taken are not part of it */
+	if (d->deleted && d->snapshot_changed != snap->gen)
+		goto out;
+
+	if (d->snapshot_gen != snap->gen) {
+		copy = fs_snapshot_dentry(d);
+		if (copy) {
+			ltfs_mutex_lock(&snap->lock);
+			copy->snapshot_next = snap->copies;
+			snap->copies = copy;
+			ltfs_mutex_unlock(&snap->lock);
+		} else
+			__atomic_store_n(&snap->failed, true, __ATOMIC_RELEASE);
+		d->snapshot_copy = copy;
+		d->snapshot_gen = snap->gen;
+	}
+	d->snapshot_changed = snap->gen;
+
+out:
+	ltfs_mutex_unlock(lock);
+}
+
+/**
+ * Preserve a dentry for the active snapshot before changing it. Call this before changing
+ * any field of the dentry which is written to the index, including the child list of a
+ * directory. The caller must hold the locks needed to change those fields. The dentry is
+ * also marked as changed, which keeps its directory from being evicted to the index spill.
+ *
+ * If the copy cannot be allocated, the snapshot is marked as failed and the index writer
+ * gives up before it reads the dentry.
+ * @param d Dentry about to change.
+ */
+void index_snapshot_preserve(struct dentry *d)
+{
+	__atomic_store_n(&d->changed, true, __ATOMIC_RELAXED);
+	_index_snapshot_preserve(d);
+}
+
+/**
+ * Preserve a dentry before updating its access time as a side effect of reading it.
+ * Like index_snapshot_preserve(), but the dentry is marked as changed only when access
+ * times are tracked in the index, so reading a directory does not keep it loaded.
+ * @param d Dentry about to change.
+ */
+void index_snapshot_preserve_atime(struct dentry *d)
+{
+	if (d->vol && d->vol->index && d->vol->index->use_atime)
+		__atomic_store_n(&d->changed, true, __ATOMIC_RELAXED);
+	_index_snapshot_preserve(d);
+}
+
+/**
+ * Hand the reference a directory holds on a child to the active snapshot. Call this when
+ * the child is removed from the name tree, instead of dropping that reference. The caller
+ * must hold the meta_lock of d.
+ * @param d Dentry being removed from the name tree.
+ * @return true if the snapshot took the reference, false if the caller must drop it.
+ */
+bool index_snapshot_hold(struct dentry *d)
+{
+	bool held = false;
+	ltfs_mutex_t *lock;
+	struct index_snapshot *snap = _index_snapshot_of(d);
+
+	if (! index_snapshot_active(snap))
+		return false;
+
+	lock = _index_snapshot_stripe(snap, d);
+	ltfs_mutex_lock(lock);
+	if (__atomic_load_n(&snap->active, __ATOMIC_RELAXED)) {
+		ltfs_mutex_lock(&snap->lock);
+		d->snapshot_next = snap->held;
+		snap->held = d;
+		ltfs_mutex_unlock(&snap->lock);
+		d->snapshot_changed = snap->gen;
+		held = true;
+	}
+	ltfs_mutex_unlock(lock);
+
+	return held;
+}
+
+/**
+ * Mark a new dentry as not belonging to the active snapshot, so that changing it before
+ * the snapshot ends does not copy it.
+ * @param snap Snapshot state of the index the dentry is created in, may be NULL.
+ * @param d New dentry, not yet published in the name tree.
+ */
+void index_snapshot_set_new(struct index_snapshot *snap, struct dentry *d)
+{
+	if (snap)
+		d->snapshot_gen = __atomic_load_n(&snap->gen, __ATOMIC_RELAXED);
+}
+
+/**
+ * Get the version of a dentry which belongs in the snapshot being written.
+ *
+ * The index writer calls this on every dentry it visits. The result is either the copy
+ * taken when the dentry changed, or a private copy taken now under the stripe lock of the
+ * dentry. The writer serializes the result without holding the stripe lock, so changes to
+ * the dentry never wait for the writer, which may itself be waiting for tape I/O.
+ * @param snap Snapshot being written, or NULL when the live index is written under the
+ *             exclusive volume lock, in which case d itself is returned.
+ * @param d Dentry to visit.
+ * @param copied On return, true if the result is a private copy, which must be freed by
+ *               index_snapshot_put().
+ * @return The dentry to write, or NULL if the snapshot failed.
+ */
+struct dentry *index_snapshot_get(struct index_snapshot *snap, struct dentry *d, bool *copied)
+{
+	ltfs_mutex_t *lock;
+	struct dentry *view;
+
+	*copied = false;
+	if (! snap)
+		return d;
+
+	lock = _index_snapshot_stripe(snap, d);
+	ltfs_mutex_lock(lock);
+	if (__atomic_load_n(&snap->failed, __ATOMIC_ACQUIRE))
+		view = NULL;
+	else if (d->snapshot_gen == snap->gen && d->snapshot_copy)
+		view = d->snapshot_copy;
+	else {
+		/* Later changes see the dentry as read and do not copy it again */
+		view = fs_snapshot_dentry(d);
+		if (view) {
+			d->snapshot_gen = snap->gen;
+			d->snapshot_copy = NULL;
+			*copied = true;
+		} else
+			__atomic_store_n(&snap->failed, true, __ATOMIC_RELEASE);
+	}
+	ltfs_mutex_unlock(lock);
+
+	return view;
+}
+
+/**
+ * Release a dentry returned by index_snapshot_get().
+ * @param view Dentry returned by index_snapshot_get().
+ * @param copied The value index_snapshot_get() returned in its copied argument.
+ */
+void index_snapshot_put(struct dentry *view, bool copied)
+{
+	if (copied)
+		fs_release_snapshot_dentry(view);
+}
+
+/**
+ * List the children of a directory in the order they are written to the index.
+ * @param dir Directory, as returned by index_snapshot_get(), or a live directory while the
+ *            exclusive volume lock is held.
+ * @param children On success, points to an array of the children, to be freed by the caller.
+ * @param count On success, the number of entries in the array.
+ * @return 0 on success or a negative value on error.
+ */
+int index_snapshot_children(struct dentry *dir, struct dentry ***children, size_t *count)
+{
+	size_t n = 0;
+	struct name_list *entry, *aux;
+
+	*children = NULL;
+	*count = HASH_COUNT(dir->child_list);
+	if (*count == 0)
+		return 0;
+
+	*children = malloc(*count * sizeof(struct dentry *));
+	if (! *children) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	HASH_ITER(hh, dir->child_list, entry, aux)
+		(*children)[n++] = entry->d;
+
+	return 0;
+}
+
+/**
+ * Remember a file reported in the sync list, so that its dirty flag is cleared once the
+ * index is written unless it changes before. Files written from a copy taken when they
+ * changed are not reported, so their flag stays set. If memory runs out, the flag also
+ * stays set and the file is reported again by the next index.
+ * @param snap Snapshot being written.
+ * @param d Live file, which index_snapshot_get() returned a private copy of.
+ */
+void index_snapshot_report(struct index_snapshot *snap, struct dentry *d)
+{
+	struct dentry **list;
+	size_t alloc;
+
+	ltfs_mutex_lock(&snap->lock);
+	if (snap->reported_count == snap->reported_alloc) {
+		alloc = snap->reported_alloc ? snap->reported_alloc * 2 : 64;
+		list = realloc(snap->reported, alloc * sizeof(struct dentry *));
+		if (! list) {
+			ltfs_mutex_unlock(&snap->lock);
+			return;
+		}
+		snap->reported = list;
+		snap->reported_alloc = alloc;
+	}
+	snap->reported[snap->reported_count++] = d;
+	ltfs_mutex_unlock(&snap->lock);
+}
@@ -0,0 +1,84 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       index_snapshot.h
+**
+** DESCRIPTION:     Prototypes for copy-on-write index snapshots.
+**
+*************************************************************************************
+*/
+#ifndef __index_snapshot_h
+#define __index_snapshot_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "libltfs/ltfs_thread.h"
+
+/** Number of locks serializing the index writer with changes to the dentries it reads */
+#define INDEX_SNAPSHOT_STRIPES (64)
+
+struct dentry;
+struct index_snapshot;
+
+int index_snapshot_create(struct index_snapshot **snap);
+void index_snapshot_free(struct index_snapshot **snap);
+bool index_snapshot_active(struct index_snapshot *snap);
+void index_snapshot_begin(struct index_snapshot *snap);
+int index_snapshot_end(struct index_snapshot *snap, bool written);
+void index_snapshot_release_held(struct index_snapshot *snap);
+
+void index_snapshot_preserve(struct dentry *d);
+void index_snapshot_preserve_atime(struct dentry *d);
+bool index_snapshot_hold(struct dentry *d);
+void index_snapshot_set_new(struct index_snapshot *snap, struct dentry *d);
+
+struct dentry *index_snapshot_get(struct index_snapshot *snap, struct dentry *d, bool *copied);
+void index_snapshot_put(struct dentry *view, bool copied);
+int index_snapshot_children(struct dentry *dir, struct dentry ***children, size_t *count);
+void index_snapshot_report(struct index_snapshot *snap, struct dentry *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __index_snapshot_h */
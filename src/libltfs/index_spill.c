@@ -0,0 +1,1005 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+** FILE NAME:       index_spill.c
+**
+** DESCRIPTION:     Lazily loaded directory contents.
+**
+**                  When an index is read from tape, the XML is also copied to an
+**                  unlinked file in the work directory, and the position of the
+**                  <contents> element of every directory is recorded while the
+**                  bytes go by. The parser then only builds the children of the
+**                  root directory; every other directory keeps a pointer to its
+**                  slot and its children are parsed from the spill file when it is
+**                  first looked up or listed. Directories loaded this way are kept
+**                  in an LRU list and unused ones are dropped again once too many
+**                  dentries have been loaded, as long as nothing below them changed
+**                  since they were read.
+**
+*************************************************************************************
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ltfs.h"
+#include "fs.h"
+#include "xml_libltfs.h"
+#include "index_spill.h"
+#include "index_snapshot.h"
+#include "dcache.h"
+
+/** Number of slots allocated at once */
+#define INDEX_SPILL_SLOT_CHUNK   (1024)
+/** Size of the buffer used to write the spill file */
+#define INDEX_SPILL_BUFFER_SIZE  (1024 * 1024)
+/** Longest element name the scanner needs to recognize, plus one */
+#define INDEX_SPILL_NAME_MAX     (16)
+/** Number of directories that may refuse eviction before a load gives up evicting */
+#define INDEX_SPILL_EVICT_TRIES  (8)
+/** Replacement text for the contents of a subdirectory when a directory is loaded */
+#define INDEX_SPILL_EMPTY_CONTENTS "<contents></contents>"
+
+/* Scanner states */
+enum {
+	SCAN_TEXT,      /* Character data */
+	SCAN_OPEN,      /* After '<' */
+	SCAN_NAME,      /* In the name of a start or end tag */
+	SCAN_TAG,       /* In a start or end tag, after the name */
+	SCAN_QUOTE,     /* In an attribute value */
+	SCAN_BANG,      /* After "<!" */
+	SCAN_BANG_DASH, /* After "<!-" */
+	SCAN_COMMENT,   /* In a comment */
+	SCAN_CDATA,     /* In a CDATA section */
+	SCAN_DECL,      /* In a declaration other than a comment or CDATA section */
+	SCAN_PI,        /* In a processing instruction */
+};
+
+/* Kinds of open elements */
+enum {
+	ELEM_OTHER,
+	ELEM_DIRECTORY,
+	ELEM_CONTENTS,  /* <contents> of a directory, which owns a slot */
+};
+
+/**
+ * index_spill structure.
+ * Must be created by index_spill_create() and freed by index_spill_free().
+ */
+struct index_spill {
+	ltfs_mutex_t lock;            /**< Protects the loaded state of the slots and the LRU list */
+	struct ltfs_index *idx;       /**< Index the spill belongs to */
+	int fd;                       /**< Spill file */
+	uint64_t size;                /**< Number of bytes fed to the spill */
+	char *buf;                    /**< Bytes not written to the spill file yet */
+	size_t buf_used;              /**< Valid bytes in buf */
+
+	/* Scanner state */
+	int state;                    /**< One of SCAN_* */
+	bool end_tag;                 /**< The current tag is an end tag */
+	bool slash;                   /**< The last character of the current tag was a '/' */
+	char quote;                   /**< Quote character of the current attribute value */
+	unsigned int match;           /**< Progress towards the end of a comment, CDATA section or PI */
+	uint64_t tag_start;           /**< Offset of the current tag */
+	char name[INDEX_SPILL_NAME_MAX]; /**< Name of the current tag, possibly truncated */
+	size_t name_len;              /**< Length of the name of the current tag */
+	unsigned char *elems;         /**< Kinds of the open elements */
+	size_t elem_depth;            /**< Number of open elements */
+	size_t elem_alloc;            /**< Allocated length of elems */
+	uint64_t *open;               /**< Numbers of the open slots */
+	size_t open_depth;            /**< Number of open slots */
+	size_t open_alloc;            /**< Allocated length of open */
+
+	/* Slots */
+	struct index_spill_slot **chunks; /**< Slot chunks */
+	size_t chunk_alloc;           /**< Allocated length of chunks */
+	uint64_t nslots;              /**< Number of slots */
+	uint64_t parse_next;          /**< Slot of the next <contents> element the parser sees */
+	uint64_t deferred;            /**< Number of directories left in the spill at mount */
+
+	/* Residency */
+	TAILQ_HEAD(spill_lru_struct, index_spill_slot) lru; /**< Loaded directories, least recently used first */
+	uint64_t resident;            /**< Number of dentries loaded from the spill */
+	uint64_t max_resident;        /**< Eviction threshold, 0 for no eviction */
+	bool failed;                  /**< Writing the spill file failed */
+};
+
+static inline struct index_spill_slot *_index_spill_slot(struct index_spill *spill, uint64_t num)
+{
+	return &spill->chunks[num / INDEX_SPILL_SLOT_CHUNK][num % INDEX_SPILL_SLOT_CHUNK];
+}
+
+/**
+ * Create a spill file for an index which is about to be parsed.
+ * @param spill On success, the new spill.
+ * @param work_dir Directory in which to create the spill file. The file is unlinked right
+ *                 away, so it disappears when the spill is freed or the process exits.
+ * @param max_resident Number of dentries loaded from the spill before unused directories
+ *                     are evicted, or 0 to never evict.
+ * @param idx Index being parsed.
+ * @return 0 on success or a negative value on error.
+ */
+int index_spill_create(struct index_spill **spill, const char *work_dir, uint64_t max_resident,
+	struct ltfs_index *idx)
+{
+	int ret;
+	char *path;
+	struct index_spill *s;
+
+	CHECK_ARG_NULL(spill, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(work_dir, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(idx, -LTFS_NULL_ARG);
+
+	s = calloc(1, sizeof(struct index_spill));
+	if (! s) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	s->buf = malloc(INDEX_SPILL_BUFFER_SIZE);
+	if (! s->buf) {
+		ltfsmsg(LTFS_ERR, 10001E, "index_spill_create: buffer");
+		free(s);
+		return -LTFS_NO_MEMORY;
+	}
+	ret = ltfs_mutex_init(&s->lock);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10002E, ret);
+		free(s->buf);
+		free(s);
+		return -LTFS_MUTEX_INIT;
+	}
+
+	ret = asprintf(&path, "%s/index_spill.%d.%p", work_dir, (int)arch_getpid(), (void *)s);
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 10001E, "index_spill_create: path");
+		ltfs_mutex_destroy(&s->lock);
+		free(s->buf);
+		free(s);
+		return -LTFS_NO_MEMORY;
+	}
+	arch_open(&s->fd, path, O_RDWR | O_CREAT | O_EXCL | O_BINARY, SHARE_FLAG_DENYNO, PERMISSION_READWRITE);
+	if (s->fd < 0) {
+		ret = -errno;
+		ltfsmsg(LTFS_WARN, 17303W, path, ret);
+		free(path);
+		ltfs_mutex_destroy(&s->lock);
+		free(s->buf);
+		free(s);
+		return -LTFS_FILE_ERR;
+	}
+	arch_unlink(path);
+	free(path);
+
+	s->idx = idx;
+	s->max_resident = max_resident;
+	s->state = SCAN_TEXT;
+	TAILQ_INIT(&s->lru);
+
+	*spill = s;
+	return 0;
+}
+
+/**
+ * Free a spill. All dentries pointing to its slots must have been released.
+ * @param spill Spill to free. Set to NULL on return.
+ */
+void index_spill_free(struct index_spill **spill)
+{
+	size_t i;
+
+	if (! spill || ! *spill)
+		return;
+
+	for (i = 0; i * INDEX_SPILL_SLOT_CHUNK < (*spill)->nslots; ++i)
+		free((*spill)->chunks[i]);
+	free((*spill)->chunks);
+	free((*spill)->elems);
+	free((*spill)->open);
+	free((*spill)->buf);
+	if ((*spill)->fd >= 0)
+		arch_close((*spill)->fd);
+	ltfs_mutex_destroy(&(*spill)->lock);
+	free(*spill);
+	*spill = NULL;
+}
+
+/**
+ * Write buffered bytes to the spill file.
+ */
+static int _index_spill_flush(struct index_spill *spill)
+{
+	ssize_t written;
+	size_t done = 0;
+
+	while (done < spill->buf_used) {
+		written = arch_write(spill->fd, spill->buf + done, spill->buf_used - done);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			ltfsmsg(LTFS_ERR, 17304E, -errno);
+			spill->failed = true;
+			return -LTFS_FILE_ERR;
+		}
+		done += written;
+	}
+	spill->buf_used = 0;
+
+	return 0;
+}
+
+static int _index_spill_push_elem(struct index_spill *spill, unsigned char kind)
+{
+	unsigned char *elems;
+
+	if (spill->elem_depth == spill->elem_alloc) {
+		elems = realloc(spill->elems, (spill->elem_alloc + 64) * sizeof(unsigned char));
+		if (! elems) {
+			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+			return -LTFS_NO_MEMORY;
+		}
+		spill->elems = elems;
+		spill->elem_alloc += 64;
+	}
+	spill->elems[spill->elem_depth++] = kind;
+
+	return 0;
+}
+
+/**
+ * Create a slot for a <contents> element starting at the current tag and make it the
+ * innermost open slot.
+ */
+static int _index_spill_open_slot(struct index_spill *spill)
+{
+	uint64_t *open;
+	struct index_spill_slot **chunks, *slot;
+
+	if (spill->open_depth == spill->open_alloc) {
+		open = realloc(spill->open, (spill->open_alloc + 64) * sizeof(uint64_t));
+		if (! open) {
+			ltfsmsg(LTFS_ERR, 10001E, "_index_spill_open_slot: stack");
+			return -LTFS_NO_MEMORY;
+		}
+		spill->open = open;
+		spill->open_alloc += 64;
+	}
+
+	if (spill->nslots % INDEX_SPILL_SLOT_CHUNK == 0) {
+		if (spill->nslots / INDEX_SPILL_SLOT_CHUNK == spill->chunk_alloc) {
+			chunks = realloc(spill->chunks, (spill->chunk_alloc + 64) * sizeof(*chunks));
+			if (! chunks) {
+				ltfsmsg(LTFS_ERR, 10001E, "_index_spill_open_slot: chunks");
+				return -LTFS_NO_MEMORY;
+			}
+			spill->chunks = chunks;
+			spill->chunk_alloc += 64;
+		}
+		spill->chunks[spill->nslots / INDEX_SPILL_SLOT_CHUNK] =
+			calloc(INDEX_SPILL_SLOT_CHUNK, sizeof(struct index_spill_slot));
+		if (! spill->chunks[spill->nslots / INDEX_SPILL_SLOT_CHUNK]) {
+			ltfsmsg(LTFS_ERR, 10001E, "_index_spill_open_slot: chunk");
+			return -LTFS_NO_MEMORY;
+		}
+	}
+
+	slot = _index_spill_slot(spill, spill->nslots);
+	slot->spill = spill;
+	slot->num = spill->nslots;
+	slot->start = spill->tag_start;
+	spill->open[spill->open_depth++] = spill->nslots++;
+
+	return 0;
+}
+
+/**
+ * Account for a complete start or end tag.
+ * @param spill Spill.
+ * @param end Offset just past the '>' of the tag.
+ * @param empty True for an empty-element tag.
+ */
+static int _index_spill_tag(struct index_spill *spill, uint64_t end, bool empty)
+{
+	int ret;
+	unsigned char top, kind;
+	struct index_spill_slot *slot, *parent;
+	bool known = spill->name_len < INDEX_SPILL_NAME_MAX;
+
+	if (known)
+		spill->name[spill->name_len] = '\0';
+
+	if (spill->end_tag) {
+		if (spill->elem_depth == 0)
+			return 0; /* Malformed, the parser reports it */
+		if (spill->elems[--spill->elem_depth] == ELEM_CONTENTS) {
+			slot = _index_spill_slot(spill, spill->open[--spill->open_depth]);
+			slot->end = end;
+			slot->next = spill->nslots;
+			if (spill->open_depth > 0) {
+				parent = _index_spill_slot(spill, spill->open[spill->open_depth - 1]);
+				parent->files += slot->files;
+			}
+		}
+		return 0;
+	}
+
+	top = spill->elem_depth ? spill->elems[spill->elem_depth - 1] : ELEM_OTHER;
+	if (top == ELEM_CONTENTS && known) {
+		slot = _index_spill_slot(spill, spill->open[spill->open_depth - 1]);
+		if (! strcmp(spill->name, "file"))
+			++slot->files;
+		else if (! strcmp(spill->name, "directory"))
+			++slot->subdirs;
+	}
+
+	if (empty)
+		return 0;
+
+	if (known && top == ELEM_DIRECTORY && ! strcmp(spill->name, "contents")) {
+		ret = _index_spill_open_slot(spill);
+		if (ret < 0)
+			return ret;
+		kind = ELEM_CONTENTS;
+	} else if (known && ! strcmp(spill->name, "directory"))
+		kind = ELEM_DIRECTORY;
+	else
+		kind = ELEM_OTHER;
+
+	return _index_spill_push_elem(spill, kind);
+}
+
+/**
+ * Append index data to the spill and record the <contents> elements found in it.
+ * Must be given every byte the XML parser reads, in order.
+ * @param spill Spill.
+ * @param buf Data.
+ * @param len Length of buf.
+ * @return 0 on success or a negative value on error.
+ */
+int index_spill_feed(struct index_spill *spill, const char *buf, size_t len)
+{
+	int ret;
+	size_t i, n;
+	char c;
+
+	CHECK_ARG_NULL(spill, -LTFS_NULL_ARG);
+
+	for (i = 0; i < len; ++i) {
+		c = buf[i];
+		switch (spill->state) {
+		case SCAN_TEXT:
+			if (c == '<') {
+				spill->tag_start = spill->size + i;
+				spill->state = SCAN_OPEN;
+			}
+			break;
+		case SCAN_OPEN:
+			spill->end_tag = false;
+			spill->slash = false;
+			spill->name_len = 0;
+			spill->match = 0;
+			if (c == '/') {
+				spill->end_tag = true;
+				spill->state = SCAN_NAME;
+			} else if (c == '!')
+				spill->state = SCAN_BANG;
+			else if (c == '?')
+				spill->state = SCAN_PI;
+			else {
+				spill->name[spill->name_len++] = c;
+				spill->state = SCAN_NAME;
+			}
+			break;
+		case SCAN_NAME:
+			if (c != '>' && c != '/' && c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+				if (spill->name_len < INDEX_SPILL_NAME_MAX - 1)
+					spill->name[spill->name_len] = c;
+				if (spill->name_len < INDEX_SPILL_NAME_MAX)
+					++spill->name_len;
+				break;
+			}
+			spill->state = SCAN_TAG;
+			/* Fall through */
+		case SCAN_TAG:
+			if (c == '>') {
+				ret = _index_spill_tag(spill, spill->size + i + 1, spill->slash);
+				if (ret < 0)
+					return ret;
+				spill->state = SCAN_TEXT;
+			} else if (c == '"' || c == '\'') {
+				spill->quote = c;
+				spill->slash = false;
+				spill->state = SCAN_QUOTE;
+			} else
+				spill->slash = (c == '/');
+			break;
+		case SCAN_QUOTE:
+			if (c == spill->quote)
+				spill->state = SCAN_TAG;
+			break;
+		case SCAN_BANG:
+			if (c == '-')
+				spill->state = SCAN_BANG_DASH;
+			else if (c == '[')
+				spill->state = SCAN_CDATA;
+			else {
+				spill->state = SCAN_DECL;
+				if (c == '>')
+					spill->state = SCAN_TEXT;
+			}
+			break;
+		case SCAN_BANG_DASH:
+			spill->state = SCAN_COMMENT;
+			break;
+		case SCAN_COMMENT:
+			if (c == '-')
+				++spill->match;
+			else if (c == '>' && spill->match >= 2)
+				spill->state = SCAN_TEXT;
+			else
+				spill->match = 0;
+			break;
+		case SCAN_CDATA:
+			if (c == ']')
+				++spill->match;
+			else if (c == '>' && spill->match >= 2)
+				spill->state = SCAN_TEXT;
+			else
+				spill->match = 0;
+			break;
+		case SCAN_DECL:
+			if (c == '[')
+				++spill->match;
+			else if (c == ']' && spill->match > 0)
+				--spill->match;
+			else if (c == '>' && spill->match == 0)
+				spill->state = SCAN_TEXT;
+			break;
+		case SCAN_PI:
+			if (c == '>' && spill->match)
+				spill->state = SCAN_TEXT;
+			else
+				spill->match = (c == '?');
+			break;
+		}
+	}
+
+	for (i = 0; i < len; i += n) {
+		n = len - i;
+		if (n > INDEX_SPILL_BUFFER_SIZE - spill->buf_used)
+			n = INDEX_SPILL_BUFFER_SIZE - spill->buf_used;
+		memcpy(spill->buf + spill->buf_used, buf + i, n);
+		spill->buf_used += n;
+		if (spill->buf_used == INDEX_SPILL_BUFFER_SIZE) {
+			ret = _index_spill_flush(spill);
+			if (ret < 0)
+				return ret;
+		}
+	}
+	spill->size += len;
+
+	return 0;
+}
+
+/**
+ * Complete a spill after the index has been parsed. The spill file is flushed and the
+ * number of <contents> elements seen by the parser is checked against the scanner.
+ * @param spill Spill.
+ * @return 0 on success or a negative value on error.
+ */
+int index_spill_finish(struct index_spill *spill)
+{
+	int ret;
+
+	CHECK_ARG_NULL(spill, -LTFS_NULL_ARG);
+
+	ret = _index_spill_flush(spill);
+	if (ret < 0)
+		return ret;
+
+	if (spill->open_depth > 0 || spill->parse_next != spill->nslots) {
+		ltfsmsg(LTFS_ERR, 17306E, (unsigned long long)spill->parse_next,
+				(unsigned long long)spill->nslots);
+		return -LTFS_INDEX_INVALID;
+	}
+
+	free(spill->elems);
+	spill->elems = NULL;
+	spill->elem_alloc = 0;
+	free(spill->open);
+	spill->open = NULL;
+	spill->open_alloc = 0;
+	free(spill->buf);
+	spill->buf = NULL;
+
+	if (spill->deferred)
+		ltfsmsg(LTFS_INFO, 17302I, (unsigned long long)spill->deferred,
+				(unsigned long long)spill->size);
+
+	return 0;
+}
+
+/**
+ * Get the number of directories whose contents were left in the spill when the index
+ * was parsed.
+ */
+uint64_t index_spill_deferred(struct index_spill *spill)
+{
+	return spill ? spill->deferred : 0;
+}
+
+/**
+ * Get the slot of the next non-empty <contents> element the parser has reached.
+ * The parser must call this for every such element, in document order.
+ * @param spill Spill.
+ * @param slot On success, the slot of the element.
+ * @return 0 on success or a negative value if the scanner did not see the element.
+ */
+int index_spill_claim(struct index_spill *spill, struct index_spill_slot **slot)
+{
+	CHECK_ARG_NULL(spill, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(slot, -LTFS_NULL_ARG);
+
+	if (spill->parse_next >= spill->nslots) {
+		ltfsmsg(LTFS_ERR, 17306E, (unsigned long long)spill->parse_next,
+				(unsigned long long)spill->nslots);
+		return -LTFS_INDEX_INVALID;
+	}
+	*slot = _index_spill_slot(spill, spill->parse_next++);
+
+	return 0;
+}
+
+/**
+ * Leave the contents of a directory in the spill. The parser must have skipped the
+ * <contents> element of the slot. The link count of the directory and the file count of
+ * the index are updated as if the contents had been parsed.
+ * @param slot Slot claimed for the contents of dir.
+ * @param dir Directory being parsed.
+ * @return 0 on success or a negative value on error.
+ */
+int index_spill_defer(struct index_spill_slot *slot, struct dentry *dir)
+{
+	struct index_spill *spill;
+
+	CHECK_ARG_NULL(slot, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(dir, -LTFS_NULL_ARG);
+
+	spill = slot->spill;
+	if (slot->end == 0) {
+		ltfsmsg(LTFS_ERR, 17306E, (unsigned long long)slot->num,
+				(unsigned long long)spill->nslots);
+		return -LTFS_INDEX_INVALID;
+	}
+
+	spill->parse_next = slot->next;
+	dir->spill = slot;
+	dir->spill_loaded = false;
+	dir->link_count += slot->subdirs;
+	ltfs_mutex_lock(&spill->idx->dirty_lock);
+	spill->idx->file_count += slot->files;
+	ltfs_mutex_unlock(&spill->idx->dirty_lock);
+	++spill->deferred;
+
+	return 0;
+}
+
+/**
+ * Prepare to read the contents of a slot. The <contents> element of each subdirectory
+ * is replaced with an empty one, and the parser is expected to claim and defer their
+ * slots. The caller must hold the spill lock.
+ * @param slot Slot to read.
+ * @param stream Stream to initialize.
+ * @return 0 on success or a negative value on error.
+ */
+int index_spill_stream_open(struct index_spill_slot *slot, struct index_spill_stream *stream)
+{
+	CHECK_ARG_NULL(slot, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(stream, -LTFS_NULL_ARG);
+
+	stream->spill = slot->spill;
+	stream->pos = slot->start;
+	stream->end = slot->end;
+	stream->child = slot->num + 1;
+	stream->last = slot->next;
+	stream->fill = NULL;
+	slot->spill->parse_next = slot->num + 1;
+
+	return 0;
+}
+
+/**
+ * Read callback for libxml2 over a stream opened by index_spill_stream_open.
+ */
+int index_spill_stream_read(void *context, char *buffer, int len)
+{
+	int ret;
+	struct index_spill_stream *stream = context;
+	struct index_spill_slot *child;
+	uint64_t limit, n;
+	int copied = 0;
+
+	while (copied < len) {
+		if (stream->fill) {
+			while (*stream->fill && copied < len)
+				buffer[copied++] = *stream->fill++;
+			if (! *stream->fill)
+				stream->fill = NULL;
+			continue;
+		}
+
+		limit = stream->end;
+		if (stream->child < stream->last) {
+			child = _index_spill_slot(stream->spill, stream->child);
+			if (stream->pos == child->start) {
+				stream->fill = INDEX_SPILL_EMPTY_CONTENTS;
+				stream->pos = child->end;
+				stream->child = child->next;
+				continue;
+			}
+			limit = child->start;
+		}
+		if (stream->pos >= limit)
+			break;
+
+		n = limit - stream->pos;
+		if (n > (uint64_t)(len - copied))
+			n = len - copied;
+		ret = index_spill_read(stream->spill, buffer + copied, n, stream->pos);
+		if (ret < 0)
+			return -1;
+		stream->pos += n;
+		copied += n;
+	}
+
+	return copied;
+}
+
+/**
+ * Close callback for libxml2 over a stream opened by index_spill_stream_open.
+ */
+int index_spill_stream_close(void *context)
+{
+	/* Do nothing */
+	return 0;
+}
+
+/**
+ * Read bytes from the spill file.
+ * @param spill Spill.
+ * @param buf Destination buffer.
+ * @param len Number of bytes to read.
+ * @param offset Offset in the spill file.
+ * @return 0 on success or a negative value on error.
+ */
+int index_spill_read(struct index_spill *spill, char *buf, size_t len, uint64_t offset)
+{
+	ssize_t nread;
+	size_t done = 0;
+
+	while (done < len) {
+		nread = pread(spill->fd, buf + done, len - done, offset + done);
+		if (nread < 0 && errno == EINTR)
+			continue;
+		if (nread <= 0) {
+			ltfsmsg(LTFS_ERR, 17304E, nread < 0 ? -errno : -LTFS_FILE_ERR);
+			return -LTFS_FILE_ERR;
+		}
+		done += nread;
+	}
+
+	return 0;
+}
+
+/**
+ * Count the files a failed load added to the file count of the index.
+ */
+static uint64_t _index_spill_count_files(struct dentry *d)
+{
+	uint64_t count = 0;
+	struct name_list *entry, *tmp;
+
+	HASH_ITER(hh, d->child_list, entry, tmp) {
+		if (! entry->d->isdir)
+			++count;
+		else if (entry->d->spill && ! entry->d->spill_loaded)
+			count += entry->d->spill->files;
+	}
+
+	return count;
+}
+
+/**
+ * Parse the children of a directory and attach them to it. The caller may hold the
+ * contents_lock of d, so the children are parsed into a private directory and moved over
+ * once complete: readers see either no children or the complete list. On error, the
+ * dentries parsed so far are released and the file count of the index is restored.
+ * @param d Directory without children.
+ * @param idx Index the directory belongs to.
+ * @param parse Function parsing the children into the directory it is given.
+ * @param arg Argument passed to parse.
+ * @return 0 on success or a negative value on error.
+ */
+int index_spill_attach(struct dentry *d, struct ltfs_index *idx,
+	int (*parse)(struct dentry *dir, struct ltfs_index *idx, void *arg), void *arg)
+{
+	int ret;
+	size_t symerr_count;
+	uint64_t files;
+	struct dentry *staging;
+	struct name_list *entry, *tmp;
+
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(idx, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(parse, -LTFS_NULL_ARG);
+
+	staging = fs_allocate_dentry(NULL, NULL, NULL, true, false, false, idx);
+	if (! staging)
+		return -LTFS_NO_MEMORY;
+	staging->vol = d->vol;
+
+	symerr_count = idx->symerr_count;
+	ret = parse(staging, idx, arg);
+	if (ret == 0 && idx->symerr_count != symerr_count)
+		ret = -LTFS_SYMLINK_CONFLICT;
+	if (ret < 0) {
+		if (idx->symerr_count != symerr_count) {
+			/* The conflicting dentries are released below */
+			idx->symerr_count = symerr_count;
+			if (symerr_count == 0) {
+				free(idx->symlink_conflict);
+				idx->symlink_conflict = NULL;
+			}
+		}
+		files = _index_spill_count_files(staging);
+		ltfs_mutex_lock(&idx->dirty_lock);
+		idx->file_count -= files;
+		ltfs_mutex_unlock(&idx->dirty_lock);
+		fs_release_dentry(staging);
+		return ret;
+	}
+
+	HASH_ITER(hh, staging->child_list, entry, tmp)
+		entry->d->parent = d;
+	__atomic_store_n(&d->child_list, staging->child_list, __ATOMIC_RELEASE);
+	staging->child_list = NULL;
+	fs_release_dentry(staging);
+
+	return 0;
+}
+
+static int _index_spill_parse_slot(struct dentry *dir, struct ltfs_index *idx, void *arg)
+{
+	return xml_dir_contents_from_spill(arg, dir, idx);
+}
+
+/**
+ * Parse the children of a directory from its slot and attach them to the directory.
+ * The caller must hold the spill lock.
+ */
+static int _index_spill_load_dir(struct index_spill *spill, struct dentry *d)
+{
+	int ret;
+	struct ltfs_index *idx = spill->idx;
+
+	ret = index_spill_attach(d, idx, _index_spill_parse_slot, d->spill);
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 17305E, (unsigned long long)d->uid, ret);
+		return ret;
+	}
+
+	/* The files were counted when the directory was deferred */
+	ltfs_mutex_lock(&idx->dirty_lock);
+	idx->file_count -= d->spill->files;
+	ltfs_mutex_unlock(&idx->dirty_lock);
+
+	d->spill->d = d;
+	d->spill->dentries = HASH_COUNT(d->child_list);
+	TAILQ_INSERT_TAIL(&spill->lru, d->spill, lru);
+	spill->resident += d->spill->dentries;
+	__atomic_store_n(&d->spill_loaded, true, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/**
+ * Take a directory off the LRU list. The caller must hold the spill lock.
+ */
+static void _index_spill_unlink(struct index_spill *spill, struct dentry *d)
+{
+	TAILQ_REMOVE(&spill->lru, d->spill, lru);
+	spill->resident -= d->spill->dentries;
+	d->spill->d = NULL;
+	d->spill->dentries = 0;
+	__atomic_store_n(&d->spill_loaded, false, __ATOMIC_RELEASE);
+}
+
+/**
+ * Check that no dentry below a directory is in use or differs from the spill, so that the
+ * children can be parsed from the spill again. The caller must hold the contents_lock of
+ * the directory for write, so no new references can be taken.
+ */
+static bool _index_spill_unused(struct dentry *d)
+{
+	struct name_list *entry, *tmp;
+
+	if (__atomic_load_n(&d->changed, __ATOMIC_RELAXED))
+		return false;
+
+	HASH_ITER(hh, d->child_list, entry, tmp) {
+		if (entry->d->numhandles != 1 || entry->d->out_of_sync || entry->d->dirty
+			|| entry->d->iosched_priv || __atomic_load_n(&entry->d->changed, __ATOMIC_RELAXED))
+			return false;
+		if (entry->d->isdir && ! _index_spill_unused(entry->d))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Take the loaded directories below d off the LRU list. The caller must hold the spill lock.
+ */
+static void _index_spill_unlink_below(struct index_spill *spill, struct dentry *d)
+{
+	struct name_list *entry, *tmp;
+
+	HASH_ITER(hh, d->child_list, entry, tmp) {
+		if (! entry->d->isdir)
+			continue;
+		if (entry->d->spill && entry->d->spill_loaded)
+			_index_spill_unlink(spill, entry->d);
+		_index_spill_unlink_below(spill, entry->d);
+	}
+}
+
+/**
+ * Drop the children of a loaded directory, leaving them in the spill.
+ * The caller must hold the spill lock.
+ * @return true if the directory was evicted, false if it is in use.
+ */
+static bool _index_spill_evict_dir(struct index_spill *spill, struct index_spill_slot *slot)
+{
+	uint64_t blocks, count;
+	struct dentry *d = slot->d;
+
+	if (fs_prepare_dentry_locks(d) < 0 || ! try_acquirewrite_mrsw(&fs_dentry_locks(d)->contents_lock))
+		return false;
+	if (! _index_spill_unused(d)) {
+		releasewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
+		return false;
+	}
+
+	count = slot->dentries;
+	_index_spill_unlink_below(spill, d);
+	_index_spill_unlink(spill, d);
+	blocks = fs_release_children(d);
+	releasewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
+
+	ltfs_mutex_lock(&spill->idx->dirty_lock);
+	spill->idx->valid_blocks -= blocks;
+	ltfs_mutex_unlock(&spill->idx->dirty_lock);
+
+	ltfsmsg(LTFS_DEBUG, 17307D, (unsigned long long)d->uid, (unsigned long long)count);
+	return true;
+}
+
+/**
+ * Evict least recently used directories until the number of loaded dentries is below the
+ * limit. Directories with changes below them are skipped, as the spill no longer matches
+ * them. The caller must hold the spill lock.
+ * @param spill Spill.
+ * @param current Directory the caller is using, which is never evicted.
+ */
+static void _index_spill_evict(struct index_spill *spill, struct dentry *current)
+{
+	int tries = 0;
+	struct index_spill_slot *slot, *next;
+
+	if (! spill->max_resident)
+		return;
+
+	/* The index writer walks the live tree while a snapshot is active */
+	if (index_snapshot_active(spill->idx->snapshot))
+		return;
+
+	slot = TAILQ_FIRST(&spill->lru);
+	while (slot && spill->resident > spill->max_resident && tries < INDEX_SPILL_EVICT_TRIES) {
+		next = TAILQ_NEXT(slot, lru);
+		if (slot->d != current && _index_spill_evict_dir(spill, slot))
+			next = TAILQ_FIRST(&spill->lru);
+		else
+			++tries;
+		slot = next;
+	}
+}
+
+/**
+ * Make sure the children of a directory are in memory. This must be called before
+ * looking at the child_list of a directory which may have been deferred or evicted to the
+ * dentry cache. The caller may hold the contents_lock of d.
+ * @param d Directory.
+ * @param evict True to evict unused directories if too many dentries are loaded. Callers
+ *              which walk the tree without taking references must pass false.
+ * @return 0 on success or a negative value on error.
+ */
+int index_spill_load(struct dentry *d, bool evict)
+{
+	int ret = 0;
+	struct index_spill *spill;
+
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+
+	/* Directories outside the spill may have their children kept by the dentry cache */
+	if (! d->spill) {
+		if (d->vol && d->vol->dcache_handle && dcache_initialized(d->vol))
+			return dcache_load(d, evict, d->vol);
+		return 0;
+	}
+
+	spill = d->spill->spill;
+	ltfs_mutex_lock(&spill->lock);
+	if (! d->spill_loaded)
+		ret = _index_spill_load_dir(spill, d);
+	else {
+		TAILQ_REMOVE(&spill->lru, d->spill, lru);
+		TAILQ_INSERT_TAIL(&spill->lru, d->spill, lru);
+	}
+	if (ret == 0 && evict)
+		_index_spill_evict(spill, d);
+	ltfs_mutex_unlock(&spill->lock);
+
+	return ret;
+}
+
+/**
+ * Take a directory which is being disposed off the LRU list.
+ * @param d Directory being disposed.
+ */
+void index_spill_forget(struct dentry *d)
+{
+	struct index_spill *spill;
+
+	if (! d || ! d->spill)
+		return;
+
+	spill = d->spill->spill;
+	ltfs_mutex_lock(&spill->lock);
+	if (d->spill_loaded)
+		_index_spill_unlink(spill, d);
+	ltfs_mutex_unlock(&spill->lock);
+}
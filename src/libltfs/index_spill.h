@@ -0,0 +1,119 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+** FILE NAME:       index_spill.h
+**
+** DESCRIPTION:     Prototypes for lazily loaded directory contents.
+**
+*************************************************************************************
+*/
+#ifndef __index_spill_h
+#define __index_spill_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "libltfs/queue.h"
+
+struct dentry;
+struct ltfs_index;
+struct index_spill;
+
+/** Default number of spilled dentries kept in memory before unused directories are evicted */
+#define INDEX_SPILL_DEFAULT_LIMIT (1000000)
+
+/**
+ * The <contents> element of one directory in the spill file. Slots are numbered in document
+ * order and never move once created, so dentries can point to them.
+ */
+struct index_spill_slot {
+	struct index_spill *spill;   /**< Spill file holding the element */
+	uint64_t num;                /**< Slot number */
+	uint64_t start;              /**< Offset of the start tag */
+	uint64_t end;                /**< Offset just past the end tag, 0 while the element is open */
+	uint64_t next;               /**< Number of the first slot after this element */
+	uint64_t files;              /**< Number of files in the whole subtree */
+	uint32_t subdirs;            /**< Number of directories directly below */
+
+	/* Take the spill lock before accessing these fields. */
+	struct dentry *d;            /**< Directory whose contents are loaded from this slot */
+	uint64_t dentries;           /**< Number of dentries loaded from this slot */
+	TAILQ_ENTRY(index_spill_slot) lru; /**< Entry in the list of loaded directories */
+};
+
+/**
+ * Stream over the contents of one slot, with the contents of its subdirectories left out.
+ * Used as the input of the XML parser when a directory is loaded.
+ */
+struct index_spill_stream {
+	struct index_spill *spill;   /**< Spill file to read */
+	uint64_t pos;                /**< Next offset to read */
+	uint64_t end;                /**< End of the slot */
+	uint64_t child;              /**< Next subdirectory slot to leave out */
+	uint64_t last;               /**< First slot after the slot being read */
+	const char *fill;            /**< Pending replacement text for a subdirectory */
+};
+
+int index_spill_create(struct index_spill **spill, const char *work_dir, uint64_t max_resident,
+	struct ltfs_index *idx);
+void index_spill_free(struct index_spill **spill);
+int index_spill_feed(struct index_spill *spill, const char *buf, size_t len);
+int index_spill_finish(struct index_spill *spill);
+uint64_t index_spill_deferred(struct index_spill *spill);
+
+int index_spill_claim(struct index_spill *spill, struct index_spill_slot **slot);
+int index_spill_defer(struct index_spill_slot *slot, struct dentry *dir);
+
+int index_spill_stream_open(struct index_spill_slot *slot, struct index_spill_stream *stream);
+int index_spill_stream_read(void *context, char *buffer, int len);
+int index_spill_stream_close(void *context);
+int index_spill_read(struct index_spill *spill, char *buf, size_t len, uint64_t offset);
+
+int index_spill_attach(struct dentry *d, struct ltfs_index *idx,
+	int (*parse)(struct dentry *dir, struct ltfs_index *idx, void *arg), void *arg);
+int index_spill_load(struct dentry *d, bool evict);
+void index_spill_forget(struct dentry *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __index_spill_h */
@@ -236,6 +236,41 @@ ssize_t iosched_write(struct dentry *d, const char *buf, size_t size, off_t offs
 	return ret;
 }
 
+/**
+ * Write to tape through the I/O scheduler, gathering the data from a caller-defined source.
+ * @param d dentry to write to
+ * @param source callback that copies data out of the source
+ * @param source_priv source handle passed to the callback
+ * @param size input data length
+ * @param offset offset relative to the beginning of file to start writing to
+ * @param isupdatetime true to update the modification time
+ * @param vol LTFS volume
+ * @return number of bytes written on success, -LTFS_UNSUPPORTED if the I/O scheduler
+ *         cannot gather data from a source, or another negative value on error.
+ */
+ssize_t iosched_write_source(struct dentry *d, ltfs_write_source source, void *source_priv,
+	size_t size, off_t offset, bool isupdatetime, struct ltfs_volume *vol)
+{
+	ssize_t ret;
+	struct iosched_priv *priv = (struct iosched_priv *) vol ? vol->iosched_handle : NULL;
+
+	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(priv->ops, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(source, -LTFS_NULL_ARG);
+
+	if (! priv->ops->write_source)
+		return -LTFS_UNSUPPORTED;
+
+	ret = priv->ops->write_source(d, source, source_priv, size, offset, isupdatetime,
+		priv->backend_handle);
+	if (ret > 0 && (size_t) ret > size)
+		ret = size;
+
+	return ret;
+}
+
 /**
  * Flushes all pending operations to the tape.
  * @param d dentry to flush or NULL to flush all queued operations.
@@ -66,6 +66,8 @@ ssize_t iosched_read(struct dentry *d, char *buf, size_t size, off_t offset,
 		struct ltfs_volume *vol);
 ssize_t iosched_write(struct dentry *d, const char *buf, size_t size, off_t offset,
 	bool isupdatetime, struct ltfs_volume *vol);
+ssize_t iosched_write_source(struct dentry *d, ltfs_write_source source, void *source_priv,
+	size_t size, off_t offset, bool isupdatetime, struct ltfs_volume *vol);
 int iosched_flush(struct dentry *d, bool closeflag, struct ltfs_volume *vol);
 int iosched_truncate(struct dentry *d, off_t length, struct ltfs_volume *vol);
 uint64_t iosched_get_filesize(struct dentry *d, struct ltfs_volume *vol);
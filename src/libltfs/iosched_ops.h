@@ -77,6 +77,22 @@ struct iosched_ops {
 	 * @return 0 on success or a negative value on error
 	 */
 	int   (*set_profiler)(char *work_dir, bool enable, void *iosched_handle);
+
+	/**
+	 * Write data gathered from a caller-defined source, copying it directly into the
+	 * scheduler's buffers. Optional: when NULL, the caller stages the data in a flat buffer
+	 * and uses write().
+	 * @param d dentry to write to.
+	 * @param source Callback that copies data out of the source.
+	 * @param source_priv Source handle passed to the callback.
+	 * @param size Number of bytes to write.
+	 * @param offset File offset to write to.
+	 * @param isupdatetime True to update the modification time.
+	 * @param iosched_handle Handle to the I/O scheduler data.
+	 * @return Number of bytes written on success or a negative value on error.
+	 */
+	ssize_t  (*write_source)(struct dentry *d, ltfs_write_source source, void *source_priv,
+					  size_t size, off_t offset, bool isupdatetime, void *iosched_handle);
 };
 
 struct iosched_ops *iosched_get_ops(void);
@@ -76,6 +76,7 @@
 #include "iosched.h"
 #include "dcache.h"
 #include "kmi.h"
+#include "index_snapshot.h"
 
 #ifndef MIN
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
@@ -151,6 +152,7 @@ int ltfs_init(int log_level, bool use_syslog, bool print_thread_id)
 	}
 
 	xml_init();
+	xattr_init();
 
 	return 0;
 }
@@ -404,6 +406,8 @@ int ltfs_volume_alloc(const char *execname, struct ltfs_volume **volume)
 		ltfsmsg(LTFS_ERR, 10002E, ret);
 		goto out_indexfree;
 	}
+	enable_reader_bias_mrsw(&newvol->lock);
+	set_lock_class_mrsw(&newvol->lock, LOCK_CLASS_VOLUME);
 	ret = ltfs_thread_mutex_init(&newvol->reval_lock);
 	if (ret) {
 		ltfsmsg(LTFS_ERR, 10002E, ret);
@@ -416,6 +420,18 @@ int ltfs_volume_alloc(const char *execname, struct ltfs_volume **volume)
 		ret = -LTFS_MUTEX_INIT;
 		goto out_lockfree2;
 	}
+	ret = ltfs_thread_mutex_init(&newvol->sync_lock);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10002E, ret);
+		ret = -LTFS_MUTEX_INIT;
+		goto out_condfree;
+	}
+	ret = ltfs_thread_cond_init(&newvol->sync_cond);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10003E, ret);
+		ret = -LTFS_MUTEX_INIT;
+		goto out_synclockfree;
+	}
 
 	if (execname) {
 		ret = asprintf(&newvol->creator, CREATOR_STRING_FORMAT,
@@ -424,13 +440,17 @@ int ltfs_volume_alloc(const char *execname, struct ltfs_volume **volume)
 			/* Memory allocation failed */
 			ltfsmsg(LTFS_ERR, 10001E, "ltfs_volume_alloc, creator string");
 			ret = -LTFS_NO_MEMORY;
-			goto out_condfree;
+			goto out_synccondfree;
 		}
 	}
 
 	*volume = newvol;
 	return 0;
 
+out_synccondfree:
+	ltfs_thread_cond_destroy(&newvol->sync_cond);
+out_synclockfree:
+	ltfs_thread_mutex_destroy(&newvol->sync_lock);
 out_condfree:
 	ltfs_thread_cond_destroy(&newvol->reval_cond);
 out_lockfree2:
@@ -475,6 +495,8 @@ void _ltfs_volume_free(bool force, struct ltfs_volume **volume)
 		destroy_mrsw(&(*volume)->lock);
 		ltfs_thread_mutex_destroy(&(*volume)->reval_lock);
 		ltfs_thread_cond_destroy(&(*volume)->reval_cond);
+		ltfs_thread_mutex_destroy(&(*volume)->sync_lock);
+		ltfs_thread_cond_destroy(&(*volume)->sync_cond);
 		free(*volume);
 		*volume = NULL;
 	}
@@ -682,6 +704,32 @@ int ltfs_parse_library_backend_opts(void *opt_args, void *opts)
 	return rc;
 }
 
+/**
+ * Store capacity data in the volume's capacity cache for lock-free readers.
+ * The fields are published one by one, so a reader may see a mix of two consecutive
+ * updates; each field is individually valid.
+ */
+static void _ltfs_capacity_publish(const struct device_capacity *cap, struct ltfs_volume *vol)
+{
+	struct ltfs_timespec now;
+
+	__atomic_store_n(&vol->capacity_cache.remaining_ip, cap->remaining_ip, __ATOMIC_RELAXED);
+	__atomic_store_n(&vol->capacity_cache.remaining_dp, cap->remaining_dp, __ATOMIC_RELAXED);
+	__atomic_store_n(&vol->capacity_cache.total_ip, cap->total_ip, __ATOMIC_RELAXED);
+	__atomic_store_n(&vol->capacity_cache.total_dp, cap->total_dp, __ATOMIC_RELAXED);
+
+	get_current_timespec(&now);
+	__atomic_store_n(&vol->capacity_stamp, now.tv_sec ? (uint64_t)now.tv_sec : 1, __ATOMIC_RELEASE);
+}
+
+static void _ltfs_capacity_snapshot(struct device_capacity *cap, struct ltfs_volume *vol)
+{
+	cap->remaining_ip = __atomic_load_n(&vol->capacity_cache.remaining_ip, __ATOMIC_RELAXED);
+	cap->remaining_dp = __atomic_load_n(&vol->capacity_cache.remaining_dp, __ATOMIC_RELAXED);
+	cap->total_ip = __atomic_load_n(&vol->capacity_cache.total_ip, __ATOMIC_RELAXED);
+	cap->total_dp = __atomic_load_n(&vol->capacity_cache.total_dp, __ATOMIC_RELAXED);
+}
+
 /**
  * Get capacity data in filesystem block units. Converts the result of
  * tape_get_capacity from partition 0/1 to data/index,
@@ -780,14 +828,63 @@ int ltfs_capacity_data_unlocked(struct device_capacity *cap, struct ltfs_volume
 		else
 			cap->remaining_dp -= (cap->total_ip / 2);
 
-		memcpy(&vol->capacity_cache, cap, sizeof(struct device_capacity));
+		_ltfs_capacity_publish(cap, vol);
 
 	} else
-		memcpy(cap, &vol->capacity_cache, sizeof(struct device_capacity));
+		_ltfs_capacity_snapshot(cap, vol);
+
+	return 0;
+}
+
+/**
+ * Get capacity data without touching the device or taking any lock.
+ * The result is the last capacity read from the device, at most one refresh period old
+ * (see capacity_refresh_thread_init), minus the blocks written since then. Falls back to
+ * ltfs_capacity_data() if the capacity has never been read. Compression makes the
+ * remaining capacity estimate conservative between refreshes.
+ * Must not be called with a lock on the volume or on the device.
+ */
+int ltfs_capacity_data_cached(struct device_capacity *cap, struct ltfs_volume *vol)
+{
+	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(cap, -LTFS_NULL_ARG);
 
+	if (! __atomic_load_n(&vol->capacity_stamp, __ATOMIC_ACQUIRE))
+		return ltfs_capacity_data(cap, vol);
+
+	_ltfs_capacity_snapshot(cap, vol);
 	return 0;
 }
 
+/**
+ * Account for blocks written to a partition in the capacity cache, so cached capacity
+ * stays close to the device's between refreshes.
+ * @param partition Partition ID the blocks were written to.
+ * @param blocks Number of blocks written.
+ * @param no_space True if the write hit early warning; no data partition space is left then.
+ * @param vol LTFS volume.
+ */
+void ltfs_capacity_consumed(char partition, uint64_t blocks, bool no_space, struct ltfs_volume *vol)
+{
+	unsigned long *remaining, cur, next;
+
+	if (partition == ltfs_dp_id(vol))
+		remaining = &vol->capacity_cache.remaining_dp;
+	else
+		remaining = &vol->capacity_cache.remaining_ip;
+
+	if (no_space && partition == ltfs_dp_id(vol)) {
+		__atomic_store_n(remaining, 0, __ATOMIC_RELAXED);
+		return;
+	}
+
+	cur = __atomic_load_n(remaining, __ATOMIC_RELAXED);
+	do {
+		next = (cur > blocks) ? cur - blocks : 0;
+	} while (! __atomic_compare_exchange_n(remaining, &cur, next, true,
+		__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
 /**
  * Get media health data from the device.
  * This is a locking wrapper for tape_get_cartridge_health().
@@ -1556,6 +1653,104 @@ static inline int _ltfs_search_index_wp(bool recover_symlink, bool can_skip_ip,
 	return 0;
 }
 
+/**
+ * Build the name of the file ltfs_save_index_to_disk writes the index to.
+ * @param work_dir LTFS work directory.
+ * @param need_gen include generation number to file name
+ * @param path On success, the allocated file name.
+ * @param vol LTFS volume
+ * @return 0 on success or a negative value on error
+ */
+static int _ltfs_index_file_path(const char *work_dir, bool need_gen, char **path,
+								 struct ltfs_volume *vol)
+{
+	int ret;
+
+	if (need_gen) {
+		if (strcmp(vol->label->barcode, "      "))
+			ret = asprintf(path, "%s/%s-%d.schema", work_dir, vol->label->barcode, vol->index->generation);
+		else
+			ret = asprintf(path, "%s/%s-%d.schema", work_dir, vol->label->vol_uuid, vol->index->generation);
+	} else {
+		if (strcmp(vol->label->barcode, "      "))
+			ret = asprintf(path, "%s/%s.schema", work_dir, vol->label->barcode);
+		else
+			ret = asprintf(path, "%s/%s.schema", work_dir, vol->label->vol_uuid);
+	}
+
+	return ret < 0 ? -LTFS_NO_MEMORY : 0;
+}
+
+/**
+ * Read the index saved in the work directory at the last unmount instead of reading the
+ * latest index from the index partition. The saved index is used only when its volume UUID,
+ * generation and self pointer match the latest index recorded in the index partition
+ * coherency information, which the caller has already checked against the volume change
+ * reference of the cartridge, and when its back pointer passes the same checks as an index
+ * read from tape.
+ * @param vol LTFS volume
+ * @return 0 if vol->index was replaced by the saved index, 1 if the index must be read from
+ *         tape.
+ */
+static int _ltfs_read_cached_index(struct ltfs_volume *vol)
+{
+	int ret;
+	char *path = NULL;
+	struct stat st;
+	struct ltfs_index *idx = NULL;
+
+	if (! vol->work_directory)
+		return 1;
+
+	ret = _ltfs_index_file_path(vol->work_directory, false, &path, vol);
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 10001E, "_ltfs_read_cached_index: path");
+		return 1;
+	}
+
+	if (stat(path, &st) < 0 || ! S_ISREG(st.st_mode)) {
+		/* No index cache is available, read the index from tape */
+		ltfsmsg(LTFS_INFO, 17300I, path, "no saved index");
+		free(path);
+		return 1;
+	}
+
+	ret = ltfs_index_alloc(&idx, vol);
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 11297E, ret);
+		free(path);
+		return 1;
+	}
+
+	ret = xml_schema_from_file(path, idx, vol);
+	if (ret < 0 || idx->symerr_count) {
+		ltfsmsg(LTFS_INFO, 17300I, path, "cannot parse");
+		goto out_fallback;
+	}
+
+	if (strncmp(idx->vol_uuid, vol->label->vol_uuid, 36)) {
+		ltfsmsg(LTFS_INFO, 17300I, path, "volume UUID");
+		goto out_fallback;
+	} else if (idx->generation != vol->ip_coh.count) {
+		ltfsmsg(LTFS_INFO, 17300I, path, "generation");
+		goto out_fallback;
+	} else if (ltfs_check_index_pointers(idx, vol->label->partid_ip, vol->ip_coh.set_id, vol) < 0) {
+		ltfsmsg(LTFS_INFO, 17300I, path, "index pointers");
+		goto out_fallback;
+	}
+
+	ltfsmsg(LTFS_INFO, 17299I, path, idx->generation);
+	ltfs_index_free(&vol->index);
+	vol->index = idx;
+	free(path);
+	return 0;
+
+out_fallback:
+	ltfs_index_free(&idx);
+	free(path);
+	return 1;
+}
+
 /**
  * Read LTFS data structures from a tape, checking for consistency (and restoring it
  * if possible). This function doesn't bother locking vol->index, as it must complete before any
@@ -1824,6 +2019,9 @@ int ltfs_mount(bool force_full, bool deep_recovery, bool recover_extra, bool rec
 				if (ret < 0)
 					goto out_unlock;
 			}
+		} else if (vol->cached_index_mount && _ltfs_read_cached_index(vol) == 0) {
+			/* The index saved at the last unmount is the latest index on the IP */
+			ltfsmsg(LTFS_DEBUG, 11025D); /* volume is consistent */
 		} else {
 			seekpos.partition = ltfs_part_id2num(vol->label->partid_ip, vol);
 			seekpos.block = vol->ip_coh.set_id;
@@ -1997,8 +2195,10 @@ void ltfs_set_index_dirty(bool locking, bool atime, struct ltfs_index *idx)
 		was_dirty = idx->dirty;
 		if (atime)
 			idx->atime_dirty = true;
-		else
+		else {
 			idx->dirty = true;
+			__atomic_add_fetch(&idx->dirty_entries, 1, __ATOMIC_RELAXED);
+		}
 		if (! atime || (atime && idx->use_atime))
 			idx->version = LTFS_INDEX_VERSION;
 		if (!was_dirty && idx->dirty && dcache_initialized(idx->root->vol))
@@ -2026,6 +2226,8 @@ void ltfs_unset_index_dirty(bool update_version, struct ltfs_index *idx)
 		was_dirty = idx->dirty;
 		idx->dirty = false;
 		idx->atime_dirty = false;
+		__atomic_store_n(&idx->dirty_entries, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&idx->dirty_bytes, 0, __ATOMIC_RELAXED);
 		if (was_dirty && dcache_initialized(idx->root->vol))
 				dcache_set_dirty(false, idx->root->vol);
 		if (update_version)
@@ -2144,6 +2346,8 @@ start:
 
 	releasewrite_mrsw(&vol->lock);
 
+	lock_profile_print();
+
 	ltfsmsg(LTFS_INFO, 11034I); /* unmount successful */
 	return 0;
 }
@@ -2345,6 +2549,84 @@ void ltfs_set_eod_check(bool use, struct ltfs_volume *vol)
 		vol->skip_eod_check = ! use;
 }
 
+/**
+ * Configure mounting from the index saved in the work directory by ltfs_save_index_to_disk.
+ * This should be done before calling ltfs_mount. The saved index is only used when the
+ * cartridge coherency information shows that it is still the latest index on the volume.
+ * Disabled by default.
+ */
+void ltfs_set_cached_index_mount(bool use, struct ltfs_volume *vol)
+{
+	if (vol)
+		vol->cached_index_mount = use;
+}
+
+/**
+ * Configure lazy loading of directory contents. When enabled, an index read from tape at
+ * mount is copied to a spill file in the work directory and only the children of the root
+ * directory are built; the children of other directories are parsed from the spill when
+ * they are first looked up or listed. This should be done before calling ltfs_mount.
+ * Disabled by default.
+ * @param use True to enable lazy loading.
+ * @param limit Number of dentries loaded from the spill before unused directories are
+ *              dropped again, or 0 to keep everything loaded.
+ * @param vol LTFS volume.
+ */
+void ltfs_set_lazy_index(bool use, uint64_t limit, struct ltfs_volume *vol)
+{
+	if (vol) {
+		vol->lazy_index = use;
+		vol->lazy_index_limit = limit;
+	}
+}
+
+/**
+ * Register a frontend callback for dentry attribute changes that libltfs makes on its own:
+ * data flushed by the I/O scheduler, times set through virtual extended attributes and
+ * revalidation. A frontend that lets the kernel cache attributes uses it to invalidate them.
+ * Changes made by the frontend's own requests are not reported.
+ * @param notify Callback, or NULL to unregister.
+ * @param priv Private data passed to the callback.
+ * @param vol LTFS volume.
+ */
+void ltfs_set_dentry_notify(ltfs_dentry_notify notify, void *priv, struct ltfs_volume *vol)
+{
+	if (vol) {
+		vol->dentry_notify_priv = priv;
+		vol->dentry_notify = notify;
+	}
+}
+
+/**
+ * Report a change to the attributes of a dentry through the registered callback.
+ * @param d Dentry whose attributes changed.
+ * @param vol LTFS volume.
+ */
+void ltfs_notify_dentry(struct dentry *d, struct ltfs_volume *vol)
+{
+	ltfs_dentry_notify notify = vol->dentry_notify;
+
+	if (notify)
+		notify(d, vol->dentry_notify_priv);
+}
+
+/**
+ * Report every referenced dentry below d as changed. Directories whose contents were not
+ * loaded from the index spill have no referenced children. Call with the volume write lock.
+ */
+static void _ltfs_notify_tree(struct dentry *d, struct ltfs_volume *vol)
+{
+	struct name_list *entry, *tmp;
+
+	if (d->numhandles)
+		ltfs_notify_dentry(d, vol);
+	if (! d->isdir || (d->spill && ! d->spill_loaded))
+		return;
+
+	HASH_ITER(hh, d->child_list, entry, tmp)
+		_ltfs_notify_tree(entry->d, vol);
+}
+
 /**
  * Set the index traversal mode. Used when looking for indexes.
  * @param mode Traversal mode, must be TRAVERSE_FORWARD or TRAVERSE_BACKWARD.
@@ -2360,6 +2642,20 @@ void ltfs_set_traverse_mode(int mode, struct ltfs_volume *vol)
 		vol->traverse_mode = mode;
 }
 
+/**
+ * Set whether index traversal reads only the header of each index. Callers that only need
+ * the generation, time and pointers of each index, such as rollback point listing, can skip
+ * building the directory tree and reading the rest of every index file.
+ * When enabled, vol->index holds no dentries besides the root in the traversal callbacks.
+ * @param use True to read only index headers.
+ * @param vol LTFS volume.
+ */
+void ltfs_set_traverse_header_only(bool use, struct ltfs_volume *vol)
+{
+	if (vol)
+		vol->traverse_header_only = use;
+}
+
 /**
  * Set a data placement policy override.
  * This should be run after ltfs_mount() but before issuing any file operations on the
@@ -2419,6 +2715,9 @@ size_t ltfs_max_cache_size(struct ltfs_volume *vol)
 	return vol->cache_size_max ? vol->cache_size_max : LTFS_MAX_CACHE_SIZE_DEFAULT;
 }
 
+static int _ltfs_write_index(char partition, char *reason, bool *shared_lock, struct ltfs_volume *vol);
+static int _ltfs_sync_index(char *reason, bool index_locking, struct ltfs_volume *vol);
+
 /**
  * Write an index file to the given partition.
  * This should only be called after a successful ltfs_mount or ltfs_format,
@@ -2431,7 +2730,28 @@ size_t ltfs_max_cache_size(struct ltfs_volume *vol)
  */
 int ltfs_write_index(char partition, char *reason, struct ltfs_volume *vol)
 {
-	int ret, ret_mam;
+	return _ltfs_write_index(partition, reason, NULL, vol);
+}
+
+/**
+ * Implementation of ltfs_write_index.
+ *
+ * When shared_lock is not NULL, the caller holds vol->lock for write and the tape device
+ * lock, and allows this function to downgrade vol->lock to a read lock once the index has
+ * been positioned and captured with ltfs_index_snapshot. The index is then serialized and
+ * written to tape from the snapshot while other operations proceed; their changes make the
+ * index dirty again and go into the next generation. Index writers are still excluded
+ * because they need vol->lock for write.
+ * @param partition partition in which the schema should be written to
+ * @param reason the reason to write down an index
+ * @param shared_lock On return, true if vol->lock was downgraded to a read lock.
+ *                    NULL to keep vol->lock untouched.
+ * @param vol LTFS volume
+ * @return 0 on success or a negative value on error
+ */
+static int _ltfs_write_index(char partition, char *reason, bool *shared_lock, struct ltfs_volume *vol)
+{
+	int ret, ret_mam, ret_snap;
 	struct tape_offset old_selfptr, old_backptr;
 	struct ltfs_timespec modtime_old = { .tv_sec = 0, .tv_nsec = 0 };
 	bool generation_inc = false;
@@ -2442,9 +2762,14 @@ int ltfs_write_index(char partition, char *reason, struct ltfs_volume *vol)
 	int volstat = -1, new_volstat = 0;
 	char *bc_print = NULL;
 	unsigned long long diff;
+	struct ltfs_index *snapshot = NULL;
+	char *creator;
 
 	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
 
+	if (shared_lock)
+		*shared_lock = false;
+
 	ret = tape_get_cart_volume_lock_status(vol->device, &volstat);
 	if (ret < 0) {
 		ltfsmsg(LTFS_ERR, 11342E, ret);
@@ -2620,8 +2945,31 @@ int ltfs_write_index(char partition, char *reason, struct ltfs_volume *vol)
 		goto out_write_perm;
 	}
 
+	/* Capture the index and release the exclusive volume lock before serializing it. If the
+	 * snapshot cannot be taken, write the live index under the exclusive lock as usual. */
+	if (shared_lock && ! dcache_initialized(vol)
+		&& ltfs_index_snapshot(vol->index, &snapshot) == 0) {
+		if (! vol->index->creator || strcmp(vol->creator, vol->index->creator)) {
+			creator = arch_strdup(vol->creator);
+			if (creator) {
+				if (vol->index->creator)
+					free(vol->index->creator);
+				vol->index->creator = creator;
+			} else
+				ltfsmsg(LTFS_ERR, 10001E, "ltfs_write_index: new creator string");
+		}
+		ltfs_unset_index_dirty(true, vol->index);
+		writetoread_mrsw(&vol->lock);
+		*shared_lock = true;
+	}
+
 	/* Actually write index to tape and disk if vol->index_cache_path is existed */
-	ret = xml_schema_to_tape(reason, vol);
+	ret = xml_schema_to_tape(reason, snapshot ? snapshot : vol->index, vol);
+	if (snapshot) {
+		ret_snap = ltfs_index_snapshot_free(&snapshot, ret == 0);
+		if (ret == 0 && ret_snap < 0)
+			ret = ret_snap;
+	}
 	if (ret < 0) {
 		ltfsmsg(LTFS_ERR, 11083E, ret);
 		if (generation_inc) {
@@ -2631,6 +2979,10 @@ int ltfs_write_index(char partition, char *reason, struct ltfs_volume *vol)
 		vol->index->backptr = old_backptr;
 		vol->index->selfptr = old_selfptr;
 
+		/* The index dirty flag was cleared when the snapshot was taken */
+		if (shared_lock && *shared_lock)
+			ltfs_set_index_dirty(true, false, vol->index);
+
 		if (IS_WRITE_PERM(-ret))
 			update_vollock = true;
 
@@ -2667,7 +3019,10 @@ int ltfs_write_index(char partition, char *reason, struct ltfs_volume *vol)
 		}
 	}
 
-	ltfs_unset_index_dirty(true, vol->index);
+	/* With a snapshot the index flags were cleared at capture time, and any dirty flag set
+	 * since then belongs to the next generation. */
+	if (! shared_lock || ! *shared_lock)
+		ltfs_unset_index_dirty(true, vol->index);
 
 out_write_perm:
 	if (write_perm) {
@@ -2717,18 +3072,7 @@ int ltfs_save_index_to_disk(const char *work_dir, char * reason, bool need_gen,
 
 	/* Write the schema to a file on disk */
 	ltfsmsg(LTFS_DEBUG, 17182D, vol->label->vol_uuid, vol->label->barcode);
-	if (need_gen) {
-		if (strcmp(vol->label->barcode, "      "))
-			ret = asprintf(&path, "%s/%s-%d.schema", work_dir, vol->label->barcode, vol->index->generation);
-		else
-			ret = asprintf(&path, "%s/%s-%d.schema", work_dir, vol->label->vol_uuid, vol->index->generation);
-	} else {
-		if (strcmp(vol->label->barcode, "      "))
-			ret = asprintf(&path, "%s/%s.schema", work_dir, vol->label->barcode);
-		else
-			ret = asprintf(&path, "%s/%s.schema", work_dir, vol->label->vol_uuid);
-	}
-
+	ret = _ltfs_index_file_path(work_dir, need_gen, &path, vol);
 	if (ret < 0) {
 		ltfsmsg(LTFS_ERR, 10001E, "ltfs_save_index_to_disk: path");
 		return -ENOMEM;
@@ -3258,19 +3602,20 @@ int ltfs_get_volume_lock(bool exclusive, struct ltfs_volume *vol)
 	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
 
 start:
-	ltfs_thread_mutex_lock(&vol->reval_lock);
-	while (vol->reval == -LTFS_REVAL_RUNNING) /* BEAM: infinite loop */
-		ltfs_thread_cond_wait(&vol->reval_cond, &vol->reval_lock);
-	ltfs_thread_mutex_unlock(&vol->reval_lock);
+	/* Only wait on reval_lock while a revalidation is actually running */
+	if (__atomic_load_n(&vol->reval, __ATOMIC_ACQUIRE) == -LTFS_REVAL_RUNNING) {
+		ltfs_thread_mutex_lock(&vol->reval_lock);
+		while (vol->reval == -LTFS_REVAL_RUNNING) /* BEAM: infinite loop */
+			ltfs_thread_cond_wait(&vol->reval_cond, &vol->reval_lock);
+		ltfs_thread_mutex_unlock(&vol->reval_lock);
+	}
 
 	if (exclusive)
 		acquirewrite_mrsw(&vol->lock);
 	else
 		acquireread_mrsw(&vol->lock);
 
-	ltfs_thread_mutex_lock(&vol->reval_lock);
-	ret = vol->reval;
-	ltfs_thread_mutex_unlock(&vol->reval_lock);
+	ret = __atomic_load_n(&vol->reval, __ATOMIC_ACQUIRE);
 
 	if (ret < 0)
 		release_mrsw(&vol->lock);
@@ -3540,6 +3885,11 @@ out:
 	vol->reval = ret < 0 ? -LTFS_REVAL_FAILED : 0;
 	ltfs_thread_cond_broadcast(&vol->reval_cond);
 	ltfs_thread_mutex_unlock(&vol->reval_lock);
+
+	/* The cartridge may have been changed behind our back; make frontends drop any
+	 * attributes they cached so they are fetched (or fail) against the revalidated volume */
+	if (vol->dentry_notify && vol->index && vol->index->root)
+		_ltfs_notify_tree(vol->index->root, vol);
 	releasewrite_mrsw(&vol->lock);
 
 	if (ret < 0) {
@@ -3551,21 +3901,128 @@ out:
 	return ret;
 }
 
+/**
+ * Add a reason to the comma separated list of reasons of a sync generation, unless it is
+ * already listed. Reasons which do not fit are left out. Call with the sync lock held.
+ */
+static void _ltfs_sync_add_reason(char *reasons, const char *reason)
+{
+	const char *pos = reasons;
+	size_t len = strlen(reasons), reason_len = strlen(reason);
+
+	while (*pos) {
+		if (! strncmp(pos, reason, reason_len) && (pos[reason_len] == ',' || pos[reason_len] == '\0'))
+			return;
+		pos = strchr(pos, ',');
+		if (! pos)
+			break;
+		pos += 2;
+	}
+
+	if (len + (len ? 2 : 0) + reason_len + 1 > LTFS_SYNC_REASONS_LEN)
+		return;
+	if (len)
+		strcat(reasons, ", ");
+	strcat(reasons, reason);
+}
+
+/**
+ * Close the open sync generation on behalf of the running leader, unless it is closed
+ * already. Callers which joined it made their changes before joining, so the caller must
+ * hold the volume lock in a mode which keeps those changes in the index it then checks
+ * or writes. Callers joining later wait for the next generation.
+ */
+static void _ltfs_sync_close_generation(struct ltfs_volume *vol)
+{
+	ltfs_thread_mutex_lock(&vol->sync_lock);
+	if (vol->sync_closed == vol->sync_completed) {
+		++vol->sync_closed;
+		vol->sync_covered = vol->sync_waiters;
+		memcpy(vol->sync_covered_reasons, vol->sync_reasons, LTFS_SYNC_REASONS_LEN);
+		vol->sync_waiters = 0;
+		vol->sync_reasons[0] = '\0';
+	}
+	ltfs_thread_mutex_unlock(&vol->sync_lock);
+}
+
 /**
  * Write index to tape if the index is dirty, and if there is space available
  * on the data partition.
- * @param vol LTFS volume
+ *
+ * Callers which take the volume lock here are grouped. A caller joins the generation
+ * which is open when it arrives. If no index write is running, it becomes the leader and
+ * writes one index for every caller of that generation, including callers which arrive
+ * while it waits for the volume lock; otherwise it waits for the running write, which
+ * covers it if its generation is still open. The leader logs the number of callers and
+ * their reasons. Callers which already hold the volume lock write the index on their own.
+ * @param reason Reason string recorded in the index
  * @param index_locking Take index lock while writing an index
- * @param type index type to write
  * @param vol LTFS volume
  * @return 0 on success or a negative value on error
  */
 int ltfs_sync_index(char *reason, bool index_locking, struct ltfs_volume *vol)
+{
+	int ret;
+	uint64_t gen;
+	uint32_t joined;
+	char reasons[LTFS_SYNC_REASONS_LEN];
+
+	/* The caller holds the volume lock, so a group leader could never take it */
+	if (! index_locking)
+		return _ltfs_sync_index(reason, false, vol);
+
+	ltfs_thread_mutex_lock(&vol->sync_lock);
+	gen = vol->sync_closed + 1;
+	++vol->sync_waiters;
+	_ltfs_sync_add_reason(vol->sync_reasons, reason);
+	while (vol->sync_completed < gen && vol->sync_running)
+		ltfs_thread_cond_wait(&vol->sync_cond, &vol->sync_lock);
+	if (vol->sync_completed >= gen) {
+		/* Another caller wrote an index which covers this one */
+		ret = vol->sync_result;
+		ltfs_thread_mutex_unlock(&vol->sync_lock);
+		return ret;
+	}
+
+	/* Lead generation gen, which _ltfs_sync_index() closes once it holds the volume lock */
+	vol->sync_running = true;
+	ltfs_thread_mutex_unlock(&vol->sync_lock);
+
+	ret = _ltfs_sync_index(reason, true, vol);
+
+	/* Callers still joined when the write failed early get its error */
+	_ltfs_sync_close_generation(vol);
+
+	ltfs_thread_mutex_lock(&vol->sync_lock);
+	joined = vol->sync_covered;
+	memcpy(reasons, vol->sync_covered_reasons, LTFS_SYNC_REASONS_LEN);
+	vol->sync_completed = vol->sync_closed;
+	vol->sync_result = ret;
+	vol->sync_running = false;
+	ltfs_thread_cond_broadcast(&vol->sync_cond);
+	ltfs_thread_mutex_unlock(&vol->sync_lock);
+
+	if (joined > 1)
+		ltfsmsg(LTFS_INFO, 17315I, joined, reasons, ret);
+
+	return ret;
+}
+
+/**
+ * Write index to tape if the index is dirty. Called by ltfs_sync_index() for each
+ * index write.
+ * @param reason Reason string recorded in the index
+ * @param index_locking Take index lock while writing an index
+ * @param vol LTFS volume
+ * @return 0 on success or a negative value on error
+ */
+static int _ltfs_sync_index(char *reason, bool index_locking, struct ltfs_volume *vol)
 {
 	int ret = 0, ret_r = 0;
 	bool dirty;
 	char partition;
 	bool dp_index_file_end, ip_index_file_end;
+	bool shared_lock = false;
 	char *bc_print = NULL;
 
 start:
@@ -3582,6 +4039,14 @@ start:
 	ltfs_mutex_lock(&vol->index->dirty_lock);
 	dirty = vol->index->dirty;
 	ltfs_mutex_unlock(&vol->index->dirty_lock);
+	if (index_locking && ! dirty) {
+		/* The callers grouped so far are covered by the index on the medium, unless one
+		 * of them changed the index after it was checked above */
+		_ltfs_sync_close_generation(vol);
+		ltfs_mutex_lock(&vol->index->dirty_lock);
+		dirty = vol->index->dirty;
+		ltfs_mutex_unlock(&vol->index->dirty_lock);
+	}
 	dp_index_file_end = vol->dp_index_file_end;
 	ip_index_file_end = vol->ip_index_file_end;
 
@@ -3606,6 +4071,10 @@ start:
 			ret = ltfs_get_volume_lock(true, vol);
 			if (ret < 0)
 				return ret;
+			/* The index written below holds the changes of every caller grouped so far */
+			_ltfs_sync_close_generation(vol);
+			/* Nothing else uses the dentry locks now: release the ones of idle dentries */
+			fs_release_idle_dentry_locks(vol);
 		}
 
 		/*
@@ -3622,8 +4091,25 @@ start:
 				releasewrite_mrsw(&vol->lock);
 			return ret;
 		}
-		ret = ltfs_write_index(partition, reason, vol);
+		ret = _ltfs_write_index(partition, reason, index_locking ? &shared_lock : NULL, vol);
 		if (IS_WRITE_PERM(-ret) && partition == ltfs_dp_id(vol)) {
+			if (shared_lock) {
+				/* The IP index below is written from the live index, so the volume lock
+				 * must be exclusive again. Keep the volume lock -> device lock order. */
+				tape_device_unlock(vol->device);
+				releaseread_mrsw(&vol->lock);
+				shared_lock = false;
+				ret_r = ltfs_get_volume_lock(true, vol);
+				if (ret_r < 0)
+					return ret_r;
+				ret_r = tape_device_lock(vol->device);
+				if (ret_r < 0) {
+					ltfsmsg(LTFS_ERR, 12010E, __FUNCTION__);
+					releasewrite_mrsw(&vol->lock);
+					return ret_r;
+				}
+			}
+
 			/*
 			 * TODO: Need to determine the last record on DP of the tape and cleanup
 			 *       all extents on the volume. Because this write perm have a chance
@@ -3649,15 +4135,19 @@ start:
 		}
 		tape_device_unlock(vol->device);
 
+		/* Dentries unlinked while the snapshot was written can go now */
+		if (index_locking)
+			index_snapshot_release_held(vol->index->snapshot);
+
 		if (IS_UNEXPECTED_MOVE(ret))
 			vol->reval = -LTFS_REVAL_FAILED;
 
 		if (index_locking && NEED_REVAL(ret)) {
-			ret = ltfs_revalidate(true, vol);
+			ret = ltfs_revalidate(! shared_lock, vol);
 			if (ret == 0)
 				goto start;
 		} else if (index_locking)
-			releasewrite_mrsw(&vol->lock);
+			release_mrsw(&vol->lock);
 		if (ret)
 			ltfsmsg(LTFS_ERR, 17069E);
 
@@ -3694,7 +4184,10 @@ int ltfs_traverse_index_no_eod(struct ltfs_volume *vol, char partition, unsigned
 	while (true) {
 		ltfs_index_free(&vol->index);
 		ltfs_index_alloc(&vol->index, vol);
-		ret = ltfs_read_index(0, false, vol);
+		if (vol->traverse_header_only)
+			ret = ltfs_read_index_header(0, vol);
+		else
+			ret = ltfs_read_index(0, false, vol);
 		if (ret < 0 && ret != -LTFS_UNSUPPORTED_INDEX_VERSION) {
 			ltfsmsg(LTFS_ERR, 17075E, 'N', (int)vol->device->position.block, partition);
 			return ret;
@@ -3777,7 +4270,10 @@ int ltfs_traverse_index_forward(struct ltfs_volume *vol, char partition, unsigne
 	while (last_index.block >= vol->device->position.block) {
 		ltfs_index_free(&vol->index);
 		ltfs_index_alloc(&vol->index, vol);
-		ret = ltfs_read_index(0, false, vol);
+		if (vol->traverse_header_only)
+			ret = ltfs_read_index_header(0, vol);
+		else
+			ret = ltfs_read_index(0, false, vol);
 		if (ret < 0 && ret != -LTFS_UNSUPPORTED_INDEX_VERSION) {
 			ltfsmsg(LTFS_ERR, 17075E, 'F', (int)vol->device->position.block, partition);
 			return ret;
@@ -3853,7 +4349,10 @@ int ltfs_traverse_index_backward(struct ltfs_volume *vol, char partition, unsign
 
 		ltfs_index_free(&vol->index);
 		ltfs_index_alloc(&vol->index, vol);
-		ret = ltfs_read_index(0, false, vol);
+		if (vol->traverse_header_only)
+			ret = ltfs_read_index_header(0, vol);
+		else
+			ret = ltfs_read_index(0, false, vol);
 		if (ret < 0 && ret != -LTFS_UNSUPPORTED_INDEX_VERSION) {
 			ltfsmsg(LTFS_ERR, 17075E, 'B', (int)vol->device->position.block, partition);
 			return ret;
@@ -4417,6 +4916,8 @@ int ltfs_profiler_set(uint64_t source, struct ltfs_volume *vol)
 			ret_save = ret;
 	}
 
+	lock_profile_enable(source & PROF_LOCK);
+
 	if (vol->device) {
 		if (source & PROF_DRIVER) {
 			ret = tape_set_profiler(vol->device, (char*)vol->work_directory, true);
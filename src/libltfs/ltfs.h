@@ -105,6 +105,7 @@ extern "C" {
 #include "libltfs/ltfs_locking.h"
 #include "libltfs/queue.h"
 #include "libltfs/uthash.h"
+#include "libltfs/index_spill.h"
 #include "libltfs/arch/time_internal.h"
 #include "libltfs/arch/ltfs_arch_ops.h"
 #include "tape_ops.h"
@@ -125,6 +126,12 @@ struct device_data;
 #define LTFS_MIN_CACHE_SIZE_DEFAULT   25 /* Default minimum cache size (MiB) */
 #define LTFS_MAX_CACHE_SIZE_DEFAULT   50 /* Default maximum cache size (MiB) */
 #define LTFS_SYNC_PERIOD_DEFAULT (5 * 60) /* default sync period (5 minutes) */
+#define LTFS_SYNC_DIRTY_ENTRIES_DEFAULT (100000) /* metadata updates that trigger a periodic sync */
+#define LTFS_SYNC_DIRTY_SIZE_DEFAULT (0)         /* MiB of unindexed data that trigger a periodic sync */
+#define LTFS_SYNC_COST_RATIO_DEFAULT (0)         /* time between periodic syncs per index write time */
+#define LTFS_SYNC_STREAM_DEFER_DEFAULT (60)      /* seconds a periodic sync may wait for streaming data */
+#define LTFS_SYNC_REASONS_LEN (128)              /* reasons of grouped syncs listed per index write */
+#define LTFS_CAPACITY_REFRESH_DEFAULT 60 /* default capacity refresh period for statfs (1 minute) */
 
 #define LTFS_NUM_PARTITIONS           2
 #define LTFS_FILENAME_MAX             255
@@ -210,6 +217,40 @@ struct device_data;
  * or a negative value on error. */
 typedef int (*ltfs_dir_filler) (void *buf, const char *name, void *priv);
 
+/* Callback prototype used to list directories through a cursor. 'offset' is the position just
+ * after this entry. The function must return 0 to continue, a positive value to stop without
+ * consuming the entry (e.g. the output buffer is full) or a negative value on error. */
+typedef int (*ltfs_dir_cursor_filler) (void *buf, const char *name, uint64_t offset, void *priv);
+
+/* Callback prototype used to list directories with attributes, see ltfs_fsops_readdir_plus.
+ * 'attr' holds the attributes of the entry, or is NULL when they could not be taken during the
+ * listing; the caller must then get them separately. Return values are as for
+ * ltfs_dir_cursor_filler. */
+typedef int (*ltfs_dir_plus_filler) (void *buf, const char *name, uint64_t offset,
+	const struct dentry_attr *attr, void *priv);
+
+/* Callback prototype used to gather write data from a caller-defined source (e.g. a FUSE
+ * buffer vector backed by a pipe). It copies 'size' bytes starting at byte 'pos' of the source
+ * into 'dst'; 'pos' always advances contiguously from 0, so the source may be consumed
+ * sequentially. The function must return the number of bytes copied or a negative value
+ * on error. */
+typedef ssize_t (*ltfs_write_source) (char *dst, size_t size, size_t pos, void *src);
+
+/* Callback prototype used to tell a frontend that the attributes of a dentry changed outside
+ * of a request from that frontend, see ltfs_set_dentry_notify. It may be invoked with volume
+ * and dentry locks held, so it must not block or call back into libltfs. */
+typedef void (*ltfs_dentry_notify) (struct dentry *d, void *priv);
+
+/**
+ * Position in a directory listing, see ltfs_fsops_readdir_cursor.
+ * Zero-initialize it before the first call.
+ */
+struct ltfs_dir_cursor {
+	uint64_t offset;           /**< Offset just after 'last' */
+	struct name_list *last;    /**< Last entry listed. Only valid while 'removals' matches the directory */
+	uint32_t removals;         /**< Directory's child_removals count when 'last' was saved */
+};
+
 /**
  * All capacities are relative to filesystem block size.
  */
@@ -264,6 +305,7 @@ struct xattr_info {
 	struct ltfs_name key;
 	char             *value;
 	size_t           size;
+	uint32_t         hash;  /**< Hash of the key name, set by fs_add_xattr */
 };
 
 /**
@@ -276,47 +318,55 @@ struct name_list {
 	UT_hash_handle  hh;
 };
 
-struct dentry {
-	/* When more than one of these locks is needed, take them in the order of
-	 * iosched_lock, contents_lock, meta_lock. If the tape device lock is needed, take it
-	 * before meta_lock. If locks are needed on a dentry's parent, take all parent locks before
-	 * any dentry locks. */
+/**
+ * Locks of a dentry. Most dentries of a large index are never locked, so these are allocated
+ * the first time a dentry is locked (see fs_dentry_locks()) instead of being embedded in it,
+ * and released again when the dentry is idle (see fs_release_idle_dentry_locks()).
+ * When more than one of these locks is needed, take them in the order of
+ * iosched_lock, contents_lock, meta_lock. If the tape device lock is needed, take it
+ * before meta_lock. If locks are needed on a dentry's parent, take all parent locks before
+ * any dentry locks.
+ */
+struct dentry_locks {
 	MultiReaderSingleWriter contents_lock;      /**< Lock for 'extentlist' and 'list' */
 	MultiReaderSingleWriter meta_lock;          /**< Lock for metadata */
 	ltfs_mutex_t iosched_lock;                      /**< Lock for use by the I/O scheduler */
+	uint64_t iosched_hold_start;                /**< Time iosched_lock was taken, for the lock profiler */
+	/* Take the dentry locks mutex in fs.c before accessing these fields. */
+	struct dentry *owner;                       /**< Dentry these locks belong to */
+	TAILQ_ENTRY(dentry_locks) list;             /**< Entry in the list of allocated locks */
+	bool keep;                                  /**< Used by fs_release_idle_dentry_locks() */
+};
 
+/* The fields are grouped by the lock which protects them, and the groups are ordered so that
+ * the ones used by lookups and getattr come first. */
+struct dentry {
 	/* Immutable fields. No locks are needed to access these. */
 	ino_t               ino;         /**< Per-session inode number, unique across all LTFS volumes in this process */
 	uint64_t            uid;         /**< Persistent unique id. In single drive mode, this id is also used as inode number. */
+	struct ltfs_volume  *vol;        /**< Volume to which this dentry belongs */
 	bool                isdir;       /**< True if this is a directory, false if it's a file */
 	bool                isslink;     /**< True if this is a symlink, false if it's a file or directory */
-	struct ltfs_name    target;      /**< Target name of symbolic link */
 	bool                out_of_sync; /**< This object was failed to sync */
-	TAILQ_ENTRY(dentry) list;        /**< To be tail q entry to manage out of sync dentry list */
-	struct ltfs_volume  *vol;        /**< Volume to which this dentry belongs */
-	size_t              tag_count;   /**< Number of unknown tags */
-	unsigned char       **preserved_tags; /**< Unknown tags to be preserved on tape */
 
-	/* Take the contents_lock before accessing these fields. */
-	TAILQ_HEAD(extent_struct, extent_info) extentlist; /**< List of extents (file only) */
+	/* Set once by fs_dentry_locks(). Use that function instead of reading this field. */
+	struct dentry_locks *locks;      /**< Locks of this dentry, or NULL if it was never locked */
+
+	/* Take the meta_lock and parent's contents_lock before writing to these fields.
+	 * Take either of those locks before reading these fields. */
+	struct ltfs_name name;                /**< File or directory name */
+	char             *platform_safe_name; /**< File or directory name after file name mangling */
+	struct dentry    *parent;             /**< Pointer to parent dentry */
 
 	/* Take the contents_lock and the meta_lock before writing to these fields. Take either of
 	 * those locks before reading these fields. */
 	uint64_t realsize;      /**< Size, not counting sparse tail */
 	uint64_t size;          /**< File size (logical EOF position) */
-	bool     extents_dirty; /**< Dirty flag of extents */
 	uint64_t used_blocks;   /**< number of used block on tape */
+	bool     extents_dirty; /**< Dirty flag of extents */
 	bool     dirty;         /**< Dirty flag of the file will clear when this dentry written to sync file list */
 
-	/* Take the meta_lock and parent's contents_lock before writing to these fields.
-	 * Take either of those locks before reading these fields. */
-	struct ltfs_name name;                /**< File or directory name */
-	char             *platform_safe_name; /**< File or directory name after file name mangling */
-	struct dentry    *parent;             /**< Pointer to parent dentry */
-
 	/* Take the meta_lock before accessing these fields. */
-	TAILQ_HEAD(xattr_struct, xattr_info) xattrlist;  /**< List of extended attributes */
-	bool     readonly;             /**< True if file is marked read-only */
 	struct ltfs_timespec creation_time; /**< Time of creation */
 	struct ltfs_timespec modify_time;   /**< Time of last modification */
 	struct ltfs_timespec access_time;   /**< Time of last access */
@@ -324,19 +374,71 @@ struct dentry {
 	struct ltfs_timespec backup_time;   /**< Time of last backup */
 	uint32_t numhandles;           /**< Reference count */
 	uint32_t link_count;           /**< Number of file system links to this dentry */
+	bool     readonly;             /**< True if file is marked read-only */
 	bool     deleted;              /**< True if dentry is unlinked from the file system */
 	bool matches_name_criteria;    /**< True if file name matches the name criteria rules */
-	void *dentry_proxy;            /**< dentry proxy corresponding to this dentry */
+	bool name_criteria_checked;    /**< True if matches_name_criteria is valid for the current name */
 	bool need_update_time;         /**< True if write api has come from Windows side */
 	bool is_immutable;             /**< True if dentry is set to Immutable */
 	bool is_appendonly;            /**< True if dentry is set to Append Only */
+	TAILQ_HEAD(xattr_struct, xattr_info) xattrlist;  /**< List of extended attributes */
+	struct xattr_index *xattr_index; /**< Name index of xattrlist, NULL while the list is short */
+	uint32_t xattr_count;          /**< Number of entries in xattrlist */
+	void *dentry_proxy;            /**< dentry proxy corresponding to this dentry */
+
+	/* Take the contents_lock before accessing these fields. */
+	TAILQ_HEAD(extent_struct, extent_info) extentlist; /**< List of extents (file only) */
+	struct extent_pack *extent_pack; /**< Packed extents, used instead of extentlist if not NULL */
+	struct name_list *child_list;  /* for hash search */
 
 	/* Take the iosched_lock before accessing iosched_priv. */
 	void *iosched_priv;            /**< I/O scheduler private data. */
 
-	struct name_list *child_list;  /* for hash search */
+	/* Rarely used immutable fields. No locks are needed to access these. */
+	struct ltfs_name    target;      /**< Target name of symbolic link */
+	TAILQ_ENTRY(dentry) list;        /**< To be tail q entry to manage out of sync dentry list */
+	size_t              tag_count;   /**< Number of unknown tags */
+	unsigned char       **preserved_tags; /**< Unknown tags to be preserved on tape */
+
+	/* Set before the dentry is published. The spill_loaded flag is changed only under the
+	 * index spill lock. */
+	struct index_spill_slot *spill; /**< Spill slot holding the contents of this directory, or NULL */
+	bool spill_loaded;             /**< True if the contents in 'spill' have been loaded into child_list */
+
+	/* Changed only by the dentry cache, under its own lock. dcache_evicted is read atomically. */
+	bool dcache_evicted;           /**< True if the children are kept in the dentry cache only */
+	void *dcache_priv;             /**< Dentry cache state of a directory whose children are loaded */
+
+	/* Set by index_snapshot_preserve() and never cleared. Accessed atomically. */
+	bool changed;                  /**< A field written to the index changed since the dentry was read */
+
+	/* Accessed atomically. */
+	uint32_t path_cached;          /**< Path cache entries referring to this dentry, see path_cache_forget() */
+
+	/* Take the contents_lock before accessing this field. */
+	uint32_t child_removals;       /**< Bumped whenever an entry leaves child_list, see ltfs_dir_cursor */
+
+	/* Take the index snapshot stripe lock of this dentry before accessing these fields. */
+	uint32_t snapshot_gen;         /**< Last snapshot which read or copied this dentry */
+	uint32_t snapshot_changed;     /**< Last snapshot during which this dentry changed */
+	struct dentry *snapshot_copy;  /**< Copy taken for snapshot_gen, or NULL if read in place */
+	struct dentry *snapshot_next;  /**< Next entry in a list of the index snapshot */
 };
 
+struct dentry_locks *fs_allocate_dentry_locks(struct dentry *d);
+
+/**
+ * Return the locks of a dentry, allocating them the first time the dentry is locked.
+ * This never returns NULL: when memory is exhausted it falls back to a spare block, or waits
+ * for one to be released (see fs_allocate_dentry_locks()). Use fs_prepare_dentry_locks() first
+ * where an allocation failure can be reported instead.
+ */
+static inline struct dentry_locks *fs_dentry_locks(struct dentry *d)
+{
+	struct dentry_locks *locks = __atomic_load_n(&d->locks, __ATOMIC_ACQUIRE);
+	return locks ? locks : fs_allocate_dentry_locks(d);
+}
+
 struct tape_attr {
 	char vender[TC_MAM_APP_VENDER_SIZE + 1];
 	char app_name[TC_MAM_APP_NAME_SIZE + 1];
@@ -414,7 +516,11 @@ struct ltfs_volume {
 	bool dp_index_file_end;            /**< Does the data partition end in an index file? */
 	enum volume_mount_type mount_type; /**< Mount type defined by enum */
 	int  traverse_mode;                /**< Traverse strategy (rollback, list index, rollback mount) */
+	bool traverse_header_only;         /**< Read only index headers while traversing indexes? */
 	bool skip_eod_check;               /**< Skip EOD existance check? */
+	bool cached_index_mount;           /**< Try the index saved in the work directory at mount? */
+	bool lazy_index;                   /**< Load directory contents from an index spill on first use? */
+	uint64_t lazy_index_limit;         /**< Spilled dentries kept in memory before eviction, 0 for no limit */
 	bool ignore_wrong_version;         /**< Ignore wrong index version while seeking index? */
 
 	/* A 1-block read cache, used to prevent reading the same block from tape over and over.
@@ -423,10 +529,14 @@ struct ltfs_volume {
 	unsigned long last_size;       /**< Size of last block read from the tape. */
 	char *last_block;              /**< Contents of last block read from the tape. */
 
-	/* Caches of cartridge health and capacity data. Take the device lock before using these. */
+	/* Caches of cartridge health and capacity data. Take the device lock before using the
+	 * health cache. The capacity cache is read and updated with atomic operations so
+	 * statfs never waits for the device, see ltfs_capacity_data_cached. */
 	cartridge_health_info health_cache;
 	uint64_t              tape_alert;
 	struct device_capacity capacity_cache;
+	uint64_t capacity_stamp;       /**< Time (sec) capacity_cache was last read from the device, 0 if never */
+	void *capacity_refresh_handle; /**< Handle to the background capacity refresh state */
 
 	/* User-controlled parameters */
 	char *creator;                 /**< Creator string to use when writing labels, index files */
@@ -442,6 +552,21 @@ struct ltfs_volume {
 	ltfs_thread_mutex_t reval_lock;
 	ltfs_thread_cond_t  reval_cond;
 	int reval;                     /**< One of 0, -LTFS_REVAL_RUNNING, -LTFS_REVAL_FAILED */
+
+	/* Group commit of index syncs. Generations are numbered from 1, and callers join the
+	 * open generation sync_closed + 1. One leader at a time writes an index; it closes the
+	 * open generation once the changes of every caller which joined it are in the index
+	 * it is about to write, and later callers wait for the next generation. */
+	ltfs_thread_mutex_t sync_lock;
+	ltfs_thread_cond_t  sync_cond;
+	bool sync_running;             /**< True while a leader is writing an index */
+	uint64_t sync_closed;          /**< Last generation closed to new callers */
+	uint64_t sync_completed;       /**< Last generation whose index write has finished */
+	int sync_result;               /**< Result of generation sync_completed */
+	uint32_t sync_waiters;         /**< Callers which joined the open generation */
+	char sync_reasons[LTFS_SYNC_REASONS_LEN]; /**< Distinct reasons of those callers */
+	uint32_t sync_covered;         /**< Callers which joined the generation being written */
+	char sync_covered_reasons[LTFS_SYNC_REASONS_LEN]; /**< Distinct reasons of those callers */
 	bool append_only_mode;         /**< Use append-only mode */
 	bool set_pew;                  /**< Set PEW value */
 
@@ -455,6 +580,9 @@ struct ltfs_volume {
 
 	const char *work_directory;
 
+	/* Frontend hook for dentry changes made outside of its requests */
+	ltfs_dentry_notify dentry_notify;  /**< Callback, or NULL if nobody listens */
+	void *dentry_notify_priv;          /**< Private data passed to dentry_notify */
 };
 
 struct ltfs_label {
@@ -486,11 +614,14 @@ struct ltfs_label {
  * LTFS and all files go straight to the data partition. The index partition only use
  * in this case is to store indices.
  */
+struct index_criteria_dfa;
+
 struct index_criteria {
 	bool             have_criteria;         /**< Does this struct actually specify criteria? */
 	uint64_t         max_filesize_criteria; /**< Maximum file size that goes into the index partition */
 	struct ltfs_name *glob_patterns;       /**< NULL-terminated list of file name criteria */
 	UChar            **glob_cache;          /**< Cache of glob patterns in comparison-ready form */
+	struct index_criteria_dfa *glob_dfa;    /**< Automaton matching ASCII names against all patterns */
 };
 
 struct ltfs_index {
@@ -515,6 +646,8 @@ struct ltfs_index {
 	bool dirty;                         /**< Set on metadata update, cleared on write to tape */
 	bool atime_dirty;                   /**< Set on atime update, cleared on write to tape */
 	bool use_atime;                     /**< Set if atime updates should make the index dirty */
+	uint64_t dirty_entries;             /**< Metadata updates since the last write to tape (atomic) */
+	uint64_t dirty_bytes;               /**< File data written since the last write to tape (atomic) */
 	uint64_t file_count;                /**< Number of files in the file system */
 	uint64_t uid_number;                /**< File/directory's most recently reserved uid number */
 	uint64_t valid_blocks;              /**< Numbert of valid blocks on tape */
@@ -529,6 +662,10 @@ struct ltfs_index {
 	unsigned char **preserved_tags;     /**< Unrecognized tags, will be preserved when writing tape */
 	size_t symerr_count;                /**< Number of conflicted symlink dentries */
 	struct dentry **symlink_conflict;   /**< symlink/extent conflicted dentries */
+	struct index_spill *spill;          /**< Spill file of the directory contents not loaded yet, or NULL */
+	struct path_cache *path_cache;      /**< Recent fs_path_lookup results, or NULL */
+	struct index_snapshot *snapshot;    /**< Copy-on-write state of the dentry tree */
+	bool is_snapshot;                   /**< True in the index copies made by ltfs_index_snapshot */
 
 	mam_lockval vollock;                /**< volume lock status on index */
 };
@@ -629,6 +766,8 @@ void _ltfs_volume_free(bool force, struct ltfs_volume **volume);
 
 int ltfs_capacity_data(struct device_capacity *cap, struct ltfs_volume *vol);
 int ltfs_capacity_data_unlocked(struct device_capacity *cap, struct ltfs_volume *vol);
+int ltfs_capacity_data_cached(struct device_capacity *cap, struct ltfs_volume *vol);
+void ltfs_capacity_consumed(char partition, uint64_t blocks, bool no_space, struct ltfs_volume *vol);
 unsigned long ltfs_get_blocksize(struct ltfs_volume *vol);
 bool ltfs_get_compression(struct ltfs_volume *vol);
 struct ltfs_timespec ltfs_get_format_time(struct ltfs_volume *vol);
@@ -676,7 +815,12 @@ int ltfs_revalidate(bool reacquire, struct ltfs_volume *vol);
 void ltfs_use_atime(bool use_atime, struct ltfs_volume *vol);
 void ltfs_set_work_dir(const char *dir, struct ltfs_volume *vol);
 void ltfs_set_eod_check(bool use, struct ltfs_volume *vol);
+void ltfs_set_cached_index_mount(bool use, struct ltfs_volume *vol);
+void ltfs_set_lazy_index(bool use, uint64_t limit, struct ltfs_volume *vol);
+void ltfs_set_dentry_notify(ltfs_dentry_notify notify, void *priv, struct ltfs_volume *vol);
+void ltfs_notify_dentry(struct dentry *d, struct ltfs_volume *vol);
 void ltfs_set_traverse_mode(int mode, struct ltfs_volume *vol);
+void ltfs_set_traverse_header_only(bool use, struct ltfs_volume *vol);
 int ltfs_override_policy(const char *rules, bool permanent, struct ltfs_volume *vol);
 int ltfs_set_scheduler_cache(size_t min_size, size_t max_size, struct ltfs_volume *vol);
 size_t ltfs_min_cache_size(struct ltfs_volume *vol);
@@ -66,6 +66,8 @@
 #include "dcache.h"
 #include "pathname.h"
 #include "index_criteria.h"
+#include "path_cache.h"
+#include "index_snapshot.h"
 #include "arch/time_internal.h"
 
 int ltfs_fsops_open(const char *path, bool open_write, bool use_iosched, struct dentry **d,
@@ -186,10 +188,11 @@ int ltfs_fsops_close(struct dentry *d, bool dirty, bool open_write, bool use_ios
 	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
 
 	if (d->need_update_time) {
-		acquirewrite_mrsw(&d->meta_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+		index_snapshot_preserve(d);
 		get_current_timespec(&d->modify_time);
 		d->change_time = d->modify_time;
-		releasewrite_mrsw(&d->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 		d->need_update_time = false;
 	}
 
@@ -213,6 +216,127 @@ int ltfs_fsops_close(struct dentry *d, bool dirty, bool open_write, bool use_ios
 	return ret;
 }
 
+int ltfs_fsops_lookup(struct dentry *parent, const char *name, struct dentry **d,
+	struct ltfs_volume *vol)
+{
+	int ret;
+	char *name_norm;
+	struct dentry *dtmp = NULL;
+
+	CHECK_ARG_NULL(parent, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
+
+	/* Cached dentries are only referenced while open */
+	if (dcache_initialized(vol))
+		return -LTFS_UNSUPPORTED;
+	if (! parent->isdir)
+		return -LTFS_ISFILE;
+
+	/* Validate and normalize the name */
+	ret = pathname_format(name, &name_norm, true, false);
+	if (ret < 0) {
+		if (ret != -LTFS_INVALID_PATH && ret != -LTFS_NAMETOOLONG)
+			ltfsmsg(LTFS_ERR, 17308E, ret);
+		return ret;
+	}
+
+	ret = ltfs_get_volume_lock(false, vol);
+	if (ret < 0) {
+		free(name_norm);
+		return ret;
+	}
+
+	acquireread_mrsw(&fs_dentry_locks(parent)->contents_lock);
+	ret = fs_directory_lookup(parent, name_norm, &dtmp);
+	releaseread_mrsw(&fs_dentry_locks(parent)->contents_lock);
+
+	releaseread_mrsw(&vol->lock);
+	free(name_norm);
+
+	if (ret == 0 && ! dtmp)
+		ret = -LTFS_NO_DENTRY;
+	if (ret == 0)
+		*d = dtmp;
+	return ret;
+}
+
+int ltfs_fsops_open_dentry(struct dentry *d, bool open_write, struct ltfs_volume *vol)
+{
+	int ret;
+
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
+
+	if (dcache_initialized(vol))
+		return -LTFS_UNSUPPORTED;
+
+	if (open_write) {
+		ret = ltfs_get_tape_readonly(vol);
+		if (ret < 0 && ret != -LTFS_LESS_SPACE)
+			return ret;
+		if (d->isslink)
+			return -LTFS_RDONLY_VOLUME;
+	}
+
+	ret = ltfs_get_volume_lock(false, vol);
+	if (ret < 0)
+		return ret;
+
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	++d->numhandles;
+	if (open_write && ! d->isdir) {
+		uint64_t max_filesize = index_criteria_get_max_filesize(vol);
+		if (! d->name_criteria_checked && max_filesize > 0 && d->size <= max_filesize) {
+			d->matches_name_criteria = index_criteria_match(d, vol);
+			d->name_criteria_checked = true;
+		}
+	}
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+
+	releaseread_mrsw(&vol->lock);
+	vol->file_open_count ++;
+	return 0;
+}
+
+void ltfs_fsops_forget(struct dentry *d, uint64_t count)
+{
+	if (! d || ! count)
+		return;
+
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	if (d->numhandles > count) {
+		d->numhandles -= count;
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+		return;
+	}
+
+	/* Dropping the last reference disposes of an unlinked dentry */
+	d->numhandles -= count - 1;
+	fs_release_dentry_unlocked(d);
+}
+
+int ltfs_fsops_parent_uid(struct dentry *d, uint64_t *uid, struct ltfs_volume *vol)
+{
+	int ret;
+
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(uid, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
+
+	ret = ltfs_get_volume_lock(false, vol);
+	if (ret < 0)
+		return ret;
+	/* The parent pointer only changes under the meta_lock, and UIDs never change */
+	acquireread_mrsw(&fs_dentry_locks(d)->meta_lock);
+	*uid = d->parent ? d->parent->uid : d->uid;
+	releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
+	releaseread_mrsw(&vol->lock);
+
+	return 0;
+}
+
 int ltfs_fsops_update_used_blocks(struct dentry *d, struct ltfs_volume *vol)
 {
 	int ret;
@@ -222,13 +346,14 @@ int ltfs_fsops_update_used_blocks(struct dentry *d, struct ltfs_volume *vol)
 	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
 	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
 
-	acquireread_mrsw(&d->contents_lock);
-	acquirewrite_mrsw(&d->meta_lock);
+	acquireread_mrsw(&fs_dentry_locks(d)->contents_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	index_snapshot_preserve(d);
 	used_save = d->used_blocks;
 	d->used_blocks = fs_get_used_blocks(d);
 	used_diff = d->used_blocks - used_save;
-	releasewrite_mrsw(&d->meta_lock);
-	releaseread_mrsw(&d->contents_lock);
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	releaseread_mrsw(&fs_dentry_locks(d)->contents_lock);
 
 	ret = ltfs_update_valid_block_count(vol, used_diff);
 
@@ -307,7 +432,7 @@ int ltfs_fsops_create(const char *path, bool isdir, bool readonly, bool overwrit
 			ltfsmsg(LTFS_ERR, 11049E, ret);
 		goto out_dispose;
 	} else if (d) {
-		releasewrite_mrsw(&parent->contents_lock);
+		releasewrite_mrsw(&fs_dentry_locks(parent)->contents_lock);
 		if (dcache_initialized(vol))
 			dcache_close(d, true, false, vol);
 		else
@@ -325,8 +450,9 @@ int ltfs_fsops_create(const char *path, bool isdir, bool readonly, bool overwrit
 		goto out_dispose;
 	}
 
-	acquirewrite_mrsw(&parent->meta_lock);
-	acquirewrite_mrsw(&d->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(parent)->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	index_snapshot_preserve(parent);
 
 	/* Set times */
 	get_current_timespec(&d->creation_time);
@@ -338,8 +464,10 @@ int ltfs_fsops_create(const char *path, bool isdir, bool readonly, bool overwrit
 	parent->change_time = d->creation_time;
 
 	/* Decide whether to write to IP */
-	if (! isdir && index_criteria_get_max_filesize(vol))
+	if (! isdir && index_criteria_get_max_filesize(vol)) {
 		d->matches_name_criteria = index_criteria_match(d, vol);
+		d->name_criteria_checked = true;
+	}
 
 	/* Set up reference counters and pointers */
 	d->vol = vol;
@@ -355,13 +483,17 @@ int ltfs_fsops_create(const char *path, bool isdir, bool readonly, bool overwrit
 	d->parent->child_list = fs_add_key_to_hash_table(d->parent->child_list, d, &ret);
 	if (ret != 0) {
 		ltfsmsg(LTFS_ERR, 11319E, "ltfs_fsops_create", ret);
-		releasewrite_mrsw(&d->meta_lock);
-		releasewrite_mrsw(&parent->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(parent)->meta_lock);
 		goto out_dispose;
 	}
 
-	releasewrite_mrsw(&d->meta_lock);
-	releasewrite_mrsw(&parent->meta_lock);
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	releasewrite_mrsw(&fs_dentry_locks(parent)->meta_lock);
+
+	/* Drop the negative entry of the new path. Undo fs_split_path to get the path back. */
+	filename[-1] = '/';
+	path_cache_invalidate(vol->index->path_cache, path_norm, false);
 
 	ltfs_mutex_lock(&vol->index->dirty_lock);
 	if (! isdir)
@@ -375,7 +507,7 @@ int ltfs_fsops_create(const char *path, bool isdir, bool readonly, bool overwrit
 	ret = 0;
 
 out_dispose:
-	releasewrite_mrsw(&parent->contents_lock);
+	releasewrite_mrsw(&fs_dentry_locks(parent)->contents_lock);
 	if (ret == 0 && dcache_initialized(vol)) {
 		ret = dcache_create(dentry_path, d, vol);
 		if (ret < 0) {
@@ -473,17 +605,17 @@ int ltfs_fsops_unlink(const char *path, ltfs_file_id *id, struct ltfs_volume *vo
 
 	/* Can't remove non-empty directories */
 	if (d->isdir) {
-		ret = 0;
-		acquireread_mrsw(&d->contents_lock);
-		if (HASH_COUNT(d->child_list) != 0)
+		acquireread_mrsw(&fs_dentry_locks(d)->contents_lock);
+		ret = index_spill_load(d, true);
+		if (ret == 0 && HASH_COUNT(d->child_list) != 0)
 			ret = -LTFS_DIRNOTEMPTY;
-		releaseread_mrsw(&d->contents_lock);
+		releaseread_mrsw(&fs_dentry_locks(d)->contents_lock);
 		if (ret < 0)
 			goto out;
 	}
 
-	acquirewrite_mrsw(&parent->meta_lock);
-	acquirewrite_mrsw(&d->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(parent)->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 	if (dcache_initialized(vol)) {
 		/*
@@ -492,23 +624,25 @@ int ltfs_fsops_unlink(const char *path, ltfs_file_id *id, struct ltfs_volume *vo
 		 */
 		ret = dcache_unlink(path_norm, d, vol);
 		if (ret < 0) {
-			releasewrite_mrsw(&d->meta_lock);
+			releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 			goto out;
 		}
 	}
 
+	index_snapshot_preserve(parent);
 	get_current_timespec(&parent->modify_time);
 	parent->change_time = parent->modify_time;
 
 	namelist = fs_find_key_from_hash_table(parent->child_list, d->platform_safe_name, &ret);
 	if (namelist) {
 		HASH_DEL(parent->child_list, namelist);
+		++parent->child_removals;
 		free(namelist->name);
 		free(namelist);
 	}
 	else {
 		ltfsmsg(LTFS_ERR, 11320E, "ltfs_fsops_unlink", ret);
-		releasewrite_mrsw(&d->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 		goto out;
 	}
 	id->uid = d->uid;
@@ -518,8 +652,9 @@ int ltfs_fsops_unlink(const char *path, ltfs_file_id *id, struct ltfs_volume *vo
 	--d->link_count;
 	if (d->isdir)
 		--parent->link_count;
-	--d->numhandles;
-	releasewrite_mrsw(&d->meta_lock);
+	if (! index_snapshot_hold(d))
+		--d->numhandles;
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 	ltfs_mutex_lock(&vol->index->dirty_lock);
 	if (! d->isdir)
@@ -530,9 +665,12 @@ int ltfs_fsops_unlink(const char *path, ltfs_file_id *id, struct ltfs_volume *vo
 	ltfs_update_valid_block_count_unlocked(vol, -1 * (int64_t)d->used_blocks);
 
 out:
-	releasewrite_mrsw(&parent->contents_lock);
+	releasewrite_mrsw(&fs_dentry_locks(parent)->contents_lock);
 	fs_release_dentry_unlocked(parent); /* parent->meta_lock is released here */
 
+	if (ret == 0)
+		path_cache_invalidate(vol->index->path_cache, path_norm, false);
+
 	releaseread_mrsw(&vol->lock);
 
 	if (ret == 0 && iosched_initialized(vol))
@@ -615,14 +753,6 @@ int ltfs_fsops_rename(const char *from, const char *to, ltfs_file_id *id, struct
 		goto out_free;
 	ltfs_mutex_lock(&vol->index->rename_lock);
 
-	if (dcache_initialized(vol)) {
-		/* Rename the cached files */
-		ret = dcache_rename(from_norm_copy, to_norm_copy, &fromdentry, vol);
-		if (ret == 0)
-			ltfs_set_index_dirty(true, false, vol->index);
-		goto out_release;
-	}
-
 	/* Look up directories and lock them */
 	ret = fs_path_lookup(from_norm, 0, &fromdir, vol->index);
 	if (ret < 0) {
@@ -636,32 +766,32 @@ int ltfs_fsops_rename(const char *from, const char *to, ltfs_file_id *id, struct
 		if (ret != -LTFS_NO_DENTRY && ret != -LTFS_NAMETOOLONG)
 			ltfsmsg(LTFS_ERR, 11057E, ret);
 		/* fromdir meta_lock is needed because the exit code calls fs_release_dentry_unlocked */
-		acquirewrite_mrsw(&fromdir->meta_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(fromdir)->meta_lock);
 		goto out_release;
 	}
 
 	if (fromdir->is_appendonly || fromdir->is_immutable ) {
 		ltfsmsg(LTFS_ERR, 17237E, "rename: parent is WORM");
 		ret = -LTFS_WORM_ENABLED;
-		acquirewrite_mrsw(&fromdir->meta_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(fromdir)->meta_lock);
 		goto out_release;
 	}
 	if (todir->is_immutable || todir->is_appendonly) {
 		ltfsmsg(LTFS_ERR, 17237E, "rename: target dir is WORM");
 		ret = -LTFS_WORM_ENABLED;
-		acquirewrite_mrsw(&fromdir->meta_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(fromdir)->meta_lock);
 		goto out_release;
 	}
 
 	/* Take locks in the appropriate order and look up the source and destination dentries */
 	if (todir == fromdir || fs_is_predecessor(todir, fromdir)) {
-		acquirewrite_mrsw(&todir->contents_lock);
-		acquirewrite_mrsw(&todir->meta_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(todir)->contents_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(todir)->meta_lock);
 
 		ret = fs_directory_lookup(todir, to_filename, &todentry);
 		if (fromdir != todir) {
-			acquirewrite_mrsw(&fromdir->contents_lock);
-			acquirewrite_mrsw(&fromdir->meta_lock);
+			acquirewrite_mrsw(&fs_dentry_locks(fromdir)->contents_lock);
+			acquirewrite_mrsw(&fs_dentry_locks(fromdir)->meta_lock);
 		}
 		if (ret < 0) {
 			if (ret != -LTFS_NAMETOOLONG)
@@ -684,12 +814,12 @@ int ltfs_fsops_rename(const char *from, const char *to, ltfs_file_id *id, struct
 			goto out_unlock;
 		}
 	} else {
-		acquirewrite_mrsw(&fromdir->contents_lock);
-		acquirewrite_mrsw(&fromdir->meta_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(fromdir)->contents_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(fromdir)->meta_lock);
 
 		ret = fs_directory_lookup(fromdir, from_filename, &fromdentry);
-		acquirewrite_mrsw(&todir->contents_lock);
-		acquirewrite_mrsw(&todir->meta_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(todir)->contents_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(todir)->meta_lock);
 		if (ret < 0) {
 			if (ret != -LTFS_NAMETOOLONG)
 				ltfsmsg(LTFS_ERR, 11056E, ret);
@@ -774,25 +904,42 @@ int ltfs_fsops_rename(const char *from, const char *to, ltfs_file_id *id, struct
 		goto out_unlock;
 	}
 
+	/* Let the dentry cache record the new name and parent. Nothing has changed yet, so the
+	 * rename is abandoned if the cache cannot follow it. */
+	if (dcache_initialized(vol)) {
+		ret = dcache_rename(from_norm_copy, to_norm_copy, &fromdentry, vol);
+		if (ret < 0) {
+			if (todentry && todentry != fromdentry)
+				fs_release_dentry(todentry);
+			fs_release_dentry(fromdentry);
+			goto out_unlock;
+		}
+	}
+
+	index_snapshot_preserve(fromdir);
+	if (todir != fromdir)
+		index_snapshot_preserve(todir);
+
 	/* If the destination dentry was found and is distinct from the source dentry, try
 	 * to unlink it before going forward with the rename. */
 	if (todentry && todentry != fromdentry) {
 		if (todentry->isdir) {
-			ret = 0;
-			acquireread_mrsw(&todentry->contents_lock);
-			if (HASH_COUNT(todentry->child_list) != 0)
+			acquireread_mrsw(&fs_dentry_locks(todentry)->contents_lock);
+			ret = index_spill_load(todentry, true);
+			if (ret == 0 && HASH_COUNT(todentry->child_list) != 0)
 				ret = -LTFS_DIRNOTEMPTY;
-			releaseread_mrsw(&todentry->contents_lock);
+			releaseread_mrsw(&fs_dentry_locks(todentry)->contents_lock);
 			if (ret < 0) {
 				fs_release_dentry(fromdentry);
 				fs_release_dentry(todentry);
 				goto out_unlock;
 			}
 		}
-		acquirewrite_mrsw(&todentry->meta_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(todentry)->meta_lock);
 		if (todentry->isdir)
 			--todir->link_count;
-		--todentry->numhandles;
+		if (! index_snapshot_hold(todentry))
+			--todentry->numhandles;
 		--todentry->link_count;
 		todentry->parent = NULL;
 		todentry->deleted = true;
@@ -800,12 +947,13 @@ int ltfs_fsops_rename(const char *from, const char *to, ltfs_file_id *id, struct
 		namelist = fs_find_key_from_hash_table(todir->child_list, todentry->platform_safe_name, &ret);
 		if (namelist) {
 			HASH_DEL(todir->child_list, namelist);
+			++todir->child_removals;
 			free(namelist->name);
 			free(namelist);
 		}
 		else {
 			ltfsmsg(LTFS_ERR, 11320E, "ltfs_fsops_rename", ret);
-			releasewrite_mrsw(&todentry->meta_lock);
+			releasewrite_mrsw(&fs_dentry_locks(todentry)->meta_lock);
 			goto out_unlock;
 		}
 		if (! todir->isdir)
@@ -820,16 +968,18 @@ int ltfs_fsops_rename(const char *from, const char *to, ltfs_file_id *id, struct
 	}
 
 	/* Remove fromdentry from old directory */
-	acquirewrite_mrsw(&fromdentry->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(fromdentry)->meta_lock);
+	index_snapshot_preserve(fromdentry);
 	namelist = fs_find_key_from_hash_table(fromdir->child_list, fromdentry->platform_safe_name, &ret);
 	if (namelist) {
 		HASH_DEL(fromdir->child_list, namelist);
+		++fromdir->child_removals;
 		free(namelist->name);
 		free(namelist);
 	}
 	else {
 		ltfsmsg(LTFS_ERR, 11320E, "ltfs_fsops_rename", ret);
-		releasewrite_mrsw(&fromdentry->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(fromdentry)->meta_lock);
 		goto out_unlock;
 	}
 
@@ -857,12 +1007,13 @@ int ltfs_fsops_rename(const char *from, const char *to, ltfs_file_id *id, struct
 	fromdentry->name.percent_encode = fs_is_percent_encode_required(fromdentry->name.name);
 	fromdentry->platform_safe_name = to_filename_copy2;
 	fromdentry->matches_name_criteria = index_criteria_match(fromdentry, vol);
+	fromdentry->name_criteria_checked = true;
 
 	/* Add fromdentry to new directory */
 	todir->child_list = fs_add_key_to_hash_table(todir->child_list, fromdentry, &ret);
 	if (ret != 0) {
 		ltfsmsg(LTFS_ERR, 11319E, "ltfs_fsops_rename", ret);
-		releasewrite_mrsw(&fromdentry->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(fromdentry)->meta_lock);
 		goto out_unlock;
 	}
 
@@ -871,7 +1022,7 @@ int ltfs_fsops_rename(const char *from, const char *to, ltfs_file_id *id, struct
 	if (! iosched_initialized(vol))
 		fs_release_dentry_unlocked(fromdentry);
 	else
-		releasewrite_mrsw(&fromdentry->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(fromdentry)->meta_lock);
 
 	ltfs_set_index_dirty(true, false, vol->index);
 
@@ -880,20 +1031,25 @@ int ltfs_fsops_rename(const char *from, const char *to, ltfs_file_id *id, struct
 
 out_unlock:
 	/* Release contents locks. The meta_locks are released by fs_release_dentry_unlocked. */
-	releasewrite_mrsw(&fromdir->contents_lock);
+	releasewrite_mrsw(&fs_dentry_locks(fromdir)->contents_lock);
 	if (fromdir != todir)
-		releasewrite_mrsw(&todir->contents_lock);
+		releasewrite_mrsw(&fs_dentry_locks(todir)->contents_lock);
 
 out_release:
-	if (! dcache_initialized(vol)) {
-		if (fromdir)
-			fs_release_dentry_unlocked(fromdir);
-		if (todir) {
-			if (todir == fromdir)
-				fs_release_dentry(todir);
-			else
-				fs_release_dentry_unlocked(todir);
-		}
+	if (fromdir)
+		fs_release_dentry_unlocked(fromdir);
+	if (todir) {
+		if (todir == fromdir)
+			fs_release_dentry(todir);
+		else
+			fs_release_dentry_unlocked(todir);
+	}
+	if (ret == 0) {
+		/* Undo fs_split_path to get the paths back. Paths below a directory move with it. */
+		from_filename[-1] = '/';
+		to_filename[-1] = '/';
+		path_cache_invalidate(vol->index->path_cache, from_norm, ! fromdentry || fromdentry->isdir);
+		path_cache_invalidate(vol->index->path_cache, to_norm, ! fromdentry || fromdentry->isdir);
 	}
 	ltfs_mutex_unlock(&vol->index->rename_lock);
 	releaseread_mrsw(&vol->lock);
@@ -919,7 +1075,7 @@ out_free:
 		free(from_norm_copy);
 	if (to_norm_copy)
 		free(to_norm_copy);
-	if (ret < 0 || dcache_initialized(vol)) {
+	if (ret < 0) {
 		if (to_filename_copy)
 			free(to_filename_copy);
 		if (to_filename_copy2)
@@ -929,19 +1085,13 @@ out_free:
 	return ret;
 }
 
-int ltfs_fsops_getattr(struct dentry *d, struct dentry_attr *attr, struct ltfs_volume *vol)
+/**
+ * Copy the attributes of a dentry, except for the size of a file with I/O scheduler state.
+ * Call with a read lock on d's meta_lock.
+ */
+static void _ltfs_fsops_fill_attr(struct dentry *d, struct dentry_attr *attr,
+	struct ltfs_volume *vol)
 {
-	int ret;
-
-	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
-	CHECK_ARG_NULL(attr, -LTFS_NULL_ARG);
-	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
-
-	ret = ltfs_get_volume_lock(false, vol);
-	if (ret < 0)
-		return ret;
-	acquireread_mrsw(&d->meta_lock);
-
 	if(d->isslink)
 		attr->size = strlen(d->target.name);
 	else
@@ -959,8 +1109,22 @@ int ltfs_fsops_getattr(struct dentry *d, struct dentry_attr *attr, struct ltfs_v
 	attr->readonly = d->readonly;
 	attr->isdir = d->isdir;
 	attr->isslink = d->isslink;
+}
+
+int ltfs_fsops_getattr(struct dentry *d, struct dentry_attr *attr, struct ltfs_volume *vol)
+{
+	int ret;
 
-	releaseread_mrsw(&d->meta_lock);
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(attr, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
+
+	ret = ltfs_get_volume_lock(false, vol);
+	if (ret < 0)
+		return ret;
+	acquireread_mrsw(&fs_dentry_locks(d)->meta_lock);
+	_ltfs_fsops_fill_attr(d, attr, vol);
+	releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
 	releaseread_mrsw(&vol->lock);
 
 	if (! d->isdir && !d->isslink && iosched_initialized(vol))
@@ -999,8 +1163,7 @@ int ltfs_fsops_setxattr(const char *path, const char *name, const char *value, s
 	struct dentry *d;
 	char *new_path = NULL, *new_name = NULL;
 	const char *new_name_strip;
-	bool write_lock;
-	int ret_restore;
+	int ret_restore, ret_lock;
 	char value_restore[LTFS_MAX_XATTR_SIZE];
 
 	id->uid = 0;
@@ -1054,8 +1217,8 @@ int ltfs_fsops_setxattr(const char *path, const char *name, const char *value, s
 		goto out_free;
 	}
 
-	/* Special case: if we are syncing the volume, flush the scheduler buffers
-	 * before taking locks. */
+	/* Special case: if we are syncing the volume, flush the scheduler buffers and join
+	 * the group commit of ltfs_sync_index, which takes the volume lock by itself. */
 start:
 	if (! strcmp(new_name_strip, "ltfs.sync") && ! strcmp(path, "/")) {
 		ret = ltfs_fsops_flush(NULL, false, vol);
@@ -1063,12 +1226,21 @@ start:
 			ltfsmsg(LTFS_ERR, 11325E, ret);
 			goto out_free;
 		}
-		ret = ltfs_get_volume_lock(true, vol);
-		write_lock = true;
-	} else {
-		ret = ltfs_get_volume_lock(false, vol);
-		write_lock = false;
+		ret = ltfs_sync_index(SYNC_EA, true, vol);
+
+		/* Revalidate below with the volume lock held, as for other attributes */
+		ret_lock = ltfs_get_volume_lock(false, vol);
+		if (ret_lock < 0) {
+			if (ret == 0)
+				ret = ret_lock;
+			goto out_free;
+		}
+		id->uid = vol->index->root->uid;
+		id->ino = vol->index->root->ino;
+		goto out_reval;
 	}
+
+	ret = ltfs_get_volume_lock(false, vol);
 	if (ret < 0)
 		goto out_free;
 
@@ -1105,8 +1277,9 @@ start:
 		ret = xattr_set(d, new_name_strip, value, size, flags, vol);
 		fs_release_dentry(d);
 	}
+out_reval:
 	if (NEED_REVAL(ret)) {
-		ret = ltfs_revalidate(write_lock, vol);
+		ret = ltfs_revalidate(false, vol);
 		if (ret == 0)
 			goto start;
 	} else if (IS_UNEXPECTED_MOVE(ret)) {
@@ -1375,7 +1548,7 @@ int ltfs_fsops_readdir(struct dentry *d, void *buf, ltfs_dir_filler filler, void
 	if (ret < 0)
 		return ret;
 
-	acquireread_mrsw(&d->contents_lock);
+	acquireread_mrsw(&fs_dentry_locks(d)->contents_lock);
 	if (dcache_initialized(vol)) {
 		int i;
 		char **namelist = NULL;
@@ -1391,8 +1564,8 @@ int ltfs_fsops_readdir(struct dentry *d, void *buf, ltfs_dir_filler filler, void
 			free(namelist);
 		}
 	} else {
-		if (HASH_COUNT(d->child_list) != 0) {
-			HASH_SORT(d->child_list, fs_hash_sort_by_uid);
+		ret = index_spill_load(d, true);
+		if (ret == 0 && HASH_COUNT(d->child_list) != 0) {
 			HASH_ITER(hh, d->child_list, entry, tmp) {
 				ret = filler(buf, entry->d->platform_safe_name, filler_priv);
 				if (ret < 0)
@@ -1400,13 +1573,14 @@ int ltfs_fsops_readdir(struct dentry *d, void *buf, ltfs_dir_filler filler, void
 			}
 		}
 	}
-	releaseread_mrsw(&d->contents_lock);
+	releaseread_mrsw(&fs_dentry_locks(d)->contents_lock);
 
 	/* Update access time */
 	if (ret == 0) {
-		acquirewrite_mrsw(&d->meta_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+		index_snapshot_preserve_atime(d);
 		get_current_timespec(&d->access_time);
-		releasewrite_mrsw(&d->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 		ltfs_set_index_dirty(true, true, vol->index);
 	}
 
@@ -1414,9 +1588,128 @@ int ltfs_fsops_readdir(struct dentry *d, void *buf, ltfs_dir_filler filler, void
 	return ret;
 }
 
+/**
+ * Pass one directory entry and its attributes to a readdir_plus filler.
+ * Call with a read lock on the parent directory's contents_lock.
+ */
+static int _ltfs_fsops_fill_plus(void *buf, struct dentry *child, uint64_t offset,
+	ltfs_dir_plus_filler filler, void *filler_priv, struct ltfs_volume *vol)
+{
+	struct dentry_attr attr;
+	bool valid;
+
+	/* The size of a file with scheduler state is only known to the scheduler, which cannot be
+	 * asked while the volume lock is held. Its attributes are left to a later getattr. A
+	 * scheduler state appearing just after this check belongs to a write that started after
+	 * this entry was listed. Children which were never locked are read without allocating
+	 * their locks. */
+	fs_acquire_dentry_meta_read(child);
+	valid = child->isdir || child->isslink || ! child->iosched_priv;
+	if (valid)
+		_ltfs_fsops_fill_attr(child, &attr, vol);
+	fs_release_dentry_meta_read(child);
+
+	return filler(buf, child->platform_safe_name, offset, valid ? &attr : NULL, filler_priv);
+}
+
+/**
+ * Common implementation of ltfs_fsops_readdir_cursor and ltfs_fsops_readdir_plus. Exactly one
+ * of 'filler' and 'plus_filler' is set.
+ */
+static int _ltfs_fsops_readdir_cursor(struct dentry *d, struct ltfs_dir_cursor *cursor,
+	uint64_t offset, void *buf, ltfs_dir_cursor_filler filler, ltfs_dir_plus_filler plus_filler,
+	void *filler_priv, struct ltfs_volume *vol)
+{
+	int ret = 0;
+	struct name_list *entry;
+
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(cursor, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
+
+	if (! d->isdir)
+		return -LTFS_ISFILE;
+
+	ret = ltfs_get_volume_lock(false, vol);
+	if (ret < 0)
+		return ret;
+
+	acquireread_mrsw(&fs_dentry_locks(d)->contents_lock);
+	if (dcache_initialized(vol)) {
+		uint64_t i;
+		char **namelist = NULL;
+		ret = dcache_readdir(d, false, (void ***) &namelist, vol);
+		if (ret == 0 && namelist) {
+			for (i=0; namelist[i]; ++i) {
+				if (i >= offset && ret == 0 && plus_filler)
+					ret = plus_filler(buf, namelist[i], i + 1, NULL, filler_priv);
+				else if (i >= offset && ret == 0)
+					ret = filler(buf, namelist[i], i + 1, filler_priv);
+				free(namelist[i]);
+			}
+			free(namelist);
+		}
+	} else {
+		ret = index_spill_load(d, true);
+		if (ret == 0) {
+			/* The child list is kept in UID order, so the saved entry's successor is the
+			 * next one to list as long as the saved entry is still in the list. */
+			if (offset && cursor->last && cursor->offset == offset
+				&& cursor->removals == d->child_removals)
+				entry = cursor->last->hh.next;
+			else
+				for (entry = d->child_list; entry && entry->uid <= offset; entry = entry->hh.next);
+
+			for (; entry; entry = entry->hh.next) {
+				if (plus_filler)
+					ret = _ltfs_fsops_fill_plus(buf, entry->d, entry->uid, plus_filler,
+						filler_priv, vol);
+				else
+					ret = filler(buf, entry->d->platform_safe_name, entry->uid, filler_priv);
+				if (ret != 0)
+					break;
+				cursor->last = entry;
+				cursor->offset = entry->uid;
+				cursor->removals = d->child_removals;
+			}
+		}
+	}
+	releaseread_mrsw(&fs_dentry_locks(d)->contents_lock);
+
+	if (ret > 0)
+		ret = 0;
+
+	/* Update access time */
+	if (ret == 0) {
+		acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+		index_snapshot_preserve_atime(d);
+		get_current_timespec(&d->access_time);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+		ltfs_set_index_dirty(true, true, vol->index);
+	}
+
+	releaseread_mrsw(&vol->lock);
+	return ret;
+}
+
+int ltfs_fsops_readdir_cursor(struct dentry *d, struct ltfs_dir_cursor *cursor, uint64_t offset,
+	void *buf, ltfs_dir_cursor_filler filler, void *filler_priv, struct ltfs_volume *vol)
+{
+	CHECK_ARG_NULL(filler, -LTFS_NULL_ARG);
+	return _ltfs_fsops_readdir_cursor(d, cursor, offset, buf, filler, NULL, filler_priv, vol);
+}
+
+int ltfs_fsops_readdir_plus(struct dentry *d, struct ltfs_dir_cursor *cursor, uint64_t offset,
+	void *buf, ltfs_dir_plus_filler filler, void *filler_priv, struct ltfs_volume *vol)
+{
+	CHECK_ARG_NULL(filler, -LTFS_NULL_ARG);
+	return _ltfs_fsops_readdir_cursor(d, cursor, offset, buf, NULL, filler, filler_priv, vol);
+}
+
 int _ltfs_fsops_read_direntry(struct dentry *d, struct ltfs_direntry *dirent,
 							  unsigned long index, bool root, struct ltfs_volume *vol)
 {
+	int ret;
 	unsigned long i = 0;
 	struct dentry *target = NULL;
 	struct name_list *entry, *tmp;
@@ -1424,10 +1717,10 @@ int _ltfs_fsops_read_direntry(struct dentry *d, struct ltfs_direntry *dirent,
 	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
 	CHECK_ARG_NULL(dirent, -LTFS_NULL_ARG);
 
-	acquireread_mrsw(&d->contents_lock);
+	acquireread_mrsw(&fs_dentry_locks(d)->contents_lock);
 
 	if ( ! d->isdir ) {
-		releaseread_mrsw(&d->contents_lock);
+		releaseread_mrsw(&fs_dentry_locks(d)->contents_lock);
 		return -LTFS_ISFILE;
 	}
 
@@ -1456,11 +1749,11 @@ int _ltfs_fsops_read_direntry(struct dentry *d, struct ltfs_direntry *dirent,
 	}
 
 	if (dcache_initialized(vol)) {
-		int ret = 0;
+		ret = 0;
 
-		releaseread_mrsw(&d->contents_lock);
+		releaseread_mrsw(&fs_dentry_locks(d)->contents_lock);
 		if (target) {
-			acquireread_mrsw(&target->meta_lock);
+			acquireread_mrsw(&fs_dentry_locks(target)->meta_lock);
 			dirent->creation_time = target->creation_time;
 			dirent->access_time   = target->access_time;
 			dirent->modify_time   = target->modify_time;
@@ -1474,16 +1767,22 @@ int _ltfs_fsops_read_direntry(struct dentry *d, struct ltfs_direntry *dirent,
 				dirent->name          = target->name.name;
 				dirent->platform_safe_name = target->platform_safe_name;
 			}
-			releaseread_mrsw(&target->meta_lock);
+			releaseread_mrsw(&fs_dentry_locks(target)->meta_lock);
 		}
 		else {
-			ret = dcache_read_direntry(d, dirent, index, vol);
+			/* The dentry cache counts children only, without "." and ".." */
+			ret = dcache_read_direntry(d, dirent, index - i, vol);
 		}
 		return ret;
 	}
 	else {
 		/* Search target dentry from directory entry */
 		if (! target) {
+			ret = index_spill_load(d, true);
+			if (ret < 0) {
+				releaseread_mrsw(&fs_dentry_locks(d)->contents_lock);
+				return ret;
+			}
 			if(HASH_COUNT(d->child_list) != 0) {
 				HASH_ITER(hh, d->child_list, entry, tmp) {
 					if(entry->d->deleted) continue;
@@ -1496,14 +1795,14 @@ int _ltfs_fsops_read_direntry(struct dentry *d, struct ltfs_direntry *dirent,
 				}
 			}
 		}
-		releaseread_mrsw(&d->contents_lock);
+		releaseread_mrsw(&fs_dentry_locks(d)->contents_lock);
 
 		/* Cannot find the target dentry*/
 		if(i != index || ! target )
 			return -LTFS_NO_DENTRY;
 
 		/* Set target dentry information to the buffer */
-		acquireread_mrsw(&target->meta_lock);
+		acquireread_mrsw(&fs_dentry_locks(target)->meta_lock);
 		dirent->creation_time = target->creation_time;
 		dirent->access_time   = target->access_time;
 		dirent->modify_time   = target->modify_time;
@@ -1517,7 +1816,7 @@ int _ltfs_fsops_read_direntry(struct dentry *d, struct ltfs_direntry *dirent,
 			dirent->name          = target->name.name;
 			dirent->platform_safe_name = target->platform_safe_name;
 		}
-		releaseread_mrsw(&target->meta_lock);
+		releaseread_mrsw(&fs_dentry_locks(target)->meta_lock);
 	}
 	return 0;
 }
@@ -1555,7 +1854,8 @@ int ltfs_fsops_utimens(struct dentry *d, const struct ltfs_timespec ts[2], struc
 	ret = ltfs_get_volume_lock(false, vol);
 	if (ret < 0)
 		return ret;
-	acquirewrite_mrsw(&d->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	index_snapshot_preserve(d);
 
 	if (d->access_time.tv_sec != ts[0].tv_sec || d->access_time.tv_nsec != ts[0].tv_nsec) {
 		d->access_time = ts[0];
@@ -1577,10 +1877,11 @@ int ltfs_fsops_utimens(struct dentry *d, const struct ltfs_timespec ts[2], struc
 		ltfs_set_index_dirty(true, false, vol->index);
 		d->dirty = true;
 	}
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+
+	/* The dentry cache reads the dentry under its own locks */
 	if (dcache_initialized(vol))
 		dcache_flush(d, FLUSH_METADATA, vol);
-
-	releasewrite_mrsw(&d->meta_lock);
 	releaseread_mrsw(&vol->lock);
 
 	return 0;
@@ -1632,7 +1933,8 @@ int ltfs_fsops_utimens_all(struct dentry *d, const struct ltfs_timespec ts[4], s
 	if (ret < 0)
 		return ret;
 
-	acquirewrite_mrsw(&d->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	index_snapshot_preserve(d);
 
 	if (ts[3].tv_sec != 0 || ts[3].tv_nsec != 0) {
 		d->change_time = ts[3];
@@ -1675,10 +1977,11 @@ int ltfs_fsops_utimens_all(struct dentry *d, const struct ltfs_timespec ts[4], s
 		d->dirty = true;
 	}
 
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+
+	/* The dentry cache reads the dentry under its own locks */
 	if (dcache_initialized(vol))
 		dcache_flush(d, FLUSH_METADATA, vol);
-
-	releasewrite_mrsw(&d->meta_lock);
 	releaseread_mrsw(&vol->lock);
 
 	return 0;
@@ -1688,6 +1991,7 @@ int ltfs_fsops_utimens_all(struct dentry *d, const struct ltfs_timespec ts[4], s
 int ltfs_fsops_set_readonly(struct dentry *d, bool readonly, struct ltfs_volume *vol)
 {
 	int ret;
+	bool dirty = false;
 
 	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
 	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
@@ -1705,15 +2009,18 @@ int ltfs_fsops_set_readonly(struct dentry *d, bool readonly, struct ltfs_volume
 	ret = ltfs_get_volume_lock(false, vol);
 	if (ret < 0)
 		return ret;
-	acquirewrite_mrsw(&d->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	index_snapshot_preserve(d);
 	if (readonly != d->readonly) {
 		d->readonly = readonly;
 		get_current_timespec(&d->change_time);
 		ltfs_set_index_dirty(true, false, vol->index);
-		if (dcache_initialized(vol))
-			dcache_flush(d, FLUSH_METADATA, vol);
+		dirty = true;
 	}
-	releasewrite_mrsw(&d->meta_lock);
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+
+	if (dirty && dcache_initialized(vol))
+		dcache_flush(d, FLUSH_METADATA, vol);
 	releaseread_mrsw(&vol->lock);
 
 	return 0;
@@ -1787,6 +2094,49 @@ int ltfs_fsops_write(struct dentry *d, const char *buf, size_t count, off_t offs
 		return 0;
 }
 
+int ltfs_fsops_write_source(struct dentry *d, ltfs_write_source source, void *source_priv,
+	size_t count, off_t offset, bool isupdatetime, struct ltfs_volume *vol)
+{
+	ssize_t ret;
+	char *buf;
+
+	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(source, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
+	if (d->isdir)
+		return -LTFS_ISDIRECTORY;
+
+	if (iosched_initialized(vol)) {
+		if (d->is_immutable || (d->is_appendonly && (uint64_t) offset != d->size)) {
+			ltfsmsg(LTFS_ERR, 17237E, "write");
+			return -LTFS_WORM_ENABLED;
+		}
+
+		ret = iosched_write_source(d, source, source_priv, count, offset, isupdatetime, vol);
+		if (ret != -LTFS_UNSUPPORTED) {
+			if (!isupdatetime && ret >= 0)
+				d->need_update_time = true;
+			return (ret < 0) ? ret : 0;
+		}
+	}
+
+	/* The data path cannot gather from the source: stage the data in a flat buffer */
+	buf = malloc(count ? count : 1);
+	if (! buf) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+
+	ret = source(buf, count, 0, source_priv);
+	if (ret >= 0 && (size_t) ret != count)
+		ret = -LTFS_BAD_ARG;
+	if (ret >= 0)
+		ret = ltfs_fsops_write(d, buf, count, offset, isupdatetime, vol);
+
+	free(buf);
+	return (ret < 0) ? ret : 0;
+}
+
 ssize_t ltfs_fsops_read(struct dentry *d, char *buf, size_t count, off_t offset,
 	struct ltfs_volume *vol)
 {
@@ -1912,13 +2262,17 @@ int ltfs_fsops_symlink_path(const char* to, const char* from, ltfs_file_id *id,
 
 	id->uid = d->uid;
 	id->ino = d->ino;
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	index_snapshot_preserve(d);
 	d->target.name = arch_strdup(to);
 	if (!d->target.name) {
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 		ltfs_fsops_close(d, true, true, use_iosche, vol);
 		return -LTFS_NO_MEMORY;
 	}
 	d->target.percent_encode = fs_is_percent_encode_required(to);
 	d->isslink = true;
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 	/* Set mount point length in EA (LiveLink support mode only) */
 	if ( ( strncmp( to, vol->mountpoint, vol->mountpoint_len )==0 ) &&
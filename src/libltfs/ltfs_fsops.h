@@ -136,6 +136,66 @@ int ltfs_fsops_open_combo(const char *path, bool open_write, bool use_iosched,
  */
 int ltfs_fsops_close(struct dentry *d, bool dirty, bool open_write, bool use_iosched,  struct ltfs_volume *vol);
 
+/**
+ * Look up a name in a directory, taking a reference to the dentry found.
+ * The reference must be dropped later using ltfs_fsops_forget(). This is not available
+ * with a dentry cache, whose dentries are only referenced while open.
+ * @param parent Directory to search. The caller must hold a reference to it.
+ * @param name Name to look up. It must not contain a path separator.
+ * @param d On success, points to the dentry found. Undefined on error.
+ * @param vol LTFS volume.
+ * @return
+ *    - 0 on success
+ *    - -LTFS_NULL_ARG if any of the input arguments are NULL
+ *    - -LTFS_UNSUPPORTED if a dentry cache is in use
+ *    - -LTFS_ISFILE if 'parent' is not a directory
+ *    - -LTFS_INVALID_PATH if the name cannot be UTF-8 encoded or contains invalid characters
+ *    - -LTFS_NAMETOOLONG if the name is too long
+ *    - -LTFS_NO_DENTRY if the name does not exist
+ *    - Another negative value if an unexpected error occurred
+ */
+int ltfs_fsops_lookup(struct dentry *parent, const char *name, struct dentry **d,
+	struct ltfs_volume *vol);
+
+/**
+ * Open a file or directory the caller already holds a reference to, as obtained from
+ * ltfs_fsops_lookup(). This takes the same new reference ltfs_fsops_open() does without
+ * resolving a path. The I/O schedulers open files by reference only, so the handle must be
+ * closed using ltfs_fsops_close() with use_iosched set for files and unset for directories.
+ * @param d File or directory to open.
+ * @param open_write True if the caller plans to write to the file. Ignored for directories.
+ * @param vol LTFS volume.
+ * @return
+ *    - 0 on success
+ *    - -LTFS_NULL_ARG if any of the input arguments are NULL
+ *    - -LTFS_UNSUPPORTED if a dentry cache is in use
+ *    - -LTFS_RDONLY_VOLUME if the underlying device is read-only or 'd' is a symbolic link
+ *      opened for write
+ *    - Another negative value if an unexpected error occurred
+ */
+int ltfs_fsops_open_dentry(struct dentry *d, bool open_write, struct ltfs_volume *vol);
+
+/**
+ * Drop references taken by ltfs_fsops_lookup(). An unlinked dentry is freed along with its
+ * last reference.
+ * @param d Dentry to release.
+ * @param count Number of references to drop.
+ */
+void ltfs_fsops_forget(struct dentry *d, uint64_t count);
+
+/**
+ * Get the UID of the directory containing a dentry, as reported for ".." in a listing.
+ * @param d Dentry the caller holds a reference to.
+ * @param uid On success, the UID of the parent directory, or the UID of 'd' itself if 'd' is
+ *            the root or has been removed.
+ * @param vol LTFS volume.
+ * @return
+ *    - 0 on success
+ *    - -LTFS_NULL_ARG if any of the input arguments are NULL
+ *    - Another negative value if an unexpected error occurred
+ */
+int ltfs_fsops_parent_uid(struct dentry *d, uint64_t *uid, struct ltfs_volume *vol);
+
 /**
  * Recalculate used blocks of specified dentry and reflect it to valid_blocks in the index structure
  * @param d File or directory to update.
@@ -324,6 +384,51 @@ int ltfs_fsops_removexattr(const char *path, const char *name, ltfs_file_id *id,
 int ltfs_fsops_readdir(struct dentry *d, void *buf, ltfs_dir_filler filler, void *filler_priv,
 	struct ltfs_volume *vol);
 
+/**
+ * List directory contents starting at a given offset, invoking a callback function for each
+ * directory entry until the callback asks to stop. It does not invoke the filler for the "."
+ * and ".." entries.
+ * Offsets are the entry UIDs, so a listing can be resumed from any offset previously passed
+ * to the filler. When 'offset' matches the one saved in the cursor and no entry has been
+ * removed from the directory since, the listing resumes in constant time; otherwise the
+ * directory is scanned for the first entry past 'offset'.
+ * With a dentry cache the offsets are entry ordinals and resuming costs a directory scan.
+ * @param d Directory to list.
+ * @param cursor Listing position, updated as entries are consumed. Callers must serialize
+ *               calls sharing a cursor.
+ * @param offset Offset to resume from, 0 to start at the beginning.
+ * @param buf Output buffer, passed to the filler function.
+ * @param filler Callback invoked for each directory entry.
+ * @param filler_priv Pointer to private data used by the filler function. May be NULL.
+ * @param vol LTFS volume.
+ * @return
+ *    - 0 on success, including when the filler stopped the listing
+ *    - -LTFS_NULL_ARG if any of the input arguments are NULL
+ *    - -LTFS_ISFILE if the provided dentry is not a directory
+ *    - Another negative value if an unexpected error occurred or if the filler callback failed
+ */
+int ltfs_fsops_readdir_cursor(struct dentry *d, struct ltfs_dir_cursor *cursor, uint64_t offset,
+	void *buf, ltfs_dir_cursor_filler filler, void *filler_priv, struct ltfs_volume *vol);
+
+/**
+ * List a directory like ltfs_fsops_readdir_cursor, also passing the attributes of each entry
+ * to the filler. The attributes are taken from the child dentry while the directory is locked,
+ * so listing N entries costs one pass instead of N getattr calls.
+ * An entry's attributes are only reported when they are exactly what ltfs_fsops_getattr would
+ * return at that moment. Otherwise, e.g. for a file whose size is pending in the I/O scheduler
+ * or when listing through the dentry cache, the filler receives NULL attributes.
+ * @param d Directory to list.
+ * @param cursor Listing position, see ltfs_fsops_readdir_cursor.
+ * @param offset Offset to resume from, 0 to start at the beginning.
+ * @param buf Output buffer, passed to the filler function.
+ * @param filler Callback invoked for each directory entry.
+ * @param filler_priv Pointer to private data used by the filler function. May be NULL.
+ * @param vol LTFS volume.
+ * @return As for ltfs_fsops_readdir_cursor.
+ */
+int ltfs_fsops_readdir_plus(struct dentry *d, struct ltfs_dir_cursor *cursor, uint64_t offset,
+	void *buf, ltfs_dir_plus_filler filler, void *filler_priv, struct ltfs_volume *vol);
+
 /**
  * Get an entry in the directory.
  * It does get the "." and ".." entries only when d is specified non volume root directory.
@@ -436,6 +541,23 @@ int ltfs_fsops_set_readonly_path(const char *path, bool readonly, ltfs_file_id *
 int ltfs_fsops_write(struct dentry *d, const char *buf, size_t count, off_t offset,
 	bool isupdatetime, struct ltfs_volume *vol);
 
+/**
+ * Write data to a file, gathering it from a caller-defined source.
+ * When the I/O scheduler supports it the source is copied straight into its cache blocks;
+ * otherwise the data is staged in a temporary buffer and passed to ltfs_fsops_write.
+ * @param d File to write.
+ * @param source Callback that copies bytes out of the source.
+ * @param source_priv Source handle passed to the callback.
+ * @param count Number of bytes to write.
+ * @param offset Logical file offset where the new data should be written.
+ * @param isupdatetime False if callar is Windows system.
+ * @param vol LTFS volume.
+ * @return 0 on success, -LTFS_BAD_ARG if the source provides fewer than 'count' bytes,
+ *         or any error returned by ltfs_fsops_write or by the source callback.
+ */
+int ltfs_fsops_write_source(struct dentry *d, ltfs_write_source source, void *source_priv,
+	size_t count, off_t offset, bool isupdatetime, struct ltfs_volume *vol);
+
 /**
  * Read data from a file.
  * The number of bytes read may be less than requested, or even 0, if the read location extents
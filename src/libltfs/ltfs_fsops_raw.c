@@ -58,6 +58,7 @@
 #include "arch/time_internal.h"
 #include "tape.h"
 #include "dcache.h"
+#include "index_snapshot.h"
 
 int ltfs_fsraw_open(const char *path, bool open_write, struct dentry **d, struct ltfs_volume *vol)
 {
@@ -86,10 +87,12 @@ int ltfs_fsraw_open(const char *path, bool open_write, struct dentry **d, struct
 
 	if (open_write && ! dtmp->isdir) {
 		uint64_t max_filesize = index_criteria_get_max_filesize(vol);
-		acquirewrite_mrsw(&dtmp->meta_lock);
-		if (! dtmp->matches_name_criteria && max_filesize > 0 && dtmp->size <= max_filesize)
+		acquirewrite_mrsw(&fs_dentry_locks(dtmp)->meta_lock);
+		if (! dtmp->name_criteria_checked && max_filesize > 0 && dtmp->size <= max_filesize) {
 			dtmp->matches_name_criteria = index_criteria_match(dtmp, vol);
-		releasewrite_mrsw(&dtmp->meta_lock);
+			dtmp->name_criteria_checked = true;
+		}
+		releasewrite_mrsw(&fs_dentry_locks(dtmp)->meta_lock);
 	}
 
 	*d = dtmp;
@@ -117,7 +120,7 @@ int _ltfs_fsraw_write_data_unlocked(char partition, const char *buf, size_t coun
 	tape_block_t *startblock, struct ltfs_volume *vol)
 {
 	int ret;
-	uint64_t blocksize, rep_count;
+	uint64_t blocksize, rep_count, nblocks = 0, nbytes = 0;
 	size_t to_write, write_count = 0;
 	ssize_t nwrite_last;
 	bool is_first_dp_locate = false;
@@ -225,12 +228,20 @@ int _ltfs_fsraw_write_data_unlocked(char partition, const char *buf, size_t coun
 				goto out_unlock;
 			}
 			write_count += to_write;
+			nbytes += to_write;
+			++nblocks;
 		}
 	}
 
 	ret = 0;
 
 out_unlock:
+	/* Data not covered by an index yet, see periodic_sync_thread */
+	if (nbytes && partition == ltfs_dp_id(vol))
+		__atomic_add_fetch(&vol->index->dirty_bytes, nbytes, __ATOMIC_RELAXED);
+	/* Keep the cached capacity current for statfs, see ltfs_capacity_data_cached */
+	if (nblocks || ret == -LTFS_NO_SPACE || ret == -LTFS_LESS_SPACE)
+		ltfs_capacity_consumed(partition, nblocks, ret == -LTFS_NO_SPACE || ret == -LTFS_LESS_SPACE, vol);
 	if (NEED_REVAL(ret))
 		tape_start_fence(vol->device);
 	else if (IS_UNEXPECTED_MOVE(ret))
@@ -265,6 +276,34 @@ start:
 	return ret;
 }
 
+/**
+ * Append an extent to a packed extent list, merging it into the last extent where possible.
+ * @return 0 if the extent was appended, 1 if it does not go after the last extent,
+ *         or a negative value on error.
+ */
+static int _ltfs_fsraw_append_packed_extent(struct dentry *d, struct extent_info *ext,
+	uint64_t blocksize)
+{
+	struct extent_info *tail = extent_pack_tail(d->extent_pack);
+	uint64_t tail_fileoffset_end = tail->fileoffset + tail->bytecount;
+	uint64_t tail_byteoffset_end = tail->byteoffset + tail->bytecount;
+
+	if (ext->fileoffset < tail_fileoffset_end)
+		return 1;
+
+	if (ext->fileoffset == tail_fileoffset_end &&
+		tail->start.partition == ext->start.partition &&
+		tail_byteoffset_end % blocksize == 0 &&
+		tail->start.block + tail_byteoffset_end / blocksize == ext->start.block &&
+		ext->byteoffset == 0) {
+		/* Add ext's bytes to the last extent */
+		tail->bytecount += ext->bytecount;
+		return 0;
+	}
+
+	return extent_pack_append(d->extent_pack, ext);
+}
+
 /**
  * Non-locking version of ltfs_fsraw_add_extent.
  * The caller should hold a read lock on vol->lock and a write lock on d->contents_lock.
@@ -272,6 +311,7 @@ start:
 int _ltfs_fsraw_add_extent_unlocked(struct dentry *d, struct extent_info *ext, bool update_time,
 	struct ltfs_volume *vol)
 {
+	int ret;
 	struct extent_info *entry, *preventry;
 	struct extent_info *ext_copy, *splitentry;
 	bool ext_used = false, free_ext = false;
@@ -283,8 +323,25 @@ int _ltfs_fsraw_add_extent_unlocked(struct dentry *d, struct extent_info *ext, b
 	ext_fileoffset_end = ext->fileoffset + ext->bytecount;
 	realsize_new = d->realsize;
 
+	index_snapshot_preserve(d);
+
+	/* Packed extent lists take appends in place. Any other change needs the list form. */
+	if (d->extent_pack) {
+		ret = _ltfs_fsraw_append_packed_extent(d, ext, blocksize);
+		if (ret < 0)
+			return ret;
+		else if (ret == 0) {
+			realsize_new += ext->bytecount;
+			goto update_size;
+		}
+
+		ret = fs_unpack_extents(d);
+		if (ret < 0)
+			return ret;
+	}
+
 	/* Copy the input extent now to avoid failing after the extent list has already been updated */
-	ext_copy = malloc(sizeof(struct extent_info));
+	ext_copy = calloc(1, sizeof(struct extent_info));
 	if (! ext_copy) {
 		ltfsmsg(LTFS_ERR, 10001E, "ltfs_append_extent_unlocked: extent copy");
 		return -LTFS_NO_MEMORY;
@@ -329,7 +386,7 @@ int _ltfs_fsraw_add_extent_unlocked(struct dentry *d, struct extent_info *ext, b
 					entry_blockcount = entry_byteoffset_end / blocksize;
 				} else {
 					/* Split entry */
-					splitentry = malloc(sizeof(struct extent_info));
+					splitentry = calloc(1, sizeof(struct extent_info));
 					if (! splitentry) {
 						ltfsmsg(LTFS_ERR, 10001E, "ltfs_append_extent_unlocked: splitentry");
 						free(ext_copy);
@@ -383,8 +440,9 @@ int _ltfs_fsraw_add_extent_unlocked(struct dentry *d, struct extent_info *ext, b
 	} else if (free_ext)
 		free(ext_copy);
 
+update_size:
 	/* Update file size and times */
-	acquirewrite_mrsw(&d->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 	if (ext_fileoffset_end > d->size)
 		d->size = ext_fileoffset_end;
 	d->realsize = realsize_new;
@@ -399,9 +457,10 @@ int _ltfs_fsraw_add_extent_unlocked(struct dentry *d, struct extent_info *ext, b
 	 */
 	d->extents_dirty = true;
 	d->dirty = true;
-	releasewrite_mrsw(&d->meta_lock);
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 	ltfs_set_index_dirty(true, false, vol->index);
+	ltfs_notify_dentry(d, vol);
 
 	return 0;
 }
@@ -428,9 +487,9 @@ int ltfs_fsraw_add_extent(struct dentry *d, struct extent_info *ext, bool update
 	if (ret < 0)
 		return ret;
 
-	acquirewrite_mrsw(&d->contents_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
 	ret = _ltfs_fsraw_add_extent_unlocked(d, ext, update_time, vol);
-	releasewrite_mrsw(&d->contents_lock);
+	releasewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
 
 	if (dcache_initialized(vol))
 		ret = dcache_flush(d, FLUSH_EXTENT_LIST, vol);
@@ -447,12 +506,28 @@ int ltfs_fsraw_cleanup_extent(struct dentry *d, struct tc_position err_pos, unsi
 	struct extent_info *ext, *preventry;
 	struct tc_position extent_last = {0, 0, UINT32_MAX, false, false};
 
+	/* Contents still in the index spill have not been touched since the index was read,
+	 * so they cannot refer to the blocks lost */
+	if (d->spill && ! d->spill_loaded)
+		return 0;
+
 	if (HASH_COUNT(d->child_list) != 0) {
 		HASH_ITER(hh, d->child_list, entry, tmp) {
 			if (entry->d->isdir) {
 				ret = ltfs_fsraw_cleanup_extent(entry->d, err_pos, blocksize, vol);
 			}
 			else {
+				if (entry->d->extent_pack) {
+					ret = fs_prepare_dentry_locks(entry->d);
+					if (ret < 0)
+						return ret;
+					acquirewrite_mrsw(&fs_dentry_locks(entry->d)->contents_lock);
+					index_snapshot_preserve(entry->d);
+					ret = fs_unpack_extents(entry->d);
+					releasewrite_mrsw(&fs_dentry_locks(entry->d)->contents_lock);
+					if (ret < 0)
+						return ret;
+				}
                 TAILQ_FOREACH_REVERSE_SAFE(ext, &entry->d->extentlist, extent_struct, list, preventry) {
 					if (ext->start.block && ext->bytecount) {
 						extent_last.partition = ltfs_part_id2num(ext->start.partition, vol);
@@ -478,11 +553,13 @@ int ltfs_fsraw_cleanup_extent(struct dentry *d, struct tc_position err_pos, unsi
 						if (ret < 0)
 							return ret;
 
-						acquirewrite_mrsw(&d->contents_lock);
+						acquirewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
+						index_snapshot_preserve(entry->d);
                         entry->d->size -= ext->bytecount;
 						TAILQ_REMOVE(&entry->d->extentlist, ext, list);
 						free(ext);
-						releasewrite_mrsw(&d->contents_lock);
+						releasewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
+						ltfs_notify_dentry(entry->d, vol);
 
 						if (dcache_initialized(vol))
 							ret = dcache_flush(d, FLUSH_EXTENT_LIST, vol);
@@ -537,9 +614,9 @@ start:
 	tmpext.bytecount = count;
 	tmpext.fileoffset = (uint64_t)offset;
 
-	acquirewrite_mrsw(&d->contents_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
 	ret = _ltfs_fsraw_add_extent_unlocked(d, &tmpext, update_time, vol);
-	releasewrite_mrsw(&d->contents_lock);
+	releasewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
 
 	releaseread_mrsw(&vol->lock);
 	return ret;
@@ -552,7 +629,8 @@ ssize_t ltfs_fsraw_read(struct dentry *d, char *buf, size_t count, off_t offset,
 	uint64_t next_off, last_off;
 	ssize_t nread, ncopy;
 	size_t read_count;
-	struct extent_info *entry;
+	struct fs_extent_iter iter;
+	const struct extent_info *entry;
 	struct tc_position seekpos, curpos;
 	uint64_t firstbyte, lastbyte, blockbytes;
 	uint64_t entry_fileoffset_end;
@@ -575,10 +653,10 @@ start:
 	ret = ltfs_get_volume_lock(false, vol);
 	if (ret < 0)
 		return ret;
-	acquireread_mrsw(&d->contents_lock);
+	acquireread_mrsw(&fs_dentry_locks(d)->contents_lock);
 	ret = tape_device_lock(vol->device);
 	if (ret == -LTFS_DEVICE_FENCED) {
-		releaseread_mrsw(&d->contents_lock);
+		releaseread_mrsw(&fs_dentry_locks(d)->contents_lock);
 		ret = ltfs_wait_revalidation(vol);
 		if (ret == 0)
 			goto start;
@@ -586,7 +664,7 @@ start:
 			return ret;
 	} else if (ret < 0) {
 		ltfsmsg(LTFS_ERR, 11004E, __FUNCTION__);
-		releaseread_mrsw(&d->contents_lock);
+		releaseread_mrsw(&fs_dentry_locks(d)->contents_lock);
 		releaseread_mrsw(&vol->lock);
 		return ret;
 	}
@@ -605,7 +683,7 @@ start:
 	next_off = (uint64_t)offset;
 	last_off = (uint64_t)offset + count;
 
-	TAILQ_FOREACH(entry, &d->extentlist, list) {
+	for (entry = fs_extent_seek(d, next_off, &iter); entry; entry = fs_extent_next(d, &iter)) {
 		if (read_count == count)
 			break;
 
@@ -667,6 +745,8 @@ start:
 				(seekpos.block - entry->start.block) * blocksize;
 			lastbyte = firstbyte;
 			while (entry_fileoffset_end > next_off && read_count < count) {
+				bool direct = false;
+
 				lastbyte += blocksize;
 				if (entry_fileoffset_end < lastbyte)
 					lastbyte = entry_fileoffset_end;
@@ -683,7 +763,15 @@ start:
 					}
 
 				} else {
-					if (blocksize == blockbytes)
+					/* A whole block that lands entirely in the output buffer is read straight
+					 * into it instead of going through the last block cache */
+					direct = (blocksize == blockbytes && next_off == firstbyte &&
+						last_off - next_off >= blocksize);
+
+					if (direct)
+						nread = tape_read(vol->device, buf + read_count, blocksize, false,
+							vol->kmi_handle);
+					else if (blocksize == blockbytes)
 						nread = tape_read(vol->device, vol->last_block, blocksize, false,
 							vol->kmi_handle);
 					else
@@ -700,15 +788,23 @@ start:
 						goto out_unlock;
 					}
 
-					vol->last_pos.partition = entry->start.partition;
-					vol->last_pos.block = seekpos.block;
-					vol->last_size = nread;
+					if (direct) {
+						/* The block cache no longer matches the tape position */
+						vol->last_pos.partition = 0;
+						vol->last_pos.block = 0;
+						vol->last_size = 0;
+					} else {
+						vol->last_pos.partition = entry->start.partition;
+						vol->last_pos.block = seekpos.block;
+						vol->last_size = nread;
+					}
 					++curpos.block;
 				}
 
 				/* Copy data into output buffer */
 				ncopy = (lastbyte > last_off ? last_off : lastbyte) - next_off;
-				memcpy(buf + read_count, vol->last_block + (next_off - firstbyte), ncopy);
+				if (! direct)
+					memcpy(buf + read_count, vol->last_block + (next_off - firstbyte), ncopy);
 
 				firstbyte += blocksize;
 				next_off += ncopy;
@@ -726,14 +822,15 @@ start:
 	}
 
 	/* update access time */
-	acquirewrite_mrsw(&d->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	index_snapshot_preserve_atime(d);
 	get_current_timespec(&d->access_time);
-	releasewrite_mrsw(&d->meta_lock);
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 	ltfs_set_index_dirty(true, true, vol->index);
 
 out_unlock:
-	releaseread_mrsw(&d->contents_lock);
+	releaseread_mrsw(&fs_dentry_locks(d)->contents_lock);
 	if (NEED_REVAL(ret)) {
 		tape_start_fence(vol->device);
 		tape_device_unlock(vol->device);
@@ -766,10 +863,31 @@ int ltfs_fsraw_truncate(struct dentry *d, off_t length, struct ltfs_volume *vol)
 	ret = ltfs_get_volume_lock(false, vol);
 	if (ret < 0)
 		return ret;
-	acquirewrite_mrsw(&d->contents_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
+	index_snapshot_preserve(d);
 
 	new_realsize = d->realsize;
 
+	/* A packed extent list is only truncated in place if the last extent is the only one
+	 * to change */
+	if (ulength < d->size && d->extent_pack) {
+		entry = extent_pack_tail(d->extent_pack);
+		if (entry->fileoffset < ulength) {
+			entry_fileoffset_last = entry->fileoffset + entry->bytecount;
+			if (entry_fileoffset_last > ulength) {
+				new_realsize -= entry_fileoffset_last - ulength;
+				entry->bytecount = ulength - entry->fileoffset;
+			}
+		} else {
+			ret = fs_unpack_extents(d);
+			if (ret < 0) {
+				releasewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
+				releaseread_mrsw(&vol->lock);
+				return ret;
+			}
+		}
+	}
+
 	/* Truncate the extent list if necessary */
 	if (ulength < d->size && ! TAILQ_EMPTY(&d->extentlist)) {
 		TAILQ_FOREACH_REVERSE_SAFE(entry, &d->extentlist, extent_struct, list, preventry) {
@@ -788,17 +906,18 @@ int ltfs_fsraw_truncate(struct dentry *d, off_t length, struct ltfs_volume *vol)
 	}
 
 	/* Update size, realsize and times */
-	acquirewrite_mrsw(&d->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 	d->size = ulength;
 	d->realsize = new_realsize;
 	get_current_timespec(&d->modify_time);
 	d->change_time = d->modify_time;
-	releasewrite_mrsw(&d->meta_lock);
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 
-	releasewrite_mrsw(&d->contents_lock);
+	releasewrite_mrsw(&fs_dentry_locks(d)->contents_lock);
 
 	ltfs_set_index_dirty(true, false, vol->index);
 	d->dirty = true;
+	ltfs_notify_dentry(d, vol);
 
 	releaseread_mrsw(&vol->lock);
 	return 0;
@@ -817,9 +936,9 @@ struct dentry *ltfs_fsraw_get_dentry(struct dentry *d, struct ltfs_volume *vol)
 	if (dcache_initialized(vol)) {
 		dcache_get_dentry(d, vol);
 	} else {
-		acquirewrite_mrsw(&d->meta_lock);
+		acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 		d->numhandles++;
-		releasewrite_mrsw(&d->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 	}
 	releaseread_mrsw(&vol->lock);
 	return d;
@@ -61,6 +61,8 @@
 #include "iosched.h"
 #include "ltfs_fsops.h"
 #include "xattr.h"
+#include "path_cache.h"
+#include "index_snapshot.h"
 
 /**
  * Allocate an empty LTFS index.
@@ -119,6 +121,22 @@ int ltfs_index_alloc(struct ltfs_index **index, struct ltfs_volume *vol)
 	newindex->root->link_count++; /* Root dentry has an extra link from its implicit parent */
 	newindex->root->vol = vol;
 
+#ifndef mingw_PLATFORM
+	/* Names are looked up caselessly on Windows, so one dentry may be cached under several paths
+	 * and invalidating by path would not be enough. */
+	ret = path_cache_create(&newindex->path_cache, PATH_CACHE_MAX_ENTRIES);
+	if (ret < 0) {
+		ltfs_index_free(&newindex);
+		return ret;
+	}
+#endif
+
+	ret = index_snapshot_create(&newindex->snapshot);
+	if (ret < 0) {
+		ltfs_index_free(&newindex);
+		return ret;
+	}
+
 	newindex->symerr_count = 0;
 	newindex->symlink_conflict = NULL;
 
@@ -139,8 +157,11 @@ void _ltfs_index_free(bool force, struct ltfs_index **index)
 		ltfs_mutex_unlock(&(*index)->refcount_lock);
 		ltfs_mutex_destroy(&(*index)->refcount_lock);
 
+		path_cache_free(&(*index)->path_cache);
 		if ((*index)->root)
 			fs_release_dentry((*index)->root);
+		index_spill_free(&(*index)->spill);
+		index_snapshot_free(&(*index)->snapshot);
 		ltfs_mutex_destroy(&(*index)->dirty_lock);
 		ltfs_mutex_destroy(&(*index)->rename_lock);
 
@@ -165,6 +186,130 @@ void _ltfs_index_free(bool force, struct ltfs_index **index)
 		ltfs_mutex_unlock(&(*index)->refcount_lock);
 }
 
+/**
+ * Capture an index which can be serialized without holding the volume lock.
+ * The copy holds the index header fields; the dentry tree is shared with the live index
+ * and read through its copy-on-write snapshot (see index_snapshot.c), which starts here.
+ * It must be freed with ltfs_index_snapshot_free.
+ * The caller must hold the volume lock for write.
+ * @param index Index to capture.
+ * @param[out] snapshot On success, the newly allocated copy.
+ * @return 0 on success or a negative value on error.
+ */
+int ltfs_index_snapshot(struct ltfs_index *index, struct ltfs_index **snapshot)
+{
+	int ret;
+	size_t i;
+	struct ltfs_index *snap;
+
+	CHECK_ARG_NULL(index, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(snapshot, -LTFS_NULL_ARG);
+
+	snap = calloc(1, sizeof(struct ltfs_index));
+	if (! snap) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+
+	memcpy(snap->vol_uuid, index->vol_uuid, sizeof(snap->vol_uuid));
+	snap->generation = index->generation;
+	snap->mod_time = index->mod_time;
+	snap->selfptr = index->selfptr;
+	snap->backptr = index->backptr;
+	snap->criteria_allow_update = index->criteria_allow_update;
+	snap->file_count = index->file_count;
+	snap->uid_number = index->uid_number;
+	snap->valid_blocks = index->valid_blocks;
+	snap->version = index->version;
+	snap->vollock = index->vollock;
+	snap->refcount = 1;
+
+	if (index->creator) {
+		snap->creator = arch_strdup(index->creator);
+		if (! snap->creator)
+			goto out_nomem;
+	}
+	snap->volume_name.percent_encode = index->volume_name.percent_encode;
+	if (index->volume_name.name) {
+		snap->volume_name.name = arch_strdup(index->volume_name.name);
+		if (! snap->volume_name.name)
+			goto out_nomem;
+	}
+	if (index->commit_message) {
+		snap->commit_message = arch_strdup(index->commit_message);
+		if (! snap->commit_message)
+			goto out_nomem;
+	}
+	if (index->tag_count > 0) {
+		snap->preserved_tags = calloc(index->tag_count, sizeof(unsigned char *));
+		if (! snap->preserved_tags)
+			goto out_nomem;
+		for (i=0; i<index->tag_count; ++i) {
+			snap->preserved_tags[i] = (unsigned char *) arch_strdup((char *) index->preserved_tags[i]);
+			if (! snap->preserved_tags[i])
+				goto out_nomem;
+			++snap->tag_count;
+		}
+	}
+
+	ret = index_criteria_dup_rules(&snap->original_criteria, &index->original_criteria);
+	if (ret < 0)
+		goto out_free;
+
+	snap->root = index->root;
+	snap->snapshot = index->snapshot;
+	snap->is_snapshot = true;
+	index_snapshot_begin(snap->snapshot);
+
+	ltfsmsg(LTFS_DEBUG, 17295D, snap->generation);
+
+	*snapshot = snap;
+	return 0;
+
+out_nomem:
+	ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+	ret = -LTFS_NO_MEMORY;
+out_free:
+	ltfs_index_snapshot_free(&snap, false);
+	return ret;
+}
+
+/**
+ * Free an index copy created by ltfs_index_snapshot and end its snapshot.
+ * Dentries removed from the name tree during the snapshot stay referenced until
+ * index_snapshot_release_held is called on the live index.
+ * @param snapshot Index copy to free. Set to NULL on return.
+ * @param written True if the index was written from the copy.
+ * @return 0 on success, or a negative value if the snapshot was not consistent.
+ */
+int ltfs_index_snapshot_free(struct ltfs_index **snapshot, bool written)
+{
+	int ret = 0;
+	size_t i;
+
+	if (! snapshot || ! *snapshot)
+		return 0;
+
+	if ((*snapshot)->is_snapshot)
+		ret = index_snapshot_end((*snapshot)->snapshot, written);
+	if ((*snapshot)->tag_count > 0) {
+		for (i=0; i<(*snapshot)->tag_count; ++i)
+			free((*snapshot)->preserved_tags[i]);
+	}
+	if ((*snapshot)->preserved_tags)
+		free((*snapshot)->preserved_tags);
+	index_criteria_free(&((*snapshot)->original_criteria));
+	if ((*snapshot)->commit_message)
+		free((*snapshot)->commit_message);
+	if ((*snapshot)->volume_name.name)
+		free((*snapshot)->volume_name.name);
+	if ((*snapshot)->creator)
+		free((*snapshot)->creator);
+	free(*snapshot);
+	*snapshot = NULL;
+	return ret;
+}
+
 /**
  * Read label from a tape, storing the information in a volume structure.
  * @param vol the volume
@@ -379,16 +524,43 @@ out_free:
 }
 
 /**
- * Read an index file from tape at the current position, storing the result in the given volume.
- * The volume structure must already contain valid label data (blocksize and volume UUID).
- * This function does not read over another file mark
- * @param eod_pos EOD position for current partition, or 0 to assume that EOD will not be
- *                encountered during parsing.
- * @param vol the volume
- * @return 0 on success, 1 if index file does not end with a file mark (but is otherwise valid),
- *         or a negative value on error.
+ * Check the self pointer and perform basic sanity checks on the back pointer of an index.
+ * @param idx Index to check.
+ * @param partition Partition the index was read from.
+ * @param block Block the index starts at.
+ * @param vol LTFS volume. The label field must be populated with a partition map.
+ * @return 0 if the pointers are sane or -LTFS_INDEX_INVALID.
  */
-int ltfs_read_index(uint64_t eod_pos, bool recover_symlink, struct ltfs_volume *vol)
+int ltfs_check_index_pointers(struct ltfs_index *idx, char partition, tape_block_t block,
+	struct ltfs_volume *vol)
+{
+	/* check self pointer */
+	if (idx->selfptr.partition != partition || idx->selfptr.block != block) {
+		ltfsmsg(LTFS_WARN, 11196W);
+		return -LTFS_INDEX_INVALID;
+	}
+
+	/* basic back pointer checks */
+	if (idx->backptr.partition != 0 &&
+		idx->backptr.partition != vol->label->partid_dp) {
+		ltfsmsg(LTFS_ERR, 11197E);
+		return -LTFS_INDEX_INVALID;
+	} else if (idx->backptr.partition == idx->selfptr.partition &&
+		idx->selfptr.block != 5 &&
+		idx->backptr.block != idx->selfptr.block &&
+		idx->backptr.block >= idx->selfptr.block - 2 ) {
+		ltfsmsg(LTFS_ERR, 11197E);
+		return -LTFS_INDEX_INVALID;
+	} else if (idx->backptr.partition != 0 && idx->backptr.block < 5) {
+		ltfsmsg(LTFS_ERR, 11197E);
+		return -LTFS_INDEX_INVALID;
+	}
+
+	return 0;
+}
+
+static int _ltfs_read_index(uint64_t eod_pos, bool recover_symlink, bool header_only,
+	struct ltfs_volume *vol)
 {
 	int ret, ret_sym;
 	struct tc_position pos;
@@ -410,7 +582,10 @@ int ltfs_read_index(uint64_t eod_pos, bool recover_symlink, struct ltfs_volume *
 	}
 
 	/* Parse and validate the schema */
-	ret = xml_schema_from_tape(eod_pos, vol);
+	if (header_only)
+		ret = xml_schema_header_from_tape(eod_pos, vol);
+	else
+		ret = xml_schema_from_tape(eod_pos, vol);
 	if ( vol->index->symerr_count ) {
 		if ( recover_symlink ) {
 			ret_sym = ltfs_split_symlink( vol );
@@ -438,28 +613,10 @@ int ltfs_read_index(uint64_t eod_pos, bool recover_symlink, struct ltfs_volume *
 		return -LTFS_INDEX_INVALID;
 	}
 
-	/* check self pointer */
-	if (vol->index->selfptr.partition != vol->label->part_num2id[pos.partition] ||
-		vol->index->selfptr.block != pos.block) {
-		ltfsmsg(LTFS_WARN, 11196W);
-		return -LTFS_INDEX_INVALID;
-	}
-
-	/* basic back pointer checks */
-	if (vol->index->backptr.partition != 0 &&
-		vol->index->backptr.partition != vol->label->partid_dp) {
-		ltfsmsg(LTFS_ERR, 11197E);
-		return -LTFS_INDEX_INVALID;
-	} else if (vol->index->backptr.partition == vol->index->selfptr.partition &&
-		vol->index->selfptr.block != 5 &&
-		vol->index->backptr.block != vol->index->selfptr.block &&
-		vol->index->backptr.block >= vol->index->selfptr.block - 2 ) {
-		ltfsmsg(LTFS_ERR, 11197E);
-		return -LTFS_INDEX_INVALID;
-	} else if (vol->index->backptr.partition != 0 && vol->index->backptr.block < 5) {
-		ltfsmsg(LTFS_ERR, 11197E);
-		return -LTFS_INDEX_INVALID;
-	}
+	ret = ltfs_check_index_pointers(vol->index, vol->label->part_num2id[pos.partition], pos.block,
+		vol);
+	if (ret < 0)
+		return ret;
 
 	/* space forward 1 FM if possible */
 	if (end_fm) {
@@ -473,6 +630,37 @@ int ltfs_read_index(uint64_t eod_pos, bool recover_symlink, struct ltfs_volume *
 	return end_fm ? 0 : 1;
 }
 
+/**
+ * Read an index file from tape at the current position, storing the result in the given volume.
+ * The volume structure must already contain valid label data (blocksize and volume UUID).
+ * This function does not read over another file mark
+ * @param eod_pos EOD position for current partition, or 0 to assume that EOD will not be
+ *                encountered during parsing.
+ * @param vol the volume
+ * @return 0 on success, 1 if index file does not end with a file mark (but is otherwise valid),
+ *         or a negative value on error.
+ */
+int ltfs_read_index(uint64_t eod_pos, bool recover_symlink, struct ltfs_volume *vol)
+{
+	return _ltfs_read_index(eod_pos, recover_symlink, false, vol);
+}
+
+/**
+ * Read only the header of an index file from tape at the current position, storing the result
+ * in the given volume. The directory tree is not built, and the tape is spaced over the rest
+ * of the index file instead of reading it, so vol->index has no contents besides the root.
+ * Otherwise this behaves like ltfs_read_index.
+ * @param eod_pos EOD position for current partition, or 0 to assume that EOD will not be
+ *                encountered during parsing.
+ * @param vol the volume
+ * @return 0 on success, 1 if index file does not end with a file mark (but is otherwise valid),
+ *         or a negative value on error.
+ */
+int ltfs_read_index_header(uint64_t eod_pos, struct ltfs_volume *vol)
+{
+	return _ltfs_read_index(eod_pos, false, true, vol);
+}
+
 /**
  * Returns true iff a given char corresponds to a valid logical partition ID.
  */
@@ -613,10 +801,17 @@ int _ltfs_check_extents(struct dentry *d, tape_block_t ip_eod, tape_block_t dp_e
 	struct ltfs_volume *vol)
 {
 	int ret;
-	struct extent_info *ext;
+	struct fs_extent_iter iter;
+	const struct extent_info *ext;
 	tape_block_t ext_lastblock;
 	struct name_list *list, *tmp;
 
+	if (d->isdir) {
+		ret = index_spill_load(d, false);
+		if (ret < 0)
+			return ret;
+	}
+
 	if (d->isdir && HASH_COUNT(d->child_list) != 0) {
 		HASH_ITER(hh, d->child_list, list, tmp) {
 			ret = _ltfs_check_extents(list->d, ip_eod, dp_eod, vol);
@@ -624,8 +819,8 @@ int _ltfs_check_extents(struct dentry *d, tape_block_t ip_eod, tape_block_t dp_e
 				return ret;
 		}
 
-	} else if (! TAILQ_EMPTY(&d->extentlist)) {
-		TAILQ_FOREACH(ext, &d->extentlist, list) {
+	} else if (fs_has_extents(d)) {
+		for (ext = fs_extent_first(d, &iter); ext; ext = fs_extent_next(d, &iter)) {
 			ext_lastblock = ext->start.block + ext->bytecount / vol->label->blocksize;
 			ext_lastblock += (ext->bytecount % vol->label->blocksize > 0) ? 1 : 0;
 			if (ext->start.block < 4)
@@ -726,17 +921,23 @@ int _ltfs_check_pointers(struct ltfs_index *ip_index, struct ltfs_index *dp_inde
 void _ltfs_last_ref(struct dentry *d, tape_block_t *dp_last, tape_block_t *ip_last,
 	struct ltfs_volume *vol)
 {
-	struct extent_info *ext;
+	struct fs_extent_iter iter;
+	const struct extent_info *ext;
 	tape_block_t ext_lastblock;
 	struct name_list *list, *tmp;
 
+	/* A directory which cannot be loaded is treated as empty, so its blocks are not
+	 * counted as referenced */
+	if (d->isdir)
+		index_spill_load(d, false);
+
 	if (d->isdir && HASH_COUNT(d->child_list) != 0) {
 		HASH_ITER(hh, d->child_list, list, tmp) {
 			_ltfs_last_ref(list->d, dp_last, ip_last, vol);
 		}
 
-	} else if (! TAILQ_EMPTY(&d->extentlist)) {
-		TAILQ_FOREACH(ext, &d->extentlist, list) {
+	} else if (fs_has_extents(d)) {
+		for (ext = fs_extent_first(d, &iter); ext; ext = fs_extent_next(d, &iter)) {
 			ext_lastblock = ext->start.block + ext->bytecount / vol->label->blocksize;
 			ext_lastblock += (ext->bytecount % vol->label->blocksize > 0) ? 1 : 0;
 			if (ext->start.partition == vol->label->partid_ip && ext_lastblock > *ip_last)
@@ -883,6 +1084,10 @@ int _ltfs_populate_lost_found(char partition, tape_block_t part_lastref,
 					}
 				}
 
+				ret = fs_prepare_dentry_locks(file);
+				if (ret < 0)
+					goto out_free;
+
 				ext = calloc(1, sizeof(struct extent_info));
 				if (! ext) {
 					ltfsmsg(LTFS_ERR, 10001E, "_ltfs_populate_lost_found: extent");
@@ -890,8 +1095,8 @@ int _ltfs_populate_lost_found(char partition, tape_block_t part_lastref,
 					goto out_free;
 				}
 
-				acquirewrite_mrsw(&file->contents_lock);
-				acquirewrite_mrsw(&file->meta_lock);
+				acquirewrite_mrsw(&fs_dentry_locks(file)->contents_lock);
+				acquirewrite_mrsw(&fs_dentry_locks(file)->meta_lock);
 				if (! dcache_enabled)
 					++file->numhandles;
 				get_current_timespec(&file->creation_time);
@@ -904,6 +1109,7 @@ int _ltfs_populate_lost_found(char partition, tape_block_t part_lastref,
 
 				ltfs_set_index_dirty(true, false, vol->index);
 				file->matches_name_criteria = false;
+				file->name_criteria_checked = true;
 				file->readonly = true;
 				file->size = nr;
 				file->realsize = nr;
@@ -914,7 +1120,7 @@ int _ltfs_populate_lost_found(char partition, tape_block_t part_lastref,
 				ext->bytecount = nr;
 				ext->fileoffset = 0;
 				TAILQ_INSERT_TAIL(&file->extentlist, ext, list);
-				releasewrite_mrsw(&file->contents_lock);
+				releasewrite_mrsw(&fs_dentry_locks(file)->contents_lock);
 
 				if (dcache_enabled)
 					dcache_close(file, false, true, vol);
@@ -942,6 +1148,8 @@ out_free:
 			dcache_close(lf_dir, true, lfdir_descend, vol);
 	} else
 		fs_release_dentry(lf_dir);
+	/* The lost and found directory was populated without going through ltfs_fsops_create */
+	path_cache_invalidate(vol->index->path_cache, "/"LTFS_LOSTANDFOUND_DIR, true);
 	free(buf);
 	return ret;
 }
@@ -1014,9 +1222,14 @@ int ltfs_check_medium(bool fix, bool deep, bool recover_extra, bool recover_syml
 	tape_block_t lastblock_d = 0, lastblock_i = 0;
 	tape_partition_t ip_num, dp_num;
 	struct ltfs_index *dp_index = NULL, *ip_index = NULL;;
+	bool lazy_index;
 
 	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
 
+	/* Both partitions' indexes are compared and merged here, so build them completely */
+	lazy_index = vol->lazy_index;
+	vol->lazy_index = false;
+
 	ip_num = ltfs_part_id2num(ltfs_ip_id(vol), vol);
 	dp_num = ltfs_part_id2num(ltfs_dp_id(vol), vol);
 
@@ -1215,6 +1428,7 @@ out_unlock:
 	if (dp_have_index && vol->index != dp_index)
 		ltfs_index_free(&dp_index);
 
+	vol->lazy_index = lazy_index;
 	return ret;
 }
 
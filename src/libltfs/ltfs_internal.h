@@ -66,11 +66,17 @@ void _ltfs_index_free(bool force, struct ltfs_index **index);
 #define ltfs_index_free_force(idx)				\
 	_ltfs_index_free(true, idx)
 
+int ltfs_index_snapshot(struct ltfs_index *index, struct ltfs_index **snapshot);
+int ltfs_index_snapshot_free(struct ltfs_index **snapshot, bool written);
+
 int ltfs_check_medium(bool fix, bool deep, bool recover_extra, bool recover_symlink, struct ltfs_volume *vol);
 int ltfs_read_labels(bool trial, struct ltfs_volume *vol);
 int ltfs_read_one_label(tape_partition_t partition, struct ltfs_label *label,
 	struct ltfs_volume *vol);
 int ltfs_read_index(uint64_t eod_pos, bool recover_symlink, struct ltfs_volume *vol);
+int ltfs_read_index_header(uint64_t eod_pos, struct ltfs_volume *vol);
+int ltfs_check_index_pointers(struct ltfs_index *idx, char partition, tape_block_t block,
+	struct ltfs_volume *vol);
 
 int ltfs_update_cart_coherency(struct ltfs_volume *vol);
 int ltfs_write_index_conditional(char partition, struct ltfs_volume *vol);
@@ -65,6 +65,53 @@ extern "C" {
 	#endif
 #endif
 
+#include <errno.h>
+#include "ltfs_locking_profile.h"
+
+/**
+ * Lock a mutex, counting the acquisition under a class of the lock profiler.
+ * @param mutex Mutex to lock.
+ * @param lock_class Profiling class of the mutex.
+ * @param hold_start Set to the time the mutex was granted if the acquisition was profiled.
+ *                   Pass the same variable to ltfs_mutex_unlock_profiled().
+ * @return 0 on success or an error code of ltfs_mutex_lock().
+ */
+static inline int ltfs_mutex_lock_profiled(ltfs_mutex_t *mutex, uint32_t lock_class, uint64_t *hold_start)
+{
+	uint64_t start;
+	bool contended = false;
+	int ret;
+
+	if (! lock_profile_active(lock_class))
+		return ltfs_mutex_lock(mutex);
+
+	start = lock_profile_now();
+	ret = ltfs_mutex_trylock(mutex);
+	if (ret == EBUSY) {
+		contended = true;
+		ret = ltfs_mutex_lock(mutex);
+	}
+	if (! ret)
+		*hold_start = lock_profile_acquired(lock_class, start, contended);
+	return ret;
+}
+
+/**
+ * Unlock a mutex locked by ltfs_mutex_lock_profiled().
+ * @param mutex Mutex to unlock.
+ * @param lock_class Profiling class of the mutex.
+ * @param hold_start Variable passed to ltfs_mutex_lock_profiled().
+ * @return 0 on success or an error code of ltfs_mutex_unlock().
+ */
+static inline int ltfs_mutex_unlock_profiled(ltfs_mutex_t *mutex, uint32_t lock_class, uint64_t *hold_start)
+{
+	if (*hold_start) {
+		lock_profile_released(lock_class, *hold_start);
+		*hold_start = 0;
+	}
+	return ltfs_mutex_unlock(mutex);
+}
+
 #ifdef __cplusplus
 }
 #endif
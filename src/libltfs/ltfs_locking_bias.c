@@ -0,0 +1,101 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       ltfs_locking_bias.c
+**
+** DESCRIPTION:     Writer side of the reader bias for Multi-reader single-writer
+**                  locks. See ltfs_locking_bias.h.
+**
+*************************************************************************************
+*/
+
+#include <sched.h>
+
+#include "libltfs/ltfs.h"
+#include "libltfs/ltfs_locking_bias.h"
+
+/* After a revocation, keep the bias off for this many times the revocation took */
+#define MRSW_BIAS_INHIBIT_FACTOR (9)
+
+struct mrsw_bias_slot mrsw_bias_table[MRSW_BIAS_SLOTS];
+
+static uint64_t _mrsw_bias_now(void)
+{
+	struct ltfs_timespec now;
+
+	get_current_timespec(&now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Clear the bias of a lock and wait for the readers which hold it through the table.
+ * The caller must hold the underlying lock for write, so that no reader sets the bias again.
+ * @param lock Lock being acquired for write.
+ * @param bias Bias state of the lock.
+ */
+void mrsw_bias_revoke(void *lock, struct mrsw_bias *bias)
+{
+	size_t i;
+	uint64_t start, end;
+
+	if (! bias->enabled || ! __atomic_load_n(&bias->rbias, __ATOMIC_RELAXED))
+		return;
+
+	start = _mrsw_bias_now();
+	__atomic_store_n(&bias->rbias, 0, __ATOMIC_SEQ_CST);
+	for (i = 0; i < MRSW_BIAS_SLOTS; ++i) {
+		while (__atomic_load_n(&mrsw_bias_table[i].lock, __ATOMIC_SEQ_CST) == lock)
+			sched_yield();
+	}
+	end = _mrsw_bias_now();
+	bias->inhibit_until = end + (end - start) * MRSW_BIAS_INHIBIT_FACTOR;
+}
+
+/**
+ * Set the bias of a lock again once the inhibition period after the last revocation is over.
+ * The caller must hold the underlying lock for read.
+ * @param bias Bias state of the lock.
+ */
+void mrsw_bias_restore(struct mrsw_bias *bias)
+{
+	if (! bias->enabled || __atomic_load_n(&bias->rbias, __ATOMIC_RELAXED))
+		return;
+
+	if (_mrsw_bias_now() >= bias->inhibit_until)
+		__atomic_store_n(&bias->rbias, 1, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,200 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       ltfs_locking_bias.h
+**
+** DESCRIPTION:     Reader bias for Multi-reader single-writer locks.
+**
+**                  A reader of a biased lock does not touch the lock itself. It
+**                  claims a slot of a process wide table, keyed by the lock and
+**                  the thread, and checks that the bias is still set. A writer
+**                  takes the underlying lock, clears the bias and waits until no
+**                  slot refers to the lock. Readers that find the bias cleared
+**                  take the underlying lock as before, and set the bias again
+**                  once a time proportional to the last revocation has passed,
+**                  so write-heavy phases fall back to the plain lock.
+**                  See D. Dice and A. Kogan, "BRAVO: Biased Locking for
+**                  Reader-Writer Locks", USENIX ATC 2019.
+**
+*************************************************************************************
+*/
+
+#ifndef __LTFS_LOCKING_BIAS_H__
+#define __LTFS_LOCKING_BIAS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* A writer scans the whole table, so it is sized for the number of threads which read a
+ * biased lock at once rather than for the number of locks. A reader which finds its slot
+ * taken uses the underlying lock. */
+#define MRSW_BIAS_SLOT_BITS  (8)
+#define MRSW_BIAS_SLOTS      (1 << MRSW_BIAS_SLOT_BITS)
+#define MRSW_BIAS_CACHE_LINE (64)
+
+/**
+ * Slot of the visible readers table. The lock field is claimed with a compare-and-swap;
+ * the other fields are written only by the thread which claimed it. Each slot has a cache
+ * line of its own, so that readers on different slots do not share lines.
+ */
+struct mrsw_bias_slot {
+	void      *lock;  /**< Lock read through this slot, or NULL */
+	pthread_t owner;  /**< Thread which claimed the slot, valid while 'owned' is set */
+	uint32_t  owned;  /**< Set after 'owner' is written, cleared before 'lock' */
+	uint32_t  depth;  /**< Nested acquisitions by the owner beyond the first */
+} __attribute__((aligned(MRSW_BIAS_CACHE_LINE)));
+
+/**
+ * Bias state embedded in a lock.
+ */
+struct mrsw_bias {
+	uint32_t enabled;       /**< Lock may be biased at all. Set at initialization only */
+	uint32_t rbias;         /**< Readers may use the table instead of the lock */
+	uint64_t inhibit_until; /**< Slow readers leave rbias clear until this time (ns) */
+};
+
+extern struct mrsw_bias_slot mrsw_bias_table[MRSW_BIAS_SLOTS];
+
+void mrsw_bias_revoke(void *lock, struct mrsw_bias *bias);
+void mrsw_bias_restore(struct mrsw_bias *bias);
+
+static inline struct mrsw_bias_slot *_mrsw_bias_slot(void *lock, pthread_t self)
+{
+	/* The low bits of thread and lock addresses vary little, so take the high bits */
+	uint64_t h = ((uint64_t)(uintptr_t)lock ^ ((uint64_t)(uintptr_t)self >> 12)) * 0x9E3779B97F4A7C15ULL;
+	return &mrsw_bias_table[h >> (64 - MRSW_BIAS_SLOT_BITS)];
+}
+
+static inline bool _mrsw_bias_owned(struct mrsw_bias_slot *slot, void *lock, pthread_t self)
+{
+	return __atomic_load_n(&slot->lock, __ATOMIC_RELAXED) == lock
+		&& __atomic_load_n(&slot->owned, __ATOMIC_ACQUIRE)
+		&& pthread_equal(slot->owner, self);
+}
+
+static inline void mrsw_bias_init(struct mrsw_bias *bias)
+{
+	bias->enabled = 0;
+	bias->rbias = 0;
+	bias->inhibit_until = 0;
+}
+
+static inline void mrsw_bias_enable(struct mrsw_bias *bias)
+{
+	bias->enabled = 1;
+	bias->rbias = 1;
+}
+
+/**
+ * Try to take a read lock through the visible readers table.
+ * @return true if the read lock is held, false if the caller must take the underlying lock.
+ */
+static inline bool mrsw_bias_acquire(void *lock, struct mrsw_bias *bias)
+{
+	pthread_t self;
+	struct mrsw_bias_slot *slot;
+	void *expected = NULL;
+
+	if (! bias->enabled)
+		return false;
+
+	self = pthread_self();
+	slot = _mrsw_bias_slot(lock, self);
+
+	/* A nested acquisition must not wait for a writer, which waits for this slot */
+	if (_mrsw_bias_owned(slot, lock, self)) {
+		++slot->depth;
+		return true;
+	}
+
+	if (! __atomic_load_n(&bias->rbias, __ATOMIC_RELAXED))
+		return false;
+	if (! __atomic_compare_exchange_n(&slot->lock, &expected, lock, false,
+									  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return false;
+	slot->owner = self;
+	slot->depth = 0;
+	__atomic_store_n(&slot->owned, 1, __ATOMIC_RELEASE);
+
+	/* Pairs with the store in mrsw_bias_revoke: either the writer sees this slot, or this
+	 * thread sees the bias cleared */
+	if (__atomic_load_n(&bias->rbias, __ATOMIC_SEQ_CST))
+		return true;
+
+	__atomic_store_n(&slot->owned, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->lock, NULL, __ATOMIC_RELEASE);
+	return false;
+}
+
+/**
+ * Release a read lock taken through the visible readers table.
+ * @return true if the read lock was held through the table, false if the caller must
+ *         release the underlying lock.
+ */
+static inline bool mrsw_bias_release(void *lock, struct mrsw_bias *bias)
+{
+	pthread_t self;
+	struct mrsw_bias_slot *slot;
+
+	if (! bias->enabled)
+		return false;
+
+	self = pthread_self();
+	slot = _mrsw_bias_slot(lock, self);
+	if (! _mrsw_bias_owned(slot, lock, self))
+		return false;
+
+	if (slot->depth)
+		--slot->depth;
+	else {
+		__atomic_store_n(&slot->owned, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->lock, NULL, __ATOMIC_RELEASE);
+	}
+	return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LTFS_LOCKING_BIAS_H__ */
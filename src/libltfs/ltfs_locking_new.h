@@ -64,6 +64,9 @@ extern "C" {
 #include <execinfo.h> /* For backtrace() */
 #include <unistd.h>
 
+#include "ltfs_locking_bias.h"
+#include "ltfs_locking_profile.h"
+
 /* Use struct for checking wrong usage of ltfs_mutex and ltfs_thread_mutex by compliter */
 typedef struct {
 	pthread_mutex_t lock;
@@ -152,6 +155,9 @@ typedef struct MultiReaderSingleWriter {
 	pthread_rwlock_t rw_lock;
 	uint32_t         writer; //if there is a write lock acquired
 	uint32_t         long_lock;
+	struct mrsw_bias bias;      /**< Reader bias, see ltfs_locking_bias.h */
+	uint32_t         lock_class; /**< Profiling class, see ltfs_locking_profile.h */
+	uint64_t         hold_start; /**< Time the profiled write lock was granted, or 0 */
 } MultiReaderSingleWriter;
 
 static inline int
@@ -161,6 +167,9 @@ init_mrsw(MultiReaderSingleWriter *mrsw)
 
 	mrsw->writer = 0;
 	mrsw->long_lock = 0;
+	mrsw->lock_class = LOCK_CLASS_NONE;
+	mrsw->hold_start = 0;
+	mrsw_bias_init(&mrsw->bias);
 	ret = ltfs_mutex_init(&mrsw->exclusive_mutex);
 	if (ret)
 		return -ret;
@@ -181,8 +190,22 @@ destroy_mrsw(MultiReaderSingleWriter *mrsw)
 	ltfs_mutex_destroy(&mrsw->exclusive_mutex);
 }
 
+/* Let readers of a heavily read lock bypass it while no writer is around */
+static inline void
+enable_reader_bias_mrsw(MultiReaderSingleWriter *mrsw)
+{
+	mrsw_bias_enable(&mrsw->bias);
+}
+
+/* Count acquisitions of this lock under the given class of the lock profiler */
+static inline void
+set_lock_class_mrsw(MultiReaderSingleWriter *mrsw, uint32_t lock_class)
+{
+	mrsw->lock_class = lock_class;
+}
+
 static inline bool
-try_acquirewrite_mrsw(MultiReaderSingleWriter *mrsw)
+_try_acquirewrite_mrsw(MultiReaderSingleWriter *mrsw)
 {
 	int err;
 	err = ltfs_mutex_trylock(&mrsw->exclusive_mutex);
@@ -194,45 +217,121 @@ try_acquirewrite_mrsw(MultiReaderSingleWriter *mrsw)
 		ltfs_mutex_unlock(&mrsw->exclusive_mutex);
 		return false;
 	}
+	mrsw_bias_revoke(mrsw, &mrsw->bias);
 	mrsw->writer=1;
 	return true;
 }
 
+static inline bool
+try_acquirewrite_mrsw(MultiReaderSingleWriter *mrsw)
+{
+	if (! _try_acquirewrite_mrsw(mrsw))
+		return false;
+	if (lock_profile_active(mrsw->lock_class))
+		mrsw->hold_start = lock_profile_acquired(mrsw->lock_class, lock_profile_now(), false);
+	return true;
+}
+
+static inline void
+_acquirewrite_mrsw(MultiReaderSingleWriter *mrsw)
+{
+	uint64_t start;
+	bool contended = false;
+
+	if (! lock_profile_active(mrsw->lock_class)) {
+		ltfs_mutex_lock(&mrsw->exclusive_mutex);
+		pthread_rwlock_wrlock(&mrsw->rw_lock);
+		mrsw_bias_revoke(mrsw, &mrsw->bias);
+		mrsw->writer=1;
+		return;
+	}
+
+	start = lock_profile_now();
+	if (! _try_acquirewrite_mrsw(mrsw)) {
+		contended = true;
+		ltfs_mutex_lock(&mrsw->exclusive_mutex);
+		pthread_rwlock_wrlock(&mrsw->rw_lock);
+		mrsw_bias_revoke(mrsw, &mrsw->bias);
+		mrsw->writer=1;
+	}
+	mrsw->hold_start = lock_profile_acquired(mrsw->lock_class, start, contended);
+}
+
+/* End the timed hold of a profiled write lock, if any */
+static inline void
+_release_profile_mrsw(MultiReaderSingleWriter *mrsw)
+{
+	if (mrsw->hold_start) {
+		lock_profile_released(mrsw->lock_class, mrsw->hold_start);
+		mrsw->hold_start = 0;
+	}
+}
+
 static inline void
 acquirewrite_mrsw(MultiReaderSingleWriter *mrsw)
 {
-	ltfs_mutex_lock(&mrsw->exclusive_mutex);
-	pthread_rwlock_wrlock(&mrsw->rw_lock);
-	mrsw->writer=1;
+	_acquirewrite_mrsw(mrsw);
 	mrsw->long_lock=0;
 }
 
 static inline void
 acquirewrite_mrsw_long(MultiReaderSingleWriter *mrsw)
 {
-	ltfs_mutex_lock(&mrsw->exclusive_mutex);
-	pthread_rwlock_wrlock(&mrsw->rw_lock);
-	mrsw->writer=1;
+	_acquirewrite_mrsw(mrsw);
 	mrsw->long_lock=1;
 }
 
 static inline void
 releasewrite_mrsw(MultiReaderSingleWriter *mrsw)
 {
+	_release_profile_mrsw(mrsw);
 	mrsw->writer=0;
 	mrsw->long_lock=0;
 	pthread_rwlock_unlock(&mrsw->rw_lock);
 	ltfs_mutex_unlock(&mrsw->exclusive_mutex);
 }
 
+/* Take a read lock of a profiled lock, counting whether a writer made it wait */
+static inline void
+_acquireread_mrsw_profiled(MultiReaderSingleWriter *mrsw)
+{
+	uint64_t start = lock_profile_now();
+	bool contended = false;
+
+	if (! mrsw_bias_acquire(mrsw, &mrsw->bias)) {
+		if (ltfs_mutex_trylock(&mrsw->exclusive_mutex)) {
+			contended = true;
+			ltfs_mutex_lock(&mrsw->exclusive_mutex);
+		}
+		mrsw->long_lock=0;
+		ltfs_mutex_unlock(&mrsw->exclusive_mutex);
+
+		if (pthread_rwlock_tryrdlock(&mrsw->rw_lock)) {
+			contended = true;
+			pthread_rwlock_rdlock(&mrsw->rw_lock);
+		}
+		mrsw_bias_restore(&mrsw->bias);
+	}
+	lock_profile_acquired(mrsw->lock_class, start, contended);
+}
+
 static inline void
 acquireread_mrsw(MultiReaderSingleWriter *mrsw)
 {
+	if (lock_profile_active(mrsw->lock_class)) {
+		_acquireread_mrsw_profiled(mrsw);
+		return;
+	}
+
+	if (mrsw_bias_acquire(mrsw, &mrsw->bias))
+		return;
+
 	ltfs_mutex_lock(&mrsw->exclusive_mutex);
 	mrsw->long_lock=0;
 	ltfs_mutex_unlock(&mrsw->exclusive_mutex);
 
 	pthread_rwlock_rdlock(&mrsw->rw_lock);
+	mrsw_bias_restore(&mrsw->bias);
 }
 
 static inline int
@@ -266,6 +365,9 @@ acquireread_mrsw_short(MultiReaderSingleWriter *mrsw)
 static inline void
 releaseread_mrsw(MultiReaderSingleWriter *mrsw)
 {
+	if (mrsw_bias_release(mrsw, &mrsw->bias))
+		return;
+
 	pthread_rwlock_unlock(&mrsw->rw_lock);
 }
 
@@ -297,6 +399,7 @@ writetoread_mrsw(MultiReaderSingleWriter *mrsw)
 	//    thread may or may not be blocked on reading_mutex, but is following that code path.
 
 	// Unset the writer flag before allowing any readers in.
+	_release_profile_mrsw(mrsw);
 	mrsw->writer = 0;
 	mrsw->long_lock = 0;
 
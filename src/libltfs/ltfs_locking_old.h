@@ -163,6 +163,9 @@ static inline int ltfs_mutexattr_setpshared(ltfs_mutexattr_t *attr,
 
 #else /* !__FreeBSD__ */
 
+#include "ltfs_locking_bias.h"
+#include "ltfs_locking_profile.h"
+
 typedef struct MultiReaderSingleWriter {
 	ltfs_mutex_t write_exclusive_mutex;
 	ltfs_mutex_t reading_mutex;
@@ -170,6 +173,9 @@ typedef struct MultiReaderSingleWriter {
 	uint32_t read_count;
 	uint32_t writer; //if there is a write lock acquired
 	uint32_t long_lock;
+	struct mrsw_bias bias; /**< Reader bias, see ltfs_locking_bias.h */
+	uint32_t lock_class;   /**< Profiling class, see ltfs_locking_profile.h */
+	uint64_t hold_start;   /**< Time the profiled write lock was granted, or 0 */
 } MultiReaderSingleWriter;
 
 static inline int
@@ -179,6 +185,9 @@ init_mrsw(MultiReaderSingleWriter *mrsw)
 	mrsw->read_count = 0;
 	mrsw->writer = 0;
 	mrsw->long_lock = 0;
+	mrsw->lock_class = LOCK_CLASS_NONE;
+	mrsw->hold_start = 0;
+	mrsw_bias_init(&mrsw->bias);
 	ret = ltfs_mutex_init(&mrsw->read_count_mutex);
 	if (ret)
 		return -ret;
@@ -204,8 +213,22 @@ destroy_mrsw(MultiReaderSingleWriter *mrsw)
 	ltfs_mutex_destroy(&mrsw->write_exclusive_mutex);
 }
 
+/* Let readers of a heavily read lock bypass it while no writer is around */
+static inline void
+enable_reader_bias_mrsw(MultiReaderSingleWriter *mrsw)
+{
+	mrsw_bias_enable(&mrsw->bias);
+}
+
+/* Count acquisitions of this lock under the given class of the lock profiler */
+static inline void
+set_lock_class_mrsw(MultiReaderSingleWriter *mrsw, uint32_t lock_class)
+{
+	mrsw->lock_class = lock_class;
+}
+
 static inline bool
-try_acquirewrite_mrsw(MultiReaderSingleWriter *mrsw)
+_try_acquirewrite_mrsw(MultiReaderSingleWriter *mrsw)
 {
 	int err;
 	err = ltfs_mutex_trylock(&mrsw->write_exclusive_mutex);
@@ -216,40 +239,118 @@ try_acquirewrite_mrsw(MultiReaderSingleWriter *mrsw)
 		ltfs_mutex_unlock(&mrsw->write_exclusive_mutex);
 		return false;
 	}
+	mrsw_bias_revoke(mrsw, &mrsw->bias);
 	mrsw->writer=1;
 	return true;
 }
 
+static inline bool
+try_acquirewrite_mrsw(MultiReaderSingleWriter *mrsw)
+{
+	if (! _try_acquirewrite_mrsw(mrsw))
+		return false;
+	if (lock_profile_active(mrsw->lock_class))
+		mrsw->hold_start = lock_profile_acquired(mrsw->lock_class, lock_profile_now(), false);
+	return true;
+}
+
+static inline void
+_acquirewrite_mrsw(MultiReaderSingleWriter *mrsw)
+{
+	uint64_t start;
+	bool contended = false;
+
+	if (! lock_profile_active(mrsw->lock_class)) {
+		ltfs_mutex_lock(&mrsw->write_exclusive_mutex);
+		ltfs_mutex_lock(&mrsw->reading_mutex);
+		mrsw_bias_revoke(mrsw, &mrsw->bias);
+		mrsw->writer=1;
+		return;
+	}
+
+	start = lock_profile_now();
+	if (! _try_acquirewrite_mrsw(mrsw)) {
+		contended = true;
+		ltfs_mutex_lock(&mrsw->write_exclusive_mutex);
+		ltfs_mutex_lock(&mrsw->reading_mutex);
+		mrsw_bias_revoke(mrsw, &mrsw->bias);
+		mrsw->writer=1;
+	}
+	mrsw->hold_start = lock_profile_acquired(mrsw->lock_class, start, contended);
+}
+
+/* End the timed hold of a profiled write lock, if any */
+static inline void
+_release_profile_mrsw(MultiReaderSingleWriter *mrsw)
+{
+	if (mrsw->hold_start) {
+		lock_profile_released(mrsw->lock_class, mrsw->hold_start);
+		mrsw->hold_start = 0;
+	}
+}
+
 static inline void
 acquirewrite_mrsw(MultiReaderSingleWriter *mrsw)
 {
-	ltfs_mutex_lock(&mrsw->write_exclusive_mutex);
-	ltfs_mutex_lock(&mrsw->reading_mutex);
-	mrsw->writer=1;
+	_acquirewrite_mrsw(mrsw);
 	mrsw->long_lock=0;
 }
 
 static inline void
 acquirewrite_mrsw_long(MultiReaderSingleWriter *mrsw)
 {
-	ltfs_mutex_lock(&mrsw->write_exclusive_mutex);
-	ltfs_mutex_lock(&mrsw->reading_mutex);
-	mrsw->writer=1;
+	_acquirewrite_mrsw(mrsw);
 	mrsw->long_lock=1;
 }
 
 static inline void
 releasewrite_mrsw(MultiReaderSingleWriter *mrsw)
 {
+	_release_profile_mrsw(mrsw);
 	mrsw->writer=0;
 	mrsw->long_lock=0;
 	ltfs_mutex_unlock(&mrsw->reading_mutex);
 	ltfs_mutex_unlock(&mrsw->write_exclusive_mutex);
 }
 
+/* Take a read lock of a profiled lock, counting whether a writer made it wait */
+static inline void
+_acquireread_mrsw_profiled(MultiReaderSingleWriter *mrsw)
+{
+	uint64_t start = lock_profile_now();
+	bool contended = false;
+
+	if (! mrsw_bias_acquire(mrsw, &mrsw->bias)) {
+		if (ltfs_mutex_trylock(&mrsw->write_exclusive_mutex)) {
+			contended = true;
+			ltfs_mutex_lock(&mrsw->write_exclusive_mutex);
+		}
+		mrsw->long_lock=0;
+		ltfs_mutex_unlock(&mrsw->write_exclusive_mutex);
+
+		ltfs_mutex_lock(&mrsw->read_count_mutex);
+		mrsw->read_count++;
+		if(mrsw->read_count==1 && ltfs_mutex_trylock(&mrsw->reading_mutex)) {
+			contended = true;
+			ltfs_mutex_lock(&mrsw->reading_mutex);
+		}
+		mrsw_bias_restore(&mrsw->bias);
+		ltfs_mutex_unlock(&mrsw->read_count_mutex);
+	}
+	lock_profile_acquired(mrsw->lock_class, start, contended);
+}
+
 static inline void
 acquireread_mrsw(MultiReaderSingleWriter *mrsw)
 {
+	if (lock_profile_active(mrsw->lock_class)) {
+		_acquireread_mrsw_profiled(mrsw);
+		return;
+	}
+
+	if (mrsw_bias_acquire(mrsw, &mrsw->bias))
+		return;
+
 	ltfs_mutex_lock(&mrsw->write_exclusive_mutex);
 	mrsw->long_lock=0;
 	ltfs_mutex_unlock(&mrsw->write_exclusive_mutex);
@@ -258,6 +359,7 @@ acquireread_mrsw(MultiReaderSingleWriter *mrsw)
 	mrsw->read_count++;
 	if(mrsw->read_count==1)
 		ltfs_mutex_lock(&mrsw->reading_mutex);
+	mrsw_bias_restore(&mrsw->bias);
 	ltfs_mutex_unlock(&mrsw->read_count_mutex);
 }
 
@@ -296,6 +398,9 @@ acquireread_mrsw_short(MultiReaderSingleWriter *mrsw)
 static inline void
 releaseread_mrsw(MultiReaderSingleWriter *mrsw)
 {
+	if (mrsw_bias_release(mrsw, &mrsw->bias))
+		return;
+
 	ltfs_mutex_lock(&mrsw->read_count_mutex);
 
 	if ( mrsw->read_count<=0 ) {
@@ -339,6 +444,7 @@ writetoread_mrsw(MultiReaderSingleWriter *mrsw)
 	//    thread may or may not be blocked on reading_mutex, but is following that code path.
 
 	// Unset the writer flag before allowing any readers in.
+	_release_profile_mrsw(mrsw);
 	mrsw->writer = 0;
 	mrsw->long_lock = 0;
 
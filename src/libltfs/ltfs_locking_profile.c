@@ -0,0 +1,193 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       ltfs_locking_profile.c
+**
+** DESCRIPTION:     Counters of the lock contention profiler. See ltfs_locking_profile.h.
+**
+*************************************************************************************
+*/
+
+#include "libltfs/ltfs.h"
+#include "libltfs/ltfs_locking_profile.h"
+
+uint32_t lock_profile_enabled = 0;
+
+static struct lock_profile_stats _lock_profile_stats[LOCK_CLASS_MAX];
+
+static const char *_lock_profile_names[LOCK_CLASS_MAX] = {
+	[LOCK_CLASS_NONE]           = "none",
+	[LOCK_CLASS_VOLUME]         = "volume",
+	[LOCK_CLASS_CONTENTS]       = "contents",
+	[LOCK_CLASS_META]           = "meta",
+	[LOCK_CLASS_DEVICE]         = "device",
+	[LOCK_CLASS_IOSCHED]        = "iosched",
+	[LOCK_CLASS_IOSCHED_DENTRY] = "iosched_dentry",
+};
+
+uint64_t lock_profile_now(void)
+{
+	struct ltfs_timespec now;
+
+	get_current_timespec(&now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void _lock_profile_max(uint64_t *max, uint64_t val)
+{
+	uint64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+	while (val > cur
+		   && ! __atomic_compare_exchange_n(max, &cur, val, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/**
+ * Account an acquisition of a profiled lock.
+ * @param lock_class Class of the lock.
+ * @param start Time the caller started to take the lock, from lock_profile_now().
+ * @param contended True if the lock could not be granted immediately.
+ * @return the time the lock was granted, to be passed to lock_profile_released().
+ */
+uint64_t lock_profile_acquired(uint32_t lock_class, uint64_t start, bool contended)
+{
+	struct lock_profile_stats *s = &_lock_profile_stats[lock_class];
+	uint64_t now = lock_profile_now();
+	uint64_t wait = now > start ? now - start : 0;
+
+	__atomic_add_fetch(&s->acquired, 1, __ATOMIC_RELAXED);
+	if (contended) {
+		__atomic_add_fetch(&s->contended, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&s->wait_total, wait, __ATOMIC_RELAXED);
+		_lock_profile_max(&s->wait_max, wait);
+	}
+	return now ? now : 1;
+}
+
+/**
+ * Account the end of an exclusive hold of a profiled lock.
+ * @param lock_class Class of the lock.
+ * @param since Value returned by lock_profile_acquired() for this hold.
+ */
+void lock_profile_released(uint32_t lock_class, uint64_t since)
+{
+	struct lock_profile_stats *s = &_lock_profile_stats[lock_class];
+	uint64_t now = lock_profile_now();
+	uint64_t hold = now > since ? now - since : 0;
+
+	__atomic_add_fetch(&s->held, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&s->hold_total, hold, __ATOMIC_RELAXED);
+	_lock_profile_max(&s->hold_max, hold);
+}
+
+/**
+ * Switch lock profiling on or off. The counters are cleared when profiling is switched on,
+ * and kept when it is switched off so they can still be read.
+ * @param enable True to profile lock acquisitions from now on.
+ */
+void lock_profile_enable(bool enable)
+{
+	uint32_t old = __atomic_exchange_n(&lock_profile_enabled, enable ? 1 : 0, __ATOMIC_SEQ_CST);
+
+	if (enable && ! old) {
+		memset(_lock_profile_stats, 0, sizeof(_lock_profile_stats));
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+}
+
+static void _lock_profile_snapshot(struct lock_profile_stats *out, uint32_t lock_class)
+{
+	struct lock_profile_stats *s = &_lock_profile_stats[lock_class];
+
+	out->acquired   = __atomic_load_n(&s->acquired, __ATOMIC_RELAXED);
+	out->contended  = __atomic_load_n(&s->contended, __ATOMIC_RELAXED);
+	out->wait_total = __atomic_load_n(&s->wait_total, __ATOMIC_RELAXED);
+	out->wait_max   = __atomic_load_n(&s->wait_max, __ATOMIC_RELAXED);
+	out->held       = __atomic_load_n(&s->held, __ATOMIC_RELAXED);
+	out->hold_total = __atomic_load_n(&s->hold_total, __ATOMIC_RELAXED);
+	out->hold_max   = __atomic_load_n(&s->hold_max, __ATOMIC_RELAXED);
+}
+
+/**
+ * Format the counters of every lock class, one line per class. Times are in microseconds.
+ * @param out On success, points to a newly allocated string which the caller must free.
+ * @return 0 on success or -LTFS_NO_MEMORY.
+ */
+int lock_profile_format(char **out)
+{
+	struct lock_profile_stats s;
+	char *buf = NULL, *tmp;
+	uint32_t i;
+	int ret;
+
+	for (i = LOCK_CLASS_NONE + 1; i < LOCK_CLASS_MAX; ++i) {
+		_lock_profile_snapshot(&s, i);
+		ret = asprintf(&tmp, "%s%s: acquired=%"PRIu64" contended=%"PRIu64
+			" wait_us=%"PRIu64" wait_max_us=%"PRIu64
+			" held=%"PRIu64" hold_us=%"PRIu64" hold_max_us=%"PRIu64"\n",
+			buf ? buf : "", _lock_profile_names[i], s.acquired, s.contended,
+			s.wait_total / 1000, s.wait_max / 1000, s.held, s.hold_total / 1000, s.hold_max / 1000);
+		free(buf);
+		if (ret < 0) {
+			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+			return -LTFS_NO_MEMORY;
+		}
+		buf = tmp;
+	}
+
+	*out = buf;
+	return 0;
+}
+
+/**
+ * Log the counters of every lock class which was taken since profiling was switched on.
+ */
+void lock_profile_print(void)
+{
+	struct lock_profile_stats s;
+	uint32_t i;
+
+	for (i = LOCK_CLASS_NONE + 1; i < LOCK_CLASS_MAX; ++i) {
+		_lock_profile_snapshot(&s, i);
+		if (! s.acquired)
+			continue;
+		ltfsmsg(LTFS_INFO, 17318I, _lock_profile_names[i],
+			(unsigned long long)s.acquired, (unsigned long long)s.contended,
+			(unsigned long long)(s.wait_total / 1000), (unsigned long long)(s.wait_max / 1000),
+			(unsigned long long)(s.hold_total / 1000), (unsigned long long)(s.hold_max / 1000));
+	}
+}
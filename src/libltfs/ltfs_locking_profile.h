@@ -0,0 +1,114 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       ltfs_locking_profile.h
+**
+** DESCRIPTION:     Lock contention profiler.
+**
+**                  Locks which are given a class count, per class, how often they
+**                  are taken, how often the taker had to wait, how long it waited
+**                  and how long exclusive holds lasted. Profiling is switched on
+**                  and off at run time through the PROF_LOCK bit of the profiler
+**                  extended attribute. While it is off, taking a classified lock
+**                  costs one extra load and branch.
+**
+*************************************************************************************
+*/
+
+#ifndef __LTFS_LOCKING_PROFILE_H__
+#define __LTFS_LOCKING_PROFILE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Lock classes. Locks of class LOCK_CLASS_NONE are never profiled.
+ */
+enum lock_profile_class {
+	LOCK_CLASS_NONE = 0,
+	LOCK_CLASS_VOLUME,          /**< ltfs_volume lock */
+	LOCK_CLASS_CONTENTS,        /**< Dentry contents_lock */
+	LOCK_CLASS_META,            /**< Dentry meta_lock */
+	LOCK_CLASS_DEVICE,          /**< Tape device lock, see tape_device_lock() */
+	LOCK_CLASS_IOSCHED,         /**< I/O scheduler lock */
+	LOCK_CLASS_IOSCHED_DENTRY,  /**< Dentry iosched_lock */
+	LOCK_CLASS_MAX
+};
+
+/**
+ * Counters of a lock class. Times are in nanoseconds. Shared (read) holds are counted
+ * as acquisitions but their hold time is not measured.
+ */
+struct lock_profile_stats {
+	uint64_t acquired;   /**< Acquisitions */
+	uint64_t contended;  /**< Acquisitions which could not be granted immediately */
+	uint64_t wait_total; /**< Time spent waiting for the lock */
+	uint64_t wait_max;   /**< Longest wait */
+	uint64_t held;       /**< Exclusive holds which were timed */
+	uint64_t hold_total; /**< Time the lock was held exclusively */
+	uint64_t hold_max;   /**< Longest exclusive hold */
+};
+
+extern uint32_t lock_profile_enabled;
+
+/**
+ * Check whether acquisitions of a lock class are to be profiled.
+ */
+static inline bool lock_profile_active(uint32_t lock_class)
+{
+	return __builtin_expect(lock_class != LOCK_CLASS_NONE
+		&& __atomic_load_n(&lock_profile_enabled, __ATOMIC_RELAXED), 0);
+}
+
+uint64_t lock_profile_now(void);
+uint64_t lock_profile_acquired(uint32_t lock_class, uint64_t start, bool contended);
+void lock_profile_released(uint32_t lock_class, uint64_t since);
+
+void lock_profile_enable(bool enable);
+int lock_profile_format(char **out);
+void lock_profile_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LTFS_LOCKING_PROFILE_H__ */
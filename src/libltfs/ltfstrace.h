@@ -156,6 +156,7 @@ int ltfs_request_profiler_stop(void);
 #define PROF_IOSCHED   (0x0000000000000002)
 #define PROF_DRIVER    (0x0000000000000004)
 #define PROF_CHANGER   (0x0000000000000008)
+#define PROF_LOCK      (0x0000000000000010)
 
 #define REQ_PROFILER_FILE        "prof_request.dat"
 #define IOSCHED_PROFILER_BASE    "prof_iosched_"
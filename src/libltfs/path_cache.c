@@ -0,0 +1,394 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       path_cache.c
+**
+** DESCRIPTION:     Path to dentry cache.
+**
+**                  fs_path_lookup walks the name tree one component at a time,
+**                  taking the contents_lock of every directory on the way. This
+**                  cache remembers the result of recent walks, keyed by the full
+**                  path, so repeated lookups of the same path (getattr, open and
+**                  getxattr of the same file) skip the walk. Failed lookups are
+**                  remembered as negative entries.
+**
+**                  An entry does not hold a handle on its dentry, so caching a
+**                  path does not keep a dentry in memory: the index spill may
+**                  still evict it, and an unlinked file goes away as soon as it
+**                  is closed. Instead, the dentry counts the entries referring
+**                  to it, and a dentry with entries calls path_cache_forget()
+**                  before it is freed. Entries themselves are reference counted:
+**                  a lookup takes a reference on the entry under the cache lock
+**                  and takes a dentry handle after dropping it, unless the
+**                  dentry has no handle left, which means it is being disposed
+**                  of. path_cache_forget() removes the entries of the dentry and
+**                  waits until the lookups holding them are done.
+**
+**                  Operations which change the name tree invalidate the affected
+**                  paths after the change. Every invalidation also advances a
+**                  generation number, and the result of a walk is only inserted
+**                  if no invalidation happened since the walk started, so a walk
+**                  racing with a rename or unlink can't leave a stale entry
+**                  behind.
+**
+*************************************************************************************
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "ltfs.h"
+#include "fs.h"
+#include "path_cache.h"
+
+/**
+ * Cached lookup result.
+ */
+struct path_cache_entry {
+	UT_hash_handle hh;                   /**< Hash table of cached paths, keyed by path */
+	UT_hash_handle hh_dentry;            /**< Hash table of positive entries, keyed by dentry */
+	TAILQ_ENTRY(path_cache_entry) list;  /**< Position in the replacement list */
+	uint32_t refcount;                   /**< References held by the cache and by lookups */
+	uint32_t referenced;                 /**< Set on every hit, cleared by the replacement scan */
+	struct dentry *d;                    /**< Dentry found, or NULL if the path does not exist */
+	char path[];                         /**< Path looked up */
+};
+
+TAILQ_HEAD(path_cache_list, path_cache_entry);
+
+/**
+ * path_cache structure.
+ * Must be created by path_cache_create() and freed by path_cache_free().
+ */
+struct path_cache {
+	MultiReaderSingleWriter lock;        /**< Protects the hash table and the list */
+	struct path_cache_entry *entries;    /**< Hash table of cached paths */
+	struct path_cache_entry *dentries;   /**< Positive entries, by dentry */
+	struct path_cache_list lru;          /**< Entries in insertion order, scanned for replacement */
+	size_t count;                        /**< Number of entries in the cache */
+	size_t max_entries;                  /**< Maximum number of entries */
+	uint64_t generation;                 /**< Advanced by every invalidation */
+};
+
+/**
+ * Create a path cache.
+ * @param cache On success, points to the new cache.
+ * @param max_entries Maximum number of paths to remember.
+ * @return 0 on success or a negative value on error.
+ */
+int path_cache_create(struct path_cache **cache, size_t max_entries)
+{
+	int ret;
+	struct path_cache *c;
+
+	CHECK_ARG_NULL(cache, -LTFS_NULL_ARG);
+
+	c = calloc(1, sizeof(struct path_cache));
+	if (! c) {
+		ltfsmsg(LTFS_ERR, 10001E, "path_cache_create: cache");
+		return -LTFS_NO_MEMORY;
+	}
+
+	ret = init_mrsw(&c->lock);
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 10002E, ret);
+		free(c);
+		return -LTFS_MUTEX_INIT;
+	}
+
+	TAILQ_INIT(&c->lru);
+	c->max_entries = max_entries ? max_entries : 1;
+
+	*cache = c;
+	return 0;
+}
+
+/**
+ * Drop a reference to an entry. The last reference frees the entry.
+ */
+static void _path_cache_put(struct path_cache_entry *entry)
+{
+	if (__atomic_sub_fetch(&entry->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+
+	/* Lets path_cache_forget() free the dentry */
+	if (entry->d)
+		__atomic_sub_fetch(&entry->d->path_cached, 1, __ATOMIC_RELEASE);
+	free(entry);
+}
+
+/**
+ * Move an entry from the cache to a list of entries to put once the cache lock is dropped.
+ * The caller must hold the cache lock for write.
+ */
+static void _path_cache_remove(struct path_cache *cache, struct path_cache_entry *entry,
+	struct path_cache_list *dead)
+{
+	HASH_DEL(cache->entries, entry);
+	if (entry->d)
+		HASH_DELETE(hh_dentry, cache->dentries, entry);
+	TAILQ_REMOVE(&cache->lru, entry, list);
+	TAILQ_INSERT_TAIL(dead, entry, list);
+	--cache->count;
+}
+
+static void _path_cache_put_list(struct path_cache_list *dead)
+{
+	struct path_cache_entry *entry, *aux;
+
+	TAILQ_FOREACH_SAFE(entry, dead, list, aux)
+		_path_cache_put(entry);
+}
+
+/**
+ * Free a path cache.
+ * Must be called before the dentry tree of the index is disposed of.
+ * @param cache Cache to free. Set to NULL on return.
+ */
+void path_cache_free(struct path_cache **cache)
+{
+	if (! cache || ! *cache)
+		return;
+
+	path_cache_flush(*cache);
+	destroy_mrsw(&(*cache)->lock);
+	free(*cache);
+	*cache = NULL;
+}
+
+/**
+ * Look up a path in the cache.
+ * @param cache Cache to search.
+ * @param path Path to search for, as passed to fs_path_lookup.
+ * @param d On a positive hit, points to the dentry found. Its handle count is incremented
+ *          as fs_path_lookup does.
+ * @param generation When the path is not cached, the generation to pass to
+ *                   path_cache_insert once the path has been walked.
+ * @return 0 if the dentry was found, -LTFS_NO_DENTRY if the path is known not to exist,
+ *         1 if the path is not cached, or another negative value on error.
+ */
+int path_cache_lookup(struct path_cache *cache, const char *path, struct dentry **d,
+	uint64_t *generation)
+{
+	int ret;
+	struct path_cache_entry *entry;
+
+	acquireread_mrsw(&cache->lock);
+	*generation = __atomic_load_n(&cache->generation, __ATOMIC_ACQUIRE);
+	HASH_FIND_STR(cache->entries, path, entry);
+	if (! entry) {
+		releaseread_mrsw(&cache->lock);
+		return 1;
+	}
+	__atomic_store_n(&entry->referenced, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&entry->refcount, 1, __ATOMIC_RELAXED);
+	releaseread_mrsw(&cache->lock);
+
+	if (! entry->d) {
+		_path_cache_put(entry);
+		return -LTFS_NO_DENTRY;
+	}
+
+	/* The entry keeps the dentry in memory until it is put, but the dentry may be on its way
+	 * to being freed: then it has no handle left, and the path must be walked again */
+	ret = fs_prepare_dentry_locks(entry->d);
+	if (ret == 0) {
+		acquirewrite_mrsw(&fs_dentry_locks(entry->d)->meta_lock);
+		if (entry->d->numhandles) {
+			++entry->d->numhandles;
+			*d = entry->d;
+		} else
+			ret = 1;
+		releasewrite_mrsw(&fs_dentry_locks(entry->d)->meta_lock);
+	}
+
+	_path_cache_put(entry);
+	return ret;
+}
+
+/**
+ * Remember the result of a path walk.
+ * The caller must hold a handle on d, and must not hold any dentry lock.
+ * @param cache Cache to update.
+ * @param path Path which was walked.
+ * @param d Dentry found, or NULL if the path does not exist.
+ * @param generation Generation returned by path_cache_lookup before the walk. Nothing is
+ *                   inserted if the cache was invalidated since then.
+ */
+void path_cache_insert(struct path_cache *cache, const char *path, struct dentry *d,
+	uint64_t generation)
+{
+	size_t len = strlen(path);
+	struct path_cache_entry *entry, *old;
+	struct path_cache_list dead;
+
+	entry = malloc(sizeof(struct path_cache_entry) + len + 1);
+	if (! entry) {
+		ltfsmsg(LTFS_ERR, 10001E, "path_cache_insert: entry");
+		return;
+	}
+	memcpy(entry->path, path, len + 1);
+	entry->refcount = 1;
+	entry->referenced = 0;
+	entry->d = d;
+	if (d)
+		__atomic_add_fetch(&d->path_cached, 1, __ATOMIC_RELAXED);
+
+	TAILQ_INIT(&dead);
+	acquirewrite_mrsw(&cache->lock);
+
+	HASH_FIND(hh, cache->entries, entry->path, len, old);
+	if (old || cache->generation != generation) {
+		/* Another walk got there first, or the result may already be stale */
+		releasewrite_mrsw(&cache->lock);
+		_path_cache_put(entry);
+		return;
+	}
+
+	/* Second chance replacement: skip over the entries hit since the last scan */
+	while (cache->count >= cache->max_entries) {
+		old = TAILQ_FIRST(&cache->lru);
+		if (__atomic_load_n(&old->referenced, __ATOMIC_RELAXED)) {
+			__atomic_store_n(&old->referenced, 0, __ATOMIC_RELAXED);
+			TAILQ_REMOVE(&cache->lru, old, list);
+			TAILQ_INSERT_TAIL(&cache->lru, old, list);
+		} else
+			_path_cache_remove(cache, old, &dead);
+	}
+
+	HASH_ADD(hh, cache->entries, path, len, entry);
+	if (d)
+		HASH_ADD(hh_dentry, cache->dentries, d, sizeof(struct dentry *), entry);
+	TAILQ_INSERT_TAIL(&cache->lru, entry, list);
+	++cache->count;
+
+	releasewrite_mrsw(&cache->lock);
+	_path_cache_put_list(&dead);
+}
+
+/**
+ * Forget a path after the name tree was changed. Must be called after the change is
+ * visible in the tree, without holding any dentry lock.
+ * @param cache Cache to update.
+ * @param path Path which was created, removed or renamed.
+ * @param subtree Also forget every path below 'path'. Required when a directory is renamed,
+ *                or when a directory appears at a path which may have negative entries below it.
+ */
+void path_cache_invalidate(struct path_cache *cache, const char *path, bool subtree)
+{
+	size_t len;
+	struct path_cache_entry *entry, *aux;
+	struct path_cache_list dead;
+
+	if (! cache)
+		return;
+
+	len = strlen(path);
+	TAILQ_INIT(&dead);
+	acquirewrite_mrsw(&cache->lock);
+
+	HASH_FIND(hh, cache->entries, path, len, entry);
+	if (entry)
+		_path_cache_remove(cache, entry, &dead);
+
+	if (subtree) {
+		HASH_ITER(hh, cache->entries, entry, aux) {
+			if (! strncmp(entry->path, path, len) && entry->path[len] == '/')
+				_path_cache_remove(cache, entry, &dead);
+		}
+	}
+
+	__atomic_add_fetch(&cache->generation, 1, __ATOMIC_RELEASE);
+	releasewrite_mrsw(&cache->lock);
+	_path_cache_put_list(&dead);
+}
+
+/**
+ * Forget every cached path. Used when the name tree changes in ways that are not tracked
+ * path by path. Must be called without holding any dentry lock.
+ * @param cache Cache to empty.
+ */
+void path_cache_flush(struct path_cache *cache)
+{
+	struct path_cache_entry *entry, *aux;
+	struct path_cache_list dead;
+
+	if (! cache)
+		return;
+
+	TAILQ_INIT(&dead);
+	acquirewrite_mrsw(&cache->lock);
+	HASH_ITER(hh, cache->entries, entry, aux)
+		_path_cache_remove(cache, entry, &dead);
+	__atomic_add_fetch(&cache->generation, 1, __ATOMIC_RELEASE);
+	releasewrite_mrsw(&cache->lock);
+	_path_cache_put_list(&dead);
+}
+
+/**
+ * Forget a dentry which is about to be freed. Does nothing unless d->path_cached is set.
+ * Removes the entries of the dentry and waits until no lookup uses them. Call without
+ * holding the meta_lock of d: the lookups being waited for take it.
+ * @param cache Cache of the index d belongs to.
+ * @param d Dentry which has no handle left.
+ */
+void path_cache_forget(struct path_cache *cache, struct dentry *d)
+{
+	struct path_cache_entry *entry;
+	struct path_cache_list dead;
+
+	if (! __atomic_load_n(&d->path_cached, __ATOMIC_ACQUIRE))
+		return;
+
+	if (cache) {
+		TAILQ_INIT(&dead);
+		acquirewrite_mrsw(&cache->lock);
+		HASH_FIND(hh_dentry, cache->dentries, &d, sizeof(struct dentry *), entry);
+		if (entry) {
+			_path_cache_remove(cache, entry, &dead);
+			__atomic_add_fetch(&cache->generation, 1, __ATOMIC_RELEASE);
+		}
+		releasewrite_mrsw(&cache->lock);
+		_path_cache_put_list(&dead);
+	}
+
+	/* Entries removed earlier may still be held by lookups */
+	while (__atomic_load_n(&d->path_cached, __ATOMIC_ACQUIRE))
+		sched_yield();
+}
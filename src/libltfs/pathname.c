@@ -51,6 +51,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 
 #ifdef __APPLE_MAKEFILE__
 #include <ICU/unicode/uchar.h>
@@ -94,6 +96,17 @@ int _pathname_utf16_to_utf8_icu(const UChar *src, char **dest);
 int _pathname_system_to_utf16_icu(const char *src, UChar **dest);
 int _pathname_utf8_to_system_icu(const char *src, char **dest);
 int _pathname_normalize_utf8_nfd_icu(const char *src, char **dest);
+int _pathname_ascii_length(const char *name);
+bool _pathname_system_is_ascii(void);
+int _pathname_validate_ascii(const char *name, int len, bool allow_slash);
+int _pathname_format_ascii(const char *src, int len, char **dest, bool validate, bool allow_slash);
+int _pathname_strdup_ascii(const char *src, int len, char **dest);
+
+/* Word-at-a-time helpers for scanning ASCII names */
+#define PATHNAME_WORD_ONES  UINT64_C(0x0101010101010101)
+#define PATHNAME_WORD_HIGHS UINT64_C(0x8080808080808080)
+/* Nonzero if any byte of w is zero */
+#define PATHNAME_WORD_HAS_ZERO(w) (((w) - PATHNAME_WORD_ONES) & ~(w) & PATHNAME_WORD_HIGHS)
 
 
 /**
@@ -108,12 +121,17 @@ int _pathname_normalize_utf8_nfd_icu(const char *src, char **dest);
  */
 int pathname_format(const char *name, char **new_name, bool validate, bool allow_slash)
 {
-	int ret;
+	int ret, len;
 
 	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
 	CHECK_ARG_NULL(new_name, -LTFS_NULL_ARG);
 
-	ret = _pathname_format_icu(name, new_name, validate, allow_slash);
+	/* ASCII names are already in NFC, so ICU is only needed for other names */
+	len = _pathname_ascii_length(name);
+	if (len >= 0 && _pathname_system_is_ascii())
+		ret = _pathname_format_ascii(name, len, new_name, validate, allow_slash);
+	else
+		ret = _pathname_format_icu(name, new_name, validate, allow_slash);
 	return ret;
 }
 
@@ -125,12 +143,16 @@ int pathname_format(const char *name, char **new_name, bool validate, bool allow
  */
 int pathname_unformat(const char *name, char **new_name)
 {
-	int ret;
+	int ret, len;
 
 	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
 	CHECK_ARG_NULL(new_name, -LTFS_NULL_ARG);
 
-	ret = _pathname_utf8_to_system_icu(name, new_name);
+	len = _pathname_ascii_length(name);
+	if (len >= 0 && _pathname_system_is_ascii())
+		ret = _pathname_strdup_ascii(name, len, new_name);
+	else
+		ret = _pathname_utf8_to_system_icu(name, new_name);
 	return ret;
 }
 
@@ -233,12 +255,16 @@ int pathname_prepare_caseless(const char *name, UChar **new_name, bool use_nfc)
  */
 int pathname_normalize(const char *name, char **new_name)
 {
-	int ret;
+	int ret, len;
 
 	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
 	CHECK_ARG_NULL(new_name, -LTFS_NULL_ARG);
 
-	ret = _pathname_normalize_utf8_icu(name, new_name);
+	len = _pathname_ascii_length(name);
+	if (len >= 0)
+		ret = _pathname_strdup_ascii(name, len, new_name);
+	else
+		ret = _pathname_normalize_utf8_icu(name, new_name);
 	return ret;
 }
 
@@ -417,6 +443,10 @@ int _pathname_validate(const char *name, bool allow_slash)
 
 	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
 
+	len = _pathname_ascii_length(name);
+	if (len >= 0)
+		return _pathname_validate_ascii(name, len, allow_slash);
+
 	len = strlen(name);
 	while (i < len) {
 		U8_NEXT(name, i, len, c);
@@ -432,6 +462,126 @@ int _pathname_validate(const char *name, bool allow_slash)
 	return 0;
 }
 
+/**
+ * Check whether a null-terminated string is plain ASCII. The string is scanned a word at a
+ * time.
+ * @param name string to check
+ * @return length of the string in bytes if it is ASCII, or -1 if it is not.
+ */
+int _pathname_ascii_length(const char *name)
+{
+	size_t len = strlen(name), i;
+	uint64_t w, bits = 0;
+
+	if (len > INT_MAX)
+		return -1;
+
+	for (i = 0; i + sizeof(w) <= len; i += sizeof(w)) {
+		memcpy(&w, name + i, sizeof(w));
+		bits |= w;
+	}
+	for (; i < len; ++i)
+		bits |= (unsigned char)name[i];
+
+	return (bits & PATHNAME_WORD_HIGHS) ? -1 : (int)len;
+}
+
+/**
+ * Check whether the system locale maps ASCII bytes to the same code points as UTF-8, so
+ * that ASCII names need no conversion between the two.
+ */
+bool _pathname_system_is_ascii(void)
+{
+	static int system_is_ascii = -1;
+	int ret = __atomic_load_n(&system_is_ascii, __ATOMIC_RELAXED);
+	const char *syslocale;
+
+	if (ret < 0) {
+		/* ICU picks its default converter once, so the result can be kept */
+		syslocale = ucnv_getDefaultName();
+		ret = (! strcmp(syslocale, "UTF-8") || ! strcmp(syslocale, "US-ASCII") ||
+			! strcmp(syslocale, "ISO-8859-1")) ? 1 : 0;
+		__atomic_store_n(&system_is_ascii, ret, __ATOMIC_RELAXED);
+	}
+	return ret == 1;
+}
+
+/**
+ * ASCII version of _pathname_validate().
+ * @param name string to check, which must be plain ASCII
+ * @param len length of the string in bytes
+ * @param allow_slash if true, allow slashes in the string
+ * @return 0 if name is valid or -LTFS_INVALID_PATH.
+ */
+int _pathname_validate_ascii(const char *name, int len, bool allow_slash)
+{
+	const uint64_t unit_separators = PATHNAME_WORD_ONES * 0x1f;
+	const uint64_t slashes = PATHNAME_WORD_ONES * '/';
+	uint64_t w, found = 0;
+	int i;
+
+	/* NUL can't appear before the end of the string, so 0x1f and '/' are the only
+	 * invalid ASCII characters */
+	for (i = 0; i + (int)sizeof(w) <= len; i += sizeof(w)) {
+		memcpy(&w, name + i, sizeof(w));
+		found |= PATHNAME_WORD_HAS_ZERO(w ^ unit_separators);
+		if (! allow_slash)
+			found |= PATHNAME_WORD_HAS_ZERO(w ^ slashes);
+	}
+	for (; i < len; ++i) {
+		if (name[i] == 0x1f || (! allow_slash && name[i] == '/'))
+			return -LTFS_INVALID_PATH;
+	}
+
+	return found ? -LTFS_INVALID_PATH : 0;
+}
+
+/**
+ * ASCII version of _pathname_format_icu(). An ASCII name is its own NFC form, so it is
+ * only validated and copied.
+ * @param src name to format, which must be plain ASCII
+ * @param len length of the name in bytes
+ * @param dest on success, points to a newly allocated copy of the name
+ * @param validate true to check the name for length and invalid characters
+ * @param allow_slash true if the name is allowed to contain '/'. Ignored if validate is false.
+ * @return 0 on success or a negative value on error.
+ */
+int _pathname_format_ascii(const char *src, int len, char **dest, bool validate, bool allow_slash)
+{
+	int ret;
+
+	if (validate) {
+		/* check length of the name unless it's supposed to be a path */
+		if (! allow_slash && len > LTFS_FILENAME_MAX) {
+			*dest = NULL;
+			return -LTFS_NAMETOOLONG;
+		}
+
+		ret = _pathname_validate_ascii(src, len, allow_slash);
+		if (ret < 0) {
+			*dest = NULL;
+			return ret;
+		}
+	}
+
+	return _pathname_strdup_ascii(src, len, dest);
+}
+
+/**
+ * Copy a string whose length is already known.
+ * @return 0 on success or -LTFS_NO_MEMORY.
+ */
+int _pathname_strdup_ascii(const char *src, int len, char **dest)
+{
+	*dest = malloc(len + 1);
+	if (! *dest) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+	memcpy(*dest, src, len + 1);
+	return 0;
+}
+
 /**
  * Determine whether a given Unicode code point is valid in XML.
  * @param c Code point to check.
@@ -516,11 +666,15 @@ int _pathname_format_icu(const char *src, char **dest, bool validate, bool allow
 
 int pathname_nfd_normalize(const char *name, char **new_name)
 {
-	int ret;
+	int ret, len;
 	CHECK_ARG_NULL(name, -LTFS_NULL_ARG);
 	CHECK_ARG_NULL(new_name, -LTFS_NULL_ARG);
 
-	ret = _pathname_normalize_utf8_nfd_icu(name, new_name);
+	len = _pathname_ascii_length(name);
+	if (len >= 0)
+		ret = _pathname_strdup_ascii(name, len, new_name);
+	else
+		ret = _pathname_normalize_utf8_nfd_icu(name, new_name);
 	return ret;
 }
 
@@ -48,6 +48,7 @@
 
 #include "ltfs.h"
 #include "ltfs_fsops.h"
+#include "periodic_sync.h"
 
 #ifdef mingw_PLATFORM
 #include <WinSock2.h>
@@ -63,6 +64,9 @@ int gettimeofday(struct timeval* tv, struct timezone* tz) {
 }
 #endif
 
+/* How often the thread looks at the dirty state of the volume (sec) */
+#define PERIODIC_SYNC_POLL_INTERVAL (1)
+
 /**
  * Periodic sync scheduler private data structure.
  */
@@ -71,10 +75,66 @@ struct periodic_sync_data {
 	ltfs_thread_mutex_t  periodic_sync_thread_mutex; /**< Used to handle the periodic sync thread */
 	ltfs_thread_t        periodic_sync_thread_id;    /**< Thread id of the periodic sync thread */
 	bool             keepalive;                  /**< Used to terminate the background thread */
-	int              period_sec;                 /**< Period between sync (sec) */
+	struct periodic_sync_policy policy;          /**< When to write an index */
+	uint64_t         cost_ms;                    /**< Duration of the last index write (msec), 0 if unknown */
+	uint64_t         cost_files;                 /**< Number of files in the index at that write */
 	struct ltfs_volume *vol;                     /**< A reference to the LTFS volume structure */
 };
 
+/**
+ * Read the update tracking state of the volume. Only the dirty lock of the index is
+ * taken, so polling an idle volume does not get in the way of file system requests.
+ * The index is replaced only while mounting, before this thread starts.
+ * @return true on success, false if the volume cannot be used right now.
+ */
+static bool _periodic_sync_sample(struct ltfs_volume *vol, bool *dirty, uint64_t *entries,
+	uint64_t *bytes, uint64_t *files)
+{
+	struct ltfs_index *idx = vol->index;
+
+	/* Leave the volume alone while it is revalidated or after revalidation failed */
+	if (__atomic_load_n(&vol->reval, __ATOMIC_ACQUIRE) < 0)
+		return false;
+
+	ltfs_mutex_lock(&idx->dirty_lock);
+	*dirty = idx->dirty;
+	*entries = __atomic_load_n(&idx->dirty_entries, __ATOMIC_RELAXED);
+	*bytes = __atomic_load_n(&idx->dirty_bytes, __ATOMIC_RELAXED);
+	*files = idx->file_count;
+	ltfs_mutex_unlock(&idx->dirty_lock);
+
+	return true;
+}
+
+/**
+ * Time between time-triggered index writes. The index write time is scaled by the
+ * growth of the index since it was measured, so that writing the index takes at most
+ * 1/cost_ratio of the time.
+ * @return period in seconds.
+ */
+static uint64_t _periodic_sync_period(struct periodic_sync_data *priv, uint64_t files)
+{
+	uint64_t period = priv->policy.period_sec, cost_ms;
+
+	if (priv->policy.cost_ratio > 0 && priv->cost_ms) {
+		cost_ms = priv->cost_ms;
+		if (priv->cost_files && files > priv->cost_files)
+			cost_ms = cost_ms * files / priv->cost_files;
+		if (cost_ms * priv->policy.cost_ratio / 1000 > period)
+			period = cost_ms * priv->policy.cost_ratio / 1000;
+	}
+
+	return period;
+}
+
+static uint64_t _periodic_sync_elapsed_ms(const struct timeval *from, const struct timeval *to)
+{
+	if (to->tv_sec < from->tv_sec)
+		return 0;
+	return (uint64_t) (to->tv_sec - from->tv_sec) * 1000
+		+ ((int64_t) to->tv_usec - (int64_t) from->tv_usec) / 1000;
+}
+
 /**
  * Main routine for periodic sync.
  * @param data Periodic sync private data
@@ -88,30 +148,87 @@ struct periodic_sync_data {
 ltfs_thread_return periodic_sync_thread(void* data)
 {
 	struct periodic_sync_data *priv = (struct periodic_sync_data *) data;
-	struct timeval now;
+	struct timeval now, last_sync, defer_start, write_start;
+	uint64_t entries, bytes, prev_bytes = 0, files, period;
+	bool dirty, streaming, deferrable, deferring = false;
+	const char *trigger;
 	int ret;
 
+	gettimeofday(&last_sync, NULL);
 	ltfs_thread_mutex_lock(&priv->periodic_sync_thread_mutex);
 	while (priv->keepalive && gettimeofday(&now, NULL) == 0) {
 		ltfs_thread_cond_timedwait(&priv->periodic_sync_thread_cond,
 								   &priv->periodic_sync_thread_mutex,
-								   priv->period_sec);
+								   PERIODIC_SYNC_POLL_INTERVAL);
 		if (! priv->keepalive)
 			break;
 
+		if (! _periodic_sync_sample(priv->vol, &dirty, &entries, &bytes, &files))
+			continue;
+		gettimeofday(&now, NULL);
+
+		/* File data reached the medium since the last look: the writer is streaming. An
+		 * index write since then reset the count, so all of it is new. */
+		if (bytes < prev_bytes)
+			streaming = (bytes > 0);
+		else
+			streaming = (bytes > prev_bytes);
+		prev_bytes = bytes;
+
+		if (! dirty) {
+			deferring = false;
+			continue;
+		}
+
+		/* Unindexed data only grows while it streams, so the size trigger is never
+		 * deferred: it would always wait for stream_defer_sec */
+		period = _periodic_sync_period(priv, files);
+		deferrable = true;
+		if (priv->policy.dirty_bytes && bytes >= priv->policy.dirty_bytes) {
+			trigger = "Sync-by-Size";
+			deferrable = false;
+		} else if (_periodic_sync_elapsed_ms(&last_sync, &now) >= period * 1000)
+			trigger = "Sync-by-Time";
+		else if (priv->policy.dirty_entries && entries >= priv->policy.dirty_entries)
+			trigger = "Sync-by-Entries";
+		else
+			continue;
+
+		/* Writing an index now would make the drive stop streaming file data. Let the
+		 * burst finish, but not for longer than stream_defer_sec. */
+		if (streaming && deferrable && priv->policy.stream_defer_sec > 0) {
+			if (! deferring) {
+				ltfsmsg(LTFS_DEBUG, 17316D, trigger);
+				deferring = true;
+				defer_start = now;
+			}
+			if (_periodic_sync_elapsed_ms(&defer_start, &now)
+				< (uint64_t) priv->policy.stream_defer_sec * 1000)
+				continue;
+		}
+		deferring = false;
+
 		ltfs_request_trace(FUSE_REQ_ENTER(REQ_SYNC), 0, 0);
 
-		ltfsmsg(LTFS_DEBUG, 17067D, "Sync-by-Time");
+		ltfsmsg(LTFS_DEBUG, 17067D, trigger);
 		ret = ltfs_fsops_flush(NULL, false, priv->vol);
 		if (ret < 0) {
 			/* Failed to flush file data */
 			ltfsmsg(LTFS_WARN, 17063W, __FUNCTION__);
 		}
 
+		gettimeofday(&write_start, NULL);
 		ret = ltfs_sync_index(SYNC_PERIODIC, true, priv->vol);
 		if (ret < 0) {
 			ltfsmsg(LTFS_INFO, 11030I, ret);
 			priv->keepalive = false;
+		} else {
+			gettimeofday(&last_sync, NULL);
+			priv->cost_ms = _periodic_sync_elapsed_ms(&write_start, &last_sync);
+			priv->cost_files = files;
+			if (_periodic_sync_period(priv, files) > (uint64_t) priv->policy.period_sec)
+				ltfsmsg(LTFS_DEBUG, 17317D, (unsigned long long) priv->cost_ms,
+					(unsigned long long) _periodic_sync_period(priv, files));
 		}
 
 		ltfs_request_trace(FUSE_REQ_EXIT(REQ_SYNC), ret, 0);
@@ -145,15 +262,16 @@ bool periodic_sync_thread_initialized(struct ltfs_volume *vol)
 
 /**
  * Initialize the periodic sync thread.
- * @param sec timer in which the syncing will be performed
+ * @param policy when to write an index
  * @param vol LTFS volume
  * @return 0 on success or a negative value on error.
  */
-int periodic_sync_thread_init(int sec, struct ltfs_volume *vol)
+int periodic_sync_thread_init(const struct periodic_sync_policy *policy, struct ltfs_volume *vol)
 {
 	int ret;
 	struct periodic_sync_data *priv;
 
+	CHECK_ARG_NULL(policy, -LTFS_NULL_ARG);
 	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
 
 	priv = calloc(1, sizeof(struct periodic_sync_data));
@@ -164,7 +282,7 @@ int periodic_sync_thread_init(int sec, struct ltfs_volume *vol)
 
 	priv->vol = vol;
 	priv->keepalive = true;
-	priv->period_sec = sec;
+	priv->policy = *policy;
 
 	ret = ltfs_thread_cond_init(&priv->periodic_sync_thread_cond);
 	if (ret) {
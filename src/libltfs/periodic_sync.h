@@ -52,9 +52,22 @@
 extern "C" {
 #endif
 
-int periodic_sync_thread_init(int sec, struct ltfs_volume *vol);
-int periodic_sync_thread_destroy(void* syncer_handle);
-bool periodic_sync_thread_initialized(void* syncer_handle);
+/**
+ * When the periodic sync thread writes an index. An index is written once the volume
+ * has been dirty for the sync period, or earlier when one of the dirty thresholds
+ * is reached.
+ */
+struct periodic_sync_policy {
+	int period_sec;            /**< Time between index writes (sec) */
+	uint64_t dirty_entries;    /**< Metadata updates that trigger an index write, 0 to disable */
+	uint64_t dirty_bytes;      /**< Unindexed file data that triggers an index write, 0 to disable */
+	int cost_ratio;            /**< Stretch the period to this many times the index write time, 0 to disable */
+	int stream_defer_sec;      /**< Longest wait for file data to stop streaming, except on the size trigger (sec), 0 to disable */
+};
+
+int periodic_sync_thread_init(const struct periodic_sync_policy *policy, struct ltfs_volume *vol);
+int periodic_sync_thread_destroy(struct ltfs_volume *vol);
+bool periodic_sync_thread_initialized(struct ltfs_volume *vol);
 
 #ifdef __cplusplus
 }
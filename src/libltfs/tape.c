@@ -532,12 +532,12 @@ int tape_device_lock(struct device_data *dev)
 {
 	int ret;
 	CHECK_ARG_NULL(dev, -LTFS_NULL_ARG);
-	ret = ltfs_mutex_lock(&dev->backend_mutex);
+	ret = ltfs_mutex_lock_profiled(&dev->backend_mutex, LOCK_CLASS_DEVICE, &dev->backend_hold_start);
 	if (ret)
 		ret = -LTFS_MUTEX_INVALID;
 	else if (dev->fence) {
 		ret = -LTFS_DEVICE_FENCED;
-		ltfs_mutex_unlock(&dev->backend_mutex);
+		ltfs_mutex_unlock_profiled(&dev->backend_mutex, LOCK_CLASS_DEVICE, &dev->backend_hold_start);
 	}
 	return ret;
 }
@@ -551,7 +551,7 @@ int tape_device_unlock(struct device_data *dev)
 {
 	int ret;
 	CHECK_ARG_NULL(dev, -LTFS_NULL_ARG);
-	ret = ltfs_mutex_unlock(&dev->backend_mutex);
+	ret = ltfs_mutex_unlock_profiled(&dev->backend_mutex, LOCK_CLASS_DEVICE, &dev->backend_hold_start);
 	switch (ret) {
 		case 0:
 			return 0;
@@ -114,6 +114,7 @@ struct device_data {
 	struct tape_ops *backend;             /**< Backend functions */
 	void *backend_data;                   /**< Backend private data */
 	ltfs_mutex_t backend_mutex;           /**< Mutex to control backend access */
+	uint64_t backend_hold_start;          /**< Time backend_mutex was taken, for the lock profiler */
 	ltfs_mutex_t read_only_flag_mutex;    /**< Mutex to control read_only access */
 	char *serial_number;                  /**< Serial number for identification */
 };
@@ -69,6 +69,10 @@ do {																	\
 	}																	\
 } while (0)
 
+/* Last element of a table in insertion order, or NULL if the table is empty */
+#define HASH_TAIL(hh,head) \
+	((head) ? DECLTYPE(head)ELMT_FROM_HH((head)->hh.tbl, (head)->hh.tbl->tail) : NULL)
+
 #ifdef __cplusplus
 }
 #endif
@@ -66,8 +66,260 @@
 #include "pathname.h"
 #include "tape.h"
 #include "ltfs_internal.h"
+#include "index_snapshot.h"
 #include "arch/time_internal.h"
 
+/**
+ * Virtual extended attributes. Each name appears once with the dentries it exists on.
+ * xattr_init() builds a perfect hash over the names so that an EA name is resolved with one
+ * hash and one string comparison. Names under "ltfs.vendor" which are not listed here exist
+ * on the root dentry and resolve to VEA_VENDOR.
+ */
+enum xattr_vea_id {
+	VEA_CREATE_TIME = 1,
+	VEA_MODIFY_TIME,
+	VEA_ACCESS_TIME,
+	VEA_CHANGE_TIME,
+	VEA_BACKUP_TIME,
+	VEA_FILE_UID,
+	VEA_VOLUME_UUID,
+	VEA_VOLUME_NAME,
+	VEA_DRIVE_CAPTURE_DUMP,
+	VEA_SOFTWARE_VERSION,
+	VEA_SOFTWARE_FORMAT_SPEC,
+	VEA_SOFTWARE_VENDOR,
+	VEA_SOFTWARE_PRODUCT,
+	VEA_MAM_BARCODE,
+	VEA_MAM_APPLICATION_VENDOR,
+	VEA_MAM_APPLICATION_VERSION,
+	VEA_MAM_APPLICATION_FORMAT_VERSION,
+	VEA_VOLUME_LOCK_STATE,
+	VEA_PARTITION,
+	VEA_STARTBLOCK,
+	VEA_POLICY_MAX_FILE_SIZE,
+	VEA_COMMIT_MESSAGE,
+	VEA_INDEX_VERSION,
+	VEA_LABEL_VERSION,
+	VEA_SYNC,
+	VEA_INDEX_GENERATION,
+	VEA_INDEX_TIME,
+	VEA_POLICY_EXISTS,
+	VEA_POLICY_ALLOW_UPDATE,
+	VEA_VOLUME_FORMAT_TIME,
+	VEA_VOLUME_BLOCKSIZE,
+	VEA_VOLUME_COMPRESSION,
+	VEA_INDEX_LOCATION,
+	VEA_INDEX_PREVIOUS,
+	VEA_INDEX_CREATOR,
+	VEA_LABEL_CREATOR,
+	VEA_PARTITION_MAP,
+	VEA_VOLUME_SERIAL,
+	VEA_MEDIA_LOADS,
+	VEA_MEDIA_RECOVERED_WRITE_ERRORS,
+	VEA_MEDIA_PERMANENT_WRITE_ERRORS,
+	VEA_MEDIA_RECOVERED_READ_ERRORS,
+	VEA_MEDIA_PERMANENT_READ_ERRORS,
+	VEA_MEDIA_PREVIOUS_PERMANENT_WRITE_ERRORS,
+	VEA_MEDIA_PREVIOUS_PERMANENT_READ_ERRORS,
+	VEA_MEDIA_BEGINNING_MEDIUM_PASSES,
+	VEA_MEDIA_MIDDLE_MEDIUM_PASSES,
+	VEA_MEDIA_EFFICIENCY,
+	VEA_MEDIA_STORAGE_ALERT,
+	VEA_MEDIA_DATASETS_WRITTEN,
+	VEA_MEDIA_DATASETS_READ,
+	VEA_MEDIA_MB_WRITTEN,
+	VEA_MEDIA_MB_READ,
+	VEA_MEDIA_DATA_PARTITION_TOTAL_CAPACITY,
+	VEA_MEDIA_DATA_PARTITION_AVAILABLE_SPACE,
+	VEA_MEDIA_INDEX_PARTITION_TOTAL_CAPACITY,
+	VEA_MEDIA_INDEX_PARTITION_AVAILABLE_SPACE,
+	VEA_MEDIA_ENCRYPTED,
+	VEA_MEDIA_POOL_ADDITIONAL_INFO,
+	VEA_DRIVE_ENCRYPTION_STATE,
+	VEA_DRIVE_ENCRYPTION_METHOD,
+	VEA_IBM_REFERENCED_BLOCKS,
+	VEA_IBM_TRACE,
+	VEA_IBM_TOTAL_BLOCKS,
+	VEA_IBM_CARTRIDGE_MOUNT_NODE,
+	VEA_IBM_LOG_LEVEL,
+	VEA_IBM_SYSLOG_LEVEL,
+	VEA_IBM_RAO,
+	VEA_IBM_PROFILER,
+	VEA_IBM_LOCK_PROFILE,
+	VEA_IBM_DUMP,
+	VEA_IBM_DUMP_TRACE,
+	VEA_VENDOR,
+};
+
+#define VEA_ON_ALL  (0x01) /* Every dentry */
+#define VEA_ON_FILE (0x02) /* Files with at least one extent */
+#define VEA_ON_ROOT (0x04) /* The root dentry */
+
+struct xattr_vea {
+	const char *name;
+	enum xattr_vea_id id;
+	int where;          /**< VEA_ON_* flag */
+};
+
+static const struct xattr_vea _xattr_vea_table[] = {
+	/* EAs on all dentries */
+	{ "ltfs.createTime",                         VEA_CREATE_TIME,                        VEA_ON_ALL },
+	{ "ltfs.modifyTime",                         VEA_MODIFY_TIME,                        VEA_ON_ALL },
+	{ "ltfs.accessTime",                         VEA_ACCESS_TIME,                        VEA_ON_ALL },
+	{ "ltfs.changeTime",                         VEA_CHANGE_TIME,                        VEA_ON_ALL },
+	{ "ltfs.backupTime",                         VEA_BACKUP_TIME,                        VEA_ON_ALL },
+	{ "ltfs.fileUID",                            VEA_FILE_UID,                           VEA_ON_ALL },
+	{ "ltfs.volumeUUID",                         VEA_VOLUME_UUID,                        VEA_ON_ALL },
+	{ "ltfs.volumeName",                         VEA_VOLUME_NAME,                        VEA_ON_ALL },
+	{ "ltfs.driveCaptureDump",                   VEA_DRIVE_CAPTURE_DUMP,                 VEA_ON_ALL },
+	{ "ltfs.softwareVersion",                    VEA_SOFTWARE_VERSION,                   VEA_ON_ALL },
+	{ "ltfs.softwareFormatSpec",                 VEA_SOFTWARE_FORMAT_SPEC,               VEA_ON_ALL },
+	{ "ltfs.softwareVendor",                     VEA_SOFTWARE_VENDOR,                    VEA_ON_ALL },
+	{ "ltfs.softwareProduct",                    VEA_SOFTWARE_PRODUCT,                   VEA_ON_ALL },
+	{ "ltfs.mamBarcode",                         VEA_MAM_BARCODE,                        VEA_ON_ALL },
+	{ "ltfs.mamApplicationVendor",               VEA_MAM_APPLICATION_VENDOR,             VEA_ON_ALL },
+	{ "ltfs.mamApplicationVersion",              VEA_MAM_APPLICATION_VERSION,            VEA_ON_ALL },
+	{ "ltfs.mamApplicationFormatVersion",        VEA_MAM_APPLICATION_FORMAT_VERSION,     VEA_ON_ALL },
+	{ "ltfs.volumeLockState",                    VEA_VOLUME_LOCK_STATE,                  VEA_ON_ALL },
+	/* EAs on non-empty files */
+	{ "ltfs.partition",                          VEA_PARTITION,                          VEA_ON_FILE },
+	{ "ltfs.startblock",                         VEA_STARTBLOCK,                         VEA_ON_FILE },
+	/* EAs on the root dentry */
+	{ "ltfs.policyMaxFileSize",                  VEA_POLICY_MAX_FILE_SIZE,               VEA_ON_ROOT },
+	{ "ltfs.commitMessage",                      VEA_COMMIT_MESSAGE,                     VEA_ON_ROOT },
+	{ "ltfs.indexVersion",                       VEA_INDEX_VERSION,                      VEA_ON_ROOT },
+	{ "ltfs.labelVersion",                       VEA_LABEL_VERSION,                      VEA_ON_ROOT },
+	{ "ltfs.sync",                               VEA_SYNC,                               VEA_ON_ROOT },
+	{ "ltfs.indexGeneration",                    VEA_INDEX_GENERATION,                   VEA_ON_ROOT },
+	{ "ltfs.indexTime",                          VEA_INDEX_TIME,                         VEA_ON_ROOT },
+	{ "ltfs.policyExists",                       VEA_POLICY_EXISTS,                      VEA_ON_ROOT },
+	{ "ltfs.policyAllowUpdate",                  VEA_POLICY_ALLOW_UPDATE,                VEA_ON_ROOT },
+	{ "ltfs.volumeFormatTime",                   VEA_VOLUME_FORMAT_TIME,                 VEA_ON_ROOT },
+	{ "ltfs.volumeBlocksize",                    VEA_VOLUME_BLOCKSIZE,                   VEA_ON_ROOT },
+	{ "ltfs.volumeCompression",                  VEA_VOLUME_COMPRESSION,                 VEA_ON_ROOT },
+	{ "ltfs.indexLocation",                      VEA_INDEX_LOCATION,                     VEA_ON_ROOT },
+	{ "ltfs.indexPrevious",                      VEA_INDEX_PREVIOUS,                     VEA_ON_ROOT },
+	{ "ltfs.indexCreator",                       VEA_INDEX_CREATOR,                      VEA_ON_ROOT },
+	{ "ltfs.labelCreator",                       VEA_LABEL_CREATOR,                      VEA_ON_ROOT },
+	{ "ltfs.partitionMap",                       VEA_PARTITION_MAP,                      VEA_ON_ROOT },
+	{ "ltfs.volumeSerial",                       VEA_VOLUME_SERIAL,                      VEA_ON_ROOT },
+	{ "ltfs.mediaLoads",                         VEA_MEDIA_LOADS,                        VEA_ON_ROOT },
+	{ "ltfs.mediaRecoveredWriteErrors",          VEA_MEDIA_RECOVERED_WRITE_ERRORS,       VEA_ON_ROOT },
+	{ "ltfs.mediaPermanentWriteErrors",          VEA_MEDIA_PERMANENT_WRITE_ERRORS,       VEA_ON_ROOT },
+	{ "ltfs.mediaRecoveredReadErrors",           VEA_MEDIA_RECOVERED_READ_ERRORS,        VEA_ON_ROOT },
+	{ "ltfs.mediaPermanentReadErrors",           VEA_MEDIA_PERMANENT_READ_ERRORS,        VEA_ON_ROOT },
+	{ "ltfs.mediaPreviousPermanentWriteErrors",  VEA_MEDIA_PREVIOUS_PERMANENT_WRITE_ERRORS, VEA_ON_ROOT },
+	{ "ltfs.mediaPreviousPermanentReadErrors",   VEA_MEDIA_PREVIOUS_PERMANENT_READ_ERRORS, VEA_ON_ROOT },
+	{ "ltfs.mediaBeginningMediumPasses",         VEA_MEDIA_BEGINNING_MEDIUM_PASSES,      VEA_ON_ROOT },
+	{ "ltfs.mediaMiddleMediumPasses",            VEA_MEDIA_MIDDLE_MEDIUM_PASSES,         VEA_ON_ROOT },
+	{ "ltfs.mediaEfficiency",                    VEA_MEDIA_EFFICIENCY,                   VEA_ON_ROOT },
+	{ "ltfs.mediaStorageAlert",                  VEA_MEDIA_STORAGE_ALERT,                VEA_ON_ROOT },
+	{ "ltfs.mediaDatasetsWritten",               VEA_MEDIA_DATASETS_WRITTEN,             VEA_ON_ROOT },
+	{ "ltfs.mediaDatasetsRead",                  VEA_MEDIA_DATASETS_READ,                VEA_ON_ROOT },
+	{ "ltfs.mediaMBWritten",                     VEA_MEDIA_MB_WRITTEN,                   VEA_ON_ROOT },
+	{ "ltfs.mediaMBRead",                        VEA_MEDIA_MB_READ,                      VEA_ON_ROOT },
+	{ "ltfs.mediaDataPartitionTotalCapacity",    VEA_MEDIA_DATA_PARTITION_TOTAL_CAPACITY, VEA_ON_ROOT },
+	{ "ltfs.mediaDataPartitionAvailableSpace",   VEA_MEDIA_DATA_PARTITION_AVAILABLE_SPACE, VEA_ON_ROOT },
+	{ "ltfs.mediaIndexPartitionTotalCapacity",   VEA_MEDIA_INDEX_PARTITION_TOTAL_CAPACITY, VEA_ON_ROOT },
+	{ "ltfs.mediaIndexPartitionAvailableSpace",  VEA_MEDIA_INDEX_PARTITION_AVAILABLE_SPACE, VEA_ON_ROOT },
+	{ "ltfs.mediaEncrypted",                     VEA_MEDIA_ENCRYPTED,                    VEA_ON_ROOT },
+	{ "ltfs.mediaPool.additionalInfo",           VEA_MEDIA_POOL_ADDITIONAL_INFO,         VEA_ON_ROOT },
+	{ "ltfs.driveEncryptionState",               VEA_DRIVE_ENCRYPTION_STATE,             VEA_ON_ROOT },
+	{ "ltfs.driveEncryptionMethod",              VEA_DRIVE_ENCRYPTION_METHOD,            VEA_ON_ROOT },
+	/* Vendor specific EAs */
+	{ "ltfs.vendor.IBM.referencedBlocks",        VEA_IBM_REFERENCED_BLOCKS,              VEA_ON_ROOT },
+	{ "ltfs.vendor.IBM.trace",                   VEA_IBM_TRACE,                          VEA_ON_ROOT },
+	{ "ltfs.vendor.IBM.totalBlocks",             VEA_IBM_TOTAL_BLOCKS,                   VEA_ON_ROOT },
+	{ "ltfs.vendor.IBM.cartridgeMountNode",      VEA_IBM_CARTRIDGE_MOUNT_NODE,           VEA_ON_ROOT },
+	{ "ltfs.vendor.IBM.logLevel",                VEA_IBM_LOG_LEVEL,                      VEA_ON_ROOT },
+	{ "ltfs.vendor.IBM.syslogLevel",             VEA_IBM_SYSLOG_LEVEL,                   VEA_ON_ROOT },
+	{ "ltfs.vendor.IBM.rao",                     VEA_IBM_RAO,                            VEA_ON_ROOT },
+	{ "ltfs.vendor.IBM.profiler",                VEA_IBM_PROFILER,                       VEA_ON_ROOT },
+	{ "ltfs.vendor.IBM.lockProfile",             VEA_IBM_LOCK_PROFILE,                   VEA_ON_ROOT },
+	{ "ltfs.vendor.IBM.dump",                    VEA_IBM_DUMP,                           VEA_ON_ROOT },
+	{ "ltfs.vendor.IBM.dumpTrace",               VEA_IBM_DUMP_TRACE,                     VEA_ON_ROOT },
+};
+
+/* Slots of the perfect hash, holding an index into _xattr_vea_table plus one, or 0 if unused.
+ * The table is kept much larger than the name list so that a collision-free seed is found
+ * after a few tries. */
+#define XATTR_VEA_SLOTS     (1024)
+#define XATTR_VEA_MAX_SEEDS (65536)
+#define XATTR_VEA_COUNT     (sizeof(_xattr_vea_table) / sizeof(_xattr_vea_table[0]))
+
+static const struct xattr_vea _xattr_vea_vendor = { NULL, VEA_VENDOR, VEA_ON_ROOT };
+static unsigned char _xattr_vea_slot[XATTR_VEA_SLOTS];
+static uint32_t _xattr_vea_seed;
+static bool _xattr_vea_hashed = false;
+
+/**
+ * Seeded FNV-1a hash of an EA name, folded to a slot of the perfect hash.
+ */
+static inline unsigned int _xattr_vea_hash(const char *name, uint32_t seed)
+{
+	uint32_t h = 2166136261U ^ seed;
+
+	while (*name) {
+		h ^= (unsigned char) *name++;
+		h *= 16777619U;
+	}
+	return (h ^ (h >> 16)) & (XATTR_VEA_SLOTS - 1);
+}
+
+/**
+ * Build the perfect hash of the virtual EA names. If no seed places every name in its own
+ * slot, lookups fall back to scanning the table.
+ */
+void xattr_init(void)
+{
+	uint32_t seed;
+	unsigned int slot;
+	size_t i;
+
+	for (seed = 0; seed < XATTR_VEA_MAX_SEEDS; ++seed) {
+		memset(_xattr_vea_slot, 0, sizeof(_xattr_vea_slot));
+		for (i = 0; i < XATTR_VEA_COUNT; ++i) {
+			slot = _xattr_vea_hash(_xattr_vea_table[i].name, seed);
+			if (_xattr_vea_slot[slot])
+				break;
+			_xattr_vea_slot[slot] = i + 1;
+		}
+		if (i == XATTR_VEA_COUNT) {
+			_xattr_vea_seed = seed;
+			_xattr_vea_hashed = true;
+			return;
+		}
+	}
+}
+
+/**
+ * Find the virtual EA entry for a name, whatever dentry it is read from.
+ * @param name EA name.
+ * @return The table entry, &_xattr_vea_vendor for other names under "ltfs.vendor", or NULL
+ *         if the name is not a virtual EA.
+ */
+static const struct xattr_vea *_xattr_vea_lookup(const char *name)
+{
+	size_t i;
+
+	if (strncmp(name, LTFS_PRIVATE_PREFIX, strlen(LTFS_PRIVATE_PREFIX)))
+		return NULL;
+
+	if (_xattr_vea_hashed) {
+		i = _xattr_vea_slot[_xattr_vea_hash(name, _xattr_vea_seed)];
+		if (i && ! strcmp(_xattr_vea_table[i - 1].name, name))
+			return &_xattr_vea_table[i - 1];
+	} else {
+		for (i = 0; i < XATTR_VEA_COUNT; ++i)
+			if (! strcmp(_xattr_vea_table[i].name, name))
+				return &_xattr_vea_table[i];
+	}
+
+	if (! strncmp(name, "ltfs.vendor", strlen("ltfs.vendor")))
+		return &_xattr_vea_vendor;
+	return NULL;
+}
+
 /* Helper functions for formatting virtual EA output */
 static int _xattr_get_cartridge_health(cartridge_health_info *h, int64_t *val, char **outval,
 	const char *msg, struct ltfs_volume *vol)
@@ -142,9 +394,9 @@ static int _xattr_get_dentry_time(struct dentry *d, struct ltfs_timespec *val, c
 								  const char *msg)
 {
 	int ret;
-	acquireread_mrsw(&d->meta_lock);
+	acquireread_mrsw(&fs_dentry_locks(d)->meta_lock);
 	ret = _xattr_get_time(val, outval, msg);
-	releaseread_mrsw(&d->meta_lock);
+	releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
 	return ret;
 }
 
@@ -207,12 +459,14 @@ static int _xattr_set_time(struct dentry *d, struct ltfs_timespec *out, const ch
 	if (ret < 0)
 		return -LTFS_BAD_ARG;
 
-	acquirewrite_mrsw(&d->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	index_snapshot_preserve(d);
 	*out = t;
 	d->dirty = true;
-	releasewrite_mrsw(&d->meta_lock);
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 	ltfs_set_index_dirty(true, false, vol->index);
+	ltfs_notify_dentry(d, vol);
 	return ret;
 }
 
@@ -288,16 +542,7 @@ static inline bool _xattr_is_stored_vea(const char *name)
  */
 static int _xattr_seek(struct xattr_info **out, struct dentry *d, const char *name)
 {
-	struct xattr_info *entry;
-
-	*out = NULL;
-	TAILQ_FOREACH(entry, &d->xattrlist, list) {
-		if (! strcmp(entry->key.name, name)) {
-			*out = entry;
-			break;
-		}
-	}
-
+	*out = fs_find_xattr(d, name);
 	if (*out)
 		return 1;
 	else
@@ -314,10 +559,11 @@ static int _xattr_seek(struct xattr_info **out, struct dentry *d, const char *na
  */
 static int _xattr_lock_dentry(const char *name, bool modify, struct dentry *d, struct ltfs_volume *vol)
 {
+	const struct xattr_vea *vea = _xattr_vea_lookup(name);
+
 	/* EAs that read the extent list need to take the contents_lock */
-	if (! strcmp(name, "ltfs.startblock")
-		|| ! strcmp(name, "ltfs.partition")) {
-		acquireread_mrsw(&d->contents_lock);
+	if (vea && vea->where == VEA_ON_FILE) {
+		acquireread_mrsw(&fs_dentry_locks(d)->contents_lock);
 	}
 
 	/* Other EAs either need no additional locks, or they need the meta_lock.
@@ -334,10 +580,11 @@ static int _xattr_lock_dentry(const char *name, bool modify, struct dentry *d, s
  */
 static void _xattr_unlock_dentry(const char *name, bool modify, struct dentry *d, struct ltfs_volume *vol)
 {
+	const struct xattr_vea *vea = _xattr_vea_lookup(name);
+
 	/* EAs that read the extent list need to take the contents_lock */
-	if (! strcmp(name, "ltfs.startblock")
-		|| ! strcmp(name, "ltfs.partition")) {
-		releaseread_mrsw(&d->contents_lock);
+	if (vea && vea->where == VEA_ON_FILE) {
+		releaseread_mrsw(&fs_dentry_locks(d)->contents_lock);
 	}
 }
 
@@ -400,103 +647,46 @@ out:
  * @param d Dentry to check.
  * @param name Name to check.
  * @param vol LTFS volume to which the dentry belongs.
- * @return true if the name exists and is virtual, false otherwise.
+ * @return The virtual EA entry if the name exists and is virtual, NULL otherwise.
  */
-static bool _xattr_is_virtual(struct dentry *d, const char *name, struct ltfs_volume *vol)
+static const struct xattr_vea *_xattr_virtual(struct dentry *d, const char *name,
+	struct ltfs_volume *vol)
 {
-	/* xattrs on all dentries */
-	if (! strcmp(name, "ltfs.createTime")
-		|| ! strcmp(name, "ltfs.modifyTime")
-		|| ! strcmp(name, "ltfs.accessTime")
-		|| ! strcmp(name, "ltfs.changeTime")
-		|| ! strcmp(name, "ltfs.backupTime")
-		|| ! strcmp(name, "ltfs.fileUID")
-		|| ! strcmp(name, "ltfs.volumeUUID")
-		|| ! strcmp(name, "ltfs.volumeName")
-		|| ! strcmp(name, "ltfs.driveCaptureDump")
-		|| ! strcmp(name, "ltfs.softwareVersion")
-		|| ! strcmp(name, "ltfs.softwareFormatSpec")
-		|| ! strcmp(name, "ltfs.softwareVendor")
-		|| ! strcmp(name, "ltfs.softwareProduct")
-		|| ! strcmp(name, "ltfs.mamBarcode")
-		|| ! strcmp(name, "ltfs.mamApplicationVendor")
-		|| ! strcmp(name, "ltfs.mamApplicationVersion")
-		|| ! strcmp(name, "ltfs.mamApplicationFormatVersion")
-		|| ! strcmp(name, "ltfs.volumeLockState")
-		)
-		return true;
+	const struct xattr_vea *vea = _xattr_vea_lookup(name);
 
-	if (_xattr_is_worm_ea(name)) {
-		/* Treat WORM related EA as real EA */
-		return false;
-	}
+	if (! vea)
+		return NULL;
 
-	/* xattrs on files */
-	if (! d->isdir) {
-		if (! TAILQ_EMPTY(&d->extentlist)
-			&& (! strcmp(name, "ltfs.partition") || ! strcmp(name, "ltfs.startblock")))
-			return true;
+	switch (vea->where) {
+		case VEA_ON_ALL:
+			return vea;
+		case VEA_ON_FILE:
+			return (! d->isdir && fs_has_extents(d)) ? vea : NULL;
+		default:
+			break;
 	}
 
-	/* xattrs on the root dentry */
-	if (d == vol->index->root) {
-		if (vol->index->index_criteria.have_criteria && ! strcmp(name, "ltfs.policyMaxFileSize"))
-			return true;
-		if (! strcmp(name, "ltfs.commitMessage")
-			|| ! strcmp(name, "ltfs.indexVersion")
-			|| ! strcmp(name, "ltfs.labelVersion")
-			|| ! strcmp(name, "ltfs.sync")
-			|| ! strcmp(name, "ltfs.indexGeneration")
-			|| ! strcmp(name, "ltfs.indexTime")
-			|| ! strcmp(name, "ltfs.policyExists")
-			|| ! strcmp(name, "ltfs.policyAllowUpdate")
-			|| ! strcmp(name, "ltfs.volumeFormatTime")
-			|| ! strcmp(name, "ltfs.volumeBlocksize")
-			|| ! strcmp(name, "ltfs.volumeCompression")
-			|| ! strcmp(name, "ltfs.indexLocation")
-			|| ! strcmp(name, "ltfs.indexPrevious")
-			|| ! strcmp(name, "ltfs.indexCreator")
-			|| ! strcmp(name, "ltfs.labelCreator")
-			|| ! strcmp(name, "ltfs.partitionMap")
-			|| ! strcmp(name, "ltfs.volumeSerial")
-			|| ! strcmp(name, "ltfs.mediaLoads")
-			|| ! strcmp(name, "ltfs.mediaRecoveredWriteErrors")
-			|| ! strcmp(name, "ltfs.mediaPermanentWriteErrors")
-			|| ! strcmp(name, "ltfs.mediaRecoveredReadErrors")
-			|| ! strcmp(name, "ltfs.mediaPermanentReadErrors")
-			|| ! strcmp(name, "ltfs.mediaPreviousPermanentWriteErrors")
-			|| ! strcmp(name, "ltfs.mediaPreviousPermanentReadErrors")
-			|| ! strcmp(name, "ltfs.mediaBeginningMediumPasses")
-			|| ! strcmp(name, "ltfs.mediaMiddleMediumPasses")
-			|| ! strcmp(name, "ltfs.mediaEfficiency")
-			|| ! strcmp(name, "ltfs.mediaStorageAlert")
-			|| ! strcmp(name, "ltfs.mediaDatasetsWritten")
-			|| ! strcmp(name, "ltfs.mediaDatasetsRead")
-			|| ! strcmp(name, "ltfs.mediaMBWritten")
-			|| ! strcmp(name, "ltfs.mediaMBRead")
-			|| ! strcmp(name, "ltfs.mediaDataPartitionTotalCapacity")
-			|| ! strcmp(name, "ltfs.mediaDataPartitionAvailableSpace")
-			|| ! strcmp(name, "ltfs.mediaIndexPartitionTotalCapacity")
-			|| ! strcmp(name, "ltfs.mediaIndexPartitionAvailableSpace")
-			|| ! strcmp(name, "ltfs.mediaEncrypted")
-			|| ! strcmp(name, "ltfs.mediaPool.additionalInfo")
-			|| ! strcmp(name, "ltfs.driveEncryptionState")
-			|| ! strcmp(name, "ltfs.driveEncryptionMethod")
-			/* Vendor specific EAs */
-			|| ! strcmp(name, "ltfs.vendor.IBM.referencedBlocks")
-			|| ! strcmp(name, "ltfs.vendor.IBM.trace")
-			|| ! strcmp(name, "ltfs.vendor.IBM.totalBlocks")
-			|| ! strcmp(name, "ltfs.vendor.IBM.cartridgeMountNode")
-			|| ! strcmp(name, "ltfs.vendor.IBM.logLevel")
-			|| ! strcmp(name, "ltfs.vendor.IBM.syslogLevel")
-			|| ! strcmp(name, "ltfs.vendor.IBM.rao")
-			|| ! strcmp(name, "ltfs.vendor.IBM.logPage")
-			|| ! strcmp(name, "ltfs.vendor.IBM.mediaMAM")
-			|| ! strncmp(name, "ltfs.vendor", strlen("ltfs.vendor")))
-			return true;
+	if (d != vol->index->root)
+		return NULL;
+	if (vea->id == VEA_POLICY_MAX_FILE_SIZE && ! vol->index->index_criteria.have_criteria)
+		return NULL;
+	if (vea->id == VEA_VENDOR && _xattr_is_worm_ea(name)) {
+		/* Treat WORM related EA as real EA */
+		return NULL;
 	}
+	return vea;
+}
 
-	return false;
+/**
+ * Determine whether an extended attribute name exists and is virtual for a given dentry.
+ * @param d Dentry to check.
+ * @param name Name to check, without the "user." prefix.
+ * @param vol LTFS volume to which the dentry belongs.
+ * @return true if the name exists and is virtual, false otherwise.
+ */
+bool xattr_is_virtual(struct dentry *d, const char *name, struct ltfs_volume *vol)
+{
+	return _xattr_virtual(d, name, vol) != NULL;
 }
 
 /**
@@ -505,17 +695,19 @@ static bool _xattr_is_virtual(struct dentry *d, const char *name, struct ltfs_vo
  * @param buf Output buffer.
  * @param buf_size Output buffer size, may be zero.
  * @param name Name to check for.
+ * @param vea Virtual EA entry of the name, as returned by _xattr_virtual.
  * @param vol LTFS volume
  * @return Number of bytes in output buffer (or if buf_size==0, number of bytes needed for output),
  *         -LTFS_NO_XATTR if no such readable virtual xattr exists,
  *         -LTFS_RDONLY_XATTR for write-only virtual EAs, or another negative value on error.
  */
 static int _xattr_get_virtual(struct dentry *d, char *buf, size_t buf_size, const char *name,
-					   struct ltfs_volume *vol)
+					   const struct xattr_vea *vea, struct ltfs_volume *vol)
 {
 	int ret = -LTFS_NO_XATTR;
 	char *val = NULL;
 	struct index_criteria *ic = &vol->index->index_criteria;
+	struct fs_extent_iter iter;
 	cartridge_health_info h = {
 		.mounts           = UNSUPPORTED_CARTRIDGE_HEALTH,
 		.written_ds       = UNSUPPORTED_CARTRIDGE_HEALTH,
@@ -536,241 +728,298 @@ static int _xattr_get_virtual(struct dentry *d, char *buf, size_t buf_size, cons
 	uint64_t append_pos = 0;
 	struct device_capacity cap;
 
-	/* EAs on all dentries */
-	if (! strcmp(name, "ltfs.createTime")) {
-		ret = _xattr_get_dentry_time(d, &d->creation_time, &val, name);
-		if (ret == LTFS_TIME_OUT_OF_RANGE) {
-			ltfsmsg(LTFS_WARN, 17222W, name, d->name.name, (unsigned long long)d->uid, (long long)d->creation_time.tv_sec);
-			ret = 0;
-		}
-	} else if (! strcmp(name, "ltfs.modifyTime")) {
-		ret = _xattr_get_dentry_time(d, &d->modify_time, &val, name);
-		if (ret == LTFS_TIME_OUT_OF_RANGE) {
-			ltfsmsg(LTFS_WARN, 17222W, name, d->name.name, (unsigned long long)d->uid, (long long)d->modify_time.tv_sec);
-			ret = 0;
-		}
-	} else if (! strcmp(name, "ltfs.accessTime")) {
-		ret = _xattr_get_dentry_time(d, &d->access_time, &val, name);
-		if (ret == LTFS_TIME_OUT_OF_RANGE) {
-			ltfsmsg(LTFS_WARN, 17222W, name, d->name.name, (unsigned long long)d->uid, (long long)d->access_time.tv_sec);
-			ret = 0;
-		}
-	} else if (! strcmp(name, "ltfs.changeTime")) {
-		ret = _xattr_get_dentry_time(d, &d->change_time, &val, name);
-		if (ret == LTFS_TIME_OUT_OF_RANGE) {
-			ltfsmsg(LTFS_WARN, 17222W, name, d->name.name, (unsigned long long)d->uid, (long long)d->change_time.tv_sec);
-			ret = 0;
-		}
-	} else if (! strcmp(name, "ltfs.backupTime")) {
-		ret = _xattr_get_dentry_time(d, &d->backup_time, &val, name);
-		if (ret == LTFS_TIME_OUT_OF_RANGE) {
-			ltfsmsg(LTFS_WARN, 17222W, name, d->name.name, (unsigned long long)d->uid, (long long)d->backup_time.tv_sec);
-			ret = 0;
-		}
-	} else if (! strcmp(name, "ltfs.driveCaptureDump")) {
-		ret = tape_takedump_drive(vol->device, true);
-	} else if (! strcmp(name, "ltfs.fileUID")) {
-		ret = xattr_get_u64(d->uid, &val, name);
-	} else if (! strcmp(name, "ltfs.volumeUUID")) {
-		ret = xattr_get_string(vol->label->vol_uuid, &val, name);
-	} else if (! strcmp(name, "ltfs.volumeName")) {
-		ltfs_mutex_lock(&vol->index->dirty_lock);
-		ret = xattr_get_string(vol->index->volume_name.name, &val, name);
-		ltfs_mutex_unlock(&vol->index->dirty_lock);
-	} else if (! strcmp(name, "ltfs.softwareVersion")) {
-		ret = xattr_get_string(PACKAGE_VERSION, &val, name);
-	} else if (! strcmp(name, "ltfs.softwareFormatSpec")) {
-		ret = xattr_get_string(LTFS_INDEX_VERSION_STR, &val, name);
-	} else if (! strcmp(name, "ltfs.softwareVendor")) {
-		ret = xattr_get_string(LTFS_VENDOR_NAME, &val, name);
-	} else if (! strcmp(name, "ltfs.softwareProduct")) {
-		if ( strncmp( PACKAGE_VERSION, "1", 1 )==0 )
-			ret = xattr_get_string("LTFS SDE", &val, name);
-		else if ( strncmp( PACKAGE_VERSION, "2", 1 )==0 )
-			ret = xattr_get_string("LTFS LE", &val, name);
-		else
-			ret = -LTFS_NO_XATTR;
-	} else if (! strcmp(name, "ltfs.vendor.IBM.logLevel")) {
-		ret = asprintf(&val, "%d", ltfs_log_level);
-		if (ret < 0) {
-			ltfsmsg(LTFS_ERR, 10001E, name);
-			val = NULL;
-			ret = -LTFS_NO_MEMORY;
-		}
-	} else if (! strcmp(name, "ltfs.vendor.IBM.syslogLevel")) {
-		ret = asprintf(&val, "%d", ltfs_syslog_level);
-		if (ret < 0) {
-			ltfsmsg(LTFS_ERR, 10001E, name);
-			val = NULL;
-			ret = -LTFS_NO_MEMORY;
-		}
-	} else if (! strcmp(name, "ltfs.vendor.IBM.profiler")) {
-		ret = ltfs_trace_get_offset(&val);
-		if (ret < 0) {
-			ltfsmsg(LTFS_ERR, 10001E, name);
-			val = NULL;
-			ret = -LTFS_NO_MEMORY;
-		}
-	} else if (! strcmp(name, "ltfs.mamBarcode")) {
-		ret = read_tape_attribute (vol, &val, name);
-		if (ret < 0) {
-			ltfsmsg(LTFS_DEBUG, 17198D, TC_MAM_BARCODE, "_xattr_get_virtual");
-			val = NULL;
-		}
-	} else if (! strcmp(name, "ltfs.mamApplicationVendor")) {
-		ret = read_tape_attribute (vol, &val, name);
-		if (ret < 0) {
-			ltfsmsg(LTFS_DEBUG, 17198D, TC_MAM_APP_VENDER, "_xattr_get_virtual");
-			val = NULL;
-		}
-	} else if (! strcmp(name, "ltfs.mamApplicationVersion")) {
-		ret = read_tape_attribute (vol, &val, name);
-		if (ret < 0) {
-			ltfsmsg(LTFS_DEBUG, 17198D, TC_MAM_APP_VERSION, "_xattr_get_virtual");
-			val = NULL;
-		}
-	} else if (! strcmp(name, "ltfs.mamApplicationFormatVersion")) {
-		ret = read_tape_attribute (vol, &val, name);
-		if (ret < 0) {
-			ltfsmsg(LTFS_DEBUG, 17198D, TC_MAM_APP_FORMAT_VERSION, "_xattr_get_virtual");
-			val = NULL;
-		}
-	} else if (! strcmp(name, "ltfs.volumeLockState")) {
-		if (vol->device) {
-			unsigned int lock = 0;
-			switch (vol->lock_status) {
-				case LOCKED_MAM:
-					lock |= VOL_LOCKED;
-					break;
-				case PWE_MAM:
-					lock |= VOL_PERM_WRITE_ERR;
-					break;
-				case PERMLOCKED_MAM:
-					lock |= VOL_PERM_LOCKED;
-					break;
-				case PWE_MAM_DP:
-					lock |= VOL_PERM_WRITE_ERR;
-					lock |= VOL_DP_PERM_ERR;
-					break;
-				case PWE_MAM_IP:
-					lock |= VOL_PERM_WRITE_ERR;
-					lock |= VOL_IP_PERM_ERR;
-					break;
-				case PWE_MAM_BOTH:
-					lock |= VOL_PERM_WRITE_ERR;
-					lock |= VOL_DP_PERM_ERR;
-					lock |= VOL_IP_PERM_ERR;
-					break;
-				default:
-					break;
+	switch (vea->id) {
+		/* EAs on all dentries */
+		case VEA_CREATE_TIME:
+			ret = _xattr_get_dentry_time(d, &d->creation_time, &val, name);
+			if (ret == LTFS_TIME_OUT_OF_RANGE) {
+				ltfsmsg(LTFS_WARN, 17222W, name, d->name.name, (unsigned long long)d->uid, (long long)d->creation_time.tv_sec);
+				ret = 0;
 			}
-			ret = asprintf(&val, "0x%08x", (uint32_t)(vol->device->write_protected | lock));
+			break;
+		case VEA_MODIFY_TIME:
+			ret = _xattr_get_dentry_time(d, &d->modify_time, &val, name);
+			if (ret == LTFS_TIME_OUT_OF_RANGE) {
+				ltfsmsg(LTFS_WARN, 17222W, name, d->name.name, (unsigned long long)d->uid, (long long)d->modify_time.tv_sec);
+				ret = 0;
+			}
+			break;
+		case VEA_ACCESS_TIME:
+			ret = _xattr_get_dentry_time(d, &d->access_time, &val, name);
+			if (ret == LTFS_TIME_OUT_OF_RANGE) {
+				ltfsmsg(LTFS_WARN, 17222W, name, d->name.name, (unsigned long long)d->uid, (long long)d->access_time.tv_sec);
+				ret = 0;
+			}
+			break;
+		case VEA_CHANGE_TIME:
+			ret = _xattr_get_dentry_time(d, &d->change_time, &val, name);
+			if (ret == LTFS_TIME_OUT_OF_RANGE) {
+				ltfsmsg(LTFS_WARN, 17222W, name, d->name.name, (unsigned long long)d->uid, (long long)d->change_time.tv_sec);
+				ret = 0;
+			}
+			break;
+		case VEA_BACKUP_TIME:
+			ret = _xattr_get_dentry_time(d, &d->backup_time, &val, name);
+			if (ret == LTFS_TIME_OUT_OF_RANGE) {
+				ltfsmsg(LTFS_WARN, 17222W, name, d->name.name, (unsigned long long)d->uid, (long long)d->backup_time.tv_sec);
+				ret = 0;
+			}
+			break;
+		case VEA_DRIVE_CAPTURE_DUMP:
+			ret = tape_takedump_drive(vol->device, true);
+			break;
+		case VEA_FILE_UID:
+			ret = xattr_get_u64(d->uid, &val, name);
+			break;
+		case VEA_VOLUME_UUID:
+			ret = xattr_get_string(vol->label->vol_uuid, &val, name);
+			break;
+		case VEA_VOLUME_NAME:
+			ltfs_mutex_lock(&vol->index->dirty_lock);
+			ret = xattr_get_string(vol->index->volume_name.name, &val, name);
+			ltfs_mutex_unlock(&vol->index->dirty_lock);
+			break;
+		case VEA_SOFTWARE_VERSION:
+			ret = xattr_get_string(PACKAGE_VERSION, &val, name);
+			break;
+		case VEA_SOFTWARE_FORMAT_SPEC:
+			ret = xattr_get_string(LTFS_INDEX_VERSION_STR, &val, name);
+			break;
+		case VEA_SOFTWARE_VENDOR:
+			ret = xattr_get_string(LTFS_VENDOR_NAME, &val, name);
+			break;
+		case VEA_SOFTWARE_PRODUCT:
+			if ( strncmp( PACKAGE_VERSION, "1", 1 )==0 )
+				ret = xattr_get_string("LTFS SDE", &val, name);
+			else if ( strncmp( PACKAGE_VERSION, "2", 1 )==0 )
+				ret = xattr_get_string("LTFS LE", &val, name);
+			else
+				ret = -LTFS_NO_XATTR;
+			break;
+		case VEA_IBM_LOG_LEVEL:
+			ret = asprintf(&val, "%d", ltfs_log_level);
 			if (ret < 0) {
 				ltfsmsg(LTFS_ERR, 10001E, name);
 				val = NULL;
 				ret = -LTFS_NO_MEMORY;
 			}
-		} else {
-			val = NULL;
-			ret = -LTFS_CART_NOT_MOUNTED;
-		}
-	}
+			break;
+		case VEA_IBM_SYSLOG_LEVEL:
+			ret = asprintf(&val, "%d", ltfs_syslog_level);
+			if (ret < 0) {
+				ltfsmsg(LTFS_ERR, 10001E, name);
+				val = NULL;
+				ret = -LTFS_NO_MEMORY;
+			}
+			break;
+		case VEA_IBM_PROFILER:
+			ret = ltfs_trace_get_offset(&val);
+			if (ret < 0) {
+				ltfsmsg(LTFS_ERR, 10001E, name);
+				val = NULL;
+				ret = -LTFS_NO_MEMORY;
+			}
+			break;
+		case VEA_IBM_LOCK_PROFILE:
+			ret = lock_profile_format(&val);
+			if (ret < 0)
+				val = NULL;
+			break;
+		case VEA_MAM_BARCODE:
+			ret = read_tape_attribute (vol, &val, name);
+			if (ret < 0) {
+				ltfsmsg(LTFS_DEBUG, 17198D, TC_MAM_BARCODE, "_xattr_get_virtual");
+				val = NULL;
+			}
+			break;
+		case VEA_MAM_APPLICATION_VENDOR:
+			ret = read_tape_attribute (vol, &val, name);
+			if (ret < 0) {
+				ltfsmsg(LTFS_DEBUG, 17198D, TC_MAM_APP_VENDER, "_xattr_get_virtual");
+				val = NULL;
+			}
+			break;
+		case VEA_MAM_APPLICATION_VERSION:
+			ret = read_tape_attribute (vol, &val, name);
+			if (ret < 0) {
+				ltfsmsg(LTFS_DEBUG, 17198D, TC_MAM_APP_VERSION, "_xattr_get_virtual");
+				val = NULL;
+			}
+			break;
+		case VEA_MAM_APPLICATION_FORMAT_VERSION:
+			ret = read_tape_attribute (vol, &val, name);
+			if (ret < 0) {
+				ltfsmsg(LTFS_DEBUG, 17198D, TC_MAM_APP_FORMAT_VERSION, "_xattr_get_virtual");
+				val = NULL;
+			}
+			break;
+		case VEA_VOLUME_LOCK_STATE:
+			if (vol->device) {
+				unsigned int lock = 0;
+				switch (vol->lock_status) {
+					case LOCKED_MAM:
+						lock |= VOL_LOCKED;
+						break;
+					case PWE_MAM:
+						lock |= VOL_PERM_WRITE_ERR;
+						break;
+					case PERMLOCKED_MAM:
+						lock |= VOL_PERM_LOCKED;
+						break;
+					case PWE_MAM_DP:
+						lock |= VOL_PERM_WRITE_ERR;
+						lock |= VOL_DP_PERM_ERR;
+						break;
+					case PWE_MAM_IP:
+						lock |= VOL_PERM_WRITE_ERR;
+						lock |= VOL_IP_PERM_ERR;
+						break;
+					case PWE_MAM_BOTH:
+						lock |= VOL_PERM_WRITE_ERR;
+						lock |= VOL_DP_PERM_ERR;
+						lock |= VOL_IP_PERM_ERR;
+						break;
+					default:
+						break;
+				}
+				ret = asprintf(&val, "0x%08x", (uint32_t)(vol->device->write_protected | lock));
+				if (ret < 0) {
+					ltfsmsg(LTFS_ERR, 10001E, name);
+					val = NULL;
+					ret = -LTFS_NO_MEMORY;
+				}
+			} else {
+				val = NULL;
+				ret = -LTFS_CART_NOT_MOUNTED;
+			}
+			break;
 
-	/* EAs on non-empty files */
-	if (ret == -LTFS_NO_XATTR && ! d->isdir && ! TAILQ_EMPTY(&d->extentlist)) {
-		if (! strcmp(name, "ltfs.partition")) {
+		/* EAs on non-empty files */
+		case VEA_PARTITION:
 			ret = 0;
 			val = malloc(2 * sizeof(char));
 			if (! val) {
 				ltfsmsg(LTFS_ERR, 10001E, name);
 				ret = -LTFS_NO_MEMORY;
 			} else {
-				val[0] = TAILQ_FIRST(&d->extentlist)->start.partition;
+				val[0] = fs_extent_first(d, &iter)->start.partition;
 				val[1] = '\0';
 			}
-		} else if (! strcmp(name, "ltfs.startblock")) {
-			ret = xattr_get_u64(TAILQ_FIRST(&d->extentlist)->start.block, &val, name);
-		}
-	}
+			break;
+		case VEA_STARTBLOCK:
+			ret = xattr_get_u64(fs_extent_first(d, &iter)->start.block, &val, name);
+			break;
 
-	/* EAs on root dentry */
-	if (ret == -LTFS_NO_XATTR && d == vol->index->root) {
-		if (! strcmp(name, "ltfs.commitMessage")) {
+		/* EAs on the root dentry */
+		case VEA_COMMIT_MESSAGE:
 			ltfs_mutex_lock(&vol->index->dirty_lock);
 			ret = xattr_get_string(vol->index->commit_message, &val, name);
 			ltfs_mutex_unlock(&vol->index->dirty_lock);
-		} else if (! strcmp(name, "ltfs.volumeSerial")) {
+			break;
+		case VEA_VOLUME_SERIAL:
 			ret = xattr_get_string(vol->label->barcode, &val, name);
-		} else if (! strcmp(name, "ltfs.volumeFormatTime")) {
+			break;
+		case VEA_VOLUME_FORMAT_TIME:
 			ret = _xattr_get_time(&vol->label->format_time, &val, name);
 			if (ret == LTFS_TIME_OUT_OF_RANGE) {
 				ltfsmsg(LTFS_WARN, 17222W, name, "root", (unsigned long long)0, (unsigned long long)vol->label->format_time.tv_sec);
 				ret = 0;
 			}
-		} else if (! strcmp(name, "ltfs.volumeBlocksize")) {
+			break;
+		case VEA_VOLUME_BLOCKSIZE:
 			ret = xattr_get_u64(vol->label->blocksize, &val, name);
-		} else if (! strcmp(name, "ltfs.indexGeneration")) {
+			break;
+		case VEA_INDEX_GENERATION:
 			ret = xattr_get_u64(vol->index->generation, &val, name);
-		} else if (! strcmp(name, "ltfs.indexTime")) {
+			break;
+		case VEA_INDEX_TIME:
 			ret = _xattr_get_time(&vol->index->mod_time, &val, name);
 			if (ret == LTFS_TIME_OUT_OF_RANGE) {
 				ltfsmsg(LTFS_WARN, 17222W, name, "root", (unsigned long long)0, (unsigned long long)vol->label->format_time.tv_sec);
 				ret = 0;
 			}
-		} else if (! strcmp(name, "ltfs.policyExists")) {
+			break;
+		case VEA_POLICY_EXISTS:
 			ret = xattr_get_string(ic->have_criteria ? "true" : "false", &val, name);
-		} else if (! strcmp(name, "ltfs.policyAllowUpdate")) {
+			break;
+		case VEA_POLICY_ALLOW_UPDATE:
 			ret = xattr_get_string(vol->index->criteria_allow_update ? "true" : "false",
 				&val, name);
-		} else if (! strcmp(name, "ltfs.policyMaxFileSize") && ic->have_criteria) {
+			break;
+		case VEA_POLICY_MAX_FILE_SIZE:
+			if (! (ic->have_criteria))
+				break;
 			ret = xattr_get_u64(ic->max_filesize_criteria, &val, name);
-		} else if (! strcmp(name, "ltfs.volumeCompression")) {
+			break;
+		case VEA_VOLUME_COMPRESSION:
 			ret = xattr_get_string(vol->label->enable_compression ? "true" : "false", &val, name);
-		} else if (! strcmp(name, "ltfs.indexLocation")) {
+			break;
+		case VEA_INDEX_LOCATION:
 			ret = _xattr_get_tapepos(&vol->index->selfptr, &val, name);
-		} else if (! strcmp(name, "ltfs.indexPrevious")) {
+			break;
+		case VEA_INDEX_PREVIOUS:
 			ret = _xattr_get_tapepos(&vol->index->backptr, &val, name);
-		} else if (! strcmp(name, "ltfs.indexCreator")) {
+			break;
+		case VEA_INDEX_CREATOR:
 			ret = xattr_get_string(vol->index->creator, &val, name);
-		} else if (! strcmp(name, "ltfs.labelCreator")) {
+			break;
+		case VEA_LABEL_CREATOR:
 			ret = xattr_get_string(vol->label->creator, &val, name);
-		} else if (! strcmp(name, "ltfs.indexVersion")) {
+			break;
+		case VEA_INDEX_VERSION:
 			ltfs_mutex_lock(&vol->index->dirty_lock);
 			ret = _xattr_get_version(vol->index->version, &val, name);
 			ltfs_mutex_unlock(&vol->index->dirty_lock);
-		} else if (! strcmp(name, "ltfs.labelVersion")) {
+			break;
+		case VEA_LABEL_VERSION:
 			ret = _xattr_get_version(vol->label->version, &val, name);
-		} else if (! strcmp(name, "ltfs.partitionMap")) {
+			break;
+		case VEA_PARTITION_MAP:
 			ret = _xattr_get_partmap(vol->label, &val, name);
-		} else if (! strcmp(name, "ltfs.mediaLoads")) {
+			break;
+		case VEA_MEDIA_LOADS:
 			ret = _xattr_get_cartridge_health(&h, &h.mounts, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaRecoveredWriteErrors")) {
+			break;
+		case VEA_MEDIA_RECOVERED_WRITE_ERRORS:
 			ret = _xattr_get_cartridge_health(&h, &h.write_temps, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaPermanentWriteErrors")) {
+			break;
+		case VEA_MEDIA_PERMANENT_WRITE_ERRORS:
 			ret = _xattr_get_cartridge_health(&h, &h.write_perms, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaRecoveredReadErrors")) {
+			break;
+		case VEA_MEDIA_RECOVERED_READ_ERRORS:
 			ret = _xattr_get_cartridge_health(&h, &h.read_temps, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaPermanentReadErrors")) {
+			break;
+		case VEA_MEDIA_PERMANENT_READ_ERRORS:
 			ret = _xattr_get_cartridge_health(&h, &h.read_perms, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaPreviousPermanentWriteErrors")) {
+			break;
+		case VEA_MEDIA_PREVIOUS_PERMANENT_WRITE_ERRORS:
 			ret = _xattr_get_cartridge_health(&h, &h.write_perms_prev, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaPreviousPermanentReadErrors")) {
+			break;
+		case VEA_MEDIA_PREVIOUS_PERMANENT_READ_ERRORS:
 			ret = _xattr_get_cartridge_health(&h, &h.read_perms_prev, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaBeginningMediumPasses")) {
+			break;
+		case VEA_MEDIA_BEGINNING_MEDIUM_PASSES:
 			ret = _xattr_get_cartridge_health(&h, &h.passes_begin, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaMiddleMediumPasses")) {
+			break;
+		case VEA_MEDIA_MIDDLE_MEDIUM_PASSES:
 			ret = _xattr_get_cartridge_health(&h, &h.passes_middle, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaEfficiency")) {
+			break;
+		case VEA_MEDIA_EFFICIENCY:
 			ret = _xattr_get_cartridge_health(&h, &h.tape_efficiency, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaDatasetsWritten")) {
+			break;
+		case VEA_MEDIA_DATASETS_WRITTEN:
 			ret = _xattr_get_cartridge_health_u64(&h, &h.written_ds, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaDatasetsRead")) {
+			break;
+		case VEA_MEDIA_DATASETS_READ:
 			ret = _xattr_get_cartridge_health_u64(&h, &h.read_ds, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaMBWritten")) {
+			break;
+		case VEA_MEDIA_MB_WRITTEN:
 			ret = _xattr_get_cartridge_health_u64(&h, &h.written_mbytes, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaMBRead")) {
+			break;
+		case VEA_MEDIA_MB_READ:
 			ret = _xattr_get_cartridge_health_u64(&h, &h.read_mbytes, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaStorageAlert")) {
+			break;
+		case VEA_MEDIA_STORAGE_ALERT:
 			ret = ltfs_get_tape_alert_unlocked(&tape_alert, vol);
 			if (ret < 0)
 				val = NULL;
@@ -782,95 +1031,113 @@ static int _xattr_get_virtual(struct dentry *d, char *buf, size_t buf_size, cons
 					ret = -LTFS_NO_MEMORY;
 				}
 			}
-		} else if (! strcmp(name, "ltfs.mediaDataPartitionTotalCapacity")) {
+			break;
+		case VEA_MEDIA_DATA_PARTITION_TOTAL_CAPACITY:
 			ret = _xattr_get_cartridge_capacity(&cap, &cap.total_dp, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaDataPartitionAvailableSpace")) {
+			break;
+		case VEA_MEDIA_DATA_PARTITION_AVAILABLE_SPACE:
 			ret = _xattr_get_cartridge_capacity(&cap, &cap.remaining_dp, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaIndexPartitionTotalCapacity")) {
+			break;
+		case VEA_MEDIA_INDEX_PARTITION_TOTAL_CAPACITY:
 			ret = _xattr_get_cartridge_capacity(&cap, &cap.total_ip, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaIndexPartitionAvailableSpace")) {
+			break;
+		case VEA_MEDIA_INDEX_PARTITION_AVAILABLE_SPACE:
 			ret = _xattr_get_cartridge_capacity(&cap, &cap.remaining_ip, &val, name, vol);
-		} else if (! strcmp(name, "ltfs.mediaEncrypted")) {
+			break;
+		case VEA_MEDIA_ENCRYPTED:
 			ret = xattr_get_string(tape_get_media_encrypted(vol->device), &val, name);
-		} else if (! strcmp(name, "ltfs.mediaPool.additionalInfo")) {
+			break;
+		case VEA_MEDIA_POOL_ADDITIONAL_INFO: {
 			char *tmp=NULL;
 			ret = tape_get_media_pool_info(vol, &tmp, &val);
 			if (ret < 0 || !val)
 				ret = -LTFS_NO_XATTR;
-		} else if (! strcmp(name, "ltfs.driveEncryptionState")) {
+			break;
+		}
+		case VEA_DRIVE_ENCRYPTION_STATE:
 			ret = xattr_get_string(tape_get_drive_encryption_state(vol->device), &val, name);
-		} else if (! strcmp(name, "ltfs.driveEncryptionMethod")) {
+			break;
+		case VEA_DRIVE_ENCRYPTION_METHOD:
 			ret = xattr_get_string(tape_get_drive_encryption_method(vol->device), &val, name);
-		} else if (! strcmp(name, "ltfs.vendor.IBM.referencedBlocks")) {
+			break;
+		case VEA_IBM_REFERENCED_BLOCKS:
 			ret = xattr_get_u64(ltfs_get_valid_block_count_unlocked(vol), &val, name);
-		} else if (! strcmp(name, "ltfs.vendor.IBM.trace")) {
+			break;
+		case VEA_IBM_TRACE:
 			ret = ltfs_get_trace_status(&val);
-		} else if (! strcmp(name, "ltfs.vendor.IBM.totalBlocks")) {
+			break;
+		case VEA_IBM_TOTAL_BLOCKS:
 			ret = ltfs_get_append_position(&append_pos, vol);
 			if (ret < 0)
 				val = NULL;
 			else
 				ret = xattr_get_u64(append_pos, &val, name);
-		} else if (! strcmp(name, "ltfs.vendor.IBM.cartridgeMountNode")) {
+			break;
+		case VEA_IBM_CARTRIDGE_MOUNT_NODE:
 			ret = asprintf(&val, "localhost");
 			if (ret < 0) {
 				ltfsmsg(LTFS_ERR, 10001E, name);
 				val = NULL;
 				ret = -LTFS_NO_MEMORY;
 			}
-		} else if ( (!strncmp(name, "ltfs.vendor.IBM.logPage.", strlen("ltfs.vendor.IBM.logPage."))) &&
-					(strlen(name) == strlen("ltfs.vendor.IBM.logPage.XX.XX")) ) {
-			char page_str[3]    = {0x00, 0x00, 0x00};
-			char subpage_str[3] = {0x00, 0x00, 0x00};
+			break;
+		case VEA_SYNC:
+			ret = ltfs_sync_index(SYNC_EA, false, vol);
+			break;
 
-			uint8_t page    = 0xFF;
-			uint8_t subpage = 0xFF;
+		default:
+			if ( (!strncmp(name, "ltfs.vendor.IBM.logPage.", strlen("ltfs.vendor.IBM.logPage."))) &&
+						(strlen(name) == strlen("ltfs.vendor.IBM.logPage.XX.XX")) ) {
+				char page_str[3]    = {0x00, 0x00, 0x00};
+				char subpage_str[3] = {0x00, 0x00, 0x00};
 
-			char *endptr = NULL;
+				uint8_t page    = 0xFF;
+				uint8_t subpage = 0xFF;
 
-			page_str[0]    = name[24];
-			page_str[1]    = name[25];
-			subpage_str[0] = name[27];
-			subpage_str[1] = name[28];
+				char *endptr = NULL;
 
-			page = (uint8_t)(strtoul(page_str, &endptr, 16));
-			if (*endptr) return -LTFS_NO_XATTR;
+				page_str[0]    = name[24];
+				page_str[1]    = name[25];
+				subpage_str[0] = name[27];
+				subpage_str[1] = name[28];
 
-			subpage = (uint8_t)(strtoul(subpage_str, &endptr, 16));
-			if (*endptr) return -LTFS_NO_XATTR;
+				page = (uint8_t)(strtoul(page_str, &endptr, 16));
+				if (*endptr) return -LTFS_NO_XATTR;
 
-			ret = ltfs_logpage(page, subpage, (unsigned char *)buf, buf_size, vol);
+				subpage = (uint8_t)(strtoul(subpage_str, &endptr, 16));
+				if (*endptr) return -LTFS_NO_XATTR;
 
-		} else if ( (!strncmp(name, "ltfs.vendor.IBM.mediaMAM.", strlen("ltfs.vendor.IBM.mediaMAM."))) &&
-					(strlen(name) == strlen("ltfs.vendor.IBM.mediaMAM.XX")) ) {
-			char part_str[3] = {0x00, 0x00, 0x00};
-			tape_partition_t part = 0;
+				ret = ltfs_logpage(page, subpage, (unsigned char *)buf, buf_size, vol);
 
-			char *endptr = NULL;
+			} else if ( (!strncmp(name, "ltfs.vendor.IBM.mediaMAM.", strlen("ltfs.vendor.IBM.mediaMAM."))) &&
+						(strlen(name) == strlen("ltfs.vendor.IBM.mediaMAM.XX")) ) {
+				char part_str[3] = {0x00, 0x00, 0x00};
+				tape_partition_t part = 0;
 
-			part_str[0] = name[25];
-			part_str[1] = name[26];
+				char *endptr = NULL;
 
-			if (!strncmp(part_str, "IP", sizeof(part_str))) {
-				part = ltfs_part_id2num(vol->label->partid_ip, vol);
-			} else if (!strncmp(part_str, "DP", sizeof(part_str))) {
-				part = ltfs_part_id2num(vol->label->partid_dp, vol);;
-			} else {
-				part = (uint8_t)(strtoul(part_str, &endptr, 16));
-				if (*endptr) return -LTFS_NO_XATTR;
-			}
+				part_str[0] = name[25];
+				part_str[1] = name[26];
+
+				if (!strncmp(part_str, "IP", sizeof(part_str))) {
+					part = ltfs_part_id2num(vol->label->partid_ip, vol);
+				} else if (!strncmp(part_str, "DP", sizeof(part_str))) {
+					part = ltfs_part_id2num(vol->label->partid_dp, vol);;
+				} else {
+					part = (uint8_t)(strtoul(part_str, &endptr, 16));
+					if (*endptr) return -LTFS_NO_XATTR;
+				}
 
-			if (part > 1) return -LTFS_NO_XATTR;
+				if (part > 1) return -LTFS_NO_XATTR;
 
-			ret = ltfs_mam(part, (unsigned char *)buf, buf_size, vol);
+				ret = ltfs_mam(part, (unsigned char *)buf, buf_size, vol);
 
-		} else if (! strncmp(name, "ltfs.vendor", strlen("ltfs.vendor"))) {
-			if (! strncmp(name + strlen("ltfs.vendor."), LTFS_VENDOR_NAME, strlen(LTFS_VENDOR_NAME))) {
-				ret = _xattr_get_vendorunique_xattr(&val, name, vol);
+			} else if (! strncmp(name, "ltfs.vendor", strlen("ltfs.vendor"))) {
+				if (! strncmp(name + strlen("ltfs.vendor."), LTFS_VENDOR_NAME, strlen(LTFS_VENDOR_NAME))) {
+					ret = _xattr_get_vendorunique_xattr(&val, name, vol);
+				}
 			}
-		} else if (! strcmp(name, "ltfs.sync")) {
-			ret = ltfs_sync_index(SYNC_EA, false, vol);
-		}
+			break;
 	}
 
 	if (val) {
@@ -894,344 +1161,394 @@ static int _xattr_get_virtual(struct dentry *d, char *buf, size_t buf_size, cons
  * @param name Name to set.
  * @param value Value to set, may be binary, not necessarily null-terminated.
  * @param size Size of value in bytes.
+ * @param vea Virtual EA entry of the name, as returned by _xattr_virtual.
  * @param vol LTFS volume
  * @return 0 on success, -LTFS_NO_XATTR if the xattr is not a settable virtual xattr,
  *         or another negative value on error.
  */
 static int _xattr_set_virtual(struct dentry *d, const char *name, const char *value,
-							  size_t size, struct ltfs_volume *vol)
+							  size_t size, const struct xattr_vea *vea, struct ltfs_volume *vol)
 {
 	int ret = 0;
 
-	if (! strcmp(name, "ltfs.sync") && d == vol->index->root)
-		ret = ltfs_sync_index(SYNC_EA, false, vol);
-	else if (! strcmp(name, "ltfs.commitMessage") && d == vol->index->root) {
-		char *value_null_terminated, *new_value;
+	switch (vea->id) {
+		case VEA_SYNC:
+			if (d != vol->index->root) {
+				ret = -LTFS_NO_XATTR;
+				break;
+			}
+			ret = ltfs_sync_index(SYNC_EA, false, vol);
+			break;
+		case VEA_COMMIT_MESSAGE: {
+			if (d != vol->index->root) {
+				ret = -LTFS_NO_XATTR;
+				break;
+			}
 
-		if (size > INDEX_MAX_COMMENT_LEN) {
-			ltfsmsg(LTFS_ERR, 11308E);
-			ret = -LTFS_LARGE_XATTR;
-		}
+			char *value_null_terminated, *new_value;
 
-		ltfs_mutex_lock(&vol->index->dirty_lock);
-		if (! value || ! size) {
-			/* Clear the current comment field */
-			if (vol->index->commit_message) {
-				free(vol->index->commit_message);
-				vol->index->commit_message = NULL;
-			}
-		} else {
-			value_null_terminated = malloc(size + 1);
-			if (! value_null_terminated) {
-				ltfsmsg(LTFS_ERR, 10001E, "_xattr_set_virtual: commit_message");
-				ltfs_mutex_unlock(&vol->index->dirty_lock);
-				return -LTFS_NO_MEMORY;
+			if (size > INDEX_MAX_COMMENT_LEN) {
+				ltfsmsg(LTFS_ERR, 11308E);
+				ret = -LTFS_LARGE_XATTR;
 			}
-			memcpy(value_null_terminated, value, size);
-			value_null_terminated[size] = '\0';
 
-			ret = pathname_format(value_null_terminated, &new_value, false, true);
-			free(value_null_terminated);
-			if (ret < 0) {
-				ltfs_mutex_unlock(&vol->index->dirty_lock);
-				return ret;
+			ltfs_mutex_lock(&vol->index->dirty_lock);
+			if (! value || ! size) {
+				/* Clear the current comment field */
+				if (vol->index->commit_message) {
+					free(vol->index->commit_message);
+					vol->index->commit_message = NULL;
+				}
+			} else {
+				value_null_terminated = malloc(size + 1);
+				if (! value_null_terminated) {
+					ltfsmsg(LTFS_ERR, 10001E, "_xattr_set_virtual: commit_message");
+					ltfs_mutex_unlock(&vol->index->dirty_lock);
+					return -LTFS_NO_MEMORY;
+				}
+				memcpy(value_null_terminated, value, size);
+				value_null_terminated[size] = '\0';
+
+				ret = pathname_format(value_null_terminated, &new_value, false, true);
+				free(value_null_terminated);
+				if (ret < 0) {
+					ltfs_mutex_unlock(&vol->index->dirty_lock);
+					return ret;
+				}
+				ret = 0;
+
+				/* Update the commit message in the index */
+				if (vol->index->commit_message)
+					free(vol->index->commit_message);
+				vol->index->commit_message = new_value;
 			}
-			ret = 0;
 
-			/* Update the commit message in the index */
-			if (vol->index->commit_message)
-				free(vol->index->commit_message);
-			vol->index->commit_message = new_value;
+			ltfs_set_index_dirty(false, false, vol->index);
+			ltfs_mutex_unlock(&vol->index->dirty_lock);
+
+			break;
 		}
+		case VEA_VOLUME_NAME: {
+			if (d != vol->index->root) {
+				ret = -LTFS_NO_XATTR;
+				break;
+			}
 
-		ltfs_set_index_dirty(false, false, vol->index);
-		ltfs_mutex_unlock(&vol->index->dirty_lock);
+			char *value_null_terminated, *new_value;
 
-	} else if (! strcmp(name, "ltfs.volumeName") && d == vol->index->root) {
-		char *value_null_terminated, *new_value;
+			ltfs_mutex_lock(&vol->index->dirty_lock);
+			if (! value || ! size) {
+				fs_clear_nametype(&vol->index->volume_name);
+				/* Clear tape attribute(TC_MAM_USER_MEDIUM_LABEL) */
+				ret =  update_tape_attribute (vol, NULL, TC_MAM_USER_MEDIUM_LABEL, 0);
+				if ( ret < 0 ) {
+					ltfsmsg(LTFS_WARN, 17199W, TC_MAM_USER_MEDIUM_LABEL, "_xattr_set_virtual");
+				}
+			} else {
+				value_null_terminated = malloc(size + 1);
+				if (! value_null_terminated) {
+					ltfsmsg(LTFS_ERR, 10001E, "_xattr_set_virtual: volume name");
+					ltfs_mutex_unlock(&vol->index->dirty_lock);
+					return -LTFS_NO_MEMORY;
+				}
+				memcpy(value_null_terminated, value, size);
+				value_null_terminated[size] = '\0';
 
-		ltfs_mutex_lock(&vol->index->dirty_lock);
-		if (! value || ! size) {
-			fs_clear_nametype(&vol->index->volume_name);
-			/* Clear tape attribute(TC_MAM_USER_MEDIUM_LABEL) */
-			ret =  update_tape_attribute (vol, NULL, TC_MAM_USER_MEDIUM_LABEL, 0);
-			if ( ret < 0 ) {
-				ltfsmsg(LTFS_WARN, 17199W, TC_MAM_USER_MEDIUM_LABEL, "_xattr_set_virtual");
-			}
-		} else {
-			value_null_terminated = malloc(size + 1);
-			if (! value_null_terminated) {
-				ltfsmsg(LTFS_ERR, 10001E, "_xattr_set_virtual: volume name");
-				ltfs_mutex_unlock(&vol->index->dirty_lock);
-				return -LTFS_NO_MEMORY;
-			}
-			memcpy(value_null_terminated, value, size);
-			value_null_terminated[size] = '\0';
+				ret = pathname_format(value_null_terminated, &new_value, true, false);
+				free(value_null_terminated);
+				if (ret < 0) {
+					ltfs_mutex_unlock(&vol->index->dirty_lock);
+					return ret;
+				}
+				ret = 0;
 
-			ret = pathname_format(value_null_terminated, &new_value, true, false);
-			free(value_null_terminated);
-			if (ret < 0) {
-				ltfs_mutex_unlock(&vol->index->dirty_lock);
-				return ret;
+				/* Update the volume name in the index */
+				fs_clear_nametype(&vol->index->volume_name);
+				fs_set_nametype(&vol->index->volume_name, new_value);
+
+				/* Update tape attribute(TC_MAM_USER_MEDIUM_LABEL) */
+				ret =  update_tape_attribute (vol, new_value, TC_MAM_USER_MEDIUM_LABEL, size);
+				if ( ret < 0 ) {
+					ltfsmsg(LTFS_WARN, 17199W, TC_MAM_USER_MEDIUM_LABEL, "_xattr_set_virtual");
+					return ret;
+				}
 			}
-			ret = 0;
 
-			/* Update the volume name in the index */
-			fs_clear_nametype(&vol->index->volume_name);
-			fs_set_nametype(&vol->index->volume_name, new_value);
+			ltfs_set_index_dirty(false, false, vol->index);
+			ltfs_mutex_unlock(&vol->index->dirty_lock);
 
-			/* Update tape attribute(TC_MAM_USER_MEDIUM_LABEL) */
-			ret =  update_tape_attribute (vol, new_value, TC_MAM_USER_MEDIUM_LABEL, size);
-			if ( ret < 0 ) {
-				ltfsmsg(LTFS_WARN, 17199W, TC_MAM_USER_MEDIUM_LABEL, "_xattr_set_virtual");
-				return ret;
-			}
+			break;
 		}
+		case VEA_CREATE_TIME:
+			ret = _xattr_set_time(d, &d->creation_time, value, size, name, vol);
+			if (ret == LTFS_TIME_OUT_OF_RANGE) {
+				ltfsmsg(LTFS_WARN, 17221W, name, d->name.name, (unsigned long long)d->uid, value);
+				ret = 0;
+			}
+			break;
+		case VEA_MODIFY_TIME:
+			get_current_timespec(&d->change_time);
+			ret = _xattr_set_time(d, &d->modify_time, value, size, name, vol);
+			if (ret == LTFS_TIME_OUT_OF_RANGE) {
+				ltfsmsg(LTFS_WARN, 17221W, name, d->name.name, (unsigned long long)d->uid, value);
+				ret = 0;
+			}
+			break;
+		case VEA_CHANGE_TIME:
+			ret = _xattr_set_time(d, &d->change_time, value, size, name, vol);
+			if (ret == LTFS_TIME_OUT_OF_RANGE) {
+				ltfsmsg(LTFS_WARN, 17221W, name, d->name.name, (unsigned long long)d->uid, value);
+				ret = 0;
+			}
+			break;
+		case VEA_ACCESS_TIME:
+			ret = _xattr_set_time(d, &d->access_time, value, size, name, vol);
+			if (ret == LTFS_TIME_OUT_OF_RANGE) {
+				ltfsmsg(LTFS_WARN, 17221W, name, d->name.name, (unsigned long long)d->uid, value);
+				ret = 0;
+			}
+			break;
+		case VEA_BACKUP_TIME:
+			ret = _xattr_set_time(d, &d->backup_time, value, size, name, vol);
+			if (ret == LTFS_TIME_OUT_OF_RANGE) {
+				ltfsmsg(LTFS_WARN, 17221W, name, d->name.name, (unsigned long long)d->uid, value);
+				ret = 0;
+			}
+			break;
+		case VEA_DRIVE_CAPTURE_DUMP:
+			ret = tape_takedump_drive(vol->device, true);
+			break;
+		case VEA_MEDIA_STORAGE_ALERT: {
+			uint64_t tape_alert = 0;
+			char *invalid_start, *v;
 
-		ltfs_set_index_dirty(false, false, vol->index);
-		ltfs_mutex_unlock(&vol->index->dirty_lock);
+			v = strndup(value, size);
+			if (! v) {
+				ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+				return -LTFS_NO_MEMORY;
+			}
 
-	} else if (! strcmp(name, "ltfs.createTime")) {
-		ret = _xattr_set_time(d, &d->creation_time, value, size, name, vol);
-		if (ret == LTFS_TIME_OUT_OF_RANGE) {
-			ltfsmsg(LTFS_WARN, 17221W, name, d->name.name, (unsigned long long)d->uid, value);
-			ret = 0;
-		}
-	} else if (! strcmp(name, "ltfs.modifyTime")) {
-		get_current_timespec(&d->change_time);
-		ret = _xattr_set_time(d, &d->modify_time, value, size, name, vol);
-		if (ret == LTFS_TIME_OUT_OF_RANGE) {
-			ltfsmsg(LTFS_WARN, 17221W, name, d->name.name, (unsigned long long)d->uid, value);
-			ret = 0;
-		}
-	} else if (! strcmp(name, "ltfs.changeTime")) {
-		ret = _xattr_set_time(d, &d->change_time, value, size, name, vol);
-		if (ret == LTFS_TIME_OUT_OF_RANGE) {
-			ltfsmsg(LTFS_WARN, 17221W, name, d->name.name, (unsigned long long)d->uid, value);
-			ret = 0;
-		}
-	} else if (! strcmp(name, "ltfs.accessTime")) {
-		ret = _xattr_set_time(d, &d->access_time, value, size, name, vol);
-		if (ret == LTFS_TIME_OUT_OF_RANGE) {
-			ltfsmsg(LTFS_WARN, 17221W, name, d->name.name, (unsigned long long)d->uid, value);
-			ret = 0;
-		}
-	} else if (! strcmp(name, "ltfs.backupTime")) {
-		ret = _xattr_set_time(d, &d->backup_time, value, size, name, vol);
-		if (ret == LTFS_TIME_OUT_OF_RANGE) {
-			ltfsmsg(LTFS_WARN, 17221W, name, d->name.name, (unsigned long long)d->uid, value);
-			ret = 0;
-		}
-	} else if (! strcmp(name, "ltfs.driveCaptureDump")) {
-		ret = tape_takedump_drive(vol->device, true);
-	} else if (! strcmp(name, "ltfs.mediaStorageAlert")) {
-		uint64_t tape_alert = 0;
-		char *invalid_start, *v;
-
-		v = strndup(value, size);
-		if (! v) {
-			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
-			return -LTFS_NO_MEMORY;
+			/* ltfs.mediaStorageAlert shall be specified by hexadecimal text */
+			tape_alert = strtoull(v, &invalid_start, 16);
+			if( (*invalid_start == '\0') && v )
+				ret = ltfs_clear_tape_alert(tape_alert, vol);
+			else
+				ret = -LTFS_STRING_CONVERSION;
+			free(v);
+			break;
 		}
+		case VEA_IBM_LOG_LEVEL: {
+			int level = 0;
+			char *invalid_start, *v;
 
-		/* ltfs.mediaStorageAlert shall be specified by hexadecimal text */
-		tape_alert = strtoull(v, &invalid_start, 16);
-		if( (*invalid_start == '\0') && v )
-			ret = ltfs_clear_tape_alert(tape_alert, vol);
-		else
-			ret = -LTFS_STRING_CONVERSION;
-		free(v);
-	} else if (! strcmp(name, "ltfs.vendor.IBM.logLevel")) {
-		int level = 0;
-		char *invalid_start, *v;
-
-		v = strndup(value, size);
-		if (! v) {
-			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
-			return -LTFS_NO_MEMORY;
-		}
+			v = strndup(value, size);
+			if (! v) {
+				ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+				return -LTFS_NO_MEMORY;
+			}
 
-		/* ltfs.vendor.IBM.logLevel shall be specified by hexadecimal text */
-		level = strtoul(v, &invalid_start, 0);
-		if( (*invalid_start == '\0') && v ) {
-			ret = 0;
-			ltfs_set_log_level(level);
-		} else
-			ret = -LTFS_STRING_CONVERSION;
-		free(v);
-	} else if (! strcmp(name, "ltfs.vendor.IBM.syslogLevel")) {
-		int level = 0;
-		char *invalid_start, *v;
-
-		v = strndup(value, size);
-		if (! v) {
-			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
-			return -LTFS_NO_MEMORY;
+			/* ltfs.vendor.IBM.logLevel shall be specified by hexadecimal text */
+			level = strtoul(v, &invalid_start, 0);
+			if( (*invalid_start == '\0') && v ) {
+				ret = 0;
+				ltfs_set_log_level(level);
+			} else
+				ret = -LTFS_STRING_CONVERSION;
+			free(v);
+			break;
 		}
+		case VEA_IBM_SYSLOG_LEVEL: {
+			int level = 0;
+			char *invalid_start, *v;
 
-		/* ltfs.vendor.IBM.syslogLevel shall be specified by hexadecimal text */
-		level = strtoul(v, &invalid_start, 0);
-		if( (*invalid_start == '\0') && v ) {
-			ret = 0;
-			ltfs_set_syslog_level(level);
-		} else
-			ret = -LTFS_STRING_CONVERSION;
-		free(v);
-	} else if (! strcmp(name, "ltfs.vendor.IBM.rao")) {
-		char *v;
-		v = strndup(value, size);
-		if (! v) {
-			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
-			return -LTFS_NO_MEMORY;
+			v = strndup(value, size);
+			if (! v) {
+				ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+				return -LTFS_NO_MEMORY;
+			}
+
+			/* ltfs.vendor.IBM.syslogLevel shall be specified by hexadecimal text */
+			level = strtoul(v, &invalid_start, 0);
+			if( (*invalid_start == '\0') && v ) {
+				ret = 0;
+				ltfs_set_syslog_level(level);
+			} else
+				ret = -LTFS_STRING_CONVERSION;
+			free(v);
+			break;
 		}
-		if (strlen(v) > PATH_MAX) return -LTFS_LARGE_XATTR; /* file path size check */
-		ret = ltfs_get_rao_list(v, vol);
-		free(v);
-	} else if (! strcmp(name, "ltfs.vendor.IBM.trace")) {
-		char *v;
-
-		v = strndup(value, size);
-		if (! v) {
-			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
-			return -LTFS_NO_MEMORY;
+		case VEA_IBM_RAO: {
+			char *v;
+			v = strndup(value, size);
+			if (! v) {
+				ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+				return -LTFS_NO_MEMORY;
+			}
+			if (strlen(v) > PATH_MAX) return -LTFS_LARGE_XATTR; /* file path size check */
+			ret = ltfs_get_rao_list(v, vol);
+			free(v);
+			break;
 		}
+		case VEA_IBM_TRACE: {
+			char *v;
 
-		ret = ltfs_set_trace_status(v);
-		free(v);
-	} else if (! strcmp(name, "ltfs.vendor.IBM.dump")) {
-		char *v;
+			v = strndup(value, size);
+			if (! v) {
+				ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+				return -LTFS_NO_MEMORY;
+			}
 
-		v = strndup(value, size);
-		if (! v) {
-			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
-			return -LTFS_NO_MEMORY;
+			ret = ltfs_set_trace_status(v);
+			free(v);
+			break;
 		}
+		case VEA_IBM_DUMP: {
+			char *v;
 
-		ret = ltfs_dump(v, vol->work_directory);
-		free(v);
-	} else if (! strcmp(name, "ltfs.vendor.IBM.dumpTrace")) {
-		char *v;
+			v = strndup(value, size);
+			if (! v) {
+				ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+				return -LTFS_NO_MEMORY;
+			}
 
-		v = strndup(value, size);
-		if (! v) {
-			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
-			return -LTFS_NO_MEMORY;
+			ret = ltfs_dump(v, vol->work_directory);
+			free(v);
+			break;
 		}
+		case VEA_IBM_DUMP_TRACE: {
+			char *v;
 
-		ret = ltfs_trace_dump(v, vol->work_directory);
-		free(v);
-	} else if (! strcmp(name, "ltfs.vendor.IBM.profiler")) {
-		uint64_t source = 0;
-		char *invalid_start, *v;
+			v = strndup(value, size);
+			if (! v) {
+				ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+				return -LTFS_NO_MEMORY;
+			}
 
-		v = strndup(value, size);
-		if (! v) {
-			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
-			return -LTFS_NO_MEMORY;
+			ret = ltfs_trace_dump(v, vol->work_directory);
+			free(v);
+			break;
 		}
+		case VEA_IBM_PROFILER: {
+			uint64_t source = 0;
+			char *invalid_start, *v;
 
-		source = strtoull(v, &invalid_start, 0);
-		if( (*invalid_start == '\0') && v ) {
-			/* Set request profiler */
-			if (source & PROF_REQ)
-				ret = ltfs_request_profiler_start(vol->work_directory);
-			else
-				ret = ltfs_request_profiler_stop();
-
-			ret = ltfs_profiler_set(source, vol);
-		} else
-			ret = -LTFS_STRING_CONVERSION;
-		free(v);
-	} else if (! strncmp(name, "ltfs.vendor", strlen("ltfs.vendor"))) {
-			if (! strncmp(name + strlen("ltfs.vendor."), LTFS_VENDOR_NAME, strlen(LTFS_VENDOR_NAME))) {
-				ret = _xattr_set_vendorunique_xattr(name, value, size, vol);
+			v = strndup(value, size);
+			if (! v) {
+				ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+				return -LTFS_NO_MEMORY;
 			}
-	} else if (! strcmp(name, "ltfs.mamBarcode")) {
-		ret =  update_tape_attribute (vol, value, TC_MAM_BARCODE, size);
-		if ( ret < 0 ) {
-			ltfsmsg(LTFS_WARN, 17199W, TC_MAM_USER_MEDIUM_LABEL, "_xattr_set_virtual");
-			return ret;
-		}
-	} else if (! strcmp(name, "ltfs.volumeLockState")) {
-		unsigned int lock = 0;
-		char *invalid_start, *v;
 
-		v = strndup(value, size);
-		if (! v) {
-			ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
-			return -LTFS_NO_MEMORY;
+			source = strtoull(v, &invalid_start, 0);
+			if( (*invalid_start == '\0') && v ) {
+				/* Set request profiler */
+				if (source & PROF_REQ)
+					ret = ltfs_request_profiler_start(vol->work_directory);
+				else
+					ret = ltfs_request_profiler_stop();
+
+				ret = ltfs_profiler_set(source, vol);
+			} else
+				ret = -LTFS_STRING_CONVERSION;
+			free(v);
+			break;
 		}
-
-		lock = strtoull(v, &invalid_start, 0);
-		if( (*invalid_start == '\0') && v ) {
-			mam_lockval new = UNLOCKED_MAM;
-			char status_mam[TC_MAM_LOCKED_MAM_SIZE];
-
-			switch (vol->t_attr->vollock) {
-				case PWE_MAM:
-				case PWE_MAM_DP:
-				case PWE_MAM_IP:
-				case PWE_MAM_BOTH:
-					/* Write perm tape cannot be updated */
-					return -LTFS_XATTR_ERR;
-					break;
-				default:
-					/* Fall through */
-					break;
+		case VEA_MAM_BARCODE:
+			ret =  update_tape_attribute (vol, value, TC_MAM_BARCODE, size);
+			if ( ret < 0 ) {
+				ltfsmsg(LTFS_WARN, 17199W, TC_MAM_USER_MEDIUM_LABEL, "_xattr_set_virtual");
+				return ret;
 			}
+			break;
+		case VEA_VOLUME_LOCK_STATE: {
+			unsigned int lock = 0;
+			char *invalid_start, *v;
 
-			if (vol->index->vollock == PERMLOCKED_MAM) {
-				/* Advisory perm-locked tape cannot be updated */
-				return -LTFS_XATTR_ERR;
+			v = strndup(value, size);
+			if (! v) {
+				ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+				return -LTFS_NO_MEMORY;
 			}
 
-			if ((lock & VOL_LOCKED) && (lock & VOL_PERM_LOCKED)) {
-				/* Invalid value to specify */
-				return -LTFS_XATTR_ERR;
-			}
+			lock = strtoull(v, &invalid_start, 0);
+			if( (*invalid_start == '\0') && v ) {
+				mam_lockval new = UNLOCKED_MAM;
+				char status_mam[TC_MAM_LOCKED_MAM_SIZE];
+
+				switch (vol->t_attr->vollock) {
+					case PWE_MAM:
+					case PWE_MAM_DP:
+					case PWE_MAM_IP:
+					case PWE_MAM_BOTH:
+						/* Write perm tape cannot be updated */
+						return -LTFS_XATTR_ERR;
+						break;
+					default:
+						/* Fall through */
+						break;
+				}
 
-			if (lock & VOL_LOCKED)
-				new = LOCKED_MAM;
-			else if (lock & VOL_PERM_LOCKED)
-				new = PERMLOCKED_MAM;
-			else
-				new = UNLOCKED_MAM;
+				if (vol->index->vollock == PERMLOCKED_MAM) {
+					/* Advisory perm-locked tape cannot be updated */
+					return -LTFS_XATTR_ERR;
+				}
 
-			if (vol->file_open_count != 0) {
-				ltfsmsg(LTFS_DEBUG, 10021D, "_xattr_set_virtual", "file open", vol->file_open_count, 0);
-				return -LTFS_XATTR_ERR;
-			}
+				if ((lock & VOL_LOCKED) && (lock & VOL_PERM_LOCKED)) {
+					/* Invalid value to specify */
+					return -LTFS_XATTR_ERR;
+				}
 
-			status_mam[0] = new;
+				if (lock & VOL_LOCKED)
+					new = LOCKED_MAM;
+				else if (lock & VOL_PERM_LOCKED)
+					new = PERMLOCKED_MAM;
+				else
+					new = UNLOCKED_MAM;
 
-			/* update MAM attribute */
-			ret =  update_tape_attribute(vol, status_mam, TC_MAM_LOCKED_MAM, TC_MAM_LOCKED_MAM_SIZE);
-			if ( ret < 0 ) {
-				ltfsmsg(LTFS_WARN, 17199W, TC_MAM_LOCKED_MAM, "_xattr_set_virtual");
-				return ret;
-			}
+				if (vol->file_open_count != 0) {
+					ltfsmsg(LTFS_DEBUG, 10021D, "_xattr_set_virtual", "file open", vol->file_open_count, 0);
+					return -LTFS_XATTR_ERR;
+				}
 
-			vol->index->vollock = new;
-			vol->t_attr->vollock = new;
-			vol->lock_status = new;
+				status_mam[0] = new;
 
-			ltfs_set_index_dirty(false, false, vol->index);
-			ret = ltfs_sync_index(SYNC_ADV_LOCK, false, vol);
-			ret = tape_device_lock(vol->device);
-			if (ret < 0) {
-				ltfsmsg(LTFS_ERR, 12010E, __FUNCTION__);
-				return ret;
-			}
-			ret = ltfs_write_index(ltfs_ip_id(vol), SYNC_EA, vol);
-			tape_device_unlock(vol->device);
-		} else
-			ret = -LTFS_STRING_CONVERSION;
-
-		free(v);
-	} else if (! strcmp(name, "ltfs.mediaPool.additionalInfo")) {
-		ret = tape_set_media_pool_info(vol, value, size, false);
-	} else
-		ret = -LTFS_NO_XATTR;
+				/* update MAM attribute */
+				ret =  update_tape_attribute(vol, status_mam, TC_MAM_LOCKED_MAM, TC_MAM_LOCKED_MAM_SIZE);
+				if ( ret < 0 ) {
+					ltfsmsg(LTFS_WARN, 17199W, TC_MAM_LOCKED_MAM, "_xattr_set_virtual");
+					return ret;
+				}
+
+				vol->index->vollock = new;
+				vol->t_attr->vollock = new;
+				vol->lock_status = new;
+
+				ltfs_set_index_dirty(false, false, vol->index);
+				ret = ltfs_sync_index(SYNC_ADV_LOCK, false, vol);
+				ret = tape_device_lock(vol->device);
+				if (ret < 0) {
+					ltfsmsg(LTFS_ERR, 12010E, __FUNCTION__);
+					return ret;
+				}
+				ret = ltfs_write_index(ltfs_ip_id(vol), SYNC_EA, vol);
+				tape_device_unlock(vol->device);
+			} else
+				ret = -LTFS_STRING_CONVERSION;
+
+			free(v);
+			break;
+		}
+		case VEA_MEDIA_POOL_ADDITIONAL_INFO:
+			ret = tape_set_media_pool_info(vol, value, size, false);
+			break;
+		default:
+			if (! strncmp(name, "ltfs.vendor", strlen("ltfs.vendor"))) {
+				if (! strncmp(name + strlen("ltfs.vendor."), LTFS_VENDOR_NAME, strlen(LTFS_VENDOR_NAME))) {
+					ret = _xattr_set_vendorunique_xattr(name, value, size, vol);
+				}
+			} else
+				ret = -LTFS_NO_XATTR;
+			break;
+	}
 
 	return ret;
 }
@@ -1241,36 +1558,46 @@ static int _xattr_set_virtual(struct dentry *d, const char *name, const char *va
  * but some have a meaningful removal operation.
  * @param d Dentry to remove xattr from.
  * @param name Attribute to remove.
+ * @param vea Virtual EA entry of the name, as returned by _xattr_virtual.
  * @param vol LTFS volume.
  * @return 0 on success, -LTFS_NO_XATTR if the xattr is not a removable virtual xattr, or another
  *         negative value on error.
  */
-static int _xattr_remove_virtual(struct dentry *d, const char *name, struct ltfs_volume *vol)
+static int _xattr_remove_virtual(struct dentry *d, const char *name, const struct xattr_vea *vea,
+	struct ltfs_volume *vol)
 {
 	int ret = 0;
 
-	if (! strcmp(name, "ltfs.commitMessage") && d == vol->index->root) {
-		ltfs_mutex_lock(&vol->index->dirty_lock);
-		if (vol->index->commit_message) {
-			free(vol->index->commit_message);
-			vol->index->commit_message = NULL;
-			ltfs_set_index_dirty(false, false, vol->index);
-		}
-		ltfs_mutex_unlock(&vol->index->dirty_lock);
-	} else if (! strcmp(name, "ltfs.volumeName") && d == vol->index->root) {
-		ltfs_mutex_lock(&vol->index->dirty_lock);
-		if (vol->index->volume_name.name) {
-			fs_clear_nametype(&vol->index->volume_name);
-			ltfs_set_index_dirty(false, false, vol->index);
-		}
-		/* Clear tape attribute(TC_MAM_USER_MEDIUM_LABEL) */
-		ret =  update_tape_attribute (vol, NULL, TC_MAM_USER_MEDIUM_LABEL, 0);
-		if ( ret < 0 ) {
-			ltfsmsg(LTFS_WARN, 17199W, TC_MAM_USER_MEDIUM_LABEL, "_xattr_set_virtual");
-		}
-		ltfs_mutex_unlock(&vol->index->dirty_lock);
-	} else
-		ret = -LTFS_NO_XATTR;
+	if (d != vol->index->root)
+		return -LTFS_NO_XATTR;
+
+	switch (vea->id) {
+		case VEA_COMMIT_MESSAGE:
+			ltfs_mutex_lock(&vol->index->dirty_lock);
+			if (vol->index->commit_message) {
+				free(vol->index->commit_message);
+				vol->index->commit_message = NULL;
+				ltfs_set_index_dirty(false, false, vol->index);
+			}
+			ltfs_mutex_unlock(&vol->index->dirty_lock);
+			break;
+		case VEA_VOLUME_NAME:
+			ltfs_mutex_lock(&vol->index->dirty_lock);
+			if (vol->index->volume_name.name) {
+				fs_clear_nametype(&vol->index->volume_name);
+				ltfs_set_index_dirty(false, false, vol->index);
+			}
+			/* Clear tape attribute(TC_MAM_USER_MEDIUM_LABEL) */
+			ret =  update_tape_attribute (vol, NULL, TC_MAM_USER_MEDIUM_LABEL, 0);
+			if ( ret < 0 ) {
+				ltfsmsg(LTFS_WARN, 17199W, TC_MAM_USER_MEDIUM_LABEL, "_xattr_set_virtual");
+			}
+			ltfs_mutex_unlock(&vol->index->dirty_lock);
+			break;
+		default:
+			ret = -LTFS_NO_XATTR;
+			break;
+	}
 
 	return ret;
 }
@@ -1312,7 +1639,7 @@ int xattr_do_set(struct dentry *d, const char *name, const char *value, size_t s
 			xattr->value = NULL;
 		}
 	} else {
-		xattr = (struct xattr_info *) calloc(1, sizeof(struct xattr_info));
+		xattr = calloc(1, sizeof(struct xattr_info));
 		if (! xattr) {
 			ltfsmsg(LTFS_ERR, 10001E, "xattr_do_set: xattr");
 			return -LTFS_NO_MEMORY;
@@ -1324,7 +1651,7 @@ int xattr_do_set(struct dentry *d, const char *name, const char *value, size_t s
 			goto out_free;
 		}
 		xattr->key.percent_encode = fs_is_percent_encode_required(xattr->key.name);
-		TAILQ_INSERT_HEAD(&d->xattrlist, xattr, list);
+		fs_add_xattr(d, xattr, false);
 	}
 
 	/* copy new value */
@@ -1341,7 +1668,7 @@ int xattr_do_set(struct dentry *d, const char *name, const char *value, size_t s
 	return 0;
 
 out_remove:
-	TAILQ_REMOVE(&d->xattrlist, xattr, list);
+	fs_remove_xattr(d, xattr);
 out_free:
 	if (xattr->key.name)
 		free(xattr->key.name);
@@ -1363,6 +1690,7 @@ int xattr_set(struct dentry *d, const char *name, const char *value, size_t size
 	int flags, struct ltfs_volume *vol)
 {
 	struct xattr_info *xattr;
+	const struct xattr_vea *vea;
 	bool replace, create;
 	int ret;
 	bool is_worm_cart = false;
@@ -1400,8 +1728,9 @@ int xattr_set(struct dentry *d, const char *name, const char *value, size_t size
 	}
 
 	/* Check if this is a user-writeable virtual xattr */
-	if (_xattr_is_virtual(d, name, vol)) {
-		ret = _xattr_set_virtual(d, name, value, size, vol);
+	vea = _xattr_virtual(d, name, vol);
+	if (vea) {
+		ret = _xattr_set_virtual(d, name, value, size, vea, vol);
 		if (ret == -LTFS_NO_XATTR)
 			ret = -LTFS_RDONLY_XATTR;
 		goto out_unlock;
@@ -1414,21 +1743,22 @@ int xattr_set(struct dentry *d, const char *name, const char *value, size_t size
 		goto out_unlock;
 	}
 
-	acquirewrite_mrsw(&d->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	index_snapshot_preserve(d);
 
 	/* Search for existing xattr with this name. */
 	ret = _xattr_seek(&xattr, d, name);
 	if (ret < 0) {
 		ltfsmsg(LTFS_ERR, 11122E, ret);
-		releasewrite_mrsw(&d->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 		goto out_unlock;
 	}
 	if (create && xattr) {
-		releasewrite_mrsw(&d->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 		ret = -LTFS_XATTR_EXISTS;
 		goto out_unlock;
 	} else if (replace && ! xattr) {
-		releasewrite_mrsw(&d->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 		ret = -LTFS_NO_XATTR;
 		goto out_unlock;
 	}
@@ -1437,7 +1767,7 @@ int xattr_set(struct dentry *d, const char *name, const char *value, size_t size
 
 		if (is_worm_cart && disable_worm_ea) {
 			ltfsmsg(LTFS_ERR, 17237E, "set xattr: clear WORM");
-			releasewrite_mrsw(&d->meta_lock);
+			releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 			ret = -LTFS_XATTR_ERR;
 			goto out_unlock;
 		}
@@ -1451,7 +1781,7 @@ int xattr_set(struct dentry *d, const char *name, const char *value, size_t size
 	if (!strcmp(name, "ltfs.mediaPool.name")) {
 		ret = tape_set_media_pool_info(vol, value, size, true);
 		if (ret < 0) {
-			releasewrite_mrsw(&d->meta_lock);
+			releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 			goto out_unlock;
 		}
 		write_idx = true;
@@ -1460,7 +1790,7 @@ int xattr_set(struct dentry *d, const char *name, const char *value, size_t size
 	/* Set extended attribute */
 	ret = xattr_do_set(d, name, value, size, xattr);
 	if (ret < 0) {
-		releasewrite_mrsw(&d->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 		goto out_unlock;
 	}
 
@@ -1475,7 +1805,7 @@ int xattr_set(struct dentry *d, const char *name, const char *value, size_t size
 	}
 
 	get_current_timespec(&d->change_time);
-	releasewrite_mrsw(&d->meta_lock);
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 	d->dirty = true;
 	ltfs_set_index_dirty(true, false, vol->index);
 
@@ -1505,6 +1835,7 @@ int xattr_get(struct dentry *d, const char *name, char *value, size_t size,
 	struct ltfs_volume *vol)
 {
 	struct xattr_info *xattr = NULL;
+	const struct xattr_vea *vea;
 	int ret;
 
 	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
@@ -1520,8 +1851,9 @@ int xattr_get(struct dentry *d, const char *name, char *value, size_t size,
 		return ret;
 
 	/* Try to get a virtual xattr first. */
-	if (_xattr_is_virtual(d, name, vol)) {
-		ret = _xattr_get_virtual(d, value, size, name, vol);
+	vea = _xattr_virtual(d, name, vol);
+	if (vea) {
+		ret = _xattr_get_virtual(d, value, size, name, vea, vol);
 		if (ret == -LTFS_DEVICE_FENCED) {
 			_xattr_unlock_dentry(name, false, d, vol);
 			ret = ltfs_wait_revalidation(vol);
@@ -1542,13 +1874,13 @@ int xattr_get(struct dentry *d, const char *name, char *value, size_t size,
 		}
 	}
 
-	acquireread_mrsw(&d->meta_lock);
+	acquireread_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 	/* Look for a real xattr. */
 	ret = _xattr_seek(&xattr, d, name);
 	if (ret < 0) {
 		ltfsmsg(LTFS_ERR, 11129E, ret);
-		releaseread_mrsw(&d->meta_lock);
+		releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
 		goto out_unlock;
 	}
 
@@ -1569,7 +1901,7 @@ int xattr_get(struct dentry *d, const char *name, char *value, size_t size,
 		ret = xattr->size;
 	}
 
-	releaseread_mrsw(&d->meta_lock);
+	releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 out_unlock:
 	_xattr_unlock_dentry(name, false, d, vol);
@@ -1595,7 +1927,7 @@ int xattr_list(struct dentry *d, char *list, size_t size, struct ltfs_volume *vo
 		return -LTFS_BAD_ARG;
 	}
 
-	acquireread_mrsw(&d->meta_lock);
+	acquireread_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 	/* Fill the buffer with only real xattrs. */
 	if (size)
@@ -1621,7 +1953,7 @@ int xattr_list(struct dentry *d, char *list, size_t size, struct ltfs_volume *vo
 		ret = -LTFS_SMALL_BUFFER;
 
 out:
-	releaseread_mrsw(&d->meta_lock);
+	releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
 	if (ret < 0)
 		return ret;
 	return nbytes;
@@ -1640,16 +1972,17 @@ int xattr_do_remove(struct dentry *d, const char *name, bool force, struct ltfs_
 	int ret;
 	struct xattr_info *xattr;
 
-	acquirewrite_mrsw(&d->meta_lock);
+	acquirewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
+	index_snapshot_preserve(d);
 
 	/* Look for a real extended attribute. */
 	ret = _xattr_seek(&xattr, d, name);
 	if (ret < 0) {
 		ltfsmsg(LTFS_ERR, 11140E, ret);
-		releasewrite_mrsw(&d->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 		return ret;
 	} else if (! xattr) {
-		releasewrite_mrsw(&d->meta_lock);
+		releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 		return -LTFS_NO_XATTR;
 	}
 
@@ -1657,15 +1990,15 @@ int xattr_do_remove(struct dentry *d, const char *name, bool force, struct ltfs_
 		/* If this xattr is in the reserved namespace, the user can't remove it. */
 		/* TODO: in the future, there could be user-removable reserved xattrs. */
 		if (strcasestr(name, "ltfs") == name && !_xattr_is_stored_vea(name) && !_xattr_is_worm_ea(name)) {
-			releasewrite_mrsw(&d->meta_lock);
+			releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 			return -LTFS_RDONLY_XATTR;
 		}
 	}
 
 	/* Remove the xattr. */
-	TAILQ_REMOVE(&d->xattrlist, xattr, list);
+	fs_remove_xattr(d, xattr);
 	get_current_timespec(&d->change_time);
-	releasewrite_mrsw(&d->meta_lock);
+	releasewrite_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 	free(xattr->key.name);
 	if (xattr->value)
@@ -1684,6 +2017,7 @@ int xattr_do_remove(struct dentry *d, const char *name, bool force, struct ltfs_
  */
 int xattr_remove(struct dentry *d, const char *name, struct ltfs_volume *vol)
 {
+	const struct xattr_vea *vea;
 	int ret;
 	bool is_worm_cart = false;
 
@@ -1711,8 +2045,9 @@ int xattr_remove(struct dentry *d, const char *name, struct ltfs_volume *vol)
 	}
 
 	/* If this xattr is virtual, try the virtual removal function. */
-	if (_xattr_is_virtual(d, name, vol)) {
-		ret = _xattr_remove_virtual(d, name, vol);
+	vea = _xattr_virtual(d, name, vol);
+	if (vea) {
+		ret = _xattr_remove_virtual(d, name, vea, vol);
 		if (ret == -LTFS_NO_XATTR)
 			ret = -LTFS_RDONLY_XATTR; /* non-removable virtual xattr */
 		goto out_dunlk;
@@ -1777,15 +2112,16 @@ int xattr_set_mountpoint_length(struct dentry *d, const char* value, size_t size
 	CHECK_ARG_NULL(d, -LTFS_NULL_ARG);
 	CHECK_ARG_NULL(value, -LTFS_NULL_ARG);
 
-	acquireread_mrsw(&d->meta_lock);
+	acquireread_mrsw(&fs_dentry_locks(d)->meta_lock);
+	index_snapshot_preserve(d);
 	ret = _xattr_seek(&xattr, d, LTFS_LIVELINK_EA_NAME);
 	if (ret < 0) {
 		ltfsmsg(LTFS_ERR, 11129E, ret);
-		releaseread_mrsw(&d->meta_lock);
+		releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
 		goto out_set;
 	}
 	ret = xattr_do_set(d, LTFS_LIVELINK_EA_NAME, value, size, xattr);
-	releaseread_mrsw(&d->meta_lock);
+	releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
 
 out_set:
 	return ret;
@@ -86,10 +86,12 @@ int xattr_list(struct dentry *d, char *list, size_t size, struct ltfs_volume *vo
 int xattr_remove(struct dentry *d, const char *name, struct ltfs_volume *vol);
 
 /** For internal use only */
+void xattr_init(void);
 int xattr_do_set(struct dentry *d, const char *name, const char *value, size_t size,
 	struct xattr_info *xattr);
 int xattr_do_remove(struct dentry *d, const char *name, bool force, struct ltfs_volume *vol);
 const char *xattr_strip_name(const char *name);
+bool xattr_is_virtual(struct dentry *d, const char *name, struct ltfs_volume *vol);
 int xattr_set_mountpoint_length(struct dentry *d, const char* value, size_t size);
 
 #ifdef __cplusplus
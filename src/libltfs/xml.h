@@ -71,6 +71,12 @@
 /* Time format in the XML file. be sure to change this if the schema changes */
 #define XML_TIME_FORMAT "0000-00-00T00:00:00.000000000Z"
 
+/* Number of index blocks which can be queued for the tape while the next one is generated */
+#define XML_OUTPUT_TAPE_RING_BLOCKS (4)
+
+/* Number of index blocks which can be read ahead of the parser */
+#define XML_INPUT_TAPE_RING_BLOCKS (8)
+
 /**
  * This structure is used to store state data when writing XML directly to tape using the libxml2
  * I/O callback method.
@@ -80,10 +86,29 @@ struct xml_output_tape {
 	int                err_code; /**< Error code from tape backend */
 	int                fd;       /**< File Descriptor for index cache if fd > 0 */
 	int                errno_fd; /**< errno from the index cache */
-	char               *buf;     /**< 1-block output buffer. */
+	char               *buf;     /**< 1-block output buffer being filled by the serializer. */
 	uint32_t           buf_size; /**< Output buffer size. */
 	uint32_t           buf_used; /**< Current output buffer usage. */
+
+	/* Completed blocks are handed over to a writer thread through a ring of block buffers,
+	 * so that the serializer keeps producing while the drive writes. */
+	char                 *ring[XML_OUTPUT_TAPE_RING_BLOCKS];     /**< Block buffers */
+	uint32_t             ring_len[XML_OUTPUT_TAPE_RING_BLOCKS];  /**< Valid bytes of each queued block */
+	unsigned int         ring_head;    /**< Next block to fill (serializer side) */
+	unsigned int         ring_tail;    /**< Next block to write (writer thread side) */
+	unsigned int         ring_count;   /**< Number of queued blocks */
+	bool                 ring_done;    /**< No more blocks will be queued */
+	bool                 writer_alive; /**< True while the writer thread exists */
+	ltfs_thread_mutex_t  ring_lock;    /**< Protects the ring and the error codes */
+	ltfs_thread_cond_t   ring_cond;    /**< Signals block hand-over in both directions */
+	ltfs_thread_t        writer;       /**< Writer thread */
+
+	struct ltfs_timespec start;        /**< Time the output was started */
+	struct ltfs_timespec write_time;   /**< Time the writer thread spent writing blocks */
+	struct ltfs_timespec stall_time;   /**< Time the serializer waited for the writer thread */
 };
+int xml_output_tape_init(struct xml_output_tape *ctx, struct device_data *device, uint32_t blocksize);
+void xml_output_tape_destroy(struct xml_output_tape *ctx);
 int xml_output_tape_write_callback(void *context, const char *buffer, int len);
 int xml_output_tape_close_callback(void *context);
 
@@ -295,11 +320,31 @@ struct xml_input_tape {
 	uint64_t           eod_pos;         /**< EOD position of the current partition. */
 	bool               saw_small_block; /**< Have we seen a small block yet? */
 	bool               saw_file_mark;   /**< If we saw a small blilock, was it a file mark? */
-	char               *buf;            /**< 1-block input buffer. */
+	char               *buf;            /**< Block being consumed by the parser, or NULL. */
 	uint32_t           buf_size;        /**< Input buffer size. */
 	uint32_t           buf_start;       /**< Offset of first valid byte in input buffer. */
 	uint32_t           buf_used;        /**< Current input buffer usage. */
+
+	/* A reader thread reads the Index ahead of the parser into a ring of block buffers,
+	 * until the end of the Index. */
+	char                 *ring[XML_INPUT_TAPE_RING_BLOCKS];     /**< Block buffers */
+	uint32_t             ring_len[XML_INPUT_TAPE_RING_BLOCKS];  /**< Valid bytes of each block */
+	unsigned int         ring_head;    /**< Next block to fill (reader thread side) */
+	unsigned int         ring_tail;    /**< Next block to parse (parser side) */
+	unsigned int         ring_count;   /**< Number of blocks filled or being parsed */
+	bool                 ring_eof;     /**< The reader thread will not fill more blocks */
+	bool                 ring_stop;    /**< The parser asks the reader thread to stop */
+	bool                 reader_alive; /**< True while the reader thread exists */
+	ltfs_thread_mutex_t  ring_lock;    /**< Protects the ring */
+	ltfs_thread_cond_t   ring_cond;    /**< Signals block hand-over in both directions */
+	ltfs_thread_t        reader;       /**< Reader thread */
+
+	struct index_spill   *spill;       /**< Spill receiving a copy of the Index, or NULL */
 };
+int xml_input_tape_init(struct xml_input_tape *ctx, uint64_t current_pos, uint64_t eod_pos,
+	struct ltfs_volume *vol);
+void xml_input_tape_finish(struct xml_input_tape *ctx, bool drain);
+void xml_input_tape_destroy(struct xml_input_tape *ctx);
 int xml_input_tape_read_callback(void *context, char *buffer, int len);
 int xml_input_tape_close_callback(void *context);
 
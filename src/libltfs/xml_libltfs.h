@@ -73,19 +73,53 @@
 #define UID_TAGNAME        "fileuid"
 #define FILEOFFSET_TAGNAME "fileoffset"
 
+/* LTFS index version checks */
+#define IDX_VERSION_SPARSE     MAKE_LTFS_VERSION(2,0,0)
+#define IDX_VERSION_BACKUPTIME MAKE_LTFS_VERSION(2,0,0)
+#define IDX_VERSION_UID        MAKE_LTFS_VERSION(2,0,0)
+
+/**
+ * Header of a record holding the children of a directory outside the index, see
+ * xml_dir_contents_to_record(). It is followed by one xml_record_subdir per subdirectory,
+ * in document order, and then by the <contents> element of the directory.
+ */
+struct xml_record_header {
+	uint64_t subdirs;             /**< Number of subdirectories */
+};
+
+/**
+ * Subdirectory in a record. Its children are not part of the record: the <contents>
+ * element of the subdirectory is left empty and kept in a record of its own.
+ */
+struct xml_record_subdir {
+	uint64_t uid;                 /**< UID of the subdirectory */
+	uint64_t link_count;          /**< Link count of the subdirectory */
+	uint64_t start;               /**< Offset of its empty <contents> element */
+	uint64_t end;                 /**< Offset just past that element */
+};
+
 /* Functions for writing XML files. See xml_writer_libltfs.c */
 xmlBufferPtr xml_make_label(const char *creator, tape_partition_t partition,
 							const struct ltfs_label *label);
 xmlBufferPtr xml_make_schema(const char *creator, const struct ltfs_index *idx);
+int xml_dir_contents_to_record(struct dentry *dir, const struct ltfs_index *idx, char **record,
+	size_t *size);
 int xml_schema_to_file(const char *filename, const char *creator,
 					   const char *reason, const struct ltfs_index *idx);
-int xml_schema_to_tape(char *reason, struct ltfs_volume *vol);
+int xml_schema_to_tape(char *reason, struct ltfs_index *idx, struct ltfs_volume *vol);
 
 /* Functions for reading XML files. See xml_reader_libltfs.c */
 int xml_label_from_file(const char *filename, struct ltfs_label *label);
 int xml_label_from_mem(const char *buf, int buf_size, struct ltfs_label *label);
 int xml_schema_from_file(const char *filename, struct ltfs_index *idx, struct ltfs_volume *vol);
 int xml_schema_from_tape(uint64_t eod_pos, struct ltfs_volume *vol);
+int xml_schema_header_from_tape(uint64_t eod_pos, struct ltfs_volume *vol);
 int xml_extent_symlink_info_from_file(const char *filename, struct dentry *d);
+int xml_dir_contents_from_spill(struct index_spill_slot *slot, struct dentry *dir,
+	struct ltfs_index *idx);
+int xml_record_subdirs(uint64_t uid, const char *record, size_t size,
+	const struct xml_record_subdir **subdirs, uint64_t *count, const char **xml);
+int xml_dir_contents_from_record(const char *record, size_t size, struct dentry *dir,
+	struct ltfs_index *idx);
 
 #endif /* __xml_libltfs_h */
@@ -495,116 +495,312 @@ int xml_parse_time(bool msg, const char *fmt_time, struct ltfs_timespec *rawtime
 	return ret;
 }
 
+/**
+ * Read one block of the Index into the given buffer. This detects the end of the Index: a
+ * small block, a file mark or EOD. If the Index ends in a file mark, the tape is positioned
+ * before the file mark.
+ * @return number of bytes read, 0 at the end of the Index, or a negative value on error.
+ */
+static ssize_t _xml_input_tape_read_block(struct xml_input_tape *ctx, char *buf)
+{
+	ssize_t nread, nr2;
+	char *buf2;
+	int ret_sp;
+
+	/* If we've reached EOD, we're at the end of the Index. */
+	if (ctx->eod_pos > 0 && ctx->current_pos == ctx->eod_pos)
+		return 0;
+
+	/* If we've exhausted a small block, we're at the end of the Index. */
+	if (ctx->saw_small_block)
+		return 0;
+
+	/* Try to read a block into the buffer. */
+	nread = tape_read(ctx->vol->device, buf, ctx->buf_size, false,
+		ctx->vol->kmi_handle);
+	++ctx->current_pos;
+	if (nread < 0) {
+		/* We know we're not at EOD, so read errors are unexpected. */
+		ltfsmsg(LTFS_ERR, 17039E, (int)nread);
+		return nread;
+	} else if ((size_t) nread < ctx->buf_size) {
+		/* Caught a small read. If this is a file mark, position before it. If
+		 * it's a record, look for a file mark following it. */
+		ctx->saw_small_block = true;
+		if (nread == 0) {
+			ctx->saw_file_mark = true;
+			ret_sp = tape_spacefm(ctx->vol->device, -1);
+			if (ret_sp < 0) {
+				ltfsmsg(LTFS_ERR, 17040E);
+				return ret_sp;
+			}
+		} else if (ctx->eod_pos == 0 ||
+			(ctx->eod_pos > 0 && ctx->current_pos < ctx->eod_pos)) {
+			/* Look for a trailing file mark. */
+			buf2 = malloc(ctx->vol->label->blocksize);
+			if (!buf2) {
+				ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+				return -LTFS_NO_MEMORY;
+			}
+			nr2 = tape_read(ctx->vol->device, buf2, ctx->vol->label->blocksize, false,
+				ctx->vol->kmi_handle);
+			free(buf2);
+			errno = 0; /* Clear errno because some OSs set errno in free() */
+			if (nr2 < 0) { /* Still not at EOD, so read errors are cause for alarm. */
+				ltfsmsg(LTFS_ERR, 17041E, (int)nr2);
+				return nr2;
+			} else if (nr2 == 0) {
+				ctx->saw_file_mark = true;
+				ret_sp = tape_spacefm(ctx->vol->device, -1);
+				if (ret_sp < 0) {
+					ltfsmsg(LTFS_ERR, 17040E);
+					return ret_sp;
+				}
+			}
+		}
+	}
+
+	return nread;
+}
+
+/**
+ * Reader thread for XML parser input from tape. It fills the free blocks of the ring ahead
+ * of the parser until the end of the Index, an error, or a stop request from the parser.
+ */
+static ltfs_thread_return _xml_input_tape_reader(void *data)
+{
+	struct xml_input_tape *ctx = data;
+	ssize_t nread;
+
+	ltfs_thread_mutex_lock(&ctx->ring_lock);
+	while (true) {
+		while (ctx->ring_count == XML_INPUT_TAPE_RING_BLOCKS && ! ctx->ring_stop)
+			ltfs_thread_cond_wait(&ctx->ring_cond, &ctx->ring_lock);
+		if (ctx->ring_stop)
+			break;
+		ltfs_thread_mutex_unlock(&ctx->ring_lock);
+
+		/* The block at ring_head is free, so it is not touched by the parser */
+		nread = _xml_input_tape_read_block(ctx, ctx->ring[ctx->ring_head]);
+
+		ltfs_thread_mutex_lock(&ctx->ring_lock);
+		if (nread < 0) {
+			ctx->err_code = nread;
+			break;
+		} else if (nread == 0)
+			break;
+
+		ctx->ring_len[ctx->ring_head] = nread;
+		ctx->ring_head = (ctx->ring_head + 1) % XML_INPUT_TAPE_RING_BLOCKS;
+		++ctx->ring_count;
+		ltfs_thread_cond_broadcast(&ctx->ring_cond);
+	}
+	ctx->ring_eof = true;
+	ltfs_thread_cond_broadcast(&ctx->ring_cond);
+	ltfs_thread_mutex_unlock(&ctx->ring_lock);
+
+	ltfs_thread_exit();
+
+	return LTFS_THREAD_RC_NULL;
+}
+
+/**
+ * Release the block being parsed and wait for the next one.
+ * @return 1 if a block is available, 0 at the end of the Index, or -1 on error.
+ */
+static int _xml_input_tape_next_block(struct xml_input_tape *ctx)
+{
+	int ret;
+
+	ltfs_thread_mutex_lock(&ctx->ring_lock);
+	if (ctx->buf) {
+		ctx->buf = NULL;
+		ctx->ring_tail = (ctx->ring_tail + 1) % XML_INPUT_TAPE_RING_BLOCKS;
+		--ctx->ring_count;
+		ltfs_thread_cond_broadcast(&ctx->ring_cond);
+	}
+
+	while (! ctx->ring_count && ! ctx->ring_eof)
+		ltfs_thread_cond_wait(&ctx->ring_cond, &ctx->ring_lock);
+
+	if (ctx->ring_count) {
+		ctx->buf = ctx->ring[ctx->ring_tail];
+		ctx->buf_start = 0;
+		ctx->buf_used = ctx->ring_len[ctx->ring_tail];
+		ret = 1;
+	} else
+		ret = ctx->err_code ? -1 : 0;
+	ltfs_thread_mutex_unlock(&ctx->ring_lock);
+
+	return ret;
+}
+
+/**
+ * Prepare an input context for parsing an Index from tape and start its reader thread.
+ * The tape must be positioned at the first block of the Index.
+ * @param ctx Input context, zero-filled by the caller.
+ * @param current_pos Current block position of the drive.
+ * @param eod_pos EOD position of the current partition, or 0 if EOD will not be encountered.
+ * @param vol LTFS volume.
+ * @return 0 on success or a negative value on error.
+ */
+int xml_input_tape_init(struct xml_input_tape *ctx, uint64_t current_pos, uint64_t eod_pos,
+	struct ltfs_volume *vol)
+{
+	int i, ret;
+
+	for (i = 0; i < XML_INPUT_TAPE_RING_BLOCKS; ++i) {
+		ctx->ring[i] = malloc(vol->label->blocksize + LTFS_CRC_SIZE);
+		if (! ctx->ring[i]) {
+			ltfsmsg(LTFS_ERR, 10001E, "xml_input_tape_init: input buffer");
+			ret = -LTFS_NO_MEMORY;
+			goto out_free;
+		}
+	}
+
+	ret = ltfs_thread_mutex_init(&ctx->ring_lock);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10002E, ret);
+		ret = -LTFS_MUTEX_INIT;
+		goto out_free;
+	}
+	ret = ltfs_thread_cond_init(&ctx->ring_cond);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10003E, ret);
+		ret = -LTFS_MUTEX_INIT;
+		goto out_mutex;
+	}
+
+	ctx->vol = vol;
+	ctx->err_code = 0;
+	ctx->current_pos = current_pos;
+	ctx->eod_pos = eod_pos;
+	ctx->saw_small_block = false;
+	ctx->saw_file_mark = false;
+	ctx->buf = NULL;
+	ctx->buf_size = vol->label->blocksize;
+	ctx->buf_start = 0;
+	ctx->buf_used = 0;
+	ctx->ring_head = 0;
+	ctx->ring_tail = 0;
+	ctx->ring_count = 0;
+	ctx->ring_eof = false;
+	ctx->ring_stop = false;
+
+	ret = ltfs_thread_create(&ctx->reader, _xml_input_tape_reader, ctx);
+	if (ret) {
+		/* Failed to spawn the index reader thread (%d) */
+		ltfsmsg(LTFS_ERR, 17298E, ret);
+		ret = -LTFS_NO_MEMORY;
+		goto out_cond;
+	}
+	ctx->reader_alive = true;
+
+	return 0;
+
+out_cond:
+	ltfs_thread_cond_destroy(&ctx->ring_cond);
+out_mutex:
+	ltfs_thread_mutex_destroy(&ctx->ring_lock);
+out_free:
+	for (i = 0; i < XML_INPUT_TAPE_RING_BLOCKS; ++i) {
+		free(ctx->ring[i]);
+		ctx->ring[i] = NULL;
+	}
+	return ret;
+}
+
+/**
+ * Terminate the reader thread of an input context. After this call, ctx->err_code and
+ * ctx->saw_file_mark are stable and the parser sees the end of the Index.
+ * @param ctx Input context.
+ * @param drain If true, let the reader thread run to the end of the Index and discard the
+ *              blocks the parser did not consume, so that the tape is positioned as if the
+ *              whole Index was parsed. If false, stop after the block being read, if any.
+ */
+void xml_input_tape_finish(struct xml_input_tape *ctx, bool drain)
+{
+	if (! ctx->reader_alive)
+		return;
+
+	if (drain) {
+		while (_xml_input_tape_next_block(ctx) > 0);
+	} else {
+		ltfs_thread_mutex_lock(&ctx->ring_lock);
+		ctx->ring_stop = true;
+		ltfs_thread_cond_broadcast(&ctx->ring_cond);
+		ltfs_thread_mutex_unlock(&ctx->ring_lock);
+	}
+
+	ltfs_thread_join(ctx->reader);
+	ctx->reader_alive = false;
+	ctx->buf = NULL;
+	ctx->buf_used = 0;
+}
+
+/**
+ * Release an input context prepared by xml_input_tape_init.
+ * @param ctx Input context.
+ */
+void xml_input_tape_destroy(struct xml_input_tape *ctx)
+{
+	int i;
+
+	xml_input_tape_finish(ctx, false);
+	ltfs_thread_cond_destroy(&ctx->ring_cond);
+	ltfs_thread_mutex_destroy(&ctx->ring_lock);
+	for (i = 0; i < XML_INPUT_TAPE_RING_BLOCKS; ++i) {
+		free(ctx->ring[i]);
+		ctx->ring[i] = NULL;
+	}
+}
+
 /**
  * Read callback for XML parser input using the libxml2 I/O routines. libxml2 reads
- * data in small, fixed-size chunks (typically 4096 bytes), so each block read from tape
- * gets buffered until it is used up.
- * This function detects whether the Index being parsed ends in a file mark, and if so, it
+ * data in small, fixed-size chunks (typically 4096 bytes), so each block read ahead by the
+ * reader thread is consumed in several calls.
+ * The reader thread detects whether the Index being parsed ends in a file mark, and if so, it
  * positions the tape before the file mark.
  */
 int xml_input_tape_read_callback(void *context, char *buffer, int len)
 {
 	struct xml_input_tape *ctx = context;
-	ssize_t nread, nr2;
-	char *buf2;
-	int bytes_saved, bytes_remaining, ret_sp;
+	int bytes_saved = 0, ret;
+	uint32_t copy_count;
 
 	if (len == 0)
 		return 0;
 
-	/* Try to fill the whole buffer from cache. If that fails, try to read from tape. */
-	if (len <= (int32_t) ctx->buf_used) {
-		memcpy(buffer, ctx->buf + ctx->buf_start, len);
-		ctx->buf_used -= len;
-		if (ctx->buf_used > 0)
-			ctx->buf_start += len;
-		else
-			ctx->buf_start = 0;
-	} else {
-		if (ctx->buf_used > 0) {
-			memcpy(buffer, ctx->buf + ctx->buf_start, ctx->buf_used);
-			bytes_saved = ctx->buf_used;
-			ctx->buf_used = 0;
-			ctx->buf_start = 0;
-		} else
-			bytes_saved = 0;
-		bytes_remaining = len - bytes_saved;
-
-		while (bytes_remaining > 0) {
-			/* If we've reached EOD, we're at the end of the Index. */
-			if (ctx->eod_pos > 0 && ctx->current_pos == ctx->eod_pos)
-				return bytes_saved;
-
-			/* If we've exhausted a small block, we're at the end of the Index. */
-			if (ctx->saw_small_block)
-				return bytes_saved;
-
-			/* Try to read a block into the buffer. */
-			nread = tape_read(ctx->vol->device, ctx->buf, ctx->buf_size, false,
-				ctx->vol->kmi_handle);
-			++ctx->current_pos;
-			if (nread < 0) {
-				/* We know we're not at EOD, so read errors are unexpected. */
-				ltfsmsg(LTFS_ERR, 17039E, (int)nread);
-				ctx->err_code = nread;
+	while (bytes_saved < len) {
+		if (ctx->buf_used == 0) {
+			if (! ctx->reader_alive)
+				break;
+			ret = _xml_input_tape_next_block(ctx);
+			if (ret < 0)
 				return -1;
-			} else if ((size_t) nread < ctx->buf_size) {
-				/* Caught a small read. If this is a file mark, position before it. If
-				 * it's a record, look for a file mark following it. */
-				ctx->saw_small_block = true;
-				if (nread == 0) {
-					ctx->saw_file_mark = true;
-					ret_sp = tape_spacefm(ctx->vol->device, -1);
-					if (ret_sp < 0) {
-						ltfsmsg(LTFS_ERR, 17040E);
-						ctx->err_code = ret_sp;
-						return -1;
-					}
-				} else if (ctx->eod_pos == 0 ||
-					(ctx->eod_pos > 0 && ctx->current_pos < ctx->eod_pos)) {
-					/* Look for a trailing file mark. */
-					buf2 = malloc(ctx->vol->label->blocksize);
-					if (!buf2) {
-						ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
-						ctx->err_code = -LTFS_NO_MEMORY;
-						return -1;
-					}
-					nr2 = tape_read(ctx->vol->device, buf2, ctx->vol->label->blocksize, false,
-						ctx->vol->kmi_handle);
-					free(buf2);
-					errno = 0; /* Clear errno because some OSs set errno in free() */
-					if (nr2 < 0) { /* Still not at EOD, so read errors are cause for alarm. */
-						ltfsmsg(LTFS_ERR, 17041E, (int)nr2);
-						ctx->err_code = nr2;
-						return -1;
-					} else if (nr2 == 0) {
-						ctx->saw_file_mark = true;
-						ret_sp = tape_spacefm(ctx->vol->device, -1);
-						if (ret_sp < 0) {
-							ltfsmsg(LTFS_ERR, 17040E);
-							ctx->err_code = ret_sp;
-							return -1;
-						}
-					}
-				}
-			}
+			else if (ret == 0)
+				break;
+		}
 
-			/* Fill the output buffer (and the cache, if there are bytes left over). */
-			if (bytes_remaining > nread) {
-				memcpy(buffer + bytes_saved, ctx->buf, nread);
-				bytes_saved += nread;
-				bytes_remaining -= nread;
-			} else {
-				memcpy(buffer + bytes_saved, ctx->buf, bytes_remaining);
-				ctx->buf_start = bytes_remaining;
-				ctx->buf_used = nread - bytes_remaining;
-				bytes_saved = len;
-				bytes_remaining = 0;
-			}
+		copy_count = len - bytes_saved;
+		if (copy_count > ctx->buf_used)
+			copy_count = ctx->buf_used;
+		memcpy(buffer + bytes_saved, ctx->buf + ctx->buf_start, copy_count);
+		ctx->buf_start += copy_count;
+		ctx->buf_used -= copy_count;
+		bytes_saved += copy_count;
+	}
+
+	/* Keep a copy of everything the parser sees for lazily loaded directories */
+	if (ctx->spill && bytes_saved > 0) {
+		ret = index_spill_feed(ctx->spill, buffer, bytes_saved);
+		if (ret < 0) {
+			ctx->err_code = ret;
+			return -1;
 		}
 	}
 
-	return len;
+	return bytes_saved;
 }
 
 /** Close callback for XML parser input using the libxml2 I/O routines.
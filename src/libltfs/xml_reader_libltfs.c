@@ -65,13 +65,9 @@
 #include "base64.h"
 #include "pathname.h"
 #include "index_criteria.h"
+#include "dcache.h"
 #include "arch/time_internal.h"
 
-/* LTFS index version checks */
-#define IDX_VERSION_SPARSE     MAKE_LTFS_VERSION(2,0,0)
-#define IDX_VERSION_BACKUPTIME MAKE_LTFS_VERSION(2,0,0)
-#define IDX_VERSION_UID        MAKE_LTFS_VERSION(2,0,0)
-
 /**************************************************************************************
  * Local Functions
  **************************************************************************************/
@@ -638,6 +634,8 @@ static int _xml_parse_one_extent(xmlTextReaderPtr reader, int idx_version, struc
 {
 	unsigned long long value_int;
 	struct extent_info *xt, *xt_last;
+	const struct extent_info *xt_tail;
+	bool xt_packed = false;
 	declare_parser_vars("extent");
 	declare_tracking_arrays_no_opt(5);
 
@@ -707,19 +705,38 @@ static int _xml_parse_one_extent(xmlTextReaderPtr reader, int idx_version, struc
 	/* For older index versions, set fileoffset at the end of the previous extent */
 	if (idx_version < IDX_VERSION_SPARSE) {
 		check_required_tag(4);
-		if (TAILQ_EMPTY(&d->extentlist))
+		if (! fs_has_extents(d))
 			xt->fileoffset = 0;
 		else {
-			xt_last = TAILQ_LAST(&d->extentlist, extent_struct);
-			xt->fileoffset = xt_last->fileoffset + xt_last->bytecount;
+			xt_tail = fs_extent_last(d);
+			xt->fileoffset = xt_tail->fileoffset + xt_tail->bytecount;
 		}
 	}
 
 	check_required_tags();
 
+	/* A packed extent list only takes extents which go after its last extent */
+	if (d->extent_pack) {
+		xt_tail = extent_pack_tail(d->extent_pack);
+		if (xt->fileoffset < xt_tail->fileoffset + xt_tail->bytecount) {
+			ret = fs_unpack_extents(d);
+			if (ret < 0) {
+				free(xt);
+				return ret;
+			}
+		}
+	}
+
 	/* Add extent to the extent list, performing appropriate reordering if necessary.
 	 * Also make sure the new extent does not overlap with any existing extents. */
-	if (TAILQ_EMPTY(&d->extentlist))
+	if (d->extent_pack) {
+		ret = extent_pack_append(d->extent_pack, xt);
+		if (ret < 0) {
+			free(xt);
+			return ret;
+		}
+		xt_packed = true;
+	} else if (TAILQ_EMPTY(&d->extentlist))
 		TAILQ_INSERT_TAIL(&d->extentlist, xt, list);
 	else {
 		bool xt_used = false;
@@ -747,6 +764,8 @@ static int _xml_parse_one_extent(xmlTextReaderPtr reader, int idx_version, struc
 			d->used_blocks++;
 	}
 
+	if (xt_packed)
+		free(xt);
 	return 0;
 }
 
@@ -755,6 +774,7 @@ static int _xml_parse_one_extent(xmlTextReaderPtr reader, int idx_version, struc
  */
 static int _xml_parse_extents(xmlTextReaderPtr reader, int idx_version, struct dentry *d)
 {
+	uint32_t count = 0;
 	declare_parser("extentinfo");
 	declare_tracking_arrays_no_tags();
 
@@ -767,11 +787,19 @@ static int _xml_parse_extents(xmlTextReaderPtr reader, int idx_version, struct d
 			if (ret < 0)
 				return ret;
 
+			/* Pack long extent lists early, so the rest of the extents are appended to
+			 * the packed list instead of being allocated one by one */
+			if (++count == EXTENT_PACK_MIN_EXTENTS)
+				fs_pack_extents(d);
+
 		} else
 			ignore_unrecognized_tag();
 	}
 
 	check_required_tags();
+
+	/* Pack lists which were unpacked to take an extent out of order */
+	fs_pack_extents(d);
 	return 0;
 }
 
@@ -861,7 +889,7 @@ static int _xml_parse_one_xattr(xmlTextReaderPtr reader, struct dentry *d)
 	check_required_tags();
 
 	if (xattr) {
-		TAILQ_INSERT_TAIL(&d->xattrlist, xattr, list);
+		fs_add_xattr(d, xattr, true);
 
 		if (!strcmp(xattr->key.name, "ltfs.vendor.IBM.immutable") && !strcmp(xattr->value, "1") ) {
 			d->is_immutable = true;
@@ -971,7 +999,7 @@ static int _xml_parse_file(xmlTextReaderPtr reader, struct ltfs_index *idx, stru
 {
 	unsigned long long value_int;
 	struct dentry *file;
-	struct extent_info *xt_last;
+	const struct extent_info *xt_last;
 	declare_parser_vars("file");
 	declare_tracking_arrays(9, 4);
 	bool symlink_flag=false, extent_flag=false, openforwrite=false;
@@ -990,7 +1018,7 @@ static int _xml_parse_file(xmlTextReaderPtr reader, struct ltfs_index *idx, stru
 
 			ret = _xml_parse_nametype(reader, &file->name, false);
 			if (ret < 0) {
-				free(file);
+				fs_free_dentry(file);
 				return ret;
 			}
 
@@ -1091,7 +1119,7 @@ static int _xml_parse_file(xmlTextReaderPtr reader, struct ltfs_index *idx, stru
 			ret = _xml_parse_nametype(reader, &file->target, true);
 			if (ret < 0) {
 				ltfsmsg(LTFS_ERR, 17270E, "symlink", file->name.name);
-				free(file);
+				fs_free_dentry(file);
 				return ret;
 			}
 
@@ -1162,8 +1190,8 @@ static int _xml_parse_file(xmlTextReaderPtr reader, struct ltfs_index *idx, stru
 	check_required_tags();
 
 	/* check that file size is not shorter than the extent list */
-	if (! TAILQ_EMPTY(&file->extentlist)) {
-		xt_last = TAILQ_LAST(&file->extentlist, extent_struct);
+	if (fs_has_extents(file)) {
+		xt_last = fs_extent_last(file);
 		if (xt_last->fileoffset + xt_last->bytecount > file->size) {
 			ltfsmsg(LTFS_ERR, 17026E);
 			return -LTFS_XML_EXT_TOO_LONG;
@@ -1210,7 +1238,7 @@ static int _xml_parse_dir_contents(xmlTextReaderPtr reader, struct dentry *dir,
 
 		if (! strcmp(name, "file")) {
 			assert_not_empty();
-			entry_name = (struct name_list *)malloc(sizeof(struct name_list));
+			entry_name = calloc(1, sizeof(struct name_list));
 			if (!entry_name) {
 				ltfsmsg(LTFS_ERR, 10001E, "_xml_parse_dir_contents: file");
 				return -LTFS_NO_MEMORY;
@@ -1223,7 +1251,7 @@ static int _xml_parse_dir_contents(xmlTextReaderPtr reader, struct dentry *dir,
 
 		} else if (! strcmp(name, "directory")) {
 			assert_not_empty();
-			entry_name = (struct name_list *)malloc(sizeof(struct name_list));
+			entry_name = calloc(1, sizeof(struct name_list));
 			if (!entry_name) {
 				ltfsmsg(LTFS_ERR, 10001E, "_xml_parse_dir_contents: dir");
 				return -LTFS_NO_MEMORY;
@@ -1289,6 +1317,7 @@ static int _xml_parse_dirtree(xmlTextReaderPtr reader, struct dentry *parent,
 {
 	unsigned long long value_int;
 	struct dentry *dir;
+	struct index_spill_slot *slot;
 
 	declare_parser_vars("directory");
 	declare_tracking_arrays(9, 1);
@@ -1319,7 +1348,7 @@ static int _xml_parse_dirtree(xmlTextReaderPtr reader, struct dentry *parent,
 				ret = _xml_parse_nametype(reader, &dir->name, false);
 				if (ret < 0) {
 					ltfsmsg(LTFS_ERR, 17272E, "name", parent->name.name);
-					free(dir);
+					fs_free_dentry(dir);
 					return ret;
 				}
 				dirname->name = dir->name.name;
@@ -1406,6 +1435,22 @@ static int _xml_parse_dirtree(xmlTextReaderPtr reader, struct dentry *parent,
 		} else if (!strcmp(name, "contents")) {
 			check_required_tag(6);
 			check_empty();
+			if (empty == 0 && idx->spill) {
+				ret = index_spill_claim(idx->spill, &slot);
+				if (ret < 0)
+					return ret;
+
+				/* Leave the contents of subdirectories in the spill until they are used.
+				 * Indexes without highestfileuid need every file UID to be parsed. */
+				if (parent && idx->version >= IDX_VERSION_UID) {
+					if (xml_skip_tag(reader) < 0)
+						return -LTFS_XML_SKIP_FAIL;
+					ret = index_spill_defer(slot, dir);
+					if (ret < 0)
+						return ret;
+					empty = 1;
+				}
+			}
 			if (empty == 0) {
 				ret = _xml_parse_dir_contents(reader, dir, idx);
 				if (ret < 0)
@@ -1500,9 +1545,11 @@ static int _xml_parse_dirtree(xmlTextReaderPtr reader, struct dentry *parent,
  * @param reader Source of XML data
  * @param idx LTFS index
  * @param vol LTFS volume to which the index belongs. May be NULL.
+ * @param header_only If true, stop at the directory tree instead of building it.
  * @return 0 on success or a negative value on error.
  */
-static int _xml_parse_schema(xmlTextReaderPtr reader, struct ltfs_index *idx, struct ltfs_volume *vol)
+static int _xml_parse_schema(xmlTextReaderPtr reader, struct ltfs_index *idx, struct ltfs_volume *vol,
+	bool header_only)
 {
 	unsigned long long value_int;
 	declare_parser_vars("ltfsindex");
@@ -1598,7 +1645,16 @@ static int _xml_parse_schema(xmlTextReaderPtr reader, struct ltfs_index *idx, st
 		} else if (! strcmp(name, "directory")) {
 			check_required_tag(6);
 			assert_not_empty();
-			ret = _xml_parse_dirtree(reader, NULL, idx, vol, NULL);
+			if (header_only) {
+				/* The format specification places the header elements, including the
+				 * optional previousgenerationlocation, before the directory tree. Stop
+				 * here once they are all seen, otherwise skip over the tree. */
+				for (i = 0; i < 6 && have_required_tags[i]; ++i);
+				if (i == 6)
+					return 0;
+				ret = xml_skip_tag(reader);
+			} else
+				ret = _xml_parse_dirtree(reader, NULL, idx, vol, NULL);
 			if (ret < 0)
 				return ret;
 
@@ -1834,6 +1890,206 @@ int xml_label_from_mem(const char *buf, int buf_size, struct ltfs_label *label)
 	return ret;
 }
 
+/**
+ * Parse a <contents> element holding the children of a directory and free the reader.
+ * @param reader Reader positioned before the element.
+ * @param dir Directory which receives the children.
+ * @param idx LTFS index the directory belongs to.
+ * @return 0 on success or a negative value on error.
+ */
+static int _xml_parse_contents_element(xmlTextReaderPtr reader, struct dentry *dir,
+	struct ltfs_index *idx)
+{
+	int ret, type, empty;
+	const char *name;
+	xmlDocPtr doc;
+
+	/* Workaround for old libxml2 version on OS X 10.5. See comment in xml_schema_from_file()
+	 * for details. */
+	doc = xmlTextReaderCurrentDoc(reader);
+
+	ret = xml_next_tag(reader, "", &name, &type);
+	if (ret == 0 && strcmp(name, "contents")) {
+		ltfsmsg(LTFS_ERR, 17017E, name);
+		ret = -LTFS_XML_WRONG_TOPTAG;
+	}
+	if (ret == 0) {
+		empty = xmlTextReaderIsEmptyElement(reader);
+		if (empty < 0) {
+			ltfsmsg(LTFS_ERR, 17003E);
+			ret = -LTFS_XML_EMPTY_UNKNOWN;
+		} else if (empty == 0)
+			ret = _xml_parse_dir_contents(reader, dir, idx);
+	}
+
+	if (doc)
+		xmlFreeDoc(doc);
+	xmlFreeTextReader(reader);
+
+	return ret;
+}
+
+/**
+ * Parse the children of a directory from an index spill.
+ * @param slot Slot holding the <contents> element of the directory.
+ * @param dir Directory which receives the children.
+ * @param idx LTFS index the spill belongs to.
+ * @return 0 on success or a negative value on error.
+ */
+int xml_dir_contents_from_spill(struct index_spill_slot *slot, struct dentry *dir,
+	struct ltfs_index *idx)
+{
+	int ret;
+	struct index_spill_stream stream;
+	xmlTextReaderPtr reader;
+
+	CHECK_ARG_NULL(slot, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(dir, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(idx, -LTFS_NULL_ARG);
+
+	ret = index_spill_stream_open(slot, &stream);
+	if (ret < 0)
+		return ret;
+
+	reader = xmlReaderForIO(index_spill_stream_read, index_spill_stream_close, &stream,
+							NULL, NULL, XML_PARSE_NOERROR | XML_PARSE_NOWARNING | XML_PARSE_HUGE);
+	if (! reader) {
+		ltfsmsg(LTFS_ERR, 17015E);
+		return -LTFS_LIBXML2_FAILURE;
+	}
+
+	return _xml_parse_contents_element(reader, dir, idx);
+}
+
+/**
+ * Find the subdirectories listed in a record written by xml_dir_contents_to_record().
+ * @param uid UID of the directory the record belongs to, for messages.
+ * @param record Record.
+ * @param size Size of the record.
+ * @param[out] subdirs On success, points to the subdirectories in the record.
+ * @param[out] count On success, the number of subdirectories.
+ * @param[out] xml On success, points to the <contents> element in the record.
+ * @return 0 on success or -LTFS_INDEX_INVALID if the record is malformed.
+ */
+int xml_record_subdirs(uint64_t uid, const char *record, size_t size,
+	const struct xml_record_subdir **subdirs, uint64_t *count, const char **xml)
+{
+	uint64_t i, pos = 0;
+	size_t len;
+	struct xml_record_header hdr;
+
+	CHECK_ARG_NULL(record, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(subdirs, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(count, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(xml, -LTFS_NULL_ARG);
+
+	if (size < sizeof(hdr))
+		goto out_invalid;
+	memcpy(&hdr, record, sizeof(hdr));
+	if (hdr.subdirs > (size - sizeof(hdr)) / sizeof(**subdirs))
+		goto out_invalid;
+
+	*subdirs = (const struct xml_record_subdir *)(record + sizeof(hdr));
+	*count = hdr.subdirs;
+	*xml = record + sizeof(hdr) + hdr.subdirs * sizeof(**subdirs);
+	len = size - (*xml - record);
+
+	/* The empty elements must be in document order and inside the <contents> element */
+	for (i = 0; i < hdr.subdirs; ++i) {
+		if ((*subdirs)[i].start < pos || (*subdirs)[i].end < (*subdirs)[i].start
+			|| (*subdirs)[i].end > len)
+			goto out_invalid;
+		pos = (*subdirs)[i].end;
+	}
+
+	return 0;
+
+out_invalid:
+	ltfsmsg(LTFS_ERR, 17321E, (unsigned long long)uid);
+	return -LTFS_INDEX_INVALID;
+}
+
+static int _xml_record_subdir_cmp(const void *a, const void *b)
+{
+	const struct xml_record_subdir *x = *(const struct xml_record_subdir * const *)a;
+	const struct xml_record_subdir *y = *(const struct xml_record_subdir * const *)b;
+
+	return (x->uid > y->uid) - (x->uid < y->uid);
+}
+
+/**
+ * Parse the children of a directory from a record written by xml_dir_contents_to_record().
+ * Subdirectories are marked as evicted, since their children are kept in records of their
+ * own, and get back the link count they had when the record was written.
+ * @param record Record.
+ * @param size Size of the record.
+ * @param dir Directory which receives the children.
+ * @param idx LTFS index the directory belongs to.
+ * @return 0 on success or a negative value on error.
+ */
+int xml_dir_contents_from_record(const char *record, size_t size, struct dentry *dir,
+	struct ltfs_index *idx)
+{
+	int ret;
+	uint64_t i, count, found = 0;
+	const char *xml;
+	const struct xml_record_subdir *subdirs, **sorted = NULL, *key, **match;
+	struct xml_record_subdir probe;
+	struct name_list *entry, *tmp;
+	xmlTextReaderPtr reader;
+
+	CHECK_ARG_NULL(record, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(dir, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(idx, -LTFS_NULL_ARG);
+
+	ret = xml_record_subdirs(dir->uid, record, size, &subdirs, &count, &xml);
+	if (ret < 0)
+		return ret;
+
+	reader = xmlReaderForMemory(xml, size - (xml - record), NULL, NULL,
+								XML_PARSE_NOERROR | XML_PARSE_NOWARNING | XML_PARSE_HUGE);
+	if (! reader) {
+		ltfsmsg(LTFS_ERR, 17015E);
+		return -LTFS_LIBXML2_FAILURE;
+	}
+	ret = _xml_parse_contents_element(reader, dir, idx);
+	if (ret < 0 || count == 0)
+		goto out;
+
+	sorted = malloc(count * sizeof(*sorted));
+	if (! sorted) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		ret = -LTFS_NO_MEMORY;
+		goto out;
+	}
+	for (i = 0; i < count; ++i)
+		sorted[i] = &subdirs[i];
+	qsort(sorted, count, sizeof(*sorted), _xml_record_subdir_cmp);
+
+	HASH_ITER(hh, dir->child_list, entry, tmp) {
+		if (! entry->d->isdir)
+			continue;
+		probe.uid = entry->d->uid;
+		key = &probe;
+		match = bsearch(&key, sorted, count, sizeof(*sorted), _xml_record_subdir_cmp);
+		if (! match) {
+			ret = -LTFS_INDEX_INVALID;
+			break;
+		}
+		entry->d->link_count = (*match)->link_count;
+		entry->d->dcache_evicted = true;
+		++found;
+	}
+	if (ret == 0 && found != count)
+		ret = -LTFS_INDEX_INVALID;
+	if (ret == -LTFS_INDEX_INVALID)
+		ltfsmsg(LTFS_ERR, 17321E, (unsigned long long)dir->uid);
+
+out:
+	free(sorted);
+	return ret;
+}
+
 /**
  * Parse an XML schema file and populate the priv->root virtual dentry tree
  * with the nodes found during the scanning.
@@ -1861,7 +2117,7 @@ int xml_schema_from_file(const char *filename, struct ltfs_index *idx, struct lt
 	 * unknown tags modifies the behavior of xmlFreeTextReader so that an additional
 	 * xmlDocFree call is required to free all memory. */
 	doc = xmlTextReaderCurrentDoc(reader);
-	ret = _xml_parse_schema(reader, idx, vol);
+	ret = _xml_parse_schema(reader, idx, vol, false);
 	if (ret < 0)
 		ltfsmsg(LTFS_ERR, 17012E, filename, ret);
 	if (doc)
@@ -1878,17 +2134,15 @@ int xml_schema_from_file(const char *filename, struct ltfs_index *idx, struct lt
 }
 
 /**
- * Parse an Index from tape and populate the vol->index->root virtual dentry tree
- * with the nodes found during the scanning.
- * If a file mark is encountered at the end of the Index, the tape is positioned before
- * the file mark.
- * @param eod_pos EOD block position for the current partition, or 0 to assume EOD will not be
- *                encountered during parsing.
+ * Parse an Index from tape into vol->index.
+ * @param eod_pos EOD block position for the current partition, or 0.
+ * @param header_only If true, only the header elements are parsed and the reader thread is
+ *                    stopped at the directory tree.
  * @param vol LTFS volume.
  * @return 0 on success, 1 if parsing succeeded but no file mark was encountered,
  *         or a negative value on error.
  */
-int xml_schema_from_tape(uint64_t eod_pos, struct ltfs_volume *vol)
+static int _xml_schema_from_tape(uint64_t eod_pos, bool header_only, struct ltfs_volume *vol)
 {
 	int ret;
 	struct tc_position current_pos;
@@ -1906,26 +2160,25 @@ int xml_schema_from_tape(uint64_t eod_pos, struct ltfs_volume *vol)
 	}
 
 	/* Create output callback context data structure. */
-	ctx = malloc(sizeof(struct xml_input_tape));
+	ctx = calloc(1, sizeof(struct xml_input_tape));
 	if (! ctx) {
 		ltfsmsg(LTFS_ERR, 10001E, "xml_schema_from_tape: ctx");
 		return -LTFS_NO_MEMORY;
 	}
-	ctx->buf = malloc(vol->label->blocksize + LTFS_CRC_SIZE);
-	if (! ctx->buf) {
-		ltfsmsg(LTFS_ERR, 10001E, "xml_schema_from_tape: ctx->buf");
+
+	/* Start reading the Index ahead of the parser */
+	ret = xml_input_tape_init(ctx, current_pos.block, eod_pos, vol);
+	if (ret < 0) {
 		free(ctx);
-		return -LTFS_NO_MEMORY;
+		return ret;
 	}
-	ctx->vol = vol;
-	ctx->err_code = 0;
-	ctx->current_pos = current_pos.block;
-	ctx->eod_pos = eod_pos;
-	ctx->saw_small_block = false;
-	ctx->saw_file_mark = false;
-	ctx->buf_size = vol->label->blocksize;
-	ctx->buf_start = 0;
-	ctx->buf_used = 0;
+
+	/* Copy the Index to a spill file if directories are loaded on first use. The spill
+	 * belongs to the index from here on and is freed with it. */
+	if (! header_only && vol->lazy_index && vol->work_directory && ! dcache_initialized(vol)
+		&& index_spill_create(&vol->index->spill, vol->work_directory,
+							  vol->lazy_index_limit, vol->index) == 0)
+		ctx->spill = vol->index->spill;
 
 	/* Create input buffer pointer. */
 	read_buf = xmlParserInputBufferCreateIO(xml_input_tape_read_callback,
@@ -1933,7 +2186,7 @@ int xml_schema_from_tape(uint64_t eod_pos, struct ltfs_volume *vol)
 											ctx, XML_CHAR_ENCODING_NONE);
 	if (! read_buf) {
 		ltfsmsg(LTFS_ERR, 17014E);
-		free(ctx->buf);
+		xml_input_tape_destroy(ctx);
 		free(ctx);
 		return -LTFS_LIBXML2_FAILURE;
 	}
@@ -1943,7 +2196,7 @@ int xml_schema_from_tape(uint64_t eod_pos, struct ltfs_volume *vol)
 	if (! reader) {
 		ltfsmsg(LTFS_ERR, 17015E);
 		xmlFreeParserInputBuffer(read_buf);
-		free(ctx->buf);
+		xml_input_tape_destroy(ctx);
 		free(ctx);
 		return -LTFS_LIBXML2_FAILURE;
 	}
@@ -1955,7 +2208,7 @@ int xml_schema_from_tape(uint64_t eod_pos, struct ltfs_volume *vol)
 		ltfsmsg(LTFS_ERR, 17015E);
 		xmlFreeTextReader(reader);
 		xmlFreeParserInputBuffer(read_buf);
-		free(ctx->buf);
+		xml_input_tape_destroy(ctx);
 		free(ctx);
 		return -LTFS_LIBXML2_FAILURE;
 	}
@@ -1966,7 +2219,16 @@ int xml_schema_from_tape(uint64_t eod_pos, struct ltfs_volume *vol)
 	doc = xmlTextReaderCurrentDoc(reader);
 
 	/* Generate the Index. */
-	ret = _xml_parse_schema(reader, vol->index, vol);
+	ret = _xml_parse_schema(reader, vol->index, vol, header_only);
+
+	/* On success, read up to the end of the Index to position the tape as before. A header
+	 * scan leaves the rest of the Index to the caller, which spaces over it to the file mark. */
+	xml_input_tape_finish(ctx, ret >= 0 && ! header_only);
+	if (ret >= 0 && ctx->spill) {
+		ret = index_spill_finish(ctx->spill);
+		if (ret == 0 && index_spill_deferred(ctx->spill) == 0)
+			index_spill_free(&vol->index->spill);
+	}
 	if (ctx->err_code < 0) {
 		/* Error happens while reading tape */
 		ltfsmsg(LTFS_ERR, 17273E, ctx->err_code);
@@ -1980,7 +2242,10 @@ int xml_schema_from_tape(uint64_t eod_pos, struct ltfs_volume *vol)
 			ret = -LTFS_INDEX_INVALID;
 		}
 	} else if (ret == 0) {
-		if(!ctx->saw_file_mark) {
+		if (header_only && ! ctx->saw_small_block
+			&& (ctx->eod_pos == 0 || ctx->current_pos < ctx->eod_pos)) {
+			/* Stopped inside the Index, the file mark is still ahead */
+		} else if(!ctx->saw_file_mark) {
 			/* Return positive value intentionally, for recovering later */
 			ret = LTFS_NO_TRAIL_FM;
 		}
@@ -1991,7 +2256,7 @@ int xml_schema_from_tape(uint64_t eod_pos, struct ltfs_volume *vol)
 	xmlFreeTextReader(reader);
 	xmlFreeParserInputBuffer(read_buf);
 
-	free(ctx->buf);
+	xml_input_tape_destroy(ctx);
 	free(ctx);
 
 #ifdef DEBUG
@@ -2003,6 +2268,39 @@ int xml_schema_from_tape(uint64_t eod_pos, struct ltfs_volume *vol)
 	return ret;
 }
 
+/**
+ * Parse an Index from tape and populate the vol->index->root virtual dentry tree
+ * with the nodes found during the scanning.
+ * If a file mark is encountered at the end of the Index, the tape is positioned before
+ * the file mark.
+ * @param eod_pos EOD block position for the current partition, or 0 to assume EOD will not be
+ *                encountered during parsing.
+ * @param vol LTFS volume.
+ * @return 0 on success, 1 if parsing succeeded but no file mark was encountered,
+ *         or a negative value on error.
+ */
+int xml_schema_from_tape(uint64_t eod_pos, struct ltfs_volume *vol)
+{
+	return _xml_schema_from_tape(eod_pos, false, vol);
+}
+
+/**
+ * Parse only the header of an Index from tape (generation, update time, self and back
+ * pointers, volume UUID and the other elements preceding the directory tree) into
+ * vol->index. No dentries are built, and the blocks following the header are not read.
+ * The tape is left either inside the Index or before its trailing file mark, so in both
+ * cases spacing forward one file mark positions it after the Index.
+ * @param eod_pos EOD block position for the current partition, or 0 to assume EOD will not be
+ *                encountered during parsing.
+ * @param vol LTFS volume.
+ * @return 0 on success, 1 if the Index ended without a file mark,
+ *         or a negative value on error.
+ */
+int xml_schema_header_from_tape(uint64_t eod_pos, struct ltfs_volume *vol)
+{
+	return _xml_schema_from_tape(eod_pos, true, vol);
+}
+
 /**
  * Parse an XML file for dcache and reconstruct dentry
  * @param filename file name for dentry.
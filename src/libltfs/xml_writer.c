@@ -94,86 +94,300 @@ int xml_format_time(struct ltfs_timespec t, char** out)
 	return noramized;
 }
 
+/**
+ * Add the time elapsed since start to a time counter.
+ */
+static void _xml_output_tape_add_time(const struct ltfs_timespec *start, struct ltfs_timespec *total)
+{
+	struct ltfs_timespec now, diff;
+
+	get_current_timespec(&now);
+	timer_sub(&now, start, &diff);
+	total->tv_sec += diff.tv_sec;
+	total->tv_nsec += diff.tv_nsec;
+	if (total->tv_nsec > LTFS_NSEC_MAX) {
+		++total->tv_sec;
+		total->tv_nsec -= 1000000000;
+	}
+}
+
+static inline unsigned long long _xml_output_tape_msec(const struct ltfs_timespec *t)
+{
+	if (t->tv_sec < 0)
+		return 0;
+	return (unsigned long long)t->tv_sec * 1000 + t->tv_nsec / 1000000;
+}
+
+/**
+ * Writer thread for XML output to tape. It writes the blocks queued by the serializer to
+ * the tape, and to the index cache when one is open, in the order they were queued.
+ * After an error, the remaining blocks are dropped and the serializer is told to stop.
+ */
+static ltfs_thread_return _xml_output_tape_writer(void *data)
+{
+	struct xml_output_tape *ctx = data;
+	struct ltfs_timespec ts_start;
+	char *block;
+	uint32_t len;
+	ssize_t ret;
+	int err_code, errno_fd;
+
+	ltfs_thread_mutex_lock(&ctx->ring_lock);
+	while (true) {
+		while (! ctx->ring_count && ! ctx->ring_done)
+			ltfs_thread_cond_wait(&ctx->ring_cond, &ctx->ring_lock);
+		if (! ctx->ring_count)
+			break;
+
+		block = ctx->ring[ctx->ring_tail];
+		len = ctx->ring_len[ctx->ring_tail];
+		ltfs_thread_mutex_unlock(&ctx->ring_lock);
+
+		err_code = errno_fd = 0;
+		get_current_timespec(&ts_start);
+		ret = tape_write(ctx->device, block, len, true, true);
+		if (ret < 0) {
+			if (len < ctx->buf_size)
+				ltfsmsg(LTFS_ERR, 17061E, (int)ret);
+			else
+				ltfsmsg(LTFS_ERR, 17060E, (int)ret);
+			err_code = ret;
+		} else if (ctx->fd >= 0) {
+			ret = arch_write(ctx->fd, block, len);
+			if (ret < 0) {
+				if (len < ctx->buf_size)
+					ltfsmsg(LTFS_ERR, 17245E, (int)errno);
+				else
+					ltfsmsg(LTFS_ERR, 17244E, (int)errno);
+				errno_fd = -LTFS_CACHE_IO;
+			}
+		}
+		_xml_output_tape_add_time(&ts_start, &ctx->write_time);
+
+		ltfs_thread_mutex_lock(&ctx->ring_lock);
+		ctx->ring_tail = (ctx->ring_tail + 1) % XML_OUTPUT_TAPE_RING_BLOCKS;
+		--ctx->ring_count;
+		if (err_code || errno_fd) {
+			ctx->err_code = err_code;
+			ctx->errno_fd = errno_fd;
+			ctx->ring_count = 0;
+			ltfs_thread_cond_broadcast(&ctx->ring_cond);
+			break;
+		}
+		ltfs_thread_cond_broadcast(&ctx->ring_cond);
+	}
+	ltfs_thread_mutex_unlock(&ctx->ring_lock);
+
+	ltfs_thread_exit();
+
+	return LTFS_THREAD_RC_NULL;
+}
+
+/**
+ * Hand the block being filled over to the writer thread and switch to the next free block.
+ * Waits while all blocks of the ring are queued.
+ * @return 0 on success or -1 if the writer thread failed.
+ */
+static int _xml_output_tape_queue(struct xml_output_tape *ctx)
+{
+	struct ltfs_timespec ts_start;
+	int ret = 0;
+
+	ltfs_thread_mutex_lock(&ctx->ring_lock);
+	if (ctx->err_code || ctx->errno_fd) {
+		ltfs_thread_mutex_unlock(&ctx->ring_lock);
+		return -1;
+	}
+
+	ctx->ring_len[ctx->ring_head] = ctx->buf_used;
+	ctx->ring_head = (ctx->ring_head + 1) % XML_OUTPUT_TAPE_RING_BLOCKS;
+	++ctx->ring_count;
+	ltfs_thread_cond_broadcast(&ctx->ring_cond);
+
+	if (ctx->ring_count == XML_OUTPUT_TAPE_RING_BLOCKS) {
+		get_current_timespec(&ts_start);
+		while (ctx->ring_count == XML_OUTPUT_TAPE_RING_BLOCKS && ! ctx->err_code && ! ctx->errno_fd)
+			ltfs_thread_cond_wait(&ctx->ring_cond, &ctx->ring_lock);
+		_xml_output_tape_add_time(&ts_start, &ctx->stall_time);
+	}
+	if (ctx->err_code || ctx->errno_fd)
+		ret = -1;
+	ltfs_thread_mutex_unlock(&ctx->ring_lock);
+
+	ctx->buf = ctx->ring[ctx->ring_head];
+	ctx->buf_used = 0;
+
+	return ret;
+}
+
+/**
+ * Wait for the writer thread to drain the ring and terminate.
+ * The time spent here is counted as serializer stall time.
+ */
+static void _xml_output_tape_stop_writer(struct xml_output_tape *ctx)
+{
+	struct ltfs_timespec ts_start;
+
+	if (! ctx->writer_alive)
+		return;
+
+	get_current_timespec(&ts_start);
+	ltfs_thread_mutex_lock(&ctx->ring_lock);
+	ctx->ring_done = true;
+	ltfs_thread_cond_broadcast(&ctx->ring_cond);
+	ltfs_thread_mutex_unlock(&ctx->ring_lock);
+
+	ltfs_thread_join(ctx->writer);
+	ctx->writer_alive = false;
+	_xml_output_tape_add_time(&ts_start, &ctx->stall_time);
+}
+
+/**
+ * Prepare an output context for writing XML to tape and start its writer thread.
+ * The caller must set ctx->fd before calling this function, and must call
+ * xml_output_tape_destroy to release the context.
+ * @param ctx Output context, zero-filled by the caller.
+ * @param device Tape device to write to.
+ * @param blocksize Size of each block written to the tape.
+ * @return 0 on success or a negative value on error.
+ */
+int xml_output_tape_init(struct xml_output_tape *ctx, struct device_data *device, uint32_t blocksize)
+{
+	int i, ret;
+
+	for (i = 0; i < XML_OUTPUT_TAPE_RING_BLOCKS; ++i) {
+		/* tape_write may append a CRC to the block */
+		ctx->ring[i] = malloc(blocksize + LTFS_CRC_SIZE);
+		if (! ctx->ring[i]) {
+			ltfsmsg(LTFS_ERR, 10001E, "xml_output_tape_init: output buffer");
+			ret = -LTFS_NO_MEMORY;
+			goto out_free;
+		}
+	}
+
+	ret = ltfs_thread_mutex_init(&ctx->ring_lock);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10002E, ret);
+		ret = -LTFS_MUTEX_INIT;
+		goto out_free;
+	}
+	ret = ltfs_thread_cond_init(&ctx->ring_cond);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10003E, ret);
+		ret = -LTFS_MUTEX_INIT;
+		goto out_mutex;
+	}
+
+	ctx->device     = device;
+	ctx->err_code   = 0;
+	ctx->errno_fd   = 0;
+	ctx->buf        = ctx->ring[0];
+	ctx->buf_size   = blocksize;
+	ctx->buf_used   = 0;
+	ctx->ring_head  = 0;
+	ctx->ring_tail  = 0;
+	ctx->ring_count = 0;
+	ctx->ring_done  = false;
+	get_current_timespec(&ctx->start);
+
+	ret = ltfs_thread_create(&ctx->writer, _xml_output_tape_writer, ctx);
+	if (ret) {
+		/* Failed to spawn the index writer thread (%d) */
+		ltfsmsg(LTFS_ERR, 17297E, ret);
+		ret = -LTFS_NO_MEMORY;
+		goto out_cond;
+	}
+	ctx->writer_alive = true;
+
+	return 0;
+
+out_cond:
+	ltfs_thread_cond_destroy(&ctx->ring_cond);
+out_mutex:
+	ltfs_thread_mutex_destroy(&ctx->ring_lock);
+out_free:
+	for (i = 0; i < XML_OUTPUT_TAPE_RING_BLOCKS; ++i) {
+		free(ctx->ring[i]);
+		ctx->ring[i] = NULL;
+	}
+	ctx->buf = NULL;
+	return ret;
+}
+
+/**
+ * Release an output context prepared by xml_output_tape_init. Blocks queued but not yet
+ * written are written before the writer thread terminates.
+ * @param ctx Output context.
+ */
+void xml_output_tape_destroy(struct xml_output_tape *ctx)
+{
+	int i;
+
+	_xml_output_tape_stop_writer(ctx);
+	ltfs_thread_cond_destroy(&ctx->ring_cond);
+	ltfs_thread_mutex_destroy(&ctx->ring_lock);
+	for (i = 0; i < XML_OUTPUT_TAPE_RING_BLOCKS; ++i) {
+		free(ctx->ring[i]);
+		ctx->ring[i] = NULL;
+	}
+	ctx->buf = NULL;
+}
+
 /**
  * Write callback for XML output using libxml2's I/O routines. It buffers the data it receives
- * into chunks of 1 tape block each and writes each chunk to the tape.
+ * into chunks of 1 tape block each and queues each chunk for the writer thread, which
+ * writes it to the tape while the next chunk is generated.
  */
 int xml_output_tape_write_callback(void *context, const char *buffer, int len)
 {
-	ssize_t ret;
 	struct xml_output_tape *ctx = context;
-	uint32_t copy_count; /* number of bytes of "buffer" to write immediately */
-	uint32_t bytes_remaining; /* number of input bytes waiting to be handled */
+	uint32_t copy_count; /* number of bytes of "buffer" to copy into the current block */
+	uint32_t bytes_remaining = len; /* number of input bytes waiting to be handled */
 
 	if (len == 0)
 		return 0;
 
-	if (ctx->err_code || ctx->errno_fd)
-		return -1;
-
-	if (ctx->buf_used + len < ctx->buf_size) {
-		memcpy(ctx->buf + ctx->buf_used, buffer, len);
-		ctx->buf_used += len;
-	} else {
-		bytes_remaining = len;
-		do {
-			copy_count = ctx->buf_size - ctx->buf_used;
-			memcpy(ctx->buf + ctx->buf_used, buffer + (len - bytes_remaining), copy_count);
-			ret = tape_write(ctx->device, ctx->buf, ctx->buf_size, true, true);
-			if (ret < 0) {
-				ltfsmsg(LTFS_ERR, 17060E, (int)ret);
-				ctx->err_code = ret;
-				return -1;
-			}
-
-			if (ctx->fd > 0) {
-				ret = arch_write(ctx->fd, ctx->buf, ctx->buf_size);
-				if (ret < 0) {
-					ltfsmsg(LTFS_ERR, 17244E, (int)errno);
-					ctx->errno_fd = -LTFS_CACHE_IO;
-					return -1;
-				}
-			}
+	while (bytes_remaining > 0) {
+		copy_count = ctx->buf_size - ctx->buf_used;
+		if (copy_count > bytes_remaining)
+			copy_count = bytes_remaining;
+		memcpy(ctx->buf + ctx->buf_used, buffer + (len - bytes_remaining), copy_count);
+		ctx->buf_used += copy_count;
+		bytes_remaining -= copy_count;
 
-			ctx->buf_used = 0;
-			bytes_remaining -= copy_count;
-		} while (bytes_remaining > ctx->buf_size);
-		if (bytes_remaining > 0)
-			memcpy(ctx->buf, buffer + (len - bytes_remaining), bytes_remaining);
-		ctx->buf_used = bytes_remaining;
+		if (ctx->buf_used == ctx->buf_size && _xml_output_tape_queue(ctx) < 0)
+			return -1;
 	}
 
 	return len;
 }
 
 /**
- * Close callback for XML output using libxml2's I/O routines. It flushes any partial buffer
- * which might be left after the write callback has received all XML data.
+ * Close callback for XML output using libxml2's I/O routines. It queues any partial buffer
+ * which might be left after the write callback has received all XML data, and waits until
+ * the writer thread has written every queued block.
  */
 int xml_output_tape_close_callback(void *context)
 {
-	int ret_t = 0, ret_d = 0, ret = 0, sret = 0;
+	int ret = 0, sret = 0;
 	struct xml_output_tape *ctx = context;
+	struct ltfs_timespec elapsed = {0, 0};
+	unsigned long long write_ms, stall_ms;
 
-	if (!ctx->err_code && !ctx->errno_fd && ctx->buf_used > 0) {
-		ret_t = tape_write(ctx->device, ctx->buf, ctx->buf_used, true, true);
-		if (ret_t < 0) {
-			ltfsmsg(LTFS_ERR, 17061E, (int)ret);
-			ctx->err_code = ret_t;
-			ret = -1;
-		} else {
-			if (ctx->fd >= 0)
-				ret_d = arch_write(ctx->fd, ctx->buf, ctx->buf_used);
-			if (ret_d < 0) {
-				ltfsmsg(LTFS_ERR, 17245E, (int)errno);
-				ctx->errno_fd = -LTFS_CACHE_IO;
-				ret = -1;
-			}
-		}
-	} else
-		ret = 0;
+	if (ctx->buf_used > 0 && _xml_output_tape_queue(ctx) < 0)
+		ret = -1;
+	_xml_output_tape_stop_writer(ctx);
+
+	if (ctx->err_code || ctx->errno_fd)
+		return -1;
+
+	_xml_output_tape_add_time(&ctx->start, &elapsed);
+	write_ms = _xml_output_tape_msec(&ctx->write_time);
+	stall_ms = _xml_output_tape_msec(&ctx->stall_time);
+	ltfsmsg(LTFS_DEBUG, 17296D, _xml_output_tape_msec(&elapsed), write_ms, stall_ms,
+			write_ms > stall_ms ? write_ms - stall_ms : 0);
 
-	if (!ctx->errno_fd && ctx->fd >= 0) {
+	if (ctx->fd >= 0) {
 		sret = fsync(ctx->fd);
 		if (sret < 0) {
 			ltfsmsg(LTFS_ERR, 17206E, "tape write callback (fsync)", errno, (unsigned long)ctx->buf_used);
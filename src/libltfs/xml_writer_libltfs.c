@@ -58,6 +58,8 @@
 #include "ltfs.h"
 #include "xml_libltfs.h"
 #include "fs.h"
+#include "index_snapshot.h"
+#include "dcache.h"
 #include "tape.h"
 #include "pathname.h"
 #include "arch/time_internal.h"
@@ -65,6 +67,10 @@
 #include "unicode/umachine.h"
 #include "unicode/utf8.h"
 #endif
+
+/* Size of the chunks in which directory contents are copied from an index spill */
+#define XML_SPILL_COPY_SIZE (64 * 1024)
+
 /* Structure to control EE's file offset cache and sync file list */
 struct ltfsee_cache
 {
@@ -271,11 +277,16 @@ static int _xml_write_xattr(xmlTextWriterPtr writer, const struct dentry *file)
  * Write file info to an XML stream.
  * @param writer output pointer
  * @param file the file to write
+ * @param live live file whose dirty flag is cleared once the index is written, or NULL if
+ *             file is a copy taken when the file changed during the snapshot
+ * @param snap snapshot being written, or NULL when writing the live index
  * @return 0 on success or -1 on failure
  */
-static int _xml_write_file(xmlTextWriterPtr writer, struct dentry *file, struct ltfsee_cache* offset_c, struct ltfsee_cache* sync_list)
+static int _xml_write_file(xmlTextWriterPtr writer, struct dentry *file, struct dentry *live,
+	struct index_snapshot *snap, struct ltfsee_cache* offset_c, struct ltfsee_cache* sync_list)
 {
-	struct extent_info *extent;
+	struct fs_extent_iter iter;
+	const struct extent_info *extent;
 	bool write_offset = false;
 	size_t i;
 
@@ -303,9 +314,9 @@ static int _xml_write_file(xmlTextWriterPtr writer, struct dentry *file, struct
 	/* write extents */
     if (file->isslink) {
 		xml_mktag(_xml_write_nametype(writer, "symlink", &file->target), -1);
-    } else if (! TAILQ_EMPTY(&file->extentlist)) {
+    } else if (fs_has_extents(file)) {
 		xml_mktag(xmlTextWriterStartElement(writer, BAD_CAST "extentinfo"), -1);
-		TAILQ_FOREACH(extent, &file->extentlist, list) {
+		for (extent = fs_extent_first(file, &iter); extent; extent = fs_extent_next(file, &iter)) {
 			/* Write file offset cache */
 			if (offset_c->fp && ! write_offset) {
 				fprintf(offset_c->fp, "%s,%"PRIu64",%"PRIu64"\n", file->name.name, extent->start.block, file->used_blocks);
@@ -346,10 +357,13 @@ static int _xml_write_file(xmlTextWriterPtr writer, struct dentry *file, struct
 
 	xml_mktag(xmlTextWriterEndElement(writer), -1);
 
-	/* Write dirty file list */
+	/* Write dirty file list. A snapshot clears the dirty flag once the index is on tape. */
 	if (sync_list->fp && file->dirty) {
 		fprintf(sync_list->fp, "%s,%"PRIu64"\n", file->name.name, file->size);
-		file->dirty = false;
+		if (! snap)
+			file->dirty = false;
+		else if (live)
+			index_snapshot_report(snap, live);
 		sync_list->count++;
 	}
 
@@ -357,29 +371,138 @@ static int _xml_write_file(xmlTextWriterPtr writer, struct dentry *file, struct
 }
 
 /**
- * Write XML tags representing the current directory tree to the given destination.
+ * Copy the <contents> element of a directory from the index spill.
  * @param writer output pointer
- * @param dir directory to process
- * @param idx pointer to ltfs index structure
- * @param offset_c file pointer to write offest cache
- * @param sync_list file pointer to write sync file list
+ * @param slot slot holding the element
  * @return 0 on success or negative on failure
  */
-static int _xml_write_dirtree(xmlTextWriterPtr writer, struct dentry *dir,
-					   const struct ltfs_index *idx, struct ltfsee_cache* offset_c, struct ltfsee_cache* sync_list)
+static int _xml_write_spilled_contents(xmlTextWriterPtr writer, struct index_spill_slot *slot)
+{
+	int ret = 0;
+	char *buf;
+	uint64_t pos, len;
+
+	buf = malloc(XML_SPILL_COPY_SIZE);
+	if (! buf) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		return -LTFS_NO_MEMORY;
+	}
+
+	for (pos = slot->start; pos < slot->end; pos += len) {
+		len = slot->end - pos;
+		if (len > XML_SPILL_COPY_SIZE)
+			len = XML_SPILL_COPY_SIZE;
+		ret = index_spill_read(slot->spill, buf, len, pos);
+		if (ret < 0)
+			break;
+		if (xmlTextWriterWriteRawLen(writer, BAD_CAST buf, len) < 0) {
+			ltfsmsg(LTFS_ERR, 17092E, __FUNCTION__);
+			ret = -1;
+			break;
+		}
+	}
+
+	free(buf);
+	return ret;
+}
+
+/**
+ * Copy the <contents> element of a directory whose children are kept by the dentry cache.
+ * The elements of its subdirectories are empty in the record and are filled in from the
+ * records of the subdirectories.
+ * @param writer output pointer
+ * @param uid UID of the directory
+ * @param vol LTFS volume
+ * @return 0 on success or negative on failure
+ */
+static int _xml_write_evicted_contents(xmlTextWriterPtr writer, uint64_t uid,
+	struct ltfs_volume *vol)
 {
-	size_t i;
-	char *offset_name, *sync_name;
-	struct ltfsee_cache *offset = offset_c, *sync = sync_list;
-	struct name_list *list_ptr, *list_tmp;
 	int ret;
+	char *record = NULL;
+	const char *xml;
+	size_t size, pos = 0;
+	uint64_t i, count;
+	const struct xml_record_subdir *subdirs;
 
-	if (!dir)
-		return 0; /* nothing to do */
+	ret = dcache_get_contents(uid, &record, &size, vol);
+	if (ret < 0)
+		return ret;
+	ret = xml_record_subdirs(uid, record, size, &subdirs, &count, &xml);
+	if (ret < 0)
+		goto out;
+	size -= xml - record;
+
+	for (i = 0; i < count; ++i) {
+		if (xmlTextWriterWriteRawLen(writer, BAD_CAST xml + pos, subdirs[i].start - pos) < 0) {
+			ltfsmsg(LTFS_ERR, 17092E, __FUNCTION__);
+			ret = -1;
+			goto out;
+		}
+		ret = _xml_write_evicted_contents(writer, subdirs[i].uid, vol);
+		if (ret < 0)
+			goto out;
+		pos = subdirs[i].end;
+	}
+	if (xmlTextWriterWriteRawLen(writer, BAD_CAST xml + pos, size - pos) < 0) {
+		ltfsmsg(LTFS_ERR, 17092E, __FUNCTION__);
+		ret = -1;
+	}
 
-	/* write standard attributes */
-	xml_mktag(xmlTextWriterStartElement(writer, BAD_CAST "directory"), -1);
-	if (dir == idx->root) {
+out:
+	free(record);
+	return ret;
+}
+
+/**
+ * Open the LTFSEE offset cache and sync list files before writing the .LTFSEE_DATA directory.
+ */
+static void _xml_open_ltfsee_caches(struct dentry *dir, struct ltfsee_cache* offset,
+	struct ltfsee_cache* sync)
+{
+	int ret;
+	char *offset_name, *sync_name;
+
+	ret = asprintf(&offset_name, "%s.%s", dir->vol->index_cache_path, "offsetcache.new");
+	if (ret > 0) {
+		arch_fopen(offset_name, "w", offset->fp);
+		free(offset_name);
+		if (!offset->fp)
+			ltfsmsg(LTFS_WARN, 17248W, "offset cache", dir->vol->index_cache_path);
+	} else
+		ltfsmsg(LTFS_WARN, 17247W, "offset cache", dir->vol->index_cache_path);
+
+	ret = asprintf(&sync_name, "%s.%s", dir->vol->index_cache_path, "synclist.new");
+	if (ret > 0) {
+		arch_fopen(sync_name, "w", sync->fp);
+		free(sync_name);
+		if (!sync->fp)
+			ltfsmsg(LTFS_WARN, 17248W, "sync list", dir->vol->index_cache_path);
+	} else
+		ltfsmsg(LTFS_WARN, 17247W, "sync list", dir->vol->index_cache_path);
+}
+
+static void _xml_close_ltfsee_cache(struct ltfsee_cache* cache)
+{
+	if (cache->fp) {
+		fflush(cache->fp);
+		fsync(fileno(cache->fp));
+		fclose(cache->fp);
+		cache->fp = NULL;
+	}
+}
+
+/**
+ * Write the standard attributes of a directory.
+ * @param writer output pointer
+ * @param dir directory to process
+ * @param idx pointer to ltfs index structure
+ * @return 0 on success or negative on failure
+ */
+static int _xml_write_dir_attributes(xmlTextWriterPtr writer, struct dentry *dir,
+	const struct ltfs_index *idx)
+{
+	if (dir->uid == idx->root->uid) {
 		if (idx->volume_name.name) {
 			xml_mktag(_xml_write_nametype(writer, "name", (struct ltfs_name*)(&idx->volume_name)), -1);
 		} else {
@@ -398,68 +521,132 @@ static int _xml_write_dirtree(xmlTextWriterPtr writer, struct dentry *dir,
 	/* write extended attributes */
 	xml_mktag(_xml_write_xattr(writer, dir), -1);
 
-	/* write children */
-	xml_mktag(xmlTextWriterStartElement(writer, BAD_CAST "contents"), -1);
-	/* Sort dentries by UID before generating xml */
-	HASH_SORT(dir->child_list, fs_hash_sort_by_uid);
-
-	HASH_ITER(hh, dir->child_list, list_ptr, list_tmp) {
-		if (list_ptr->d->isdir) {
-
-			if (list_ptr->d->vol->index_cache_path && !strcmp(list_ptr->d->name.name, ".LTFSEE_DATA")) {
-				ret = asprintf(&offset_name, "%s.%s", list_ptr->d->vol->index_cache_path, "offsetcache.new");
-				if (ret > 0) {
-					arch_fopen(offset_name, "w", offset->fp);
-					free(offset_name);
-					if (!offset->fp)
-						ltfsmsg(LTFS_WARN, 17248W, "offset cache", list_ptr->d->vol->index_cache_path);
-				} else
-					ltfsmsg(LTFS_WARN, 17247W, "offset cache", list_ptr->d->vol->index_cache_path);
-
-				ret = asprintf(&sync_name, "%s.%s", list_ptr->d->vol->index_cache_path, "synclist.new");
-				if (ret > 0) {
-					arch_fopen(sync_name, "w", sync->fp);
-					free(sync_name);
-					if (!sync->fp)
-						ltfsmsg(LTFS_WARN, 17248W, "sync list", list_ptr->d->vol->index_cache_path);
-				} else
-					ltfsmsg(LTFS_WARN, 17247W, "sync list", list_ptr->d->vol->index_cache_path);
-			}
+	return 0;
+}
 
-			xml_mktag(_xml_write_dirtree(writer, list_ptr->d, idx, offset, sync), -1);
+static int _xml_write_dentry(xmlTextWriterPtr writer, struct dentry *d,
+	const struct ltfs_index *idx, struct index_snapshot *snap,
+	struct ltfsee_cache* offset_c, struct ltfsee_cache* sync_list);
 
-			if (offset->fp) {
-				fflush(offset->fp);
-				fsync(fileno(offset->fp));
-				fclose(offset->fp);
-				offset->fp = NULL;
-			}
-			if (sync->fp) {
-				fflush(sync->fp);
-				fsync(fileno(sync->fp));
-				fclose(sync->fp);
-				sync->fp = NULL;
-			}
+/**
+ * Write XML tags representing the current directory tree to the given destination.
+ * @param writer output pointer
+ * @param dir directory to process, as returned by index_snapshot_get
+ * @param copied copied flag returned by index_snapshot_get for dir, released by this function
+ * @param idx pointer to ltfs index structure
+ * @param snap snapshot being written, or NULL when writing the live index
+ * @param offset_c file pointer to write offest cache
+ * @param sync_list file pointer to write sync file list
+ * @return 0 on success or negative on failure
+ */
+static int _xml_write_dirtree(xmlTextWriterPtr writer, struct dentry *dir, bool copied,
+	const struct ltfs_index *idx, struct index_snapshot *snap,
+	struct ltfsee_cache* offset_c, struct ltfsee_cache* sync_list)
+{
+	int ret = -1;
+	size_t i, count = 0;
+	struct dentry **children = NULL;
+	bool spilled, evicted, ltfsee = false;
+
+	spilled = dir->spill && ! __atomic_load_n(&dir->spill_loaded, __ATOMIC_ACQUIRE);
+	evicted = ! spilled && __atomic_load_n(&dir->dcache_evicted, __ATOMIC_ACQUIRE);
+
+	if (dir->uid != idx->root->uid && dir->vol->index_cache_path
+		&& ! strcmp(dir->name.name, ".LTFSEE_DATA") && ! spilled && ! evicted) {
+		_xml_open_ltfsee_caches(dir, offset_c, sync_list);
+		ltfsee = true;
+	}
 
-		} else
-			xml_mktag(_xml_write_file(writer, list_ptr->d, offset_c, sync_list), -1);
+	/* write standard attributes */
+	if (xmlTextWriterStartElement(writer, BAD_CAST "directory") < 0
+		|| _xml_write_dir_attributes(writer, dir, idx) < 0) {
+		ltfsmsg(LTFS_ERR, 17042E, __FUNCTION__);
+		goto out;
 	}
 
-	xml_mktag(xmlTextWriterEndElement(writer), -1);
+	if (! spilled && ! evicted && index_snapshot_children(dir, &children, &count) < 0)
+		goto out;
+
+	/* Children which were never loaded are copied from the index they were read from */
+	if (spilled) {
+		if (_xml_write_spilled_contents(writer, dir->spill) < 0)
+			goto out;
+	} else if (evicted) {
+		/* Children evicted to the dentry cache are copied from their records */
+		if (_xml_write_evicted_contents(writer, dir->uid, dir->vol) < 0)
+			goto out;
+	} else {
+		/* write children. Child lists are kept in UID order (see fs_add_key_to_hash_table) */
+		if (xmlTextWriterStartElement(writer, BAD_CAST "contents") < 0) {
+			ltfsmsg(LTFS_ERR, 17042E, __FUNCTION__);
+			goto out;
+		}
+		for (i = 0; i < count; ++i) {
+			if (_xml_write_dentry(writer, children[i], idx, snap, offset_c, sync_list) < 0)
+				goto out;
+		}
+		if (xmlTextWriterEndElement(writer) < 0) {
+			ltfsmsg(LTFS_ERR, 17042E, __FUNCTION__);
+			goto out;
+		}
+	}
 
 	/* Save unrecognized tags */
 	if (dir->tag_count > 0) {
 		for (i=0; i<dir->tag_count; ++i) {
 			if (xmlTextWriterWriteRaw(writer, dir->preserved_tags[i]) < 0) {
 				ltfsmsg(LTFS_ERR, 17092E, __FUNCTION__);
-				return -1;
+				goto out;
 			}
 		}
 	}
 
-	xml_mktag(xmlTextWriterEndElement(writer), -1);
+	if (xmlTextWriterEndElement(writer) < 0) {
+		ltfsmsg(LTFS_ERR, 17042E, __FUNCTION__);
+		goto out;
+	}
+	ret = 0;
 
-	return 0;
+out:
+	free(children);
+	if (ltfsee) {
+		_xml_close_ltfsee_cache(offset_c);
+		_xml_close_ltfsee_cache(sync_list);
+	}
+	index_snapshot_put(dir, copied);
+	return ret;
+}
+
+/**
+ * Write a file or a directory tree, as found in the snapshot being written.
+ * @param writer output pointer
+ * @param d dentry to write
+ * @param idx pointer to ltfs index structure
+ * @param snap snapshot being written, or NULL when writing the live index
+ * @param offset_c file pointer to write offest cache
+ * @param sync_list file pointer to write sync file list
+ * @return 0 on success or negative on failure
+ */
+static int _xml_write_dentry(xmlTextWriterPtr writer, struct dentry *d,
+	const struct ltfs_index *idx, struct index_snapshot *snap,
+	struct ltfsee_cache* offset_c, struct ltfsee_cache* sync_list)
+{
+	int ret;
+	bool copied;
+	struct dentry *view;
+
+	view = index_snapshot_get(snap, d, &copied);
+	if (! view) {
+		ltfsmsg(LTFS_ERR, 17042E, __FUNCTION__);
+		return -1;
+	}
+
+	if (view->isdir)
+		return _xml_write_dirtree(writer, view, copied, idx, snap, offset_c, sync_list);
+
+	ret = _xml_write_file(writer, view, (! snap || copied) ? d : NULL, snap, offset_c, sync_list);
+	index_snapshot_put(view, copied);
+	return ret;
 }
 
 /**
@@ -567,7 +754,8 @@ static int _xml_write_schema(xmlTextWriterPtr writer, const char *creator,
 		xml_mktag(xmlTextWriterWriteElement(writer, BAD_CAST "volumelockstate", BAD_CAST value), -1);
 	}
 
-	xml_mktag(_xml_write_dirtree(writer, idx->root, idx, &offset, &list), -1);
+	xml_mktag(_xml_write_dentry(writer, idx->root, idx, idx->is_snapshot ? idx->snapshot : NULL,
+		&offset, &list), -1);
 	if (offset.count)
 		ltfsmsg(LTFS_INFO, 17249I, (unsigned long long)offset.count);
 	if (list.count)
@@ -714,6 +902,153 @@ xmlBufferPtr xml_make_schema(const char *creator, const struct ltfs_index *idx)
 	return buf;
 }
 
+/**
+ * Write the <contents> element of a record, see xml_dir_contents_to_record().
+ * @param writer output pointer, writing to buf
+ * @param buf buffer the writer writes to
+ * @param children children of the directory
+ * @param count number of children
+ * @param idx pointer to ltfs index structure
+ * @param subdirs on success, the subdirectories found, to be freed by the caller
+ * @param nsub on success, the number of subdirectories
+ * @return 0 on success or negative on failure
+ */
+static int _xml_write_record_contents(xmlTextWriterPtr writer, xmlBufferPtr buf,
+	struct dentry **children, size_t count, const struct ltfs_index *idx,
+	struct xml_record_subdir **subdirs, uint64_t *nsub)
+{
+	size_t i, j, alloc = 0;
+	struct dentry *d;
+	struct xml_record_subdir *list;
+	struct ltfsee_cache none = {NULL, 0};
+
+	xml_mktag(xmlTextWriterStartElement(writer, BAD_CAST "contents"), -1);
+	for (i = 0; i < count; ++i) {
+		d = children[i];
+		if (! d->isdir) {
+			if (_xml_write_file(writer, d, d, NULL, &none, &none) < 0)
+				return -1;
+			continue;
+		}
+
+		if (*nsub == alloc) {
+			alloc = alloc ? alloc * 2 : 16;
+			list = realloc(*subdirs, alloc * sizeof(*list));
+			if (! list) {
+				ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+				return -LTFS_NO_MEMORY;
+			}
+			*subdirs = list;
+		}
+		list = &(*subdirs)[(*nsub)++];
+		list->uid = d->uid;
+		list->link_count = d->link_count;
+
+		/* The writer is flushed around the empty <contents> element to find its offsets */
+		xml_mktag(xmlTextWriterStartElement(writer, BAD_CAST "directory"), -1);
+		xml_mktag(_xml_write_dir_attributes(writer, d, idx), -1);
+		xml_mktag(xmlTextWriterFlush(writer), -1);
+		list->start = xmlBufferLength(buf);
+		xml_mktag(xmlTextWriterStartElement(writer, BAD_CAST "contents"), -1);
+		xml_mktag(xmlTextWriterEndElement(writer), -1);
+		xml_mktag(xmlTextWriterFlush(writer), -1);
+		list->end = xmlBufferLength(buf);
+		for (j = 0; j < d->tag_count; ++j) {
+			if (xmlTextWriterWriteRaw(writer, d->preserved_tags[j]) < 0) {
+				ltfsmsg(LTFS_ERR, 17092E, __FUNCTION__);
+				return -1;
+			}
+		}
+		xml_mktag(xmlTextWriterEndElement(writer), -1);
+	}
+	xml_mktag(xmlTextWriterEndElement(writer), -1);
+	xml_mktag(xmlTextWriterFlush(writer), -1);
+
+	return 0;
+}
+
+/**
+ * Write the children of a directory as a record, which the dentry cache keeps while they
+ * are evicted from memory. The record holds the <contents> element of the directory as it
+ * would appear in the index, except that the <contents> elements of subdirectories are
+ * left empty: every directory below needs a record of its own. The caller must keep the
+ * children from changing while the record is written.
+ * @param dir Directory.
+ * @param idx Index the directory belongs to.
+ * @param[out] record On success, an allocated buffer holding the record.
+ * @param[out] size On success, the size of the record.
+ * @return 0 on success or a negative value on error.
+ */
+int xml_dir_contents_to_record(struct dentry *dir, const struct ltfs_index *idx, char **record,
+	size_t *size)
+{
+	int ret;
+	size_t count = 0, len;
+	uint64_t nsub = 0;
+	struct dentry **children = NULL;
+	struct xml_record_subdir *subdirs = NULL;
+	struct xml_record_header hdr;
+	xmlBufferPtr buf = NULL;
+	xmlTextWriterPtr writer = NULL;
+
+	CHECK_ARG_NULL(dir, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(idx, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(record, -LTFS_NULL_ARG);
+	CHECK_ARG_NULL(size, -LTFS_NULL_ARG);
+
+	/* Records are parsed with the version of the index, so it must have file UIDs */
+	if (idx->version < IDX_VERSION_UID)
+		return -LTFS_UNSUPPORTED_INDEX_VERSION;
+
+	ret = index_snapshot_children(dir, &children, &count);
+	if (ret < 0)
+		return ret;
+
+	buf = xmlBufferCreate();
+	if (! buf) {
+		ltfsmsg(LTFS_ERR, 17048E);
+		ret = -LTFS_NO_MEMORY;
+		goto out;
+	}
+	writer = xmlNewTextWriterMemory(buf, 0);
+	if (! writer) {
+		ltfsmsg(LTFS_ERR, 17049E);
+		ret = -LTFS_NO_MEMORY;
+		goto out;
+	}
+
+	ret = _xml_write_record_contents(writer, buf, children, count, idx, &subdirs, &nsub);
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 17050E);
+		if (ret != -LTFS_NO_MEMORY)
+			ret = -LTFS_LIBXML2_FAILURE;
+		goto out;
+	}
+
+	hdr.subdirs = nsub;
+	len = xmlBufferLength(buf);
+	*size = sizeof(hdr) + nsub * sizeof(*subdirs) + len;
+	*record = malloc(*size);
+	if (! *record) {
+		ltfsmsg(LTFS_ERR, 10001E, __FUNCTION__);
+		ret = -LTFS_NO_MEMORY;
+		goto out;
+	}
+	memcpy(*record, &hdr, sizeof(hdr));
+	if (nsub)
+		memcpy(*record + sizeof(hdr), subdirs, nsub * sizeof(*subdirs));
+	memcpy(*record + sizeof(hdr) + nsub * sizeof(*subdirs), xmlBufferContent(buf), len);
+
+out:
+	if (writer)
+		xmlFreeTextWriter(writer);
+	if (buf)
+		xmlBufferFree(buf);
+	free(subdirs);
+	free(children);
+	return ret;
+}
+
 static int _commit_offset_caches(const char* path, const struct ltfs_index *idx)
 {
 	int ret = 0, fd = -1;
@@ -816,12 +1151,15 @@ int xml_schema_to_file(const char *filename, const char *creator,
 }
 
 /**
- * Generate an XML Index based on the vol->index->root directory tree.
+ * Generate an XML Index based on the given index, which is either vol->index or a snapshot
+ * of it taken by ltfs_index_snapshot.
  * The generated data are written directly to the tape with the appropriate blocksize.
+ * @param reason reason to write the index.
+ * @param idx index to write.
  * @param vol LTFS volume.
  * @return 0 on success or a negative value on error.
  */
-int xml_schema_to_tape(char *reason, struct ltfs_volume *vol)
+int xml_schema_to_tape(char *reason, struct ltfs_index *idx, struct ltfs_volume *vol)
 {
 	int ret, bk = -1;
 	xmlOutputBufferPtr write_buf;
@@ -830,6 +1168,7 @@ int xml_schema_to_tape(char *reason, struct ltfs_volume *vol)
 	char *creator = NULL;
 	bool immed = false;
 
+	CHECK_ARG_NULL(idx, -LTFS_NULL_ARG);
 	CHECK_ARG_NULL(vol, -LTFS_NULL_ARG);
 	CHECK_ARG_NULL(reason, -LTFS_NULL_ARG);
 
@@ -839,22 +1178,19 @@ int xml_schema_to_tape(char *reason, struct ltfs_volume *vol)
 		ltfsmsg(LTFS_ERR, 10001E, "xml_schema_to_tape: output context");
 		return -LTFS_NO_MEMORY;
 	}
-	out_ctx->buf = malloc(vol->label->blocksize + LTFS_CRC_SIZE);
-	if (! out_ctx->buf) {
-		ltfsmsg(LTFS_ERR, 10001E, "xml_schema_to_tape: output buffer");
-		free(out_ctx);
-		return -LTFS_NO_MEMORY;
-	}
 
 	out_ctx->fd       = -1;
 	out_ctx->errno_fd = 0;
 	if (vol->index_cache_path)
 		xml_acquire_file_lock(vol->index_cache_path, &out_ctx->fd, &bk, true);
 
-	out_ctx->buf_size = vol->label->blocksize;
-	out_ctx->buf_used = 0;
-	out_ctx->device   = vol->device;
-	out_ctx->err_code = 0;
+	ret = xml_output_tape_init(out_ctx, vol->device, vol->label->blocksize);
+	if (ret < 0) {
+		if (out_ctx->fd >= 0)
+			xml_release_file_lock(vol->index_cache_path, out_ctx->fd, bk, false);
+		free(out_ctx);
+		return ret;
+	}
 
 	/* Create output buffer pointer. */
 	write_buf = xmlOutputBufferCreateIO(xml_output_tape_write_callback,
@@ -864,7 +1200,7 @@ int xml_schema_to_tape(char *reason, struct ltfs_volume *vol)
 		ltfsmsg(LTFS_ERR, 17053E);
 		if (out_ctx->fd >= 0)
 			xml_release_file_lock(vol->index_cache_path, out_ctx->fd, bk, false);
-		free(out_ctx->buf);
+		xml_output_tape_destroy(out_ctx);
 		free(out_ctx);
 		return -LTFS_LIBXML2_FAILURE;
 	}
@@ -876,7 +1212,7 @@ int xml_schema_to_tape(char *reason, struct ltfs_volume *vol)
 		if (out_ctx->fd >= 0)
 			xml_release_file_lock(vol->index_cache_path, out_ctx->fd, bk, false);
 		xmlOutputBufferClose(write_buf);
-		free(out_ctx->buf);
+		xml_output_tape_destroy(out_ctx);
 		free(out_ctx);
 		return -LTFS_LIBXML2_FAILURE;
 	}
@@ -884,7 +1220,7 @@ int xml_schema_to_tape(char *reason, struct ltfs_volume *vol)
 	/* Generate the Index. */
 	asprintf(&creator, "%s - %s", vol->creator, reason);
 	if (creator) {
-		ret = _xml_write_schema(writer, creator, vol->index);
+		ret = _xml_write_schema(writer, creator, idx);
 		if (ret < 0) {
 			ltfsmsg(LTFS_ERR, 17055E, ret);
 		}
@@ -908,7 +1244,7 @@ int xml_schema_to_tape(char *reason, struct ltfs_volume *vol)
 				 * It's time to unveil the offset cache and sync cache to other programs.
 				 */
 				if (vol->index_cache_path)
-					_commit_offset_caches(vol->index_cache_path, vol->index);
+					_commit_offset_caches(vol->index_cache_path, idx);
 			} else {
 				ltfsmsg(LTFS_ERR, 11084E, ret);
 			}
@@ -917,8 +1253,9 @@ int xml_schema_to_tape(char *reason, struct ltfs_volume *vol)
 				xml_release_file_lock(vol->index_cache_path, out_ctx->fd, bk, false);
 		}
 
-		/* Update the creator string */
-		if (! vol->index->creator || strcmp(vol->creator, vol->index->creator)) {
+		/* Update the creator string. A snapshot writer does this in ltfs_write_index
+		 * while it still holds the volume lock exclusively. */
+		if (idx == vol->index && (! vol->index->creator || strcmp(vol->creator, vol->index->creator))) {
 			if (vol->index->creator)
 				free(vol->index->creator);
 			vol->index->creator = arch_strdup(vol->creator);
@@ -936,7 +1273,7 @@ int xml_schema_to_tape(char *reason, struct ltfs_volume *vol)
 		ret = -LTFS_NO_MEMORY;
 	}
 
-	free(out_ctx->buf);
+	xml_output_tape_destroy(out_ctx);
 	free(out_ctx);
 
 	return ret;
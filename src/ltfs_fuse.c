@@ -60,9 +60,11 @@
 #include "libltfs/pathname.h"
 #include "libltfs/xattr.h"
 #include "libltfs/periodic_sync.h"
+#include "libltfs/capacity_refresh.h"
 #include "libltfs/arch/time_internal.h"
 #include "libltfs/arch/errormap.h"
 #include "libltfs/kmi.h"
+#include "libltfs/dcache.h"
 
 #ifdef mingw_PLATFORM
 #include "libltfs/arch/win/win_util.h"
@@ -218,8 +220,8 @@ const char *_dentry_name(const char *path, struct file_info *fi)
 		return "(unnamed)";
 }
 
-static void _ltfs_fuse_attr_to_stat(struct stat *stbuf, struct dentry_attr *attr,
-	struct ltfs_fuse_data *priv)
+void _ltfs_fuse_attr_to_stat(struct stat *stbuf, const struct dentry_attr *attr, uid_t uid,
+	gid_t gid, struct ltfs_fuse_data *priv)
 {
 	stbuf->st_dev = LTFS_SUPER_MAGIC;
 	stbuf->st_ino = attr->uid;
@@ -235,8 +237,8 @@ static void _ltfs_fuse_attr_to_stat(struct stat *stbuf, struct dentry_attr *attr
 		stbuf->st_uid = priv->mount_uid;
 		stbuf->st_gid = priv->mount_gid;
 	} else {
-		stbuf->st_uid = fuse_get_context()->uid;
-		stbuf->st_gid = fuse_get_context()->gid;
+		stbuf->st_uid = uid;
+		stbuf->st_gid = gid;
 	}
 	stbuf->st_size = attr->size;
 	stbuf->st_blksize = attr->blocksize;
@@ -270,7 +272,8 @@ int ltfs_fuse_fgetattr(const char *path, struct stat *stbuf, struct fuse_file_in
 	ret = ltfs_fsops_getattr(file->file_info->dentry_handle, &attr, priv->data);
 
 	if (ret == 0)
-		_ltfs_fuse_attr_to_stat(stbuf, &attr, priv);
+		_ltfs_fuse_attr_to_stat(stbuf, &attr, fuse_get_context()->uid, fuse_get_context()->gid,
+			priv);
 
 	ltfs_request_trace(FUSE_REQ_EXIT(REQ_FGETATTR), ret,
 					   ((struct dentry *)(file->file_info->dentry_handle))->uid);
@@ -292,7 +295,8 @@ int ltfs_fuse_getattr(const char *path, struct stat *stbuf)
 	ret = ltfs_fsops_getattr_path(path, &attr, &id, priv->data);
 
 	if (ret == 0)
-		_ltfs_fuse_attr_to_stat(stbuf, &attr, priv);
+		_ltfs_fuse_attr_to_stat(stbuf, &attr, fuse_get_context()->uid, fuse_get_context()->gid,
+			priv);
 
 	ltfs_request_trace(FUSE_REQ_EXIT(REQ_GETATTR), ret, id.uid);
 
@@ -307,23 +311,23 @@ int ltfs_fuse_access(const char *path, int mode)
 	return 0;
 }
 
-int ltfs_fuse_statfs(const char *path, struct statvfs *buf)
+/**
+ * Fill in file system statistics for a statfs request.
+ */
+int _ltfs_fuse_statfs(struct statvfs *buf, struct ltfs_fuse_data *priv)
 {
 #ifndef mingw_PLATFORM
 	int ret;
-	struct ltfs_fuse_data *priv = fuse_get_context()->private_data;
 	struct statvfs *stats = &priv->fs_stats;
 	struct device_capacity blockstat;
 
-	ltfs_request_trace(FUSE_REQ_ENTER(REQ_STATFS), 0, 0);
-
 	memset(&blockstat, 0, sizeof(blockstat));
 
-	ret = ltfs_capacity_data(&blockstat, priv->data);
-	if (ret < 0) {
-		ltfs_request_trace(FUSE_REQ_EXIT(REQ_STATFS), ret, 0);
-		return errormap_fuse_error(ret);
-	}
+	/* Never wait for the device here, the cached capacity is at most
+	 * LTFS_CAPACITY_REFRESH_DEFAULT seconds old */
+	ret = ltfs_capacity_data_cached(&blockstat, priv->data);
+	if (ret < 0)
+		return ret;
 
 	stats->f_blocks = blockstat.total_dp;           /* Total tape capacity */
 	stats->f_bfree = blockstat.remaining_dp;        /* Remaining tape capacity */
@@ -346,13 +350,25 @@ int ltfs_fuse_statfs(const char *path, struct statvfs *buf)
 	memcpy(buf, stats, sizeof(struct statvfs));
 #endif /* __APPLE__ */
 
-	ltfs_request_trace(FUSE_REQ_EXIT(REQ_STATFS), 0, 0);
-
 #endif /* mingw_PLATFORM */
 
 	return 0;
 }
 
+int ltfs_fuse_statfs(const char *path, struct statvfs *buf)
+{
+	struct ltfs_fuse_data *priv = fuse_get_context()->private_data;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_STATFS), 0, 0);
+
+	ret = _ltfs_fuse_statfs(buf, priv);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_STATFS), ret, 0);
+
+	return errormap_fuse_error(ret);
+}
+
 int ltfs_fuse_open(const char *path, struct fuse_file_info *fi)
 {
 	struct ltfs_fuse_data *priv = fuse_get_context()->private_data;
@@ -832,11 +848,32 @@ int ltfs_fuse_rename(const char *from, const char *to)
 	return errormap_fuse_error(ret);
 }
 
-int _ltfs_fuse_filldir(void *buf, const char *name, void *priv)
+/* "." and ".." take FUSE offsets 1 and 2, directory entries are shifted past them */
+#define LTFS_FUSE_DIR_OFFSET_BASE 2
+
+/* Listing state passed through ltfs_fsops_readdir_plus to _ltfs_fuse_filldir */
+struct ltfs_fuse_dirfill {
+	fuse_fill_dir_t filler;
+	struct ltfs_fuse_data *priv;
+	uid_t uid;
+	gid_t gid;
+};
+
+int _ltfs_fuse_filldir(void *buf, const char *name, uint64_t offset,
+	const struct dentry_attr *attr, void *priv)
 {
 	int ret;
 	char *new_name;
-	fuse_fill_dir_t filler = priv;
+	struct ltfs_fuse_dirfill *fill = priv;
+	struct stat stbuf, *st = NULL;
+
+	/* Hand the attributes to FUSE with the name, so the entry type (and with use_ino the
+	 * inode number) is known without a getattr round trip */
+	if (attr) {
+		memset(&stbuf, 0, sizeof(stbuf));
+		_ltfs_fuse_attr_to_stat(&stbuf, attr, fill->uid, fill->gid, fill->priv);
+		st = &stbuf;
+	}
 
 	ret = pathname_unformat(name, &new_name);
 	if (ret < 0) {
@@ -853,14 +890,15 @@ int _ltfs_fuse_filldir(void *buf, const char *name, void *priv)
 		return ret;
 	}
 
-	ret = filler(buf, new_name, NULL, 0);
+	ret = fill->filler(buf, new_name, st, offset + LTFS_FUSE_DIR_OFFSET_BASE);
 #else
-	ret = filler(buf, name, NULL, 0);
+	ret = fill->filler(buf, name, st, offset + LTFS_FUSE_DIR_OFFSET_BASE);
 #endif
 
 	free(new_name);
+	/* Buffer full, the entry is returned again by the next call */
 	if (ret)
-		return -ENOBUFS;
+		return 1;
 	return 0;
 }
 
@@ -869,25 +907,36 @@ int ltfs_fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 {
 	struct ltfs_fuse_data *priv = fuse_get_context()->private_data;
 	struct ltfs_file_handle *file = FILEHANDLE_TO_STRUCT(fi->fh);
+	struct ltfs_fuse_dirfill fill;
 	int ret;
 
 	ltfs_request_trace(FUSE_REQ_ENTER(REQ_READDIR), (uint64_t)offset, 0);
 
 	ltfsmsg(LTFS_DEBUG, 14047D, _dentry_name(path, file->file_info));
 
-	if (filler(buf, ".",  NULL, 0)) {
+	/* Listing in offset mode lets FUSE fetch large directories one buffer at a time,
+	 * resuming from the handle's cursor instead of rebuilding the whole listing. */
+	if (offset < 1 && filler(buf, ".",  NULL, 1)) {
 		/* No buffer space */
 		ltfsmsg(LTFS_DEBUG, 14026D);
 		return -ENOBUFS;
 	}
-	if (filler(buf, "..", NULL, 0)) {
+	if (offset < 2 && filler(buf, "..", NULL, 2)) {
 		/* No buffer space */
 		ltfsmsg(LTFS_DEBUG, 14026D);
 		return -ENOBUFS;
 	}
 
-	ret = ltfs_fsops_readdir(file->file_info->dentry_handle, buf, _ltfs_fuse_filldir,
-							 filler, priv->data);
+	fill.filler = filler;
+	fill.priv = priv;
+	fill.uid = fuse_get_context()->uid;
+	fill.gid = fuse_get_context()->gid;
+
+	ltfs_mutex_lock(&file->lock);
+	ret = ltfs_fsops_readdir_plus(file->file_info->dentry_handle, &file->dir_cursor,
+		offset > LTFS_FUSE_DIR_OFFSET_BASE ? offset - LTFS_FUSE_DIR_OFFSET_BASE : 0,
+		buf, _ltfs_fuse_filldir, &fill, priv->data);
+	ltfs_mutex_unlock(&file->lock);
 
 	ltfs_request_trace(FUSE_REQ_EXIT(REQ_READDIR), ret,
 					   ((struct dentry *)(file->file_info->dentry_handle))->uid);
@@ -895,18 +944,11 @@ int ltfs_fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 	return errormap_fuse_error(ret);
 }
 
-int ltfs_fuse_write(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fi)
+/**
+ * Common completion of ltfs_fuse_write and ltfs_fuse_write_buf.
+ */
+static int _ltfs_fuse_write_done(struct ltfs_file_handle *file, size_t size, int ret)
 {
-	struct ltfs_fuse_data *priv = fuse_get_context()->private_data;
-	struct ltfs_file_handle *file = FILEHANDLE_TO_STRUCT(fi->fh);
-	int ret;
-
-	ltfs_request_trace(FUSE_REQ_ENTER(REQ_WRITE), (uint64_t)offset, (uint64_t)size);
-
-	ltfsmsg(LTFS_DEBUG3, 14048D, _dentry_name(path, file->file_info), (long long)offset, size);
-
-	ret = ltfs_fsops_write(file->file_info->dentry_handle, buf, size, offset, true, priv->data);
-
 	if (ret == 0) {
 		ltfs_mutex_lock(&file->lock);
 		file->dirty = true;
@@ -927,6 +969,75 @@ int ltfs_fuse_write(const char *path, const char *buf, size_t size, off_t offset
 	}
 }
 
+int ltfs_fuse_write(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fi)
+{
+	struct ltfs_fuse_data *priv = fuse_get_context()->private_data;
+	struct ltfs_file_handle *file = FILEHANDLE_TO_STRUCT(fi->fh);
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_WRITE), (uint64_t)offset, (uint64_t)size);
+
+	ltfsmsg(LTFS_DEBUG3, 14048D, _dentry_name(path, file->file_info), (long long)offset, size);
+
+	ret = ltfs_fsops_write(file->file_info->dentry_handle, buf, size, offset, true, priv->data);
+
+	return _ltfs_fuse_write_done(file, size, ret);
+}
+
+#if FUSE_VERSION >= 29
+/**
+ * Write source that reads from a FUSE buffer vector. The vector is moved to byte 'pos' of its
+ * data before fuse_buf_copy copies from it and advances it. When splice is enabled the vector
+ * refers to a pipe and the data moves from it straight into the destination, normally an
+ * I/O scheduler cache block. A pipe can only be read in order, so for a pipe 'pos' must be
+ * where the previous copy stopped.
+ */
+ssize_t _ltfs_fuse_bufvec_source(char *dst, size_t size, size_t pos, void *src)
+{
+	struct fuse_bufvec *bufv = src;
+	struct fuse_bufvec dst_buf = FUSE_BUFVEC_INIT(size);
+	size_t idx = 0, off = pos, first, last, i;
+
+	/* Find the buffer holding byte 'pos' */
+	while (idx < bufv->count && off >= bufv->buf[idx].size) {
+		off -= bufv->buf[idx].size;
+		++idx;
+	}
+
+	if (idx != bufv->idx || off != bufv->off) {
+		first = idx < bufv->idx ? idx : bufv->idx;
+		last = idx < bufv->idx ? bufv->idx : idx;
+		for (i = first; i <= last && i < bufv->count; ++i) {
+			if ((bufv->buf[i].flags & FUSE_BUF_IS_FD) && ! (bufv->buf[i].flags & FUSE_BUF_FD_SEEK))
+				return -LTFS_BAD_ARG;
+		}
+		bufv->idx = idx;
+		bufv->off = off;
+	}
+
+	dst_buf.buf[0].mem = dst;
+	return fuse_buf_copy(&dst_buf, bufv, 0);
+}
+
+int ltfs_fuse_write_buf(const char *path, struct fuse_bufvec *buf, off_t offset,
+	struct fuse_file_info *fi)
+{
+	struct ltfs_fuse_data *priv = fuse_get_context()->private_data;
+	struct ltfs_file_handle *file = FILEHANDLE_TO_STRUCT(fi->fh);
+	size_t size = fuse_buf_size(buf);
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_WRITE), (uint64_t)offset, (uint64_t)size);
+
+	ltfsmsg(LTFS_DEBUG3, 14048D, _dentry_name(path, file->file_info), (long long)offset, size);
+
+	ret = ltfs_fsops_write_source(file->file_info->dentry_handle, _ltfs_fuse_bufvec_source, buf,
+		size, offset, true, priv->data);
+
+	return _ltfs_fuse_write_done(file, size, ret);
+}
+#endif
+
 int ltfs_fuse_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi)
 {
 	struct ltfs_fuse_data *priv = fuse_get_context()->private_data;
@@ -1063,7 +1174,96 @@ int ltfs_fuse_removexattr(const char *path, const char *name)
  */
 void * ltfs_fuse_mount(struct fuse_conn_info *conn)
 {
-	struct ltfs_fuse_data *priv = fuse_get_context()->private_data;
+#if FUSE_VERSION >= 29
+	/* Let the kernel splice write payloads into a pipe, see ltfs_fuse_write_buf */
+	if (conn->capable & FUSE_CAP_SPLICE_READ)
+		conn->want |= FUSE_CAP_SPLICE_READ;
+#endif
+	return _ltfs_fuse_setup(fuse_get_context()->private_data);
+}
+
+/**
+ * Set up the dentry cache of the mounted cartridge. A cache left by an earlier mount is
+ * reused when it matches the index generation on the medium and was closed cleanly;
+ * otherwise it is rebuilt from the index.
+ * @return 0 on success or a negative value on error.
+ */
+static int _ltfs_fuse_dcache_init(struct ltfs_fuse_data *priv)
+{
+	int i, ret;
+	char **options, *uuid = NULL;
+	const char *name;
+	unsigned int gen = 0;
+	bool exists = false, dirty = true;
+	struct dcache_options *opt = NULL;
+	struct ltfs_volume *vol = priv->data;
+
+	options = config_file_get_options("dcache", priv->config);
+	if (! options)
+		return -LTFS_NO_MEMORY;
+	ret = dcache_parse_options((const char **) options, &opt);
+	for (i=0; options[i]; ++i)
+		free(options[i]);
+	free(options);
+	if (ret < 0)
+		return ret;
+
+	ret = dcache_init(&priv->dcache_plugin, opt, vol);
+	dcache_free_options(&opt);
+	if (ret < 0)
+		return ret;
+
+	name = HAVE_BARCODE(vol) ? vol->label->barcode : vol->label->vol_uuid;
+	ret = dcache_set_workdir(priv->work_directory, false, vol);
+	if (ret == 0)
+		ret = dcache_get_advisory_lock(name, vol);
+	if (ret < 0)
+		goto out_destroy;
+
+	ret = dcache_cache_exists(name, &exists, vol);
+	if (ret == 0 && exists) {
+		if (dcache_get_vol_uuid(priv->work_directory, name, &uuid, vol) == 0
+			&& ! strcmp(uuid, vol->label->vol_uuid)
+			&& dcache_get_generation(priv->work_directory, name, &gen, vol) == 0
+			&& gen == vol->index->generation
+			&& dcache_get_dirty(priv->work_directory, name, &dirty, vol) == 0 && ! dirty)
+			ltfsmsg(LTFS_INFO, 14128I, name);
+		else {
+			exists = false;
+			ret = dcache_rmcache(name, vol);
+		}
+		free(uuid);
+	}
+	if (ret == 0 && ! exists)
+		ret = dcache_mkcache(name, vol);
+	if (ret == 0)
+		ret = dcache_assign_name(name, vol);
+	if (ret == 0)
+		return 0;
+
+	dcache_put_advisory_lock(name, vol);
+out_destroy:
+	dcache_destroy(vol);
+	return ret;
+}
+
+/**
+ * Close the dentry cache of the cartridge, once the final index is on the medium.
+ */
+static void _ltfs_fuse_dcache_destroy(struct ltfs_fuse_data *priv)
+{
+	struct ltfs_volume *vol = priv->data;
+
+	dcache_unassign_name(vol);
+	dcache_put_advisory_lock(HAVE_BARCODE(vol) ? vol->label->barcode : vol->label->vol_uuid, vol);
+	dcache_destroy(vol);
+}
+
+/**
+ * Secondary setup shared by the FUSE frontends, called when FUSE starts serving requests.
+ */
+void *_ltfs_fuse_setup(struct ltfs_fuse_data *priv)
+{
 	struct statvfs *stats = &priv->fs_stats;
 
 	ltfs_request_trace(FUSE_REQ_ENTER(REQ_MOUNT), 0, 0);
@@ -1090,6 +1290,13 @@ void * ltfs_fuse_mount(struct fuse_conn_info *conn)
 		ltfsmsg(LTFS_WARN, 14028W);
 	}
 
+	/* Open the dentry cache, if one has been specified by the user */
+	if (priv->dcache_backend_name) {
+		int ret = _ltfs_fuse_dcache_init(priv);
+		if (ret < 0)
+			ltfsmsg(LTFS_WARN, 14127W, ret);
+	}
+
 	/* fill in fixed filesystem stats */
 	stats->f_bsize = ltfs_get_blocksize(priv->data); /* Filesystem optimal transfer block size */
 
@@ -1131,8 +1338,19 @@ void * ltfs_fuse_mount(struct fuse_conn_info *conn)
 #endif /* mingw_PLATFORM */
 
 	/* Kick timer thread for sync by time */
-	if (priv->sync_type == LTFS_SYNC_TIME)
-		periodic_sync_thread_init(priv->sync_time, priv->data);
+	if (priv->sync_type == LTFS_SYNC_TIME) {
+		struct periodic_sync_policy policy = {
+			.period_sec = priv->sync_time,
+			.dirty_entries = priv->sync_dirty_entries,
+			.dirty_bytes = priv->sync_dirty_size * 1024 * 1024,
+			.cost_ratio = priv->sync_cost_ratio,
+			.stream_defer_sec = priv->sync_stream_defer,
+		};
+		periodic_sync_thread_init(&policy, priv->data);
+	}
+
+	/* Keep the capacity reported by statfs fresh without querying the device per call */
+	capacity_refresh_thread_init(LTFS_CAPACITY_REFRESH_DEFAULT, priv->data);
 
 	ltfs_request_trace(FUSE_REQ_EXIT(REQ_MOUNT), (uint64_t)priv, 0);
 
@@ -1151,6 +1369,8 @@ void ltfs_fuse_umount(void *userdata)
 
 	if (periodic_sync_thread_initialized(priv->data))
 		periodic_sync_thread_destroy(priv->data);
+	if (capacity_refresh_thread_initialized(priv->data))
+		capacity_refresh_thread_destroy(priv->data);
 
 	/*
 	 * Destroy the I/O scheduler, if one has been specified by the user.
@@ -1166,7 +1386,10 @@ void ltfs_fuse_umount(void *userdata)
 
 	ltfs_unmount(SYNC_UNMOUNT, priv->data);
 
-	if (priv->capture_index)
+	if (dcache_initialized(priv->data))
+		_ltfs_fuse_dcache_destroy(priv);
+
+	if (priv->capture_index || priv->cached_index_mount)
 		ltfs_save_index_to_disk(priv->work_directory, SYNC_UNMOUNT, false, priv->data);
 
 	ltfs_request_trace(FUSE_REQ_EXIT(REQ_UNMOUNT), 0, 0);
@@ -1228,6 +1451,9 @@ struct fuse_operations ltfs_ops = {
 	.releasedir  = ltfs_fuse_releasedir,
 	.fsyncdir    = ltfs_fuse_fsyncdir,
 	.write       = ltfs_fuse_write,
+#if FUSE_VERSION >= 29
+	.write_buf   = ltfs_fuse_write_buf,
+#endif
 	.read        = ltfs_fuse_read,
 	.setxattr    = ltfs_fuse_setxattr,
 	.getxattr    = ltfs_fuse_getxattr,
@@ -91,6 +91,14 @@ struct ltfs_fuse_data {
 	char *sync_type_str;           /**< Sync type fetched by option (time, close or none)*/
 	ltfs_sync_type_t sync_type;    /**< Sync type (time, close or none)*/
 	long sync_time;                /**< Sync time*/
+	char *str_sync_dirty_entries;  /**< Metadata updates that trigger a periodic sync (string) */
+	char *str_sync_dirty_size;     /**< Unindexed MiB that trigger a periodic sync (string) */
+	char *str_sync_cost_ratio;     /**< Period per index write time (string) */
+	char *str_sync_stream_defer;   /**< Longest periodic sync delay while data streams (string) */
+	uint64_t sync_dirty_entries;   /**< Metadata updates that trigger a periodic sync, 0 to disable */
+	uint64_t sync_dirty_size;      /**< Unindexed MiB that trigger a periodic sync, 0 to disable */
+	uint64_t sync_cost_ratio;      /**< Period per index write time, 0 to disable */
+	uint64_t sync_stream_defer;    /**< Longest periodic sync delay while data streams (sec), 0 to disable */
 
 	bool snmp_enabled;             /**< Indicates if the snmp service is enabled */
 	char *snmp_deffile;            /**< SNMP definition file */
@@ -128,9 +136,16 @@ struct ltfs_fuse_data {
 	int release_device;            /**< Release device? */
 	int allow_other;               /**< Allow all users to access the volume? */
 	int capture_index;             /**< Capture index information to work directory at unmount */
+	int cached_index_mount;        /**< Mount with the index captured at the last unmount if still valid */
+	int lazy_index;                /**< Load directory contents from an index spill on first use */
+	char *str_lazy_index_limit;    /**< Dentries loaded from the index spill before eviction (string) */
+	uint64_t lazy_index_limit;     /**< Dentries loaded from the index spill before eviction */
 	char *symlink_str;             /**< Symbolic Link type fetched by option (live or posix)*/
 	char *str_append_only_mode;    /**< option sting of scsi_append_only_mode */
 	int append_only_mode;          /**< Use append-only mode */
+	int lowlevel;                  /**< Serve requests through the FUSE low-level (inode) interface */
+	struct fuse_chan *ll_chan;     /**< Low-level channel used for cache invalidation, NULL if unsupported */
+	double ll_cache_timeout;       /**< Entry and attribute timeout handed to the kernel by the low-level frontend */
 
 	bool advanced_help;            /**< Include standard FUSE options on --help? */
 
@@ -150,6 +165,7 @@ struct ltfs_fuse_data {
 struct ltfs_file_handle {
 	struct file_info *file_info; /**< open_file data associated with this file handle */
 	bool dirty;                  /**< True if this handle has been written but not synced */
+	struct ltfs_dir_cursor dir_cursor; /**< Listing position of a directory handle */
 	ltfs_mutex_t lock;
 };
 
@@ -201,9 +217,31 @@ struct file_info {
 #define REQ_REMOVEXATTR 001d
 #define REQ_SYMLINK     001e
 #define REQ_READLINK    001f
+#define REQ_LOOKUP      0020
+#define REQ_FORGET      0021
+#define REQ_SETATTR     0022
 /* Following definition is reserved.
  * Actually used in libltfs for handling periodic sync
 #define REQ_SYNC        fffe
 */
 
+/* Helpers shared by the path-based frontend (ltfs_fuse.c) and the inode-based one (ltfs_fuse_ll.c) */
+void *_ltfs_fuse_setup(struct ltfs_fuse_data *priv);
+void ltfs_fuse_umount(void *userdata);
+int _ltfs_fuse_statfs(struct statvfs *buf, struct ltfs_fuse_data *priv);
+void _ltfs_fuse_attr_to_stat(struct stat *stbuf, const struct dentry_attr *attr, uid_t uid,
+	gid_t gid, struct ltfs_fuse_data *priv);
+#if FUSE_VERSION >= 29
+ssize_t _ltfs_fuse_bufvec_source(char *dst, size_t size, size_t pos, void *src);
+#endif
+
+/**
+ * Serve a mounted volume through the FUSE low-level interface, which addresses files by
+ * inode instead of by path. This replaces fuse_main() when the lowlevel option is given.
+ * @param args FUSE command line arguments.
+ * @param priv LTFS FUSE data, with the volume already mounted.
+ * @return 0 on success or 1 on error, like fuse_main().
+ */
+int ltfs_fuse_ll_main(struct fuse_args *args, struct ltfs_fuse_data *priv);
+
 #endif /* __ltfs_fuse_h__ */
@@ -0,0 +1,1201 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       ltfs_fuse_ll.c
+**
+** DESCRIPTION:     Implements the interface of LTFS with the FUSE low-level API.
+**
+**                  The path-based frontend in ltfs_fuse.c resolves the path of every
+**                  request again. Here the kernel addresses files by inode number,
+**                  and each inode number is the address of a dentry holding one
+**                  reference for every lookup the kernel has not forgotten yet. So
+**                  most requests reach their dentry without any lookup, and open
+**                  handles need no table of open files.
+**
+**                  Operations which libltfs only offers by path (namespace changes,
+**                  symbolic links and extended attributes) rebuild the path from the
+**                  parent dentry.
+**
+*************************************************************************************
+*/
+#include <limits.h>
+#include "ltfs_fuse.h"
+#include <fuse_lowlevel.h>
+#include "libltfs/ltfs_fsops.h"
+#include "libltfs/fs.h"
+#include "libltfs/pathname.h"
+#include "libltfs/arch/time_internal.h"
+#include "libltfs/arch/errormap.h"
+
+#define FUSE_REQ_ENTER(r)   REQ_NUMBER(REQ_STAT_ENTER, REQ_FUSE, r)
+#define FUSE_REQ_EXIT(r)    REQ_NUMBER(REQ_STAT_EXIT,  REQ_FUSE, r)
+
+/* Same default as the high-level FUSE library uses for the path-based frontend */
+#define LTFS_LL_DEFAULT_TIMEOUT 1.0
+/* Entries and attributes may stay cached much longer when the kernel accepts invalidations */
+#define LTFS_LL_CACHE_TIMEOUT   3600.0
+
+/* "." and ".." take FUSE offsets 1 and 2, directory entries are shifted past them */
+#define LTFS_LL_DIR_OFFSET_BASE 2
+
+/**
+ * Open file or directory handle. The handle holds its own reference to the dentry.
+ */
+struct ltfs_ll_handle {
+	struct dentry *d;                  /**< Open file or directory */
+	bool open_write;                   /**< True if opened for writing */
+	bool dirty;                        /**< True if this handle has been written but not synced */
+	bool write_index;                  /**< True if an index should be written once this handle is closed */
+	struct ltfs_dir_cursor dir_cursor; /**< Listing position of a directory handle */
+	ltfs_mutex_t lock;
+};
+
+/**
+ * Output buffer of a readdir request.
+ */
+struct ltfs_ll_dirbuf {
+	fuse_req_t req;
+	char *buf;
+	size_t size;
+	size_t used;
+};
+
+#define FILEHANDLE_TO_LL(fh) ((struct ltfs_ll_handle *)(uintptr_t)(fh))
+#define LL_TO_FILEHANDLE(h)  ((uint64_t)(uintptr_t)(h))
+
+/* FUSE node IDs are dentry addresses, so that requests reach their dentry without a lookup.
+ * They never reach userspace: st_ino and d_ino are the dentry UIDs, as in the path-based
+ * frontend, since an address is reused once the kernel forgets its dentry. */
+static inline struct dentry *_ll_dentry(fuse_ino_t ino, struct ltfs_fuse_data *priv)
+{
+	if (ino == FUSE_ROOT_ID)
+		return priv->data->index->root;
+	return (struct dentry *)(uintptr_t)ino;
+}
+
+static inline fuse_ino_t _ll_ino(struct dentry *d, struct ltfs_fuse_data *priv)
+{
+	if (d == priv->data->index->root)
+		return FUSE_ROOT_ID;
+	return (fuse_ino_t)(uintptr_t)d;
+}
+
+static inline void _ll_reply_err(fuse_req_t req, int ret)
+{
+	fuse_reply_err(req, -errormap_fuse_error(ret));
+}
+
+static struct ltfs_ll_handle *_ll_new_handle(struct dentry *d, bool open_write)
+{
+	int ret;
+	struct ltfs_ll_handle *h = calloc(1, sizeof(struct ltfs_ll_handle));
+	if (! h) {
+		ltfsmsg(LTFS_ERR, 10001E, "_ll_new_handle");
+		return NULL;
+	}
+	ret = ltfs_mutex_init(&h->lock);
+	if (ret) {
+		ltfsmsg(LTFS_ERR, 10002E, ret);
+		free(h);
+		return NULL;
+	}
+	h->d = d;
+	h->open_write = open_write;
+	return h;
+}
+
+static void _ll_free_handle(struct ltfs_ll_handle *h)
+{
+	if (h) {
+		ltfs_mutex_destroy(&h->lock);
+		free(h);
+	}
+}
+
+/**
+ * Build the path of a dentry, or of a name inside a directory dentry, for the operations
+ * which libltfs only offers by path.
+ * @param ino Inode of the dentry.
+ * @param name Name inside the directory, or NULL for the path of the dentry itself.
+ * @param path On success, points to a newly allocated path.
+ * @return 0 on success or a negative value on error.
+ */
+static int _ll_path(fuse_ino_t ino, const char *name, char **path, struct ltfs_fuse_data *priv)
+{
+	int ret;
+	char *dir_path;
+
+	ret = fs_dentry_lookup(_ll_dentry(ino, priv), &dir_path);
+	if (ret < 0 || ! name) {
+		*path = ret < 0 ? NULL : dir_path;
+		return ret;
+	}
+
+	ret = asprintf(path, "%s/%s", strcmp(dir_path, "/") ? dir_path : "", name);
+	free(dir_path);
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 10001E, "_ll_path");
+		return -LTFS_NO_MEMORY;
+	}
+	return 0;
+}
+
+/**
+ * Fill in the reply to a request which creates a kernel reference to a dentry. On error
+ * the reference passed in is dropped.
+ */
+static int _ll_fill_entry(fuse_req_t req, struct dentry *d, struct fuse_entry_param *e,
+	struct ltfs_fuse_data *priv)
+{
+	const struct fuse_ctx *ctx = fuse_req_ctx(req);
+	struct dentry_attr attr;
+	int ret;
+
+	ret = ltfs_fsops_getattr(d, &attr, priv->data);
+	if (ret < 0) {
+		ltfs_fsops_forget(d, 1);
+		return ret;
+	}
+
+	memset(e, 0, sizeof(*e));
+	e->ino = _ll_ino(d, priv);
+	/* Dentry addresses are reused once the kernel forgets them, UIDs are not */
+	e->generation = attr.uid;
+	e->attr_timeout = priv->ll_cache_timeout;
+	e->entry_timeout = priv->ll_cache_timeout;
+	_ltfs_fuse_attr_to_stat(&e->attr, &attr, ctx->uid, ctx->gid, priv);
+	return 0;
+}
+
+/**
+ * Take the kernel reference for an entry which has just been created by path.
+ */
+static int _ll_lookup_created(fuse_req_t req, fuse_ino_t parent, const char *name,
+	struct fuse_entry_param *e, struct ltfs_fuse_data *priv)
+{
+	struct dentry *d;
+	int ret;
+
+	ret = ltfs_fsops_lookup(_ll_dentry(parent, priv), name, &d, priv->data);
+	if (ret < 0)
+		return ret;
+	return _ll_fill_entry(req, d, e, priv);
+}
+
+static void _ll_set_cache_flags(struct fuse_file_info *fi, bool open_write)
+{
+#ifdef __APPLE__
+	fi->direct_io  = 0;
+	fi->keep_cache = 0;
+#else
+#if FUSE_VERSION <= 27
+	/* for FUSE <= 2.7, set direct_io when opening for write */
+	fi->direct_io = open_write ? 1 : 0;
+	fi->keep_cache = 0;
+#else
+	fi->direct_io = 0;
+	fi->keep_cache = 1;
+#endif
+#endif
+}
+
+static bool _ll_open_write(struct fuse_file_info *fi)
+{
+	return ((fi->flags & O_WRONLY) == O_WRONLY) || ((fi->flags & O_RDWR) == O_RDWR);
+}
+
+/**
+ * Drop the attributes the kernel cached for a dentry which libltfs changed on its own,
+ * e.g. when the I/O scheduler flushed data or the volume was revalidated.
+ */
+static void _ll_notify_dentry(struct dentry *d, void *data)
+{
+	struct ltfs_fuse_data *priv = data;
+
+	/* A negative offset invalidates the attributes only, the page cache is left alone */
+	fuse_lowlevel_notify_inval_inode(priv->ll_chan, _ll_ino(d, priv), -1, 0);
+}
+
+static void ltfs_ll_init(void *userdata, struct fuse_conn_info *conn)
+{
+	struct ltfs_fuse_data *priv = userdata;
+
+#if FUSE_VERSION >= 29
+	/* Let the kernel splice write payloads into a pipe, see ltfs_ll_write_buf */
+	if (conn->capable & FUSE_CAP_SPLICE_READ)
+		conn->want |= FUSE_CAP_SPLICE_READ;
+#endif
+	_ltfs_fuse_setup(userdata);
+
+	/* Invalidation notifications need protocol 7.12. Without them cached attributes could
+	 * go stale behind the kernel's back, so keep the short default timeout. */
+	priv->ll_cache_timeout = LTFS_LL_DEFAULT_TIMEOUT;
+#if FUSE_VERSION >= 28
+	if (priv->ll_chan && (conn->proto_major > 7 || (conn->proto_major == 7 && conn->proto_minor >= 12))) {
+		priv->ll_cache_timeout = LTFS_LL_CACHE_TIMEOUT;
+		ltfs_set_dentry_notify(_ll_notify_dentry, priv, priv->data);
+	}
+#endif
+}
+
+static void ltfs_ll_destroy(void *userdata)
+{
+	struct ltfs_fuse_data *priv = userdata;
+
+	/* The channel goes away with the session */
+	ltfs_set_dentry_notify(NULL, NULL, priv->data);
+	ltfs_fuse_umount(userdata);
+}
+
+static void ltfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct fuse_entry_param e;
+	struct dentry *d;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_LOOKUP), 0, 0);
+
+	ltfsmsg(LTFS_DEBUG3, 14124D, name);
+
+	ret = ltfs_fsops_lookup(_ll_dentry(parent, priv), name, &d, priv->data);
+	if (ret == 0)
+		ret = _ll_fill_entry(req, d, &e, priv);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_LOOKUP), ret, ret == 0 ? e.attr.st_ino : 0);
+
+	if (ret < 0)
+		_ll_reply_err(req, ret);
+	else if (fuse_reply_entry(req, &e) < 0)
+		ltfs_fsops_forget(d, 1);
+}
+
+static void _ll_forget(fuse_ino_t ino, uint64_t nlookup, struct ltfs_fuse_data *priv)
+{
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_FORGET), nlookup, 0);
+
+	/* The root is never looked up, so the kernel holds no references to forget */
+	if (ino != FUSE_ROOT_ID)
+		ltfs_fsops_forget(_ll_dentry(ino, priv), nlookup);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_FORGET), 0, 0);
+}
+
+static void ltfs_ll_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup)
+{
+	_ll_forget(ino, nlookup, fuse_req_userdata(req));
+	fuse_reply_none(req);
+}
+
+#if FUSE_VERSION >= 29
+static void ltfs_ll_forget_multi(fuse_req_t req, size_t count, struct fuse_forget_data *forgets)
+{
+	size_t i;
+
+	for (i = 0; i < count; ++i)
+		_ll_forget(forgets[i].ino, forgets[i].nlookup, fuse_req_userdata(req));
+	fuse_reply_none(req);
+}
+#endif
+
+static int _ll_getattr(fuse_req_t req, struct dentry *d, struct stat *stbuf,
+	struct ltfs_fuse_data *priv)
+{
+	const struct fuse_ctx *ctx = fuse_req_ctx(req);
+	struct dentry_attr attr;
+	int ret;
+
+	ret = ltfs_fsops_getattr(d, &attr, priv->data);
+	if (ret == 0)
+		_ltfs_fuse_attr_to_stat(stbuf, &attr, ctx->uid, ctx->gid, priv);
+	return ret;
+}
+
+static void ltfs_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct stat stbuf;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_GETATTR), 0, 0);
+
+	ret = _ll_getattr(req, _ll_dentry(ino, priv), &stbuf, priv);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_GETATTR), ret, ret == 0 ? stbuf.st_ino : 0);
+
+	if (ret < 0)
+		_ll_reply_err(req, ret);
+	else
+		fuse_reply_attr(req, &stbuf, priv->ll_cache_timeout);
+}
+
+/**
+ * Change attributes of a file or directory. As in the path-based frontend, a mode change
+ * just sets or clears the read-only flag and ownership changes succeed without effect.
+ */
+static void ltfs_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr, int to_set,
+	struct fuse_file_info *fi)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct dentry *d = _ll_dentry(ino, priv);
+	struct ltfs_timespec ts[2];
+	struct dentry_attr cur;
+	struct stat stbuf;
+	int ret = 0;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_SETATTR), (uint64_t)to_set, 0);
+
+	if (to_set & FUSE_SET_ATTR_MODE)
+		ret = ltfs_fsops_set_readonly(d, (attr->st_mode & 0222) ? false : true, priv->data);
+
+	if (ret == 0 && (to_set & FUSE_SET_ATTR_SIZE))
+		ret = ltfs_fsops_truncate(d, attr->st_size, priv->data);
+
+	if (ret == 0 && (to_set & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME))) {
+		ret = ltfs_fsops_getattr(d, &cur, priv->data);
+		if (ret == 0) {
+			ts[0] = cur.access_time;
+			ts[1] = cur.modify_time;
+			if (to_set & FUSE_SET_ATTR_ATIME_NOW)
+				get_current_timespec(&ts[0]);
+			else if (to_set & FUSE_SET_ATTR_ATIME)
+				ts[0] = ltfs_timespec_from_timespec(&attr->st_atim);
+			if (to_set & FUSE_SET_ATTR_MTIME_NOW)
+				get_current_timespec(&ts[1]);
+			else if (to_set & FUSE_SET_ATTR_MTIME)
+				ts[1] = ltfs_timespec_from_timespec(&attr->st_mtim);
+			ret = ltfs_fsops_utimens(d, ts, priv->data);
+		}
+	}
+
+	if (ret == 0)
+		ret = _ll_getattr(req, d, &stbuf, priv);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_SETATTR), ret, ret == 0 ? stbuf.st_ino : 0);
+
+	if (ret < 0)
+		_ll_reply_err(req, ret);
+	else
+		fuse_reply_attr(req, &stbuf, priv->ll_cache_timeout);
+}
+
+static void ltfs_ll_access(fuse_req_t req, fuse_ino_t ino, int mask)
+{
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_ACCESS), 0, 0);
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_ACCESS), 0, 0);
+	fuse_reply_err(req, 0);
+}
+
+static void ltfs_ll_statfs(fuse_req_t req, fuse_ino_t ino)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct statvfs buf;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_STATFS), 0, 0);
+
+	memset(&buf, 0, sizeof(buf));
+	ret = _ltfs_fuse_statfs(&buf, priv);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_STATFS), ret, 0);
+
+	if (ret < 0)
+		_ll_reply_err(req, ret);
+	else
+		fuse_reply_statfs(req, &buf);
+}
+
+static void _ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi, bool isdir)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct dentry *d = _ll_dentry(ino, priv);
+	struct ltfs_ll_handle *h;
+	bool open_write = isdir ? false : _ll_open_write(fi);
+	int ret;
+
+	ltfs_request_trace((isdir ? FUSE_REQ_ENTER(REQ_OPENDIR) : FUSE_REQ_ENTER(REQ_OPEN)), (uint64_t)fi->flags, 0);
+
+	h = _ll_new_handle(d, open_write);
+	if (! h) {
+		ltfs_request_trace((isdir ? FUSE_REQ_EXIT(REQ_OPENDIR) : FUSE_REQ_EXIT(REQ_OPEN)), -ENOMEM, 0);
+		fuse_reply_err(req, ENOMEM);
+		return;
+	}
+
+	ret = ltfs_fsops_open_dentry(d, open_write, priv->data);
+	if (ret < 0) {
+		_ll_free_handle(h);
+		ltfs_request_trace((isdir ? FUSE_REQ_EXIT(REQ_OPENDIR) : FUSE_REQ_EXIT(REQ_OPEN)), ret, 0);
+		_ll_reply_err(req, ret);
+		return;
+	}
+
+	fi->fh = LL_TO_FILEHANDLE(h);
+	if (! isdir)
+		_ll_set_cache_flags(fi, open_write);
+
+	ltfs_request_trace((isdir ? FUSE_REQ_EXIT(REQ_OPENDIR) : FUSE_REQ_EXIT(REQ_OPEN)), 0, d->uid);
+
+	/* The open was interrupted, nobody will release the handle */
+	if (fuse_reply_open(req, fi) < 0) {
+		ltfs_fsops_close(d, false, open_write, ! isdir, priv->data);
+		_ll_free_handle(h);
+	}
+}
+
+static void ltfs_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+	_ll_open(req, ino, fi, false);
+}
+
+static void ltfs_ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+	_ll_open(req, ino, fi, true);
+}
+
+static void ltfs_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct ltfs_ll_handle *h = FILEHANDLE_TO_LL(fi->fh);
+	uint64_t uid = h->d->uid;
+	bool dirty, write_index;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_RELEASE), 0, 0);
+
+	ltfs_mutex_lock(&h->lock);
+	dirty = h->dirty;
+	write_index = (priv->sync_type == LTFS_SYNC_CLOSE) ? h->write_index : false;
+	ltfs_mutex_unlock(&h->lock);
+
+	ret = ltfs_fsops_close(h->d, dirty, h->open_write, true, priv->data);
+	if (write_index)
+		ltfs_sync_index(SYNC_CLOSE, true, priv->data);
+
+	_ll_free_handle(h);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_RELEASE), ret, uid);
+
+	_ll_reply_err(req, ret);
+}
+
+static void ltfs_ll_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct ltfs_ll_handle *h = FILEHANDLE_TO_LL(fi->fh);
+	uint64_t uid = h->d->uid;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_RELEASEDIR), 0, 0);
+
+	ret = ltfs_fsops_close(h->d, false, false, false, priv->data);
+	_ll_free_handle(h);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_RELEASEDIR), ret, uid);
+
+	_ll_reply_err(req, ret);
+}
+
+static void ltfs_ll_fsyncdir(fuse_req_t req, fuse_ino_t ino, int datasync,
+	struct fuse_file_info *fi)
+{
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_FSYNCDIR), 0, 0);
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_FSYNCDIR), 0, 0);
+	fuse_reply_err(req, 0);
+}
+
+static int _ll_do_flush(struct ltfs_ll_handle *h, struct ltfs_fuse_data *priv, const char *caller)
+{
+	bool dirty;
+	int ret = 0;
+
+	ltfs_mutex_lock(&h->lock);
+	dirty = h->dirty;
+	ltfs_mutex_unlock(&h->lock);
+
+	if (dirty) {
+		ret = ltfs_fsops_flush(h->d, false, priv->data);
+		if (ret < 0)
+			ltfsmsg(LTFS_ERR, 14022E, caller);
+		else {
+			ltfs_mutex_lock(&h->lock);
+			h->dirty = false;
+			ltfs_mutex_unlock(&h->lock);
+		}
+	}
+
+	return ret;
+}
+
+static void ltfs_ll_fsync(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi)
+{
+	struct ltfs_ll_handle *h = FILEHANDLE_TO_LL(fi->fh);
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_FSYNC), (uint64_t)datasync, 0);
+
+	ret = _ll_do_flush(h, fuse_req_userdata(req), __FUNCTION__);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_FSYNC), ret, h->d->uid);
+
+	_ll_reply_err(req, ret);
+}
+
+static void ltfs_ll_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+	struct ltfs_ll_handle *h = FILEHANDLE_TO_LL(fi->fh);
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_FLUSH), 0, 0);
+
+	ret = _ll_do_flush(h, fuse_req_userdata(req), __FUNCTION__);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_FLUSH), ret, h->d->uid);
+
+	_ll_reply_err(req, ret);
+}
+
+static void ltfs_ll_create(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode,
+	struct fuse_file_info *fi)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct fuse_entry_param e;
+	struct ltfs_ll_handle *h = NULL;
+	struct dentry *d = NULL;
+	char *path = NULL;
+	bool readonly, overwrite;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_CREATE), (uint64_t)fi->flags, 0);
+
+	readonly = ! (mode & priv->file_mode & 0222);
+	overwrite = ((!(fi->flags & O_RDONLY) && !(fi->flags & O_APPEND) && !(fi->flags & O_NONBLOCK)) || (fi->flags & O_TRUNC));
+
+	ret = _ll_path(parent, name, &path, priv);
+	if (ret == 0) {
+		ltfsmsg(LTFS_DEBUG, 14040D, path);
+		h = _ll_new_handle(NULL, _ll_open_write(fi));
+		if (! h)
+			ret = -LTFS_NO_MEMORY;
+	}
+	if (ret == 0)
+		ret = ltfs_fsops_create(path, false, readonly, overwrite, &d, priv->data);
+	if (ret == 0) {
+		ret = _ll_lookup_created(req, parent, name, &e, priv);
+		if (ret < 0)
+			ltfs_fsops_close(d, false, h->open_write, true, priv->data);
+	}
+	free(path);
+
+	if (ret < 0) {
+		_ll_free_handle(h);
+		ltfs_request_trace(FUSE_REQ_EXIT(REQ_CREATE), ret, 0);
+		_ll_reply_err(req, ret);
+		return;
+	}
+
+	h->d = d;
+	fi->fh = LL_TO_FILEHANDLE(h);
+	_ll_set_cache_flags(fi, true);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_CREATE), 0, d->uid);
+
+	if (fuse_reply_create(req, &e, fi) < 0) {
+		ltfs_fsops_forget(d, 1);
+		ltfs_fsops_close(d, false, h->open_write, true, priv->data);
+		_ll_free_handle(h);
+	}
+}
+
+static void ltfs_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct fuse_entry_param e;
+	struct dentry *d;
+	char *path;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_MKDIR), (uint64_t)mode, 0);
+
+	ret = _ll_path(parent, name, &path, priv);
+	if (ret == 0) {
+		ltfsmsg(LTFS_DEBUG, 14041D, path);
+		ret = ltfs_fsops_create(path, true, false, false, &d, priv->data);
+		free(path);
+	}
+	if (ret == 0) {
+		ltfs_fsops_close(d, false, false, false, priv->data);
+		ret = _ll_lookup_created(req, parent, name, &e, priv);
+	}
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_MKDIR), ret, ret == 0 ? e.attr.st_ino : 0);
+
+	if (ret < 0)
+		_ll_reply_err(req, ret);
+	else if (fuse_reply_entry(req, &e) < 0)
+		ltfs_fsops_forget(_ll_dentry(e.ino, priv), 1);
+}
+
+static void _ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name, bool isdir)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	ltfs_file_id id;
+	char *path;
+	int ret;
+
+	ltfs_request_trace((isdir ? FUSE_REQ_ENTER(REQ_RMDIR) : FUSE_REQ_ENTER(REQ_UNLINK)), 0, 0);
+
+	id.uid = 0;
+	ret = _ll_path(parent, name, &path, priv);
+	if (ret == 0) {
+		ltfsmsg(LTFS_DEBUG, isdir ? 14045D : 14044D, path);
+		ret = ltfs_fsops_unlink(path, &id, priv->data);
+		free(path);
+	}
+
+	ltfs_request_trace((isdir ? FUSE_REQ_EXIT(REQ_RMDIR) : FUSE_REQ_EXIT(REQ_UNLINK)), ret, id.uid);
+
+	_ll_reply_err(req, ret);
+}
+
+static void ltfs_ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+	_ll_unlink(req, parent, name, false);
+}
+
+static void ltfs_ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+	_ll_unlink(req, parent, name, true);
+}
+
+static void ltfs_ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+	fuse_ino_t newparent, const char *newname)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	char *from = NULL, *to = NULL;
+	ltfs_file_id id;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_RENAME), 0, 0);
+
+	id.uid = 0;
+	ret = _ll_path(parent, name, &from, priv);
+	if (ret == 0)
+		ret = _ll_path(newparent, newname, &to, priv);
+	if (ret == 0) {
+		ltfsmsg(LTFS_DEBUG, 14046D, from, to);
+		ret = ltfs_fsops_rename(from, to, &id, priv->data);
+	}
+	free(from);
+	free(to);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_RENAME), ret, id.uid);
+
+	_ll_reply_err(req, ret);
+}
+
+static void ltfs_ll_symlink(fuse_req_t req, const char *link, fuse_ino_t parent,
+	const char *name)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct fuse_entry_param e;
+	ltfs_file_id id;
+	char *path;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_SYMLINK), 0, 0);
+
+	ret = _ll_path(parent, name, &path, priv);
+	if (ret == 0) {
+		ret = ltfs_fsops_symlink_path(link, path, &id, priv->data);
+		free(path);
+	}
+	if (ret == 0)
+		ret = _ll_lookup_created(req, parent, name, &e, priv);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_SYMLINK), ret, ret == 0 ? e.attr.st_ino : 0);
+
+	if (ret < 0)
+		_ll_reply_err(req, ret);
+	else if (fuse_reply_entry(req, &e) < 0)
+		ltfs_fsops_forget(_ll_dentry(e.ino, priv), 1);
+}
+
+static void ltfs_ll_readlink(fuse_req_t req, fuse_ino_t ino)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	char buf[PATH_MAX + 1];
+	ltfs_file_id id;
+	char *path;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_READLINK), 0, 0);
+
+	id.uid = 0;
+	ret = _ll_path(ino, NULL, &path, priv);
+	if (ret == 0) {
+		ret = ltfs_fsops_readlink_path(path, buf, sizeof(buf), &id, priv->data);
+		free(path);
+	}
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_READLINK), ret, id.uid);
+
+	if (ret < 0)
+		_ll_reply_err(req, ret);
+	else
+		fuse_reply_readlink(req, buf);
+}
+
+/**
+ * Add an entry to a readdir reply.
+ * @param type File type bits (S_IFDIR, ...) reported to the kernel, or 0 if unknown.
+ * @return 0 on success, or 1 if the buffer is full.
+ */
+static int _ll_add_direntry(struct ltfs_ll_dirbuf *dirbuf, const char *name, uint64_t ino,
+	mode_t type, off_t offset)
+{
+	struct stat stbuf;
+	size_t len;
+
+	memset(&stbuf, 0, sizeof(stbuf));
+	stbuf.st_ino = ino;
+	stbuf.st_mode = type;
+
+	len = fuse_add_direntry(dirbuf->req, dirbuf->buf + dirbuf->used, dirbuf->size - dirbuf->used,
+		name, &stbuf, offset);
+	if (len > dirbuf->size - dirbuf->used)
+		return 1;
+	dirbuf->used += len;
+	return 0;
+}
+
+static int _ll_filldir(void *buf, const char *name, uint64_t offset,
+	const struct dentry_attr *attr, void *priv)
+{
+	int ret;
+	mode_t type = 0;
+#ifdef __APPLE__
+	char *new_name;
+
+	ret = pathname_nfd_normalize(name, &new_name);
+	if (ret < 0) {
+		ltfsmsg(LTFS_ERR, 14027E, "nfd", ret);
+		return ret;
+	}
+	name = new_name;
+#endif
+
+	/* FUSE 2 has no READDIRPLUS, but the entry type still spares type-only scans a lookup */
+	if (attr)
+		type = attr->isslink ? S_IFLNK : (attr->isdir ? S_IFDIR : S_IFREG);
+
+	/* Entry offsets are the UIDs, which are also the inode numbers. When the buffer is
+	 * full, the entry is returned again by the next call. */
+	ret = _ll_add_direntry(buf, name, attr ? attr->uid : offset, type,
+		offset + LTFS_LL_DIR_OFFSET_BASE);
+
+#ifdef __APPLE__
+	free(new_name);
+#endif
+	return ret;
+}
+
+static void ltfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset,
+	struct fuse_file_info *fi)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct ltfs_ll_handle *h = FILEHANDLE_TO_LL(fi->fh);
+	struct ltfs_ll_dirbuf dirbuf;
+	uint64_t parent_uid;
+	int ret = 0;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_READDIR), (uint64_t)offset, 0);
+
+	dirbuf.req = req;
+	dirbuf.size = size;
+	dirbuf.used = 0;
+	dirbuf.buf = malloc(size);
+	if (! dirbuf.buf) {
+		ltfsmsg(LTFS_ERR, 10001E, "ltfs_ll_readdir");
+		ltfs_request_trace(FUSE_REQ_EXIT(REQ_READDIR), -ENOMEM, h->d->uid);
+		fuse_reply_err(req, ENOMEM);
+		return;
+	}
+
+	if (offset < 1)
+		ret = _ll_add_direntry(&dirbuf, ".", h->d->uid, S_IFDIR, 1);
+	if (ret == 0 && offset < 2) {
+		ret = ltfs_fsops_parent_uid(h->d, &parent_uid, priv->data);
+		if (ret == 0)
+			ret = _ll_add_direntry(&dirbuf, "..", parent_uid, S_IFDIR, 2);
+	}
+
+	if (ret == 0) {
+		ltfs_mutex_lock(&h->lock);
+		ret = ltfs_fsops_readdir_plus(h->d, &h->dir_cursor,
+			offset > LTFS_LL_DIR_OFFSET_BASE ? offset - LTFS_LL_DIR_OFFSET_BASE : 0,
+			&dirbuf, _ll_filldir, NULL, priv->data);
+		ltfs_mutex_unlock(&h->lock);
+	} else if (ret > 0)
+		ret = 0;
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_READDIR), ret, h->d->uid);
+
+	if (ret < 0)
+		_ll_reply_err(req, ret);
+	else
+		fuse_reply_buf(req, dirbuf.buf, dirbuf.used);
+	free(dirbuf.buf);
+}
+
+static void _ll_write_done(fuse_req_t req, struct ltfs_ll_handle *h, size_t size, int ret)
+{
+	if (ret == 0) {
+		ltfs_mutex_lock(&h->lock);
+		h->dirty = true;
+		h->write_index = true;
+		ltfs_mutex_unlock(&h->lock);
+	}
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_WRITE), ret == 0 ? (uint64_t)size : (uint64_t)ret,
+		h->d->uid);
+
+	if (ret < 0)
+		_ll_reply_err(req, ret);
+	else
+		fuse_reply_write(req, size);
+}
+
+static void ltfs_ll_write(fuse_req_t req, fuse_ino_t ino, const char *buf, size_t size,
+	off_t offset, struct fuse_file_info *fi)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct ltfs_ll_handle *h = FILEHANDLE_TO_LL(fi->fh);
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_WRITE), (uint64_t)offset, (uint64_t)size);
+
+	ret = ltfs_fsops_write(h->d, buf, size, offset, true, priv->data);
+	_ll_write_done(req, h, size, ret);
+}
+
+#if FUSE_VERSION >= 29
+static void ltfs_ll_write_buf(fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec *bufv,
+	off_t offset, struct fuse_file_info *fi)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct ltfs_ll_handle *h = FILEHANDLE_TO_LL(fi->fh);
+	size_t size = fuse_buf_size(bufv);
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_WRITE), (uint64_t)offset, (uint64_t)size);
+
+	ret = ltfs_fsops_write_source(h->d, _ltfs_fuse_bufvec_source, bufv, size, offset, true,
+		priv->data);
+	_ll_write_done(req, h, size, ret);
+}
+#endif
+
+static void ltfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset,
+	struct fuse_file_info *fi)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	struct ltfs_ll_handle *h = FILEHANDLE_TO_LL(fi->fh);
+	ssize_t ret;
+	char *buf;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_READ), (uint64_t)offset, (uint64_t)size);
+
+	buf = malloc(size);
+	if (! buf) {
+		ltfsmsg(LTFS_ERR, 10001E, "ltfs_ll_read");
+		ret = -LTFS_NO_MEMORY;
+	} else
+		ret = ltfs_fsops_read(h->d, buf, size, offset, priv->data);
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_READ), (uint64_t)ret, h->d->uid);
+
+	if (ret < 0)
+		_ll_reply_err(req, ret);
+	else
+		fuse_reply_buf(req, buf, ret);
+	free(buf);
+}
+
+#ifdef __APPLE__
+static void ltfs_ll_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+	const char *value, size_t size, int flags, uint32_t position)
+#else
+static void ltfs_ll_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+	const char *value, size_t size, int flags)
+#endif /* __APPLE__ */
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	ltfs_file_id id;
+	char *path;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_SETXATTR), (uint64_t)size, 0);
+
+#ifdef __APPLE__
+	if (position) {
+		/* Position argument must be zero */
+		ltfsmsg(LTFS_ERR, 14023E);
+		ltfs_request_trace(FUSE_REQ_EXIT(REQ_SETXATTR), -EINVAL, 0);
+		fuse_reply_err(req, EINVAL);
+		return;
+	}
+#endif /* __APPLE__ */
+
+	id.uid = 0;
+	ret = _ll_path(ino, NULL, &path, priv);
+	if (ret == 0) {
+		ltfsmsg(LTFS_DEBUG3, 14050D, path, name, size);
+		ret = ltfs_fsops_setxattr(path, name, value, size, flags, &id, priv->data);
+		free(path);
+	}
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_SETXATTR), ret, id.uid);
+
+	_ll_reply_err(req, ret);
+}
+
+/**
+ * Reply to a getxattr or listxattr request. A zero size asks for the size of the value only.
+ */
+static void _ll_reply_xattr(fuse_req_t req, int ret, char *value, size_t size)
+{
+	if (ret < 0)
+		_ll_reply_err(req, ret);
+	else if (size == 0)
+		fuse_reply_xattr(req, ret);
+	else
+		fuse_reply_buf(req, value, ret);
+}
+
+#ifdef __APPLE__
+static void ltfs_ll_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name, size_t size,
+	uint32_t position)
+#else
+static void ltfs_ll_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name, size_t size)
+#endif /* __APPLE__ */
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	char *path, *value = NULL;
+	ltfs_file_id id;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_GETXATTR), (uint64_t)size, 0);
+
+#ifdef __APPLE__
+	if (position) {
+		/* Position argument must be zero */
+		ltfsmsg(LTFS_ERR, 14024E);
+		ltfs_request_trace(FUSE_REQ_EXIT(REQ_GETXATTR), -EINVAL, 0);
+		fuse_reply_err(req, EINVAL);
+		return;
+	}
+#else
+	/* Short-circuit requests for system EAs to avoid mounting the same unnecessarily in
+	 * library mode. */
+	if (strstr(name, "system.") == name || strstr(name, "security.") == name) {
+		ltfs_request_trace(FUSE_REQ_EXIT(REQ_GETXATTR), -LTFS_NO_XATTR, 0);
+		_ll_reply_err(req, -LTFS_NO_XATTR);
+		return;
+	}
+#endif /* __APPLE__ */
+
+	id.uid = 0;
+	if (size > 0) {
+		value = malloc(size);
+		if (! value) {
+			ltfsmsg(LTFS_ERR, 10001E, "ltfs_ll_getxattr");
+			ltfs_request_trace(FUSE_REQ_EXIT(REQ_GETXATTR), -ENOMEM, 0);
+			fuse_reply_err(req, ENOMEM);
+			return;
+		}
+	}
+
+	ret = _ll_path(ino, NULL, &path, priv);
+	if (ret == 0) {
+		ltfsmsg(LTFS_DEBUG3, 14051D, path, name);
+		ret = ltfs_fsops_getxattr(path, name, value, size, &id, priv->data);
+		free(path);
+	}
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_GETXATTR), ret, id.uid);
+
+	_ll_reply_xattr(req, ret, value, size);
+	free(value);
+}
+
+static void ltfs_ll_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	char *path, *list = NULL;
+	ltfs_file_id id;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_LISTXATTR), (uint64_t)size, 0);
+
+	id.uid = 0;
+	if (size > 0) {
+		list = malloc(size);
+		if (! list) {
+			ltfsmsg(LTFS_ERR, 10001E, "ltfs_ll_listxattr");
+			ltfs_request_trace(FUSE_REQ_EXIT(REQ_LISTXATTR), -ENOMEM, 0);
+			fuse_reply_err(req, ENOMEM);
+			return;
+		}
+	}
+
+	ret = _ll_path(ino, NULL, &path, priv);
+	if (ret == 0) {
+		ltfsmsg(LTFS_DEBUG, 14052D, path);
+		ret = ltfs_fsops_listxattr(path, list, size, &id, priv->data);
+		free(path);
+	}
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_LISTXATTR), ret, id.uid);
+
+	_ll_reply_xattr(req, ret, list, size);
+	free(list);
+}
+
+static void ltfs_ll_removexattr(fuse_req_t req, fuse_ino_t ino, const char *name)
+{
+	struct ltfs_fuse_data *priv = fuse_req_userdata(req);
+	ltfs_file_id id;
+	char *path;
+	int ret;
+
+	ltfs_request_trace(FUSE_REQ_ENTER(REQ_REMOVEXATTR), 0, 0);
+
+	id.uid = 0;
+	ret = _ll_path(ino, NULL, &path, priv);
+	if (ret == 0) {
+		ltfsmsg(LTFS_DEBUG, 14053D, path, name);
+		ret = ltfs_fsops_removexattr(path, name, &id, priv->data);
+		free(path);
+	}
+
+	ltfs_request_trace(FUSE_REQ_EXIT(REQ_REMOVEXATTR), ret, id.uid);
+
+	_ll_reply_err(req, ret);
+}
+
+struct fuse_lowlevel_ops ltfs_ll_ops = {
+	.init         = ltfs_ll_init,
+	.destroy      = ltfs_ll_destroy,
+	.lookup       = ltfs_ll_lookup,
+	.forget       = ltfs_ll_forget,
+	.getattr      = ltfs_ll_getattr,
+	.setattr      = ltfs_ll_setattr,
+	.readlink     = ltfs_ll_readlink,
+	.mkdir        = ltfs_ll_mkdir,
+	.unlink       = ltfs_ll_unlink,
+	.rmdir        = ltfs_ll_rmdir,
+	.symlink      = ltfs_ll_symlink,
+	.rename       = ltfs_ll_rename,
+	.open         = ltfs_ll_open,
+	.read         = ltfs_ll_read,
+	.write        = ltfs_ll_write,
+	.flush        = ltfs_ll_flush,
+	.release      = ltfs_ll_release,
+	.fsync        = ltfs_ll_fsync,
+	.opendir      = ltfs_ll_opendir,
+	.readdir      = ltfs_ll_readdir,
+	.releasedir   = ltfs_ll_releasedir,
+	.fsyncdir     = ltfs_ll_fsyncdir,
+	.statfs       = ltfs_ll_statfs,
+	.setxattr     = ltfs_ll_setxattr,
+	.getxattr     = ltfs_ll_getxattr,
+	.listxattr    = ltfs_ll_listxattr,
+	.removexattr  = ltfs_ll_removexattr,
+	.access       = ltfs_ll_access,
+	.create       = ltfs_ll_create,
+#if FUSE_VERSION >= 29
+	.forget_multi = ltfs_ll_forget_multi,
+	.write_buf    = ltfs_ll_write_buf,
+#endif
+};
+
+int ltfs_fuse_ll_main(struct fuse_args *args, struct ltfs_fuse_data *priv)
+{
+	struct fuse_session *se;
+	struct fuse_chan *ch;
+	char *mountpoint = NULL;
+	int multithreaded, foreground;
+	int ret = -1;
+
+	if (fuse_parse_cmdline(args, &mountpoint, &multithreaded, &foreground) < 0) {
+		ltfsmsg(LTFS_ERR, 14118E, "parse");
+		return 1;
+	}
+
+	ch = fuse_mount(mountpoint, args);
+	if (! ch) {
+		ltfsmsg(LTFS_ERR, 14118E, "mount");
+		free(mountpoint);
+		return 1;
+	}
+
+	priv->ll_chan = ch;
+	priv->ll_cache_timeout = LTFS_LL_DEFAULT_TIMEOUT;
+
+	se = fuse_lowlevel_new(args, &ltfs_ll_ops, sizeof(ltfs_ll_ops), priv);
+	if (! se) {
+		ltfsmsg(LTFS_ERR, 14118E, "session");
+		fuse_unmount(mountpoint, ch);
+		free(mountpoint);
+		return 1;
+	}
+
+	if (fuse_daemonize(foreground) == 0 && fuse_set_signal_handlers(se) == 0) {
+		fuse_session_add_chan(se, ch);
+		ret = multithreaded ? fuse_session_loop_mt(se) : fuse_session_loop(se);
+		fuse_remove_signal_handlers(se);
+		fuse_session_remove_chan(ch);
+	}
+
+	fuse_session_destroy(se);
+	fuse_unmount(mountpoint, ch);
+	free(mountpoint);
+
+	return ret ? 1 : 0;
+}
@@ -111,6 +111,7 @@ static struct fuse_opt ltfs_options[] = {
 	LTFS_OPT("tape_backend=%s",        tape_backend_name, 0),
 	LTFS_OPT("iosched_backend=%s",     iosched_backend_name, 0),
 	LTFS_OPT("kmi_backend=%s",         kmi_backend_name, 0),
+	LTFS_OPT("dcache_backend=%s",      dcache_backend_name, 0),
 	LTFS_OPT("umask=%s",               force_umask, 0),
 	LTFS_OPT("fmask=%s",               force_fmask, 0),
 	LTFS_OPT("dmask=%s",               force_dmask, 0),
@@ -127,6 +128,10 @@ static struct fuse_opt ltfs_options[] = {
 	LTFS_OPT("eject",                  eject, 1),
 	LTFS_OPT("noeject",                eject, 0),
 	LTFS_OPT("sync_type=%s",           sync_type_str, 0),
+	LTFS_OPT("sync_dirty_entries=%s",  str_sync_dirty_entries, 0),
+	LTFS_OPT("sync_dirty_size=%s",     str_sync_dirty_size, 0),
+	LTFS_OPT("sync_cost_ratio=%s",     str_sync_cost_ratio, 0),
+	LTFS_OPT("sync_stream_defer=%s",   str_sync_stream_defer, 0),
 	LTFS_OPT("force_mount_no_eod",     skip_eod_check, 1),
 	LTFS_OPT("device_list",            device_list, 1),
 	LTFS_OPT("rollback_mount=%s",      rollback_str, 0),
@@ -134,6 +139,10 @@ static struct fuse_opt ltfs_options[] = {
 	LTFS_OPT("allow_other",            allow_other, 1),
 	LTFS_OPT("noallow_other",          allow_other, 0),
 	LTFS_OPT("capture_index",          capture_index, 1),
+	LTFS_OPT("cached_index_mount",     cached_index_mount, 1),
+	LTFS_OPT("lazy_index",             lazy_index, 1),
+	LTFS_OPT("lazy_index_limit=%s",    str_lazy_index_limit, 0),
+	LTFS_OPT("lowlevel",               lowlevel, 1),
 	LTFS_OPT("symlink_type=%s",        symlink_str, 0),
 	LTFS_OPT("scsi_append_only_mode=%s", str_append_only_mode, 0),
 	LTFS_OPT_KEY("-a",                 KEY_ADVANCED_HELP),
@@ -168,11 +177,20 @@ void single_drive_advanced_usage(const char *default_driver, struct ltfs_fuse_da
 	ltfsresult(14425I); /* -o eject */
 	ltfsresult(14439I); /* -o noeject */
 	ltfsresult(14427I, LONG_MAX / 60); /* -o sync_type=type */
+	ltfsresult(14474I, (unsigned long long)LTFS_SYNC_DIRTY_ENTRIES_DEFAULT); /* -o sync_dirty_entries=<num> */
+	ltfsresult(14475I, (unsigned long long)LTFS_SYNC_DIRTY_SIZE_DEFAULT); /* -o sync_dirty_size=<num> */
+	ltfsresult(14476I, (unsigned long long)LTFS_SYNC_COST_RATIO_DEFAULT); /* -o sync_cost_ratio=<num> */
+	ltfsresult(14477I, (unsigned long long)LTFS_SYNC_STREAM_DEFER_DEFAULT); /* -o sync_stream_defer=<sec> */
 	ltfsresult(14443I); /* -o force_mount_no_eod */
 	ltfsresult(14436I); /* -o device_list */
 	ltfsresult(14437I); /* -o rollback_mount */
 	ltfsresult(14448I); /* -o release_device */
 	ltfsresult(14456I); /* -o capture_index */
+	ltfsresult(14469I); /* -o cached_index_mount */
+	ltfsresult(14470I); /* -o lazy_index */
+	ltfsresult(14471I, (unsigned long long)INDEX_SPILL_DEFAULT_LIMIT); /* -o lazy_index_limit=<num> */
+	ltfsresult(14472I); /* -o lowlevel */
+	ltfsresult(14473I, config_file_get_default_plugin("dcache", priv->config)); /* -o dcache_backend=<name> */
 	ltfsresult(14463I); /* -o scsi_append_only_mode=<on|off> */
 	ltfsresult(14406I); /* -a */
 	/* TODO: future use for WORM */
@@ -469,10 +487,44 @@ static int create_workdir(struct ltfs_fuse_data *priv)
 	return 0;
 }
 
+/**
+ * Parse a periodic sync threshold between 0 and max.
+ * @return 0 on success, 1 if the value is invalid.
+ */
+static int parse_sync_threshold(const char *name, const char *str, uint64_t def, uint64_t max,
+	uint64_t *val)
+{
+	char *invalid_start;
+
+	if (! str) {
+		*val = def;
+		return 0;
+	}
+
+	errno = 0;
+	*val = strtoull(str, &invalid_start, 10);
+	if (errno || *invalid_start != '\0' || str[0] == '\0' || str[0] == '-' || *val > max) {
+		ltfsmsg(LTFS_ERR, 14129E, name, str);
+		return 1;
+	}
+	return 0;
+}
+
 int validate_sync_option(struct ltfs_fuse_data *priv)
 {
 	char *sync_time_str, *end_time_str;
 
+	/* Thresholds of the periodic sync */
+	if (parse_sync_threshold("sync_dirty_entries", priv->str_sync_dirty_entries,
+			LTFS_SYNC_DIRTY_ENTRIES_DEFAULT, UINT64_MAX, &priv->sync_dirty_entries)
+		|| parse_sync_threshold("sync_dirty_size", priv->str_sync_dirty_size,
+			LTFS_SYNC_DIRTY_SIZE_DEFAULT, UINT64_MAX >> 20, &priv->sync_dirty_size)
+		|| parse_sync_threshold("sync_cost_ratio", priv->str_sync_cost_ratio,
+			LTFS_SYNC_COST_RATIO_DEFAULT, INT_MAX, &priv->sync_cost_ratio)
+		|| parse_sync_threshold("sync_stream_defer", priv->str_sync_stream_defer,
+			LTFS_SYNC_STREAM_DEFER_DEFAULT, INT_MAX, &priv->sync_stream_defer))
+		return 1;
+
 	/* Search time description and devide option string*/
 	if (priv->sync_type_str) {
 		priv->sync_time = -1;
@@ -746,12 +798,15 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/* Unlink objects from the file system instead of having them renamed to .fuse_hidden */
-	ret = fuse_opt_add_arg(&args, "-ohard_remove");
-	if (ret < 0) {
-		/* Could not enable FUSE option */
-		ltfsmsg(LTFS_ERR, 14001E, "hard_remove", ret);
-		return 1;
+	/* Unlink objects from the file system instead of having them renamed to .fuse_hidden.
+	 * The low-level interface always does, as open handles keep their dentries alive. */
+	if (! priv->lowlevel) {
+		ret = fuse_opt_add_arg(&args, "-ohard_remove");
+		if (ret < 0) {
+			/* Could not enable FUSE option */
+			ltfsmsg(LTFS_ERR, 14001E, "hard_remove", ret);
+			return 1;
+		}
 	}
 
 	/* perform reads synchronously */
@@ -823,6 +878,15 @@ int main(int argc, char **argv)
 		priv->kmi_backend_name = config_file_get_default_plugin("kmi", priv->config);
 	if (priv->kmi_backend_name && strcmp(priv->kmi_backend_name, "none") == 0)
 		priv->kmi_backend_name = NULL;
+	if (priv->dcache_backend_name == NULL)
+		priv->dcache_backend_name = config_file_get_default_plugin("dcache", priv->config);
+	if (priv->dcache_backend_name && strcmp(priv->dcache_backend_name, "none") == 0)
+		priv->dcache_backend_name = NULL;
+	if (priv->dcache_backend_name && priv->lowlevel) {
+		/* The low-level frontend keeps dentries referenced by inode, which the cache does not allow */
+		ltfsmsg(LTFS_WARN, 14126W);
+		priv->dcache_backend_name = NULL;
+	}
 	if (priv->work_directory == NULL || ! strcmp(priv->work_directory, ""))
 		priv->work_directory = LTFS_DEFAULT_WORK_DIR;
 	if (priv->force_min_pool) {
@@ -874,6 +938,14 @@ int main(int argc, char **argv)
 			return 1;
 		}
 	}
+	if (priv->dcache_backend_name) {
+		ret = plugin_load(&priv->dcache_plugin, "dcache", priv->dcache_backend_name,
+			priv->config);
+		if (ret < 0) {
+			ltfsmsg(LTFS_ERR, 14125E, ret);
+			return 1;
+		}
+	}
 
 	/* Make sure we have a device name */
 	if (! priv->devname) {
@@ -908,6 +980,8 @@ int main(int argc, char **argv)
 		plugin_unload(&priv->iosched_plugin);
 	if (priv->kmi_backend_name)
 		plugin_unload(&priv->kmi_plugin);
+	if (priv->dcache_backend_name)
+		plugin_unload(&priv->dcache_plugin);
 	plugin_unload(&priv->tape_plugin);
 
 	/* Free data structures */
@@ -951,6 +1025,18 @@ int single_drive_main(struct fuse_args *args, struct ltfs_fuse_data *priv)
 		}
 	}
 
+	/* Validate lazy_index_limit option */
+	if (priv->str_lazy_index_limit) {
+		errno = 0;
+		priv->lazy_index_limit = strtoull(priv->str_lazy_index_limit, &invalid_start, 10);
+		if (errno || *invalid_start != '\0' || priv->str_lazy_index_limit[0] == '\0'
+			|| priv->str_lazy_index_limit[0] == '-') {
+			ltfsmsg(LTFS_ERR, 14117E, priv->str_lazy_index_limit);
+			return 1;
+		}
+	} else
+		priv->lazy_index_limit = INDEX_SPILL_DEFAULT_LIMIT;
+
 	/* Validate append_only_mode */
 	if (priv->str_append_only_mode) {
 		if (strcasecmp(priv->str_append_only_mode, "on") == 0)
@@ -972,8 +1058,8 @@ int single_drive_main(struct fuse_args *args, struct ltfs_fuse_data *priv)
 	}
 
 	/* If the local inode space is big enough, have FUSE pass through our UIDs as inode
-	 * numbers instead of generating its own. */
-	if (sizeof(ino_t) >= 8) {
+	 * numbers instead of generating its own. The low-level interface always does. */
+	if (sizeof(ino_t) >= 8 && ! priv->lowlevel) {
 		ret = fuse_opt_add_arg(args, "-ouse_ino");
 		if (ret < 0) {
 			/* Could not enable FUSE option */
@@ -1064,6 +1150,14 @@ int single_drive_main(struct fuse_args *args, struct ltfs_fuse_data *priv)
 		ltfs_set_eod_check(! priv->skip_eod_check, priv->data);
 	}
 
+	/* Check the index captured at the last unmount can be used at mount */
+	if (priv->cached_index_mount)
+		ltfs_set_cached_index_mount(true, priv->data);
+
+	/* Defer building directory contents until they are used */
+	if (priv->lazy_index)
+		ltfs_set_lazy_index(true, priv->lazy_index_limit, priv->data);
+
 	/* Validate symbolic link type */
 	priv->data->livelink = false;
 	if (priv->symlink_str) {
@@ -1243,7 +1337,10 @@ int single_drive_main(struct fuse_args *args, struct ltfs_fuse_data *priv)
 	ltfsmsg(LTFS_INFO, 14113I);
 	/* Set handlers for signals that need to be caught while fuse main is running*/
 	ltfs_extra_signal_handlers();
-	ret = fuse_main(args->argc, args->argv, &ltfs_ops, priv);
+	if (priv->lowlevel)
+		ret = ltfs_fuse_ll_main(args, priv);
+	else
+		ret = fuse_main(args->argc, args->argv, &ltfs_ops, priv);
 	if (ret != 0) {
 		ltfsmsg(LTFS_WARN, 14123W, ret);
 	}
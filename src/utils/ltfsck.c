@@ -1530,6 +1530,10 @@ int list_rollback_points(struct ltfs_volume *vol, struct other_check_opts *opt)
 {
 	int ret;
 
+	/* Only the volume name and a captured index need the directory tree */
+	if (! opt->full_index_info && ! opt->capture_index)
+		ltfs_set_traverse_header_only(true, vol);
+
 	if (opt->salvage_points) {
 		ret = list_rollback_points_no_eod(vol, opt);
 	}
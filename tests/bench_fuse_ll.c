@@ -0,0 +1,456 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       tests/bench_fuse_ll.c
+**
+** DESCRIPTION:     Compares create, stat, open and readdir rates of the path-based
+**                  and the low-level FUSE frontends, calling both operation tables
+**                  in process on the file backend. Also checks that the low-level
+**                  listings report the inode numbers stat reports.
+**
+**                  Usage: bench_fuse_ll <file backend directory> [files] [depth]
+**
+*************************************************************************************
+*/
+
+#include <fuse_lowlevel.h>
+
+#include "libltfs/ltfs.h"
+#include "libltfs/ltfs_fsops.h"
+#include "libltfs/config_file.h"
+#include "libltfs/plugin.h"
+#include "ltfs_fuse.h"
+#include "test_util.h"
+
+#define DEFAULT_FILES (20000)
+#define DEFAULT_DEPTH (3)
+#define DIR_BUFSIZE   (4096)
+#define READDIR_REPS  (20)
+
+extern struct fuse_operations ltfs_ops;
+extern struct fuse_lowlevel_ops ltfs_ll_ops;
+
+/* The operations are called in process, so requests and replies are recorded here instead of
+ * going through a FUSE session */
+struct fuse_req {
+	struct ltfs_fuse_data *priv;
+	struct fuse_ctx ctx;
+	int err;
+	struct fuse_entry_param e;
+	struct fuse_file_info fi;
+	struct stat attr;
+	int entries;
+	off_t last;
+	/* Inode numbers of ".", ".." and the first file, when listed */
+	ino_t dot, dotdot, first;
+};
+
+static struct fuse_context context;
+
+struct fuse_context *fuse_get_context(void)
+{
+	return &context;
+}
+
+void *fuse_req_userdata(fuse_req_t req)
+{
+	return req->priv;
+}
+
+const struct fuse_ctx *fuse_req_ctx(fuse_req_t req)
+{
+	return &req->ctx;
+}
+
+int fuse_reply_err(fuse_req_t req, int err)
+{
+	req->err = err;
+	return 0;
+}
+
+void fuse_reply_none(fuse_req_t req)
+{
+}
+
+int fuse_reply_entry(fuse_req_t req, const struct fuse_entry_param *e)
+{
+	req->err = 0;
+	req->e = *e;
+	return 0;
+}
+
+int fuse_reply_create(fuse_req_t req, const struct fuse_entry_param *e,
+	const struct fuse_file_info *fi)
+{
+	req->err = 0;
+	req->e = *e;
+	req->fi = *fi;
+	return 0;
+}
+
+int fuse_reply_attr(fuse_req_t req, const struct stat *attr, double attr_timeout)
+{
+	req->err = 0;
+	req->attr = *attr;
+	return 0;
+}
+
+int fuse_reply_open(fuse_req_t req, const struct fuse_file_info *fi)
+{
+	req->err = 0;
+	req->fi = *fi;
+	return 0;
+}
+
+int fuse_reply_buf(fuse_req_t req, const char *buf, size_t size)
+{
+	req->err = 0;
+	return 0;
+}
+
+int fuse_reply_write(fuse_req_t req, size_t count)
+{
+	req->err = 0;
+	return 0;
+}
+
+/* Entry size as the FUSE library computes it */
+static size_t direntry_size(const char *name)
+{
+	return (24 + strlen(name) + 7) & ~(size_t)7;
+}
+
+size_t fuse_add_direntry(fuse_req_t req, char *buf, size_t bufsize, const char *name,
+	const struct stat *stbuf, off_t off)
+{
+	size_t len = direntry_size(name);
+
+	if (len <= bufsize) {
+		if (! strcmp(name, "."))
+			req->dot = stbuf->st_ino;
+		else if (! strcmp(name, ".."))
+			req->dotdot = stbuf->st_ino;
+		else if (! req->first)
+			req->first = stbuf->st_ino;
+		++req->entries;
+		req->last = off;
+	}
+	return len;
+}
+
+struct hl_dirbuf {
+	size_t used;
+	int entries;
+	off_t last;
+};
+
+static int hl_filldir(void *buf, const char *name, const struct stat *stbuf, off_t off)
+{
+	struct hl_dirbuf *b = buf;
+	size_t len = direntry_size(name);
+
+	if (b->used + len > DIR_BUFSIZE)
+		return 1;
+	b->used += len;
+	++b->entries;
+	b->last = off;
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void init_req(struct fuse_req *req, struct ltfs_fuse_data *priv)
+{
+	memset(req, 0, sizeof(*req));
+	req->priv = priv;
+}
+
+static int make_dir(const char *path, struct ltfs_volume *vol)
+{
+	int ret;
+	struct dentry *d;
+
+	ret = ltfs_fsops_create(path, true, false, false, &d, vol);
+	if (ret == 0)
+		ltfs_fsops_close(d, false, false, false, vol);
+	return ret;
+}
+
+/* Check that the inode numbers the low-level frontend lists for a directory match the ones
+ * stat reports for the directory, its parent and its first file */
+static void check_inodes(struct ltfs_fuse_data *priv, fuse_ino_t parent, fuse_ino_t dir,
+	const char *first)
+{
+	struct fuse_req req;
+	struct fuse_file_info fi;
+	ino_t parent_ino, dir_ino;
+
+	init_req(&req, priv);
+	ltfs_ll_ops.getattr(&req, parent, NULL);
+	parent_ino = req.attr.st_ino;
+	ltfs_ll_ops.getattr(&req, dir, NULL);
+	dir_ino = req.attr.st_ino;
+
+	memset(&fi, 0, sizeof(fi));
+	ltfs_ll_ops.opendir(&req, dir, &fi);
+	fi = req.fi;
+	ltfs_ll_ops.readdir(&req, dir, DIR_BUFSIZE, 0, &fi);
+	ltfs_ll_ops.releasedir(&req, dir, &fi);
+	if (req.dot != dir_ino || req.dotdot != parent_ino) {
+		fprintf(stderr, "Listing has \".\" %ju and \"..\" %ju, stat has %ju and %ju\n",
+			(uintmax_t)req.dot, (uintmax_t)req.dotdot, (uintmax_t)dir_ino, (uintmax_t)parent_ino);
+		++failures;
+	}
+
+	ltfs_ll_ops.lookup(&req, dir, first);
+	if (req.err || req.first != req.e.attr.st_ino) {
+		fprintf(stderr, "Listing has %ju for %s, lookup has %ju\n", (uintmax_t)req.first, first,
+			(uintmax_t)req.e.attr.st_ino);
+		++failures;
+	}
+	if (! req.err)
+		ltfs_ll_ops.forget(&req, req.e.ino, 1);
+}
+
+int main(int argc, char **argv)
+{
+	int ret, i, k, files, depth, entries_hl = 0, entries_ll = 0;
+	char dir[256] = "", path[512], name[32];
+	double start, t_hl, t_ll;
+	off_t off;
+	struct config_file *cfg = NULL;
+	struct libltfs_plugin backend;
+	char *fargv[] = { argv[0], NULL };
+	struct fuse_args args = FUSE_ARGS_INIT(1, fargv);
+	struct ltfs_volume *vol = NULL;
+	struct ltfs_fuse_data *priv;
+	struct fuse_req req;
+	struct fuse_file_info fi, dfi;
+	struct stat stbuf;
+	struct hl_dirbuf hb;
+	fuse_ino_t parent = FUSE_ROOT_ID, ino = FUSE_ROOT_ID, *inos;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <file backend directory> [files] [depth]\n", argv[0]);
+		return 1;
+	}
+	files = argc > 2 ? atoi(argv[2]) : DEFAULT_FILES;
+	depth = argc > 3 ? atoi(argv[3]) : DEFAULT_DEPTH;
+
+	priv = calloc(1, sizeof(*priv));
+	inos = calloc(files, sizeof(*inos));
+	if (! priv || ! inos)
+		return 1;
+
+	ret = ltfs_init(LTFS_ERR, true, false);
+	if (ret == 0)
+		ret = config_file_load(NULL, &cfg);
+	if (ret == 0)
+		ret = plugin_load(&backend, "tape", "file", cfg);
+	if (ret == 0)
+		ret = ltfs_fs_init();
+	if (ret == 0)
+		ret = ltfs_volume_alloc("bench_fuse_ll", &vol);
+	if (ret == 0)
+		ret = ltfs_device_open(argv[1], backend.ops, vol);
+	if (ret == 0)
+		ret = ltfs_parse_tape_backend_opts(&args, vol);
+	if (ret == 0) {
+		ltfs_load_tape(vol);
+		ret = ltfs_wait_device_ready(vol);
+	}
+	if (ret == 0)
+		ret = ltfs_setup_device(vol);
+	if (ret == 0)
+		ret = ltfs_mount(false, false, false, false, 0, vol);
+	if (ret < 0) {
+		fprintf(stderr, "Cannot mount %s (%d), format it with mkltfs -e file first\n",
+			argv[1], ret);
+		return 1;
+	}
+
+	priv->data = vol;
+	priv->file_mode = priv->dir_mode = 0777;
+	priv->sync_type = LTFS_SYNC_UNMOUNT;
+	context.private_data = priv;
+
+	/* /dir/dir/.../hl for the path-based frontend and .../ll for the low-level one, looked
+	 * up component by component as the kernel would */
+	init_req(&req, priv);
+	for (i = 0; i <= depth; ++i) {
+		strcat(dir, i < depth ? "/dir" : "/ll");
+		make_dir(dir, vol);
+		parent = ino;
+		ltfs_ll_ops.lookup(&req, parent, i < depth ? "dir" : "ll");
+		if (req.err) {
+			fprintf(stderr, "Lookup in %s failed (%d)\n", dir, req.err);
+			return 1;
+		}
+		ino = req.e.ino;
+	}
+	strcpy(dir + strlen(dir) - 2, "hl");
+	make_dir(dir, vol);
+
+	printf("%-12s %14s %14s\n", "op", "path (ops/s)", "inode (ops/s)");
+
+	start = now();
+	for (i = 0; i < files; ++i) {
+		memset(&fi, 0, sizeof(fi));
+		fi.flags = O_WRONLY | O_CREAT;
+		snprintf(path, sizeof(path), "%s/f%06d", dir, i);
+		ltfs_ops.getattr(path, &stbuf);
+		if (ltfs_ops.create(path, 0644, &fi) != 0) {
+			fprintf(stderr, "Cannot create %s\n", path);
+			return 1;
+		}
+		ltfs_ops.flush(path, &fi);
+		ltfs_ops.release(path, &fi);
+	}
+	t_hl = now() - start;
+	start = now();
+	for (i = 0; i < files; ++i) {
+		memset(&fi, 0, sizeof(fi));
+		fi.flags = O_WRONLY | O_CREAT;
+		snprintf(name, sizeof(name), "f%06d", i);
+		ltfs_ll_ops.lookup(&req, ino, name);
+		ltfs_ll_ops.create(&req, ino, name, 0644, &fi);
+		if (req.err) {
+			fprintf(stderr, "Cannot create %s (%d)\n", name, req.err);
+			return 1;
+		}
+		inos[i] = req.e.ino;
+		ltfs_ll_ops.flush(&req, inos[i], &req.fi);
+		ltfs_ll_ops.release(&req, inos[i], &req.fi);
+	}
+	t_ll = now() - start;
+	printf("%-12s %14.0f %14.0f\n", "create", files / t_hl, files / t_ll);
+
+	start = now();
+	for (i = 0; i < files; ++i) {
+		snprintf(path, sizeof(path), "%s/f%06d", dir, i);
+		if (ltfs_ops.getattr(path, &stbuf) != 0)
+			return 1;
+	}
+	t_hl = now() - start;
+	start = now();
+	for (i = 0; i < files; ++i) {
+		snprintf(name, sizeof(name), "f%06d", i);
+		ltfs_ll_ops.lookup(&req, ino, name);
+		if (req.err)
+			return 1;
+		ltfs_ll_ops.forget(&req, req.e.ino, 1);
+	}
+	t_ll = now() - start;
+	printf("%-12s %14.0f %14.0f\n", "stat", files / t_hl, files / t_ll);
+
+	start = now();
+	for (i = 0; i < files; ++i) {
+		memset(&fi, 0, sizeof(fi));
+		fi.flags = O_RDONLY;
+		snprintf(path, sizeof(path), "%s/f%06d", dir, i);
+		if (ltfs_ops.open(path, &fi) != 0)
+			return 1;
+		ltfs_ops.flush(path, &fi);
+		ltfs_ops.release(path, &fi);
+	}
+	t_hl = now() - start;
+	start = now();
+	for (i = 0; i < files; ++i) {
+		memset(&fi, 0, sizeof(fi));
+		fi.flags = O_RDONLY;
+		ltfs_ll_ops.open(&req, inos[i], &fi);
+		if (req.err)
+			return 1;
+		ltfs_ll_ops.flush(&req, inos[i], &req.fi);
+		ltfs_ll_ops.release(&req, inos[i], &req.fi);
+	}
+	t_ll = now() - start;
+	printf("%-12s %14.0f %14.0f\n", "open+close", files / t_hl, files / t_ll);
+
+	/* Directory listings with the buffer size the kernel uses */
+	start = now();
+	for (k = 0; k < READDIR_REPS; ++k) {
+		memset(&fi, 0, sizeof(fi));
+		ltfs_ops.opendir(dir, &fi);
+		for (off = 0;; off = hb.last) {
+			memset(&hb, 0, sizeof(hb));
+			ltfs_ops.readdir(dir, &hb, hl_filldir, off, &fi);
+			if (! hb.entries)
+				break;
+			entries_hl += hb.entries;
+		}
+		ltfs_ops.releasedir(dir, &fi);
+	}
+	t_hl = now() - start;
+	start = now();
+	for (k = 0; k < READDIR_REPS; ++k) {
+		memset(&fi, 0, sizeof(fi));
+		ltfs_ll_ops.opendir(&req, ino, &fi);
+		dfi = req.fi;
+		for (off = 0;; off = req.last) {
+			req.entries = 0;
+			ltfs_ll_ops.readdir(&req, ino, DIR_BUFSIZE, off, &dfi);
+			if (req.err || ! req.entries)
+				break;
+			entries_ll += req.entries;
+		}
+		ltfs_ll_ops.releasedir(&req, ino, &dfi);
+	}
+	t_ll = now() - start;
+	printf("%-12s %14.0f %14.0f (entries/s)\n", "readdir", entries_hl / t_hl, entries_ll / t_ll);
+
+	check_inodes(priv, parent, ino, "f000000");
+	check_inodes(priv, FUSE_ROOT_ID, FUSE_ROOT_ID, "dir");
+
+	for (i = 0; i < files; ++i)
+		ltfs_ll_ops.forget(&req, inos[i], 1);
+	ltfs_unmount("bench_fuse_ll", vol);
+	ltfs_device_close(vol);
+	ltfs_volume_free(&vol);
+	ltfs_finish();
+
+	if (test_failed("inode checks failed"))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,169 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       tests/bench_getattr.c
+**
+** DESCRIPTION:     Measures how getattr scales with the number of threads, with
+**                  and without the reader bias of the volume lock. Every getattr
+**                  takes the volume lock for read; a writer thread takes it for
+**                  write now and then, as the periodic sync would.
+**
+**                  Usage: bench_getattr [seconds per run] [max threads]
+**
+*************************************************************************************
+*/
+
+#include "libltfs/ltfs.h"
+#include "libltfs/fs.h"
+#include "libltfs/ltfs_fsops.h"
+#include "libltfs/ltfs_internal.h"
+#include "test_util.h"
+
+#define FILES       (64)
+#define WRITE_EVERY (10000) /* Microseconds between two write acquisitions */
+
+struct bench {
+	struct ltfs_volume *vol;
+	volatile bool stop;
+	uint64_t ops;
+	uint64_t writes;
+	uint64_t write_ns;
+};
+
+static void *reader(void *arg)
+{
+	struct bench *b = arg;
+	struct dentry_attr attr;
+	ltfs_file_id id;
+	char path[32];
+	uint64_t ops = 0;
+	unsigned int i = (unsigned int)(uintptr_t)pthread_self();
+
+	while (! b->stop) {
+		snprintf(path, sizeof(path), "/f%u", (i++) % FILES);
+		if (ltfs_fsops_getattr_path(path, &attr, &id, b->vol) < 0) {
+			fprintf(stderr, "getattr of %s failed\n", path);
+			exit(1);
+		}
+		++ops;
+	}
+
+	__atomic_add_fetch(&b->ops, ops, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+static void *writer(void *arg)
+{
+	struct bench *b = arg;
+	uint64_t start;
+
+	while (! b->stop) {
+		usleep(WRITE_EVERY);
+		start = now_ns();
+		acquirewrite_mrsw(&b->vol->lock);
+		b->write_ns += now_ns() - start;
+		++b->writes;
+		releasewrite_mrsw(&b->vol->lock);
+	}
+
+	return NULL;
+}
+
+/* Run readers and the writer for a while. Returns the getattr rate, and the mean time the
+ * writer waited for the lock in write_us. */
+static double run(struct ltfs_volume *vol, int threads, double seconds, double *write_us)
+{
+	int i;
+	pthread_t tid[threads + 1];
+	struct bench b = { .vol = vol, .stop = false };
+
+	for (i = 0; i < threads; ++i)
+		pthread_create(&tid[i], NULL, reader, &b);
+	pthread_create(&tid[threads], NULL, writer, &b);
+	usleep((useconds_t)(seconds * 1000000));
+	b.stop = true;
+	for (i = 0; i <= threads; ++i)
+		pthread_join(tid[i], NULL);
+
+	*write_us = b.writes ? b.write_ns / 1000.0 / b.writes : 0;
+	return b.ops / seconds;
+}
+
+int main(int argc, char **argv)
+{
+	int ret, i, threads, max_threads;
+	double seconds, biased, plain, biased_write, plain_write;
+	char name[32];
+	struct ltfs_volume *vol = NULL;
+
+	seconds = argc > 1 ? atof(argv[1]) : 1.0;
+	max_threads = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+	ret = ltfs_init(LTFS_ERR, false, false);
+	if (ret == 0)
+		ret = ltfs_volume_alloc("bench_getattr", &vol);
+	if (ret == 0)
+		ret = ltfs_index_alloc(&vol->index, vol);
+	for (i = 0; ret == 0 && i < FILES; ++i) {
+		snprintf(name, sizeof(name), "f%d", i);
+		if (! fs_allocate_dentry(vol->index->root, name, NULL, false, false, true, vol->index))
+			ret = -LTFS_NO_MEMORY;
+	}
+	if (ret < 0) {
+		fprintf(stderr, "Cannot set up the volume (%d)\n", ret);
+		return 1;
+	}
+
+	printf("threads   biased ops/s  write us    plain ops/s  write us\n");
+	for (threads = 1; threads <= max_threads; threads *= 2) {
+		vol->lock.bias.enabled = 1;
+		vol->lock.bias.rbias = 1;
+		biased = run(vol, threads, seconds, &biased_write);
+
+		vol->lock.bias.enabled = 0;
+		vol->lock.bias.rbias = 0;
+		plain = run(vol, threads, seconds, &plain_write);
+
+		printf("%7d  %13.0f  %8.1f  %13.0f  %8.1f\n", threads, biased, biased_write,
+			plain, plain_write);
+	}
+
+	ltfs_volume_free(&vol);
+	ltfs_finish();
+	return 0;
+}
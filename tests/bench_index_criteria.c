@@ -0,0 +1,195 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       tests/bench_index_criteria.c
+**
+** DESCRIPTION:     Measures index_criteria_match over generated names with 40 name
+**                  rules, with the compiled automaton and with the glob matcher.
+**
+**                  Usage: bench_index_criteria [names] [names for the glob matcher]
+**
+*************************************************************************************
+*/
+
+#include <unicode/ucnv.h>
+
+#include "libltfs/ltfs.h"
+#include "libltfs/ltfs_internal.h"
+#include "libltfs/index_criteria.h"
+#include "test_util.h"
+
+static const char *exts[] = {
+	"txt", "jpg", "jpeg", "png", "gif", "c", "h", "cpp", "hpp", "log",
+	"xml", "json", "yaml", "md", "pdf", "doc", "xls", "csv", "tar", "gz",
+};
+
+#define EXT_COUNT (sizeof(exts) / sizeof(exts[0]))
+
+/* Extensions, prefixes, '?' and several '*' per rule */
+static int set_rules(struct ltfs_volume *vol)
+{
+	size_t i;
+	char rules[1024];
+	int len;
+
+	len = sprintf(rules, "name=");
+	for (i = 0; i < EXT_COUNT; ++i)
+		len += sprintf(rules + len, "*.%s:", exts[i]);
+	for (i = 0; i < 8; ++i)
+		len += sprintf(rules + len, "Thumb%zu*:", i);
+	sprintf(rules + len, "*cache*idx*:*_meta_*.bin:data??.dat:IMG_????.RAW:*.bak*:readme*:"
+		"*-v?.?.*:core.*:.*rc:*~:*.o:*.so*/size=1M");
+
+	return index_criteria_parse(rules, vol);
+}
+
+/* Names which match some rule about half of the time; one in a hundred is not ASCII */
+static char **make_names(int count)
+{
+	int i, j, len, kind;
+	char buf[128], tail[32], **names;
+	unsigned int seed = 7;
+	static const char chars[] =
+		"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_.-~";
+
+	names = calloc(count, sizeof(char *));
+	if (! names)
+		return NULL;
+	for (i = 0; i < count; ++i) {
+		len = 1 + rand_r(&seed) % 24;
+		kind = rand_r(&seed) % 10;
+		for (j = 0; j < len; ++j)
+			buf[j] = chars[rand_r(&seed) % (sizeof(chars) - 1)];
+		buf[len] = '\0';
+		strcpy(tail, buf + len / 2);
+		if (kind < 3)
+			sprintf(buf + len, ".%s", exts[rand_r(&seed) % EXT_COUNT]);
+		else if (kind == 3)
+			sprintf(buf, "Thumb%d%s", rand_r(&seed) % 10, tail);
+		else if (kind == 4)
+			sprintf(buf, "x%scache%sidx", tail, tail);
+		else if (kind == 5)
+			sprintf(buf, "IMG_%04d.raw", rand_r(&seed) % 10000);
+		if (i % 100 == 0)
+			strcat(buf, "\xc3\xa9.TXT");
+		names[i] = strdup(buf);
+		if (! names[i])
+			return NULL;
+	}
+	return names;
+}
+
+/* Match the first count names, returning how many matched */
+static int run(struct ltfs_volume *vol, char **names, int count, double *ns)
+{
+	int i, matched = 0;
+	uint64_t start;
+	struct dentry d;
+
+	memset(&d, 0, sizeof(d));
+	start = now_ns();
+	for (i = 0; i < count; ++i) {
+		d.name.name = names[i];
+		matched += index_criteria_match(&d, vol);
+	}
+	*ns = (double)(now_ns() - start) / count;
+	return matched;
+}
+
+int main(int argc, char **argv)
+{
+	int ret, i, count, glob_count, matched, dfa_matched, glob_matched;
+	double ns_dfa, ns_glob, ns;
+	char **names;
+	struct ltfs_volume *vol = NULL;
+	struct index_criteria *ic;
+	struct index_criteria_dfa *dfa;
+
+	count = argc > 1 ? atoi(argv[1]) : 2000000;
+	glob_count = argc > 2 ? atoi(argv[2]) : 10000;
+	if (count < 1 || glob_count < 1)
+		return 1;
+	if (glob_count > count)
+		glob_count = count;
+
+	ucnv_setDefaultName("UTF-8");
+
+	ret = ltfs_init(LTFS_ERR, false, false);
+	if (ret == 0)
+		ret = ltfs_volume_alloc("bench_index_criteria", &vol);
+	if (ret == 0)
+		ret = ltfs_index_alloc(&vol->index, vol);
+	if (ret == 0)
+		ret = set_rules(vol);
+	if (ret < 0) {
+		fprintf(stderr, "Cannot set up the volume (%d)\n", ret);
+		return 1;
+	}
+	ic = &vol->index->index_criteria;
+	if (! ic->glob_dfa) {
+		fprintf(stderr, "The rules were not compiled\n");
+		return 1;
+	}
+
+	names = make_names(count);
+	if (! names) {
+		fprintf(stderr, "Cannot allocate the names\n");
+		return 1;
+	}
+
+	matched = run(vol, names, count, &ns_dfa);
+	dfa_matched = run(vol, names, glob_count, &ns);
+
+	dfa = ic->glob_dfa;
+	ic->glob_dfa = NULL;
+	glob_matched = run(vol, names, glob_count, &ns_glob);
+	ic->glob_dfa = dfa;
+
+	printf("40 rules, %d names\n", count);
+	printf("automaton     %10.0f ns/name  %d matched\n", ns_dfa, matched);
+	printf("glob matcher  %10.0f ns/name  %d of the first %d matched (automaton: %d)\n",
+		ns_glob, glob_matched, glob_count, dfa_matched);
+
+	for (i = 0; i < count; ++i)
+		free(names[i]);
+	free(names);
+	index_criteria_free(ic);
+	ltfs_volume_free(&vol);
+	ltfs_finish();
+	return glob_matched == dfa_matched ? 0 : 1;
+}
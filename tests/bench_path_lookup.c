@@ -0,0 +1,155 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       tests/bench_path_lookup.c
+**
+** DESCRIPTION:     Measures fs_path_lookup and ltfs_fsops_getattr_path of files
+**                  at depths up to 10, with and without the path cache.
+**
+**                  Usage: bench_path_lookup [seconds per run]
+**
+*************************************************************************************
+*/
+
+#include "libltfs/ltfs.h"
+#include "libltfs/ltfs_fsops.h"
+#include "libltfs/fs.h"
+#include "libltfs/ltfs_internal.h"
+#include "test_util.h"
+
+#define DEPTH (10)
+#define FILES (256)
+
+static const int depths[] = { 1, 2, 4, 8, 10 };
+
+/* Look up, or get the attributes of, the files of the directory at 'depth' in turn for a while */
+static double run(struct ltfs_volume *vol, int depth, bool getattr, double seconds)
+{
+	int i, ret;
+	char path[256], *p;
+	uint64_t ops = 0, start, end;
+	struct dentry *d;
+	struct dentry_attr attr;
+	ltfs_file_id id;
+
+	p = path;
+	for (i = 1; i <= depth; ++i)
+		p += sprintf(p, "/d%d", i);
+
+	start = now_ns();
+	end = start + (uint64_t)(seconds * 1e9);
+	do {
+		for (i = 0; i < FILES; ++i) {
+			sprintf(p, "/f%d", i);
+			if (getattr)
+				ret = ltfs_fsops_getattr_path(path, &attr, &id, vol);
+			else {
+				ret = fs_path_lookup(path, 0, &d, vol->index);
+				if (ret == 0)
+					fs_release_dentry(d);
+			}
+			if (ret < 0) {
+				fprintf(stderr, "Lookup of %s failed (%d)\n", path, ret);
+				exit(1);
+			}
+		}
+		ops += FILES;
+	} while (now_ns() < end);
+
+	return ops / ((now_ns() - start) / 1e9);
+}
+
+int main(int argc, char **argv)
+{
+	int ret = 0, i, depth;
+	size_t n;
+	double seconds, cached, walked, cached_attr, walked_attr;
+	char name[32];
+	struct ltfs_volume *vol = NULL;
+	struct ltfs_index *idx;
+	struct path_cache *cache;
+	struct dentry *dir;
+
+	seconds = argc > 1 ? atof(argv[1]) : 1.0;
+
+	ret = ltfs_init(LTFS_ERR, false, false);
+	if (ret == 0)
+		ret = ltfs_volume_alloc("bench_path_lookup", &vol);
+	if (ret == 0)
+		ret = ltfs_index_alloc(&vol->index, vol);
+	if (ret < 0) {
+		fprintf(stderr, "Cannot set up the volume (%d)\n", ret);
+		return 1;
+	}
+
+	/* /d1/d2/.../d10, with FILES files in every directory */
+	idx = vol->index;
+	dir = idx->root;
+	for (depth = 0; depth <= DEPTH && dir; ++depth) {
+		for (i = 0; i < FILES; ++i) {
+			snprintf(name, sizeof(name), "f%d", i);
+			if (! fs_allocate_dentry(dir, name, NULL, false, false, true, idx))
+				return 1;
+		}
+		if (depth < DEPTH) {
+			snprintf(name, sizeof(name), "d%d", depth + 1);
+			dir = fs_allocate_dentry(dir, name, NULL, true, false, true, idx);
+		}
+	}
+	if (! dir)
+		return 1;
+
+	cache = idx->path_cache;
+	printf("depth  cached lookups/s  walked lookups/s  cached getattrs/s  walked getattrs/s\n");
+	for (n = 0; n < sizeof(depths) / sizeof(depths[0]); ++n) {
+		depth = depths[n];
+		idx->path_cache = cache;
+		cached = run(vol, depth, false, seconds);
+		cached_attr = run(vol, depth, true, seconds);
+		idx->path_cache = NULL;
+		walked = run(vol, depth, false, seconds);
+		walked_attr = run(vol, depth, true, seconds);
+		printf("%5d  %16.0f  %16.0f  %17.0f  %17.0f\n", depth, cached, walked, cached_attr,
+			walked_attr);
+	}
+	idx->path_cache = cache;
+
+	ltfs_volume_free(&vol);
+	ltfs_finish();
+	return 0;
+}
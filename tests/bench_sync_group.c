@@ -0,0 +1,273 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       tests/bench_sync_group.c
+**
+** DESCRIPTION:     Measures concurrent index syncs against the file backend. Each
+**                  thread sets an extended attribute on its own file and then syncs,
+**                  in a loop. The syncs are issued once the way ltfs.sync used to run,
+**                  each writing the index under the volume write lock, and once
+**                  through the group commit of ltfs_sync_index. Reports the time
+**                  taken and the number of index writes of each run.
+**
+**                  Needs the installed configuration file, to load the file backend.
+**
+**                  Usage: bench_sync_group [threads] [syncs per thread] [files]
+**
+*************************************************************************************
+*/
+
+#include <fuse.h>
+#include <ftw.h>
+#include <unistd.h>
+
+#include "libltfs/ltfs.h"
+#include "libltfs/ltfs_fsops.h"
+#include "libltfs/tape.h"
+#include "libltfs/index_criteria.h"
+#include "libltfs/config_file.h"
+#include "libltfs/plugin.h"
+#include "test_util.h"
+
+#define MAX_THREADS (64)
+
+static struct config_file *config = NULL;
+static struct libltfs_plugin backend;
+
+static struct ltfs_volume *vol;
+static pthread_barrier_t barrier;
+static int syncs;
+static bool grouped;
+static int errors = 0;
+
+static int format_volume(const char *tape)
+{
+	int ret;
+	char *fargv[] = { "bench_sync_group", NULL };
+	struct fuse_args args = FUSE_ARGS_INIT(1, fargv);
+	struct ltfs_volume *newvol = NULL;
+
+	ret = ltfs_volume_alloc("bench_sync_group", &newvol);
+	if (ret == 0)
+		ret = ltfs_set_blocksize(LTFS_DEFAULT_BLOCKSIZE, newvol);
+	if (ret == 0)
+		ret = ltfs_device_open(tape, backend.ops, newvol);
+	if (ret == 0)
+		ret = ltfs_parse_tape_backend_opts(&args, newvol);
+	if (ret == 0) {
+		ltfs_load_tape(newvol);
+		ret = ltfs_wait_device_ready(newvol);
+	}
+	if (ret == 0)
+		ret = ltfs_setup_device(newvol);
+	if (ret == 0) {
+		ltfs_set_partition_map('b', 'a', 1, 0, newvol);
+		ret = tape_load_tape(newvol->device, newvol->kmi_handle, false);
+	}
+	if (ret == 0)
+		ret = index_criteria_set_allow_update(true, newvol);
+	if (ret == 0)
+		ret = ltfs_format_tape(newvol, 0, false);
+
+	if (newvol && newvol->device)
+		ltfs_device_close(newvol);
+	ltfs_volume_free(&newvol);
+	fuse_opt_free_args(&args);
+	return ret;
+}
+
+static int mount_volume(const char *tape)
+{
+	int ret;
+	char *fargv[] = { "bench_sync_group", NULL };
+	struct fuse_args args = FUSE_ARGS_INIT(1, fargv);
+
+	ret = ltfs_volume_alloc("bench_sync_group", &vol);
+	if (ret == 0)
+		ret = ltfs_device_open(tape, backend.ops, vol);
+	if (ret == 0)
+		ret = ltfs_parse_tape_backend_opts(&args, vol);
+	if (ret == 0) {
+		ltfs_load_tape(vol);
+		ret = ltfs_wait_device_ready(vol);
+	}
+	if (ret == 0)
+		ret = ltfs_setup_device(vol);
+	if (ret == 0)
+		ret = ltfs_mount(false, false, false, false, 0, vol);
+	fuse_opt_free_args(&args);
+	return ret;
+}
+
+/* ltfs.sync on the root before the group commit: the index is written under the volume
+ * write lock by the caller itself */
+static int sync_alone(void)
+{
+	int ret;
+
+	ret = ltfs_fsops_flush(NULL, false, vol);
+	if (ret == 0)
+		ret = ltfs_get_volume_lock(true, vol);
+	if (ret < 0)
+		return ret;
+	ret = ltfs_sync_index(SYNC_EA, false, vol);
+	releasewrite_mrsw(&vol->lock);
+	return ret;
+}
+
+static void *run(void *arg)
+{
+	int i, ret;
+	char path[32], value[16];
+	ltfs_file_id id;
+
+	snprintf(path, sizeof(path), "/t%ld", (long) arg);
+	pthread_barrier_wait(&barrier);
+	for (i = 0; i < syncs; ++i) {
+		snprintf(value, sizeof(value), "%d", i);
+		ret = ltfs_fsops_setxattr(path, "user.counter", value, strlen(value), 0, &id, vol);
+		if (ret == 0) {
+			if (grouped)
+				ret = ltfs_fsops_setxattr("/", "user.ltfs.sync", "1", 1, 0, &id, vol);
+			else
+				ret = sync_alone();
+		}
+		if (ret < 0)
+			__atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+/* Run the threads once, returning the number of index writes and the elapsed time */
+static unsigned int measure(int threads, double *seconds)
+{
+	long i;
+	unsigned int gen;
+	uint64_t start;
+	pthread_t tid[MAX_THREADS];
+
+	gen = vol->index->generation;
+	pthread_barrier_init(&barrier, NULL, threads + 1);
+	for (i = 0; i < threads; ++i)
+		pthread_create(&tid[i], NULL, run, (void *) i);
+	pthread_barrier_wait(&barrier);
+	start = now_ns();
+	for (i = 0; i < threads; ++i)
+		pthread_join(tid[i], NULL);
+	*seconds = (now_ns() - start) / 1e9;
+	pthread_barrier_destroy(&barrier);
+	return vol->index->generation - gen;
+}
+
+static int remove_file(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+int main(int argc, char **argv)
+{
+	int ret, i, threads, files;
+	unsigned int writes[2];
+	double seconds[2];
+	char base[] = "/tmp/bench_sync_group.XXXXXX", tape[64], path[32];
+	struct dentry *d;
+
+	threads = argc > 1 ? atoi(argv[1]) : 8;
+	syncs = argc > 2 ? atoi(argv[2]) : 10;
+	files = argc > 3 ? atoi(argv[3]) : 30000;
+	if (threads < 1 || threads > MAX_THREADS || syncs < 1 || files < 0)
+		return 1;
+
+	ret = ltfs_init(LTFS_ERR, true, false);
+	if (ret == 0)
+		ret = config_file_load(NULL, &config);
+	if (ret == 0)
+		ret = plugin_load(&backend, "tape", "file", config);
+	if (ret < 0) {
+		fprintf(stderr, "The file backend must be installed\n");
+		return 1;
+	}
+	ltfs_fs_init();
+
+	if (! mkdtemp(base)) {
+		fprintf(stderr, "Cannot create a temporary directory\n");
+		return 1;
+	}
+	snprintf(tape, sizeof(tape), "%s/tape", base);
+	if (mkdir(tape, 0700) < 0 || format_volume(tape) < 0 || mount_volume(tape) < 0) {
+		fprintf(stderr, "Cannot format and mount a cartridge in %s\n", tape);
+		nftw(base, remove_file, 16, FTW_DEPTH | FTW_PHYS);
+		return 1;
+	}
+
+	/* The files make each index write take a while, like on a real volume */
+	for (i = 0; i < files + threads && ret == 0; ++i) {
+		if (i < threads)
+			snprintf(path, sizeof(path), "/t%d", i);
+		else
+			snprintf(path, sizeof(path), "/f%d", i);
+		ret = ltfs_fsops_create(path, false, false, false, &d, vol);
+		if (ret == 0)
+			ret = ltfs_fsops_close(d, true, true, false, vol);
+	}
+	if (ret == 0)
+		ret = ltfs_fsops_volume_sync("bench_sync_group", vol);
+	if (ret < 0) {
+		fprintf(stderr, "Cannot populate the volume (%d)\n", ret);
+		return 1;
+	}
+
+	grouped = false;
+	writes[0] = measure(threads, &seconds[0]);
+	grouped = true;
+	writes[1] = measure(threads, &seconds[1]);
+
+	printf("%d threads, %d syncs each, %d files\n", threads, syncs, files);
+	printf("write lock per sync  %7.2f s  %4u index writes\n", seconds[0], writes[0]);
+	printf("group commit         %7.2f s  %4u index writes\n", seconds[1], writes[1]);
+	if (errors)
+		printf("%d syncs failed\n", errors);
+
+	ltfs_unmount("bench_sync_group", vol);
+	ltfs_device_close(vol);
+	ltfs_volume_free(&vol);
+	plugin_unload(&backend);
+	config_file_free(config);
+	nftw(base, remove_file, 16, FTW_DEPTH | FTW_PHYS);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,484 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       tests/test_dcache_disk.c
+**
+** DESCRIPTION:     Checks the disk dentry cache against the file backend: with a
+**                  small maxresident, directories are evicted and loaded back on
+**                  demand with their attributes, extended attributes and data
+**                  intact, also after renames and removals, and the index written
+**                  with directories evicted matches the tree when the cartridge is
+**                  mounted again with and without the cache.
+**
+**                  Loads the file backend and the disk dentry cache plugins from
+**                  the build tree, through the configuration file generated by
+**                  "make check". Built without it, uses the installed one.
+**
+*************************************************************************************
+*/
+
+#include <fuse.h>
+#include <ftw.h>
+#include <unistd.h>
+
+#include "libltfs/ltfs.h"
+#include "libltfs/ltfs_fsops.h"
+#include "libltfs/fs.h"
+#include "libltfs/tape.h"
+#include "libltfs/index_criteria.h"
+#include "libltfs/index_spill.h"
+#include "libltfs/config_file.h"
+#include "libltfs/plugin.h"
+#include "libltfs/dcache.h"
+#include "test_util.h"
+
+#ifndef TEST_CONFIG_FILE
+#define TEST_CONFIG_FILE NULL
+#endif
+
+#define DIRS        (16)
+#define FILES       (8)
+#define SUBFILES    (4)
+#define MAX_ENTRIES (DIRS * (FILES + SUBFILES + 1) + 2 * DIRS)
+#define CACHE_NAME  "test_dcache_disk"
+
+/* Small enough that only a few of the directories fit in memory */
+static const char *dcache_options[] = { "maxresident 24", NULL };
+
+struct entry {
+	char path[64];
+	char data[64];   /**< Contents and user.tag value of a file, empty for a directory */
+	bool isdir;
+	bool removed;
+	uint64_t uid;
+};
+
+static struct entry model[MAX_ENTRIES];
+static int entries = 0;
+
+static struct config_file *config = NULL;
+static struct libltfs_plugin backend, dcache_plugin;
+
+static int format_volume(const char *tape)
+{
+	int ret;
+	char *fargv[] = { "test_dcache_disk", NULL };
+	struct fuse_args args = FUSE_ARGS_INIT(1, fargv);
+	struct ltfs_volume *vol = NULL;
+
+	ret = ltfs_volume_alloc("test_dcache_disk", &vol);
+	if (ret == 0)
+		ret = ltfs_set_blocksize(LTFS_DEFAULT_BLOCKSIZE, vol);
+	if (ret == 0)
+		ret = ltfs_device_open(tape, backend.ops, vol);
+	if (ret == 0)
+		ret = ltfs_parse_tape_backend_opts(&args, vol);
+	if (ret == 0) {
+		ltfs_load_tape(vol);
+		ret = ltfs_wait_device_ready(vol);
+	}
+	if (ret == 0)
+		ret = ltfs_setup_device(vol);
+	if (ret == 0) {
+		ltfs_set_partition_map('b', 'a', 1, 0, vol);
+		ret = tape_load_tape(vol->device, vol->kmi_handle, false);
+	}
+	if (ret == 0)
+		ret = index_criteria_set_allow_update(true, vol);
+	if (ret == 0)
+		ret = ltfs_format_tape(vol, 0, false);
+
+	if (vol && vol->device)
+		ltfs_device_close(vol);
+	ltfs_volume_free(&vol);
+	fuse_opt_free_args(&args);
+	return ret;
+}
+
+static struct ltfs_volume *mount_volume(const char *tape)
+{
+	int ret;
+	char *fargv[] = { "test_dcache_disk", NULL };
+	struct fuse_args args = FUSE_ARGS_INIT(1, fargv);
+	struct ltfs_volume *vol = NULL;
+
+	ret = ltfs_volume_alloc("test_dcache_disk", &vol);
+	if (ret == 0)
+		ret = ltfs_device_open(tape, backend.ops, vol);
+	if (ret == 0)
+		ret = ltfs_parse_tape_backend_opts(&args, vol);
+	if (ret == 0) {
+		ltfs_load_tape(vol);
+		ret = ltfs_wait_device_ready(vol);
+	}
+	if (ret == 0)
+		ret = ltfs_setup_device(vol);
+	if (ret == 0)
+		ret = ltfs_mount(false, false, false, false, 0, vol);
+	fuse_opt_free_args(&args);
+
+	if (ret < 0) {
+		fprintf(stderr, "Cannot mount %s (%d)\n", tape, ret);
+		if (vol && vol->device)
+			ltfs_device_close(vol);
+		ltfs_volume_free(&vol);
+		return NULL;
+	}
+	return vol;
+}
+
+/**
+ * Set up the dentry cache the way the FUSE frontend does, reusing the cache of the last
+ * mount if it matches the index.
+ */
+static int start_dcache(struct ltfs_volume *vol, const char *work, bool *reused)
+{
+	int ret;
+	bool exists = false, dirty = true;
+	unsigned int gen = 0;
+	struct dcache_options *opt = NULL;
+
+	*reused = false;
+	ret = dcache_parse_options(dcache_options, &opt);
+	if (ret < 0)
+		return ret;
+	ret = dcache_init(&dcache_plugin, opt, vol);
+	dcache_free_options(&opt);
+	if (ret < 0)
+		return ret;
+
+	ret = dcache_set_workdir(work, false, vol);
+	if (ret == 0)
+		ret = dcache_get_advisory_lock(CACHE_NAME, vol);
+	if (ret == 0)
+		ret = dcache_cache_exists(CACHE_NAME, &exists, vol);
+	if (ret == 0 && exists) {
+		*reused = dcache_get_generation(work, CACHE_NAME, &gen, vol) == 0
+			&& gen == vol->index->generation
+			&& dcache_get_dirty(work, CACHE_NAME, &dirty, vol) == 0 && ! dirty;
+		if (! *reused)
+			ret = dcache_rmcache(CACHE_NAME, vol);
+	}
+	if (ret == 0 && ! *reused)
+		ret = dcache_mkcache(CACHE_NAME, vol);
+	if (ret == 0)
+		ret = dcache_assign_name(CACHE_NAME, vol);
+	return ret;
+}
+
+static void unmount_volume(struct ltfs_volume *vol, bool dcache)
+{
+	CHECK(ltfs_unmount("test_dcache_disk", vol) == 0);
+	if (dcache) {
+		CHECK(dcache_unassign_name(vol) == 0);
+		dcache_put_advisory_lock(CACHE_NAME, vol);
+		dcache_destroy(vol);
+	}
+	ltfs_device_close(vol);
+	ltfs_volume_free(&vol);
+}
+
+static struct entry *add_entry(const char *path, bool isdir)
+{
+	struct entry *e = &model[entries++];
+
+	snprintf(e->path, sizeof(e->path), "%s", path);
+	if (! isdir)
+		snprintf(e->data, sizeof(e->data), "contents of %s", path);
+	e->isdir = isdir;
+	return e;
+}
+
+static void create_entry(const char *path, bool isdir, struct ltfs_volume *vol)
+{
+	int ret;
+	ltfs_file_id id;
+	struct dentry *d;
+	struct dentry_attr attr;
+	struct entry *e = add_entry(path, isdir);
+
+	ret = ltfs_fsops_create(path, isdir, false, false, &d, vol);
+	CHECK(ret == 0);
+	if (ret < 0)
+		return;
+	if (! isdir)
+		CHECK(ltfs_fsops_write(d, e->data, strlen(e->data), 0, true, vol) == 0);
+	CHECK(ltfs_fsops_getattr(d, &attr, vol) == 0);
+	e->uid = attr.uid;
+	CHECK(ltfs_fsops_close(d, true, true, false, vol) == 0);
+	if (! isdir)
+		CHECK(ltfs_fsops_setxattr(path, "user.tag", e->data, strlen(e->data), 0, &id, vol) == 0);
+}
+
+/**
+ * Rename an entry and everything below it in the model.
+ */
+static void rename_entry(const char *from, const char *to, struct ltfs_volume *vol)
+{
+	int i;
+	char path[64];
+	size_t len = strlen(from);
+	ltfs_file_id id;
+
+	CHECK(ltfs_fsops_rename(from, to, &id, vol) == 0);
+	for (i = 0; i < entries; ++i) {
+		if (! strncmp(model[i].path, from, len) && (! model[i].path[len] || model[i].path[len] == '/')) {
+			snprintf(path, sizeof(path), "%s%s", to, model[i].path + len);
+			strcpy(model[i].path, path);
+		}
+	}
+}
+
+static void remove_entry(const char *path, struct ltfs_volume *vol)
+{
+	int i;
+	ltfs_file_id id;
+
+	CHECK(ltfs_fsops_unlink(path, &id, vol) == 0);
+	for (i = 0; i < entries; ++i) {
+		if (! strcmp(model[i].path, path))
+			model[i].removed = true;
+	}
+}
+
+static int count_filler(void *buf, const char *name, void *priv)
+{
+	if (strcmp(name, ".") && strcmp(name, ".."))
+		++*(int *)buf;
+	return 0;
+}
+
+static int model_children(const char *dir)
+{
+	int i, count = 0;
+	size_t len = strlen(dir);
+	const char *slash;
+
+	for (i = 0; i < entries; ++i) {
+		if (model[i].removed || strncmp(model[i].path, dir, len) || model[i].path[len] != '/')
+			continue;
+		slash = strchr(model[i].path + len + 1, '/');
+		if (! slash)
+			++count;
+	}
+	return count;
+}
+
+/**
+ * Check every entry of the model through the file system operations, which load evicted
+ * directories on the way.
+ */
+static void verify(struct ltfs_volume *vol)
+{
+	int i, ret, count;
+	char buf[64], value[64];
+	ltfs_file_id id;
+	struct dentry *d;
+	struct dentry_attr attr;
+	struct entry *e;
+
+	for (i = 0; i < entries; ++i) {
+		e = &model[i];
+		ret = ltfs_fsops_open(e->path, false, false, &d, vol);
+		if (e->removed) {
+			CHECK(ret == -LTFS_NO_DENTRY);
+			if (ret == 0)
+				ltfs_fsops_close(d, false, false, false, vol);
+			continue;
+		}
+		CHECK(ret == 0);
+		if (ret < 0) {
+			fprintf(stderr, "Cannot open %s (%d)\n", e->path, ret);
+			continue;
+		}
+
+		CHECK(ltfs_fsops_getattr(d, &attr, vol) == 0);
+		CHECK(attr.uid == e->uid);
+		CHECK(attr.isdir == e->isdir);
+		if (e->isdir) {
+			count = 0;
+			CHECK(ltfs_fsops_readdir(d, &count, count_filler, NULL, vol) == 0);
+			CHECK(count == model_children(e->path));
+		} else {
+			memset(buf, 0, sizeof(buf));
+			CHECK(attr.size == strlen(e->data));
+			CHECK(ltfs_fsops_read(d, buf, sizeof(buf), 0, vol) == (ssize_t)strlen(e->data));
+			CHECK(! strcmp(buf, e->data));
+		}
+		CHECK(ltfs_fsops_close(d, false, false, false, vol) == 0);
+
+		if (! e->isdir) {
+			memset(value, 0, sizeof(value));
+			ret = ltfs_fsops_getxattr(e->path, "user.tag", value, sizeof(value), &id, vol);
+			CHECK(ret == (int)strlen(e->data));
+			CHECK(! strcmp(value, e->data));
+		}
+	}
+}
+
+/**
+ * Count the top level directories whose children are kept by the dentry cache only.
+ */
+static int evicted_dirs(struct ltfs_volume *vol)
+{
+	int count = 0;
+	struct dentry *root = vol->index->root;
+	struct name_list *entry, *tmp;
+
+	acquireread_mrsw(&fs_dentry_locks(root)->contents_lock);
+	index_spill_load(root, false);
+	HASH_ITER(hh, root->child_list, entry, tmp) {
+		if (entry->d->isdir && __atomic_load_n(&entry->d->dcache_evicted, __ATOMIC_ACQUIRE))
+			++count;
+	}
+	releaseread_mrsw(&fs_dentry_locks(root)->contents_lock);
+
+	return count;
+}
+
+static int remove_file(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+int main(int argc, char **argv)
+{
+	int i, j, ret;
+	char base[] = "/tmp/test_dcache_disk.XXXXXX", tape[64], work[64], path[64];
+	bool reused;
+	struct ltfs_volume *vol;
+
+	ret = ltfs_init(LTFS_ERR, true, false);
+	if (ret == 0)
+		ret = config_file_load(TEST_CONFIG_FILE, &config);
+	if (ret == 0)
+		ret = plugin_load(&backend, "tape", "file", config);
+	if (ret == 0)
+		ret = plugin_load(&dcache_plugin, "dcache", "disk", config);
+	if (ret < 0) {
+		fprintf(stderr, "Cannot load the file backend and the disk dentry cache plugins\n");
+		return 77;
+	}
+	ltfs_fs_init();
+
+	if (! mkdtemp(base)) {
+		fprintf(stderr, "Cannot create a temporary directory\n");
+		return 1;
+	}
+	snprintf(tape, sizeof(tape), "%s/tape", base);
+	snprintf(work, sizeof(work), "%s/work", base);
+	if (mkdir(tape, 0700) < 0 || mkdir(work, 0700) < 0 || format_volume(tape) < 0) {
+		fprintf(stderr, "Cannot format a cartridge in %s\n", tape);
+		nftw(base, remove_file, 16, FTW_DEPTH | FTW_PHYS);
+		return 1;
+	}
+
+	/* Build a tree much larger than the cache keeps in memory */
+	vol = mount_volume(tape);
+	if (! vol)
+		return 1;
+	CHECK(start_dcache(vol, work, &reused) == 0);
+	CHECK(! reused);
+	for (i = 0; i < DIRS; ++i) {
+		snprintf(path, sizeof(path), "/d%02d", i);
+		create_entry(path, true, vol);
+		for (j = 0; j < FILES; ++j) {
+			snprintf(path, sizeof(path), "/d%02d/f%02d", i, j);
+			create_entry(path, false, vol);
+		}
+		snprintf(path, sizeof(path), "/d%02d/sub", i);
+		create_entry(path, true, vol);
+		for (j = 0; j < SUBFILES; ++j) {
+			snprintf(path, sizeof(path), "/d%02d/sub/g%02d", i, j);
+			create_entry(path, false, vol);
+		}
+	}
+	CHECK(evicted_dirs(vol) > 0);
+
+	/* Move and remove entries of evicted directories */
+	rename_entry("/d01/sub", "/d02/moved", vol);
+	rename_entry("/d04/f01", "/d05/x01", vol);
+	remove_entry("/d03/f00", vol);
+	for (j = 0; j < SUBFILES; ++j) {
+		snprintf(path, sizeof(path), "/d06/sub/g%02d", j);
+		remove_entry(path, vol);
+	}
+	remove_entry("/d06/sub", vol);
+	verify(vol);
+	CHECK(evicted_dirs(vol) > 0);
+
+	/* The index is written while directories are evicted */
+	CHECK(ltfs_fsops_volume_sync("test_dcache_disk", vol) == 0);
+	verify(vol);
+	unmount_volume(vol, true);
+
+	/* Without the cache, the whole tree comes from the index */
+	vol = mount_volume(tape);
+	if (! vol)
+		return 1;
+	verify(vol);
+	unmount_volume(vol, false);
+
+	/* The cache of the last mount matches the index, so its records are reused */
+	vol = mount_volume(tape);
+	if (! vol)
+		return 1;
+	CHECK(start_dcache(vol, work, &reused) == 0);
+	CHECK(reused);
+	CHECK(evicted_dirs(vol) > 0);
+	verify(vol);
+	create_entry("/d07/new", false, vol);
+	verify(vol);
+	unmount_volume(vol, true);
+
+	vol = mount_volume(tape);
+	if (! vol)
+		return 1;
+	verify(vol);
+	unmount_volume(vol, false);
+
+	plugin_unload(&dcache_plugin);
+	plugin_unload(&backend);
+	config_file_free(config);
+	nftw(base, remove_file, 16, FTW_DEPTH | FTW_PHYS);
+
+	if (test_failed("checks failed"))
+		return 1;
+	printf("Evicted directories load back intact and reach the index\n");
+	return 0;
+}
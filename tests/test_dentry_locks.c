@@ -0,0 +1,258 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       tests/test_dentry_locks.c
+**
+** DESCRIPTION:     Checks that the lock blocks of idle dentries are released by
+**                  fs_release_idle_dentry_locks(), and that the blocks of
+**                  dentries in use and of their ancestors are kept, and that
+**                  listing a directory with attributes does not allocate the
+**                  blocks of its entries.
+**
+**                  Then accounts the bytes per dentry of a large index after every
+**                  entry was locked once. The index has 100,000 entries by default;
+**                  pass a count to check a larger one, e.g. 10000000.
+**
+*************************************************************************************
+*/
+
+#include "libltfs/ltfs.h"
+#include "libltfs/ltfs_fsops.h"
+#include "libltfs/fs.h"
+#include "libltfs/ltfs_internal.h"
+#include "test_util.h"
+
+#define DIRS  (3)
+#define FILES (1000)
+
+/* Entries per directory of the accounting index */
+#define ACCOUNT_FANOUT (1000)
+#define ACCOUNT_DEFAULT_ENTRIES (100000)
+
+/* Bytes of locks per dentry saved by allocating them on first use, as measured on LP64
+ * when the locks were moved out of struct dentry */
+#define CLAIMED_LOCK_BYTES (312)
+
+static struct dentry *dirs[DIRS];
+static struct dentry *files[DIRS][FILES];
+
+/* Build /d0/d1/d2, each directory holding FILES files */
+static int build_tree(struct ltfs_index *idx)
+{
+	int i, j;
+	char name[32];
+	struct dentry *parent = idx->root;
+
+	for (i = 0; i < DIRS; ++i) {
+		snprintf(name, sizeof(name), "d%d", i);
+		dirs[i] = fs_allocate_dentry(parent, name, NULL, true, false, true, idx);
+		if (! dirs[i])
+			return -LTFS_NO_MEMORY;
+		for (j = 0; j < FILES; ++j) {
+			snprintf(name, sizeof(name), "f%d", j);
+			files[i][j] = fs_allocate_dentry(dirs[i], name, NULL, false, false, true, idx);
+			if (! files[i][j])
+				return -LTFS_NO_MEMORY;
+		}
+		parent = dirs[i];
+	}
+
+	return 0;
+}
+
+/* Lock every file once, as a readdir or a getattr of each file would */
+static void touch_files(void)
+{
+	int i, j;
+
+	for (i = 0; i < DIRS; ++i) {
+		for (j = 0; j < FILES; ++j) {
+			acquireread_mrsw(&fs_dentry_locks(files[i][j])->meta_lock);
+			releaseread_mrsw(&fs_dentry_locks(files[i][j])->meta_lock);
+		}
+	}
+}
+
+/* Count the entries listed with their attributes */
+static int count_plus(void *buf, const char *name, uint64_t offset,
+	const struct dentry_attr *attr, void *priv)
+{
+	if (attr)
+		++*(int *)buf;
+	return 0;
+}
+
+/*
+ * Build an index of 'entries' files spread over directories of ACCOUNT_FANOUT files, lock
+ * every entry once and release the idle lock blocks, then check that the index costs
+ * sizeof(struct dentry) per entry plus the few blocks still live.
+ */
+static void check_accounting(size_t entries)
+{
+	int ret;
+	size_t i, live;
+	char name[32];
+	double per_dentry, embedded, lock_bytes;
+	struct ltfs_volume *vol = NULL;
+	struct dentry *dir = NULL, *d;
+
+	ret = ltfs_volume_alloc("test_dentry_locks_accounting", &vol);
+	if (ret == 0)
+		ret = ltfs_index_alloc(&vol->index, vol);
+	if (ret < 0) {
+		fprintf(stderr, "Cannot set up the accounting volume (%d)\n", ret);
+		++failures;
+		return;
+	}
+
+	for (i = 0; i < entries; ++i) {
+		if (i % ACCOUNT_FANOUT == 0) {
+			snprintf(name, sizeof(name), "d%zu", i / ACCOUNT_FANOUT);
+			dir = fs_allocate_dentry(vol->index->root, name, NULL, true, false, true, vol->index);
+			if (! dir)
+				break;
+		}
+		snprintf(name, sizeof(name), "f%zu", i % ACCOUNT_FANOUT);
+		d = fs_allocate_dentry(dir, name, NULL, false, false, true, vol->index);
+		if (! d)
+			break;
+		acquireread_mrsw(&fs_dentry_locks(d)->meta_lock);
+		releaseread_mrsw(&fs_dentry_locks(d)->meta_lock);
+	}
+	CHECK(i == entries);
+	CHECK(fs_dentry_locks_count() >= entries);
+
+	fs_release_idle_dentry_locks(vol);
+	live = fs_dentry_locks_count();
+	CHECK(live == 1);
+
+	/* Every directory is a dentry too */
+	entries += (entries + ACCOUNT_FANOUT - 1) / ACCOUNT_FANOUT + 1;
+	per_dentry = (double)(entries * sizeof(struct dentry) + live * sizeof(struct dentry_locks))
+		/ entries;
+	lock_bytes = 2 * sizeof(MultiReaderSingleWriter) + sizeof(ltfs_mutex_t);
+	embedded = sizeof(struct dentry) - sizeof(struct dentry_locks *) + lock_bytes;
+	fprintf(stderr, "%zu dentries: %.2f bytes each (%zu dentry, %zu live lock blocks of %zu), "
+			"%.0f with embedded locks\n", entries, per_dentry, sizeof(struct dentry), live,
+			sizeof(struct dentry_locks), embedded);
+
+	CHECK(per_dentry < sizeof(struct dentry) + 1);
+	CHECK(embedded - per_dentry > lock_bytes - sizeof(struct dentry_locks *) - 1);
+#if UINTPTR_MAX > 0xffffffffUL
+	CHECK(embedded - per_dentry >= CLAIMED_LOCK_BYTES);
+#endif
+
+	ltfs_volume_free(&vol);
+	CHECK(fs_dentry_locks_count() == 0);
+}
+
+int main(int argc, char **argv)
+{
+	int ret, listed = 0;
+	size_t base;
+	struct ltfs_volume *vol = NULL;
+	struct dentry *ref = NULL;
+	struct ltfs_dir_cursor cursor;
+
+	ret = ltfs_init(LTFS_ERR, false, false);
+	if (ret < 0) {
+		fprintf(stderr, "ltfs_init failed (%d)\n", ret);
+		return 1;
+	}
+
+	ret = ltfs_volume_alloc("test_dentry_locks", &vol);
+	if (ret == 0)
+		ret = ltfs_index_alloc(&vol->index, vol);
+	if (ret == 0)
+		ret = build_tree(vol->index);
+	if (ret < 0) {
+		fprintf(stderr, "Cannot set up the volume (%d)\n", ret);
+		return 1;
+	}
+
+	/* Building the tree locked every directory */
+	base = fs_dentry_locks_count();
+	CHECK(base == DIRS + 1);
+
+	touch_files();
+	CHECK(fs_dentry_locks_count() == base + DIRS * FILES);
+
+	/* Hold a reference on a file in the deepest directory and a lock on a file of the first */
+	CHECK(fs_directory_lookup(dirs[DIRS - 1], "f7", &ref) == 0 && ref == files[DIRS - 1][7]);
+	acquireread_mrsw(&fs_dentry_locks(files[0][3])->contents_lock);
+
+	fs_release_idle_dentry_locks(vol);
+	CHECK(fs_dentry_locks_count() == DIRS + 3);
+	CHECK(vol->index->root->locks && dirs[0]->locks && dirs[1]->locks && dirs[2]->locks);
+	CHECK(ref->locks && files[0][3]->locks);
+	CHECK(! files[0][4]->locks && ! files[DIRS - 1][6]->locks);
+
+	releaseread_mrsw(&fs_dentry_locks(files[0][3])->contents_lock);
+	fs_release_dentry(ref);
+
+	/* Nothing is in use now but the root, which is never released */
+	fs_release_idle_dentry_locks(vol);
+	CHECK(fs_dentry_locks_count() == 1);
+
+	/* Listing with attributes only locks the directory listed */
+	memset(&cursor, 0, sizeof(cursor));
+	CHECK(ltfs_fsops_readdir_plus(dirs[0], &cursor, 0, &listed, count_plus, NULL, vol) == 0);
+	CHECK(listed == FILES + 1);
+	CHECK(fs_dentry_locks_count() == 2 && dirs[0]->locks && ! files[0][0]->locks);
+	fs_release_idle_dentry_locks(vol);
+	CHECK(fs_dentry_locks_count() == 1);
+
+	/* Released dentries can be locked again */
+	touch_files();
+	CHECK(fs_dentry_locks_count() == 1 + DIRS * FILES);
+	fs_release_idle_dentry_locks(vol);
+	CHECK(fs_dentry_locks_count() == 1);
+
+	CHECK(fs_prepare_dentry_locks(dirs[1]) == 0 && dirs[1]->locks);
+	CHECK(fs_dentry_locks_count() == 2);
+
+	/* Disposing of the index releases the remaining locks */
+	ltfs_volume_free(&vol);
+	CHECK(fs_dentry_locks_count() == 0);
+
+	check_accounting(argc > 1 ? strtoul(argv[1], NULL, 10) : ACCOUNT_DEFAULT_ENTRIES);
+
+	ltfs_finish();
+
+	return test_failed("checks failed") ? 1 : 0;
+}
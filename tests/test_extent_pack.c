@@ -0,0 +1,343 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       tests/test_extent_pack.c
+**
+** DESCRIPTION:     Checks the packed extent list against the extent lists it is
+**                  built from: random lists around the 64 extent group size are
+**                  packed, walked, searched, copied and unpacked, and extents are
+**                  appended and files truncated after packing.
+**
+**                  Usage: test_extent_pack [seed]
+**
+*************************************************************************************
+*/
+
+#include "libltfs/ltfs.h"
+#include "libltfs/ltfs_fsops_raw.h"
+#include "libltfs/fs.h"
+#include "libltfs/extent_pack.h"
+#include "libltfs/ltfs_internal.h"
+#include "test_util.h"
+
+#define GROUP (64)
+#define MAX_EXTENTS (1000)
+#define MAX_APPENDS (2 * GROUP + 2)
+#define RANDOM_LISTS (20)
+#define SEEKS (200)
+
+static const uint32_t counts[] = {
+	1, 2, GROUP - 1, GROUP, GROUP + 1, 2 * GROUP - 1, 2 * GROUP, 2 * GROUP + 1, 10 * GROUP,
+	MAX_EXTENTS
+};
+
+/* Expected extents of the file being checked */
+static struct extent_info ref[MAX_EXTENTS + MAX_APPENDS];
+static uint32_t nref;
+
+static uint64_t seed = 88172645463325252ULL;
+
+/* Random number below n, from a xorshift generator so that runs can be repeated */
+static uint64_t rnd(uint64_t n)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return n ? seed % n : 0;
+}
+
+static bool same_extent(const struct extent_info *a, const struct extent_info *b)
+{
+	return a->start.partition == b->start.partition && a->start.block == b->start.block
+		&& a->byteoffset == b->byteoffset && a->bytecount == b->bytecount
+		&& a->fileoffset == b->fileoffset;
+}
+
+static uint64_t ref_end(void)
+{
+	return nref ? ref[nref - 1].fileoffset + ref[nref - 1].bytecount : 0;
+}
+
+/* Make a random extent starting at or after 'fileoffset', near the previous one on tape */
+static void random_extent(struct extent_info *ext, const struct extent_info *prev,
+	uint64_t fileoffset)
+{
+	uint64_t block = prev ? prev->start.block : rnd(1000);
+
+	ext->start.partition = prev ? prev->start.partition : 'b';
+	if (rnd(8) == 0)
+		ext->start.partition = (ext->start.partition == 'a') ? 'b' : 'a';
+
+	/* Blocks mostly move forward, but may jump far in either direction */
+	switch (rnd(4)) {
+		case 0:
+			block -= (block < 100000) ? block : rnd(100000);
+			break;
+		case 1:
+			block += rnd(1ULL << 40);
+			break;
+		default:
+			block += 1 + rnd(4);
+			break;
+	}
+	ext->start.block = block;
+	ext->byteoffset = rnd(2) ? 0 : rnd(LTFS_DEFAULT_BLOCKSIZE);
+	ext->bytecount = 1 + (rnd(4) ? rnd(4 * LTFS_DEFAULT_BLOCKSIZE) : rnd(1ULL << 36));
+
+	/* Leave a sparse gap before some extents */
+	ext->fileoffset = fileoffset + (rnd(3) ? 0 : rnd(1ULL << 32));
+}
+
+static void make_extents(uint32_t count)
+{
+	uint32_t i;
+
+	for (nref = 0, i = 0; i < count; ++i, ++nref)
+		random_extent(&ref[i], i ? &ref[i - 1] : NULL, ref_end());
+}
+
+/* Create a file holding the expected extents, and pack them */
+static struct dentry *make_file(struct ltfs_index *idx, int n)
+{
+	uint32_t i;
+	char name[32];
+	struct dentry *d;
+	struct extent_info *ext;
+
+	snprintf(name, sizeof(name), "f%d", n);
+	d = fs_allocate_dentry(idx->root, name, NULL, false, false, true, idx);
+	if (! d)
+		return NULL;
+
+	for (i = 0; i < nref; ++i) {
+		ext = calloc(1, sizeof(struct extent_info));
+		if (! ext)
+			return NULL;
+		*ext = ref[i];
+		TAILQ_INSERT_TAIL(&d->extentlist, ext, list);
+		d->realsize += ref[i].bytecount;
+	}
+	d->size = ref_end();
+
+	fs_pack_extents(d);
+	return d;
+}
+
+/* Compare the extents of a file with the expected ones, walking and seeking */
+static void check_extents(struct dentry *d, const char *what)
+{
+	int k;
+	int nfail = failures;
+	uint32_t i, j;
+	uint64_t offset;
+	struct fs_extent_iter iter;
+	const struct extent_info *ext;
+
+	for (i = 0, ext = fs_extent_first(d, &iter); ext && i < nref; ext = fs_extent_next(d, &iter), ++i)
+		CHECK(same_extent(ext, &ref[i]));
+	CHECK(i == nref && ! ext);
+
+	ext = fs_extent_last(d);
+	CHECK(nref ? (ext && same_extent(ext, &ref[nref - 1])) : ! ext);
+
+	for (k = 0; k < SEEKS + 3 * (int)nref; ++k) {
+		/* Random offsets, and the start, last byte and end of every extent */
+		if (k < SEEKS)
+			offset = rnd(ref_end() + 2);
+		else {
+			j = (k - SEEKS) / 3;
+			offset = ref[j].fileoffset + ((k - SEEKS) % 3 ? ref[j].bytecount - 2 + (k - SEEKS) % 3 : 0);
+		}
+
+		for (i = 0; i < nref && ref[i].fileoffset + ref[i].bytecount <= offset; ++i);
+		ext = fs_extent_seek(d, offset, &iter);
+		if (i == nref) {
+			CHECK(! ext);
+			continue;
+		}
+
+		/* Walk on past the next group boundary */
+		for (j = i; ext && j < nref && j < i + GROUP + 1; ext = fs_extent_next(d, &iter), ++j)
+			CHECK(same_extent(ext, &ref[j]));
+		CHECK(j == nref ? ! ext : j == i + GROUP + 1);
+	}
+
+	if (failures != nfail)
+		fprintf(stderr, "%s: %u extents, %s\n", what, nref, d->extent_pack ? "packed" : "listed");
+}
+
+/* Check that a copy of a packed list walks the same */
+static void check_copy(struct dentry *d)
+{
+	uint32_t i;
+	struct extent_pack *copy;
+	struct extent_pack_iter iter;
+	const struct extent_info *ext;
+
+	if (! d->extent_pack)
+		return;
+
+	copy = extent_pack_copy(d->extent_pack);
+	CHECK(copy && extent_pack_count(copy) == nref);
+	if (! copy)
+		return;
+	for (i = 0, ext = extent_pack_first(copy, &iter); ext && i < nref; ext = extent_pack_next(&iter), ++i)
+		CHECK(same_extent(ext, &ref[i]));
+	CHECK(i == nref && ! ext);
+	extent_pack_free(copy);
+}
+
+/* Append extents to a packed list, extending the last one in place now and then */
+static void check_append(struct dentry *d)
+{
+	uint32_t i, count;
+	struct extent_info ext, *tail;
+
+	if (! d->extent_pack)
+		return;
+
+	/* An extent overlapping the last one is refused */
+	ext = ref[nref - 1];
+	CHECK(extent_pack_append(d->extent_pack, &ext) == -LTFS_BAD_ARG);
+	check_extents(d, "refused append");
+
+	count = 1 + rnd(MAX_APPENDS);
+	for (i = 0; i < count; ++i) {
+		if (rnd(4) == 0) {
+			tail = extent_pack_tail(d->extent_pack);
+			tail->bytecount += LTFS_DEFAULT_BLOCKSIZE;
+			ref[nref - 1].bytecount += LTFS_DEFAULT_BLOCKSIZE;
+		}
+		random_extent(&ext, &ref[nref - 1], ref_end());
+		CHECK(extent_pack_append(d->extent_pack, &ext) == 0);
+		ref[nref++] = ext;
+	}
+	d->size = ref_end();
+	CHECK(extent_pack_count(d->extent_pack) == nref);
+	check_extents(d, "append");
+}
+
+/* Expected effect of ltfs_fsraw_truncate() on the extents */
+static void truncate_ref(uint64_t length)
+{
+	while (nref && ref[nref - 1].fileoffset >= length)
+		--nref;
+	if (nref && ref_end() > length)
+		ref[nref - 1].bytecount = length - ref[nref - 1].fileoffset;
+}
+
+/* Truncate the last extent, which keeps the list packed, then truncate further back */
+static void check_truncate(struct dentry *d, struct ltfs_volume *vol)
+{
+	uint64_t length;
+
+	if (d->extent_pack && ref[nref - 1].bytecount > 1) {
+		length = ref[nref - 1].fileoffset + 1 + rnd(ref[nref - 1].bytecount - 1);
+		CHECK(ltfs_fsraw_truncate(d, length, vol) == 0);
+		truncate_ref(length);
+		CHECK(d->extent_pack != NULL);
+		check_extents(d, "truncate in the last extent");
+	}
+
+	length = rnd(ref_end());
+	CHECK(ltfs_fsraw_truncate(d, length, vol) == 0);
+	truncate_ref(length);
+	check_extents(d, "truncate");
+
+	fs_pack_extents(d);
+	CHECK((d->extent_pack != NULL) == (nref >= EXTENT_PACK_MIN_EXTENTS));
+	check_extents(d, "packed again");
+}
+
+static void check_list(struct ltfs_volume *vol, uint32_t count, int n)
+{
+	struct dentry *d;
+
+	make_extents(count);
+	d = make_file(vol->index, n);
+	CHECK(d != NULL);
+	if (! d)
+		return;
+
+	CHECK((d->extent_pack != NULL) == (count >= EXTENT_PACK_MIN_EXTENTS));
+	check_extents(d, "pack");
+	check_copy(d);
+
+	/* The unpacked list is the one packed */
+	CHECK(fs_unpack_extents(d) == 0 && ! d->extent_pack);
+	check_extents(d, "unpack");
+	fs_pack_extents(d);
+
+	check_append(d);
+	check_copy(d);
+	check_truncate(d, vol);
+}
+
+int main(int argc, char **argv)
+{
+	int ret, n = 0;
+	size_t i;
+	struct ltfs_volume *vol = NULL;
+
+	if (argc > 1)
+		seed = strtoull(argv[1], NULL, 0);
+
+	ret = ltfs_init(LTFS_ERR, false, false);
+	if (ret < 0) {
+		fprintf(stderr, "ltfs_init failed (%d)\n", ret);
+		return 1;
+	}
+
+	ret = ltfs_volume_alloc("test_extent_pack", &vol);
+	if (ret == 0)
+		ret = ltfs_index_alloc(&vol->index, vol);
+	if (ret < 0) {
+		fprintf(stderr, "Cannot set up the volume (%d)\n", ret);
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+		check_list(vol, counts[i], n++);
+	for (i = 0; i < RANDOM_LISTS; ++i)
+		check_list(vol, EXTENT_PACK_MIN_EXTENTS + rnd(MAX_EXTENTS - EXTENT_PACK_MIN_EXTENTS), n++);
+
+	ltfs_volume_free(&vol);
+	ltfs_finish();
+
+	return test_failed("checks failed") ? 1 : 0;
+}
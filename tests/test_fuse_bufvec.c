@@ -0,0 +1,200 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       tests/test_fuse_bufvec.c
+**
+** DESCRIPTION:     Checks that the FUSE write source copies from the requested
+**                  position of memory, file and pipe buffer vectors.
+**
+*************************************************************************************
+*/
+
+#include <fuse.h>
+#include <unistd.h>
+
+#include "libltfs/ltfs.h"
+#include "ltfs_fuse.h"
+#include "test_util.h"
+
+#if FUSE_VERSION >= 29
+
+#define BUFFERS (3)
+
+static const size_t sizes[BUFFERS] = { 5, 7, 11 };
+
+static char data[32];
+static size_t total;
+
+static struct fuse_bufvec *new_bufvec(void)
+{
+	struct fuse_bufvec *bufv;
+
+	bufv = calloc(1, sizeof(struct fuse_bufvec) + (BUFFERS - 1) * sizeof(struct fuse_buf));
+	if (! bufv) {
+		fprintf(stderr, "Cannot allocate the buffer vector\n");
+		exit(1);
+	}
+	bufv->count = BUFFERS;
+	return bufv;
+}
+
+/* A vector of memory buffers holding 'data' */
+static struct fuse_bufvec *mem_bufvec(void)
+{
+	struct fuse_bufvec *bufv = new_bufvec();
+	size_t i, start = 0;
+
+	for (i = 0; i < BUFFERS; ++i) {
+		bufv->buf[i].size = sizes[i];
+		bufv->buf[i].mem = data + start;
+		bufv->buf[i].fd = -1;
+		start += sizes[i];
+	}
+	return bufv;
+}
+
+/* A vector of file buffers holding 'data', read at their positions or in order */
+static struct fuse_bufvec *fd_bufvec(int fd, bool seek)
+{
+	struct fuse_bufvec *bufv = new_bufvec();
+	size_t i, start = 0;
+
+	for (i = 0; i < BUFFERS; ++i) {
+		bufv->buf[i].size = sizes[i];
+		bufv->buf[i].flags = FUSE_BUF_IS_FD | (seek ? FUSE_BUF_FD_SEEK : 0);
+		bufv->buf[i].fd = fd;
+		bufv->buf[i].pos = start;
+		start += sizes[i];
+	}
+	return bufv;
+}
+
+/* Copy 'size' bytes from 'pos' and compare them with the data */
+static void check_copy(struct fuse_bufvec *bufv, size_t pos, size_t size)
+{
+	char dst[sizeof(data)];
+	ssize_t ret;
+
+	memset(dst, 0, sizeof(dst));
+	ret = _ltfs_fuse_bufvec_source(dst, size, pos, bufv);
+	CHECK(ret == (ssize_t)size);
+	if (ret == (ssize_t)size && memcmp(dst, data + pos, size)) {
+		fprintf(stderr, "Wrong data copied from %zu, %zu bytes\n", pos, size);
+		++failures;
+	}
+}
+
+/* Copies in order, then out of order: backwards, forwards, within a buffer and across
+ * buffer boundaries */
+static void check_random_access(struct fuse_bufvec *bufv)
+{
+	size_t pos, size;
+
+	for (pos = 0; pos < total; pos += size) {
+		size = (pos % 4) + 1;
+		if (pos + size > total)
+			size = total - pos;
+		check_copy(bufv, pos, size);
+	}
+	check_copy(bufv, 0, total);
+	check_copy(bufv, 3, 4);
+	check_copy(bufv, 12, 11);
+	check_copy(bufv, 1, 2);
+	check_copy(bufv, 5, 7);
+	check_copy(bufv, 4, 15);
+	check_copy(bufv, 22, 1);
+	check_copy(bufv, total, 0);
+}
+
+int main(int argc, char **argv)
+{
+	struct fuse_bufvec *bufv;
+	char path[] = "/tmp/test_fuse_bufvec.XXXXXX", dst[sizeof(data)];
+	int fd, pipe_fds[2];
+	size_t i;
+
+	for (i = 0; i < BUFFERS; ++i)
+		total += sizes[i];
+	for (i = 0; i < total; ++i)
+		data[i] = 'a' + i;
+
+	bufv = mem_bufvec();
+	check_random_access(bufv);
+	free(bufv);
+
+	fd = mkstemp(path);
+	if (fd < 0 || write(fd, data, total) != (ssize_t)total) {
+		fprintf(stderr, "Cannot create %s\n", path);
+		return 1;
+	}
+	unlink(path);
+	bufv = fd_bufvec(fd, true);
+	check_random_access(bufv);
+	free(bufv);
+	close(fd);
+
+	/* A pipe is read in order, and a copy from anywhere else is refused */
+	if (pipe(pipe_fds) < 0 || write(pipe_fds[1], data, total) != (ssize_t)total) {
+		fprintf(stderr, "Cannot create a pipe\n");
+		return 1;
+	}
+	bufv = fd_bufvec(pipe_fds[0], false);
+	check_copy(bufv, 0, 3);
+	check_copy(bufv, 3, 6);
+	CHECK(_ltfs_fuse_bufvec_source(dst, 2, 0, bufv) < 0);
+	CHECK(_ltfs_fuse_bufvec_source(dst, 2, 14, bufv) < 0);
+	check_copy(bufv, 9, total - 9);
+	free(bufv);
+	close(pipe_fds[0]);
+	close(pipe_fds[1]);
+
+	if (test_failed("checks failed"))
+		return 1;
+	printf("Buffer vector copies honour their position\n");
+	return 0;
+}
+
+#else
+
+/* FUSE versions without buffer vectors have no write source */
+int main(int argc, char **argv)
+{
+	return 77;
+}
+
+#endif /* FUSE_VERSION >= 29 */
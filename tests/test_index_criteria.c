@@ -0,0 +1,258 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       tests/test_index_criteria.c
+**
+** DESCRIPTION:     Checks that the automaton compiled from the name= rules of the
+**                  index criteria gives the same decision as the glob matcher, and
+**                  as a plain reference glob for ASCII names, over fixed and random
+**                  rule sets.
+**
+*************************************************************************************
+*/
+
+#include <ctype.h>
+#include <unicode/ucnv.h>
+
+#include "libltfs/ltfs.h"
+#include "libltfs/ltfs_internal.h"
+#include "libltfs/index_criteria.h"
+#include "test_util.h"
+
+#define RULE_SETS  (1500)
+#define NAMES      (40)
+#define MAX_RULES  (6)
+
+static int compared = 0;
+
+/* Characters of random rules and names. Upper and lower case mix so that folding is
+ * exercised; the names also hold literal wildcards, which rules must not expand. */
+static const char *rule_chars[] = { "a", "b", "A", "B", ".", "x", "*", "*", "?", "\xc3\xa9", "\xc3\x89" };
+static const char *name_chars[] = { "a", "b", "A", "B", ".", "x", "X", "*", "?", "-", "\xc3\xa9" };
+
+#define RULE_CHAR_COUNT (sizeof(rule_chars) / sizeof(rule_chars[0]))
+#define NAME_CHAR_COUNT (sizeof(name_chars) / sizeof(name_chars[0]))
+
+/* Caseless glob over ASCII strings, where each byte is one character */
+static bool ref_glob(const char *rule, const char *name)
+{
+	if (*rule == '\0')
+		return *name == '\0';
+	if (*rule == '*') {
+		do {
+			if (ref_glob(rule + 1, name))
+				return true;
+		} while (*name++);
+		return false;
+	}
+	if (*name == '\0')
+		return false;
+	if (*rule != '?' && tolower((unsigned char) *rule) != tolower((unsigned char) *name))
+		return false;
+	return ref_glob(rule + 1, name + 1);
+}
+
+static bool is_ascii(const char *str)
+{
+	for (; *str; ++str) {
+		if ((unsigned char) *str >= 0x80)
+			return false;
+	}
+	return true;
+}
+
+/* Replace the criteria of the volume with the given rules */
+static int set_rules(struct ltfs_volume *vol, const char **rules, int count)
+{
+	int i, ret;
+	char buf[512];
+	size_t len;
+
+	len = snprintf(buf, sizeof(buf), "name=");
+	for (i = 0; i < count; ++i)
+		len += snprintf(buf + len, sizeof(buf) - len, "%s%s", i ? ":" : "", rules[i]);
+	snprintf(buf + len, sizeof(buf) - len, "/size=1M");
+
+	ret = index_criteria_parse(buf, vol);
+	if (ret < 0)
+		fprintf(stderr, "Cannot parse \"%s\" (%d)\n", buf, ret);
+	return ret;
+}
+
+/* Match a name with and without the automaton, and against the reference for ASCII */
+static void compare(struct ltfs_volume *vol, const char **rules, int count, const char *name)
+{
+	int i;
+	bool with_dfa, without_dfa, ref = false;
+	struct dentry d;
+	struct index_criteria *ic = &vol->index->index_criteria;
+	struct index_criteria_dfa *dfa = ic->glob_dfa;
+
+	memset(&d, 0, sizeof(d));
+	d.name.name = (char *) name;
+
+	with_dfa = index_criteria_match(&d, vol);
+	ic->glob_dfa = NULL;
+	without_dfa = index_criteria_match(&d, vol);
+	ic->glob_dfa = dfa;
+
+	if (is_ascii(name)) {
+		for (i = 0; i < count && ! ref; ++i)
+			ref = is_ascii(rules[i]) && ref_glob(rules[i], name);
+	} else {
+		ref = without_dfa;
+	}
+
+	++compared;
+	if (with_dfa != without_dfa || with_dfa != ref) {
+		fprintf(stderr, "\"%s\" gives %d with the automaton, %d without, %d expected; rules",
+			name, with_dfa, without_dfa, ref);
+		for (i = 0; i < count; ++i)
+			fprintf(stderr, " \"%s\"", rules[i]);
+		fprintf(stderr, "\n");
+		++failures;
+	}
+}
+
+static void random_string(char *buf, size_t max, const char **chars, size_t nchars,
+	unsigned int *seed)
+{
+	size_t len = 0, want = 1 + rand_r(seed) % max;
+	const char *c;
+
+	while (want--) {
+		c = chars[rand_r(seed) % nchars];
+		strcpy(buf + len, c);
+		len += strlen(c);
+	}
+}
+
+/* Rule sets of the kind found in practice */
+static const char *fixed_rules[] = {
+	"*.txt", "*.JPG", "Thumbs*", "*cache*idx*", "data??.dat", "IMG_????.RAW", "*.bak*",
+	"core.*", ".*rc", "*~", "*-v?.?.*", "readme", "*", "?",
+};
+
+static const char *fixed_names[] = {
+	"a.txt", "A.TXT", "a.txt.gz", ".txt", "txt", "photo.jpg", "photo.Jpg", "thumbs.db",
+	"Thumbs", "xcacheyidx", "cacheidx", "cache.idx.old", "data01.dat", "data1.dat",
+	"data001.dat", "img_0001.raw", "IMG_001.RAW", "x.bak", "x.BAK.1", "core.1234", "core",
+	".bashrc", "bashrc", "file~", "~", "lib-v1.2.so", "lib-v1.22.so", "README", "readme.md",
+	"a", "ab", "*", "?", "a\xc3\xa9.txt", "\xc3\xa9", "\xc3\x89.TXT",
+};
+
+#define FIXED_RULE_COUNT (sizeof(fixed_rules) / sizeof(fixed_rules[0]))
+#define FIXED_NAME_COUNT (sizeof(fixed_names) / sizeof(fixed_names[0]))
+
+int main(int argc, char **argv)
+{
+	int ret, i, j, count;
+	size_t k;
+	unsigned int seed = 4711;
+	char rulebuf[MAX_RULES][32], namebuf[64];
+	const char *rules[MAX_RULES];
+	const char *blowup[] = { "*a??????????????" };
+	const char *mixed[] = { "\xc3\xa9*", "*.txt" };
+	struct ltfs_volume *vol = NULL;
+
+	/* Rules and names are converted from the system encoding */
+	ucnv_setDefaultName("UTF-8");
+
+	ret = ltfs_init(LTFS_NONE, false, false);
+	if (ret == 0)
+		ret = ltfs_volume_alloc("test_index_criteria", &vol);
+	if (ret == 0)
+		ret = ltfs_index_alloc(&vol->index, vol);
+	if (ret < 0) {
+		fprintf(stderr, "Cannot set up the volume (%d)\n", ret);
+		return 1;
+	}
+
+	/* Each fixed rule alone, all but the catch-all rules together, and all of them */
+	for (k = 0; k < FIXED_RULE_COUNT; ++k) {
+		if (set_rules(vol, &fixed_rules[k], 1) < 0)
+			return 1;
+		CHECK(vol->index->index_criteria.glob_dfa);
+		for (j = 0; j < (int) FIXED_NAME_COUNT; ++j)
+			compare(vol, &fixed_rules[k], 1, fixed_names[j]);
+	}
+	for (count = FIXED_RULE_COUNT - 2; count <= (int) FIXED_RULE_COUNT; count += 2) {
+		if (set_rules(vol, fixed_rules, count) < 0)
+			return 1;
+		CHECK(vol->index->index_criteria.glob_dfa);
+		for (j = 0; j < (int) FIXED_NAME_COUNT; ++j)
+			compare(vol, fixed_rules, count, fixed_names[j]);
+	}
+
+	/* A non-ASCII rule leaves ASCII names to the automaton and the others to ICU */
+	if (set_rules(vol, mixed, 2) < 0)
+		return 1;
+	CHECK(vol->index->index_criteria.glob_dfa);
+	for (j = 0; j < (int) FIXED_NAME_COUNT; ++j)
+		compare(vol, mixed, 2, fixed_names[j]);
+
+	/* Too many states for the automaton, so the glob matcher decides alone */
+	if (set_rules(vol, blowup, 1) < 0)
+		return 1;
+	CHECK(! vol->index->index_criteria.glob_dfa);
+	compare(vol, blowup, 1, "xxa12345678901234");
+	compare(vol, blowup, 1, "a1234567890123");
+
+	for (i = 0; i < RULE_SETS; ++i) {
+		count = 1 + rand_r(&seed) % MAX_RULES;
+		for (j = 0; j < count; ++j) {
+			random_string(rulebuf[j], 6, rule_chars, RULE_CHAR_COUNT, &seed);
+			rules[j] = rulebuf[j];
+		}
+		if (set_rules(vol, rules, count) < 0)
+			return 1;
+		for (j = 0; j < NAMES; ++j) {
+			random_string(namebuf, 10, name_chars, NAME_CHAR_COUNT, &seed);
+			compare(vol, rules, count, namebuf);
+		}
+	}
+
+	index_criteria_free(&vol->index->index_criteria);
+	ltfs_volume_free(&vol);
+	ltfs_finish();
+
+	if (test_failed("checks failed"))
+		return 1;
+	printf("%d names agree with the glob matcher\n", compared);
+	return 0;
+}
@@ -0,0 +1,169 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       tests/test_path_cache.c
+**
+** DESCRIPTION:     Checks that cached paths do not hold handles on their dentries,
+**                  and that a dentry freed while its path is cached is neither
+**                  returned nor touched by later lookups, also while lookups
+**                  run in other threads.
+**
+*************************************************************************************
+*/
+
+#include "libltfs/ltfs.h"
+#include "libltfs/fs.h"
+#include "libltfs/ltfs_internal.h"
+#include "libltfs/path_cache.h"
+#include "test_util.h"
+
+#define FILES  (16)
+#define ROUNDS (2000)
+
+struct stress {
+	struct ltfs_index *idx;
+	volatile bool stop;
+	uint64_t hits;
+};
+
+static int add_files(struct dentry *dir, struct ltfs_index *idx)
+{
+	int i;
+	char name[32];
+
+	for (i = 0; i < FILES; ++i) {
+		snprintf(name, sizeof(name), "f%d", i);
+		if (! fs_allocate_dentry(dir, name, NULL, false, false, true, idx))
+			return -LTFS_NO_MEMORY;
+	}
+	return 0;
+}
+
+/* Drop the files of a directory, as the index spill does when it evicts it */
+static void drop_files(struct dentry *dir)
+{
+	acquirewrite_mrsw(&fs_dentry_locks(dir)->contents_lock);
+	fs_release_children(dir);
+	releasewrite_mrsw(&fs_dentry_locks(dir)->contents_lock);
+}
+
+static void *lookup_thread(void *arg)
+{
+	struct stress *s = arg;
+	struct dentry *d;
+	char path[32];
+	unsigned int i = 0;
+
+	while (! s->stop) {
+		snprintf(path, sizeof(path), "/d/f%u", (i++) % FILES);
+		if (fs_path_lookup(path, 0, &d, s->idx) == 0) {
+			if (strcmp(d->platform_safe_name, path + 3))
+				__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+			fs_release_dentry(d);
+			++s->hits;
+		}
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int ret, i;
+	pthread_t tid;
+	struct ltfs_volume *vol = NULL;
+	struct ltfs_index *idx;
+	struct dentry *dir = NULL, *d = NULL, *again = NULL;
+	struct stress s;
+
+	ret = ltfs_init(LTFS_ERR, false, false);
+	if (ret == 0)
+		ret = ltfs_volume_alloc("test_path_cache", &vol);
+	if (ret == 0)
+		ret = ltfs_index_alloc(&vol->index, vol);
+	if (ret == 0) {
+		idx = vol->index;
+		dir = fs_allocate_dentry(idx->root, "d", NULL, true, false, true, idx);
+		ret = dir ? add_files(dir, idx) : -LTFS_NO_MEMORY;
+	}
+	if (ret < 0) {
+		fprintf(stderr, "Cannot set up the volume (%d)\n", ret);
+		return 1;
+	}
+
+	/* A cached path leaves the dentry with the handle of its parent only */
+	CHECK(fs_path_lookup("/d/f1", 0, &d, idx) == 0);
+	fs_release_dentry(d);
+	CHECK(d->numhandles == 1 && d->path_cached == 1);
+	CHECK(fs_path_lookup("/d/f1", 0, &again, idx) == 0 && again == d);
+	CHECK(d->numhandles == 2);
+	fs_release_dentry(again);
+
+	/* Negative entries are remembered too */
+	CHECK(fs_path_lookup("/d/nothing", 0, &d, idx) == -LTFS_NO_DENTRY);
+	CHECK(fs_path_lookup("/d/nothing", 0, &d, idx) == -LTFS_NO_DENTRY);
+
+	/* The dentry can be freed while its path is cached, and a later lookup walks again */
+	drop_files(dir);
+	CHECK(fs_path_lookup("/d/f1", 0, &d, idx) == -LTFS_NO_DENTRY);
+	CHECK(add_files(dir, idx) == 0);
+	path_cache_invalidate(idx->path_cache, "/d", true);
+	CHECK(fs_path_lookup("/d/f1", 0, &d, idx) == 0 && d->parent == dir);
+	fs_release_dentry(d);
+
+	/* Free and recreate the files while another thread looks them up */
+	s.idx = idx;
+	s.stop = false;
+	s.hits = 0;
+	pthread_create(&tid, NULL, lookup_thread, &s);
+	for (i = 0; i < ROUNDS; ++i) {
+		drop_files(dir);
+		CHECK(add_files(dir, idx) == 0);
+		path_cache_invalidate(idx->path_cache, "/d", true);
+		if (i % 64 == 0)
+			sched_yield();
+	}
+	s.stop = true;
+	pthread_join(tid, NULL);
+	CHECK(s.hits > 0);
+
+	ltfs_volume_free(&vol);
+	ltfs_finish();
+
+	return test_failed("checks failed") ? 1 : 0;
+}
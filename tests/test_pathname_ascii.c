@@ -0,0 +1,264 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       tests/test_pathname_ascii.c
+**
+** DESCRIPTION:     Checks that the ASCII fast paths of the path name functions
+**                  give the same results and errors as ICU over a large random
+**                  set of names, with and without non-ASCII characters.
+**
+*************************************************************************************
+*/
+
+#include <unicode/ucnv.h>
+#include <unicode/utf8.h>
+
+#include "libltfs/ltfs.h"
+#include "libltfs/pathname.h"
+#include "test_util.h"
+
+#define STRINGS (200000)
+#define MAX_LEN (300)
+
+/* ICU implementations in pathname.c, which the ASCII fast paths must agree with */
+int _pathname_validate(const char *name, bool allow_slash);
+int _pathname_valid_in_xml(UChar32 c);
+int _pathname_format_icu(const char *src, char **dest, bool validate, bool allow_slash);
+int _pathname_normalize_utf8_icu(const char *src, char **dest);
+int _pathname_utf8_to_system_icu(const char *src, char **dest);
+int _pathname_normalize_utf8_nfd_icu(const char *src, char **dest);
+
+/* Valid and invalid UTF-8 sequences mixed into the non-ASCII strings */
+static const char *sequences[] = {
+	"\xc3\xa9",         /* precomposed e acute */
+	"e\xcc\x81",        /* e followed by a combining acute accent */
+	"\xe3\x81\x8c",     /* hiragana ga */
+	"\xe3\x81\x8b\xe3\x82\x99", /* hiragana ka with a combining voiced mark */
+	"\xf0\x9f\x98\x80", /* a code point outside the BMP */
+	"\xef\xbf\xbe",     /* U+FFFE, not valid in XML */
+	"\xff",             /* never valid in UTF-8 */
+	"\x80",             /* lone continuation byte */
+	"\xc3",             /* truncated sequence */
+	"\xed\xa0\x80",     /* encoded surrogate */
+};
+
+#define SEQUENCE_COUNT (sizeof(sequences) / sizeof(sequences[0]))
+
+/* _pathname_validate() as it was before the ASCII fast path */
+static int old_validate(const char *name, bool allow_slash)
+{
+	UChar32 c;
+	int32_t i = 0, len;
+
+	len = strlen(name);
+	while (i < len) {
+		U8_NEXT(name, i, len, c);
+		if (c < 0)
+			return -LTFS_ICU_ERROR;
+
+		if (_pathname_valid_in_xml(c) == 0 || (! allow_slash && c == '/'))
+			return -LTFS_INVALID_PATH;
+	}
+
+	return 0;
+}
+
+/* pathname_format() as it was before the ASCII fast path */
+static int old_format(const char *name, char **new_name, bool validate, bool allow_slash)
+{
+	int ret;
+
+	ret = _pathname_format_icu(name, new_name, false, allow_slash);
+	if (ret < 0 || ! validate)
+		return ret;
+
+	if (! allow_slash) {
+		ret = pathname_strlen(*new_name);
+		if (ret > LTFS_FILENAME_MAX)
+			ret = -LTFS_NAMETOOLONG;
+	}
+	if (ret >= 0)
+		ret = old_validate(*new_name, allow_slash);
+	if (ret < 0) {
+		free(*new_name);
+		*new_name = NULL;
+		return ret;
+	}
+	return 0;
+}
+
+static void report(const char *what, const char *name, int ret_new, int ret_old)
+{
+	size_t i;
+
+	fprintf(stderr, "%s differs (%d, %d) for \"", what, ret_new, ret_old);
+	for (i = 0; name[i]; ++i) {
+		if ((unsigned char) name[i] < 0x20 || (unsigned char) name[i] >= 0x7f)
+			fprintf(stderr, "\\x%02x", (unsigned char) name[i]);
+		else
+			fputc(name[i], stderr);
+	}
+	fprintf(stderr, "\"\n");
+	++failures;
+}
+
+/* Compare return values, and outputs when both calls succeed */
+static void compare_result(const char *what, const char *name, int ret_new, char *out_new,
+	int ret_old, char *out_old)
+{
+	if (ret_new != ret_old || (ret_new >= 0 && strcmp(out_new, out_old)))
+		report(what, name, ret_new, ret_old);
+	if (ret_new >= 0)
+		free(out_new);
+	if (ret_old >= 0)
+		free(out_old);
+}
+
+static void compare(const char *name)
+{
+	int ret_new, ret_old, flags;
+	char *out_new = NULL, *out_old = NULL;
+
+	for (flags = 0; flags < 4; ++flags) {
+		ret_new = pathname_format(name, &out_new, flags & 1, flags & 2);
+		ret_old = old_format(name, &out_old, flags & 1, flags & 2);
+		compare_result("pathname_format", name, ret_new, out_new, ret_old, out_old);
+	}
+
+	ret_new = pathname_unformat(name, &out_new);
+	ret_old = _pathname_utf8_to_system_icu(name, &out_old);
+	compare_result("pathname_unformat", name, ret_new, out_new, ret_old, out_old);
+
+	ret_new = pathname_normalize(name, &out_new);
+	ret_old = _pathname_normalize_utf8_icu(name, &out_old);
+	compare_result("pathname_normalize", name, ret_new, out_new, ret_old, out_old);
+
+	ret_new = pathname_nfd_normalize(name, &out_new);
+	ret_old = _pathname_normalize_utf8_nfd_icu(name, &out_old);
+	compare_result("pathname_nfd_normalize", name, ret_new, out_new, ret_old, out_old);
+
+	for (flags = 0; flags < 2; ++flags) {
+		ret_new = _pathname_validate(name, flags);
+		ret_old = old_validate(name, flags);
+		if (ret_new != ret_old)
+			report("_pathname_validate", name, ret_new, ret_old);
+	}
+}
+
+/* Fill buf with a random string, mostly printable ASCII with some control characters,
+ * slashes and, if mixed is true, UTF-8 sequences */
+static void random_string(char *buf, unsigned int *seed, bool mixed)
+{
+	size_t len = 0, want, n;
+	unsigned int r;
+	const char *seq;
+
+	/* Mostly short names, sometimes names longer than LTFS_FILENAME_MAX */
+	want = (rand_r(seed) % 16) ? rand_r(seed) % 40 : rand_r(seed) % MAX_LEN;
+	while (len < want) {
+		r = rand_r(seed) % 100;
+		if (mixed && r < 10) {
+			seq = sequences[rand_r(seed) % SEQUENCE_COUNT];
+			n = strlen(seq);
+			if (len + n > MAX_LEN)
+				break;
+			memcpy(buf + len, seq, n);
+			len += n;
+			continue;
+		}
+		if (r < 12)
+			buf[len++] = '/';
+		else if (r < 14)
+			buf[len++] = 1 + rand_r(seed) % 0x1f;
+		else
+			buf[len++] = 0x20 + rand_r(seed) % 0x5f;
+	}
+	buf[len] = '\0';
+}
+
+int main(int argc, char **argv)
+{
+	int ret, i, len, pos;
+	unsigned int seed = 12345;
+	char buf[MAX_LEN + 8];
+
+	/* The formatting fast path depends on the system encoding, so pin the one LTFS
+	 * normally runs with before any name is converted */
+	ucnv_setDefaultName(argc > 1 ? argv[1] : "UTF-8");
+
+	ret = ltfs_init(LTFS_NONE, false, false);
+	if (ret < 0) {
+		fprintf(stderr, "Cannot initialize libltfs (%d)\n", ret);
+		return 1;
+	}
+
+	/* A non-ASCII byte at every position of every length that crosses a word boundary */
+	for (len = 0; len <= 17; ++len) {
+		memset(buf, 'a', len);
+		buf[len] = '\0';
+		compare(buf);
+		for (pos = 0; pos < len; ++pos) {
+			buf[pos] = '\xe9';
+			compare(buf);
+			buf[pos] = 0x1f;
+			compare(buf);
+			buf[pos] = '/';
+			compare(buf);
+			buf[pos] = 'a';
+		}
+	}
+
+	/* Names of exactly and just over the maximum length */
+	for (len = LTFS_FILENAME_MAX - 1; len <= LTFS_FILENAME_MAX + 1; ++len) {
+		memset(buf, 'n', len);
+		buf[len] = '\0';
+		compare(buf);
+	}
+
+	for (i = 0; i < STRINGS; ++i) {
+		random_string(buf, &seed, (i % 4) == 0);
+		compare(buf);
+	}
+
+	ltfs_finish();
+
+	if (test_failed("results differ"))
+		return 1;
+	printf("%d strings agree with ICU (system encoding %s)\n", STRINGS, ucnv_getDefaultName());
+	return 0;
+}
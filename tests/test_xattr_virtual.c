@@ -0,0 +1,284 @@
+/*
+**
+**  OO_Copyright_BEGIN
+**
+**
+**  Copyright 2010, 2025 IBM Corp. All rights reserved.
+**
+**  Redistribution and use in source and binary forms, with or without
+**   modification, are permitted provided that the following conditions
+**  are met:
+**  1. Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**  2. Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in the
+**  documentation and/or other materials provided with the distribution.
+**  3. Neither the name of the copyright holder nor the names of its
+**     contributors may be used to endorse or promote products derived from
+**     this software without specific prior written permission.
+**
+**  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+**  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+**  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+**  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+**  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+**  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+**  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+**  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+**  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+**  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+**  POSSIBILITY OF SUCH DAMAGE.
+**
+**
+**  OO_Copyright_END
+**
+*************************************************************************************
+**
+** COMPONENT NAME:  IBM Linear Tape File System
+**
+** FILE NAME:       tests/test_xattr_virtual.c
+**
+** DESCRIPTION:     Checks that the virtual EA table resolves every name on every kind
+**                  of dentry exactly as the strcmp chain it replaced did.
+**
+*************************************************************************************
+*/
+
+#include "libltfs/ltfs.h"
+#include "libltfs/fs.h"
+#include "libltfs/ltfs_internal.h"
+#include "libltfs/xattr.h"
+#include "test_util.h"
+
+/* The strcmp chain of xattr.c before the table was introduced, kept as a reference */
+static bool old_is_worm_ea(const char *name)
+{
+	if (!strcmp(name, "ltfs.vendor.IBM.immutable") || !strcmp(name, "ltfs.vendor.IBM.appendonly")) {
+		/* WORM related xattr */
+		return true;
+	}
+	return false;
+}
+
+static bool old_is_virtual(struct dentry *d, const char *name, struct ltfs_volume *vol)
+{
+	/* xattrs on all dentries */
+	if (! strcmp(name, "ltfs.createTime")
+		|| ! strcmp(name, "ltfs.modifyTime")
+		|| ! strcmp(name, "ltfs.accessTime")
+		|| ! strcmp(name, "ltfs.changeTime")
+		|| ! strcmp(name, "ltfs.backupTime")
+		|| ! strcmp(name, "ltfs.fileUID")
+		|| ! strcmp(name, "ltfs.volumeUUID")
+		|| ! strcmp(name, "ltfs.volumeName")
+		|| ! strcmp(name, "ltfs.driveCaptureDump")
+		|| ! strcmp(name, "ltfs.softwareVersion")
+		|| ! strcmp(name, "ltfs.softwareFormatSpec")
+		|| ! strcmp(name, "ltfs.softwareVendor")
+		|| ! strcmp(name, "ltfs.softwareProduct")
+		|| ! strcmp(name, "ltfs.mamBarcode")
+		|| ! strcmp(name, "ltfs.mamApplicationVendor")
+		|| ! strcmp(name, "ltfs.mamApplicationVersion")
+		|| ! strcmp(name, "ltfs.mamApplicationFormatVersion")
+		|| ! strcmp(name, "ltfs.volumeLockState")
+		)
+		return true;
+
+	if (old_is_worm_ea(name)) {
+		/* Treat WORM related EA as real EA */
+		return false;
+	}
+
+	/* xattrs on files */
+	if (! d->isdir) {
+		if (! TAILQ_EMPTY(&d->extentlist)
+			&& (! strcmp(name, "ltfs.partition") || ! strcmp(name, "ltfs.startblock")))
+			return true;
+	}
+
+	/* xattrs on the root dentry */
+	if (d == vol->index->root) {
+		if (vol->index->index_criteria.have_criteria && ! strcmp(name, "ltfs.policyMaxFileSize"))
+			return true;
+		if (! strcmp(name, "ltfs.commitMessage")
+			|| ! strcmp(name, "ltfs.indexVersion")
+			|| ! strcmp(name, "ltfs.labelVersion")
+			|| ! strcmp(name, "ltfs.sync")
+			|| ! strcmp(name, "ltfs.indexGeneration")
+			|| ! strcmp(name, "ltfs.indexTime")
+			|| ! strcmp(name, "ltfs.policyExists")
+			|| ! strcmp(name, "ltfs.policyAllowUpdate")
+			|| ! strcmp(name, "ltfs.volumeFormatTime")
+			|| ! strcmp(name, "ltfs.volumeBlocksize")
+			|| ! strcmp(name, "ltfs.volumeCompression")
+			|| ! strcmp(name, "ltfs.indexLocation")
+			|| ! strcmp(name, "ltfs.indexPrevious")
+			|| ! strcmp(name, "ltfs.indexCreator")
+			|| ! strcmp(name, "ltfs.labelCreator")
+			|| ! strcmp(name, "ltfs.partitionMap")
+			|| ! strcmp(name, "ltfs.volumeSerial")
+			|| ! strcmp(name, "ltfs.mediaLoads")
+			|| ! strcmp(name, "ltfs.mediaRecoveredWriteErrors")
+			|| ! strcmp(name, "ltfs.mediaPermanentWriteErrors")
+			|| ! strcmp(name, "ltfs.mediaRecoveredReadErrors")
+			|| ! strcmp(name, "ltfs.mediaPermanentReadErrors")
+			|| ! strcmp(name, "ltfs.mediaPreviousPermanentWriteErrors")
+			|| ! strcmp(name, "ltfs.mediaPreviousPermanentReadErrors")
+			|| ! strcmp(name, "ltfs.mediaBeginningMediumPasses")
+			|| ! strcmp(name, "ltfs.mediaMiddleMediumPasses")
+			|| ! strcmp(name, "ltfs.mediaEfficiency")
+			|| ! strcmp(name, "ltfs.mediaStorageAlert")
+			|| ! strcmp(name, "ltfs.mediaDatasetsWritten")
+			|| ! strcmp(name, "ltfs.mediaDatasetsRead")
+			|| ! strcmp(name, "ltfs.mediaMBWritten")
+			|| ! strcmp(name, "ltfs.mediaMBRead")
+			|| ! strcmp(name, "ltfs.mediaDataPartitionTotalCapacity")
+			|| ! strcmp(name, "ltfs.mediaDataPartitionAvailableSpace")
+			|| ! strcmp(name, "ltfs.mediaIndexPartitionTotalCapacity")
+			|| ! strcmp(name, "ltfs.mediaIndexPartitionAvailableSpace")
+			|| ! strcmp(name, "ltfs.mediaEncrypted")
+			|| ! strcmp(name, "ltfs.mediaPool.additionalInfo")
+			|| ! strcmp(name, "ltfs.driveEncryptionState")
+			|| ! strcmp(name, "ltfs.driveEncryptionMethod")
+			/* Vendor specific EAs */
+			|| ! strcmp(name, "ltfs.vendor.IBM.referencedBlocks")
+			|| ! strcmp(name, "ltfs.vendor.IBM.trace")
+			|| ! strcmp(name, "ltfs.vendor.IBM.totalBlocks")
+			|| ! strcmp(name, "ltfs.vendor.IBM.cartridgeMountNode")
+			|| ! strcmp(name, "ltfs.vendor.IBM.logLevel")
+			|| ! strcmp(name, "ltfs.vendor.IBM.syslogLevel")
+			|| ! strcmp(name, "ltfs.vendor.IBM.rao")
+			|| ! strcmp(name, "ltfs.vendor.IBM.logPage")
+			|| ! strcmp(name, "ltfs.vendor.IBM.mediaMAM")
+			|| ! strncmp(name, "ltfs.vendor", strlen("ltfs.vendor")))
+			return true;
+	}
+
+	return false;
+}
+
+/* Every name the old chain knew, plus names that are close to them or must stay real EAs */
+static const char *names[] = {
+	"ltfs.createTime", "ltfs.modifyTime", "ltfs.accessTime", "ltfs.changeTime",
+	"ltfs.backupTime", "ltfs.fileUID", "ltfs.volumeUUID", "ltfs.volumeName",
+	"ltfs.driveCaptureDump", "ltfs.softwareVersion", "ltfs.softwareFormatSpec",
+	"ltfs.softwareVendor", "ltfs.softwareProduct", "ltfs.mamBarcode",
+	"ltfs.mamApplicationVendor", "ltfs.mamApplicationVersion",
+	"ltfs.mamApplicationFormatVersion", "ltfs.volumeLockState",
+	"ltfs.partition", "ltfs.startblock",
+	"ltfs.policyMaxFileSize", "ltfs.commitMessage", "ltfs.indexVersion", "ltfs.labelVersion",
+	"ltfs.sync", "ltfs.indexGeneration", "ltfs.indexTime", "ltfs.policyExists",
+	"ltfs.policyAllowUpdate", "ltfs.volumeFormatTime", "ltfs.volumeBlocksize",
+	"ltfs.volumeCompression", "ltfs.indexLocation", "ltfs.indexPrevious", "ltfs.indexCreator",
+	"ltfs.labelCreator", "ltfs.partitionMap", "ltfs.volumeSerial", "ltfs.mediaLoads",
+	"ltfs.mediaRecoveredWriteErrors", "ltfs.mediaPermanentWriteErrors",
+	"ltfs.mediaRecoveredReadErrors", "ltfs.mediaPermanentReadErrors",
+	"ltfs.mediaPreviousPermanentWriteErrors", "ltfs.mediaPreviousPermanentReadErrors",
+	"ltfs.mediaBeginningMediumPasses", "ltfs.mediaMiddleMediumPasses", "ltfs.mediaEfficiency",
+	"ltfs.mediaStorageAlert", "ltfs.mediaDatasetsWritten", "ltfs.mediaDatasetsRead",
+	"ltfs.mediaMBWritten", "ltfs.mediaMBRead", "ltfs.mediaDataPartitionTotalCapacity",
+	"ltfs.mediaDataPartitionAvailableSpace", "ltfs.mediaIndexPartitionTotalCapacity",
+	"ltfs.mediaIndexPartitionAvailableSpace", "ltfs.mediaEncrypted",
+	"ltfs.mediaPool.additionalInfo", "ltfs.driveEncryptionState", "ltfs.driveEncryptionMethod",
+	"ltfs.vendor.IBM.referencedBlocks", "ltfs.vendor.IBM.trace", "ltfs.vendor.IBM.totalBlocks",
+	"ltfs.vendor.IBM.cartridgeMountNode", "ltfs.vendor.IBM.logLevel",
+	"ltfs.vendor.IBM.syslogLevel", "ltfs.vendor.IBM.rao", "ltfs.vendor.IBM.logPage",
+	"ltfs.vendor.IBM.mediaMAM", "ltfs.vendor.IBM.profiler", "ltfs.vendor.IBM.lockProfile",
+	"ltfs.vendor.IBM.dump", "ltfs.vendor.IBM.dumpTrace", "ltfs.vendor.IBM.immutablX",
+	/* Real EAs */
+	"ltfs.vendor.IBM.immutable", "ltfs.vendor.IBM.appendonly",
+	"ltfs.permissions.unix", "ltfs.hash.sha256sum", "ltfs.spannedFileOffset",
+	"user.name", "comment", "",
+	/* Prefixes and near misses */
+	"ltfs", "ltfs.", "ltfs.vendor", "ltfs.vendor.", "ltfs.vendorX", "ltfs.vendor.ACME.x",
+	"LTFS.sync", "ltfs.SYNC", "ltfs.Sync", "ltfs.createtime", "ltfs.mediapool.additionalInfo",
+};
+
+#define NAME_COUNT (sizeof(names) / sizeof(names[0]))
+
+static void compare_one(struct dentry *d, const char *name, struct ltfs_volume *vol)
+{
+	if (xattr_is_virtual(d, name, vol) != old_is_virtual(d, name, vol)) {
+		fprintf(stderr, "Mismatch for \"%s\" on %s (criteria %d)\n", name,
+			d->name.name ? d->name.name : "/", vol->index->index_criteria.have_criteria);
+		++failures;
+	}
+}
+
+/* Compare the old and new answers for a name and for its truncated and extended forms */
+static void compare(struct dentry *d, const char *name, struct ltfs_volume *vol)
+{
+	char buf[128];
+	size_t len = strlen(name);
+
+	compare_one(d, name, vol);
+	if (len > 0 && len < sizeof(buf) - 1) {
+		memcpy(buf, name, len - 1);
+		buf[len - 1] = '\0';
+		compare_one(d, buf, vol);
+		memcpy(buf, name, len);
+		buf[len] = 'X';
+		buf[len + 1] = '\0';
+		compare_one(d, buf, vol);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int ret, criteria;
+	size_t i, j;
+	bool on_file;
+	struct ltfs_volume *vol = NULL;
+	struct ltfs_index *idx;
+	struct dentry *dentries[4];
+	struct extent_info *ext = NULL;
+
+	ret = ltfs_init(LTFS_ERR, false, false);
+	if (ret == 0)
+		ret = ltfs_volume_alloc("test_xattr_virtual", &vol);
+	if (ret == 0)
+		ret = ltfs_index_alloc(&vol->index, vol);
+	if (ret == 0) {
+		idx = vol->index;
+		dentries[0] = idx->root;
+		dentries[1] = fs_allocate_dentry(idx->root, "dir", NULL, true, false, true, idx);
+		dentries[2] = fs_allocate_dentry(idx->root, "empty", NULL, false, false, true, idx);
+		dentries[3] = fs_allocate_dentry(idx->root, "file", NULL, false, false, true, idx);
+		if (dentries[3])
+			ext = calloc(1, sizeof(struct extent_info));
+		if (! dentries[1] || ! dentries[2] || ! ext)
+			ret = -LTFS_NO_MEMORY;
+	}
+	if (ret < 0) {
+		fprintf(stderr, "Cannot set up the volume (%d)\n", ret);
+		return 1;
+	}
+	ext->start.partition = 'b';
+	ext->start.block = 10;
+	ext->bytecount = 4096;
+	TAILQ_INSERT_TAIL(&dentries[3]->extentlist, ext, list);
+	dentries[3]->size = 4096;
+
+	for (criteria = 0; criteria < 2; ++criteria) {
+		idx->index_criteria.have_criteria = criteria;
+		for (i = 0; i < sizeof(dentries) / sizeof(dentries[0]); ++i)
+			for (j = 0; j < NAME_COUNT; ++j)
+				compare(dentries[i], names[j], vol);
+	}
+
+	/* Only the attributes the old code read under the contents lock depend on the extents */
+	for (j = 0; j < NAME_COUNT; ++j) {
+		on_file = xattr_is_virtual(dentries[3], names[j], vol)
+			&& ! xattr_is_virtual(dentries[2], names[j], vol);
+		CHECK(on_file == (! strcmp(names[j], "ltfs.partition")
+			|| ! strcmp(names[j], "ltfs.startblock")));
+	}
+
+	ltfs_volume_free(&vol);
+	ltfs_finish();
+
+	if (test_failed("checks failed"))
+		return 1;
+	printf("%zu names agree on every dentry\n", NAME_COUNT);
+	return 0;
+}